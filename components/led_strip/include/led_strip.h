@@ -6,8 +6,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "led_strip_rmt.h"
+#include "led_strip_spi.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +51,59 @@ esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t
  */
 esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
 
+/**
+ * @brief Set consecutive pixels from an RGB buffer
+ *
+ * @note The pixels are converted to the wire order of the strip and through the brightness and gamma correction in one pass,
+ *       instead of one `led_strip_set_pixel` call per pixel. The white component of RGBW strips is set to 0.
+ *
+ * @param strip: LED strip
+ * @param start: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param rgb: pixels, 3 bytes each in the order red, green, blue
+ *
+ * @return
+ *      - ESP_OK: Set the pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters, or pixels out of the strip
+ *      - ESP_FAIL: Set the pixels failed because other error occurred
+ */
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *rgb);
+
+/**
+ * @brief Set consecutive pixels from an RGBW buffer
+ *
+ * @note Only call this function if your led strip does have the white component (e.g. SK6812-RGBW)
+ *
+ * @param strip: LED strip
+ * @param start: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param rgbw: pixels, 4 bytes each in the order red, green, blue, white
+ *
+ * @return
+ *      - ESP_OK: Set the pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of invalid parameters, pixels out of the strip or a strip without white
+ *      - ESP_FAIL: Set the pixels failed because other error occurred
+ */
+esp_err_t led_strip_set_pixels_rgbw(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *rgbw);
+
+/**
+ * @brief Set the brightness and gamma correction applied to the colours
+ *
+ * @note The correction applies to the pixels set afterwards, by every set pixel function, the pixels already set keep their colour.
+ *       It is a 256 bytes table per strip, built from a compile time gamma table (2.8): the brightness scales the colour
+ *       components first, then the gamma correction maps them to the LED PWM duty.
+ *
+ * @param strip: LED strip
+ * @param brightness: brightness, 255 for full brightness
+ * @param gamma: whether to apply the gamma correction
+ *
+ * @return
+ *      - ESP_OK: Set the correction successfully
+ *      - ESP_ERR_INVALID_ARG: Set the correction failed because of invalid parameters
+ *      - ESP_ERR_NOT_SUPPORTED: The backend has no colour correction
+ */
+esp_err_t led_strip_set_correction(led_strip_handle_t strip, uint8_t brightness, bool gamma);
+
 /**
  * @brief Refresh memory colors to LEDs
  *
@@ -63,6 +118,36 @@ esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uin
  */
 esp_err_t led_strip_refresh(led_strip_handle_t strip);
 
+/**
+ * @brief Queue the memory colors for the LEDs and return without waiting for the transmission
+ *
+ * @param strip: LED strip
+ * @param done_cb: callback invoked once the frame has been sent out, can be NULL
+ * @param user_ctx: user context passed to the callback
+ *
+ * @return
+ *      - ESP_OK: Frame queued, or skipped because the pixels did not change since the last frame
+ *      - ESP_ERR_INVALID_STATE: Every transmission slot is in use, retry once a frame is done
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note:
+ *      The pixels are copied, so they can be updated again as soon as this function returns.
+ *      Backends without asynchronous support refresh synchronously, then invoke the callback.
+ */
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip, led_strip_refresh_done_cb_t done_cb, void *user_ctx);
+
+/**
+ * @brief Wait for the frames queued by `led_strip_refresh_async` to be sent out
+ *
+ * @param strip: LED strip
+ * @param timeout_ms: maximum time to wait, -1 to wait forever
+ *
+ * @return
+ *      - ESP_OK: All the frames have been sent out
+ *      - ESP_ERR_TIMEOUT: Frames are still pending after the timeout
+ */
+esp_err_t led_strip_wait_refresh_done(led_strip_handle_t strip, int32_t timeout_ms);
+
 /**
  * @brief Clear LED strip (turn off all LEDs)
  *
@@ -40,6 +40,51 @@ typedef struct {
  */
 esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip);
 
+/**
+ * @brief Type of LED strip group handle
+ */
+typedef struct led_strip_rmt_group_t *led_strip_rmt_group_handle_t;
+
+/**
+ * @brief Group LED strips created by `led_strip_new_rmt_device`, so that they are refreshed together
+ *
+ * @note The strips start sending their frames at the same time, with the RMT sync manager on the chips
+ *       that have one, so a group refresh takes as long as the longest strip.
+ * @note While they are in the group, the strips are only refreshed by `led_strip_rmt_group_refresh`:
+ *       `led_strip_refresh`, `led_strip_refresh_async`, `led_strip_clear` and `led_strip_del` fail with ESP_ERR_INVALID_STATE.
+ *
+ * @param strips LED strips to group, on different RMT channels
+ * @param num_strips Number of strips, at most the number of RMT TX channels of the chip
+ * @param ret_group Returned LED strip group handle
+ * @return
+ *      - ESP_OK: create LED strip group successfully
+ *      - ESP_ERR_INVALID_ARG: create LED strip group failed because of invalid argument, or a strip not based on RMT
+ *      - ESP_ERR_INVALID_STATE: create LED strip group failed because a strip is already in a group
+ *      - ESP_ERR_NO_MEM: create LED strip group failed because of out of memory
+ *      - ESP_FAIL: create LED strip group failed because some other error
+ */
+esp_err_t led_strip_new_rmt_group(const led_strip_handle_t *strips, size_t num_strips, led_strip_rmt_group_handle_t *ret_group);
+
+/**
+ * @brief Send the pixels of every strip of the group, and wait until all of them are out
+ *
+ * @param group LED strip group
+ * @return
+ *      - ESP_OK: Refresh successfully
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ */
+esp_err_t led_strip_rmt_group_refresh(led_strip_rmt_group_handle_t group);
+
+/**
+ * @brief Delete the LED strip group, the strips are refreshed on their own again
+ *
+ * @param group LED strip group
+ * @return
+ *      - ESP_OK: Delete successfully
+ *      - ESP_FAIL: Delete failed because some other error occurred
+ */
+esp_err_t led_strip_del_rmt_group(led_strip_rmt_group_handle_t group);
+
 #ifdef __cplusplus
 }
 #endif
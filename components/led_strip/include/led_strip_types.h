@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,19 @@ typedef enum {
  */
 typedef struct led_strip_t *led_strip_handle_t;
 
+/**
+ * @brief Callback invoked once a frame queued by `led_strip_refresh_async` has been sent out
+ *
+ * @param strip: LED strip
+ * @param user_ctx: user context passed to `led_strip_refresh_async`
+ *
+ * @return Whether a high priority task has been woken up by this callback
+ *
+ * @note With the RMT backend the callback runs in the RMT interrupt context, it must not block.
+ *       When the frame is skipped because the pixels did not change, it runs in the caller context.
+ */
+typedef bool (*led_strip_refresh_done_cb_t)(led_strip_handle_t strip, void *user_ctx);
+
 /**
  * @brief LED Strip Configuration
  */
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include "esp_err.h"
+#include "led_strip_types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,6 +52,37 @@ struct led_strip_t {
      */
     esp_err_t (*set_pixel_rgbw)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
 
+    /**
+     * @brief Set consecutive pixels from a buffer, converted to the wire order of the strip in one pass
+     *
+     * @param strip: LED strip
+     * @param start: index of the first pixel to set
+     * @param count: number of pixels to set
+     * @param pixels: RGB or RGBW pixels
+     * @param bytes_per_pixel: 3 for RGB pixels, 4 for RGBW pixels
+     *
+     * @return
+     *      - ESP_OK: Set the pixels successfully
+     *      - ESP_ERR_INVALID_ARG: Set the pixels failed because of an invalid argument
+     *
+     * @note This member is optional, `led_strip_set_pixels` falls back to `set_pixel` and `set_pixel_rgbw` when it is NULL.
+     */
+    esp_err_t (*set_pixels)(led_strip_t *strip, uint32_t start, uint32_t count, const uint8_t *pixels, uint8_t bytes_per_pixel);
+
+    /**
+     * @brief Set the brightness and gamma correction of the colours set from now on
+     *
+     * @param strip: LED strip
+     * @param brightness: brightness, 255 for full brightness
+     * @param gamma: whether to apply the gamma correction
+     *
+     * @return
+     *      - ESP_OK: Set the correction successfully
+     *
+     * @note This member is optional, `led_strip_set_correction` returns ESP_ERR_NOT_SUPPORTED when it is NULL.
+     */
+    esp_err_t (*set_correction)(led_strip_t *strip, uint8_t brightness, bool gamma);
+
     /**
      * @brief Refresh memory colors to LEDs
      *
@@ -66,6 +98,36 @@ struct led_strip_t {
      */
     esp_err_t (*refresh)(led_strip_t *strip);
 
+    /**
+     * @brief Queue the memory colors for the LEDs without waiting for the transmission
+     *
+     * @param strip: LED strip
+     * @param done_cb: callback invoked once the frame has been sent out, can be NULL
+     * @param user_ctx: user context passed to the callback
+     *
+     * @return
+     *      - ESP_OK: Frame queued, or skipped because the pixels did not change since the last frame
+     *      - ESP_ERR_INVALID_STATE: Every transmission slot is in use
+     *      - ESP_FAIL: Refresh failed because some other error occurred
+     *
+     * @note This member is optional, `led_strip_refresh_async` falls back to `refresh` when it is NULL.
+     */
+    esp_err_t (*refresh_async)(led_strip_t *strip, led_strip_refresh_done_cb_t done_cb, void *user_ctx);
+
+    /**
+     * @brief Wait for the frames queued by `refresh_async` to be sent out
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: maximum time to wait, -1 to wait forever
+     *
+     * @return
+     *      - ESP_OK: All the frames have been sent out
+     *      - ESP_ERR_TIMEOUT: Frames are still pending after the timeout
+     *
+     * @note This member is optional, it must be set together with `refresh_async`.
+     */
+    esp_err_t (*wait_refresh_done)(led_strip_t *strip, int32_t timeout_ms);
+
     /**
      * @brief Clear LED strip (turn off all LEDs)
      *
@@ -22,12 +22,70 @@ esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uin
     return strip->set_pixel_rgbw(strip, index, red, green, blue, white);
 }
 
+static esp_err_t led_strip_set_pixels_common(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *pixels, uint8_t bytes_per_pixel)
+{
+    ESP_RETURN_ON_FALSE(strip && (pixels || count == 0), ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (strip->set_pixels) {
+        return strip->set_pixels(strip, start, count, pixels, bytes_per_pixel);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *pixel = pixels + i * bytes_per_pixel;
+        if (bytes_per_pixel == 4) {
+            ESP_RETURN_ON_ERROR(strip->set_pixel_rgbw(strip, start + i, pixel[0], pixel[1], pixel[2], pixel[3]), TAG, "set pixel failed");
+        } else {
+            ESP_RETURN_ON_ERROR(strip->set_pixel(strip, start + i, pixel[0], pixel[1], pixel[2]), TAG, "set pixel failed");
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *rgb)
+{
+    return led_strip_set_pixels_common(strip, start, count, rgb, 3);
+}
+
+esp_err_t led_strip_set_pixels_rgbw(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *rgbw)
+{
+    return led_strip_set_pixels_common(strip, start, count, rgbw, 4);
+}
+
+esp_err_t led_strip_set_correction(led_strip_handle_t strip, uint8_t brightness, bool gamma)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (!strip->set_correction) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return strip->set_correction(strip, brightness, gamma);
+}
+
 esp_err_t led_strip_refresh(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
     return strip->refresh(strip);
 }
 
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip, led_strip_refresh_done_cb_t done_cb, void *user_ctx)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (!strip->refresh_async) {
+        ESP_RETURN_ON_ERROR(strip->refresh(strip), TAG, "refresh failed");
+        if (done_cb) {
+            done_cb(strip, user_ctx);
+        }
+        return ESP_OK;
+    }
+    return strip->refresh_async(strip, done_cb, user_ctx);
+}
+
+esp_err_t led_strip_wait_refresh_done(led_strip_handle_t strip, int32_t timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (!strip->wait_refresh_done) {
+        return ESP_OK;
+    }
+    return strip->wait_refresh_done(strip, timeout_ms);
+}
+
 esp_err_t led_strip_clear(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
@@ -0,0 +1,52 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include "led_strip_correction.h"
+
+// round(255 * (i / 255) ^ 2.8)
+static const uint8_t s_gamma_lut[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+      2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+      5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+     10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+     25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+     37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+     51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+     69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+     90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+    115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+    144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+    177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+    215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+void led_strip_correction_init(led_strip_correction_t *correction, uint8_t brightness, bool gamma)
+{
+    for (int i = 0; i < 256; i++) {
+        // brightness 255 keeps the value as it is
+        uint8_t scaled = (uint8_t)((i * (brightness + 1)) >> 8);
+        correction->table[i] = gamma ? s_gamma_lut[scaled] : scaled;
+    }
+}
+
+void led_strip_correction_convert(const led_strip_correction_t *correction, const uint8_t *src, uint8_t src_bytes_per_pixel,
+                                  uint32_t count, uint8_t *dst, uint8_t dst_bytes_per_pixel)
+{
+    const uint8_t *table = correction->table;
+    for (uint32_t i = 0; i < count; i++) {
+        // In the order of GRB(W), as LED strip like WS2812 sends out pixels in this order
+        dst[0] = table[src[1]];
+        dst[1] = table[src[0]];
+        dst[2] = table[src[2]];
+        if (dst_bytes_per_pixel > 3) {
+            dst[3] = src_bytes_per_pixel > 3 ? table[src[3]] : 0;
+        }
+        src += src_bytes_per_pixel;
+        dst += dst_bytes_per_pixel;
+    }
+}
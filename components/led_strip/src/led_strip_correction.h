@@ -0,0 +1,46 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Colour correction of a strip: every colour byte goes through `table`, brightness first then gamma
+ */
+typedef struct {
+    uint8_t table[256]; /*!< Corrected value of every byte value, the identity without correction */
+} led_strip_correction_t;
+
+/**
+ * @brief Build the correction table of a brightness and gamma setting
+ *
+ * @param[out] correction Correction to build
+ * @param[in] brightness Brightness, 255 for full brightness
+ * @param[in] gamma Whether to apply the gamma correction (2.8) of the compile time table
+ */
+void led_strip_correction_init(led_strip_correction_t *correction, uint8_t brightness, bool gamma);
+
+/**
+ * @brief Convert pixels to the wire order of the strip, GRB or GRBW, through the correction, in one pass
+ *
+ * @param[in] correction Correction
+ * @param[in] src Pixels, RGB or RGBW
+ * @param[in] src_bytes_per_pixel 3 for RGB, 4 for RGBW
+ * @param[in] count Number of pixels
+ * @param[out] dst Pixels in the wire order
+ * @param[in] dst_bytes_per_pixel 3 for GRB, 4 for GRBW, the white of RGB pixels is 0
+ */
+void led_strip_correction_convert(const led_strip_correction_t *correction, const uint8_t *src, uint8_t src_bytes_per_pixel,
+                                  uint32_t count, uint8_t *dst, uint8_t dst_bytes_per_pixel);
+
+#ifdef __cplusplus
+}
+#endif
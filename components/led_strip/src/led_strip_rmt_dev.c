@@ -5,13 +5,16 @@
  */
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
 #include <sys/cdefs.h>
 #include "esp_log.h"
 #include "esp_check.h"
 #include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
 #include "led_strip.h"
 #include "led_strip_interface.h"
 #include "led_strip_rmt_encoder.h"
+#include "led_strip_correction.h"
 
 #define LED_STRIP_RMT_DEFAULT_RESOLUTION 10000000 // 10MHz resolution
 #define LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE 4
@@ -21,29 +24,70 @@
 #else
 #define LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS 48
 #endif
+// with DMA the default memory block holds a whole frame, up to this size, so that it is encoded in one go
+#define LED_STRIP_RMT_DMA_MAX_MEM_BLOCK_SYMBOLS 1024
+// pixels converted on the stack at a time by set_pixels, to compare them with the frame
+#define LED_STRIP_RMT_SET_PIXELS_CHUNK 32
 
 static const char *TAG = "led_strip_rmt";
 
+/**
+ * @brief A transmission queued on the RMT channel
+ *
+ * RMT transactions complete in order, so the slots form a ring: the task pushes at `head`,
+ * the RMT done interrupt pops at `tail`.
+ */
+typedef struct {
+    led_strip_refresh_done_cb_t done_cb;
+    void *user_ctx;
+} led_strip_rmt_slot_t;
+
+typedef struct led_strip_rmt_group_t led_strip_rmt_group_t;
+
 typedef struct {
     led_strip_t base;
     rmt_channel_handle_t rmt_chan;
     rmt_encoder_handle_t strip_encoder;
     uint32_t strip_len;
     uint8_t bytes_per_pixel;
+    bool dirty;                 // pixels changed since the last frame
+    uint8_t *frames;            // one frame copy per slot, allocated by the first asynchronous refresh
+    atomic_uint head;           // slots pushed
+    atomic_uint tail;           // slots done
+    led_strip_rmt_slot_t slots[LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE];
+    led_strip_rmt_group_t *group; // the group that refreshes the strip, NULL if none
+    led_strip_correction_t correction;
     uint8_t pixel_buf[];
 } led_strip_rmt_obj;
 
+struct led_strip_rmt_group_t {
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+    rmt_sync_manager_handle_t sync; // holds the start of the channels until all of them have a frame
+#endif
+    size_t num_strips;
+    led_strip_rmt_obj *strips[];
+};
+
+static void led_strip_rmt_write(led_strip_rmt_obj *rmt_strip, uint8_t *dst, uint8_t value)
+{
+    if (*dst != value) {
+        *dst = value;
+        rmt_strip->dirty = true;
+    }
+}
+
 static esp_err_t led_strip_rmt_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
     ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
     uint32_t start = index * rmt_strip->bytes_per_pixel;
+    const uint8_t *table = rmt_strip->correction.table;
     // In thr order of GRB, as LED strip like WS2812 sends out pixels in this order
-    rmt_strip->pixel_buf[start + 0] = green & 0xFF;
-    rmt_strip->pixel_buf[start + 1] = red & 0xFF;
-    rmt_strip->pixel_buf[start + 2] = blue & 0xFF;
+    led_strip_rmt_write(rmt_strip, &rmt_strip->pixel_buf[start + 0], table[green & 0xFF]);
+    led_strip_rmt_write(rmt_strip, &rmt_strip->pixel_buf[start + 1], table[red & 0xFF]);
+    led_strip_rmt_write(rmt_strip, &rmt_strip->pixel_buf[start + 2], table[blue & 0xFF]);
     if (rmt_strip->bytes_per_pixel > 3) {
-        rmt_strip->pixel_buf[start + 3] = 0;
+        led_strip_rmt_write(rmt_strip, &rmt_strip->pixel_buf[start + 3], 0);
     }
     return ESP_OK;
 }
@@ -54,32 +98,139 @@ static esp_err_t led_strip_rmt_set_pixel_rgbw(led_strip_t *strip, uint32_t index
     ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
     ESP_RETURN_ON_FALSE(rmt_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
     uint8_t *buf_start = rmt_strip->pixel_buf + index * 4;
+    const uint8_t *table = rmt_strip->correction.table;
     // SK6812 component order is GRBW
-    *buf_start = green & 0xFF;
-    *++buf_start = red & 0xFF;
-    *++buf_start = blue & 0xFF;
-    *++buf_start = white & 0xFF;
+    led_strip_rmt_write(rmt_strip, buf_start, table[green & 0xFF]);
+    led_strip_rmt_write(rmt_strip, ++buf_start, table[red & 0xFF]);
+    led_strip_rmt_write(rmt_strip, ++buf_start, table[blue & 0xFF]);
+    led_strip_rmt_write(rmt_strip, ++buf_start, table[white & 0xFF]);
     return ESP_OK;
 }
 
-static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+static esp_err_t led_strip_rmt_set_pixels(led_strip_t *strip, uint32_t start, uint32_t count, const uint8_t *pixels, uint8_t bytes_per_pixel)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(start <= rmt_strip->strip_len && count <= rmt_strip->strip_len - start, ESP_ERR_INVALID_ARG, TAG, "pixels out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(bytes_per_pixel == 3 || rmt_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
+    uint8_t *dst = rmt_strip->pixel_buf + start * rmt_strip->bytes_per_pixel;
+    if (rmt_strip->dirty) {
+        // the next frame is sent anyway, no need to know whether the pixels change
+        led_strip_correction_convert(&rmt_strip->correction, pixels, bytes_per_pixel, count, dst, rmt_strip->bytes_per_pixel);
+        return ESP_OK;
+    }
+    uint8_t chunk[LED_STRIP_RMT_SET_PIXELS_CHUNK * 4];
+    while (count > 0) {
+        uint32_t n = count < LED_STRIP_RMT_SET_PIXELS_CHUNK ? count : LED_STRIP_RMT_SET_PIXELS_CHUNK;
+        size_t size = n * rmt_strip->bytes_per_pixel;
+        led_strip_correction_convert(&rmt_strip->correction, pixels, bytes_per_pixel, n, chunk, rmt_strip->bytes_per_pixel);
+        if (memcmp(dst, chunk, size) != 0) {
+            memcpy(dst, chunk, size);
+            rmt_strip->dirty = true;
+        }
+        pixels += n * bytes_per_pixel;
+        dst += size;
+        count -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_correction(led_strip_t *strip, uint8_t brightness, bool gamma)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    led_strip_correction_init(&rmt_strip->correction, brightness, gamma);
+    return ESP_OK;
+}
+
+static bool led_strip_rmt_trans_done(rmt_channel_handle_t tx_chan, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = (led_strip_rmt_obj *)user_ctx;
+    unsigned int tail = atomic_load(&rmt_strip->tail);
+    led_strip_rmt_slot_t slot = rmt_strip->slots[tail % LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE];
+    // release the slot before the callback, so that it can queue the next frame
+    atomic_store(&rmt_strip->tail, tail + 1);
+    if (slot.done_cb) {
+        return slot.done_cb(&rmt_strip->base, slot.user_ctx);
+    }
+    return false;
+}
+
+/**
+ * @brief Queue a frame on the channel, which stays enabled between refreshes
+ */
+static esp_err_t led_strip_rmt_queue(led_strip_rmt_obj *rmt_strip, const uint8_t *frame, led_strip_refresh_done_cb_t done_cb, void *user_ctx)
+{
     rmt_transmit_config_t tx_conf = {
         .loop_count = 0,
+        .flags.queue_nonblocking = true,
     };
+    unsigned int head = atomic_load(&rmt_strip->head);
+    rmt_strip->slots[head % LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE] = (led_strip_rmt_slot_t) {
+        .done_cb = done_cb,
+        .user_ctx = user_ctx,
+    };
+    // publish the slot first: the done interrupt can fire before rmt_transmit returns
+    atomic_store(&rmt_strip->head, head + 1);
+    esp_err_t ret = rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, frame,
+                                 rmt_strip->strip_len * rmt_strip->bytes_per_pixel, &tx_conf);
+    if (ret != ESP_OK) {
+        // nothing was queued after this slot, take it back
+        atomic_store(&rmt_strip->head, head);
+    }
+    return ret;
+}
 
-    ESP_RETURN_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), TAG, "enable RMT channel failed");
-    ESP_RETURN_ON_ERROR(rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, rmt_strip->pixel_buf,
-                                     rmt_strip->strip_len * rmt_strip->bytes_per_pixel, &tx_conf), TAG, "transmit pixels by RMT failed");
+static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(!rmt_strip->group, ESP_ERR_INVALID_STATE, TAG, "strip is refreshed by its group");
+    if (atomic_load(&rmt_strip->head) - atomic_load(&rmt_strip->tail) >= LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE) {
+        // every slot is taken by asynchronous frames
+        ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    }
+    ESP_RETURN_ON_ERROR(led_strip_rmt_queue(rmt_strip, rmt_strip->pixel_buf, NULL, NULL), TAG, "transmit pixels by RMT failed");
     ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
-    ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+    rmt_strip->dirty = false;
     return ESP_OK;
 }
 
+static esp_err_t led_strip_rmt_refresh_async(led_strip_t *strip, led_strip_refresh_done_cb_t done_cb, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(!rmt_strip->group, ESP_ERR_INVALID_STATE, TAG, "strip is refreshed by its group");
+    size_t frame_size = rmt_strip->strip_len * rmt_strip->bytes_per_pixel;
+    if (!rmt_strip->dirty) {
+        // the strip already shows these pixels, or will once the queued frames are out
+        if (done_cb) {
+            done_cb(strip, user_ctx);
+        }
+        return ESP_OK;
+    }
+    if (!rmt_strip->frames) {
+        rmt_strip->frames = malloc(frame_size * LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE);
+        ESP_RETURN_ON_FALSE(rmt_strip->frames, ESP_ERR_NO_MEM, TAG, "no mem for frame buffers");
+    }
+    unsigned int head = atomic_load(&rmt_strip->head);
+    if (head - atomic_load(&rmt_strip->tail) >= LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // the slot's frame is free: its previous transmission is done
+    uint8_t *frame = rmt_strip->frames + (head % LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE) * frame_size;
+    memcpy(frame, rmt_strip->pixel_buf, frame_size);
+    ESP_RETURN_ON_ERROR(led_strip_rmt_queue(rmt_strip, frame, done_cb, user_ctx), TAG, "transmit pixels by RMT failed");
+    rmt_strip->dirty = false;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_wait_refresh_done(led_strip_t *strip, int32_t timeout_ms)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    return rmt_tx_wait_all_done(rmt_strip->rmt_chan, timeout_ms);
+}
+
 static esp_err_t led_strip_rmt_clear(led_strip_t *strip)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(!rmt_strip->group, ESP_ERR_INVALID_STATE, TAG, "strip is refreshed by its group");
     // Write zero to turn off all leds
     memset(rmt_strip->pixel_buf, 0, rmt_strip->strip_len * rmt_strip->bytes_per_pixel);
     return led_strip_rmt_refresh(strip);
@@ -88,8 +239,12 @@ static esp_err_t led_strip_rmt_clear(led_strip_t *strip)
 static esp_err_t led_strip_rmt_del(led_strip_t *strip)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(!rmt_strip->group, ESP_ERR_INVALID_STATE, TAG, "strip is in a group");
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
     ESP_RETURN_ON_ERROR(rmt_del_channel(rmt_strip->rmt_chan), TAG, "delete RMT channel failed");
     ESP_RETURN_ON_ERROR(rmt_del_encoder(rmt_strip->strip_encoder), TAG, "delete strip encoder failed");
+    free(rmt_strip->frames);
     free(rmt_strip);
     return ESP_OK;
 }
@@ -118,6 +273,16 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
         clk_src = rmt_config->clk_src;
     }
     size_t mem_block_symbols = LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS;
+    if (rmt_config->flags.with_dma) {
+        // the pixel symbols and the reset code, rounded up to an even number of symbols
+        size_t frame_symbols = (led_config->max_leds * bytes_per_pixel * 8 + 2) & ~(size_t)1;
+        if (frame_symbols > LED_STRIP_RMT_DMA_MAX_MEM_BLOCK_SYMBOLS) {
+            frame_symbols = LED_STRIP_RMT_DMA_MAX_MEM_BLOCK_SYMBOLS;
+        }
+        if (frame_symbols > mem_block_symbols) {
+            mem_block_symbols = frame_symbols;
+        }
+    }
     // override the default value if the user sets it
     if (rmt_config->mem_block_symbols) {
         mem_block_symbols = rmt_config->mem_block_symbols;
@@ -135,16 +300,29 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
 
     led_strip_encoder_config_t strip_encoder_conf = {
         .resolution = resolution,
-        .led_model = led_config->led_model
+        .led_model = led_config->led_model,
+        .bytes_per_pixel = bytes_per_pixel,
     };
     ESP_GOTO_ON_ERROR(rmt_new_led_strip_encoder(&strip_encoder_conf, &rmt_strip->strip_encoder), err, TAG, "create LED strip encoder failed");
 
+    // the channel stays enabled for the lifetime of the strip, so that refreshes can be queued
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = led_strip_rmt_trans_done,
+    };
+    ESP_GOTO_ON_ERROR(rmt_tx_register_event_callbacks(rmt_strip->rmt_chan, &cbs, rmt_strip), err, TAG, "register RMT callbacks failed");
+    ESP_GOTO_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), err, TAG, "enable RMT channel failed");
 
     rmt_strip->bytes_per_pixel = bytes_per_pixel;
     rmt_strip->strip_len = led_config->max_leds;
+    rmt_strip->dirty = true; // the LEDs state is unknown until the first frame
+    led_strip_correction_init(&rmt_strip->correction, 255, false);
     rmt_strip->base.set_pixel = led_strip_rmt_set_pixel;
     rmt_strip->base.set_pixel_rgbw = led_strip_rmt_set_pixel_rgbw;
+    rmt_strip->base.set_pixels = led_strip_rmt_set_pixels;
+    rmt_strip->base.set_correction = led_strip_rmt_set_correction;
     rmt_strip->base.refresh = led_strip_rmt_refresh;
+    rmt_strip->base.refresh_async = led_strip_rmt_refresh_async;
+    rmt_strip->base.wait_refresh_done = led_strip_rmt_wait_refresh_done;
     rmt_strip->base.clear = led_strip_rmt_clear;
     rmt_strip->base.del = led_strip_rmt_del;
 
@@ -162,3 +340,88 @@ err:
     }
     return ret;
 }
+
+esp_err_t led_strip_new_rmt_group(const led_strip_handle_t *strips, size_t num_strips, led_strip_rmt_group_handle_t *ret_group)
+{
+    led_strip_rmt_group_t *group = NULL;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(strips && num_strips && ret_group, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    group = calloc(1, sizeof(led_strip_rmt_group_t) + num_strips * sizeof(led_strip_rmt_obj *));
+    ESP_GOTO_ON_FALSE(group, ESP_ERR_NO_MEM, err, TAG, "no mem for strip group");
+    for (size_t i = 0; i < num_strips; i++) {
+        ESP_GOTO_ON_FALSE(strips[i] && strips[i]->refresh == led_strip_rmt_refresh, ESP_ERR_INVALID_ARG, err, TAG, "strip %zu is not based on RMT", i);
+        led_strip_rmt_obj *rmt_strip = __containerof(strips[i], led_strip_rmt_obj, base);
+        ESP_GOTO_ON_FALSE(!rmt_strip->group, ESP_ERR_INVALID_STATE, err, TAG, "strip %zu is already in a group", i);
+        for (size_t j = 0; j < i; j++) {
+            ESP_GOTO_ON_FALSE(group->strips[j] != rmt_strip, ESP_ERR_INVALID_ARG, err, TAG, "strip %zu is given twice", i);
+        }
+        // the asynchronous frames must not wait for the other channels
+        ESP_GOTO_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), err, TAG, "flush RMT channel failed");
+        group->strips[i] = rmt_strip;
+    }
+    group->num_strips = num_strips;
+
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+    rmt_channel_handle_t channels[SOC_RMT_TX_CANDIDATES_PER_GROUP];
+    ESP_GOTO_ON_FALSE(num_strips <= SOC_RMT_TX_CANDIDATES_PER_GROUP, ESP_ERR_INVALID_ARG, err, TAG, "too many strips, at most %d", SOC_RMT_TX_CANDIDATES_PER_GROUP);
+    for (size_t i = 0; i < num_strips; i++) {
+        channels[i] = group->strips[i]->rmt_chan;
+    }
+    rmt_sync_manager_config_t sync_config = {
+        .tx_channel_array = channels,
+        .array_size = num_strips,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_sync_manager(&sync_config, &group->sync), err, TAG, "create RMT sync manager failed");
+#endif
+
+    for (size_t i = 0; i < num_strips; i++) {
+        group->strips[i]->group = group;
+    }
+    *ret_group = group;
+    return ESP_OK;
+err:
+    free(group);
+    return ret;
+}
+
+esp_err_t led_strip_rmt_group_refresh(led_strip_rmt_group_handle_t group)
+{
+    esp_err_t ret = ESP_OK;
+    size_t queued = 0;
+    ESP_RETURN_ON_FALSE(group, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+    // the channels are idle, the previous group refresh waited for them: start them in phase
+    ESP_RETURN_ON_ERROR(rmt_sync_reset(group->sync), TAG, "reset RMT sync manager failed");
+#endif
+    // with the sync manager, the channels start once the last frame is queued; without it, one after the other
+    for (queued = 0; queued < group->num_strips; queued++) {
+        led_strip_rmt_obj *rmt_strip = group->strips[queued];
+        ESP_GOTO_ON_ERROR(led_strip_rmt_queue(rmt_strip, rmt_strip->pixel_buf, NULL, NULL), err, TAG, "transmit pixels by RMT failed");
+    }
+    // the frame time of the longest strip, instead of the sum of the strips
+    for (size_t i = 0; i < group->num_strips; i++) {
+        ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(group->strips[i]->rmt_chan, -1), TAG, "flush RMT channel failed");
+        group->strips[i]->dirty = false;
+    }
+    return ESP_OK;
+err:
+    // drop the frames already queued: they would wait for the others forever
+    for (size_t i = 0; i < queued; i++) {
+        rmt_disable(group->strips[i]->rmt_chan);
+        rmt_enable(group->strips[i]->rmt_chan);
+    }
+    return ret;
+}
+
+esp_err_t led_strip_del_rmt_group(led_strip_rmt_group_handle_t group)
+{
+    ESP_RETURN_ON_FALSE(group, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+    ESP_RETURN_ON_ERROR(rmt_del_sync_manager(group->sync), TAG, "delete RMT sync manager failed");
+#endif
+    for (size_t i = 0; i < group->num_strips; i++) {
+        group->strips[i]->group = NULL;
+    }
+    free(group);
+    return ESP_OK;
+}
@@ -4,11 +4,23 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
 #include "esp_check.h"
 #include "led_strip_rmt_encoder.h"
 
 static const char *TAG = "led_rmt_encoder";
 
+// bit timings, in ns
+#define LED_STRIP_SK6812_T0H_NS 300
+#define LED_STRIP_SK6812_T0L_NS 900
+#define LED_STRIP_SK6812_T1H_NS 600
+#define LED_STRIP_SK6812_T1L_NS 600
+#define LED_STRIP_WS2812_T0H_NS 300
+#define LED_STRIP_WS2812_T0L_NS 900
+#define LED_STRIP_WS2812_T1H_NS 900
+#define LED_STRIP_WS2812_T1L_NS 300
+#define LED_STRIP_RESET_US      50
+
 typedef struct {
     rmt_encoder_t base;
     rmt_encoder_t *bytes_encoder;
@@ -71,7 +83,7 @@ static esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
     return ESP_OK;
 }
 
-esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+esp_err_t rmt_new_led_strip_bytes_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
 {
     esp_err_t ret = ESP_OK;
     rmt_led_strip_encoder_t *led_encoder = NULL;
@@ -144,3 +156,174 @@ err:
     }
     return ret;
 }
+
+#if LED_STRIP_RMT_ENCODER_LUT
+// resolution of the compile time tables, the default one of the RMT backend
+#define LED_STRIP_LUT_RESOLUTION 10000000
+#define LED_STRIP_LUT_TICKS(ns) ((ns) * (LED_STRIP_LUT_RESOLUTION / 1000000) / 1000)
+
+// the 8 symbols of a byte, MSB first, for the T0H, T0L, T1H and T1L given in ticks
+#define LED_STRIP_LUT_BIT(byte, bit, t0h, t0l, t1h, t1l) { \
+        .level0 = 1, .duration0 = (((byte) >> (bit)) & 1) ? (t1h) : (t0h), \
+        .level1 = 0, .duration1 = (((byte) >> (bit)) & 1) ? (t1l) : (t0l), \
+    }
+#define LED_STRIP_LUT_BYTE(byte, ...) { \
+        LED_STRIP_LUT_BIT(byte, 7, __VA_ARGS__), LED_STRIP_LUT_BIT(byte, 6, __VA_ARGS__), \
+        LED_STRIP_LUT_BIT(byte, 5, __VA_ARGS__), LED_STRIP_LUT_BIT(byte, 4, __VA_ARGS__), \
+        LED_STRIP_LUT_BIT(byte, 3, __VA_ARGS__), LED_STRIP_LUT_BIT(byte, 2, __VA_ARGS__), \
+        LED_STRIP_LUT_BIT(byte, 1, __VA_ARGS__), LED_STRIP_LUT_BIT(byte, 0, __VA_ARGS__), \
+    }
+#define LED_STRIP_LUT_4(n, ...) LED_STRIP_LUT_BYTE((n), __VA_ARGS__), LED_STRIP_LUT_BYTE((n) + 1, __VA_ARGS__), \
+                                LED_STRIP_LUT_BYTE((n) + 2, __VA_ARGS__), LED_STRIP_LUT_BYTE((n) + 3, __VA_ARGS__)
+#define LED_STRIP_LUT_16(n, ...) LED_STRIP_LUT_4((n), __VA_ARGS__), LED_STRIP_LUT_4((n) + 4, __VA_ARGS__), \
+                                 LED_STRIP_LUT_4((n) + 8, __VA_ARGS__), LED_STRIP_LUT_4((n) + 12, __VA_ARGS__)
+#define LED_STRIP_LUT_64(n, ...) LED_STRIP_LUT_16((n), __VA_ARGS__), LED_STRIP_LUT_16((n) + 16, __VA_ARGS__), \
+                                 LED_STRIP_LUT_16((n) + 32, __VA_ARGS__), LED_STRIP_LUT_16((n) + 48, __VA_ARGS__)
+#define LED_STRIP_LUT(...) { LED_STRIP_LUT_64(0, __VA_ARGS__), LED_STRIP_LUT_64(64, __VA_ARGS__), \
+                             LED_STRIP_LUT_64(128, __VA_ARGS__), LED_STRIP_LUT_64(192, __VA_ARGS__) }
+
+typedef rmt_symbol_word_t led_strip_lut_t[256][8];
+
+static const led_strip_lut_t s_sk6812_lut = LED_STRIP_LUT(
+            LED_STRIP_LUT_TICKS(LED_STRIP_SK6812_T0H_NS), LED_STRIP_LUT_TICKS(LED_STRIP_SK6812_T0L_NS),
+            LED_STRIP_LUT_TICKS(LED_STRIP_SK6812_T1H_NS), LED_STRIP_LUT_TICKS(LED_STRIP_SK6812_T1L_NS));
+static const led_strip_lut_t s_ws2812_lut = LED_STRIP_LUT(
+            LED_STRIP_LUT_TICKS(LED_STRIP_WS2812_T0H_NS), LED_STRIP_LUT_TICKS(LED_STRIP_WS2812_T0L_NS),
+            LED_STRIP_LUT_TICKS(LED_STRIP_WS2812_T1H_NS), LED_STRIP_LUT_TICKS(LED_STRIP_WS2812_T1L_NS));
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encoder_t *simple_encoder;
+    const led_strip_lut_t *lut;
+    led_strip_lut_t *heap_lut; // the table of a resolution other than the default one
+    size_t bytes_per_pixel;
+    rmt_symbol_word_t reset_code;
+} rmt_led_strip_lut_encoder_t;
+
+static size_t rmt_encode_led_strip_lut_cb(const void *data, size_t data_size, size_t symbols_written, size_t symbols_free,
+                                          rmt_symbol_word_t *symbols, bool *done, void *arg)
+{
+    rmt_led_strip_lut_encoder_t *led_encoder = (rmt_led_strip_lut_encoder_t *)arg;
+    const uint8_t *pixels = (const uint8_t *)data;
+    size_t offset = symbols_written / 8;
+    size_t encoded_symbols = 0;
+    if (offset < data_size) {
+        // whole pixels, the driver guarantees room for one (min_chunk_size)
+        size_t bytes = symbols_free / 8 / led_encoder->bytes_per_pixel * led_encoder->bytes_per_pixel;
+        if (bytes > data_size - offset) {
+            bytes = data_size - offset;
+        }
+        for (size_t i = 0; i < bytes; i++) {
+            memcpy(&symbols[i * 8], (*led_encoder->lut)[pixels[offset + i]], 8 * sizeof(rmt_symbol_word_t));
+        }
+        encoded_symbols = bytes * 8;
+        offset += bytes;
+    }
+    if (offset == data_size && encoded_symbols < symbols_free) {
+        symbols[encoded_symbols++] = led_encoder->reset_code;
+        *done = true;
+    }
+    return encoded_symbols;
+}
+
+static size_t rmt_encode_led_strip_lut(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_led_strip_lut_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_lut_encoder_t, base);
+    return led_encoder->simple_encoder->encode(led_encoder->simple_encoder, channel, primary_data, data_size, ret_state);
+}
+
+static esp_err_t rmt_del_led_strip_lut_encoder(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_lut_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_lut_encoder_t, base);
+    rmt_del_encoder(led_encoder->simple_encoder);
+    free(led_encoder->heap_lut);
+    free(led_encoder);
+    return ESP_OK;
+}
+
+static esp_err_t rmt_led_strip_lut_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_lut_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_lut_encoder_t, base);
+    return rmt_encoder_reset(led_encoder->simple_encoder);
+}
+
+static void led_strip_lut_fill(led_strip_lut_t *lut, uint32_t resolution, uint32_t t0h_ns, uint32_t t0l_ns, uint32_t t1h_ns, uint32_t t1l_ns)
+{
+    rmt_symbol_word_t bit0 = {
+        .level0 = 1,
+        .duration0 = (uint64_t)t0h_ns * resolution / 1000000000,
+        .level1 = 0,
+        .duration1 = (uint64_t)t0l_ns * resolution / 1000000000,
+    };
+    rmt_symbol_word_t bit1 = {
+        .level0 = 1,
+        .duration0 = (uint64_t)t1h_ns * resolution / 1000000000,
+        .level1 = 0,
+        .duration1 = (uint64_t)t1l_ns * resolution / 1000000000,
+    };
+    for (int byte = 0; byte < 256; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+            (*lut)[byte][bit] = (byte & (0x80 >> bit)) ? bit1 : bit0;
+        }
+    }
+}
+
+static esp_err_t rmt_new_led_strip_lut_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_led_strip_lut_encoder_t *led_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config->bytes_per_pixel, ESP_ERR_INVALID_ARG, err, TAG, "invalid bytes per pixel");
+    led_encoder = calloc(1, sizeof(rmt_led_strip_lut_encoder_t));
+    ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
+    led_encoder->base.encode = rmt_encode_led_strip_lut;
+    led_encoder->base.del = rmt_del_led_strip_lut_encoder;
+    led_encoder->base.reset = rmt_led_strip_lut_encoder_reset;
+    led_encoder->bytes_per_pixel = config->bytes_per_pixel;
+    if (config->resolution == LED_STRIP_LUT_RESOLUTION) {
+        led_encoder->lut = (config->led_model == LED_MODEL_SK6812) ? &s_sk6812_lut : &s_ws2812_lut;
+    } else {
+        led_encoder->heap_lut = malloc(sizeof(led_strip_lut_t));
+        ESP_GOTO_ON_FALSE(led_encoder->heap_lut, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip lookup table");
+        if (config->led_model == LED_MODEL_SK6812) {
+            led_strip_lut_fill(led_encoder->heap_lut, config->resolution, LED_STRIP_SK6812_T0H_NS, LED_STRIP_SK6812_T0L_NS,
+                               LED_STRIP_SK6812_T1H_NS, LED_STRIP_SK6812_T1L_NS);
+        } else {
+            led_strip_lut_fill(led_encoder->heap_lut, config->resolution, LED_STRIP_WS2812_T0H_NS, LED_STRIP_WS2812_T0L_NS,
+                               LED_STRIP_WS2812_T1H_NS, LED_STRIP_WS2812_T1L_NS);
+        }
+        led_encoder->lut = led_encoder->heap_lut;
+    }
+    uint32_t reset_ticks = config->resolution / 1000000 * LED_STRIP_RESET_US / 2;
+    led_encoder->reset_code = (rmt_symbol_word_t) {
+        .level0 = 0,
+        .duration0 = reset_ticks,
+        .level1 = 0,
+        .duration1 = reset_ticks,
+    };
+    rmt_simple_encoder_config_t simple_encoder_config = {
+        .callback = rmt_encode_led_strip_lut_cb,
+        .arg = led_encoder,
+        .min_chunk_size = config->bytes_per_pixel * 8,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_simple_encoder(&simple_encoder_config, &led_encoder->simple_encoder), err, TAG, "create simple encoder failed");
+    *ret_encoder = &led_encoder->base;
+    return ESP_OK;
+err:
+    if (led_encoder) {
+        free(led_encoder->heap_lut);
+        free(led_encoder);
+    }
+    return ret;
+}
+#endif // LED_STRIP_RMT_ENCODER_LUT
+
+esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    ESP_RETURN_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->led_model < LED_MODEL_INVALID, ESP_ERR_INVALID_ARG, TAG, "invalid led model");
+#if LED_STRIP_RMT_ENCODER_LUT
+    return rmt_new_led_strip_lut_encoder(config, ret_encoder);
+#else
+    return rmt_new_led_strip_bytes_encoder(config, ret_encoder);
+#endif
+}
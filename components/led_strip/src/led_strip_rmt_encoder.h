@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include "esp_idf_version.h"
 #include "driver/rmt_encoder.h"
 #include "led_strip_types.h"
 
@@ -13,17 +14,29 @@
 extern "C" {
 #endif
 
+// the lookup table encoder writes the symbols through the simple encoder callback of IDF 5.3
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#define LED_STRIP_RMT_ENCODER_LUT 1
+#else
+#define LED_STRIP_RMT_ENCODER_LUT 0
+#endif
+
 /**
  * @brief Type of led strip encoder configuration
  */
 typedef struct {
-    uint32_t resolution;   /*!< Encoder resolution, in Hz */
-    led_model_t led_model; /*!< LED model */
+    uint32_t resolution;     /*!< Encoder resolution, in Hz */
+    led_model_t led_model;   /*!< LED model */
+    uint8_t bytes_per_pixel; /*!< Bytes per pixel, the lookup table encoder writes whole pixels */
 } led_strip_encoder_config_t;
 
 /**
  * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols
  *
+ * With IDF 5.3 and later every byte is copied from a table of its 8 symbols, whole pixels at a time.
+ * The tables for the default 10MHz resolution are built at compile time, other resolutions get one on the heap.
+ * Before IDF 5.3 this is the bytes encoder.
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
@@ -33,6 +46,18 @@ typedef struct {
  */
 esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols with the RMT bytes encoder, bit by bit
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating led strip encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_led_strip_bytes_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,226 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "driver/spi_master.h"
+#include "soc/soc_caps.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "led_strip_spi_encoder.h"
+#include "led_strip_correction.h"
+
+// the SPI clock can be a few percent off the one of the timing, the LED bits have 150ns of tolerance
+#define LED_STRIP_SPI_CLOCK_TOLERANCE_PERCENT 10
+// pixels converted on the stack at a time by set_pixels, before they are encoded
+#define LED_STRIP_SPI_SET_PIXELS_CHUNK 32
+
+static const char *TAG = "led_strip_spi";
+
+typedef struct {
+    led_strip_t base;
+    spi_host_device_t spi_host;
+    spi_device_handle_t spi_device;
+    led_model_t led_model;
+    uint32_t strip_len;
+    uint8_t bytes_per_pixel;
+    uint8_t spi_bits;           // SPI bytes per LED byte
+    size_t frame_size;          // SPI bytes of the pixels and of the reset code
+    uint8_t *spi_buf;           // the pixels already encoded, DMA capable
+    led_strip_correction_t correction;
+} led_strip_spi_obj;
+
+static void led_strip_spi_encode_pixel(led_strip_spi_obj *spi_strip, uint32_t index, const uint8_t *pixel)
+{
+    uint8_t *dst = spi_strip->spi_buf + index * spi_strip->bytes_per_pixel * spi_strip->spi_bits;
+    led_strip_spi_encode(spi_strip->led_model, pixel, spi_strip->bytes_per_pixel, dst);
+}
+
+static esp_err_t led_strip_spi_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    const uint8_t *table = spi_strip->correction.table;
+    // In thr order of GRB, as LED strip like WS2812 sends out pixels in this order
+    uint8_t pixel[4] = { table[green & 0xFF], table[red & 0xFF], table[blue & 0xFF], 0 };
+    led_strip_spi_encode_pixel(spi_strip, index, pixel);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(spi_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
+    const uint8_t *table = spi_strip->correction.table;
+    // SK6812 component order is GRBW
+    uint8_t pixel[4] = { table[green & 0xFF], table[red & 0xFF], table[blue & 0xFF], table[white & 0xFF] };
+    led_strip_spi_encode_pixel(spi_strip, index, pixel);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_set_pixels(led_strip_t *strip, uint32_t start, uint32_t count, const uint8_t *pixels, uint8_t bytes_per_pixel)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_FALSE(start <= spi_strip->strip_len && count <= spi_strip->strip_len - start, ESP_ERR_INVALID_ARG, TAG, "pixels out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(bytes_per_pixel == 3 || spi_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
+    uint8_t chunk[LED_STRIP_SPI_SET_PIXELS_CHUNK * 4];
+    uint32_t index = start;
+    while (count > 0) {
+        uint32_t n = count < LED_STRIP_SPI_SET_PIXELS_CHUNK ? count : LED_STRIP_SPI_SET_PIXELS_CHUNK;
+        uint8_t *dst = spi_strip->spi_buf + index * spi_strip->bytes_per_pixel * spi_strip->spi_bits;
+        led_strip_correction_convert(&spi_strip->correction, pixels, bytes_per_pixel, n, chunk, spi_strip->bytes_per_pixel);
+        led_strip_spi_encode(spi_strip->led_model, chunk, n * spi_strip->bytes_per_pixel, dst);
+        pixels += n * bytes_per_pixel;
+        index += n;
+        count -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_set_correction(led_strip_t *strip, uint8_t brightness, bool gamma)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    led_strip_correction_init(&spi_strip->correction, brightness, gamma);
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    spi_transaction_t tx_conf = {
+        .length = spi_strip->frame_size * 8,
+        .tx_buffer = spi_strip->spi_buf,
+        .rx_buffer = NULL,
+    };
+    ESP_RETURN_ON_ERROR(spi_device_transmit(spi_strip->spi_device, &tx_conf), TAG, "transmit pixels by SPI failed");
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_clear(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    // Write zero to turn off all leds
+    const uint8_t off[4] = { 0 };
+    for (uint32_t index = 0; index < spi_strip->strip_len; index++) {
+        led_strip_spi_encode_pixel(spi_strip, index, off);
+    }
+    return led_strip_spi_refresh(strip);
+}
+
+static esp_err_t led_strip_spi_del(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    ESP_RETURN_ON_ERROR(spi_bus_remove_device(spi_strip->spi_device), TAG, "delete SPI device failed");
+    ESP_RETURN_ON_ERROR(spi_bus_free(spi_strip->spi_host), TAG, "free SPI bus failed");
+    free(spi_strip->spi_buf);
+    free(spi_strip);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const led_strip_spi_config_t *spi_config, led_strip_handle_t *ret_strip)
+{
+    led_strip_spi_obj *spi_strip = NULL;
+    bool bus_initialized = false;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(led_config && spi_config && ret_strip, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(led_config->led_pixel_format < LED_PIXEL_FORMAT_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led_pixel_format");
+    const led_strip_spi_timing_t *timing = led_strip_spi_get_timing(led_config->led_model);
+    ESP_GOTO_ON_FALSE(timing, ESP_ERR_INVALID_ARG, err, TAG, "invalid led_model");
+    // MOSI idles low between the frames, an inverted line would send a reset code as a long high pulse
+    ESP_GOTO_ON_FALSE(!led_config->flags.invert_out, ESP_ERR_NOT_SUPPORTED, err, TAG, "invert_out is not supported by the SPI backend");
+    uint8_t bytes_per_pixel = 3;
+    if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRBW) {
+        bytes_per_pixel = 4;
+    } else if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRB) {
+        bytes_per_pixel = 3;
+    } else {
+        assert(false);
+    }
+    size_t frame_size = led_config->max_leds * bytes_per_pixel * timing->bits + timing->reset_bytes;
+    ESP_GOTO_ON_FALSE(spi_config->flags.with_dma || frame_size <= SOC_SPI_MAXIMUM_BUFFER_SIZE, ESP_ERR_INVALID_ARG, err, TAG,
+                      "%zu SPI bytes per frame, more than %d need DMA", frame_size, SOC_SPI_MAXIMUM_BUFFER_SIZE);
+
+    spi_strip = calloc(1, sizeof(led_strip_spi_obj));
+    ESP_GOTO_ON_FALSE(spi_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for spi strip");
+    // the reset code at the end of the buffer stays zero
+    spi_strip->spi_buf = heap_caps_calloc(1, frame_size, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    ESP_GOTO_ON_FALSE(spi_strip->spi_buf, ESP_ERR_NO_MEM, err, TAG, "no mem for spi buffer");
+    spi_strip->led_model = led_config->led_model;
+    spi_strip->bytes_per_pixel = bytes_per_pixel;
+    spi_strip->spi_bits = timing->bits;
+    spi_strip->strip_len = led_config->max_leds;
+    spi_strip->frame_size = frame_size;
+    spi_strip->spi_host = spi_config->spi_bus;
+    led_strip_correction_init(&spi_strip->correction, 255, false);
+    const uint8_t off[4] = { 0 };
+    for (uint32_t index = 0; index < spi_strip->strip_len; index++) {
+        led_strip_spi_encode_pixel(spi_strip, index, off);
+    }
+
+    spi_bus_config_t spi_bus_cfg = {
+        .mosi_io_num = led_config->strip_gpio_num,
+        // Only use MOSI to generate the signal, set -1 when other pins are not used.
+        .miso_io_num = -1,
+        .sclk_io_num = -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = frame_size,
+    };
+    ESP_GOTO_ON_ERROR(spi_bus_initialize(spi_config->spi_bus, &spi_bus_cfg, spi_config->flags.with_dma ? SPI_DMA_CH_AUTO : SPI_DMA_DISABLED),
+                      err, TAG, "create SPI bus failed");
+    bus_initialized = true;
+
+    // for backward compatibility, if the user does not set the clk_src, use the default value
+    spi_clock_source_t clk_src = SPI_CLK_SRC_DEFAULT;
+    if (spi_config->clk_src) {
+        clk_src = spi_config->clk_src;
+    }
+    spi_device_interface_config_t spi_dev_cfg = {
+        .clock_source = clk_src,
+        .command_bits = 0,
+        .address_bits = 0,
+        .dummy_bits = 0,
+        .clock_speed_hz = timing->clock_hz,
+        .mode = 0,
+        // set -1 when CS is not used
+        .spics_io_num = -1,
+        .queue_size = 1,
+    };
+    ESP_GOTO_ON_ERROR(spi_bus_add_device(spi_strip->spi_host, &spi_dev_cfg, &spi_strip->spi_device), err, TAG, "add SPI device failed");
+
+    int clock_khz = 0;
+    ESP_GOTO_ON_ERROR(spi_device_get_actual_freq(spi_strip->spi_device, &clock_khz), err, TAG, "get SPI clock failed");
+    int expected_khz = timing->clock_hz / 1000;
+    ESP_GOTO_ON_FALSE(abs(clock_khz - expected_khz) * 100 <= expected_khz * LED_STRIP_SPI_CLOCK_TOLERANCE_PERCENT, ESP_ERR_NOT_SUPPORTED, err, TAG,
+                      "SPI clock %dkHz too far from %dkHz", clock_khz, expected_khz);
+
+    spi_strip->base.set_pixel = led_strip_spi_set_pixel;
+    spi_strip->base.set_pixel_rgbw = led_strip_spi_set_pixel_rgbw;
+    spi_strip->base.set_pixels = led_strip_spi_set_pixels;
+    spi_strip->base.set_correction = led_strip_spi_set_correction;
+    spi_strip->base.refresh = led_strip_spi_refresh;
+    spi_strip->base.clear = led_strip_spi_clear;
+    spi_strip->base.del = led_strip_spi_del;
+
+    *ret_strip = &spi_strip->base;
+    return ESP_OK;
+err:
+    if (spi_strip) {
+        if (spi_strip->spi_device) {
+            spi_bus_remove_device(spi_strip->spi_device);
+        }
+        if (bus_initialized) {
+            spi_bus_free(spi_strip->spi_host);
+        }
+        free(spi_strip->spi_buf);
+        free(spi_strip);
+    }
+    return ret;
+}
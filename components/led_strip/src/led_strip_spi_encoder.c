@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "led_strip_spi_encoder.h"
+
+#define LED_STRIP_SPI_WS2812_CLOCK_HZ 2500000 // 0.4us per SPI bit
+#define LED_STRIP_SPI_SK6812_CLOCK_HZ 3333333 // 0.3us per SPI bit
+#define LED_STRIP_SPI_RESET_US        50
+#define LED_STRIP_SPI_RESET_BYTES(clock_hz) (((clock_hz) / 1000 * LED_STRIP_SPI_RESET_US / 1000 + 7) / 8)
+
+static const led_strip_spi_timing_t s_ws2812_timing = {
+    .clock_hz = LED_STRIP_SPI_WS2812_CLOCK_HZ,
+    .bits = 3,
+    .reset_bytes = LED_STRIP_SPI_RESET_BYTES(LED_STRIP_SPI_WS2812_CLOCK_HZ),
+};
+
+static const led_strip_spi_timing_t s_sk6812_timing = {
+    .clock_hz = LED_STRIP_SPI_SK6812_CLOCK_HZ,
+    .bits = 4,
+    .reset_bytes = LED_STRIP_SPI_RESET_BYTES(LED_STRIP_SPI_SK6812_CLOCK_HZ),
+};
+
+// the `width` SPI bits of a LED bit, high then the bit then low, at their place in the SPI bits of the byte, MSB first
+#define LED_STRIP_SPI_BIT(byte, bit, width) \
+    (((1UL << ((width) - 1)) | ((((byte) >> (bit)) & 1UL) << ((width) - 2))) << ((width) * (bit)))
+#define LED_STRIP_SPI_CODE(byte, width) ( \
+        LED_STRIP_SPI_BIT(byte, 7, width) | LED_STRIP_SPI_BIT(byte, 6, width) | \
+        LED_STRIP_SPI_BIT(byte, 5, width) | LED_STRIP_SPI_BIT(byte, 4, width) | \
+        LED_STRIP_SPI_BIT(byte, 3, width) | LED_STRIP_SPI_BIT(byte, 2, width) | \
+        LED_STRIP_SPI_BIT(byte, 1, width) | LED_STRIP_SPI_BIT(byte, 0, width))
+#define LED_STRIP_SPI_BYTE_3(byte) { \
+        (LED_STRIP_SPI_CODE(byte, 3) >> 16) & 0xFF, (LED_STRIP_SPI_CODE(byte, 3) >> 8) & 0xFF, \
+        LED_STRIP_SPI_CODE(byte, 3) & 0xFF, \
+    }
+#define LED_STRIP_SPI_BYTE_4(byte) { \
+        (LED_STRIP_SPI_CODE(byte, 4) >> 24) & 0xFF, (LED_STRIP_SPI_CODE(byte, 4) >> 16) & 0xFF, \
+        (LED_STRIP_SPI_CODE(byte, 4) >> 8) & 0xFF, LED_STRIP_SPI_CODE(byte, 4) & 0xFF, \
+    }
+#define LED_STRIP_SPI_LUT_4(n, width) LED_STRIP_SPI_BYTE_##width((n)), LED_STRIP_SPI_BYTE_##width((n) + 1), \
+                                      LED_STRIP_SPI_BYTE_##width((n) + 2), LED_STRIP_SPI_BYTE_##width((n) + 3)
+#define LED_STRIP_SPI_LUT_16(n, width) LED_STRIP_SPI_LUT_4((n), width), LED_STRIP_SPI_LUT_4((n) + 4, width), \
+                                       LED_STRIP_SPI_LUT_4((n) + 8, width), LED_STRIP_SPI_LUT_4((n) + 12, width)
+#define LED_STRIP_SPI_LUT_64(n, width) LED_STRIP_SPI_LUT_16((n), width), LED_STRIP_SPI_LUT_16((n) + 16, width), \
+                                       LED_STRIP_SPI_LUT_16((n) + 32, width), LED_STRIP_SPI_LUT_16((n) + 48, width)
+#define LED_STRIP_SPI_LUT(width) { LED_STRIP_SPI_LUT_64(0, width), LED_STRIP_SPI_LUT_64(64, width), \
+                                   LED_STRIP_SPI_LUT_64(128, width), LED_STRIP_SPI_LUT_64(192, width) }
+
+static const uint8_t s_ws2812_lut[256][3] = LED_STRIP_SPI_LUT(3);
+static const uint8_t s_sk6812_lut[256][4] = LED_STRIP_SPI_LUT(4);
+
+const led_strip_spi_timing_t *led_strip_spi_get_timing(led_model_t led_model)
+{
+    switch (led_model) {
+    case LED_MODEL_WS2812:
+        return &s_ws2812_timing;
+    case LED_MODEL_SK6812:
+        return &s_sk6812_timing;
+    default:
+        return NULL;
+    }
+}
+
+void led_strip_spi_encode(led_model_t led_model, const uint8_t *src, size_t size, uint8_t *dst)
+{
+    if (led_model == LED_MODEL_SK6812) {
+        for (size_t i = 0; i < size; i++) {
+            memcpy(dst, s_sk6812_lut[src[i]], 4);
+            dst += 4;
+        }
+    } else {
+        for (size_t i = 0; i < size; i++) {
+            memcpy(dst, s_ws2812_lut[src[i]], 3);
+            dst += 3;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Bit timings of the SPI backend: every LED bit is sent as `bits` SPI bits at `clock_hz`,
+ *        the first one high, the second one the LED bit, the others low
+ *
+ * WS2812: 3 bits at 2.5MHz, a 0 is high for 0.4us then low for 0.8us, a 1 high for 0.8us then low for 0.4us
+ * SK6812: 4 bits at 3.33MHz, a 0 is high for 0.3us then low for 0.9us, a 1 high for 0.6us then low for 0.6us
+ */
+typedef struct {
+    uint32_t clock_hz;       /*!< SPI clock */
+    uint8_t bits;            /*!< SPI bits per LED bit, also SPI bytes per LED byte */
+    size_t reset_bytes;      /*!< Low SPI bytes of the reset code, at least 50us */
+} led_strip_spi_timing_t;
+
+/**
+ * @brief Get the SPI bit timings of a LED model
+ *
+ * @param[in] led_model LED model
+ * @return The timings, NULL for an invalid model
+ */
+const led_strip_spi_timing_t *led_strip_spi_get_timing(led_model_t led_model);
+
+/**
+ * @brief Encode LED bytes into the SPI bytes of their waveform, from a table of the SPI bytes of every byte value
+ *
+ * @param[in] led_model LED model
+ * @param[in] src LED bytes, in the order they are sent
+ * @param[in] size Number of LED bytes
+ * @param[out] dst SPI bytes, `size * bits` of the model timing
+ */
+void led_strip_spi_encode(led_model_t led_model, const uint8_t *src, size_t size, uint8_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+/**
+ * \file bench.c
+ * \brief Checks and timing shared by the host benches, see bench.h.
+ */
+#include <stdio.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "bench.h"
+
+static atomic_int s_failures = 0;
+
+void bench_check(bool condition, const char *what) {
+    if (!condition) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        s_failures++;
+    }
+}
+
+int64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int bench_result(void) {
+    if (s_failures > 0) {
+        fprintf(stderr, "%d checks failed\n", (int)s_failures);
+        return 1;
+    }
+    printf("  all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,39 @@
+/**
+ * \file bench.h
+ * \brief Checks and timing shared by the host benches.
+ *
+ * A bench reports what it measured and checks what the application relies on with bench_check().
+ * It ends with bench_result(), which gives its exit status.
+ */
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Check a condition, reporting it when it does not hold.
+ * \param[in] condition the condition
+ * \param[in] what      what is checked, printed on failure
+ */
+void bench_check(bool condition, const char *what);
+
+/** \brief Monotonic time, in nanoseconds */
+int64_t bench_now_ns(void);
+
+/**
+ * \brief Report the outcome of the checks.
+ * \return the exit status of the bench: 0 if all checks passed, 1 otherwise
+ */
+int bench_result(void);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _BENCH_H_
@@ -0,0 +1,357 @@
+/**
+ * \file broker_race_bench.c
+ * \brief Time to a connected broker address with broker_race.c, against connecting to one address at a time.
+ *
+ * The broker addresses are local stand-ins on 127.0.0.x, all on the same port:
+ *   - healthy:    a listener that accepts
+ *   - refused:    no listener, the connection is reset right away
+ *   - blackholed: a listener whose accept queue is full, SYNs are dropped and the connection times out
+ *   - slow:       a blackholed listener that frees its queue after a while, the SYN retransmission connects
+ *                 (about 1 s later, the initial retransmission timeout of Linux)
+ * Each scenario lists the addresses in the resolver order. The race gets one endpoint per address, as with
+ * fallback endpoints. One at a time connects in the resolver order, each attempt bounded by the timeout (-t),
+ * as the MQTT client does with the first address the resolver returns.
+ *
+ * It checks that the race connects to the expected address and hands over that connection, blocking, that a
+ * dead first address costs the stagger rather than the timeout, that the next race starts with the address that
+ * won, and that a race with no address up fails within its timeout and ranks the addresses last.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "broker_race.h"
+#include "platform.h"
+
+#define MAX_STAND_INS   (4)
+
+
+/**
+ * Stand-ins
+ */
+
+typedef enum {
+    HEALTHY,
+    REFUSED,
+    BLACKHOLED,
+    SLOW,
+} stand_in_kind_t;
+
+static const char *s_kind_names[] = { "healthy", "refused", "blackholed", "slow" };
+
+typedef struct {
+    stand_in_kind_t kind;
+    char host[INET_ADDRSTRLEN];
+    uint32_t address;
+    int listener;
+    /** Fills the accept queue of a blackholed or slow listener */
+    int filler;
+    uint32_t open_after_ms;
+    volatile bool stop;
+    pthread_t thread;
+} stand_in_t;
+
+static uint16_t s_port;
+
+static int make_listener(uint32_t address, uint16_t port, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in at = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = address };
+    if (fd < 0 || bind(fd, (struct sockaddr *)&at, sizeof(at)) != 0 || listen(fd, backlog) != 0) {
+        fprintf(stderr, "Failed to listen on port %u: %s\n", port, strerror(errno));
+        exit(1);
+    }
+    return fd;
+}
+
+/* Accepts and closes the connections of a healthy listener, frees the queue of a slow one after its delay */
+static void *stand_in_main(void *arg) {
+    stand_in_t *stand_in = arg;
+    int64_t open_at = bench_now_ns() + stand_in->open_after_ms * 1000000LL;
+    while (!stand_in->stop) {
+        if (stand_in->kind == SLOW && bench_now_ns() < open_at) {
+            platform_delay_ms(5);
+            continue;
+        }
+        struct pollfd pfd = { .fd = stand_in->listener, .events = POLLIN };
+        if (poll(&pfd, 1, 20) == 1) {
+            int fd = accept(stand_in->listener, NULL, NULL);
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void stand_in_start(stand_in_t *stand_in, stand_in_kind_t kind, int index, uint32_t open_after_ms) {
+    memset(stand_in, 0, sizeof(stand_in_t));
+    stand_in->kind = kind;
+    stand_in->listener = -1;
+    stand_in->filler = -1;
+    stand_in->open_after_ms = open_after_ms;
+    snprintf(stand_in->host, sizeof(stand_in->host), "127.0.0.%d", 10 + index);
+    inet_pton(AF_INET, stand_in->host, &stand_in->address);
+    if (kind == REFUSED) {
+        return;
+    }
+    stand_in->listener = make_listener(stand_in->address, s_port, kind == HEALTHY ? 64 : 0);
+    if (kind != HEALTHY) {
+        // With a backlog of 0 the queue holds one connection: once it is taken, SYNs are dropped
+        stand_in->filler = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(s_port), .sin_addr.s_addr = stand_in->address };
+        if (connect(stand_in->filler, (struct sockaddr *)&to, sizeof(to)) != 0) {
+            fprintf(stderr, "Failed to fill the queue of %s\n", stand_in->host);
+            exit(1);
+        }
+    }
+    if (kind == HEALTHY || kind == SLOW) {
+        pthread_create(&stand_in->thread, NULL, stand_in_main, stand_in);
+    }
+}
+
+static void stand_in_stop(stand_in_t *stand_in) {
+    stand_in->stop = true;
+    if (stand_in->kind == HEALTHY || stand_in->kind == SLOW) {
+        pthread_join(stand_in->thread, NULL);
+    }
+    if (stand_in->filler >= 0) {
+        close(stand_in->filler);
+    }
+    if (stand_in->listener >= 0) {
+        close(stand_in->listener);
+    }
+}
+
+/* Connect in the resolver order, one address at a time: the index of the address that connected, -1 if none */
+static int connect_one_at_a_time(const stand_in_t *stand_ins, int count, int timeout_ms) {
+    struct timeval timeout = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+    for (int i = 0; i < count; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        // SO_SNDTIMEO also bounds connect()
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(s_port), .sin_addr.s_addr = stand_ins[i].address };
+        int ret = connect(fd, (struct sockaddr *)&to, sizeof(to));
+        close(fd);
+        if (ret == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Scenarios
+ */
+
+typedef struct {
+    const char *name;
+    int count;
+    stand_in_kind_t kinds[MAX_STAND_INS];
+    /** Index of the address that should connect first, -1 for none */
+    int expected;
+} scenario_t;
+
+static const scenario_t s_scenarios[] = {
+    { "all healthy",            2, { HEALTHY, HEALTHY },                0 },
+    { "first refused",          2, { REFUSED, HEALTHY },                1 },
+    { "first blackholed",       2, { BLACKHOLED, HEALTHY },             1 },
+    { "first slow",             2, { SLOW, HEALTHY },                   1 },
+    { "two blackholed",         3, { BLACKHOLED, BLACKHOLED, HEALTHY }, 2 },
+    { "none up",                2, { BLACKHOLED, REFUSED },             -1 },
+};
+
+typedef struct {
+    int winner;
+    uint32_t attempts;
+    double race_ms;
+    /** The winning connection handed over: blocking and connected to the winner */
+    bool handed_over;
+    /** Second race with the health of the first one */
+    int again_winner;
+    uint32_t again_attempts;
+    double again_ms;
+    int one_winner;
+    double one_ms;
+} result_t;
+
+static int index_of(const stand_in_t *stand_ins, int count, uint32_t address) {
+    for (int i = 0; i < count; i++) {
+        if (stand_ins[i].address == address) {
+            return i;
+        }
+    }
+    return -2;
+}
+
+/* The connection handed over by a race: blocking, and connected to the address that won */
+static bool is_handed_over(int fd, uint32_t address) {
+    struct sockaddr_in peer;
+    socklen_t length = sizeof(peer);
+    int flags = (fd >= 0) ? fcntl(fd, F_GETFL, 0) : -1;
+    return flags >= 0 && (flags & O_NONBLOCK) == 0 &&
+           getpeername(fd, (struct sockaddr *)&peer, &length) == 0 && peer.sin_addr.s_addr == address;
+}
+
+static void run(const scenario_t *scenario, int stagger_ms, int timeout_ms, result_t *result) {
+    stand_in_t stand_ins[MAX_STAND_INS];
+    const char *hosts[MAX_STAND_INS];
+    // The slow address frees its queue shortly after the first SYN
+    for (int i = 0; i < scenario->count; i++) {
+        stand_in_start(&stand_ins[i], scenario->kinds[i], i, 100);
+        hosts[i] = stand_ins[i].host;
+    }
+
+    broker_race_t race = { .stagger_ms = stagger_ms, .timeout_ms = timeout_ms };
+    char what[128];
+    snprintf(what, sizeof(what), "%s: every endpoint resolved", scenario->name);
+    bench_check(broker_race_resolve(&race, hosts, scenario->count, s_port) == scenario->count, what);
+
+    uint32_t address = 0;
+    int connection = -1;
+    int64_t start = bench_now_ns();
+    int ret = broker_race_connect(&race, &address, &connection);
+    result->race_ms = (bench_now_ns() - start) / 1e6;
+    result->winner = (ret == 0) ? index_of(stand_ins, scenario->count, address) : -1;
+    result->attempts = race.stats.attempts;
+    result->handed_over = (ret == 0) ? is_handed_over(connection, address) : (connection == -1);
+    if (connection >= 0) {
+        close(connection);
+    }
+
+    // The slow address is open by now: the health decides, not the first SYN
+    start = bench_now_ns();
+    ret = broker_race_connect(&race, &address, NULL);
+    result->again_ms = (bench_now_ns() - start) / 1e6;
+    result->again_winner = (ret == 0) ? index_of(stand_ins, scenario->count, address) : -1;
+    result->again_attempts = race.stats.attempts - result->attempts;
+
+    if (scenario->expected < 0) {
+        // The penalties of the first race expired during the second one, the failures add up
+        snprintf(what, sizeof(what), "%s: every address failed in both races", scenario->name);
+        bool failed = true;
+        for (size_t i = 0; i < race.count; i++) {
+            failed = failed && race.addresses[i].failures == 2;
+        }
+        bench_check(failed, what);
+    }
+    else {
+        // A failure reported after the race, e.g. a TLS handshake, ranks the winner last
+        broker_race_report(&race, stand_ins[scenario->expected].address, false);
+        snprintf(what, sizeof(what), "%s: reported failure ranks the address last", scenario->name);
+        bool other_up = false;
+        for (int i = 0; i < scenario->count; i++) {
+            other_up = other_up || (i != scenario->expected && scenario->kinds[i] == HEALTHY);
+        }
+        if (other_up) {
+            bench_check(broker_race_connect(&race, &address, NULL) == 0 && address != stand_ins[scenario->expected].address, what);
+        }
+        broker_race_report(&race, stand_ins[scenario->expected].address, true);
+    }
+
+    for (int i = 0; i < scenario->count; i++) {
+        stand_in_stop(&stand_ins[i]);
+    }
+
+    // One at a time, with fresh stand-ins
+    for (int i = 0; i < scenario->count; i++) {
+        stand_in_start(&stand_ins[i], scenario->kinds[i], i, 100);
+    }
+    start = bench_now_ns();
+    result->one_winner = connect_one_at_a_time(stand_ins, scenario->count, timeout_ms);
+    result->one_ms = (bench_now_ns() - start) / 1e6;
+    for (int i = 0; i < scenario->count; i++) {
+        stand_in_stop(&stand_ins[i]);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s MILLIS      delay between two attempts of a race (%d)\n"
+            "  -t MILLIS      connection timeout, of a race and of each attempt one at a time (3000)\n", name,
+            BROKER_RACE_STAGGER_MS);
+}
+
+int main(int argc, char **argv) {
+    int stagger_ms = BROKER_RACE_STAGGER_MS;
+    int timeout_ms = 3000;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:t:h")) != -1) {
+        switch (opt) {
+        case 's': stagger_ms = atoi(optarg); break;
+        case 't': timeout_ms = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (stagger_ms <= 0 || timeout_ms < 1500 || stagger_ms * MAX_STAND_INS >= timeout_ms) {
+        // The slow address needs the SYN retransmission, after 1 s
+        usage(argv[0]);
+        return 1;
+    }
+
+    // A free port on the first stand-in address, shared by all of them
+    uint32_t first;
+    inet_pton(AF_INET, "127.0.0.10", &first);
+    int probe = make_listener(first, 0, 1);
+    struct sockaddr_in bound;
+    socklen_t length = sizeof(bound);
+    getsockname(probe, (struct sockaddr *)&bound, &length);
+    s_port = ntohs(bound.sin_port);
+    close(probe);
+
+    printf("Broker address race: %dms between attempts, %dms timeout\n", stagger_ms, timeout_ms);
+    printf("  %-18s %-36s %8s %9s %10s %12s\n", "", "addresses", "winner", "attempts", "race", "one at a time");
+    for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+        const scenario_t *scenario = &s_scenarios[i];
+        result_t result;
+        run(scenario, stagger_ms, timeout_ms, &result);
+
+        char kinds[64] = "";
+        for (int j = 0; j < scenario->count; j++) {
+            strcat(kinds, j == 0 ? "" : ", ");
+            strcat(kinds, s_kind_names[scenario->kinds[j]]);
+        }
+        printf("  %-18s %-36s %8d %9u %8.0fms %10.0fms\n", scenario->name, kinds, result.winner, result.attempts,
+               result.race_ms, result.one_ms);
+        printf("  %-18s %-36s %8d %9u %8.0fms\n", "  again", "", result.again_winner, result.again_attempts,
+               result.again_ms);
+
+        char what[128];
+        snprintf(what, sizeof(what), "%s: race connects to address %d", scenario->name, scenario->expected);
+        bench_check(result.winner == scenario->expected && result.again_winner == scenario->expected, what);
+        if (scenario->expected >= 0) {
+            // Each dead address before the winner costs at most the stagger
+            snprintf(what, sizeof(what), "%s: race within the staggers", scenario->name);
+            bench_check(result.race_ms < stagger_ms * scenario->expected + 200, what);
+            snprintf(what, sizeof(what), "%s: next race starts with the winner", scenario->name);
+            bench_check(result.again_attempts == 1 && result.again_ms < 200, what);
+            // The MQTT client starts TLS on it instead of connecting again
+            snprintf(what, sizeof(what), "%s: winning connection handed over", scenario->name);
+            bench_check(result.handed_over, what);
+        }
+        else {
+            snprintf(what, sizeof(what), "%s: race fails within its timeout", scenario->name);
+            bench_check(result.race_ms < timeout_ms + 200, what);
+        }
+        if (scenario->kinds[0] == BLACKHOLED || scenario->kinds[0] == SLOW) {
+            snprintf(what, sizeof(what), "%s: one at a time waits for the first address", scenario->name);
+            bench_check(result.one_ms > 900, what);
+        }
+    }
+
+    return bench_result();
+}
@@ -0,0 +1,325 @@
+/**
+ * \file cert_cache_bench.c
+ * \brief Set-up and handshake time of a mutually authenticated MQTT connection, with and without the parse-once
+ *        cache of the enrolment certificates (cert_cache.c).
+ *
+ * A TLS server stands in for the broker on a socket pair, with a leaf issued by an RSA root and a request for the
+ * client certificate. Every connection gets a TLS configuration of its own, as with esp-tls:
+ *   - uncached: the configuration parses the PEM IoT Hub root and the PEM device certificate, as esp-tls does
+ *               when given the strings of the QuarkLink context
+ *   - cached:   the root parsed once is attached, and the device certificate decoded to DER once is used, as
+ *               cert_cache_attach() and cert_cache_device_cert() provide
+ * The device key is set up once in both: on the device it stays in the DS peripheral.
+ *
+ * OpenSSL stands in for mbedtls, so the times are those of the host: the bench reports the share of the
+ * connection the parsing takes. It checks that every handshake verifies the broker chain and the device
+ * certificate, and that the cache takes the parsing out of the set-up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+
+#define BROKER_HOST     "broker.example-iot.net"
+#define MAX_CONNECTIONS (10000)
+
+typedef struct {
+    EVP_PKEY *root_key;
+    X509 *root;
+    char *root_pem;
+    SSL_CTX *server;
+    EVP_PKEY *device_key;
+    char *device_pem;
+    /** What the cache keeps */
+    X509_STORE *cached_root;
+    X509 *cached_device;
+} credentials_t;
+
+typedef struct {
+    int64_t *setup_ns;
+    int64_t *handshake_ns;
+    int connections;
+    int verified;
+} result_t;
+
+static X509 *make_cert(EVP_PKEY *key, EVP_PKEY *issuer_key, X509 *issuer, const char *cn, bool ca) {
+    X509 *cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), issuer != NULL ? 2 : 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)cn, -1, -1, 0);
+    X509_set_issuer_name(cert, issuer != NULL ? X509_get_subject_name(issuer) : name);
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, issuer != NULL ? issuer : cert, cert, NULL, NULL, 0);
+    X509_EXTENSION *extension = X509V3_EXT_conf(NULL, &ctx, "basicConstraints", ca ? "critical,CA:TRUE" : "CA:FALSE");
+    X509_add_ext(cert, extension, -1);
+    X509_EXTENSION_free(extension);
+    if (!ca && issuer != NULL) {
+        extension = X509V3_EXT_conf(NULL, &ctx, "subjectAltName", "DNS:" BROKER_HOST);
+        X509_add_ext(cert, extension, -1);
+        X509_EXTENSION_free(extension);
+    }
+    X509_sign(cert, issuer_key, EVP_sha256());
+    return cert;
+}
+
+static char *to_pem(X509 *cert) {
+    BIO *bio = BIO_new(BIO_s_mem());
+    char *data = NULL;
+    long length;
+    char *pem = NULL;
+    if (bio != NULL && PEM_write_bio_X509(bio, cert) == 1 && (length = BIO_get_mem_data(bio, &data)) > 0) {
+        pem = strndup(data, length);
+    }
+    BIO_free(bio);
+    return pem;
+}
+
+static X509 *from_pem(const char *pem) {
+    BIO *bio = BIO_new_mem_buf(pem, -1);
+    X509 *cert = (bio != NULL) ? PEM_read_bio_X509(bio, NULL, NULL, NULL) : NULL;
+    BIO_free(bio);
+    return cert;
+}
+
+static int credentials_init(credentials_t *credentials) {
+    memset(credentials, 0, sizeof(credentials_t));
+    // An RSA root as the IoT Hub ones, an ECC broker leaf and an ECC device certificate
+    credentials->root_key = EVP_RSA_gen(2048);
+    EVP_PKEY *leaf_key = EVP_EC_gen("P-256");
+    credentials->device_key = EVP_EC_gen("P-256");
+    if (credentials->root_key == NULL || leaf_key == NULL || credentials->device_key == NULL) {
+        return -1;
+    }
+    credentials->root = make_cert(credentials->root_key, credentials->root_key, NULL, "Example IoT Root CA", true);
+    X509 *leaf = make_cert(leaf_key, credentials->root_key, credentials->root, BROKER_HOST, false);
+    X509 *device = make_cert(credentials->device_key, credentials->device_key, NULL, "bench-device", false);
+    credentials->root_pem = to_pem(credentials->root);
+    credentials->device_pem = to_pem(device);
+
+    credentials->server = SSL_CTX_new(TLS_server_method());
+    X509_STORE *clients = SSL_CTX_get_cert_store(credentials->server);
+    int ret = (credentials->root_pem != NULL && credentials->device_pem != NULL && credentials->server != NULL &&
+               SSL_CTX_use_certificate(credentials->server, leaf) == 1 &&
+               SSL_CTX_use_PrivateKey(credentials->server, leaf_key) == 1 &&
+               X509_STORE_add_cert(clients, device) == 1) ? 0 : -1;
+    SSL_CTX_set_verify(credentials->server, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+    // Every connection is a full handshake, as on the device
+    SSL_CTX_set_options(credentials->server, SSL_OP_NO_TICKET);
+    SSL_CTX_set_session_cache_mode(credentials->server, SSL_SESS_CACHE_OFF);
+
+    // The cache: the root parsed once, the device certificate decoded once
+    credentials->cached_root = X509_STORE_new();
+    X509 *root = from_pem(credentials->root_pem);
+    unsigned char *der = NULL;
+    int der_length = i2d_X509(device, &der);
+    const unsigned char *p = der;
+    credentials->cached_device = (der_length > 0) ? d2i_X509(NULL, &p, der_length) : NULL;
+    if (credentials->cached_root == NULL || root == NULL || X509_STORE_add_cert(credentials->cached_root, root) != 1 ||
+        credentials->cached_device == NULL) {
+        ret = -1;
+    }
+    OPENSSL_free(der);
+    X509_free(root);
+    X509_free(leaf);
+    X509_free(device);
+    EVP_PKEY_free(leaf_key);
+    return ret;
+}
+
+static void credentials_free(credentials_t *credentials) {
+    EVP_PKEY_free(credentials->root_key);
+    X509_free(credentials->root);
+    free(credentials->root_pem);
+    SSL_CTX_free(credentials->server);
+    EVP_PKEY_free(credentials->device_key);
+    free(credentials->device_pem);
+    X509_STORE_free(credentials->cached_root);
+    X509_free(credentials->cached_device);
+}
+
+typedef struct {
+    SSL_CTX *ctx;
+    int fd;
+} server_t;
+
+static void *server_main(void *arg) {
+    server_t *server = arg;
+    SSL *ssl = SSL_new(server->ctx);
+    if (ssl != NULL && SSL_set_fd(ssl, server->fd) == 1 && SSL_accept(ssl) == 1) {
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+    close(server->fd);
+    return NULL;
+}
+
+/* The TLS configuration of one connection: the certificates parsed from PEM, or those of the cache */
+static SSL_CTX *client_context(const credentials_t *credentials, bool cached) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        return NULL;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    bool ok;
+    if (cached) {
+        SSL_CTX_set1_cert_store(ctx, credentials->cached_root);
+        ok = SSL_CTX_use_certificate(ctx, credentials->cached_device) == 1;
+    }
+    else {
+        X509 *root = from_pem(credentials->root_pem);
+        X509 *device = from_pem(credentials->device_pem);
+        ok = root != NULL && device != NULL && X509_STORE_add_cert(SSL_CTX_get_cert_store(ctx), root) == 1 &&
+             SSL_CTX_use_certificate(ctx, device) == 1;
+        X509_free(root);
+        X509_free(device);
+    }
+    if (!ok || SSL_CTX_use_PrivateKey(ctx, credentials->device_key) != 1) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/* One connection: 0 if the handshake verified both ends */
+static int connect_once(const credentials_t *credentials, bool cached, int64_t *setup_ns, int64_t *handshake_ns) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return -1;
+    }
+    server_t server = { .ctx = credentials->server, .fd = fds[1] };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server_main, &server) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    int64_t start = bench_now_ns();
+    SSL_CTX *ctx = client_context(credentials, cached);
+    SSL *ssl = (ctx != NULL) ? SSL_new(ctx) : NULL;
+    int ret = -1;
+    if (ssl != NULL && SSL_set_fd(ssl, fds[0]) == 1 && SSL_set_tlsext_host_name(ssl, BROKER_HOST) == 1 &&
+        SSL_set1_host(ssl, BROKER_HOST) == 1) {
+        int64_t ready = bench_now_ns();
+        *setup_ns = ready - start;
+        if (SSL_connect(ssl) == 1 && SSL_get_verify_result(ssl) == X509_V_OK) {
+            *handshake_ns = bench_now_ns() - ready;
+            ret = 0;
+        }
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    close(fds[0]);
+    pthread_join(thread, NULL);
+    return ret;
+}
+
+static void run(const credentials_t *credentials, bool cached, int connections, result_t *result) {
+    result->connections = connections;
+    result->verified = 0;
+    for (int i = 0; i < connections; i++) {
+        result->setup_ns[i] = 0;
+        result->handshake_ns[i] = 0;
+        if (connect_once(credentials, cached, &result->setup_ns[i], &result->handshake_ns[i]) == 0) {
+            result->verified++;
+        }
+    }
+}
+
+static int compare_ns(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double median_us(int64_t *values, int count) {
+    qsort(values, count, sizeof(int64_t), compare_ns);
+    return values[count / 2] / 1e3;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n CONNECTIONS connections with and without the cache (200)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int connections = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': connections = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (connections <= 0 || connections > MAX_CONNECTIONS) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    credentials_t credentials;
+    if (credentials_init(&credentials) != 0) {
+        fprintf(stderr, "Failed to create the certificates\n");
+        return 1;
+    }
+    result_t results[2];
+    for (int cached = 0; cached < 2; cached++) {
+        results[cached].setup_ns = calloc(connections, sizeof(int64_t));
+        results[cached].handshake_ns = calloc(connections, sizeof(int64_t));
+        if (results[cached].setup_ns == NULL || results[cached].handshake_ns == NULL) {
+            return 1;
+        }
+    }
+    // Alternate the runs, so that both see the same machine load
+    for (int round = 0; round < 2; round++) {
+        for (int cached = 0; cached < 2; cached++) {
+            run(&credentials, cached, round == 0 ? 10 : connections, &results[cached]);
+        }
+    }
+
+    printf("Mutually authenticated connections, RSA-2048 root, P-256 broker and device: %d each, medians\n",
+           connections);
+    printf("  %-10s %12s %14s %12s %10s\n", "", "set-up (us)", "handshake (us)", "total (us)", "verified");
+    double setup[2];
+    double total[2];
+    for (int cached = 0; cached < 2; cached++) {
+        result_t *result = &results[cached];
+        double handshake = median_us(result->handshake_ns, connections);
+        setup[cached] = median_us(result->setup_ns, connections);
+        total[cached] = setup[cached] + handshake;
+        printf("  %-10s %12.1f %14.1f %12.1f %6d/%-4d\n", cached ? "cached" : "uncached", setup[cached], handshake,
+               total[cached], result->verified, connections);
+    }
+    printf("  parsing: %.1f us per connection, %.1f%% of the uncached connection\n", setup[0] - setup[1],
+           100.0 * (setup[0] - setup[1]) / total[0]);
+
+    bench_check(results[0].verified == connections && results[1].verified == connections,
+                "every handshake verifies the broker chain and the device certificate");
+    bench_check(setup[1] < setup[0], "the cache takes the parsing out of the set-up");
+
+    for (int cached = 0; cached < 2; cached++) {
+        free(results[cached].setup_ns);
+        free(results[cached].handshake_ns);
+    }
+    credentials_free(&credentials);
+    return bench_result();
+}
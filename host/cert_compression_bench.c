@@ -0,0 +1,323 @@
+/**
+ * \file cert_compression_bench.c
+ * \brief Bytes on the wire and decoding time of the TLS 1.3 server certificate, with and without RFC 8879.
+ *
+ * The chains are made up with OpenSSL in the shapes the device meets: an ECDSA leaf alone, an ECDSA leaf with
+ * its intermediate, and an RSA-2048 chain up to the root as some IoT hubs send. Each one is encoded as the
+ * Certificate message of TLS 1.3, compressed with zlib as a server would, and decompressed through the code of
+ * patches/certcomp_mbedtls.patch with the host decoder (cert_compression_linux.c, zlib where the device uses
+ * the inflater of its ROM). The transfer times are the serialization of the message on links of a few rates;
+ * OpenSSL 3.0 has no RFC 8879, so there is no live handshake to time against.
+ *
+ * The checks cover the extension bytes of the ClientHello and the messages the client must refuse.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include <zlib.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cert_compression.h"
+#include "cert_compression.h"
+
+/** Record header, inner content type and AEAD tag of a TLS 1.3 record */
+#define RECORD_OVERHEAD   (5 + 1 + 16)
+#define RECORD_MAX        (16384)
+#define HS_HEADER         (4)
+#define MAX_CHAIN         (3)
+
+
+static void put_u24(unsigned char *p, size_t value) {
+    p[0] = (unsigned char)(value >> 16);
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)value;
+}
+
+static X509 *make_cert(EVP_PKEY *key, EVP_PKEY *issuer_key, X509 *issuer, const char *cn, bool ca, long serial) {
+    X509 *cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), ca ? 10L * 365 * 24 * 3600 : 398L * 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "C", MBSTRING_ASC, (const unsigned char *)"GB", -1, -1, 0);
+    X509_NAME_add_entry_by_txt(name, "O", MBSTRING_ASC, (const unsigned char *)"Example IoT Services Ltd", -1, -1, 0);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)cn, -1, -1, 0);
+    X509_set_issuer_name(cert, issuer != NULL ? X509_get_subject_name(issuer) : name);
+
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, issuer != NULL ? issuer : cert, cert, NULL, NULL, 0);
+    const char *const ca_exts[][2] = {
+        { "basicConstraints", "critical,CA:TRUE" },
+        { "keyUsage", "critical,keyCertSign,cRLSign" },
+        { "subjectKeyIdentifier", "hash" },
+    };
+    const char *const leaf_exts[][2] = {
+        { "basicConstraints", "critical,CA:FALSE" },
+        { "keyUsage", "critical,digitalSignature" },
+        { "extendedKeyUsage", "serverAuth" },
+        { "subjectKeyIdentifier", "hash" },
+        { "authorityKeyIdentifier", "keyid" },
+        { "subjectAltName", "DNS:broker.example-iot.net,DNS:*.eu.example-iot.net,DNS:*.us.example-iot.net" },
+        { "authorityInfoAccess", "OCSP;URI:http://ocsp.example-iot.net,caIssuers;URI:http://pki.example-iot.net/ica.crt" },
+        { "crlDistributionPoints", "URI:http://pki.example-iot.net/ica.crl" },
+        { "certificatePolicies", "2.23.140.1.2.2" },
+    };
+    size_t count = ca ? sizeof(ca_exts) / sizeof(ca_exts[0]) : sizeof(leaf_exts) / sizeof(leaf_exts[0]);
+    for (size_t i = 0; i < count; i++) {
+        const char *const *ext = ca ? ca_exts[i] : leaf_exts[i];
+        X509_EXTENSION *extension = X509V3_EXT_conf(NULL, &ctx, ext[0], ext[1]);
+        if (extension != NULL) {
+            X509_add_ext(cert, extension, -1);
+            X509_EXTENSION_free(extension);
+        }
+    }
+    X509_sign(cert, issuer_key, EVP_sha256());
+    return cert;
+}
+
+/*
+ * struct {
+ *     opaque certificate_request_context<0..2^8-1>;
+ *     CertificateEntry certificate_list<0..2^24-1>;
+ * } Certificate;
+ */
+static size_t certificate_message(X509 *const *chain, int count, unsigned char *out, size_t size) {
+    size_t length = 4;
+    for (int i = 0; i < count; i++) {
+        int der_length = i2d_X509(chain[i], NULL);
+        if (der_length <= 0 || length + 5 + (size_t)der_length > size) {
+            return 0;
+        }
+        unsigned char *p = out + length + 3;
+        put_u24(out + length, (size_t)der_length);
+        i2d_X509(chain[i], &p);
+        length += 3 + (size_t)der_length;
+        out[length] = 0;  // no extensions
+        out[length + 1] = 0;
+        length += 2;
+    }
+    size_t list_length = length - 4;
+    out[0] = 0;
+    put_u24(out + 1, list_length);
+    return length;
+}
+
+/* CompressedCertificate body, zlib at the level a server would cache it with */
+static size_t compressed_message(uint16_t alg, const unsigned char *message, size_t length, unsigned char *out,
+                                 size_t size) {
+    uLongf compressed_length = size - 8;
+    if (compress2(out + 8, &compressed_length, message, length, Z_BEST_COMPRESSION) != Z_OK) {
+        return 0;
+    }
+    out[0] = (unsigned char)(alg >> 8);
+    out[1] = (unsigned char)alg;
+    put_u24(out + 2, length);
+    put_u24(out + 5, compressed_length);
+    return 8 + compressed_length;
+}
+
+/* Handshake message in TLS 1.3 records */
+static size_t wire_bytes(size_t body_length) {
+    size_t length = HS_HEADER + body_length;
+    return length + (length + RECORD_MAX - 1) / RECORD_MAX * RECORD_OVERHEAD;
+}
+
+static int decompress(const unsigned char *message, size_t length, unsigned char **out, size_t *out_length) {
+    *out = NULL;
+    int ret = mbedtls_ssl_cert_compression_decompress(message, length, out, out_length);
+    if (ret != 0) {
+        bench_check(*out == NULL, "nothing allocated on failure");
+    }
+    return ret;
+}
+
+static void check_rejections(const unsigned char *message, size_t length, const unsigned char *compressed,
+                             size_t compressed_length) {
+    static unsigned char bad[RECORD_MAX];
+    unsigned char *out;
+    size_t out_length;
+    mbedtls_ssl_cert_compression_stats_t before, after;
+    mbedtls_ssl_cert_compression_get_stats(&before);
+
+    bench_check(decompress(compressed, compressed_length, &out, &out_length) == 0 && out_length == length &&
+                memcmp(out, message, length) == 0, "round trip");
+    free(out);
+
+    memcpy(bad, compressed, compressed_length);
+    bad[1] = MBEDTLS_SSL_CERT_COMPRESSION_BROTLI;
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER,
+                "algorithm not offered refused");
+
+    memcpy(bad, compressed, compressed_length);
+    put_u24(bad + 2, length + 1);
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_BAD_CERTIFICATE,
+                "uncompressed length too long refused");
+    put_u24(bad + 2, length - 1);
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_BAD_CERTIFICATE,
+                "uncompressed length too short refused");
+
+    memcpy(bad, compressed, compressed_length);
+    put_u24(bad + 2, MBEDTLS_SSL_CERT_DECOMPRESSED_MAX + 1);
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_BAD_CERTIFICATE,
+                "uncompressed length over the limit refused");
+
+    memcpy(bad, compressed, compressed_length);
+    size_t truncated = compressed_length - 8 - 10;
+    put_u24(bad + 5, truncated);
+    bench_check(decompress(bad, 8 + truncated, &out, &out_length) == MBEDTLS_ERR_SSL_BAD_CERTIFICATE,
+                "truncated stream refused");
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_DECODE_ERROR,
+                "compressed length mismatch refused");
+    bench_check(decompress(bad, 7, &out, &out_length) == MBEDTLS_ERR_SSL_DECODE_ERROR, "short message refused");
+
+    memcpy(bad, compressed, compressed_length);
+    bad[compressed_length - 1] ^= 0x55;
+    bench_check(decompress(bad, compressed_length, &out, &out_length) == MBEDTLS_ERR_SSL_BAD_CERTIFICATE,
+                "corrupted stream refused");
+
+    mbedtls_ssl_cert_compression_get_stats(&after);
+    bench_check(after.messages == before.messages + 9 && after.failures == before.failures + 8 &&
+                after.compressed_bytes == before.compressed_bytes + compressed_length &&
+                after.uncompressed_bytes == before.uncompressed_bytes + length, "statistics");
+}
+
+static void check_extension(void) {
+    unsigned char buffer[16];
+    size_t length;
+    const unsigned char expected[] = { 0x00, 0x1B, 0x00, 0x03, 0x02, 0x00, 0x01 };
+
+    bench_check(mbedtls_ssl_cert_compression_write_ext(buffer, buffer + sizeof(buffer), &length) == 0 &&
+                length == sizeof(expected) && memcmp(buffer, expected, length) == 0, "compress_certificate extension");
+    bench_check(mbedtls_ssl_cert_compression_write_ext(buffer, buffer + 6, &length) == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL,
+                "extension larger than the buffer");
+
+    const uint16_t too_many[MBEDTLS_SSL_CERT_COMPRESSION_MAX_ALGS + 1] = { 1, 2, 3, 4 };
+    bench_check(mbedtls_ssl_set_cert_decompression(too_many, MBEDTLS_SSL_CERT_COMPRESSION_MAX_ALGS + 1,
+                                             cert_compression_decompress, NULL) == MBEDTLS_ERR_SSL_BAD_INPUT_DATA,
+                "too many algorithms refused");
+    bench_check(mbedtls_ssl_set_cert_decompression(NULL, 0, NULL, NULL) == 0 && !mbedtls_ssl_cert_compression_enabled() &&
+                mbedtls_ssl_cert_compression_write_ext(buffer, buffer + sizeof(buffer), &length) == 0 && length == 0,
+                "no extension without a decoder");
+    bench_check(cert_compression_init() == 0 && mbedtls_ssl_cert_compression_enabled(), "decoder registered");
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-r rounds]\n"
+            "  -r  decompressions timed per chain (default 2000)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:h")) != -1) {
+        switch (opt) {
+        case 'r': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    // The rejection checks log the invalid streams
+    setenv("QL_LOG_LEVEL", "0", 0);
+
+    bench_check(cert_compression_init() == 0, "decoder registered");
+    check_extension();
+
+    EVP_PKEY *ec_root = EVP_EC_gen("P-256");
+    EVP_PKEY *ec_ica = EVP_EC_gen("P-256");
+    EVP_PKEY *ec_leaf = EVP_EC_gen("P-256");
+    EVP_PKEY *rsa_root = EVP_RSA_gen(2048);
+    EVP_PKEY *rsa_ica = EVP_RSA_gen(2048);
+    EVP_PKEY *rsa_leaf = EVP_RSA_gen(2048);
+    if (ec_root == NULL || ec_ica == NULL || ec_leaf == NULL || rsa_root == NULL || rsa_ica == NULL ||
+        rsa_leaf == NULL) {
+        fprintf(stderr, "Key generation failed\n");
+        return 1;
+    }
+    X509 *ec_root_cert = make_cert(ec_root, ec_root, NULL, "Example IoT ECC Root CA", true, 1);
+    X509 *ec_ica_cert = make_cert(ec_ica, ec_root, ec_root_cert, "Example IoT ECC Issuing CA 01", true, 2);
+    X509 *ec_leaf_cert = make_cert(ec_leaf, ec_ica, ec_ica_cert, "broker.example-iot.net", false, 3);
+    X509 *rsa_root_cert = make_cert(rsa_root, rsa_root, NULL, "Example IoT RSA Root CA", true, 4);
+    X509 *rsa_ica_cert = make_cert(rsa_ica, rsa_root, rsa_root_cert, "Example IoT RSA Issuing CA 01", true, 5);
+    X509 *rsa_leaf_cert = make_cert(rsa_leaf, rsa_ica, rsa_ica_cert, "broker.example-iot.net", false, 6);
+
+    struct {
+        const char *name;
+        X509 *chain[MAX_CHAIN];
+        int count;
+    } chains[] = {
+        { "ECDSA leaf", { ec_leaf_cert }, 1 },
+        { "ECDSA leaf + CA", { ec_leaf_cert, ec_ica_cert }, 2 },
+        { "RSA leaf + CA + root", { rsa_leaf_cert, rsa_ica_cert, rsa_root_cert }, 3 },
+    };
+    const int rates_kbps[] = { 50, 250, 1000 };
+    enum { RATE_COUNT = sizeof(rates_kbps) / sizeof(rates_kbps[0]) };
+
+    static unsigned char message[RECORD_MAX];
+    static unsigned char compressed[RECORD_MAX];
+    printf("Server Certificate message, zlib (RFC 8879), %d decompressions per chain\n", rounds);
+    printf("  %-22s %8s %8s %7s %10s", "chain", "plain B", "zlib B", "saved", "decode us");
+    for (int r = 0; r < RATE_COUNT; r++) {
+        printf("   %4d kbit/s", rates_kbps[r]);
+    }
+    printf("\n");
+
+    for (size_t c = 0; c < sizeof(chains) / sizeof(chains[0]); c++) {
+        size_t length = certificate_message(chains[c].chain, chains[c].count, message, sizeof(message));
+        bench_check(length > 0 && length <= MBEDTLS_SSL_CERT_DECOMPRESSED_MAX, "chain within the decompression limit");
+        size_t compressed_length = compressed_message(MBEDTLS_SSL_CERT_COMPRESSION_ZLIB, message, length,
+                                                      compressed, sizeof(compressed));
+        bench_check(compressed_length > 0 && compressed_length < 8 + length, "chain compressed");
+        if (length == 0 || compressed_length == 0) {
+            continue;
+        }
+        check_rejections(message, length, compressed, compressed_length);
+
+        int64_t start = bench_now_ns();
+        for (int i = 0; i < rounds; i++) {
+            unsigned char *out;
+            size_t out_length;
+            if (mbedtls_ssl_cert_compression_decompress(compressed, compressed_length, &out, &out_length) != 0) {
+                bench_check(false, "timed decompression");
+                break;
+            }
+            free(out);
+        }
+        double decode_us = (double)(bench_now_ns() - start) / rounds / 1000.0;
+
+        size_t plain = wire_bytes(length);
+        size_t packed = wire_bytes(compressed_length);
+        printf("  %-22s %8zu %8zu %6.1f%% %10.1f", chains[c].name, plain, packed,
+               100.0 * (double)(plain - packed) / (double)plain, decode_us);
+        for (int r = 0; r < RATE_COUNT; r++) {
+            double plain_ms = (double)plain * 8.0 / rates_kbps[r];
+            double packed_ms = (double)packed * 8.0 / rates_kbps[r];
+            printf("  %5.1f->%5.1f", plain_ms, packed_ms);
+        }
+        printf("\n");
+    }
+    printf("  (transfer times in ms; the ClientHello grows by 7 bytes)\n");
+
+    X509 *certs[] = { ec_root_cert, ec_ica_cert, ec_leaf_cert, rsa_root_cert, rsa_ica_cert, rsa_leaf_cert };
+    EVP_PKEY *keys[] = { ec_root, ec_ica, ec_leaf, rsa_root, rsa_ica, rsa_leaf };
+    for (size_t i = 0; i < sizeof(certs) / sizeof(certs[0]); i++) {
+        X509_free(certs[i]);
+        EVP_PKEY_free(keys[i]);
+    }
+
+    return bench_result();
+}
@@ -0,0 +1,47 @@
+/**
+ * \file cert_compression_linux.c
+ * \brief Linux implementation of cert_compression.h, on zlib instead of the miniz of the ROM.
+ */
+#include <zlib.h>
+#include "esp_log.h"
+#include "mbedtls/ssl_cert_compression.h"
+
+#include "cert_compression.h"
+
+static const char *TAG = "cert_compression";
+
+static const uint16_t s_algs[] = { MBEDTLS_SSL_CERT_COMPRESSION_ZLIB };
+
+int cert_compression_init(void) {
+    if (mbedtls_ssl_set_cert_decompression(s_algs, sizeof(s_algs) / sizeof(s_algs[0]),
+                                           cert_compression_decompress, NULL) != 0) {
+        ESP_LOGE(TAG, "Failed to register the certificate decoder");
+        return -1;
+    }
+    return 0;
+}
+
+int cert_compression_decompress(void *ctx, uint16_t alg, const unsigned char *in, size_t in_len,
+                                unsigned char *out, size_t out_len) {
+    if (alg != MBEDTLS_SSL_CERT_COMPRESSION_ZLIB) {
+        return -1;
+    }
+    z_stream stream = {
+        .next_in = (unsigned char *)in,
+        .avail_in = in_len,
+        .next_out = out,
+        .avail_out = out_len,
+    };
+    if (inflateInit(&stream) != Z_OK) {
+        ESP_LOGE(TAG, "Out of memory for the inflater");
+        return -1;
+    }
+    int ret = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (ret != Z_STREAM_END || stream.avail_in != 0 || stream.avail_out != 0) {
+        ESP_LOGW(TAG, "Invalid compressed certificate (status %d, %zu of %zu bytes)",
+                 ret, out_len - stream.avail_out, out_len);
+        return -1;
+    }
+    return 0;
+}
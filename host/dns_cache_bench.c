@@ -0,0 +1,357 @@
+/**
+ * \file dns_cache_bench.c
+ * \brief Time to resolve the QuarkLink and IoT Hub endpoints at each boot or wake, with the DNS cache (dns_cache.c)
+ * against a local DNS stand-in (dns_stub.c) that answers after a modelled resolver latency (-l).
+ *
+ * Every step resolves both endpoints, as a device does before its first connections. The IoT Hub name is a CNAME
+ * with a shorter TTL than its addresses, as on Azure. The steps go through a cold boot, a wake within the TTL
+ * and one past it (the cache kept as in RTC memory, its clock moved on), a power cycle (the cache loaded from NVS,
+ * on the emulator of nvs_mock.c), the resolver down, a wake past the stale period, and revalidations against a
+ * round-robin resolver.
+ *
+ * It checks that the answers are fresh within the TTL, that expired answers are returned at once and then
+ * revalidated with the new addresses, that the TTL is the smallest of the chain, that a resolver down keeps the
+ * stale answers, that the answers survive a power cycle, that rotated addresses are not written to NVS again,
+ * that the platform resolver goes through the cache, and that the lwIP hook (dns_cache_lookup) never waits for the
+ * server.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "dns_cache.h"
+#include "dns_stub.h"
+#include "nvs_mock.h"
+#include "platform.h"
+#include "platform_linux.h"
+
+#define QUARKLINK_HOST  "demo.quarklink.io"
+#define IOT_HUB_HOST    "demo-hub.azure-devices.net"
+#define IOT_HUB_CNAME   "ihsu-prod-ams-001.cloudapp.net"
+/** A name first looked up by the lwIP hook */
+#define HOOK_HOST       "global.azure-devices-provisioning.net"
+#define QUARKLINK_TTL   300
+#define IOT_HUB_TTL     300
+#define IOT_HUB_CNAME_TTL 60
+/** The cache clock at the first boot, in s */
+#define START_CLOCK_S   1000
+
+
+static uint32_t ip(const char *text) {
+    uint32_t address = 0;
+    inet_pton(AF_INET, text, &address);
+    return address;
+}
+
+/** Statistics of the caches stopped so far */
+static dns_cache_stats_t s_total;
+
+static void add_stats(dns_cache_stats_t *total, const dns_cache_stats_t *stats) {
+    total->fresh += stats->fresh;
+    total->stale += stats->stale;
+    total->misses += stats->misses;
+    total->deferred += stats->deferred;
+    total->queries += stats->queries;
+    total->query_failures += stats->query_failures;
+    total->revalidations += stats->revalidations;
+    total->persisted += stats->persisted;
+    total->saved_us += stats->saved_us;
+}
+
+static void all_stats(dns_cache_stats_t *stats) {
+    dns_cache_get_stats(stats);
+    add_stats(stats, &s_total);
+}
+
+/* Stop the cache, as a reboot or deep sleep does */
+static void cache_stop(dns_cache_table_t *table) {
+    dns_cache_stats_t stats;
+    dns_cache_get_stats(&stats);
+    add_stats(&s_total, &stats);
+    if (table != NULL) {
+        dns_cache_save(table);
+    }
+    dns_cache_free();
+}
+
+/* A deep sleep: the entries kept in RTC memory, the clock moved on */
+static void deep_sleep(uint32_t wake_clock_s) {
+    dns_cache_table_t table;
+    cache_stop(&table);
+    dns_cache_init();
+    dns_cache_restore(&table, wake_clock_s);
+}
+
+/* Wait for the revalidation task to make \p revalidations queries in all */
+static bool wait_revalidations(uint32_t revalidations) {
+    for (int i = 0; i < 600; i++) {
+        dns_cache_stats_t stats;
+        all_stats(&stats);
+        if (stats.revalidations >= revalidations) {
+            return true;
+        }
+        platform_delay_ms(5);
+    }
+    return false;
+}
+
+static const dns_cache_entry_t *find_entry(const dns_cache_table_t *table, const char *name) {
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (strcmp(table->entries[i].name, name) == 0) {
+            return &table->entries[i];
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    const char *name;
+    double ms;
+    uint32_t fresh;
+    uint32_t stale;
+    uint32_t misses;
+    uint32_t queries;
+    /** First address of each endpoint, 0 if not resolved */
+    uint32_t quarklink;
+    uint32_t iot_hub;
+} step_t;
+
+/* Resolve both endpoints */
+static void boot(dns_stub_t *stub, step_t *step) {
+    dns_cache_stats_t before;
+    all_stats(&before);
+    uint32_t queries = dns_stub_queries(stub);
+    uint32_t addresses[DNS_CACHE_MAX_ADDRESSES];
+
+    int64_t start = bench_now_ns();
+    step->quarklink = (dns_cache_resolve(QUARKLINK_HOST, addresses, DNS_CACHE_MAX_ADDRESSES) > 0) ? addresses[0] : 0;
+    step->iot_hub = (dns_cache_resolve(IOT_HUB_HOST, addresses, DNS_CACHE_MAX_ADDRESSES) > 0) ? addresses[0] : 0;
+    step->ms = (bench_now_ns() - start) / 1e6;
+
+    dns_cache_stats_t after;
+    all_stats(&after);
+    step->fresh = after.fresh - before.fresh;
+    step->stale = after.stale - before.stale;
+    step->misses = after.misses - before.misses;
+    step->queries = dns_stub_queries(stub) - queries;
+}
+
+static void print_step(const step_t *step) {
+    char hub[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &step->iot_hub, hub, sizeof(hub));
+    printf("  %-30s %9.1fms %6u %6u %7u %8u   %s\n", step->name, step->ms, step->fresh, step->stale, step->misses,
+           step->queries, hub);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -l MILLIS      latency of the DNS stand-in (40)\n", name);
+}
+
+int main(int argc, char **argv) {
+    uint32_t latency_ms = 40;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:h")) != -1) {
+        switch (opt) {
+        case 'l': latency_ms = (uint32_t)atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    dns_stub_t *stub = dns_stub_start();
+    if (stub == NULL) {
+        fprintf(stderr, "Failed to start the DNS stand-in\n");
+        return 1;
+    }
+    dns_stub_set_latency(stub, latency_ms);
+    const uint32_t quarklink[] = { ip("10.0.0.1") };
+    const uint32_t hub[] = { ip("10.0.1.1"), ip("10.0.1.2") };
+    const uint32_t moved[] = { ip("10.0.1.3") };
+    dns_stub_set(stub, QUARKLINK_HOST, NULL, 0, quarklink, 1, QUARKLINK_TTL);
+    dns_stub_set(stub, IOT_HUB_HOST, IOT_HUB_CNAME, IOT_HUB_CNAME_TTL, hub, 2, IOT_HUB_TTL);
+    platform_linux_set_dns_server(ip("127.0.0.1"), dns_stub_port(stub));
+    nvs_mock_reset();
+
+    printf("DNS cache: stand-in answering in %ums, TTL %us (%s) and %us (%s through a CNAME of %us)\n", latency_ms,
+           QUARKLINK_TTL, QUARKLINK_HOST, IOT_HUB_TTL, IOT_HUB_HOST, IOT_HUB_CNAME_TTL);
+    printf("  %-30s %11s %6s %6s %7s %8s   %s\n", "", "resolve", "fresh", "stale", "misses", "queries", "IoT Hub");
+
+    dns_cache_table_t table;
+    dns_cache_stats_t stats;
+    dns_cache_stats_t before_stats;
+    uint32_t addresses[DNS_CACHE_MAX_ADDRESSES];
+    step_t step;
+    uint32_t revalidations = 0;
+
+    // Cold boot: nothing in RTC memory nor in NVS
+    dns_cache_init();
+    dns_cache_restore(&(dns_cache_table_t){ 0 }, START_CLOCK_S);
+    step = (step_t){ .name = "cold boot" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.misses == 2 && step.queries == 2 && step.quarklink == quarklink[0] && step.iot_hub == hub[0],
+                "cold boot: both endpoints from the server");
+    bench_check(step.ms >= 2 * latency_ms, "cold boot: waits for the server");
+    dns_cache_save(&table);
+    const dns_cache_entry_t *entry = find_entry(&table, IOT_HUB_HOST);
+    bench_check(entry != NULL && entry->ttl_s == IOT_HUB_CNAME_TTL && entry->count == 2, "TTL of the CNAME chain");
+    entry = find_entry(&table, QUARKLINK_HOST);
+    bench_check(entry != NULL && entry->ttl_s == QUARKLINK_TTL, "TTL of the A record");
+
+    step = (step_t){ .name = "again" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.fresh == 2 && step.queries == 0, "again: fresh");
+
+    // Deep sleep within the TTL of both
+    deep_sleep(START_CLOCK_S + IOT_HUB_CNAME_TTL / 2);
+    step = (step_t){ .name = "wake within the TTL" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.fresh == 2 && step.queries == 0 && step.iot_hub == hub[0], "wake within the TTL: fresh");
+    bench_check(step.ms < latency_ms / 2.0, "wake within the TTL: without the server");
+
+    // The IoT Hub moves, then a deep sleep past the TTL of both
+    dns_stub_set(stub, IOT_HUB_HOST, IOT_HUB_CNAME, IOT_HUB_CNAME_TTL, moved, 1, IOT_HUB_TTL);
+    deep_sleep(START_CLOCK_S + QUARKLINK_TTL + 100);
+    step = (step_t){ .name = "wake past the TTL" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.stale == 2 && step.iot_hub == hub[0], "wake past the TTL: stale answers");
+    bench_check(step.ms < latency_ms / 2.0, "wake past the TTL: without waiting for the server");
+    revalidations += 2;
+    bench_check(wait_revalidations(revalidations), "wake past the TTL: revalidated in the background");
+    step = (step_t){ .name = "  revalidated" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.fresh == 2 && step.queries == 0 && step.iot_hub == moved[0], "revalidated: the new address");
+
+    // Power cycle: RTC memory lost, the entries come from NVS at an unknown age
+    cache_stop(NULL);
+    dns_cache_init();
+    bench_check(dns_cache_load() == 0, "power cycle: entries in NVS");
+    step = (step_t){ .name = "power cycle" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.stale == 2 && step.quarklink == quarklink[0] && step.iot_hub == moved[0],
+                "power cycle: the persisted answers");
+    bench_check(step.ms < latency_ms / 2.0, "power cycle: without waiting for the server");
+    revalidations += 2;
+    bench_check(wait_revalidations(revalidations), "power cycle: revalidated in the background");
+
+    // The resolver stops answering
+    dns_stub_set_down(stub, true);
+    deep_sleep(START_CLOCK_S);
+    step = (step_t){ .name = "resolver down, past the TTL" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.stale == 2 && step.iot_hub == moved[0], "resolver down: stale answers");
+    revalidations += 2;
+    bench_check(wait_revalidations(revalidations), "resolver down: revalidation attempted");
+    all_stats(&stats);
+    bench_check(stats.query_failures == 2, "resolver down: revalidations failed");
+    step = (step_t){ .name = "  still down" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.stale == 2 && step.iot_hub == moved[0], "resolver down: stale answers kept");
+    revalidations += 2;
+    wait_revalidations(revalidations);
+    dns_stub_set_down(stub, false);
+
+    // Past the stale period the answers are not served before the server answers
+    deep_sleep(START_CLOCK_S + 2 * DNS_CACHE_MAX_STALE_S);
+    step = (step_t){ .name = "wake past the stale period" };
+    boot(stub, &step);
+    print_step(&step);
+    bench_check(step.misses == 2 && step.queries == 2 && step.iot_hub == moved[0], "past the stale period: from the server");
+
+    // A round-robin resolver rotates the addresses: the revalidations find the same set and write nothing to NVS
+    const uint32_t rotated[] = { ip("10.0.1.4"), ip("10.0.1.5"), ip("10.0.1.6") };
+    dns_stub_set(stub, IOT_HUB_HOST, IOT_HUB_CNAME, IOT_HUB_CNAME_TTL, rotated, 3, IOT_HUB_TTL);
+    dns_stub_set_rotate(stub, true);
+    const uint32_t rotation_clock_s = START_CLOCK_S + 2 * DNS_CACHE_MAX_STALE_S;
+    uint32_t persisted = 0;
+    uint32_t firsts = 0;
+    uint32_t previous = 0;
+    for (int i = 1; i <= 4; i++) {
+        deep_sleep(rotation_clock_s + i * (QUARKLINK_TTL + 100));
+        step = (step_t){ .name = (i == 1) ? "round robin, past the TTL" : "  again past the TTL" };
+        boot(stub, &step);
+        print_step(&step);
+        revalidations += 2;
+        wait_revalidations(revalidations);
+        all_stats(&stats);
+        if (i == 1) {
+            // The new set of addresses is written once
+            persisted = stats.persisted;
+        }
+        else if (dns_cache_resolve(IOT_HUB_HOST, addresses, DNS_CACHE_MAX_ADDRESSES) == 3 && addresses[0] != previous) {
+            firsts++;
+        }
+        previous = addresses[0];
+    }
+    bench_check(firsts == 3, "round robin: the answers rotated");
+    bench_check(stats.persisted == persisted, "round robin: the same addresses in another order are not persisted");
+    dns_stub_set_rotate(stub, false);
+
+    // The platform resolver and the connections of net_linux.c go through the cache, as lwIP on the device
+    platform_linux_set_resolver(dns_cache_resolve);
+    int64_t before[PLATFORM_LINUX_STAT_COUNT];
+    int64_t after[PLATFORM_LINUX_STAT_COUNT];
+    platform_linux_get_stats(before, NULL);
+    bench_check(platform_dns_resolve_all(IOT_HUB_HOST, addresses, DNS_CACHE_MAX_ADDRESSES) == 3 && addresses[0] == previous,
+                "platform resolver: from the cache");
+    bench_check(platform_dns_resolve_all("127.0.0.1", addresses, DNS_CACHE_MAX_ADDRESSES) == 1, "platform resolver: numeric");
+    platform_linux_get_stats(after, NULL);
+    bench_check(after[PLATFORM_LINUX_DNS_LOOKUPS] - before[PLATFORM_LINUX_DNS_LOOKUPS] == 1,
+                "platform resolver: only the numeric address left to the host");
+    platform_linux_set_resolver(NULL);
+
+    // The lwIP hook only takes cached answers: a new name is left to lwIP at once and queried in the background
+    dns_stub_set(stub, HOOK_HOST, NULL, 0, quarklink, 1, QUARKLINK_TTL);
+    all_stats(&before_stats);
+    uint32_t queries = dns_stub_queries(stub);
+    int64_t start = bench_now_ns();
+    int looked_up = dns_cache_lookup(HOOK_HOST, addresses, DNS_CACHE_MAX_ADDRESSES);
+    double lookup_ms = (bench_now_ns() - start) / 1e6;
+    all_stats(&stats);
+    bench_check(looked_up == -1 && stats.deferred == before_stats.deferred + 1 && stats.misses == before_stats.misses,
+                "lwIP hook: a new name left to lwIP");
+    bench_check(lookup_ms < latency_ms / 2.0, "lwIP hook: without waiting for the server");
+    revalidations++;
+    bench_check(wait_revalidations(revalidations) && dns_stub_queries(stub) == queries + 1,
+                "lwIP hook: the new name queried in the background");
+    bench_check(dns_cache_lookup(HOOK_HOST, addresses, DNS_CACHE_MAX_ADDRESSES) == 1 && addresses[0] == quarklink[0],
+                "lwIP hook: then from the cache");
+
+    // The least recently used name makes room, a wake every 10s: the IoT Hub is used at each
+    for (int i = 0; i < DNS_CACHE_ENTRIES - 1; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "fallback-%d.example.net", i);
+        dns_stub_set(stub, name, NULL, 0, quarklink, 1, QUARKLINK_TTL);
+        deep_sleep(rotation_clock_s + 5 * (QUARKLINK_TTL + 100) + 10 * (i + 1));
+        dns_cache_resolve(IOT_HUB_HOST, addresses, 1);
+        dns_cache_resolve(name, addresses, 1);
+    }
+    dns_cache_save(&table);
+    bench_check(find_entry(&table, QUARKLINK_HOST) == NULL && find_entry(&table, IOT_HUB_HOST) != NULL,
+                "the least recently used name replaced");
+
+    cache_stop(NULL);
+    dns_stub_stop(stub);
+
+    uint32_t lookups = s_total.fresh + s_total.stale + s_total.misses;
+    printf("  %u lookups: %u fresh, %u stale, %u misses (%.0f%% answered at once), %u deferred by the hook, "
+           "%u queries, %u failed, %u revalidations, %u NVS writes\n", lookups, s_total.fresh, s_total.stale,
+           s_total.misses, 100.0 * (s_total.fresh + s_total.stale) / lookups, s_total.deferred, s_total.queries,
+           s_total.query_failures, s_total.revalidations, s_total.persisted);
+    printf("  server time saved: %.0fms\n", s_total.saved_us / 1e3);
+
+    return bench_result();
+}
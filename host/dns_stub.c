@@ -0,0 +1,270 @@
+/**
+ * \file dns_stub.c
+ * \brief Local DNS server for the host benches, see dns_stub.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dns_stub.h"
+
+#define DNS_STUB_NAMES          (8)
+#define DNS_STUB_MAX_NAME       (128)
+#define DNS_STUB_MAX_ADDRESSES  (8)
+#define DNS_MAX_MESSAGE         (512)
+
+typedef struct {
+    char name[DNS_STUB_MAX_NAME];
+    char cname[DNS_STUB_MAX_NAME];
+    uint32_t cname_ttl;
+    uint32_t addresses[DNS_STUB_MAX_ADDRESSES];
+    size_t count;
+    uint32_t ttl;
+    /** Answers given, for the rotation */
+    uint32_t answers;
+} dns_stub_record_t;
+
+struct dns_stub {
+    int fd;
+    uint16_t port;
+    pthread_t thread;
+    atomic_bool stop;
+    atomic_bool down;
+    atomic_bool rotate;
+    atomic_uint latency_ms;
+    atomic_uint queries;
+    pthread_mutex_t lock;
+    dns_stub_record_t records[DNS_STUB_NAMES];
+};
+
+static void put16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+}
+
+static void put32(uint8_t *bytes, uint32_t value) {
+    put16(bytes, (uint16_t)(value >> 16));
+    put16(bytes + 2, (uint16_t)value);
+}
+
+/* Encode a dotted name: its length */
+static size_t encode_name(const char *name, uint8_t *out) {
+    size_t pos = 0;
+    while (*name != '\0') {
+        const char *dot = strchr(name, '.');
+        size_t length = (dot != NULL) ? (size_t)(dot - name) : strlen(name);
+        out[pos++] = (uint8_t)length;
+        memcpy(out + pos, name, length);
+        pos += length;
+        name += length + (dot != NULL ? 1 : 0);
+    }
+    out[pos++] = 0;
+    return pos;
+}
+
+/* Decode the uncompressed question name at pos: the position after it, 0 if malformed */
+static size_t decode_name(const uint8_t *message, size_t length, size_t pos, char *name) {
+    size_t out = 0;
+    while (pos < length && message[pos] != 0) {
+        uint8_t label = message[pos++];
+        if (label > 63 || pos + label > length || out + label + 1 >= DNS_STUB_MAX_NAME) {
+            return 0;
+        }
+        if (out > 0) {
+            name[out++] = '.';
+        }
+        memcpy(name + out, message + pos, label);
+        out += label;
+        pos += label;
+    }
+    name[out] = '\0';
+    return (pos < length) ? pos + 1 : 0;
+}
+
+/* Reply to a query: the length of the reply, 0 to drop it */
+static size_t answer(dns_stub_t *stub, const uint8_t *query, size_t length, uint8_t *reply) {
+    char name[DNS_STUB_MAX_NAME];
+    size_t end = (length >= 12) ? decode_name(query, length, 12, name) : 0;
+    if (end == 0 || end + 4 > length) {
+        return 0;
+    }
+    end += 4;
+    memcpy(reply, query, end);
+    put16(reply + 2, 0x8180);   // QR, RD, RA
+    put16(reply + 4, 1);
+    memset(reply + 6, 0, 6);
+    size_t pos = end;
+    bool a_query = (query[end - 4] == 0 && query[end - 3] == 1);
+
+    pthread_mutex_lock(&stub->lock);
+    dns_stub_record_t *record = NULL;
+    for (int i = 0; i < DNS_STUB_NAMES && record == NULL; i++) {
+        if (stub->records[i].name[0] != '\0' && strcasecmp(stub->records[i].name, name) == 0) {
+            record = &stub->records[i];
+        }
+    }
+    if (record == NULL) {
+        put16(reply + 2, 0x8183);   // NXDOMAIN
+    }
+    else if (a_query) {
+        uint16_t answers = 0;
+        // The A records belong to the question, or to the canonical name
+        uint16_t owner = 0xC00C;
+        if (record->cname[0] != '\0') {
+            put16(reply + pos, 0xC00C);
+            put16(reply + pos + 2, 5);
+            put16(reply + pos + 4, 1);
+            put32(reply + pos + 6, record->cname_ttl);
+            size_t cname_length = encode_name(record->cname, reply + pos + 12);
+            put16(reply + pos + 10, (uint16_t)cname_length);
+            owner = (uint16_t)(0xC000 | (pos + 12));
+            pos += 12 + cname_length;
+            answers++;
+        }
+        // Round robin: every answer starts one address further
+        size_t first = (stub->rotate && record->count > 0) ? record->answers++ % record->count : 0;
+        for (size_t i = 0; i < record->count && pos + 16 <= DNS_MAX_MESSAGE; i++) {
+            put16(reply + pos, owner);
+            put16(reply + pos + 2, 1);
+            put16(reply + pos + 4, 1);
+            put32(reply + pos + 6, record->ttl);
+            put16(reply + pos + 10, 4);
+            memcpy(reply + pos + 12, &record->addresses[(first + i) % record->count], 4);
+            pos += 16;
+            answers++;
+        }
+        put16(reply + 6, answers);
+    }
+    pthread_mutex_unlock(&stub->lock);
+    return pos;
+}
+
+static void *stub_main(void *arg) {
+    dns_stub_t *stub = arg;
+    while (!stub->stop) {
+        struct pollfd pfd = { .fd = stub->fd, .events = POLLIN };
+        if (poll(&pfd, 1, 20) != 1) {
+            continue;
+        }
+        uint8_t query[DNS_MAX_MESSAGE];
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        ssize_t received = recvfrom(stub->fd, query, sizeof(query), 0, (struct sockaddr *)&from, &from_length);
+        if (received <= 0) {
+            continue;
+        }
+        stub->queries++;
+        if (stub->down) {
+            continue;
+        }
+        uint8_t reply[DNS_MAX_MESSAGE];
+        size_t length = answer(stub, query, (size_t)received, reply);
+        uint32_t latency_ms = stub->latency_ms;
+        if (latency_ms > 0) {
+            struct timespec delay = { .tv_sec = latency_ms / 1000, .tv_nsec = (latency_ms % 1000) * 1000000L };
+            nanosleep(&delay, NULL);
+        }
+        if (length > 0) {
+            sendto(stub->fd, reply, length, 0, (struct sockaddr *)&from, from_length);
+        }
+    }
+    return NULL;
+}
+
+dns_stub_t *dns_stub_start(void) {
+    dns_stub_t *stub = calloc(1, sizeof(dns_stub_t));
+    if (stub == NULL) {
+        return NULL;
+    }
+    stub->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in at = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t length = sizeof(at);
+    if (stub->fd < 0 || bind(stub->fd, (struct sockaddr *)&at, sizeof(at)) != 0 ||
+        getsockname(stub->fd, (struct sockaddr *)&at, &length) != 0) {
+        if (stub->fd >= 0) {
+            close(stub->fd);
+        }
+        free(stub);
+        return NULL;
+    }
+    stub->port = ntohs(at.sin_port);
+    pthread_mutex_init(&stub->lock, NULL);
+    if (pthread_create(&stub->thread, NULL, stub_main, stub) != 0) {
+        pthread_mutex_destroy(&stub->lock);
+        close(stub->fd);
+        free(stub);
+        return NULL;
+    }
+    return stub;
+}
+
+void dns_stub_stop(dns_stub_t *stub) {
+    if (stub == NULL) {
+        return;
+    }
+    stub->stop = true;
+    pthread_join(stub->thread, NULL);
+    close(stub->fd);
+    pthread_mutex_destroy(&stub->lock);
+    free(stub);
+}
+
+uint16_t dns_stub_port(const dns_stub_t *stub) {
+    return stub->port;
+}
+
+int dns_stub_set(dns_stub_t *stub, const char *name, const char *cname, uint32_t cname_ttl,
+                 const uint32_t *addresses, size_t count, uint32_t ttl) {
+    if (strlen(name) >= DNS_STUB_MAX_NAME || (cname != NULL && strlen(cname) >= DNS_STUB_MAX_NAME)) {
+        return -1;
+    }
+    pthread_mutex_lock(&stub->lock);
+    dns_stub_record_t *record = NULL;
+    for (int i = 0; i < DNS_STUB_NAMES && record == NULL; i++) {
+        if (strcasecmp(stub->records[i].name, name) == 0) {
+            record = &stub->records[i];
+        }
+    }
+    for (int i = 0; i < DNS_STUB_NAMES && record == NULL; i++) {
+        if (stub->records[i].name[0] == '\0') {
+            record = &stub->records[i];
+        }
+    }
+    if (record != NULL) {
+        memset(record, 0, sizeof(dns_stub_record_t));
+        strcpy(record->name, name);
+        if (cname != NULL) {
+            strcpy(record->cname, cname);
+        }
+        record->cname_ttl = cname_ttl;
+        record->count = (count < DNS_STUB_MAX_ADDRESSES) ? count : DNS_STUB_MAX_ADDRESSES;
+        memcpy(record->addresses, addresses, record->count * sizeof(uint32_t));
+        record->ttl = ttl;
+    }
+    pthread_mutex_unlock(&stub->lock);
+    return (record != NULL) ? 0 : -1;
+}
+
+void dns_stub_set_latency(dns_stub_t *stub, uint32_t ms) {
+    stub->latency_ms = ms;
+}
+
+void dns_stub_set_down(dns_stub_t *stub, bool down) {
+    stub->down = down;
+}
+
+void dns_stub_set_rotate(dns_stub_t *stub, bool rotate) {
+    stub->rotate = rotate;
+}
+
+uint32_t dns_stub_queries(const dns_stub_t *stub) {
+    return stub->queries;
+}
@@ -0,0 +1,68 @@
+/**
+ * \file dns_stub.h
+ * \brief Local DNS server standing in for the resolver of the network, for the host benches.
+ *
+ * It answers the A queries over UDP from a table of names set by the bench, each with its addresses and TTL,
+ * optionally behind a CNAME with its own TTL (as the Azure IoT Hub names are). Other names get NXDOMAIN.
+ * A latency can be added before every answer, the addresses can be rotated from one answer to the next as
+ * round-robin resolvers do, and the server can be taken down: queries are then dropped.
+ * Point the cache at it with platform_linux_set_dns_server().
+ */
+#ifndef _DNS_STUB_H_
+#define _DNS_STUB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct dns_stub dns_stub_t;
+
+/**
+ * \brief Start the server on 127.0.0.1, on a free port.
+ * \return the server, NULL for failure
+ */
+dns_stub_t *dns_stub_start(void);
+
+/**
+ * \brief Stop the server.
+ */
+void dns_stub_stop(dns_stub_t *stub);
+
+/** \brief The server port */
+uint16_t dns_stub_port(const dns_stub_t *stub);
+
+/**
+ * \brief Set the answer for a name, replacing the previous one.
+ * \param[in] name      the name
+ * \param[in] cname     the canonical name the addresses belong to, NULL for none
+ * \param[in] cname_ttl the TTL of the CNAME record
+ * \param[in] addresses the addresses, in network byte order
+ * \param[in] count     the number of addresses
+ * \param[in] ttl       the TTL of the A records
+ * \return 0 for success, -1 if the table is full
+ */
+int dns_stub_set(dns_stub_t *stub, const char *name, const char *cname, uint32_t cname_ttl,
+                 const uint32_t *addresses, size_t count, uint32_t ttl);
+
+/** \brief Wait \p ms before every answer */
+void dns_stub_set_latency(dns_stub_t *stub, uint32_t ms);
+
+/** \brief Drop the queries while down */
+void dns_stub_set_down(dns_stub_t *stub, bool down);
+
+/** \brief Start every answer one address further than the previous one */
+void dns_stub_set_rotate(dns_stub_t *stub, bool rotate);
+
+/** \brief Number of queries received, answered or not */
+uint32_t dns_stub_queries(const dns_stub_t *stub);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _DNS_STUB_H_
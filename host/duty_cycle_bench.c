@@ -0,0 +1,553 @@
+/**
+ * \file duty_cycle_bench.c
+ * \brief Time awake per wake from deep sleep of the duty-cycle mode (app_duty_cycle_sample(),
+ *        app_duty_cycle_publish()), on the Linux platform.
+ *
+ * Each wake runs what app_main and the getting_started_task run in the duty-cycle mode, with the device RAM
+ * cleared in between and the app_retained_t kept, as deep sleep does. Three modes are compared:
+ *   - cold:     every sample is a power-on: load the context from flash, associate, check the status, resolve
+ *               the broker, full TLS handshake and publish one sample
+ *   - batch:    the samples are kept and published DUTY_CYCLE_SAMPLES at a time, nothing else is kept
+ *   - retained: the batch mode with the packed context, the broker address and the TLS session kept as well
+ *
+ * The bench runs a TLS MQTT broker on 127.0.0.1 and replaces the QuarkLink client with a model: the stored
+ * context is read from the NVS emulator, a status call takes a fixed time. The Wi-Fi association and the DNS
+ * latency are modelled by platform_linux_set_network_latency(). The MQTT handshake and publish are real.
+ * It checks that every sample reaches the broker once, and that with the retained state a radio wake reads
+ * nothing from flash, resolves nothing and resumes the TLS session, after the first one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+#include "app.h"
+#include "quarklink.h"
+#include "platform.h"
+#include "platform_linux.h"
+#include "nvs_mock.h"
+
+#define DEVICE_ID       "duty-cycle-bench"
+#define BROKER_HOST     "localhost"
+
+typedef enum {
+    MODE_COLD = 0,
+    MODE_BATCH,
+    MODE_RETAINED,
+    MODE_COUNT
+} bench_mode_t;
+
+static const char *s_mode_names[MODE_COUNT] = { "cold", "batch", "retained" };
+
+typedef struct {
+    SSL_CTX *ctx;
+    int listen_fd;
+    uint16_t port;
+    char *cert_pem;
+    /** Close the connections right away, as an unreachable broker */
+    atomic_bool refuse;
+    atomic_int handshakes;
+    atomic_int resumed;
+    atomic_int publishes;
+    atomic_int samples;
+} broker_t;
+
+typedef struct {
+    int wakes;
+    int radio_wakes;
+    int failed_wakes;
+    int64_t awake_us;
+    int64_t radio_awake_us;
+    int64_t sample_awake_us;
+    uint64_t flash_read;
+    int64_t dns_lookups;
+    int64_t status_calls;
+    int handshakes;
+    int resumed;
+    int samples_published;
+} result_t;
+
+static broker_t s_broker;
+static uint32_t s_status_ms = 250;
+static atomic_bool s_enrolled = false;
+
+/**
+ * MQTT broker
+ */
+
+/* Self-signed certificate for localhost, its PEM kept for the enrolment */
+static int broker_credentials(SSL_CTX *ctx) {
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (key_ctx == NULL || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        return -1;
+    }
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509 *crt = X509_new();
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), 1);
+    X509_gmtime_adj(X509_getm_notBefore(crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 24 * 3600);
+    X509_set_pubkey(crt, key);
+    X509_NAME *name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)BROKER_HOST, -1, -1, 0);
+    X509_set_issuer_name(crt, name);
+    X509V3_CTX ext_ctx;
+    X509V3_set_ctx(&ext_ctx, crt, crt, NULL, NULL, 0);
+    X509_EXTENSION *san = X509V3_EXT_conf_nid(NULL, &ext_ctx, NID_subject_alt_name, "DNS:" BROKER_HOST);
+    X509_add_ext(crt, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(crt, key, EVP_sha256());
+
+    int ret = -1;
+    BIO *bio = BIO_new(BIO_s_mem());
+    char *pem = NULL;
+    long pem_len;
+    if (bio != NULL && PEM_write_bio_X509(bio, crt) == 1 && (pem_len = BIO_get_mem_data(bio, &pem)) > 0 &&
+        SSL_CTX_use_certificate(ctx, crt) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1) {
+        s_broker.cert_pem = strndup(pem, pem_len);
+        ret = s_broker.cert_pem != NULL ? 0 : -1;
+    }
+    BIO_free(bio);
+    X509_free(crt);
+    EVP_PKEY_free(key);
+    return ret;
+}
+
+static int read_exact(SSL *ssl, uint8_t *data, size_t length) {
+    while (length > 0) {
+        int n = SSL_read(ssl, data, (int)length);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/* Count the samples of a batch: the elements of its "temperature" array */
+static int batch_samples(const uint8_t *payload, size_t length) {
+    char text[MAX_BATCH_LENGTH + 1];
+    if (length > MAX_BATCH_LENGTH) {
+        return 0;
+    }
+    memcpy(text, payload, length);
+    text[length] = '\0';
+    const char *array = strstr(text, "\"temperature\":[");
+    if (array == NULL || array[15] == ']') {
+        return 0;
+    }
+    int samples = 1;
+    for (const char *c = array + 15; *c != '\0' && *c != ']'; c++) {
+        samples += (*c == ',');
+    }
+    return samples;
+}
+
+static void *broker_connection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    SSL *ssl = SSL_new(s_broker.ctx);
+    SSL_set_fd(ssl, fd);
+    if (atomic_load(&s_broker.refuse) || SSL_accept(ssl) != 1) {
+        goto done;
+    }
+    atomic_fetch_add(&s_broker.handshakes, 1);
+    if (SSL_session_reused(ssl)) {
+        atomic_fetch_add(&s_broker.resumed, 1);
+    }
+
+    while (1) {
+        uint8_t type;
+        if (read_exact(ssl, &type, 1) != 0) {
+            break;
+        }
+        size_t length = 0;
+        for (int shift = 0; shift < 28; shift += 7) {
+            uint8_t byte;
+            if (read_exact(ssl, &byte, 1) != 0) {
+                goto done;
+            }
+            length |= (size_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        uint8_t *body = malloc(length + 1);
+        if (body == NULL || read_exact(ssl, body, length) != 0) {
+            free(body);
+            break;
+        }
+        uint8_t reply[4] = { 0 };
+        switch (type & 0xF0) {
+        case 0x10:  // CONNECT: CONNACK
+            reply[0] = 0x20;
+            reply[1] = 2;
+            SSL_write(ssl, reply, 4);
+            break;
+        case 0x30:  // PUBLISH: PUBACK for QoS 1
+            if (length >= 2) {
+                size_t topic_length = (body[0] << 8) | body[1];
+                size_t offset = 2 + topic_length + (((type >> 1) & 3) > 0 ? 2 : 0);
+                if (offset <= length) {
+                    atomic_fetch_add(&s_broker.publishes, 1);
+                    atomic_fetch_add(&s_broker.samples, batch_samples(body + offset, length - offset));
+                }
+                if (((type >> 1) & 3) == 1 && 2 + topic_length + 2 <= length) {
+                    reply[0] = 0x40;
+                    reply[1] = 2;
+                    reply[2] = body[2 + topic_length];
+                    reply[3] = body[2 + topic_length + 1];
+                    SSL_write(ssl, reply, 4);
+                }
+            }
+            break;
+        case 0xC0:  // PINGREQ
+            reply[0] = 0xD0;
+            SSL_write(ssl, reply, 2);
+            break;
+        case 0xE0:  // DISCONNECT
+            free(body);
+            goto done;
+        default:
+            break;
+        }
+        free(body);
+    }
+done:
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    ERR_clear_error();
+    return NULL;
+}
+
+static void *broker_accept(void *arg) {
+    while (1) {
+        int fd = accept(s_broker.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, broker_connection, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int broker_start(void) {
+    s_broker.ctx = SSL_CTX_new(TLS_server_method());
+    if (s_broker.ctx == NULL || broker_credentials(s_broker.ctx) != 0) {
+        return -1;
+    }
+    // One TLS 1.3 ticket per connection, the client keeps the last one
+    SSL_CTX_set_num_tickets(s_broker.ctx, 1);
+    s_broker.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t address_length = sizeof(address);
+    if (bind(s_broker.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(s_broker.listen_fd, 16) != 0 ||
+        getsockname(s_broker.listen_fd, (struct sockaddr *)&address, &address_length) != 0) {
+        return -1;
+    }
+    s_broker.port = ntohs(address.sin_port);
+    pthread_t thread;
+    return pthread_create(&thread, NULL, broker_accept, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * QuarkLink client model
+ */
+
+/* The provisioning data, persisted by the client library in NVS */
+static void provision(void) {
+    quarklink_context_t *provisioned = calloc(1, sizeof(quarklink_context_t));
+    nvs_handle_t handle;
+    if (provisioned != NULL && nvs_open("quarklink", NVS_READWRITE, &handle) == ESP_OK) {
+        strcpy(provisioned->endpoint, "bench.quarklink.io");
+        provisioned->port = 6000;
+        strcpy(provisioned->deviceID, DEVICE_ID);
+        nvs_set_blob(handle, "context", provisioned, sizeof(quarklink_context_t));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    free(provisioned);
+}
+
+quarklink_return_t quarklink_init(quarklink_context_t *quarklink, const char *endpoint, const char *rootCert) {
+    memset(quarklink, 0, sizeof(quarklink_context_t));
+    snprintf(quarklink->endpoint, sizeof(quarklink->endpoint), "%s", endpoint);
+    snprintf(quarklink->rootCert, sizeof(quarklink->rootCert), "%s", rootCert);
+    strcpy(quarklink->deviceID, DEVICE_ID);
+    return QUARKLINK_SUCCESS;
+}
+
+quarklink_return_t quarklink_loadStoredContext(quarklink_context_t *quarklink) {
+    // Reads the whole context, the enrolment fields are in the enrolment store
+    nvs_handle_t handle;
+    size_t length = sizeof(quarklink_context_t);
+    if (nvs_open("quarklink", NVS_READONLY, &handle) != ESP_OK) {
+        return QUARKLINK_CONTEXT_NOTHING_STORED;
+    }
+    esp_err_t err = nvs_get_blob(handle, "context", quarklink, &length);
+    nvs_close(handle);
+    return err == ESP_OK ? QUARKLINK_CONTEXT_NO_ENROLMENT_INFO_STORED : QUARKLINK_CONTEXT_NOTHING_STORED;
+}
+
+quarklink_return_t quarklink_deleteEnrolmentContext(const quarklink_context_t *quarklink) {
+    return QUARKLINK_SUCCESS;
+}
+
+/* A modelled API call, counted like the calls of quarklink_linux.c */
+static void quarklink_call(void) {
+    platform_linux_stat_add(PLATFORM_LINUX_QUARKLINK_REQUESTS, 1);
+    usleep(s_status_ms * 1000);
+}
+
+quarklink_return_t quarklink_status(quarklink_context_t *quarklink) {
+    quarklink_call();
+    return atomic_load(&s_enrolled) ? QUARKLINK_STATUS_ENROLLED : QUARKLINK_STATUS_NOT_ENROLLED;
+}
+
+quarklink_return_t quarklink_enrol(quarklink_context_t *quarklink) {
+    quarklink_call();
+    snprintf(quarklink->deviceCert, sizeof(quarklink->deviceCert), "%s", s_broker.cert_pem);
+    snprintf(quarklink->iotHubRootCert, sizeof(quarklink->iotHubRootCert), "%s", s_broker.cert_pem);
+    strcpy(quarklink->iotHubEndpoint, BROKER_HOST);
+    quarklink->iotHubPort = s_broker.port;
+    atomic_store(&s_enrolled, true);
+    return QUARKLINK_SUCCESS;
+}
+
+quarklink_return_t quarklink_firmwareUpdate(quarklink_context_t *quarklink, const char *signingKey) {
+    return QUARKLINK_FWUPDATE_NO_UPDATE;
+}
+
+/**
+ * Wakes
+ */
+
+static app_device_t s_device;
+
+/* One wake from deep sleep, as app_main and the getting_started_task run it. Returns the time awake, in us */
+static int64_t wake(app_retained_t *retained, bench_mode_t mode, bool *radio, bool *published) {
+    int64_t start_ns = bench_now_ns();
+    if (mode == MODE_COLD) {
+        // Power-on
+        memset(retained, 0, sizeof(app_retained_t));
+    }
+    *radio = app_duty_cycle_sample(retained) || mode == MODE_COLD;
+    *published = false;
+    if (*radio) {
+        if (mode == MODE_BATCH) {
+            // Only the samples are kept
+            retained->context_length = 0;
+            retained->broker_address = 0;
+            retained->session.length = 0;
+        }
+        uint32_t batches = retained->batches;
+        memset(&s_device, 0, sizeof(s_device));
+        s_device.keep_metrics = true;
+        if ((app_device_restore(&s_device, retained) == 0 || app_device_load(&s_device) == 0) &&
+            platform_network_start() == 0) {
+            app_duty_cycle_publish(&s_device, retained);
+        }
+        *published = retained->batches != batches;
+        // The RAM is lost in deep sleep
+        ql_state_free(&s_device.state);
+    }
+    return (bench_now_ns() - start_ns) / 1000;
+}
+
+static void run(bench_mode_t mode, int wakes, result_t *result) {
+    int64_t values[PLATFORM_LINUX_STAT_COUNT];
+    int64_t before[PLATFORM_LINUX_STAT_COUNT];
+    nvs_mock_stats_t nvs_before;
+    nvs_mock_stats_t nvs_after;
+    memset(result, 0, sizeof(result_t));
+    platform_linux_get_stats(before, NULL);
+    nvs_mock_get_stats(DEVICE_ID, &nvs_before);
+    int handshakes = atomic_load(&s_broker.handshakes);
+    int resumed = atomic_load(&s_broker.resumed);
+    int samples = atomic_load(&s_broker.samples);
+
+    static app_retained_t retained;
+    memset(&retained, 0, sizeof(retained));
+    for (int i = 0; i < wakes; i++) {
+        bool radio;
+        bool published;
+        int64_t awake_us = wake(&retained, mode, &radio, &published);
+        result->wakes++;
+        result->awake_us += awake_us;
+        if (radio) {
+            result->radio_wakes++;
+            result->radio_awake_us += awake_us;
+            result->failed_wakes += published ? 0 : 1;
+        }
+        else {
+            result->sample_awake_us += awake_us;
+        }
+    }
+
+    platform_linux_get_stats(values, NULL);
+    nvs_mock_get_stats(DEVICE_ID, &nvs_after);
+    result->flash_read = nvs_after.bytes_read - nvs_before.bytes_read;
+    result->dns_lookups = values[PLATFORM_LINUX_DNS_LOOKUPS] - before[PLATFORM_LINUX_DNS_LOOKUPS];
+    result->status_calls = values[PLATFORM_LINUX_QUARKLINK_REQUESTS] - before[PLATFORM_LINUX_QUARKLINK_REQUESTS];
+    result->handshakes = atomic_load(&s_broker.handshakes) - handshakes;
+    result->resumed = atomic_load(&s_broker.resumed) - resumed;
+    result->samples_published = atomic_load(&s_broker.samples) - samples;
+}
+
+static double per(double value, int count) {
+    return count > 0 ? value / count : 0.0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -b BATCHES     radio wakes of the batch modes (%d samples each) (6)\n"
+            "  -c WAKES       wakes of the cold mode (5)\n"
+            "  -a MS          modelled Wi-Fi association time (300)\n"
+            "  -d MS          modelled DNS latency (30)\n"
+            "  -q MS          modelled QuarkLink status time (250)\n", name, DUTY_CYCLE_SAMPLES);
+}
+
+int main(int argc, char **argv) {
+    int batches = 6;
+    int cold_wakes = 5;
+    uint32_t associate_ms = 300;
+    uint32_t dns_ms = 30;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:c:a:d:q:h")) != -1) {
+        switch (opt) {
+        case 'b': batches = atoi(optarg); break;
+        case 'c': cold_wakes = atoi(optarg); break;
+        case 'a': associate_ms = (uint32_t)atoi(optarg); break;
+        case 'd': dns_ms = (uint32_t)atoi(optarg); break;
+        case 'q': s_status_ms = (uint32_t)atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (batches <= 0 || cold_wakes <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    if (broker_start() != 0) {
+        fprintf(stderr, "Cannot start the MQTT broker\n");
+        return 1;
+    }
+    platform_linux_bind_device(DEVICE_ID);
+    platform_linux_set_network_latency(associate_ms, dns_ms);
+    provision();
+
+    // First boot: enrol, as after provisioning
+    result_t enrol;
+    run(MODE_COLD, 1, &enrol);
+    bench_check(atomic_load(&s_enrolled) && enrol.samples_published == 1, "enrolled and published at the first boot");
+
+    result_t results[MODE_COUNT];
+    run(MODE_COLD, cold_wakes, &results[MODE_COLD]);
+    run(MODE_BATCH, batches * DUTY_CYCLE_SAMPLES, &results[MODE_BATCH]);
+    run(MODE_RETAINED, batches * DUTY_CYCLE_SAMPLES, &results[MODE_RETAINED]);
+
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        const result_t *result = &results[mode];
+        char what[64];
+        snprintf(what, sizeof(what), "every sample published once (%s)", s_mode_names[mode]);
+        bench_check(result->failed_wakes == 0 && result->samples_published == result->wakes, what);
+    }
+    const result_t *retained = &results[MODE_RETAINED];
+    bench_check(results[MODE_BATCH].radio_wakes == batches && retained->radio_wakes == batches,
+                "one radio wake per DUTY_CYCLE_SAMPLES samples");
+    // Only the first radio wake after power-on loads the context from flash
+    bench_check(retained->flash_read == results[MODE_BATCH].flash_read / batches, "no flash read with the retained context");
+    bench_check(retained->dns_lookups == 1, "one DNS lookup with the retained address");
+    bench_check(retained->resumed == retained->handshakes - 1, "TLS session resumed after the first radio wake");
+    bench_check(retained->status_calls == (batches + DUTY_CYCLE_STATUS_INTERVAL - 1) / DUTY_CYCLE_STATUS_INTERVAL,
+                "status checked every DUTY_CYCLE_STATUS_INTERVAL radio wakes");
+    bench_check(per(retained->awake_us, retained->wakes) < per(results[MODE_COLD].awake_us, results[MODE_COLD].wakes),
+                "less time awake per sample than a cold boot per sample");
+
+    // Unreachable broker: the batch is kept, the oldest sample dropped at the next wake, then published
+    static app_retained_t state;
+    memset(&state, 0, sizeof(state));
+    int wakes = 0;
+    bool radio = false;
+    bool published = false;
+    while (!radio) {
+        wake(&state, MODE_RETAINED, &radio, &published);
+        wakes++;
+    }
+    atomic_store(&s_broker.refuse, true);
+    for (int i = 0; i < DUTY_CYCLE_SAMPLES; i++) {
+        wake(&state, MODE_RETAINED, &radio, &published);
+    }
+    bench_check(!published && state.sample_count == DUTY_CYCLE_SAMPLES, "samples kept while the broker is unreachable");
+    bench_check(state.broker_address == 0 && state.session.length == 0, "address and session dropped after a failed connection");
+    atomic_store(&s_broker.refuse, false);
+    wake(&state, MODE_RETAINED, &radio, &published);
+    bench_check(published && state.sample_count == 0 && state.dropped == 1, "oldest sample dropped, then the batch published");
+
+    printf("Duty-cycle wakes: %d samples per radio wake, status every %d radio wakes, "
+           "modelled association %ums, DNS %ums, status %ums\n",
+           DUTY_CYCLE_SAMPLES, DUTY_CYCLE_STATUS_INTERVAL, associate_ms, dns_ms, s_status_ms);
+    printf("  %-30s %12s %12s %12s\n", "", s_mode_names[MODE_COLD], s_mode_names[MODE_BATCH], s_mode_names[MODE_RETAINED]);
+    printf("  %-30s %12d %12d %12d\n", "wakes", results[0].wakes, results[1].wakes, results[2].wakes);
+    printf("  %-30s %12d %12d %12d\n", "radio wakes", results[0].radio_wakes, results[1].radio_wakes, results[2].radio_wakes);
+    printf("  %-30s %10.2fms %10.2fms %10.2fms\n", "awake per radio wake",
+           per(results[0].radio_awake_us, results[0].radio_wakes) / 1000,
+           per(results[1].radio_awake_us, results[1].radio_wakes) / 1000,
+           per(results[2].radio_awake_us, results[2].radio_wakes) / 1000);
+    printf("  %-30s %12s %10.1fus %10.1fus\n", "awake per sample-only wake", "-",
+           per(results[1].sample_awake_us, results[1].wakes - results[1].radio_wakes),
+           per(results[2].sample_awake_us, results[2].wakes - results[2].radio_wakes));
+    printf("  %-30s %10.2fms %10.2fms %10.2fms\n", "awake per sample",
+           per(results[0].awake_us, results[0].wakes) / 1000,
+           per(results[1].awake_us, results[1].wakes) / 1000,
+           per(results[2].awake_us, results[2].wakes) / 1000);
+    printf("  %-30s %12.0f %12.0f %12.0f\n", "flash bytes read/radio wake",
+           per(results[0].flash_read, results[0].radio_wakes), per(results[1].flash_read, results[1].radio_wakes),
+           per(results[2].flash_read, results[2].radio_wakes));
+    printf("  %-30s %12.2f %12.2f %12.2f\n", "DNS lookups/radio wake",
+           per(results[0].dns_lookups, results[0].radio_wakes), per(results[1].dns_lookups, results[1].radio_wakes),
+           per(results[2].dns_lookups, results[2].radio_wakes));
+    printf("  %-30s %12.2f %12.2f %12.2f\n", "status calls/radio wake",
+           per(results[0].status_calls, results[0].radio_wakes), per(results[1].status_calls, results[1].radio_wakes),
+           per(results[2].status_calls, results[2].radio_wakes));
+    printf("  %-30s %9d/%-2d %9d/%-2d %9d/%-2d\n", "resumed/TLS handshakes",
+           results[0].resumed, results[0].handshakes, results[1].resumed, results[1].handshakes,
+           results[2].resumed, results[2].handshakes);
+    printf("  retained state: %zu bytes of RTC memory, context %u bytes, TLS session %u bytes\n",
+           sizeof(app_retained_t), state.context_length, state.session.length);
+
+    return bench_result();
+}
@@ -0,0 +1,788 @@
+/**
+ * \file early_data_bench.c
+ * \brief Time to the first publish of a new MQTT connection, with and without TLS 1.3 early data (0-RTT).
+ *
+ * The bench runs a TLS 1.3 MQTT broker on 127.0.0.1 that accepts early data, behind a proxy that delays every
+ * byte by a one-way latency, and holds back the first byte from the client by one more round trip, as the TCP
+ * handshake does. Each connection of the Linux MQTT client (mqtt_linux.c) publishes one QoS 0 message, and the
+ * bench measures the time from platform_mqtt_start() to the PUBLISH reaching the broker, and to the CONNECTED
+ * event. The modes are:
+ *   - full:      no TLS session kept, the message published once connected (as before the connect messages)
+ *   - raced:     as full, on a TCP connection established beforehand and handed over, as by the broker race
+ *   - resumed:   the TLS session resumed, the message published once connected
+ *   - pipelined: the TLS session resumed, the message written with the CONNECT without waiting for the CONNACK
+ *   - 0-rtt:     the CONNECT and the message sent as early data with the ClientHello
+ *   - rejected:  as 0-rtt, with a broker that rejects the early data: both are sent again after the handshake
+ * It checks that every message reaches the broker once, that the early data is accepted or rejected as the broker
+ * decides, and that each mode takes the round trips it should.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+#include "platform.h"
+#include "platform_linux.h"
+
+#define BROKER_HOST     "localhost"
+#define TOPIC           "bench/early-data"
+#define MAX_CONNECTIONS (1000)
+
+typedef enum {
+    MODE_FULL = 0,
+    MODE_RACED,
+    MODE_RESUMED,
+    MODE_PIPELINED,
+    MODE_EARLY,
+    MODE_REJECTED,
+    MODE_COUNT
+} bench_mode_t;
+
+static const char *s_mode_names[MODE_COUNT] = { "full", "raced", "resumed", "pipelined", "0-rtt", "rejected" };
+
+typedef struct {
+    SSL_CTX *ctx;
+    int listen_fd;
+    uint16_t port;
+    char *cert_pem;
+    /** Reject the early data of the next connections */
+    atomic_bool reject_early;
+    atomic_int handshakes;
+    atomic_int resumed;
+    /** Connections that sent early data, and the PUBLISH packets received in it */
+    atomic_int early_connections;
+    atomic_int early_publishes;
+    /** PUBLISH packets received, and the time of the last one */
+    pthread_mutex_t lock;
+    pthread_cond_t published;
+    int publishes;
+    int64_t published_ns;
+} broker_t;
+
+typedef struct {
+    int listen_fd;
+    uint16_t port;
+    uint32_t delay_ms;
+} proxy_t;
+
+typedef struct {
+    int connections;
+    int delivered;
+    int64_t publish_ns[MAX_CONNECTIONS];
+    int64_t connected_ns[MAX_CONNECTIONS];
+    int handshakes;
+    int resumed;
+    int early_sent;
+    int early_publishes;
+    int64_t early_accepted;
+    int64_t early_rejected;
+} result_t;
+
+static broker_t s_broker = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .published = PTHREAD_COND_INITIALIZER,
+};
+static proxy_t s_proxy;
+
+static void sleep_until_ns(int64_t deadline) {
+    struct timespec ts = {
+        .tv_sec = deadline / 1000000000,
+        .tv_nsec = deadline % 1000000000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static int listen_loopback(uint16_t *port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t address_length = sizeof(address);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &address_length) != 0) {
+        return -1;
+    }
+    *port = ntohs(address.sin_port);
+    return fd;
+}
+
+/**
+ * MQTT broker
+ */
+
+/* Self-signed certificate for localhost, its PEM kept for the client */
+static int broker_credentials(SSL_CTX *ctx) {
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (key_ctx == NULL || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        return -1;
+    }
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509 *crt = X509_new();
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), 1);
+    X509_gmtime_adj(X509_getm_notBefore(crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 24 * 3600);
+    X509_set_pubkey(crt, key);
+    X509_NAME *name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)BROKER_HOST, -1, -1, 0);
+    X509_set_issuer_name(crt, name);
+    X509V3_CTX ext_ctx;
+    X509V3_set_ctx(&ext_ctx, crt, crt, NULL, NULL, 0);
+    X509_EXTENSION *san = X509V3_EXT_conf_nid(NULL, &ext_ctx, NID_subject_alt_name, "DNS:" BROKER_HOST);
+    X509_add_ext(crt, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(crt, key, EVP_sha256());
+
+    int ret = -1;
+    BIO *bio = BIO_new(BIO_s_mem());
+    char *pem = NULL;
+    long pem_len;
+    if (bio != NULL && PEM_write_bio_X509(bio, crt) == 1 && (pem_len = BIO_get_mem_data(bio, &pem)) > 0 &&
+        SSL_CTX_use_certificate(ctx, crt) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1) {
+        s_broker.cert_pem = strndup(pem, pem_len);
+        ret = s_broker.cert_pem != NULL ? 0 : -1;
+    }
+    BIO_free(bio);
+    X509_free(crt);
+    EVP_PKEY_free(key);
+    return ret;
+}
+
+static int allow_early_data(SSL *ssl, void *arg) {
+    return atomic_load(&s_broker.reject_early) ? 0 : 1;
+}
+
+/* Bytes received on a connection, parsed into MQTT packets as they arrive */
+typedef struct {
+    SSL *ssl;
+    uint8_t data[4096];
+    size_t length;
+    /** Replies held back until the handshake completes */
+    uint8_t replies[64];
+    size_t replies_length;
+    bool handshake_done;
+    bool disconnect;
+} broker_conn_t;
+
+static void reply(broker_conn_t *conn, const uint8_t *packet, size_t length) {
+    if (conn->handshake_done) {
+        SSL_write(conn->ssl, packet, (int)length);
+    }
+    else if (conn->replies_length + length <= sizeof(conn->replies)) {
+        memcpy(conn->replies + conn->replies_length, packet, length);
+        conn->replies_length += length;
+    }
+}
+
+static void handle_packet(broker_conn_t *conn, uint8_t type, const uint8_t *body, size_t length, bool early) {
+    uint8_t packet[4] = { 0 };
+    switch (type & 0xF0) {
+    case 0x10:  // CONNECT: CONNACK
+        packet[0] = 0x20;
+        packet[1] = 2;
+        reply(conn, packet, 4);
+        break;
+    case 0x30:  // PUBLISH
+        pthread_mutex_lock(&s_broker.lock);
+        s_broker.publishes++;
+        s_broker.published_ns = bench_now_ns();
+        pthread_cond_broadcast(&s_broker.published);
+        pthread_mutex_unlock(&s_broker.lock);
+        if (early) {
+            atomic_fetch_add(&s_broker.early_publishes, 1);
+        }
+        if (((type >> 1) & 3) == 1 && length >= 2) {
+            size_t topic_length = (body[0] << 8) | body[1];
+            if (2 + topic_length + 2 <= length) {
+                packet[0] = 0x40;
+                packet[1] = 2;
+                packet[2] = body[2 + topic_length];
+                packet[3] = body[2 + topic_length + 1];
+                reply(conn, packet, 4);
+            }
+        }
+        break;
+    case 0xC0:  // PINGREQ
+        packet[0] = 0xD0;
+        reply(conn, packet, 2);
+        break;
+    case 0xE0:  // DISCONNECT
+        conn->disconnect = true;
+        break;
+    default:
+        break;
+    }
+}
+
+/* Append received bytes and handle the complete packets */
+static int receive(broker_conn_t *conn, const uint8_t *data, size_t length, bool early) {
+    if (conn->length + length > sizeof(conn->data)) {
+        return -1;
+    }
+    memcpy(conn->data + conn->length, data, length);
+    conn->length += length;
+    size_t offset = 0;
+    while (offset < conn->length) {
+        size_t remaining = 0;
+        size_t header = 1;
+        bool complete = false;
+        for (int shift = 0; shift < 28 && offset + header < conn->length; shift += 7) {
+            uint8_t byte = conn->data[offset + header++];
+            remaining |= (size_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || offset + header + remaining > conn->length) {
+            break;
+        }
+        handle_packet(conn, conn->data[offset], conn->data + offset + header, remaining, early);
+        offset += header + remaining;
+    }
+    memmove(conn->data, conn->data + offset, conn->length - offset);
+    conn->length -= offset;
+    return 0;
+}
+
+static void *broker_connection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    broker_conn_t *conn = calloc(1, sizeof(broker_conn_t));
+    if (conn == NULL) {
+        close(fd);
+        return NULL;
+    }
+    conn->ssl = SSL_new(s_broker.ctx);
+    SSL_set_fd(conn->ssl, fd);
+
+    // The early data is handled as it arrives, before the client Finished
+    uint8_t buffer[2048];
+    bool early = false;
+    for (;;) {
+        size_t n = 0;
+        int ret = SSL_read_early_data(conn->ssl, buffer, sizeof(buffer), &n);
+        if (ret == SSL_READ_EARLY_DATA_ERROR) {
+            goto done;
+        }
+        if (n > 0) {
+            early = true;
+            if (receive(conn, buffer, n, true) != 0) {
+                goto done;
+            }
+        }
+        if (ret == SSL_READ_EARLY_DATA_FINISH) {
+            break;
+        }
+    }
+    if (SSL_accept(conn->ssl) != 1) {
+        goto done;
+    }
+    conn->handshake_done = true;
+    atomic_fetch_add(&s_broker.handshakes, 1);
+    if (SSL_session_reused(conn->ssl)) {
+        atomic_fetch_add(&s_broker.resumed, 1);
+    }
+    if (early) {
+        atomic_fetch_add(&s_broker.early_connections, 1);
+    }
+    if (conn->replies_length > 0) {
+        SSL_write(conn->ssl, conn->replies, (int)conn->replies_length);
+    }
+
+    while (!conn->disconnect) {
+        int n = SSL_read(conn->ssl, buffer, sizeof(buffer));
+        if (n <= 0 || receive(conn, buffer, (size_t)n, false) != 0) {
+            break;
+        }
+    }
+done:
+    SSL_shutdown(conn->ssl);
+    SSL_free(conn->ssl);
+    close(fd);
+    free(conn);
+    ERR_clear_error();
+    return NULL;
+}
+
+static void *broker_accept(void *arg) {
+    while (1) {
+        int fd = accept(s_broker.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, broker_connection, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int broker_start(void) {
+    s_broker.ctx = SSL_CTX_new(TLS_server_method());
+    if (s_broker.ctx == NULL || broker_credentials(s_broker.ctx) != 0) {
+        return -1;
+    }
+    SSL_CTX_set_min_proto_version(s_broker.ctx, TLS1_3_VERSION);
+    // One ticket per connection, single use: OpenSSL refuses early data with a ticket already seen
+    SSL_CTX_set_num_tickets(s_broker.ctx, 1);
+    SSL_CTX_set_max_early_data(s_broker.ctx, 16384);
+    SSL_CTX_set_allow_early_data_cb(s_broker.ctx, allow_early_data, NULL);
+    s_broker.listen_fd = listen_loopback(&s_broker.port);
+    if (s_broker.listen_fd < 0) {
+        return -1;
+    }
+    pthread_t thread;
+    return pthread_create(&thread, NULL, broker_accept, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * Latency proxy
+ */
+
+typedef struct chunk {
+    struct chunk *next;
+    int64_t due_ns;
+    size_t length;
+    uint8_t data[];
+} chunk_t;
+
+/* One direction of a proxied connection: a reader queues what it receives, a writer forwards it when due */
+typedef struct {
+    int from;
+    int to;
+    /** Nothing is forwarded before, the model of the TCP handshake */
+    int64_t not_before_ns;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    chunk_t *head;
+    chunk_t *tail;
+    bool closed;
+    pthread_t reader;
+    pthread_t writer;
+} pipe_t;
+
+typedef struct {
+    int client_fd;
+    int broker_fd;
+    pipe_t up;
+    pipe_t down;
+} proxy_conn_t;
+
+static void *pipe_reader(void *arg) {
+    pipe_t *pipe = arg;
+    int64_t delay_ns = s_proxy.delay_ms * 1000000LL;
+    uint8_t buffer[4096];
+    for (;;) {
+        ssize_t n = read(pipe->from, buffer, sizeof(buffer));
+        if (n <= 0) {
+            break;
+        }
+        chunk_t *chunk = malloc(sizeof(chunk_t) + n);
+        if (chunk == NULL) {
+            break;
+        }
+        int64_t now = bench_now_ns();
+        chunk->next = NULL;
+        chunk->due_ns = (now > pipe->not_before_ns ? now : pipe->not_before_ns) + delay_ns;
+        chunk->length = (size_t)n;
+        memcpy(chunk->data, buffer, n);
+        pthread_mutex_lock(&pipe->lock);
+        if (pipe->tail != NULL) {
+            pipe->tail->next = chunk;
+        }
+        else {
+            pipe->head = chunk;
+        }
+        pipe->tail = chunk;
+        pthread_cond_signal(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+    pthread_mutex_lock(&pipe->lock);
+    pipe->closed = true;
+    pthread_cond_signal(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+    return NULL;
+}
+
+static void *pipe_writer(void *arg) {
+    pipe_t *pipe = arg;
+    for (;;) {
+        pthread_mutex_lock(&pipe->lock);
+        while (pipe->head == NULL && !pipe->closed) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        chunk_t *chunk = pipe->head;
+        if (chunk != NULL) {
+            pipe->head = chunk->next;
+            if (pipe->head == NULL) {
+                pipe->tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&pipe->lock);
+        if (chunk == NULL) {
+            break;
+        }
+        sleep_until_ns(chunk->due_ns);
+        ssize_t n = send(pipe->to, chunk->data, chunk->length, MSG_NOSIGNAL);
+        free(chunk);
+        if (n < 0) {
+            // The other end is gone: stop reading this side too
+            shutdown(pipe->from, SHUT_RD);
+        }
+    }
+    shutdown(pipe->to, SHUT_WR);
+    return NULL;
+}
+
+static int pipe_start(pipe_t *pipe, int from, int to, int64_t not_before_ns) {
+    pipe->from = from;
+    pipe->to = to;
+    pipe->not_before_ns = not_before_ns;
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->changed, NULL);
+    if (pthread_create(&pipe->reader, NULL, pipe_reader, pipe) != 0) {
+        return -1;
+    }
+    if (pthread_create(&pipe->writer, NULL, pipe_writer, pipe) != 0) {
+        shutdown(from, SHUT_RD);
+        pthread_join(pipe->reader, NULL);
+        return -1;
+    }
+    return 0;
+}
+
+static void pipe_join(pipe_t *pipe) {
+    pthread_join(pipe->reader, NULL);
+    pthread_join(pipe->writer, NULL);
+    pthread_mutex_destroy(&pipe->lock);
+    pthread_cond_destroy(&pipe->changed);
+}
+
+static void *proxy_connection(void *arg) {
+    proxy_conn_t *conn = arg;
+    // The client sends its first byte one round trip after connect(), once the SYN-ACK has come back
+    int64_t handshake_ns = bench_now_ns() + 2 * s_proxy.delay_ms * 1000000LL;
+    if (pipe_start(&conn->up, conn->client_fd, conn->broker_fd, handshake_ns) == 0) {
+        if (pipe_start(&conn->down, conn->broker_fd, conn->client_fd, 0) == 0) {
+            pipe_join(&conn->down);
+        }
+        else {
+            shutdown(conn->client_fd, SHUT_RDWR);
+        }
+        pipe_join(&conn->up);
+    }
+    close(conn->client_fd);
+    close(conn->broker_fd);
+    free(conn);
+    return NULL;
+}
+
+static void *proxy_accept(void *arg) {
+    while (1) {
+        int client_fd = accept(s_proxy.listen_fd, NULL, NULL);
+        if (client_fd < 0) {
+            continue;
+        }
+        int broker_fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {
+            .sin_family = AF_INET,
+            .sin_port = htons(s_broker.port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        proxy_conn_t *conn = calloc(1, sizeof(proxy_conn_t));
+        pthread_t thread;
+        int one = 1;
+        if (conn == NULL || broker_fd < 0 || connect(broker_fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+            free(conn);
+            close(client_fd);
+            if (broker_fd >= 0) {
+                close(broker_fd);
+            }
+            continue;
+        }
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(broker_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        conn->client_fd = client_fd;
+        conn->broker_fd = broker_fd;
+        if (pthread_create(&thread, NULL, proxy_connection, conn) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(client_fd);
+            close(broker_fd);
+            free(conn);
+        }
+    }
+    return NULL;
+}
+
+static int proxy_start(uint32_t delay_ms) {
+    s_proxy.delay_ms = delay_ms;
+    s_proxy.listen_fd = listen_loopback(&s_proxy.port);
+    if (s_proxy.listen_fd < 0) {
+        return -1;
+    }
+    pthread_t thread;
+    return pthread_create(&thread, NULL, proxy_accept, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * Client
+ */
+
+typedef struct {
+    platform_queue_t *events;
+} client_t;
+
+static void on_event(void *arg, const platform_mqtt_event_t *event) {
+    client_t *client = arg;
+    if (event->id == PLATFORM_MQTT_EVENT_CONNECTED || event->id == PLATFORM_MQTT_EVENT_ERROR) {
+        int id = event->id;
+        platform_queue_send(client->events, &id);
+    }
+}
+
+static int broker_publishes(void) {
+    pthread_mutex_lock(&s_broker.lock);
+    int publishes = s_broker.publishes;
+    pthread_mutex_unlock(&s_broker.lock);
+    return publishes;
+}
+
+/* Wait until the broker has received more than `count` publishes, returns the time of the last one, 0 for timeout */
+static int64_t wait_publishes(int count, int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int64_t published_ns = 0;
+    pthread_mutex_lock(&s_broker.lock);
+    while (s_broker.publishes <= count &&
+           pthread_cond_timedwait(&s_broker.published, &s_broker.lock, &deadline) == 0) {
+    }
+    if (s_broker.publishes > count) {
+        published_ns = s_broker.published_ns;
+    }
+    pthread_mutex_unlock(&s_broker.lock);
+    return published_ns;
+}
+
+/* One connection publishing one message. Returns 0 if the message reached the broker */
+static int connect_and_publish(bench_mode_t mode, platform_tls_session_t *session, int seq,
+                               int64_t *publish_ns, int64_t *connected_ns) {
+    static quarklink_context_t quarklink;
+    memset(&quarklink, 0, sizeof(quarklink));
+    strcpy(quarklink.deviceID, "early-data-bench");
+    strcpy(quarklink.iotHubEndpoint, BROKER_HOST);
+    quarklink.iotHubPort = s_proxy.port;
+    snprintf(quarklink.iotHubRootCert, sizeof(quarklink.iotHubRootCert), "%s", s_broker.cert_pem);
+
+    char payload[32];
+    snprintf(payload, sizeof(payload), "{\"seq\":%d}", seq);
+    platform_mqtt_message_t message = {
+        .topic = TOPIC,
+        .data = payload,
+        .qos = 0,
+    };
+    client_t client = { .events = platform_queue_create(4, sizeof(int)) };
+    platform_mqtt_config_t mqtt_cfg = {
+        .quarklink = &quarklink,
+        .address = htonl(INADDR_LOOPBACK),
+        .socket = -1,
+        .session = (mode <= MODE_RACED) ? NULL : session,
+        .event_cb = on_event,
+        .event_arg = &client,
+    };
+    if (mode >= MODE_PIPELINED) {
+        mqtt_cfg.connect_messages = &message;
+        mqtt_cfg.connect_message_count = 1;
+        mqtt_cfg.early_data = (mode != MODE_PIPELINED);
+    }
+
+    if (mode == MODE_RACED) {
+        // The race has connected: its TCP handshake is over by the time the client starts
+        struct sockaddr_in to = {
+            .sin_family = AF_INET,
+            .sin_port = htons(s_proxy.port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+        mqtt_cfg.socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (mqtt_cfg.socket >= 0 && connect(mqtt_cfg.socket, (struct sockaddr *)&to, sizeof(to)) != 0) {
+            close(mqtt_cfg.socket);
+            mqtt_cfg.socket = -1;
+        }
+        usleep(2 * s_proxy.delay_ms * 1000);
+    }
+
+    int before = broker_publishes();
+    int64_t start = bench_now_ns();
+    platform_mqtt_t *mqtt = platform_mqtt_start(&mqtt_cfg);
+    int event = PLATFORM_MQTT_EVENT_ERROR;
+    if (mqtt != NULL && platform_queue_receive(client.events, &event, 5000) == 0 &&
+        event == PLATFORM_MQTT_EVENT_CONNECTED) {
+        *connected_ns = bench_now_ns() - start;
+        if (mode < MODE_PIPELINED) {
+            platform_mqtt_publish(mqtt, TOPIC, payload, 0, 0, 0);
+        }
+    }
+    int64_t published_ns = wait_publishes(before, 5000);
+    *publish_ns = published_ns > 0 ? published_ns - start : 0;
+    platform_mqtt_stop(mqtt);
+    platform_queue_delete(client.events);
+    return (event == PLATFORM_MQTT_EVENT_CONNECTED && published_ns > 0) ? 0 : -1;
+}
+
+static void run(bench_mode_t mode, int connections, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    atomic_store(&s_broker.reject_early, mode == MODE_REJECTED);
+    // Get a session for the resumptions
+    static platform_tls_session_t session;
+    memset(&session, 0, sizeof(session));
+    int64_t publish_ns;
+    int64_t connected_ns;
+    connect_and_publish(MODE_RESUMED, &session, -1, &publish_ns, &connected_ns);
+
+    int64_t values[PLATFORM_LINUX_STAT_COUNT];
+    int64_t before[PLATFORM_LINUX_STAT_COUNT];
+    platform_linux_get_stats(before, NULL);
+    int handshakes = atomic_load(&s_broker.handshakes);
+    int resumed = atomic_load(&s_broker.resumed);
+    int early_connections = atomic_load(&s_broker.early_connections);
+    int early_publishes = atomic_load(&s_broker.early_publishes);
+    int publishes = broker_publishes();
+    for (int i = 0; i < connections; i++) {
+        if (connect_and_publish(mode, &session, i, &result->publish_ns[i], &result->connected_ns[i]) == 0) {
+            result->connections++;
+        }
+    }
+    // Let the broker count the connections that have just closed
+    usleep(50000);
+    platform_linux_get_stats(values, NULL);
+    result->delivered = broker_publishes() - publishes;
+    result->handshakes = atomic_load(&s_broker.handshakes) - handshakes;
+    result->resumed = atomic_load(&s_broker.resumed) - resumed;
+    result->early_sent = atomic_load(&s_broker.early_connections) - early_connections;
+    result->early_publishes = atomic_load(&s_broker.early_publishes) - early_publishes;
+    result->early_accepted = values[PLATFORM_LINUX_MQTT_EARLY_ACCEPTED] - before[PLATFORM_LINUX_MQTT_EARLY_ACCEPTED];
+    result->early_rejected = values[PLATFORM_LINUX_MQTT_EARLY_REJECTED] - before[PLATFORM_LINUX_MQTT_EARLY_REJECTED];
+}
+
+static int compare_ns(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double median_ms(int64_t *values, int count) {
+    if (count == 0) {
+        return 0.0;
+    }
+    qsort(values, count, sizeof(int64_t), compare_ns);
+    return values[count / 2] / 1e6;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n CONNECTIONS connections per mode (10)\n"
+            "  -d MS          one-way network latency (25)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int connections = 10;
+    uint32_t delay_ms = 25;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+        switch (opt) {
+        case 'n': connections = atoi(optarg); break;
+        case 'd': delay_ms = (uint32_t)atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (connections <= 0 || connections > MAX_CONNECTIONS || delay_ms < 5 || delay_ms > 1000) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (broker_start() != 0 || proxy_start(delay_ms) != 0) {
+        fprintf(stderr, "Failed to start the broker\n");
+        return 1;
+    }
+
+    result_t *results = calloc(MODE_COUNT, sizeof(result_t));
+    if (results == NULL) {
+        return 1;
+    }
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        run((bench_mode_t)mode, connections, &results[mode]);
+    }
+
+    double rtt_ms = 2.0 * delay_ms;
+    printf("Time to the first publish of %d connections per mode, round trip %.0f ms (TCP handshake included)\n",
+           connections, rtt_ms);
+    printf("  %-10s %14s %14s %14s %14s %10s\n", "mode", "publish (ms)", "round trips", "connected (ms)",
+           "resumed", "delivered");
+    double publish_rtts[MODE_COUNT];
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        result_t *result = &results[mode];
+        double publish = median_ms(result->publish_ns, result->connections);
+        double connected = median_ms(result->connected_ns, result->connections);
+        publish_rtts[mode] = publish / rtt_ms;
+        printf("  %-10s %14.1f %14.2f %14.1f %9d/%-4d %5d/%-4d\n", s_mode_names[mode], publish, publish_rtts[mode],
+               connected, result->resumed, result->handshakes, result->delivered, connections);
+        char what[96];
+        snprintf(what, sizeof(what), "every message delivered once (%s)", s_mode_names[mode]);
+        bench_check(result->connections == connections && result->delivered == connections, what);
+        snprintf(what, sizeof(what), "TLS session resumed (%s)", s_mode_names[mode]);
+        bench_check(mode <= MODE_RACED ? result->resumed == 0 : result->resumed == connections, what);
+    }
+    const result_t *early = &results[MODE_EARLY];
+    const result_t *rejected = &results[MODE_REJECTED];
+    printf("  early data: %d/%d accepted, %d publishes in early data; rejected mode: %d/%d rejected\n",
+           (int)early->early_accepted, connections, early->early_publishes, (int)rejected->early_rejected, connections);
+    bench_check(early->early_accepted == connections && early->early_sent == connections &&
+                early->early_publishes == connections, "early data accepted, the message in it");
+    bench_check(rejected->early_rejected == connections && rejected->early_accepted == 0 && rejected->early_publishes == 0,
+                "rejected early data sent again after the handshake");
+    bench_check(results[MODE_PIPELINED].early_sent == 0, "no early data unless enabled");
+    bench_check(publish_rtts[MODE_RACED] < publish_rtts[MODE_FULL] - 0.7, "handed over connection saves the TCP handshake");
+    // TCP handshake, TLS handshake, CONNACK, then half a round trip: 3.5, one less pipelined, one less with 0-RTT
+    bench_check(publish_rtts[MODE_RESUMED] > 3.2 && publish_rtts[MODE_PIPELINED] < publish_rtts[MODE_RESUMED] - 0.7,
+                "pipelined saves the CONNACK round trip");
+    bench_check(publish_rtts[MODE_EARLY] < publish_rtts[MODE_PIPELINED] - 0.7 && publish_rtts[MODE_EARLY] < 2.0,
+                "0-RTT saves the TLS handshake round trip");
+    bench_check(publish_rtts[MODE_REJECTED] < publish_rtts[MODE_RESUMED] - 0.7, "rejected early data costs no more than pipelined");
+    free(results);
+
+    return bench_result();
+}
@@ -0,0 +1,283 @@
+/**
+ * \file enrol_store_bench.c
+ * \brief Flash cost of persisting and loading the enrolment context, as one blob and with the per-field
+ *        enrolment store (enrol_store.c), on the NVS emulator (nvs_mock.c).
+ *
+ * The single blob is the layout of the QuarkLink client on Linux (quarklink_linux.c): the whole context,
+ * certificates at their maximum length, written at every enrolment. Each layout runs in its own partition:
+ *   - a first enrolment
+ *   - enrolments returning the same context, as after a "not enrolled" status
+ *   - enrolments renewing the device certificate, as after a "certificate expired" status
+ *   - boots, loading the context
+ * Besides the flash bytes, it checks that the loaded context is the persisted one, that an unchanged
+ * enrolment writes nothing, and that a persist interrupted by a power loss leaves the previous context.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "enrol_store.h"
+#include "nvs_mock.h"
+#include "platform_linux.h"
+
+#define LEGACY_NAMESPACE    "ql_legacy"
+#define LEGACY_KEY          "enrol"
+#define DEVICE_CERT_LENGTH  1180
+#define ROOT_CERT_LENGTH    1290
+
+typedef enum {
+    LAYOUT_LEGACY,
+    LAYOUT_STORE,
+    LAYOUT_COUNT
+} layout_t;
+
+/** The whole context in one blob, as quarklink_linux.c stores it */
+typedef struct {
+    uint32_t magic;
+    char deviceCert[QUARKLINK_MAX_LONG_CERT_LENGTH];
+    char iotHubRootCert[QUARKLINK_MAX_LONG_CERT_LENGTH];
+    char iotHubEndpoint[QUARKLINK_MAX_ENDPOINT_LENGTH];
+    uint16_t iotHubPort;
+    char scopeID[ENROL_STORE_MAX_SCOPE_ID_LENGTH];
+    char fwUpdateTopic[ENROL_STORE_MAX_TOPIC_LENGTH];
+} legacy_enrolment_t;
+
+typedef struct {
+    uint64_t first_written;
+    uint64_t same_written;
+    uint64_t same_read;
+    uint64_t renew_written;
+    uint32_t renew_erases;
+    uint64_t boot_read;
+    double boot_us;
+} result_t;
+
+static const char *s_partitions[LAYOUT_COUNT] = { "legacy", "store" };
+static char s_scope_id[ENROL_STORE_MAX_SCOPE_ID_LENGTH] = "";
+static char s_topic[ENROL_STORE_MAX_TOPIC_LENGTH] = "fwupdate/device";
+
+/* A PEM certificate of `length` characters, its body from `seed` */
+static void make_cert(char *pem, size_t length, unsigned seed) {
+    static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const char *begin = "-----BEGIN CERTIFICATE-----\n";
+    const char *end = "-----END CERTIFICATE-----\n";
+    size_t body = length - strlen(begin) - strlen(end);
+    strcpy(pem, begin);
+    char *p = pem + strlen(begin);
+    srand(seed);
+    for (size_t i = 0; i < body; i++) {
+        *p++ = (i % 65 == 64 || i == body - 1) ? '\n' : base64[rand() % 64];
+    }
+    strcpy(p, end);
+}
+
+static void make_context(quarklink_context_t *quarklink, unsigned device_cert_seed) {
+    memset(quarklink, 0, sizeof(quarklink_context_t));
+    make_cert(quarklink->deviceCert, DEVICE_CERT_LENGTH, device_cert_seed);
+    make_cert(quarklink->iotHubRootCert, ROOT_CERT_LENGTH, 1);
+    snprintf(quarklink->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint), "broker.example.quarklink.io");
+    quarklink->iotHubPort = 8883;
+    quarklink->scopeID = s_scope_id;
+    quarklink->fwUpdateTopic = s_topic;
+}
+
+static bool same_context(const quarklink_context_t *a, const quarklink_context_t *b) {
+    return strcmp(a->deviceCert, b->deviceCert) == 0 && strcmp(a->iotHubRootCert, b->iotHubRootCert) == 0 &&
+           strcmp(a->iotHubEndpoint, b->iotHubEndpoint) == 0 && a->iotHubPort == b->iotHubPort &&
+           strcmp(a->scopeID, b->scopeID) == 0 && strcmp(a->fwUpdateTopic, b->fwUpdateTopic) == 0;
+}
+
+/**
+ * Single blob layout
+ */
+
+static int legacy_persist(const quarklink_context_t *quarklink) {
+    legacy_enrolment_t *stored = calloc(1, sizeof(legacy_enrolment_t));
+    nvs_handle_t handle;
+    if (stored == NULL || nvs_open(LEGACY_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        free(stored);
+        return -1;
+    }
+    stored->magic = 0x514C4531;
+    memcpy(stored->deviceCert, quarklink->deviceCert, sizeof(stored->deviceCert));
+    memcpy(stored->iotHubRootCert, quarklink->iotHubRootCert, sizeof(stored->iotHubRootCert));
+    memcpy(stored->iotHubEndpoint, quarklink->iotHubEndpoint, sizeof(stored->iotHubEndpoint));
+    stored->iotHubPort = quarklink->iotHubPort;
+    snprintf(stored->scopeID, sizeof(stored->scopeID), "%s", quarklink->scopeID);
+    snprintf(stored->fwUpdateTopic, sizeof(stored->fwUpdateTopic), "%s", quarklink->fwUpdateTopic);
+    esp_err_t err = nvs_set_blob(handle, LEGACY_KEY, stored, sizeof(legacy_enrolment_t));
+    nvs_close(handle);
+    free(stored);
+    return err == ESP_OK ? 0 : -1;
+}
+
+static int legacy_load(quarklink_context_t *quarklink, legacy_enrolment_t *stored) {
+    nvs_handle_t handle;
+    if (nvs_open(LEGACY_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return -1;
+    }
+    size_t length = sizeof(legacy_enrolment_t);
+    esp_err_t err = nvs_get_blob(handle, LEGACY_KEY, stored, &length);
+    nvs_close(handle);
+    if (err != ESP_OK || length != sizeof(legacy_enrolment_t)) {
+        return -1;
+    }
+    memcpy(quarklink->deviceCert, stored->deviceCert, sizeof(quarklink->deviceCert));
+    memcpy(quarklink->iotHubRootCert, stored->iotHubRootCert, sizeof(quarklink->iotHubRootCert));
+    memcpy(quarklink->iotHubEndpoint, stored->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint));
+    quarklink->iotHubPort = stored->iotHubPort;
+    ql_context_set_string(quarklink, QL_CONTEXT_SCOPE_ID, stored->scopeID);
+    ql_context_set_string(quarklink, QL_CONTEXT_FW_UPDATE_TOPIC, stored->fwUpdateTopic);
+    return 0;
+}
+
+/**
+ * Runs
+ */
+
+static int persist(layout_t layout, enrol_store_t *store, const quarklink_context_t *quarklink) {
+    return layout == LAYOUT_LEGACY ? legacy_persist(quarklink) : enrol_store_persist(store, quarklink);
+}
+
+static void run(layout_t layout, int rounds, result_t *result) {
+    platform_linux_bind_device(s_partitions[layout]);
+    quarklink_context_t *expected = malloc(sizeof(quarklink_context_t));
+    quarklink_context_t *loaded = calloc(1, sizeof(quarklink_context_t));
+    legacy_enrolment_t *legacy = malloc(sizeof(legacy_enrolment_t));
+    enrol_store_t *store = calloc(1, sizeof(enrol_store_t));
+    if (expected == NULL || loaded == NULL || legacy == NULL || store == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    nvs_mock_stats_t before;
+    nvs_mock_stats_t after;
+
+    // First enrolment
+    make_context(expected, 100);
+    nvs_mock_get_stats(s_partitions[layout], &before);
+    bench_check(persist(layout, store, expected) == 0, "first enrolment stored");
+    nvs_mock_get_stats(s_partitions[layout], &after);
+    result->first_written = after.bytes_written - before.bytes_written;
+
+    // Same enrolment again
+    before = after;
+    for (int i = 0; i < rounds; i++) {
+        bench_check(persist(layout, store, expected) == 0, "same enrolment stored");
+    }
+    nvs_mock_get_stats(s_partitions[layout], &after);
+    result->same_written = (after.bytes_written - before.bytes_written) / rounds;
+    result->same_read = (after.bytes_read - before.bytes_read) / rounds;
+
+    // Renewed device certificate
+    before = after;
+    for (int i = 0; i < rounds; i++) {
+        make_context(expected, 200 + i);
+        bench_check(persist(layout, store, expected) == 0, "renewed enrolment stored");
+    }
+    nvs_mock_get_stats(s_partitions[layout], &after);
+    result->renew_written = (after.bytes_written - before.bytes_written) / rounds;
+    result->renew_erases = after.page_erases - before.page_erases;
+
+    // Boots
+    before = after;
+    int64_t total_ns = 0;
+    int mismatches = 0;
+    for (int i = 0; i < rounds; i++) {
+        ql_context_release(loaded);
+        memset(loaded, 0, sizeof(quarklink_context_t));
+        memset(store, 0, sizeof(enrol_store_t));
+        int64_t start_ns = bench_now_ns();
+        int ret = layout == LAYOUT_LEGACY ? legacy_load(loaded, legacy) : enrol_store_load(store, loaded);
+        total_ns += bench_now_ns() - start_ns;
+        if (ret != 0 || !same_context(loaded, expected)) {
+            mismatches++;
+        }
+    }
+    bench_check(mismatches == 0, "loaded context is the persisted one");
+    nvs_mock_get_stats(s_partitions[layout], &after);
+    result->boot_read = (after.bytes_read - before.bytes_read) / rounds;
+    result->boot_us = total_ns / 1000.0 / rounds;
+
+    if (layout == LAYOUT_STORE) {
+        // Power loss after the device certificate is written, before the index
+        quarklink_context_t *renewed = malloc(sizeof(quarklink_context_t));
+        if (renewed == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        make_context(renewed, 1000);
+        snprintf(renewed->iotHubEndpoint, sizeof(renewed->iotHubEndpoint), "other.example.quarklink.io");
+        nvs_mock_fail_after(1);
+        bench_check(enrol_store_persist(store, renewed) != 0, "interrupted persist fails");
+        nvs_mock_fail_after(-1);
+        memset(store, 0, sizeof(enrol_store_t));
+        bench_check(enrol_store_load(store, loaded) == 0 && same_context(loaded, expected),
+                    "interrupted persist keeps the previous enrolment");
+        bench_check(enrol_store_persist(store, renewed) == 0, "persist after the power loss");
+        memset(store, 0, sizeof(enrol_store_t));
+        bench_check(enrol_store_load(store, loaded) == 0 && same_context(loaded, renewed), "new enrolment after the power loss");
+        // The QuarkLink client frees or reallocates them
+        bench_check(loaded->scopeID != store->scope_id && loaded->fwUpdateTopic != store->fw_update_topic,
+                    "loaded strings are copies of their own");
+        free(renewed);
+    }
+    free(expected);
+    ql_context_release(loaded);
+    free(loaded);
+    free(legacy);
+    free(store);
+    platform_linux_bind_device(NULL);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of enrolments and boots per scenario (100)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    result_t results[LAYOUT_COUNT];
+    for (layout_t layout = 0; layout < LAYOUT_COUNT; layout++) {
+        run(layout, rounds, &results[layout]);
+    }
+    bench_check(results[LAYOUT_STORE].same_written == 0 && results[LAYOUT_STORE].same_read == 0,
+                "same enrolment neither written nor read");
+    bench_check(results[LAYOUT_STORE].renew_written < results[LAYOUT_LEGACY].renew_written,
+                "renewed certificate writes less than the whole context");
+    bench_check(results[LAYOUT_STORE].boot_read < results[LAYOUT_LEGACY].boot_read, "boot reads less than the whole context");
+
+    printf("Enrolment context with %d + %d bytes of certificates, %d rounds, NVS flash bytes per operation\n",
+           DEVICE_CERT_LENGTH, ROOT_CERT_LENGTH, rounds);
+    printf("  %-28s %12s %12s\n", "operation", "one blob", "per field");
+    printf("  %-28s %12llu %12llu\n", "first enrolment, written", (unsigned long long)results[0].first_written,
+           (unsigned long long)results[1].first_written);
+    printf("  %-28s %12llu %12llu\n", "same enrolment, written", (unsigned long long)results[0].same_written,
+           (unsigned long long)results[1].same_written);
+    printf("  %-28s %12llu %12llu\n", "same enrolment, read", (unsigned long long)results[0].same_read,
+           (unsigned long long)results[1].same_read);
+    printf("  %-28s %12llu %12llu\n", "renewed certificate, written", (unsigned long long)results[0].renew_written,
+           (unsigned long long)results[1].renew_written);
+    printf("  %-28s %12u %12u\n", "page erases over renewals", results[0].renew_erases, results[1].renew_erases);
+    printf("  %-28s %12llu %12llu\n", "boot, read", (unsigned long long)results[0].boot_read,
+           (unsigned long long)results[1].boot_read);
+    printf("  %-28s %10.2fus %10.2fus\n", "boot, load time", results[0].boot_us, results[1].boot_us);
+
+    return bench_result();
+}
@@ -0,0 +1,49 @@
+/**
+ * \file esp_heap_caps.h
+ * \brief Host replacement for the ESP-IDF capability allocator: every capability is the C heap.
+ */
+#ifndef _ESP_HEAP_CAPS_H_
+#define _ESP_HEAP_CAPS_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_8BIT         (1 << 2)
+#define MALLOC_CAP_INTERNAL     (1 << 11)
+
+static inline void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
+
+static inline void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return calloc(n, size);
+}
+
+static inline void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps) {
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+static inline void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+/* The C heap has no fixed size: no fragmentation figure */
+static inline size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 0;
+}
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _ESP_HEAP_CAPS_H_
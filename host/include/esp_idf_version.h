@@ -0,0 +1,15 @@
+/**
+ * \file esp_idf_version.h
+ * \brief Host replacement for the ESP-IDF version macros: the version the device build uses.
+ */
+#ifndef _ESP_IDF_VERSION_H_
+#define _ESP_IDF_VERSION_H_
+
+#define ESP_IDF_VERSION_MAJOR   5
+#define ESP_IDF_VERSION_MINOR   3
+#define ESP_IDF_VERSION_PATCH   1
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(ESP_IDF_VERSION_MAJOR, ESP_IDF_VERSION_MINOR, ESP_IDF_VERSION_PATCH)
+
+#endif // _ESP_IDF_VERSION_H_
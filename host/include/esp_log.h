@@ -0,0 +1,49 @@
+/**
+ * \file esp_log.h
+ * \brief Host replacement for the ESP-IDF logging macros used by the shared sources.
+ *
+ * The level is read once from the QL_LOG_LEVEL environment variable (0 none, 1 error, 2 warning,
+ * 3 info, 4 debug, 5 verbose) and defaults to warning, as thousands of devices log to the same terminal.
+ */
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/** \brief The current log level, see platform_linux.c */
+esp_log_level_t host_log_level(void);
+
+/** \brief Identifier of the simulated device running on the calling thread, "-" if none */
+const char *host_log_device(void);
+
+#define HOST_LOG(level, letter, tag, format, ...) do { \
+        if (host_log_level() >= (level)) { \
+            fprintf(stderr, letter " [%s] %s: " format "\n", host_log_device(), tag, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG(ESP_LOG_ERROR,   "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG(ESP_LOG_WARN,    "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG(ESP_LOG_INFO,    "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG(ESP_LOG_DEBUG,   "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _ESP_LOG_H_
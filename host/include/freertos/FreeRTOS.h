@@ -0,0 +1,25 @@
+/**
+ * \file FreeRTOS.h
+ * \brief Host replacement for the FreeRTOS critical sections: a portMUX is a mutex.
+ */
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define taskENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define taskEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _FREERTOS_H_
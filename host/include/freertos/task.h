@@ -0,0 +1,28 @@
+/**
+ * \file task.h
+ * \brief Host replacement for the FreeRTOS task handle: the pthread of the calling thread.
+ *
+ * As a TCB on the device, the handle of a thread that ended can be given to a new one.
+ */
+#ifndef _FREERTOS_TASK_H_
+#define _FREERTOS_TASK_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef void *TaskHandle_t;
+
+static inline TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return (TaskHandle_t)(uintptr_t)pthread_self();
+}
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _FREERTOS_TASK_H_
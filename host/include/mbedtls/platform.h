@@ -0,0 +1,13 @@
+/**
+ * \file platform.h
+ * \brief Host replacement for the mbedtls allocation functions.
+ */
+#ifndef _MBEDTLS_PLATFORM_H_
+#define _MBEDTLS_PLATFORM_H_
+
+#include <stdlib.h>
+
+#define mbedtls_calloc calloc
+#define mbedtls_free   free
+
+#endif // _MBEDTLS_PLATFORM_H_
@@ -0,0 +1,30 @@
+/**
+ * \file sha256.h
+ * \brief Host replacement for the mbedtls SHA-256 one-shot function, on top of OpenSSL.
+ */
+#ifndef _MBEDTLS_SHA256_H_
+#define _MBEDTLS_SHA256_H_
+
+#include <stddef.h>
+#include <openssl/sha.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+static inline int mbedtls_sha256(const unsigned char *input, size_t ilen, unsigned char output[32], int is224) {
+    if (is224) {
+        SHA224(input, ilen, output);
+    }
+    else {
+        SHA256(input, ilen, output);
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _MBEDTLS_SHA256_H_
@@ -0,0 +1,15 @@
+/**
+ * \file ssl.h
+ * \brief Host replacement for the mbedtls TLS error codes, for the sources built from the mbedtls patches.
+ */
+#ifndef _MBEDTLS_SSL_H_
+#define _MBEDTLS_SSL_H_
+
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA          -0x7100
+#define MBEDTLS_ERR_SSL_DECODE_ERROR            -0x7300
+#define MBEDTLS_ERR_SSL_BAD_CERTIFICATE         -0x7A00
+#define MBEDTLS_ERR_SSL_ALLOC_FAILED            -0x7F00
+#define MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER       -0x6600
+#define MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL        -0x6A00
+
+#endif // _MBEDTLS_SSL_H_
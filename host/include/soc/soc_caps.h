@@ -0,0 +1,12 @@
+/**
+ * \file soc_caps.h
+ * \brief Host replacement for the ESP-IDF SoC capabilities used by the components, those of the ESP32-S3.
+ */
+#ifndef _SOC_SOC_CAPS_H_
+#define _SOC_SOC_CAPS_H_
+
+#define SOC_RMT_TX_CANDIDATES_PER_GROUP 4
+#define SOC_RMT_SUPPORT_TX_SYNCHRO      1
+#define SOC_SPI_MAXIMUM_BUFFER_SIZE     64
+
+#endif // _SOC_SOC_CAPS_H_
@@ -0,0 +1,397 @@
+/**
+ * \file keepalive_bench.c
+ * \brief TLS handshakes and time per QuarkLink API call of the Linux QuarkLink client (quarklink_linux.c),
+ *        with one connection per call and with the keep-alive connection.
+ *
+ * The bench runs its own HTTPS server on 127.0.0.1, serving the stub REST paths, with a certificate generated
+ * with OpenSSL. Every round is a status check followed by an enrol and a firmware update, back to back. It
+ * reports the handshakes per API call counted by the client and the connections accepted by the server, and
+ * checks that:
+ *   - with keep-alive, the three calls of a round share one connection
+ *   - a connection closed by the server while idle is replaced transparently, without a failed call
+ *   - a connection idle for longer than the client timeout is replaced before sending
+ *   - enrolling through a context unpacked from the QuarkLink state (ql_state.h), as the application does,
+ *     lets the client free and reallocate the scope ID and the firmware update topic of the context
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+#include "quarklink.h"
+#include "platform.h"
+#include "platform_linux.h"
+#include "quarklink_linux.h"
+#include "ql_state.h"
+
+#define DEVICE_ID   "bench-device"
+
+typedef struct {
+    SSL_CTX *ctx;
+    int listen_fd;
+    uint16_t port;
+    /** Idle time after which the server closes a connection, in ms */
+    atomic_int idle_close_ms;
+    atomic_int connections;
+    atomic_int requests;
+    atomic_int firmware_count;
+} server_t;
+
+typedef struct {
+    int api_calls;
+    int failed_calls;
+    int64_t handshakes;
+    int connections;
+    double call_us;
+} result_t;
+
+static server_t s_server;
+
+/**
+ * HTTPS server
+ */
+
+/* Self-signed certificate for 127.0.0.1, its PEM written to `cert_path` */
+static int server_credentials(SSL_CTX *ctx, const char *cert_path) {
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (key_ctx == NULL || EVP_PKEY_keygen_init(key_ctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(key_ctx, &key) <= 0) {
+        return -1;
+    }
+    EVP_PKEY_CTX_free(key_ctx);
+
+    X509 *crt = X509_new();
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), 1);
+    X509_gmtime_adj(X509_getm_notBefore(crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 24 * 3600);
+    X509_set_pubkey(crt, key);
+    X509_NAME *name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"127.0.0.1", -1, -1, 0);
+    X509_set_issuer_name(crt, name);
+    X509V3_CTX ext_ctx;
+    X509V3_set_ctx(&ext_ctx, crt, crt, NULL, NULL, 0);
+    X509_EXTENSION *san = X509V3_EXT_conf_nid(NULL, &ext_ctx, NID_subject_alt_name, "IP:127.0.0.1");
+    X509_add_ext(crt, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(crt, key, EVP_sha256());
+
+    FILE *file = fopen(cert_path, "w");
+    int ret = -1;
+    if (file != NULL && PEM_write_X509(file, crt) == 1 && SSL_CTX_use_certificate(ctx, crt) == 1 &&
+        SSL_CTX_use_PrivateKey(ctx, key) == 1) {
+        ret = 0;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    X509_free(crt);
+    EVP_PKEY_free(key);
+    return ret;
+}
+
+static void server_reply(SSL *ssl, int status, const char *body, size_t length, bool close) {
+    char headers[256];
+    int headers_length = snprintf(headers, sizeof(headers),
+                                  "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n",
+                                  status, status == 200 ? "OK" : (status == 204 ? "No Content" : "Not Found"),
+                                  length, close ? "close" : "keep-alive");
+    SSL_write(ssl, headers, headers_length);
+    if (length > 0) {
+        SSL_write(ssl, body, (int)length);
+    }
+}
+
+static void server_route(SSL *ssl, const char *method, const char *path, bool close) {
+    static const char enrolment[] =
+        "{\"iotHubEndpoint\": \"127.0.0.1\", \"iotHubPort\": 1883, "
+        "\"deviceCert\": \"-----BEGIN CERTIFICATE-----\\nc3R1Yg==\\n-----END CERTIFICATE-----\\n\", "
+        "\"iotHubRootCert\": \"\", \"scopeID\": \"0ne00BENCH\", \"fwUpdateTopic\": \"devices/" DEVICE_ID "/fw\"}";
+    static const char status[] = "{\"status\": \"enrolled\"}";
+    static char image[16 * 1024];
+    atomic_fetch_add(&s_server.requests, 1);
+    if (strcmp(method, "GET") == 0 && strstr(path, "/status") != NULL) {
+        server_reply(ssl, 200, status, strlen(status), close);
+    }
+    else if (strcmp(method, "POST") == 0 && strstr(path, "/enrol") != NULL) {
+        server_reply(ssl, 200, enrolment, strlen(enrolment), close);
+    }
+    else if (strcmp(method, "GET") == 0 && strstr(path, "/firmware") != NULL) {
+        // An update every other request
+        bool update = atomic_fetch_add(&s_server.firmware_count, 1) % 2 == 1;
+        server_reply(ssl, update ? 200 : 204, image, update ? sizeof(image) : 0, close);
+    }
+    else {
+        server_reply(ssl, 404, NULL, 0, close);
+    }
+}
+
+static void *server_connection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    SSL *ssl = SSL_new(s_server.ctx);
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) == 1) {
+        atomic_fetch_add(&s_server.connections, 1);
+        char request[2048] = "";
+        size_t length = 0;
+        while (1) {
+            char *end = NULL;
+            while ((end = strstr(request, "\r\n\r\n")) == NULL || length == 0) {
+                struct pollfd pfd = { .fd = fd, .events = POLLIN };
+                if (SSL_pending(ssl) == 0 && poll(&pfd, 1, atomic_load(&s_server.idle_close_ms)) <= 0) {
+                    goto done;
+                }
+                int n = SSL_read(ssl, request + length, (int)(sizeof(request) - 1 - length));
+                if (n <= 0) {
+                    goto done;
+                }
+                length += n;
+                request[length] = '\0';
+            }
+            char method[8];
+            char path[256];
+            if (sscanf(request, "%7s %255s", method, path) != 2) {
+                goto done;
+            }
+            bool close = strcasestr(request, "\r\nConnection: close") != NULL;
+            server_route(ssl, method, path, close);
+            if (close) {
+                goto done;
+            }
+            // Requests have no body: keep what follows the headers
+            size_t used = end + 4 - request;
+            memmove(request, end + 4, length - used + 1);
+            length -= used;
+        }
+    }
+done:
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    ERR_clear_error();
+    return NULL;
+}
+
+static void *server_accept(void *arg) {
+    while (1) {
+        int fd = accept(s_server.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, server_connection, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int server_start(const char *cert_path) {
+    s_server.ctx = SSL_CTX_new(TLS_server_method());
+    if (s_server.ctx == NULL || server_credentials(s_server.ctx, cert_path) != 0) {
+        return -1;
+    }
+    s_server.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t address_length = sizeof(address);
+    if (bind(s_server.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(s_server.listen_fd, 64) != 0 ||
+        getsockname(s_server.listen_fd, (struct sockaddr *)&address, &address_length) != 0) {
+        return -1;
+    }
+    s_server.port = ntohs(address.sin_port);
+    atomic_store(&s_server.idle_close_ms, 60000);
+    pthread_t thread;
+    return pthread_create(&thread, NULL, server_accept, NULL) == 0 ? 0 : -1;
+}
+
+/**
+ * Client
+ */
+
+static bool api_call(quarklink_context_t *quarklink, int call) {
+    quarklink_return_t ret;
+    platform_connection_begin();
+    switch (call) {
+    case 0:
+        ret = quarklink_status(quarklink);
+        platform_connection_end();
+        return ret == QUARKLINK_STATUS_ENROLLED;
+    case 1:
+        ret = quarklink_enrol(quarklink);
+        platform_connection_end();
+        return ret == QUARKLINK_SUCCESS;
+    default:
+        ret = quarklink_firmwareUpdate(quarklink, NULL);
+        platform_connection_end();
+        return ret == QUARKLINK_FWUPDATE_NO_UPDATE || ret == QUARKLINK_FWUPDATE_UPDATED;
+    }
+}
+
+/* `rounds` rounds of status, enrol and firmware update, `pause_ms` apart */
+static void run(quarklink_context_t *quarklink, int rounds, int pause_ms, result_t *result) {
+    int64_t values[PLATFORM_LINUX_STAT_COUNT];
+    platform_linux_get_stats(values, NULL);
+    int64_t handshakes = values[PLATFORM_LINUX_QUARKLINK_HANDSHAKES];
+    int connections = atomic_load(&s_server.connections);
+    memset(result, 0, sizeof(result_t));
+
+    int64_t call_ns = 0;
+    for (int round = 0; round < rounds; round++) {
+        if (pause_ms > 0) {
+            usleep(pause_ms * 1000);
+        }
+        for (int call = 0; call < 3; call++) {
+            int64_t start_ns = bench_now_ns();
+            bool ok = api_call(quarklink, call);
+            call_ns += bench_now_ns() - start_ns;
+            result->api_calls++;
+            result->failed_calls += ok ? 0 : 1;
+        }
+    }
+    quarklink_linux_disconnect();
+    platform_linux_get_stats(values, NULL);
+    result->handshakes = values[PLATFORM_LINUX_QUARKLINK_HANDSHAKES] - handshakes;
+    result->connections = atomic_load(&s_server.connections) - connections;
+    result->call_us = call_ns / 1000.0 / result->api_calls;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of status, enrol and firmware update rounds (200)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 200;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    char dir[] = "/tmp/ql-keepalive-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char cert_path[64];
+    snprintf(cert_path, sizeof(cert_path), "%s/server.pem", dir);
+    if (server_start(cert_path) != 0) {
+        fprintf(stderr, "Cannot start the HTTPS server\n");
+        return 1;
+    }
+
+    platform_linux_bind_device(DEVICE_ID);
+    quarklink_context_t *quarklink = malloc(sizeof(quarklink_context_t));
+    if (quarklink == NULL || quarklink_linux_provision("127.0.0.1", s_server.port, cert_path, dir) != 0 ||
+        quarklink_init(quarklink, "placeholder.endpoint", "") != QUARKLINK_SUCCESS ||
+        quarklink_loadStoredContext(quarklink) != QUARKLINK_CONTEXT_NO_ENROLMENT_INFO_STORED) {
+        fprintf(stderr, "Cannot set up the QuarkLink client\n");
+        return 1;
+    }
+
+    result_t per_call;
+    quarklink_linux_set_keepalive(0);
+    run(quarklink, rounds, 0, &per_call);
+    bench_check(per_call.failed_calls == 0, "calls with a connection per call");
+    bench_check(per_call.handshakes == per_call.api_calls && per_call.connections == per_call.api_calls,
+                "one handshake per call without keep-alive");
+
+    result_t keepalive;
+    quarklink_linux_set_keepalive(QUARKLINK_LINUX_KEEPALIVE_IDLE_MS);
+    run(quarklink, rounds, 0, &keepalive);
+    bench_check(keepalive.failed_calls == 0, "calls on the keep-alive connection");
+    bench_check(keepalive.handshakes == 1 && keepalive.connections == 1, "one handshake for all the calls with keep-alive");
+
+    // The server closes idle connections before the next round: the client reconnects transparently
+    int reconnect_rounds = rounds < 20 ? rounds : 20;
+    result_t server_close;
+    atomic_store(&s_server.idle_close_ms, 20);
+    run(quarklink, reconnect_rounds, 50, &server_close);
+    bench_check(server_close.failed_calls == 0, "no failed call when the server closes idle connections");
+    bench_check(server_close.handshakes == reconnect_rounds, "one handshake per round when the server closes idle connections");
+
+    // The client idle timeout expires before the next round: a new connection without a failed attempt
+    result_t client_idle;
+    atomic_store(&s_server.idle_close_ms, 60000);
+    quarklink_linux_set_keepalive(20);
+    run(quarklink, reconnect_rounds, 50, &client_idle);
+    bench_check(client_idle.failed_calls == 0 && client_idle.handshakes == reconnect_rounds &&
+                client_idle.connections == reconnect_rounds, "new connection after the client idle timeout");
+
+    // Enrolments through the packed state: each one unpacks the snapshot, the client replaces its strings
+    ql_state_t state = { 0 };
+    ql_context_t context = { 0 };
+    int enrolments = 0;
+    bench_check(ql_state_init(&state) == 0 && ql_context_pack(&context, quarklink) == 0 &&
+                ql_state_publish(&state, &context, QUARKLINK_STATUS_ENROLLED) == 0, "enrolled context published");
+    for (int i = 0; i < reconnect_rounds; i++) {
+        quarklink_context_t *unpacked = ql_state_begin(&state);
+        if (unpacked == NULL) {
+            break;
+        }
+        platform_connection_begin();
+        quarklink_return_t ret = quarklink_enrol(unpacked);
+        platform_connection_end();
+        if (ret != QUARKLINK_SUCCESS) {
+            ql_state_cancel(&state, unpacked);
+        }
+        else if (ql_state_end(&state, unpacked, QUARKLINK_STATUS_ENROLLED) == 0) {
+            enrolments++;
+        }
+    }
+    bench_check(enrolments == reconnect_rounds, "enrolments through the unpacked context");
+    const ql_snapshot_t *snapshot = ql_state_acquire(&state);
+    bench_check(snapshot != NULL && strcmp(ql_context_string(&snapshot->context, QL_CONTEXT_SCOPE_ID), "0ne00BENCH") == 0 &&
+                strcmp(ql_context_string(&snapshot->context, QL_CONTEXT_FW_UPDATE_TOPIC), "devices/" DEVICE_ID "/fw") == 0,
+                "enrolled scope ID and firmware update topic published");
+    ql_state_release(&state, snapshot);
+    ql_state_free(&state);
+    quarklink_linux_disconnect();
+
+    printf("QuarkLink API calls against a local HTTPS server: %d rounds of status, enrol and firmware update\n", rounds);
+    printf("  %-28s %12s %12s\n", "", "per call", "keep-alive");
+    printf("  %-28s %12d %12d\n", "API calls", per_call.api_calls, keepalive.api_calls);
+    printf("  %-28s %12.2f %12.3f\n", "handshakes per call", (double)per_call.handshakes / per_call.api_calls,
+           (double)keepalive.handshakes / keepalive.api_calls);
+    printf("  %-28s %12d %12d\n", "server connections", per_call.connections, keepalive.connections);
+    printf("  %-28s %10.0fus %10.0fus\n", "time per call", per_call.call_us, keepalive.call_us);
+    printf("  %-28s %12s %12.2f\n", "handshakes/round, idle close", "-", (double)server_close.handshakes / reconnect_rounds);
+
+    ql_context_release(quarklink);
+    free(quarklink);
+    return bench_result();
+}
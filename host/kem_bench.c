@@ -0,0 +1,223 @@
+/**
+ * \file kem_bench.c
+ * \brief Latency of the client side of the X25519MLKEM768 key exchange.
+ *
+ * Every round replays the two steps of the patched mbedtls handshake, in its order:
+ *   - ClientHello: ML-KEM-768 keypair, X25519 keygen and public key export
+ *   - ServerHello: ML-KEM-768 decapsulation, transcript hash of the ServerHello and X25519 agreement
+ * The ML-KEM code is the PQClean implementation of patches/mlkem_mbedtls.patch, X25519 and SHA-256
+ * come from OpenSSL. The absolute numbers are the host ones: on the device X25519 is software mbedtls.
+ *
+ * Every random byte, keys included, comes from SHAKE256 of the seed given with -s, so that two runs with the
+ * same seed do the same computations; the ML-KEM keypair and encapsulation use the derandomized entry points,
+ * like the patched mbedtls.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <openssl/evp.h>
+
+#include "kem.h"
+#include "fips202.h"
+#include "randombytes.h"
+#include "platform.h"
+
+#define X25519_KEY_SIZE_BYTES 32
+/** ServerHello without the key share: random, session ID, cipher suite and the other extensions */
+#define SERVER_HELLO_BASE_SIZE 90
+
+typedef struct {
+    uint8_t seed[2 * KYBER_SYMBYTES];
+    uint8_t ek[KYBER_PUBLICKEYBYTES];
+    uint8_t dk[KYBER_SECRETKEYBYTES];
+    uint8_t ct[KYBER_CIPHERTEXTBYTES];
+    uint8_t ss[KYBER_SSBYTES];
+} kem_state_t;
+
+typedef enum {
+    STEP_CLIENT_HELLO,
+    STEP_SERVER_HELLO,
+    STEP_TOTAL,
+    STEP_COUNT
+} step_t;
+
+static const char *s_step_names[STEP_COUNT] = { "ClientHello", "ServerHello", "total" };
+
+/* ML-KEM output of the server, checked against the decapsulation */
+static uint8_t s_server_ss[KYBER_SSBYTES];
+
+static uint64_t s_rng_seed = 1;
+static uint64_t s_rng_counter = 0;
+
+/* Deterministic generator: SHAKE256 of the seed and of a counter per request */
+static void bench_random(uint8_t *output, size_t n) {
+    uint8_t input[2 * sizeof(uint64_t)];
+    memcpy(input, &s_rng_seed, sizeof(uint64_t));
+    memcpy(input + sizeof(uint64_t), &s_rng_counter, sizeof(uint64_t));
+    s_rng_counter++;
+    shake256(output, n, input, sizeof(input));
+}
+
+/* Only the randomized PQClean entry points call it, the bench does not */
+int randombytes(uint8_t *output, size_t n) {
+    bench_random(output, n);
+    return 0;
+}
+
+static EVP_PKEY *x25519_keygen(void) {
+    uint8_t private_key[X25519_KEY_SIZE_BYTES];
+    bench_random(private_key, sizeof(private_key));
+    return EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, private_key, sizeof(private_key));
+}
+
+static int x25519_agree(EVP_PKEY *own, EVP_PKEY *peer, uint8_t *secret) {
+    size_t length = X25519_KEY_SIZE_BYTES;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new(own, NULL);
+    int ret = (ctx != NULL && EVP_PKEY_derive_init(ctx) > 0 && EVP_PKEY_derive_set_peer(ctx, peer) > 0 &&
+               EVP_PKEY_derive(ctx, secret, &length) > 0) ? 0 : -1;
+    EVP_PKEY_CTX_free(ctx);
+    return ret;
+}
+
+/**
+ * \brief Run one key exchange.
+ * \param[out] latencies the latency of every step, in us
+ * \return 0 for success, -1 if a step failed or the shared secrets differ
+ */
+static int run_round(kem_state_t *kem, int64_t *latencies) {
+    uint8_t pub[X25519_KEY_SIZE_BYTES];
+    uint8_t x25519_ss[X25519_KEY_SIZE_BYTES];
+    uint8_t server_hello[SERVER_HELLO_BASE_SIZE + KYBER_CIPHERTEXTBYTES + X25519_KEY_SIZE_BYTES];
+    uint8_t transcript[32];
+    size_t pub_len = sizeof(pub);
+    EVP_PKEY *client = NULL;
+    EVP_PKEY *server = NULL;
+    EVP_PKEY *server_pub = NULL;
+    int ret = -1;
+
+    uint8_t coins[KYBER_SYMBYTES];
+    bench_random(kem->seed, sizeof(kem->seed));
+
+    // ClientHello
+    int64_t start_us = platform_now_us();
+    bool generated = PQCLEAN_MLKEM768_CLEAN_crypto_kem_keypair_derand(kem->ek, kem->dk, kem->seed) == 0;
+    client = x25519_keygen();
+    bool exported = generated && client != NULL && EVP_PKEY_get_raw_public_key(client, pub, &pub_len) == 1;
+    latencies[STEP_CLIENT_HELLO] = platform_now_us() - start_us;
+    if (!exported) {
+        goto exit;
+    }
+
+    // Server side, not measured
+    server = x25519_keygen();
+    bench_random(coins, sizeof(coins));
+    if (server == NULL || PQCLEAN_MLKEM768_CLEAN_crypto_kem_enc_derand(kem->ct, s_server_ss, kem->ek, coins) != 0) {
+        goto exit;
+    }
+    pub_len = sizeof(pub);
+    EVP_PKEY_get_raw_public_key(server, pub, &pub_len);
+    server_pub = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, NULL, pub, pub_len);
+    bench_random(server_hello, SERVER_HELLO_BASE_SIZE);
+    memcpy(server_hello + SERVER_HELLO_BASE_SIZE, kem->ct, KYBER_CIPHERTEXTBYTES);
+    memcpy(server_hello + SERVER_HELLO_BASE_SIZE + KYBER_CIPHERTEXTBYTES, pub, X25519_KEY_SIZE_BYTES);
+
+    // ServerHello
+    start_us = platform_now_us();
+    bool decapsulated = PQCLEAN_MLKEM768_CLEAN_crypto_kem_dec(kem->ss, kem->ct, kem->dk) == 0;
+    bool hashed = EVP_Digest(server_hello, sizeof(server_hello), transcript, NULL, EVP_sha256(), NULL) == 1;
+    bool agreed = server_pub != NULL && x25519_agree(client, server_pub, x25519_ss) == 0;
+    latencies[STEP_SERVER_HELLO] = platform_now_us() - start_us;
+    latencies[STEP_TOTAL] = latencies[STEP_CLIENT_HELLO] + latencies[STEP_SERVER_HELLO];
+
+    if (decapsulated && hashed && agreed && memcmp(kem->ss, s_server_ss, KYBER_SSBYTES) == 0) {
+        ret = 0;
+    }
+
+exit:
+    EVP_PKEY_free(client);
+    EVP_PKEY_free(server);
+    EVP_PKEY_free(server_pub);
+    return ret;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t median(int64_t *values, int count) {
+    qsort(values, count, sizeof(int64_t), compare_latency);
+    return values[count / 2];
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of key exchanges (500)\n"
+            "  -w ROUNDS      warm-up key exchanges, not measured (20)\n"
+            "  -s SEED        seed of the deterministic random generator (1)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 500;
+    int warmup = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:s:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 's': s_rng_seed = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0 || warmup < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    kem_state_t *kem = calloc(1, sizeof(kem_state_t));
+    bool allocated = kem != NULL;
+    int64_t *samples[STEP_COUNT];
+    for (int step = 0; step < STEP_COUNT; step++) {
+        samples[step] = calloc(rounds, sizeof(int64_t));
+        allocated = allocated && samples[step] != NULL;
+    }
+    if (!allocated) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    int64_t latencies[STEP_COUNT];
+    uint8_t first_ss[KYBER_SSBYTES] = { 0 };
+    for (int i = 0; i < warmup + rounds; i++) {
+        if (run_round(kem, latencies) != 0) {
+            fprintf(stderr, "Key exchange %d failed\n", i);
+            return 1;
+        }
+        if (i == 0) {
+            memcpy(first_ss, kem->ss, sizeof(first_ss));
+        }
+        if (i >= warmup) {
+            for (int step = 0; step < STEP_COUNT; step++) {
+                samples[step][i - warmup] = latencies[step];
+            }
+        }
+    }
+
+    printf("X25519MLKEM768 client key exchange, %d rounds, median latency\n", rounds);
+    for (int step = 0; step < STEP_COUNT; step++) {
+        printf("  %-12s %8lldus\n", s_step_names[step], (long long)median(samples[step], rounds));
+    }
+    printf("  seed %llu, first ML-KEM secret %02x%02x%02x%02x%02x%02x%02x%02x (the same for every run with this seed)\n",
+           (unsigned long long)s_rng_seed, first_ss[0], first_ss[1], first_ss[2], first_ss[3], first_ss[4],
+           first_ss[5], first_ss[6], first_ss[7]);
+
+    for (int step = 0; step < STEP_COUNT; step++) {
+        free(samples[step]);
+    }
+    free(kem);
+    return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * \file led_anim_bench.c
+ * \brief Status LED animation task (led_anim.c) driving a LED strip on the RMT mock (rmt_mock.c).
+ *
+ * Measures what a publish costs the telemetry loop, with the former sequence (blocking clear, 100 ms
+ * delay, blocking refresh) and with a flash posted to the animation task, and checks the animation:
+ *   - the flash lasts its duration, to a frame period, then the previous colour comes back
+ *   - the animation frames are presented at the frame rate and show the rendered colours
+ *   - no frame is rendered while the LED does not change
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "led_strip.h"
+#include "rmt_mock.h"
+#include "led_anim.h"
+#include "app.h"
+#include "platform.h"
+#include "platform_linux.h"
+
+#define ANIM_GPIO 8
+#define LEGACY_GPIO 9
+#define MAX_WRITES 4096
+/** Allowed delay of a frame on a loaded host, in us */
+#define FRAME_TOLERANCE_US 5000
+
+typedef struct {
+    int64_t time_us;
+    led_anim_rgb_t rgb;
+} led_write_t;
+
+static led_strip_handle_t s_strip;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static led_write_t s_writes[MAX_WRITES];
+static int s_write_count = 0;
+
+/* Same as platform_led_write on the device */
+static void led_output(uint8_t red, uint8_t green, uint8_t blue) {
+    int64_t now = platform_now_us();
+    led_strip_set_pixel(s_strip, 0, red, green, blue);
+    if (led_strip_refresh_async(s_strip, NULL, NULL) == ESP_ERR_INVALID_STATE) {
+        led_strip_refresh(s_strip);
+    }
+    pthread_mutex_lock(&s_lock);
+    if (s_write_count < MAX_WRITES) {
+        s_writes[s_write_count].time_us = now;
+        s_writes[s_write_count].rgb = (led_anim_rgb_t){ red, green, blue };
+        s_write_count++;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+/* Copy the writes recorded since `first` */
+static int get_writes(int first, led_write_t *writes) {
+    pthread_mutex_lock(&s_lock);
+    int count = s_write_count - first;
+    memcpy(writes, s_writes + first, count * sizeof(led_write_t));
+    pthread_mutex_unlock(&s_lock);
+    return count;
+}
+
+static int write_count(void) {
+    pthread_mutex_lock(&s_lock);
+    int count = s_write_count;
+    pthread_mutex_unlock(&s_lock);
+    return count;
+}
+
+static bool rgb_equal(led_anim_rgb_t a, led_anim_rgb_t b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t median(int64_t *values, int count) {
+    qsort(values, count, sizeof(int64_t), compare_latency);
+    return values[count / 2];
+}
+
+static led_strip_handle_t new_strip(int gpio) {
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = gpio,
+        .max_leds = 1,
+        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+        .led_model = LED_MODEL_WS2812,
+    };
+    led_strip_rmt_config_t rmt_config = {
+        .resolution_hz = 10 * 1000 * 1000,
+    };
+    led_strip_handle_t strip = NULL;
+    led_strip_new_rmt_device(&strip_config, &rmt_config, &strip);
+    return strip;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n PUBLISHES   number of publishes per mode (10)\n"
+            "  -d SECONDS     duration of the pulse animation (2)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int publishes = 10;
+    int seconds = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:h")) != -1) {
+        switch (opt) {
+        case 'n': publishes = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (publishes <= 0 || seconds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    s_strip = new_strip(ANIM_GPIO);
+    led_strip_handle_t legacy = new_strip(LEGACY_GPIO);
+    int64_t *samples[2] = { calloc(publishes, sizeof(int64_t)), calloc(publishes, sizeof(int64_t)) };
+    led_write_t *writes = calloc(MAX_WRITES, sizeof(led_write_t));
+    if (s_strip == NULL || legacy == NULL || samples[0] == NULL || samples[1] == NULL || writes == NULL) {
+        fprintf(stderr, "Failed to create the LED strips\n");
+        return 1;
+    }
+    platform_linux_set_led_output(led_output);
+    if (led_anim_start(NULL) != 0) {
+        return 1;
+    }
+    const led_anim_rgb_t colour = led_anim_colour(GREEN);
+    led_anim_t solid = { .pattern = LED_ANIM_SOLID, .colour = colour };
+    bench_check(led_anim_play(&solid) == 0, "play");
+    platform_delay_ms(100);
+
+    // Publisher cost: the former sequence, then a flash posted to the animation task
+    for (int i = 0; i < publishes; i++) {
+        int64_t start_us = platform_now_us();
+        led_strip_clear(legacy);
+        platform_delay_ms(100);
+        led_strip_set_pixel(legacy, 0, colour.red, colour.green, colour.blue);
+        led_strip_refresh(legacy);
+        samples[0][i] = platform_now_us() - start_us;
+
+        int first = write_count();
+        start_us = platform_now_us();
+        bench_check(led_anim_flash(LED_ANIM_RGB_OFF, 100) == 0, "flash");
+        samples[1][i] = platform_now_us() - start_us;
+        platform_delay_ms(200);
+
+        // off, then the colour back after 100 ms
+        int count = get_writes(first, writes);
+        bench_check(count == 2, "two writes per flash");
+        if (count == 2) {
+            int64_t length = writes[1].time_us - writes[0].time_us;
+            bench_check(rgb_equal(writes[0].rgb, LED_ANIM_RGB_OFF) && rgb_equal(writes[1].rgb, colour), "flash colours");
+            bench_check(length >= 100000 && length <= 100000 + LED_ANIM_FRAME_PERIOD_MS * 1000 + FRAME_TOLERANCE_US,
+                        "flash duration");
+        }
+    }
+
+    // Nothing is rendered while the LED does not change
+    led_anim_stats_t before;
+    led_anim_stats_t after;
+    led_anim_get_stats(&before);
+    platform_delay_ms(200);
+    led_anim_get_stats(&after);
+    bench_check(after.frames == before.frames, "no frame while idle");
+
+    // Frame rate and content of an animation that changes every frame
+    led_anim_t pulse = { .pattern = LED_ANIM_PULSE, .colour = { 255, 0, 0 }, .period_ms = 1000 };
+    int first = write_count();
+    led_anim_get_stats(&before);
+    bench_check(led_anim_play(&pulse) == 0, "play");
+    platform_delay_ms(seconds * 1000);
+    led_anim_get_stats(&after);
+    int count = get_writes(first, writes);
+    int64_t *intervals = calloc(count > 1 ? count : 1, sizeof(int64_t));
+    int mismatches = 0;
+    int64_t origin = count > 0 ? writes[0].time_us : 0;
+    for (int i = 0; i < count; i++) {
+        // the frame due at a multiple of the frame period
+        int64_t frame = (writes[i].time_us - origin + LED_ANIM_FRAME_PERIOD_MS * 500) / (LED_ANIM_FRAME_PERIOD_MS * 1000);
+        if (!rgb_equal(writes[i].rgb, led_anim_render(&pulse, (uint32_t)(frame * LED_ANIM_FRAME_PERIOD_MS)))) {
+            mismatches++;
+        }
+        if (i > 0) {
+            intervals[i - 1] = writes[i].time_us - writes[i - 1].time_us;
+        }
+    }
+    int expected = seconds * 1000 / LED_ANIM_FRAME_PERIOD_MS;
+    int64_t interval = count > 1 ? median(intervals, count - 1) : 0;
+    bench_check(count >= expected * 9 / 10, "frame count");
+    bench_check(interval >= LED_ANIM_FRAME_PERIOD_MS * 1000 - 1000 && interval <= LED_ANIM_FRAME_PERIOD_MS * 1000 + 1000,
+                "frame period");
+    bench_check(mismatches == 0, "frame colours");
+
+    bench_check(led_anim_play(&solid) == 0, "play");
+    platform_delay_ms(100);
+    led_anim_stats_t stats;
+    led_anim_get_stats(&stats);
+    rmt_mock_stats_t rmt_stats;
+    rmt_mock_get_stats(rmt_mock_find_channel(ANIM_GPIO), &rmt_stats);
+    bench_check(rmt_stats.transactions == stats.writes, "one RMT frame per write");
+
+    printf("Status LED, %d publishes, median publisher cost\n", publishes);
+    printf("  %-24s %8lldus\n", "clear, delay, refresh", (long long)median(samples[0], publishes));
+    printf("  %-24s %8lldus\n", "flash posted", (long long)median(samples[1], publishes));
+    printf("Pulse animation, %d s at %d ms per frame\n", seconds, LED_ANIM_FRAME_PERIOD_MS);
+    printf("  %d writes, median interval %lldus, %d colour mismatches, %lu frames presented\n",
+           count, (long long)interval, mismatches, (unsigned long)(after.frames - before.frames));
+    printf("  total: %lu frames, %lu writes, %lu late, max lateness %luus, %lu commands, %lu dropped\n",
+           (unsigned long)stats.frames, (unsigned long)stats.writes, (unsigned long)stats.late_frames,
+           (unsigned long)stats.max_lateness_us, (unsigned long)stats.commands, (unsigned long)stats.dropped);
+
+    free(intervals);
+    free(writes);
+    free(samples[0]);
+    free(samples[1]);
+    return bench_result();
+}
@@ -0,0 +1,177 @@
+/**
+ * \file led_bench.c
+ * \brief Caller latency of the LED strip refresh, blocking and asynchronous, on the RMT mock (rmt_mock.c).
+ *
+ * Besides the latencies, it checks what the application relies on:
+ *   - the frame on the wire is the one the pixels held when the refresh was called
+ *   - a refresh of unchanged pixels is skipped, and its callback still runs
+ *   - the asynchronous refresh queues up to the RMT trans_queue_depth frames, then refuses
+ *   - the channel is enabled once for the lifetime of the strip
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "led_strip.h"
+#include "rmt_mock.h"
+#include "platform.h"
+
+#define LED_GPIO 8
+/** trans_queue_depth of led_strip_rmt_dev.c */
+#define LED_QUEUE_DEPTH 4
+#define LED_RESOLUTION_HZ (10 * 1000 * 1000)
+
+static atomic_uint s_done = 0;
+
+static bool refresh_done(led_strip_handle_t strip, void *user_ctx) {
+    atomic_fetch_add(&s_done, 1);
+    return false;
+}
+
+/**
+ * \brief Decode the GRB bytes of the last frame sent on the channel.
+ * \return the number of bytes decoded, without the reset code
+ */
+static size_t last_frame(rmt_channel_handle_t chan, uint8_t *bytes, size_t max_bytes) {
+    size_t count = rmt_mock_get_last_symbols(chan, NULL, 0);
+    rmt_symbol_word_t *symbols = calloc(count ? count : 1, sizeof(rmt_symbol_word_t));
+    if (symbols == NULL) {
+        return 0;
+    }
+    rmt_mock_get_last_symbols(chan, symbols, count);
+    size_t length = 0;
+    memset(bytes, 0, max_bytes);
+    // WS2812: a 1 is high for 0.9us, a 0 for 0.3us, the reset code is low
+    for (size_t i = 0; i < count && length < max_bytes * 8 && symbols[i].level0 == 1; i++, length++) {
+        bool one = symbols[i].duration0 > LED_RESOLUTION_HZ / 1000000 * 6 / 10;
+        bytes[length / 8] |= (uint8_t)(one << (7 - length % 8));
+    }
+    free(symbols);
+    return length / 8;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t median(int64_t *values, int count) {
+    qsort(values, count, sizeof(int64_t), compare_latency);
+    return values[count / 2];
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of refreshes per mode (200)\n"
+            "  -l LEDS        length of the strip (1)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 200;
+    int leds = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0 || leds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = LED_GPIO,
+        .max_leds = leds,
+        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+        .led_model = LED_MODEL_WS2812,
+    };
+    led_strip_rmt_config_t rmt_config = {
+        .resolution_hz = LED_RESOLUTION_HZ,
+    };
+    led_strip_handle_t strip;
+    if (led_strip_new_rmt_device(&strip_config, &rmt_config, &strip) != ESP_OK) {
+        fprintf(stderr, "Failed to create the LED strip\n");
+        return 1;
+    }
+    rmt_channel_handle_t chan = rmt_mock_find_channel(LED_GPIO);
+    int64_t *samples[2] = { calloc(rounds, sizeof(int64_t)), calloc(rounds, sizeof(int64_t)) };
+    uint8_t *frame = calloc(leds, 3);
+    if (chan == NULL || samples[0] == NULL || samples[1] == NULL || frame == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Caller latency, a different colour every round so that no frame is skipped
+    for (int i = 0; i < rounds; i++) {
+        led_strip_set_pixel(strip, 0, i & 0xFF, 0x10, 0x20);
+        int64_t start_us = platform_now_us();
+        bench_check(led_strip_refresh(strip) == ESP_OK, "blocking refresh");
+        samples[0][i] = platform_now_us() - start_us;
+
+        led_strip_set_pixel(strip, 0, 0x30, i & 0xFF, 0x40);
+        start_us = platform_now_us();
+        bench_check(led_strip_refresh_async(strip, refresh_done, NULL) == ESP_OK, "asynchronous refresh");
+        samples[1][i] = platform_now_us() - start_us;
+        bench_check(led_strip_wait_refresh_done(strip, 1000) == ESP_OK, "wait for the asynchronous refresh");
+    }
+    bench_check(atomic_load(&s_done) == (unsigned int)rounds, "one callback per asynchronous refresh");
+
+    // The frame is copied: updating the pixels while it is queued does not change it
+    led_strip_set_pixel(strip, 0, 0x12, 0x34, 0x56);
+    bench_check(led_strip_refresh_async(strip, NULL, NULL) == ESP_OK, "asynchronous refresh");
+    led_strip_set_pixel(strip, 0, 0xAA, 0xBB, 0xCC);
+    led_strip_wait_refresh_done(strip, 1000);
+    bench_check(last_frame(chan, frame, leds * 3) == (size_t)leds * 3, "frame length");
+    bench_check(frame[0] == 0x34 && frame[1] == 0x12 && frame[2] == 0x56, "frame content (GRB)");
+
+    // Unchanged pixels are skipped
+    rmt_mock_stats_t before;
+    rmt_mock_stats_t after;
+    bench_check(led_strip_refresh_async(strip, NULL, NULL) == ESP_OK, "asynchronous refresh");
+    led_strip_wait_refresh_done(strip, 1000);
+    rmt_mock_get_stats(chan, &before);
+    unsigned int done = atomic_load(&s_done);
+    bench_check(led_strip_refresh_async(strip, refresh_done, NULL) == ESP_OK, "skipped refresh");
+    led_strip_wait_refresh_done(strip, 1000);
+    rmt_mock_get_stats(chan, &after);
+    bench_check(after.transactions == before.transactions, "unchanged pixels are not sent");
+    bench_check(atomic_load(&s_done) == done + 1, "callback of a skipped refresh");
+
+    // Back to back refreshes fill the queue, then are refused until a frame is done
+    int queued = 0;
+    esp_err_t ret = ESP_OK;
+    for (int i = 0; i <= LED_QUEUE_DEPTH && ret == ESP_OK; i++) {
+        led_strip_set_pixel(strip, 0, i, i, i);
+        ret = led_strip_refresh_async(strip, NULL, NULL);
+        queued += (ret == ESP_OK);
+    }
+    bench_check(queued == LED_QUEUE_DEPTH && ret == ESP_ERR_INVALID_STATE, "queue depth");
+    bench_check(led_strip_wait_refresh_done(strip, 1000) == ESP_OK, "wait for the queued refreshes");
+    bench_check(led_strip_refresh_async(strip, NULL, NULL) == ESP_OK, "refresh once the queue is empty");
+    bench_check(led_strip_clear(strip) == ESP_OK, "clear");
+
+    rmt_mock_get_stats(chan, &after);
+    bench_check(after.enables == 1, "channel enabled once");
+    int64_t blocking = median(samples[0], rounds);
+    int64_t async = median(samples[1], rounds);
+    printf("LED strip refresh, %d LEDs, %d rounds, median caller latency\n", leds, rounds);
+    printf("  %-12s %8lldus\n", "blocking", (long long)blocking);
+    printf("  %-12s %8lldus\n", "async", (long long)async);
+    printf("  channel enabled %u times, %u frames, %u refused, %u refills, %llu us on the wire\n",
+           after.enables, after.transactions, after.rejected, after.refills, (unsigned long long)after.wire_us);
+
+    bench_check(led_strip_del(strip) == ESP_OK, "delete");
+    free(samples[0]);
+    free(samples[1]);
+    free(frame);
+    return bench_result();
+}
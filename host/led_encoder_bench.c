@@ -0,0 +1,168 @@
+/**
+ * \file led_encoder_bench.c
+ * \brief Throughput of the LED strip RMT encoders on the RMT mock (rmt_mock.c).
+ *
+ * Every strip length and memory block size is encoded with the bytes encoder (bit by bit, the encoder
+ * before IDF 5.3) and with the lookup table encoder (whole pixels from a byte to 8 symbols table),
+ * without waiting for the wire time. Reports the encoder throughput in symbols/us and the refill
+ * interrupts per frame, and checks that both encoders send the same symbols.
+ * The bytes encoder is the mock one, a model of the driver's: the ratio matters, not the absolute numbers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#include "led_strip_rmt_encoder.h"
+#include "rmt_mock.h"
+
+#define LED_GPIO 8
+#define LED_RESOLUTION_HZ (10 * 1000 * 1000)
+#define BYTES_PER_PIXEL 3
+
+typedef struct {
+    const char *name;
+    size_t mem_block_symbols;   /*!< 0: a whole frame, as the DMA mode of led_strip_rmt_dev.c */
+} mem_block_t;
+
+static const mem_block_t s_mem_blocks[] = {
+    { "48 (C3, S3)", 48 },
+    { "64 (S2)", 64 },
+    { "DMA (S3)", 0 },
+};
+
+static const int s_strip_lengths[] = { 1, 16, 64, 256 };
+
+typedef struct {
+    double symbols_per_us;
+    double refills_per_frame;
+    size_t frame_symbols;
+} result_t;
+
+/**
+ * \brief Send `rounds` frames with one encoder.
+ * \param[out] last the symbols of the last frame, at least `max_symbols`
+ * \return 0 for success, -1 for failure
+ */
+static int run(bool lut, size_t mem_block_symbols, const uint8_t *pixels, size_t size, int rounds,
+               rmt_symbol_word_t *last, size_t max_symbols, result_t *result) {
+    rmt_tx_channel_config_t chan_config = {
+        .gpio_num = LED_GPIO,
+        .resolution_hz = LED_RESOLUTION_HZ,
+        .mem_block_symbols = mem_block_symbols,
+        .trans_queue_depth = 4,
+    };
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = LED_RESOLUTION_HZ,
+        .led_model = LED_MODEL_WS2812,
+        .bytes_per_pixel = BYTES_PER_PIXEL,
+    };
+    rmt_transmit_config_t tx_config = { .loop_count = 0 };
+    rmt_channel_handle_t chan = NULL;
+    rmt_encoder_handle_t encoder = NULL;
+    int ret = -1;
+    if (rmt_new_tx_channel(&chan_config, &chan) != ESP_OK) {
+        return -1;
+    }
+    esp_err_t err = lut ? rmt_new_led_strip_encoder(&encoder_config, &encoder)
+                    : rmt_new_led_strip_bytes_encoder(&encoder_config, &encoder);
+    if (err != ESP_OK || rmt_enable(chan) != ESP_OK) {
+        goto exit;
+    }
+    for (int i = 0; i < rounds; i++) {
+        if (rmt_transmit(chan, encoder, pixels, size, &tx_config) != ESP_OK) {
+            goto exit;
+        }
+    }
+    rmt_tx_wait_all_done(chan, -1);
+    rmt_mock_stats_t stats;
+    rmt_mock_get_stats(chan, &stats);
+    result->symbols_per_us = stats.encode_ns > 0 ? stats.symbols * 1000.0 / stats.encode_ns : 0;
+    result->refills_per_frame = (double)stats.refills / stats.transactions;
+    result->frame_symbols = rmt_mock_get_last_symbols(chan, last, max_symbols);
+    ret = 0;
+
+exit:
+    rmt_disable(chan);
+    if (encoder != NULL) {
+        rmt_del_encoder(encoder);
+    }
+    rmt_del_channel(chan);
+    return ret;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n FRAMES      number of frames per encoder and configuration (1000)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    rmt_mock_set_real_time(false);
+
+    int failures = 0;
+    printf("LED strip RMT encoders, WS2812 GRB, %d frames, encoder throughput and refill interrupts per frame\n", rounds);
+    printf("  %-6s %-12s %14s %14s %9s %12s %12s\n", "LEDs", "mem block", "bytes sym/us", "LUT sym/us", "speedup",
+           "bytes refill", "LUT refill");
+    for (size_t l = 0; l < sizeof(s_strip_lengths) / sizeof(s_strip_lengths[0]); l++) {
+        size_t size = s_strip_lengths[l] * BYTES_PER_PIXEL;
+        size_t max_symbols = size * 8 + 1;
+        uint8_t *pixels = malloc(size);
+        rmt_symbol_word_t *symbols[2] = { calloc(max_symbols, sizeof(rmt_symbol_word_t)),
+                                          calloc(max_symbols, sizeof(rmt_symbol_word_t)) };
+        if (pixels == NULL || symbols[0] == NULL || symbols[1] == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        for (size_t i = 0; i < size; i++) {
+            pixels[i] = (uint8_t)rand();
+        }
+        for (size_t m = 0; m < sizeof(s_mem_blocks) / sizeof(s_mem_blocks[0]); m++) {
+            size_t mem_block_symbols = s_mem_blocks[m].mem_block_symbols;
+            if (mem_block_symbols == 0) {
+                // as led_strip_new_rmt_device with DMA
+                mem_block_symbols = (max_symbols + 1) & ~(size_t)1;
+                mem_block_symbols = mem_block_symbols < 48 ? 48 : (mem_block_symbols > 1024 ? 1024 : mem_block_symbols);
+            }
+            result_t results[2];
+            for (int lut = 0; lut < 2; lut++) {
+                if (run(lut, mem_block_symbols, pixels, size, rounds, symbols[lut], max_symbols, &results[lut]) != 0) {
+                    fprintf(stderr, "FAILED: %s encoder, %d LEDs\n", lut ? "LUT" : "bytes", s_strip_lengths[l]);
+                    return 1;
+                }
+            }
+            if (results[0].frame_symbols != max_symbols || results[1].frame_symbols != max_symbols ||
+                memcmp(symbols[0], symbols[1], max_symbols * sizeof(rmt_symbol_word_t)) != 0) {
+                fprintf(stderr, "FAILED: the encoders send different symbols, %d LEDs, %s\n", s_strip_lengths[l],
+                        s_mem_blocks[m].name);
+                failures++;
+            }
+            printf("  %-6d %-12s %14.1f %14.1f %8.1fx %12.1f %12.1f\n", s_strip_lengths[l], s_mem_blocks[m].name,
+                   results[0].symbols_per_us, results[1].symbols_per_us,
+                   results[0].symbols_per_us > 0 ? results[1].symbols_per_us / results[0].symbols_per_us : 0.0,
+                   results[0].refills_per_frame, results[1].refills_per_frame);
+        }
+        free(pixels);
+        free(symbols[0]);
+        free(symbols[1]);
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("  the encoders send the same symbols\n");
+    return 0;
+}
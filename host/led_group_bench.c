@@ -0,0 +1,204 @@
+/**
+ * \file led_group_bench.c
+ * \brief Frame time of several LED strips, refreshed one after the other and as a group, on the RMT mock (rmt_mock.c).
+ *
+ * Besides the frame times, it checks:
+ *   - a group refresh takes about as long as the longest strip, not the sum of the strips
+ *   - the strips of a group start their frames together
+ *   - every strip sends its own pixels
+ *   - a strip in a group cannot be refreshed on its own
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "led_strip.h"
+#include "rmt_mock.h"
+#include "platform.h"
+
+#define FIRST_GPIO 10
+#define MAX_STRIPS 4
+#define LED_RESOLUTION_HZ (10 * 1000 * 1000)
+/** Allowed overhead of a group refresh over the longest strip, and skew of the starts, on a loaded host, in us */
+#define GROUP_TOLERANCE_US 1000
+
+static const uint32_t s_strip_lengths[MAX_STRIPS] = { 8, 16, 30, 60 };
+
+static int compare_time(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t median(int64_t *values, int count) {
+    qsort(values, count, sizeof(int64_t), compare_time);
+    return values[count / 2];
+}
+
+/* Set every pixel of the strip to a colour of the round */
+static void set_pixels(led_strip_handle_t strip, uint32_t length, int round) {
+    for (uint32_t i = 0; i < length; i++) {
+        led_strip_set_pixel(strip, i, (round + i) & 0xFF, (round * 3) & 0xFF, i & 0xFF);
+    }
+}
+
+/* Whether the last frame on the channel is the pixels of the round, in GRB order */
+static bool check_frame(rmt_channel_handle_t chan, uint32_t length, int round) {
+    size_t count = rmt_mock_get_last_symbols(chan, NULL, 0);
+    if (count != length * 24 + 1) {
+        return false;
+    }
+    rmt_symbol_word_t *symbols = calloc(count, sizeof(rmt_symbol_word_t));
+    if (symbols == NULL) {
+        return false;
+    }
+    rmt_mock_get_last_symbols(chan, symbols, count);
+    bool ok = true;
+    for (uint32_t i = 0; i < length && ok; i++) {
+        uint8_t grb[3] = { (round * 3) & 0xFF, (round + i) & 0xFF, i & 0xFF };
+        for (int bit = 0; bit < 24; bit++) {
+            // WS2812: a 1 is high for 0.9us, a 0 for 0.3us
+            bool one = symbols[i * 24 + bit].duration0 > LED_RESOLUTION_HZ / 1000000 * 6 / 10;
+            if (one != ((grb[bit / 8] >> (7 - bit % 8)) & 1)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    free(symbols);
+    return ok;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of refreshes per mode (100)\n"
+            "  -s STRIPS      number of strips, 2 to %d (%d)\n", name, MAX_STRIPS, MAX_STRIPS);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 100;
+    int num_strips = MAX_STRIPS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        case 's': num_strips = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0 || num_strips < 2 || num_strips > MAX_STRIPS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    led_strip_handle_t strips[MAX_STRIPS];
+    rmt_channel_handle_t channels[MAX_STRIPS];
+    int64_t wire_us[MAX_STRIPS];
+    int64_t sum_us = 0;
+    int64_t longest_us = 0;
+    for (int s = 0; s < num_strips; s++) {
+        led_strip_config_t strip_config = {
+            .strip_gpio_num = FIRST_GPIO + s,
+            .max_leds = s_strip_lengths[s],
+            .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+            .led_model = LED_MODEL_WS2812,
+        };
+        led_strip_rmt_config_t rmt_config = {
+            .resolution_hz = LED_RESOLUTION_HZ,
+        };
+        if (led_strip_new_rmt_device(&strip_config, &rmt_config, &strips[s]) != ESP_OK) {
+            fprintf(stderr, "Failed to create the LED strips\n");
+            return 1;
+        }
+        channels[s] = rmt_mock_find_channel(FIRST_GPIO + s);
+    }
+    int64_t *samples[2] = { calloc(rounds, sizeof(int64_t)), calloc(rounds, sizeof(int64_t)) };
+    int64_t *skews = calloc(rounds, sizeof(int64_t));
+    if (samples[0] == NULL || samples[1] == NULL || skews == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // One strip after the other
+    for (int i = 0; i < rounds; i++) {
+        int64_t start_us = platform_now_us();
+        for (int s = 0; s < num_strips; s++) {
+            set_pixels(strips[s], s_strip_lengths[s], i);
+            bench_check(led_strip_refresh(strips[s]) == ESP_OK, "refresh");
+        }
+        samples[0][i] = platform_now_us() - start_us;
+    }
+    for (int s = 0; s < num_strips; s++) {
+        rmt_mock_stats_t stats;
+        rmt_mock_get_stats(channels[s], &stats);
+        wire_us[s] = stats.wire_us / stats.transactions;
+        sum_us += wire_us[s];
+        longest_us = wire_us[s] > longest_us ? wire_us[s] : longest_us;
+    }
+
+    // As a group
+    led_strip_rmt_group_handle_t group = NULL;
+    bench_check(led_strip_new_rmt_group(strips, num_strips, &group) == ESP_OK, "create group");
+    if (group == NULL) {
+        return 1;
+    }
+    bench_check(led_strip_refresh(strips[0]) == ESP_ERR_INVALID_STATE, "refresh of a strip in a group refused");
+    bench_check(led_strip_refresh_async(strips[0], NULL, NULL) == ESP_ERR_INVALID_STATE,
+                "asynchronous refresh of a strip in a group refused");
+    led_strip_rmt_group_handle_t other = NULL;
+    bench_check(led_strip_new_rmt_group(strips, 2, &other) == ESP_ERR_INVALID_STATE, "strip in two groups refused");
+    int frame_errors = 0;
+    for (int i = 0; i < rounds; i++) {
+        int round = rounds + i;
+        for (int s = 0; s < num_strips; s++) {
+            set_pixels(strips[s], s_strip_lengths[s], round);
+        }
+        int64_t start_us = platform_now_us();
+        bench_check(led_strip_rmt_group_refresh(group) == ESP_OK, "group refresh");
+        samples[1][i] = platform_now_us() - start_us;
+
+        int64_t first = INT64_MAX;
+        int64_t last = INT64_MIN;
+        for (int s = 0; s < num_strips; s++) {
+            rmt_mock_stats_t stats;
+            rmt_mock_get_stats(channels[s], &stats);
+            first = stats.last_start_us < first ? stats.last_start_us : first;
+            last = stats.last_start_us > last ? stats.last_start_us : last;
+            if (!check_frame(channels[s], s_strip_lengths[s], round)) {
+                frame_errors++;
+            }
+        }
+        skews[i] = last - first;
+    }
+    bench_check(led_strip_del_rmt_group(group) == ESP_OK, "delete group");
+    bench_check(led_strip_refresh(strips[0]) == ESP_OK, "refresh once the group is deleted");
+
+    int64_t sequential = median(samples[0], rounds);
+    int64_t grouped = median(samples[1], rounds);
+    int64_t skew = median(skews, rounds);
+    bench_check(frame_errors == 0, "group frames");
+    bench_check(grouped <= longest_us + GROUP_TOLERANCE_US, "group refresh as long as the longest strip");
+    bench_check(grouped < sequential, "group refresh shorter than one strip after the other");
+    bench_check(skew <= GROUP_TOLERANCE_US, "strips start together");
+
+    printf("LED strips");
+    for (int s = 0; s < num_strips; s++) {
+        printf("%s %lu LEDs (%lldus)", s > 0 ? "," : "", (unsigned long)s_strip_lengths[s], (long long)wire_us[s]);
+    }
+    printf(", %d rounds, median frame time\n", rounds);
+    printf("  %-24s %8lldus (wire time %lldus)\n", "one after the other", (long long)sequential, (long long)sum_us);
+    printf("  %-24s %8lldus (longest strip %lldus), start skew %lldus\n", "group", (long long)grouped,
+           (long long)longest_us, (long long)skew);
+
+    for (int s = 0; s < num_strips; s++) {
+        led_strip_del(strips[s]);
+    }
+    free(samples[0]);
+    free(samples[1]);
+    free(skews);
+    return bench_result();
+}
@@ -0,0 +1,173 @@
+/**
+ * \file led_pixels_bench.c
+ * \brief Cost of filling a LED strip frame, one led_strip_set_pixel call per pixel and with led_strip_set_pixels,
+ *        on the RMT and SPI backends (rmt_mock.c, spi_mock.c).
+ *
+ * Every mode is measured without and with colour correction (half brightness and gamma), and the frames
+ * both ways put on the wire are compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "led_strip.h"
+#include "rmt_mock.h"
+#include "spi_mock.h"
+
+#define RMT_GPIO 8
+#define SPI_GPIO 11
+#define LED_RESOLUTION_HZ (10 * 1000 * 1000)
+
+typedef enum {
+    BACKEND_RMT,
+    BACKEND_SPI,
+} backend_t;
+
+
+static led_strip_handle_t new_strip(backend_t backend, uint32_t leds) {
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = backend == BACKEND_RMT ? RMT_GPIO : SPI_GPIO,
+        .max_leds = leds,
+        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
+        .led_model = LED_MODEL_WS2812,
+    };
+    led_strip_handle_t strip = NULL;
+    if (backend == BACKEND_RMT) {
+        led_strip_rmt_config_t rmt_config = {
+            .resolution_hz = LED_RESOLUTION_HZ,
+            .flags.with_dma = true,
+        };
+        led_strip_new_rmt_device(&strip_config, &rmt_config, &strip);
+    }
+    else {
+        led_strip_spi_config_t spi_config = {
+            .spi_bus = SPI2_HOST,
+            .flags.with_dma = true,
+        };
+        led_strip_new_spi_device(&strip_config, &spi_config, &strip);
+    }
+    return strip;
+}
+
+/* Copy the last frame on the wire: the RMT symbols or the SPI bytes */
+static size_t last_frame(backend_t backend, void *frame, size_t max_size) {
+    if (backend == BACKEND_RMT) {
+        rmt_channel_handle_t chan = rmt_mock_find_channel(RMT_GPIO);
+        size_t count = rmt_mock_get_last_symbols(chan, frame, max_size / sizeof(rmt_symbol_word_t));
+        return count * sizeof(rmt_symbol_word_t);
+    }
+    return spi_mock_get_last_bytes(SPI2_HOST, frame, max_size);
+}
+
+static void set_one_by_one(led_strip_handle_t strip, const uint8_t *rgb, uint32_t leds) {
+    for (uint32_t i = 0; i < leds; i++) {
+        led_strip_set_pixel(strip, i, rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of frames per mode (500)\n"
+            "  -l LEDS        length of the strip (1024)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 500;
+    int leds = 1024;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        case 'l': leds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0 || leds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    rmt_mock_set_real_time(false);
+
+    // two frames, so that every round changes the pixels
+    uint8_t *frames[2] = { malloc(leds * 3), malloc(leds * 3) };
+    size_t max_wire = (size_t)leds * 24 * sizeof(rmt_symbol_word_t) + 64;
+    uint8_t *wire[2] = { malloc(max_wire), malloc(max_wire) };
+    if (frames[0] == NULL || frames[1] == NULL || wire[0] == NULL || wire[1] == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (int i = 0; i < leds * 3; i++) {
+        frames[0][i] = (uint8_t)rand();
+        frames[1][i] = (uint8_t)rand();
+    }
+
+    printf("LED strip of %d WS2812, %d frames, mean time to set the pixels of a frame\n", leds, rounds);
+    printf("  %-8s %-12s %14s %14s %9s\n", "backend", "correction", "set_pixel", "set_pixels", "speedup");
+    const char *backend_names[] = { "RMT", "SPI" };
+    for (backend_t backend = BACKEND_RMT; backend <= BACKEND_SPI; backend++) {
+        led_strip_handle_t strip = new_strip(backend, leds);
+        if (strip == NULL) {
+            fprintf(stderr, "Failed to create the %s strip\n", backend_names[backend]);
+            return 1;
+        }
+        for (int corrected = 0; corrected < 2; corrected++) {
+            bench_check(led_strip_set_correction(strip, corrected ? 128 : 255, corrected) == ESP_OK, "set correction");
+            double times[2];
+            for (int bulk = 0; bulk < 2; bulk++) {
+                int64_t total_ns = 0;
+                for (int i = 0; i < rounds; i++) {
+                    const uint8_t *rgb = frames[i % 2];
+                    int64_t start_ns = bench_now_ns();
+                    if (bulk) {
+                        led_strip_set_pixels(strip, 0, leds, rgb);
+                    }
+                    else {
+                        set_one_by_one(strip, rgb, leds);
+                    }
+                    total_ns += bench_now_ns() - start_ns;
+                    // the RMT backend compares the pixels with the frame until it is sent
+                    if (backend == BACKEND_RMT) {
+                        led_strip_refresh(strip);
+                    }
+                }
+                times[bulk] = total_ns / 1000.0 / rounds;
+            }
+
+            // the same frame both ways
+            set_one_by_one(strip, frames[0], leds);
+            led_strip_refresh(strip);
+            size_t size = last_frame(backend, wire[0], max_wire);
+            led_strip_set_pixels(strip, 0, leds, frames[1]);
+            led_strip_refresh(strip);
+            led_strip_set_pixels(strip, 0, leds, frames[0]);
+            led_strip_refresh(strip);
+            bench_check(last_frame(backend, wire[1], max_wire) == size && memcmp(wire[0], wire[1], size) == 0,
+                        "same frame with set_pixel and set_pixels");
+
+            printf("  %-8s %-12s %12.2fus %12.2fus %8.1fx\n", backend_names[backend],
+                   corrected ? "128, gamma" : "none", times[0], times[1], times[1] > 0 ? times[0] / times[1] : 0.0);
+        }
+        // no brightness is all the LEDs off
+        bench_check(led_strip_set_correction(strip, 0, false) == ESP_OK, "set correction");
+        led_strip_set_pixels(strip, 0, leds, frames[0]);
+        led_strip_refresh(strip);
+        size_t size = last_frame(backend, wire[0], max_wire);
+        led_strip_clear(strip);
+        bench_check(last_frame(backend, wire[1], max_wire) == size && memcmp(wire[0], wire[1], size) == 0,
+                    "no brightness turns the LEDs off");
+        bench_check(led_strip_set_pixels(strip, leds - 1, 2, frames[0]) == ESP_ERR_INVALID_ARG, "pixels out of the strip refused");
+        bench_check(led_strip_set_pixels_rgbw(strip, 0, 1, frames[0]) == ESP_ERR_INVALID_ARG, "RGBW pixels on a GRB strip refused");
+        led_strip_del(strip);
+    }
+
+    free(frames[0]);
+    free(frames[1]);
+    free(wire[0]);
+    free(wire[1]);
+    return bench_result();
+}
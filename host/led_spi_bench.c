@@ -0,0 +1,274 @@
+/**
+ * \file led_spi_bench.c
+ * \brief SPI backend of the LED strip component: encoding kernel throughput and waveform, on the SPI mock (spi_mock.c).
+ *
+ * The table encoder (led_strip_spi_encoder.c) is compared with a bit by bit encoder of the same waveform,
+ * and checked against the datasheet timings: the SPI bytes are decoded back into high and low pulses at
+ * the clock the driver gives, every pulse must be within 150ns of the datasheet and the frame must end with
+ * a reset code of at least 50us. The backend is then run through the led_strip API on the mock:
+ *   - the frame on MOSI decodes to the pixels, GRB and GRBW
+ *   - clear sends all the LEDs off
+ *   - a frame larger than the SPI buffer needs DMA, an inverted output is refused
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "led_strip.h"
+#include "led_strip_spi_encoder.h"
+#include "soc/soc_caps.h"
+#include "spi_mock.h"
+#include "platform.h"
+
+/** Datasheet tolerance of every pulse, in ns */
+#define PULSE_TOLERANCE_NS 150
+#define RESET_MIN_US 50
+#define MAX_LEDS 256
+
+typedef struct {
+    const char *name;
+    led_model_t model;
+    led_pixel_format_t format;
+    uint8_t bytes_per_pixel;
+    /* Datasheet timings in ns */
+    uint32_t t0h;
+    uint32_t t0l;
+    uint32_t t1h;
+    uint32_t t1l;
+} led_type_t;
+
+static const led_type_t s_types[] = {
+    { "WS2812", LED_MODEL_WS2812, LED_PIXEL_FORMAT_GRB, 3, 400, 850, 800, 450 },
+    { "SK6812", LED_MODEL_SK6812, LED_PIXEL_FORMAT_GRBW, 4, 300, 900, 600, 600 },
+};
+
+
+/* Bit by bit encoder of the same waveform: high, the LED bit, then low up to `bits` SPI bits */
+static void encode_bits(const uint8_t *src, size_t size, uint8_t bits, uint8_t *dst) {
+    memset(dst, 0, size * bits);
+    size_t out = 0;
+    for (size_t i = 0; i < size; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            for (uint8_t k = 0; k < bits; k++) {
+                bool level = (k == 0) || (k == 1 && ((src[i] >> bit) & 1));
+                dst[out / 8] |= (uint8_t)(level << (7 - out % 8));
+                out++;
+            }
+        }
+    }
+}
+
+static bool spi_bit(const uint8_t *spi, size_t index) {
+    return (spi[index / 8] >> (7 - index % 8)) & 1;
+}
+
+/**
+ * \brief Decode SPI bytes into LED bytes from the pulses on MOSI, and check their timings.
+ * \param[out] reset_us the length of the final low level
+ * \return the number of LED bytes, 0 if a pulse is out of the datasheet timings
+ */
+static size_t decode_waveform(const led_type_t *type, const uint8_t *spi, size_t spi_size, int clock_hz, uint8_t *bytes,
+                              size_t max_bytes, uint32_t *reset_us) {
+    size_t total = spi_size * 8;
+    size_t index = 0;
+    size_t length = 0;
+    double period_ns = 1e9 / clock_hz;
+    memset(bytes, 0, max_bytes);
+    *reset_us = 0;
+    while (index < total) {
+        size_t high = 0;
+        size_t low = 0;
+        while (index < total && spi_bit(spi, index)) {
+            high++;
+            index++;
+        }
+        while (index < total && !spi_bit(spi, index)) {
+            low++;
+            index++;
+        }
+        if (high == 0 || index == total) {
+            // the reset code
+            *reset_us = (uint32_t)(low * period_ns / 1000);
+            if (high == 0) {
+                break;
+            }
+        }
+        double high_ns = high * period_ns;
+        double low_ns = low * period_ns;
+        bool one = high_ns > (type->t0h + type->t1h) / 2.0;
+        double th = one ? type->t1h : type->t0h;
+        double tl = one ? type->t1l : type->t0l;
+        bool last = index == total;
+        if (high_ns < th - PULSE_TOLERANCE_NS || high_ns > th + PULSE_TOLERANCE_NS ||
+            (!last && (low_ns < tl - PULSE_TOLERANCE_NS || low_ns > tl + PULSE_TOLERANCE_NS))) {
+            return 0;
+        }
+        if (length / 8 >= max_bytes) {
+            return 0;
+        }
+        bytes[length / 8] |= (uint8_t)(one << (7 - length % 8));
+        length++;
+    }
+    return length / 8;
+}
+
+/* Throughput of an encoder in LED bytes per us */
+static double throughput(const led_type_t *type, bool table, const uint8_t *src, size_t size, uint8_t *dst, int rounds) {
+    const led_strip_spi_timing_t *timing = led_strip_spi_get_timing(type->model);
+    int64_t start_us = platform_now_us();
+    for (int i = 0; i < rounds; i++) {
+        if (table) {
+            led_strip_spi_encode(type->model, src, size, dst);
+        }
+        else {
+            encode_bits(src, size, timing->bits, dst);
+        }
+    }
+    int64_t elapsed_us = platform_now_us() - start_us;
+    return elapsed_us > 0 ? (double)size * rounds / elapsed_us : 0;
+}
+
+static led_strip_handle_t new_strip(const led_type_t *type, uint32_t leds, spi_host_device_t bus, bool dma, bool invert,
+                                    esp_err_t *err) {
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = 11,
+        .max_leds = leds,
+        .led_pixel_format = type->format,
+        .led_model = type->model,
+        .flags.invert_out = invert,
+    };
+    led_strip_spi_config_t spi_config = {
+        .clk_src = SPI_CLK_SRC_DEFAULT,
+        .spi_bus = bus,
+        .flags.with_dma = dma,
+    };
+    led_strip_handle_t strip = NULL;
+    *err = led_strip_new_spi_device(&strip_config, &spi_config, &strip);
+    return strip;
+}
+
+/* Whether the last frame on the bus is the given LED bytes, with a reset code */
+static bool check_frame(const led_type_t *type, spi_host_device_t bus, const uint8_t *expected, size_t size,
+                        uint8_t *spi, uint8_t *decoded) {
+    const led_strip_spi_timing_t *timing = led_strip_spi_get_timing(type->model);
+    size_t spi_size = spi_mock_get_last_bytes(bus, spi, MAX_LEDS * 4 * 4 + timing->reset_bytes);
+    // the clock the mock driver gives for the requested one
+    int clock_hz = 80000000 / ((80000000 + timing->clock_hz - 1) / timing->clock_hz);
+    uint32_t reset_us;
+    size_t length = decode_waveform(type, spi, spi_size, clock_hz, decoded, MAX_LEDS * 4, &reset_us);
+    return length == size && memcmp(decoded, expected, size) == 0 && reset_us >= RESET_MIN_US;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of encodings of a 256 LED frame per encoder (2000)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 2000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    size_t max_bytes = MAX_LEDS * 4;
+    uint8_t *pixels = malloc(max_bytes);
+    uint8_t *decoded = malloc(max_bytes);
+    uint8_t *spi[2] = { malloc(max_bytes * 4 + 64), malloc(max_bytes * 4 + 64) };
+    if (pixels == NULL || decoded == NULL || spi[0] == NULL || spi[1] == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < max_bytes; i++) {
+        pixels[i] = (uint8_t)rand();
+    }
+
+    printf("LED strip SPI encoders, %d LED frames, %d rounds, LED bytes per us\n", MAX_LEDS, rounds);
+    printf("  %-8s %-6s %12s %12s %9s %12s\n", "LED", "clock", "bit by bit", "table", "speedup", "frame");
+    for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++) {
+        const led_type_t *type = &s_types[t];
+        const led_strip_spi_timing_t *timing = led_strip_spi_get_timing(type->model);
+        size_t size = MAX_LEDS * type->bytes_per_pixel;
+
+        // every byte value, then random pixels
+        uint8_t values[256];
+        for (int v = 0; v < 256; v++) {
+            values[v] = (uint8_t)v;
+        }
+        led_strip_spi_encode(type->model, values, 256, spi[0]);
+        encode_bits(values, 256, timing->bits, spi[1]);
+        bench_check(memcmp(spi[0], spi[1], 256 * timing->bits) == 0, "table and bit by bit encoders agree on every byte");
+
+        double bits_rate = throughput(type, false, pixels, size, spi[1], rounds);
+        double table_rate = throughput(type, true, pixels, size, spi[0], rounds);
+        bench_check(memcmp(spi[0], spi[1], size * timing->bits) == 0, "table and bit by bit encoders agree on the frame");
+        printf("  %-8s %4.2fMHz %12.1f %12.1f %8.1fx %9zu B\n", type->name, timing->clock_hz / 1e6, bits_rate, table_rate,
+               bits_rate > 0 ? table_rate / bits_rate : 0.0, size * timing->bits + timing->reset_bytes);
+    }
+
+    // Backend on the SPI mock
+    for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++) {
+        const led_type_t *type = &s_types[t];
+        const led_strip_spi_timing_t *timing = led_strip_spi_get_timing(type->model);
+        uint32_t leds = 60;
+        size_t size = leds * type->bytes_per_pixel;
+        esp_err_t err;
+        led_strip_handle_t strip = new_strip(type, leds, SPI2_HOST, true, false, &err);
+        bench_check(err == ESP_OK && strip != NULL, "create SPI strip with DMA");
+        if (strip == NULL) {
+            continue;
+        }
+        int64_t start_us = platform_now_us();
+        for (uint32_t i = 0; i < leds; i++) {
+            const uint8_t *p = pixels + i * type->bytes_per_pixel;
+            // GRB(W) on the wire
+            if (type->bytes_per_pixel == 4) {
+                bench_check(led_strip_set_pixel_rgbw(strip, i, p[1], p[0], p[2], p[3]) == ESP_OK, "set pixel");
+            }
+            else {
+                bench_check(led_strip_set_pixel(strip, i, p[1], p[0], p[2]) == ESP_OK, "set pixel");
+            }
+        }
+        int64_t set_us = platform_now_us() - start_us;
+        bench_check(led_strip_refresh(strip) == ESP_OK, "refresh");
+        bench_check(check_frame(type, SPI2_HOST, pixels, size, spi[0], decoded), "frame on MOSI");
+        bench_check(led_strip_clear(strip) == ESP_OK, "clear");
+        memset(spi[1], 0, size);
+        bench_check(check_frame(type, SPI2_HOST, spi[1], size, spi[0], decoded), "cleared frame on MOSI");
+        spi_mock_stats_t stats;
+        spi_mock_get_stats(SPI2_HOST, &stats);
+        printf("  %s backend, %lu LEDs: %lldus to set the pixels, %lluus on the wire per frame\n", type->name,
+               (unsigned long)leds, (long long)set_us, (unsigned long long)(stats.wire_us / stats.transactions));
+        bench_check(led_strip_del(strip) == ESP_OK, "delete");
+
+        // without DMA the frame and its reset code fit in the SPI buffer
+        uint32_t max_leds = (SOC_SPI_MAXIMUM_BUFFER_SIZE - timing->reset_bytes) / (type->bytes_per_pixel * timing->bits);
+        strip = new_strip(type, max_leds, SPI3_HOST, false, false, &err);
+        bench_check(err == ESP_OK && strip != NULL, "create SPI strip without DMA");
+        if (strip != NULL) {
+            bench_check(led_strip_refresh(strip) == ESP_OK, "refresh without DMA");
+            bench_check(led_strip_del(strip) == ESP_OK, "delete");
+        }
+        strip = new_strip(type, max_leds + 1, SPI3_HOST, false, false, &err);
+        bench_check(err == ESP_ERR_INVALID_ARG && strip == NULL, "frame larger than the SPI buffer without DMA refused");
+        strip = new_strip(type, leds, SPI3_HOST, true, true, &err);
+        bench_check(err == ESP_ERR_NOT_SUPPORTED && strip == NULL, "inverted output refused");
+    }
+
+    free(pixels);
+    free(decoded);
+    free(spi[0]);
+    free(spi[1]);
+    return bench_result();
+}
@@ -0,0 +1,249 @@
+/**
+ * \file loadtest.c
+ * \brief Run the getting started application as many simulated devices against a broker and a QuarkLink stub.
+ *
+ * Every device runs app_device_run() (the same code as the getting_started_task) in its own thread.
+ * Devices are started progressively, then the tool reports at a fixed interval:
+ *   - connect storms: MQTT connection attempts, peak of concurrent handshakes and the handshake histogram
+ *   - publish throughput: telemetry publishes per second
+ *   - status-poll load: QuarkLink requests per second, TLS handshakes per request, peak of concurrent requests and
+ *     the status round trip histogram
+ * followed by the runtime metrics report of metrics_flush(), aggregated over all the devices.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "app.h"
+#include "metrics.h"
+#include "platform.h"
+#include "platform_linux.h"
+#include "quarklink_linux.h"
+#include "nvs_mock.h"
+
+typedef struct {
+    app_device_t app;
+    char device_id[QUARKLINK_MAX_DEVICE_ID_LENGTH];
+    pthread_t thread;
+    bool started;
+} sim_device_t;
+
+typedef struct {
+    int devices;
+    double ramp;
+    int duration;
+    double time_scale;
+    int report_interval;
+    const char *quarklink_host;
+    int quarklink_port;
+    const char *root_cert;
+    const char *store_dir;
+    const char *prefix;
+    int keepalive_s;
+    int publish_window;
+} loadtest_config_t;
+
+static atomic_bool s_stop = false;
+static atomic_int s_restarts = 0;
+static int s_publish_window = 0;
+
+static void *device_thread(void *arg) {
+    sim_device_t *device = arg;
+    platform_linux_bind_device(device->device_id);
+
+    while (!s_stop) {
+        memset(&device->app, 0, sizeof(device->app));
+        device->app.keep_metrics = true;
+        device->app.publish_window = (uint16_t)s_publish_window;
+        device->app.stop = s_stop;
+        if (app_device_load(&device->app) != 0 || app_device_run(&device->app) != APP_EXIT_RESTART) {
+            break;
+        }
+        // Firmware updated: reboot
+        quarklink_linux_disconnect();
+        atomic_fetch_add(&s_restarts, 1);
+    }
+    return NULL;
+}
+
+static void on_signal(int signal) {
+    (void)signal;
+    s_stop = true;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n DEVICES     number of simulated devices (100)\n"
+            "  -r RATE        devices started per second (50)\n"
+            "  -d SECONDS     test duration, 0 to run until interrupted (60)\n"
+            "  -t SCALE       time scale of the application intervals, e.g. 10 polls the status every 2s (1)\n"
+            "  -i SECONDS     report interval (10)\n"
+            "  -q HOST:PORT   QuarkLink stub (127.0.0.1:8443)\n"
+            "  -c FILE        QuarkLink stub root certificate (stub-cert.pem)\n"
+            "  -s DIR         directory for the persisted enrolments (/tmp/ql-loadtest)\n"
+            "  -p PREFIX      device ID prefix (sim)\n"
+            "  -k SECONDS     idle timeout of the keep-alive connections to QuarkLink, 0 for one connection per request (30)\n"
+            "  -w WINDOW      publish the telemetry with QoS 1 and WINDOW messages in flight, 0 for QoS 0 (0)\n"
+            "Set QL_LOG_LEVEL (0-5) to change the log level.\n", name);
+}
+
+static int parse_args(int argc, char **argv, loadtest_config_t *config) {
+    static char host[QUARKLINK_MAX_ENDPOINT_LENGTH];
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:d:t:i:q:c:s:p:k:w:h")) != -1) {
+        switch (opt) {
+        case 'n': config->devices = atoi(optarg); break;
+        case 'r': config->ramp = atof(optarg); break;
+        case 'd': config->duration = atoi(optarg); break;
+        case 't': config->time_scale = atof(optarg); break;
+        case 'i': config->report_interval = atoi(optarg); break;
+        case 'q': {
+            const char *colon = strrchr(optarg, ':');
+            if (colon == NULL) {
+                return -1;
+            }
+            snprintf(host, sizeof(host), "%.*s", (int)(colon - optarg), optarg);
+            config->quarklink_host = host;
+            config->quarklink_port = atoi(colon + 1);
+            break;
+        }
+        case 'c': config->root_cert = optarg; break;
+        case 's': config->store_dir = optarg; break;
+        case 'p': config->prefix = optarg; break;
+        case 'k': config->keepalive_s = atoi(optarg); break;
+        case 'w': config->publish_window = atoi(optarg); break;
+        default: return -1;
+        }
+    }
+    if (config->devices <= 0 || config->ramp <= 0 || config->report_interval <= 0 || config->time_scale <= 0 ||
+        config->keepalive_s < 0 || config->publish_window < 0 || config->publish_window > MQTT_OUTBOX_MAX_WINDOW) {
+        return -1;
+    }
+    return 0;
+}
+
+static void report(double elapsed, double interval, int started, int64_t *previous) {
+    int64_t values[PLATFORM_LINUX_STAT_COUNT];
+    int64_t peaks[PLATFORM_LINUX_STAT_COUNT];
+    platform_linux_get_stats(values, peaks);
+
+#define RATE(stat) ((values[stat] - previous[stat]) / interval)
+    printf("[%7.1fs] devices %d, restarts %d\n", elapsed, started, atomic_load(&s_restarts));
+    printf("  mqtt      connected %lld, connect attempts %.1f/s, concurrent handshakes peak %lld\n",
+           (long long)values[PLATFORM_LINUX_MQTT_CONNECTED], RATE(PLATFORM_LINUX_MQTT_CONNECTS),
+           (long long)peaks[PLATFORM_LINUX_MQTT_CONNECTING]);
+    printf("  publish   %.1f/s\n", RATE(PLATFORM_LINUX_MQTT_PUBLISHED));
+    int64_t requests = values[PLATFORM_LINUX_QUARKLINK_REQUESTS] - previous[PLATFORM_LINUX_QUARKLINK_REQUESTS];
+    int64_t handshakes = values[PLATFORM_LINUX_QUARKLINK_HANDSHAKES] - previous[PLATFORM_LINUX_QUARKLINK_HANDSHAKES];
+    printf("  quarklink %.1f req/s, %.2f handshakes/req, concurrent peak %lld\n",
+           RATE(PLATFORM_LINUX_QUARKLINK_REQUESTS), requests > 0 ? (double)handshakes / requests : 0.0,
+           (long long)peaks[PLATFORM_LINUX_QUARKLINK_ACTIVE]);
+#undef RATE
+
+    static char metrics[MAX_METRICS_LENGTH * 4];
+    if (metrics_flush(metrics, sizeof(metrics)) > 0) {
+        printf("  metrics   %s\n", metrics);
+    }
+    fflush(stdout);
+    memcpy(previous, values, sizeof(values));
+}
+
+int main(int argc, char **argv) {
+    loadtest_config_t config = {
+        .devices = 100,
+        .ramp = 50,
+        .duration = 60,
+        .time_scale = 1,
+        .report_interval = 10,
+        .quarklink_host = "127.0.0.1",
+        .quarklink_port = 8443,
+        .root_cert = "stub-cert.pem",
+        .store_dir = "/tmp/ql-loadtest",
+        .prefix = "sim",
+        .keepalive_s = QUARKLINK_LINUX_KEEPALIVE_IDLE_MS / 1000,
+    };
+    if (parse_args(argc, argv, &config) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (quarklink_linux_provision(config.quarklink_host, config.quarklink_port, config.root_cert, config.store_dir) != 0) {
+        return 1;
+    }
+    quarklink_linux_set_keepalive(config.keepalive_s * 1000);
+    s_publish_window = config.publish_window;
+    nvs_mock_set_dir(config.store_dir);
+    platform_linux_set_time_scale(config.time_scale);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    sim_device_t *devices = calloc(config.devices, sizeof(sim_device_t));
+    if (devices == NULL) {
+        fprintf(stderr, "Cannot allocate %d devices\n", config.devices);
+        return 1;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+
+    int64_t previous[PLATFORM_LINUX_STAT_COUNT] = { 0 };
+    int64_t start = platform_now_us();
+    int64_t next_report = start + config.report_interval * 1000000LL;
+    int64_t last_report = start;
+    int started = 0;
+
+    printf("Starting %d devices at %.1f/s, time scale %.1f\n", config.devices, config.ramp, config.time_scale);
+    while (!s_stop) {
+        int64_t now = platform_now_us();
+        double elapsed = (now - start) / 1e6;
+        if (config.duration > 0 && elapsed >= config.duration) {
+            break;
+        }
+
+        // Ramp up
+        int target = (int)(elapsed * config.ramp) + 1;
+        while (started < config.devices && started < target) {
+            sim_device_t *device = &devices[started];
+            snprintf(device->device_id, sizeof(device->device_id), "%s-%06d", config.prefix, started);
+            if (pthread_create(&device->thread, &attr, device_thread, device) != 0) {
+                fprintf(stderr, "Cannot start device %d\n", started);
+                s_stop = true;
+                break;
+            }
+            device->started = true;
+            started++;
+        }
+
+        if (now >= next_report) {
+            report(elapsed, (now - last_report) / 1e6, started, previous);
+            last_report = now;
+            next_report += config.report_interval * 1000000LL;
+        }
+        usleep(10000);
+    }
+
+    printf("Stopping\n");
+    s_stop = true;
+    for (int i = 0; i < config.devices; i++) {
+        devices[i].app.stop = true;
+    }
+    for (int i = 0; i < config.devices; i++) {
+        if (devices[i].started) {
+            pthread_join(devices[i].thread, NULL);
+        }
+    }
+    int64_t now = platform_now_us();
+    report((now - start) / 1e6, (now - last_report) / 1e6, started, previous);
+
+    pthread_attr_destroy(&attr);
+    free(devices);
+    return 0;
+}
@@ -0,0 +1,647 @@
+/**
+ * \file mqtt_linux.c
+ * \brief Minimal MQTT 3.1.1 client implementing the platform.h MQTT API on Linux.
+ *
+ * Each client has one thread that connects, reads the incoming packets, sends the keep-alive
+ * pings and reconnects, like the esp_mqtt task. Publishes are written from the caller thread.
+ * The connection uses TLS when the enrolment returned an IoT Hub root certificate, plain TCP otherwise.
+ * When the caller keeps a TLS session, each connection resumes it and saves the new one after the CONNACK.
+ * The CONNECT and the connect messages are written together; with early data enabled and a resumed TLS 1.3
+ * session that allows it, they leave with the ClientHello.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+
+#include "platform.h"
+#include "platform_linux.h"
+#include "net_linux.h"
+
+static const char *TAG = "mqtt_linux";
+
+#define MQTT_DEFAULT_KEEPALIVE      (120)
+/** Same as the esp_mqtt default */
+#define MQTT_RECONNECT_TIMEOUT_MS   (10000)
+#define MQTT_NETWORK_TIMEOUT_MS     (10000)
+/** Granularity of the keep-alive and stop checks */
+#define MQTT_POLL_MS                (1000)
+#define MQTT_MAX_PACKET_SIZE        (64 * 1024)
+
+#define MQTT_CONNECT        (0x10)
+#define MQTT_CONNACK        (0x20)
+#define MQTT_PUBLISH        (0x30)
+#define MQTT_PUBACK         (0x40)
+#define MQTT_SUBSCRIBE      (0x82)
+#define MQTT_SUBACK         (0x90)
+#define MQTT_UNSUBACK       (0xB0)
+#define MQTT_PINGREQ        (0xC0)
+#define MQTT_PINGRESP       (0xD0)
+#define MQTT_DISCONNECT     (0xE0)
+
+struct platform_mqtt {
+    char *host;
+    /** Address resolved by the caller, "" to resolve the host */
+    char address[INET_ADDRSTRLEN];
+    /** Connection to the address handed over by the caller, -1 once taken over by the first connection */
+    int socket;
+    uint16_t port;
+    char *client_id;
+    char *username;
+    SSL_CTX *tls;
+    /** Session to resume and update, owned by the caller, NULL if none */
+    platform_tls_session_t *session;
+    /** The PUBLISH packets of the connect messages, NULL once sent */
+    uint8_t *connect_messages;
+    size_t connect_messages_length;
+    size_t connect_message_count;
+    bool early_data;
+    int keepalive;
+    platform_mqtt_event_cb_t event_cb;
+    void *event_arg;
+
+    pthread_t thread;
+    /** Protects conn and the writes */
+    pthread_mutex_t lock;
+    net_conn_t conn;
+    atomic_bool connected;
+    atomic_bool stop;
+    atomic_uint next_msg_id;
+    /** Time of the last packet sent, for the keep-alive */
+    _Atomic int64_t last_sent_us;
+};
+
+static void emit(platform_mqtt_t *mqtt, platform_mqtt_event_t *event) {
+    if (mqtt->event_cb != NULL) {
+        mqtt->event_cb(mqtt->event_arg, event);
+    }
+}
+
+static void emit_id(platform_mqtt_t *mqtt, platform_mqtt_event_id_t id, int msg_id) {
+    platform_mqtt_event_t event = {
+        .id = id,
+        .msg_id = msg_id,
+    };
+    emit(mqtt, &event);
+}
+
+static uint16_t new_msg_id(platform_mqtt_t *mqtt) {
+    uint16_t msg_id;
+    do {
+        msg_id = (uint16_t)atomic_fetch_add(&mqtt->next_msg_id, 1);
+    } while (msg_id == 0);
+    return msg_id;
+}
+
+static size_t put_remaining_length(uint8_t *buffer, size_t length) {
+    size_t n = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        buffer[n++] = byte | (length > 0 ? 0x80 : 0);
+    } while (length > 0);
+    return n;
+}
+
+static uint8_t *put_string(uint8_t *buffer, const char *string, size_t length) {
+    buffer[0] = length >> 8;
+    buffer[1] = length & 0xFF;
+    memcpy(buffer + 2, string, length);
+    return buffer + 2 + length;
+}
+
+/* Prefix the body, which starts 5 bytes into the buffer, with the fixed header. Returns the packet length, the packet
+ * starts at *packet */
+static size_t frame_packet(uint8_t type, uint8_t *buffer, size_t body_length, uint8_t **packet) {
+    uint8_t header[5];
+    header[0] = type;
+    size_t header_length = 1 + put_remaining_length(header + 1, body_length);
+    *packet = buffer + 5 - header_length;
+    memcpy(*packet, header, header_length);
+    return header_length + body_length;
+}
+
+static int send_bytes(platform_mqtt_t *mqtt, const uint8_t *data, size_t length) {
+    pthread_mutex_lock(&mqtt->lock);
+    int ret = mqtt->conn.fd >= 0 ? net_write(&mqtt->conn, data, length) : -1;
+    pthread_mutex_unlock(&mqtt->lock);
+    if (ret == 0) {
+        mqtt->last_sent_us = platform_now_us();
+    }
+    return ret;
+}
+
+/* Send a body that starts 5 bytes into the buffer */
+static int send_packet(platform_mqtt_t *mqtt, uint8_t type, uint8_t *buffer, size_t body_length) {
+    uint8_t *packet;
+    size_t length = frame_packet(type, buffer, body_length, &packet);
+    return send_bytes(mqtt, packet, length);
+}
+
+/* Room for a PUBLISH packet, header included */
+static size_t publish_size(size_t topic_length, int len) {
+    return 5 + 2 + topic_length + 2 + len;
+}
+
+/* Encode a PUBLISH packet, the buffer must hold publish_size() bytes. Returns the packet length, the packet
+ * starts at *packet */
+static size_t encode_publish(platform_mqtt_t *mqtt, uint8_t *buffer, const char *topic, size_t topic_length,
+                             const char *data, int len, int qos, int retain, int *msg_id, uint8_t **packet) {
+    uint8_t *body = buffer + 5;
+    uint8_t *p = put_string(body, topic, topic_length);
+    *msg_id = 0;
+    if (qos > 0) {
+        *msg_id = new_msg_id(mqtt);
+        *p++ = *msg_id >> 8;
+        *p++ = *msg_id & 0xFF;
+    }
+    memcpy(p, data, len);
+    p += len;
+    return frame_packet(MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0), buffer, p - body, packet);
+}
+
+/*
+ * The first flight of a connection: the CONNECT, followed by the connect messages not sent yet.
+ * Allocated, freed by the caller.
+ */
+static uint8_t *first_flight(platform_mqtt_t *mqtt, size_t *length) {
+    size_t client_id_length = strlen(mqtt->client_id);
+    size_t username_length = mqtt->username != NULL ? strlen(mqtt->username) : 0;
+    size_t messages_length = mqtt->connect_messages != NULL ? mqtt->connect_messages_length : 0;
+    uint8_t *buffer = malloc(5 + 10 + 2 + client_id_length + 2 + username_length + messages_length);
+    if (buffer == NULL) {
+        return NULL;
+    }
+    uint8_t *body = buffer + 5;
+    uint8_t *p = put_string(body, "MQTT", 4);
+    *p++ = 4;                                   // protocol level 3.1.1
+    *p++ = 0x02 | (username_length ? 0x80 : 0); // clean session, username
+    *p++ = mqtt->keepalive >> 8;
+    *p++ = mqtt->keepalive & 0xFF;
+    p = put_string(p, mqtt->client_id, client_id_length);
+    if (username_length) {
+        p = put_string(p, mqtt->username, username_length);
+    }
+    uint8_t *packet;
+    size_t connect_length = frame_packet(MQTT_CONNECT, buffer, p - body, &packet);
+    memmove(buffer, packet, connect_length);
+    if (messages_length > 0) {
+        memcpy(buffer + connect_length, mqtt->connect_messages, messages_length);
+    }
+    *length = connect_length + messages_length;
+    return buffer;
+}
+
+/*
+ * Read exactly length bytes, a timeout is only reported before the first byte when idle_ok is set.
+ * OpenSSL connections cannot be read and written concurrently: wait for data without the lock, then read with it.
+ */
+static int read_exact(platform_mqtt_t *mqtt, uint8_t *data, size_t length, bool idle_ok) {
+    size_t received = 0;
+    while (received < length) {
+        int n = net_wait_readable(&mqtt->conn, MQTT_POLL_MS);
+        if (n > 0) {
+            pthread_mutex_lock(&mqtt->lock);
+            n = net_read(&mqtt->conn, data + received, length - received);
+            pthread_mutex_unlock(&mqtt->lock);
+        }
+        else if (n == 0) {
+            n = NET_TIMEOUT;
+        }
+        if (n == NET_TIMEOUT) {
+            if ((idle_ok && received == 0) || mqtt->stop) {
+                return NET_TIMEOUT;
+            }
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        received += n;
+    }
+    return 0;
+}
+
+/* Read one packet, the body is allocated and must be freed by the caller */
+static int read_packet(platform_mqtt_t *mqtt, uint8_t *type, uint8_t **body, size_t *body_length) {
+    int ret = read_exact(mqtt, type, 1, true);
+    if (ret != 0) {
+        return ret;
+    }
+    size_t length = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t byte;
+        if (shift > 21 || read_exact(mqtt, &byte, 1, false) != 0) {
+            return -1;
+        }
+        length |= (size_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            break;
+        }
+    }
+    if (length > MQTT_MAX_PACKET_SIZE) {
+        return -1;
+    }
+    *body = malloc(length + 1);
+    if (*body == NULL || read_exact(mqtt, *body, length, false) != 0) {
+        free(*body);
+        *body = NULL;
+        return -1;
+    }
+    *body_length = length;
+    return 0;
+}
+
+static void handle_publish(platform_mqtt_t *mqtt, uint8_t type, uint8_t *body, size_t length) {
+    if (length < 2) {
+        return;
+    }
+    size_t topic_length = (body[0] << 8) | body[1];
+    size_t offset = 2 + topic_length;
+    int qos = (type >> 1) & 0x03;
+    int msg_id = 0;
+    if (qos > 0) {
+        if (offset + 2 > length) {
+            return;
+        }
+        msg_id = (body[offset] << 8) | body[offset + 1];
+        offset += 2;
+    }
+    if (offset > length) {
+        return;
+    }
+
+    platform_mqtt_event_t event = {
+        .id = PLATFORM_MQTT_EVENT_DATA,
+        .msg_id = msg_id,
+        .topic = (const char *)body + 2,
+        .topic_len = (int)topic_length,
+        .data = (const char *)body + offset,
+        .data_len = (int)(length - offset),
+        .total_data_len = (int)(length - offset),
+        .current_data_offset = 0,
+    };
+    emit(mqtt, &event);
+
+    if (qos == 1) {
+        uint8_t ack[5 + 2] = { [5] = msg_id >> 8, [6] = msg_id & 0xFF };
+        send_packet(mqtt, MQTT_PUBACK, ack, 2);
+    }
+}
+
+/* Keep the session of the connection for the next one: TLS 1.3 tickets arrive after the handshake */
+static void save_session(platform_mqtt_t *mqtt) {
+    if (mqtt->session == NULL || mqtt->conn.ssl == NULL) {
+        return;
+    }
+    SSL_SESSION *session = SSL_get1_session(mqtt->conn.ssl);
+    if (session == NULL) {
+        return;
+    }
+    int length = i2d_SSL_SESSION(session, NULL);
+    if (SSL_SESSION_is_resumable(session) && length > 0 && length <= PLATFORM_TLS_SESSION_SIZE) {
+        unsigned char *p = mqtt->session->data;
+        i2d_SSL_SESSION(session, &p);
+        mqtt->session->length = (uint16_t)length;
+    }
+    else {
+        ESP_LOGD(TAG, "TLS session not kept (%d bytes)", length);
+    }
+    SSL_SESSION_free(session);
+}
+
+/* The session kept from the previous connection, NULL if none */
+static SSL_SESSION *load_session(platform_mqtt_t *mqtt) {
+    if (mqtt->session == NULL || mqtt->session->length == 0 || mqtt->tls == NULL) {
+        return NULL;
+    }
+    const unsigned char *p = mqtt->session->data;
+    return d2i_SSL_SESSION(NULL, &p, mqtt->session->length);
+}
+
+/* Wait for the CONNACK, then process the incoming packets until the connection drops or the client is stopped */
+static void run_session(platform_mqtt_t *mqtt) {
+    bool connack = false;
+    int64_t connect_deadline = platform_now_us() + MQTT_NETWORK_TIMEOUT_MS * 1000LL;
+    bool ping_pending = false;
+
+    while (!mqtt->stop) {
+        uint8_t type = 0;
+        uint8_t *body = NULL;
+        size_t length = 0;
+        int ret = read_packet(mqtt, &type, &body, &length);
+        int64_t now = platform_now_us();
+        if (ret == NET_TIMEOUT) {
+            if (!connack) {
+                if (now > connect_deadline) {
+                    break;
+                }
+                continue;
+            }
+            if (now - mqtt->last_sent_us >= mqtt->keepalive * 1000000LL) {
+                if (ping_pending) {
+                    ESP_LOGW(TAG, "No PINGRESP");
+                    break;
+                }
+                uint8_t ping[5];
+                send_packet(mqtt, MQTT_PINGREQ, ping, 0);
+                ping_pending = true;
+            }
+            continue;
+        }
+        if (ret != 0) {
+            break;
+        }
+
+        int msg_id = length >= 2 ? (body[0] << 8) | body[1] : 0;
+        switch (type & 0xF0) {
+        case MQTT_CONNACK:
+            if (connack || length < 2 || body[1] != 0) {
+                ESP_LOGD(TAG, "Connection refused error: 0x%x", length >= 2 ? body[1] : 0xFF);
+                if (!connack) {
+                    platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, -1);
+                }
+                platform_mqtt_event_t event = { .id = PLATFORM_MQTT_EVENT_ERROR, .error_code = length >= 2 ? body[1] : -1 };
+                emit(mqtt, &event);
+                free(body);
+                return;
+            }
+            connack = true;
+            save_session(mqtt);
+            mqtt->connected = true;
+            platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, -1);
+            platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTED, 1);
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_CONNECTED, 0);
+            break;
+        case MQTT_PUBLISH:
+            handle_publish(mqtt, type, body, length);
+            break;
+        case MQTT_PUBACK:
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_PUBLISHED, msg_id);
+            break;
+        case MQTT_SUBACK:
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_SUBSCRIBED, msg_id);
+            break;
+        case MQTT_UNSUBACK:
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_UNSUBSCRIBED, msg_id);
+            break;
+        case MQTT_PINGRESP:
+            ping_pending = false;
+            break;
+        default:
+            ESP_LOGD(TAG, "Ignoring packet type 0x%x", type);
+            break;
+        }
+        free(body);
+    }
+
+    if (!connack) {
+        platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, -1);
+        platform_mqtt_event_t event = { .id = PLATFORM_MQTT_EVENT_ERROR };
+        emit(mqtt, &event);
+    }
+}
+
+/* Encode the connect messages once, with their message IDs: they may be written twice if the early data is rejected */
+static int encode_connect_messages(platform_mqtt_t *mqtt, const platform_mqtt_message_t *messages, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (messages[i].qos < 0 || messages[i].qos > 1) {
+            return -1;
+        }
+        int len = messages[i].len > 0 ? messages[i].len : (int)strlen(messages[i].data);
+        total += publish_size(strlen(messages[i].topic), len);
+    }
+    if (count == 0) {
+        return 0;
+    }
+    mqtt->connect_messages = malloc(total);
+    if (mqtt->connect_messages == NULL) {
+        return -1;
+    }
+    uint8_t *end = mqtt->connect_messages;
+    for (size_t i = 0; i < count; i++) {
+        int len = messages[i].len > 0 ? messages[i].len : (int)strlen(messages[i].data);
+        // The packet starts up to 3 bytes into its room, shorter headers first: move it back to the end
+        uint8_t *packet;
+        int msg_id;
+        size_t length = encode_publish(mqtt, end, messages[i].topic, strlen(messages[i].topic), messages[i].data, len,
+                                       messages[i].qos, 0, &msg_id, &packet);
+        memmove(end, packet, length);
+        end += length;
+    }
+    mqtt->connect_messages_length = end - mqtt->connect_messages;
+    mqtt->connect_message_count = count;
+    return 0;
+}
+
+static void *mqtt_task(void *arg) {
+    platform_mqtt_t *mqtt = arg;
+
+    while (!mqtt->stop) {
+        emit_id(mqtt, PLATFORM_MQTT_EVENT_BEFORE_CONNECT, 0);
+        platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTS, 1);
+        platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, 1);
+
+        net_conn_t conn;
+        SSL_SESSION *session = load_session(mqtt);
+        size_t flight_length = 0;
+        uint8_t *flight = first_flight(mqtt, &flight_length);
+        int early_status = SSL_EARLY_DATA_NOT_SENT;
+        int connected = -1;
+        if (flight != NULL && mqtt->socket >= 0) {
+            connected = net_connect_socket(&conn, mqtt->socket, mqtt->host, mqtt->tls, session,
+                                           mqtt->early_data ? flight : NULL, flight_length, &early_status,
+                                           MQTT_POLL_MS);
+            mqtt->socket = -1;
+        }
+        else if (flight != NULL) {
+            connected = net_connect_early(&conn, mqtt->address[0] != '\0' ? mqtt->address : NULL, mqtt->host,
+                                          mqtt->port, mqtt->tls, session, mqtt->early_data ? flight : NULL,
+                                          flight_length, &early_status, MQTT_POLL_MS);
+        }
+        SSL_SESSION_free(session);
+        if (connected == 0) {
+            if (conn.ssl != NULL && SSL_session_reused(conn.ssl)) {
+                platform_linux_stat_add(PLATFORM_LINUX_MQTT_RESUMED, 1);
+            }
+            if (early_status == SSL_EARLY_DATA_ACCEPTED) {
+                platform_linux_stat_add(PLATFORM_LINUX_MQTT_EARLY_ACCEPTED, 1);
+            }
+            else if (early_status == SSL_EARLY_DATA_REJECTED) {
+                ESP_LOGD(TAG, "Early data rejected, sending it again");
+                platform_linux_stat_add(PLATFORM_LINUX_MQTT_EARLY_REJECTED, 1);
+            }
+            pthread_mutex_lock(&mqtt->lock);
+            mqtt->conn = conn;
+            pthread_mutex_unlock(&mqtt->lock);
+
+            if (early_status == SSL_EARLY_DATA_ACCEPTED) {
+                mqtt->last_sent_us = platform_now_us();
+            }
+            if (early_status == SSL_EARLY_DATA_ACCEPTED || send_bytes(mqtt, flight, flight_length) == 0) {
+                if (mqtt->connect_messages != NULL) {
+                    // Sent on the first connection only
+                    platform_linux_stat_add(PLATFORM_LINUX_MQTT_PUBLISHED, (int64_t)mqtt->connect_message_count);
+                    free(mqtt->connect_messages);
+                    mqtt->connect_messages = NULL;
+                }
+                run_session(mqtt);
+            }
+            else {
+                platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, -1);
+                emit_id(mqtt, PLATFORM_MQTT_EVENT_ERROR, 0);
+            }
+
+            pthread_mutex_lock(&mqtt->lock);
+            net_close(&mqtt->conn);
+            pthread_mutex_unlock(&mqtt->lock);
+        }
+        else {
+            platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTING, -1);
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_ERROR, 0);
+        }
+        free(flight);
+
+        if (mqtt->connected) {
+            mqtt->connected = false;
+            platform_linux_stat_add(PLATFORM_LINUX_MQTT_CONNECTED, -1);
+            emit_id(mqtt, PLATFORM_MQTT_EVENT_DISCONNECTED, 0);
+        }
+
+        for (int waited = 0; waited < MQTT_RECONNECT_TIMEOUT_MS && !mqtt->stop; waited += 100) {
+            platform_delay_ms(100);
+        }
+    }
+    return NULL;
+}
+
+platform_mqtt_t *platform_mqtt_start(const platform_mqtt_config_t *config) {
+    const quarklink_context_t *quarklink = config->quarklink;
+    platform_mqtt_t *mqtt = calloc(1, sizeof(platform_mqtt_t));
+    if (mqtt == NULL) {
+        if (config->socket >= 0) {
+            close(config->socket);
+        }
+        return NULL;
+    }
+    mqtt->host = strdup(quarklink->iotHubEndpoint);
+    mqtt->port = quarklink->iotHubPort;
+    mqtt->client_id = strdup(quarklink->deviceID);
+    mqtt->username = config->username != NULL ? strdup(config->username) : NULL;
+    mqtt->tls = net_tls_context(quarklink->iotHubRootCert);
+    mqtt->session = config->session;
+    if (config->address != 0) {
+        struct in_addr address = { .s_addr = config->address };
+        inet_ntop(AF_INET, &address, mqtt->address, sizeof(mqtt->address));
+    }
+    mqtt->socket = config->socket;
+    mqtt->keepalive = config->keepalive > 0 ? config->keepalive : MQTT_DEFAULT_KEEPALIVE;
+    mqtt->early_data = config->early_data;
+    mqtt->event_cb = config->event_cb;
+    mqtt->event_arg = config->event_arg;
+    mqtt->conn.fd = -1;
+    atomic_init(&mqtt->next_msg_id, 1);
+    pthread_mutex_init(&mqtt->lock, NULL);
+
+    if (quarklink->iotHubRootCert[0] != '\0' && mqtt->tls == NULL) {
+        ESP_LOGE(TAG, "Invalid IoT Hub root certificate");
+    }
+    else if (encode_connect_messages(mqtt, config->connect_messages, config->connect_message_count) != 0) {
+        ESP_LOGE(TAG, "Invalid connect messages");
+    }
+    else if (mqtt->host != NULL && mqtt->client_id != NULL) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, 256 * 1024);
+        int ret = pthread_create(&mqtt->thread, &attr, mqtt_task, mqtt);
+        pthread_attr_destroy(&attr);
+        if (ret == 0) {
+            return mqtt;
+        }
+    }
+
+    if (mqtt->socket >= 0) {
+        close(mqtt->socket);
+    }
+    pthread_mutex_destroy(&mqtt->lock);
+    free(mqtt->host);
+    free(mqtt->client_id);
+    free(mqtt->username);
+    free(mqtt->connect_messages);
+    free(mqtt);
+    return NULL;
+}
+
+void platform_mqtt_stop(platform_mqtt_t *mqtt) {
+    if (mqtt == NULL) {
+        return;
+    }
+    mqtt->stop = true;
+    pthread_mutex_lock(&mqtt->lock);
+    if (mqtt->connected) {
+        uint8_t header[2] = { MQTT_DISCONNECT, 0 };
+        net_write(&mqtt->conn, header, sizeof(header));
+    }
+    net_shutdown(&mqtt->conn);
+    pthread_mutex_unlock(&mqtt->lock);
+    pthread_join(mqtt->thread, NULL);
+
+    if (mqtt->socket >= 0) {
+        close(mqtt->socket);
+    }
+    pthread_mutex_destroy(&mqtt->lock);
+    free(mqtt->host);
+    free(mqtt->client_id);
+    free(mqtt->username);
+    free(mqtt->connect_messages);
+    free(mqtt);
+}
+
+int platform_mqtt_publish(platform_mqtt_t *mqtt, const char *topic, const char *data, int len, int qos, int retain) {
+    if (mqtt == NULL || !mqtt->connected || qos < 0 || qos > 1) {
+        return -1;
+    }
+    if (len == 0) {
+        len = (int)strlen(data);
+    }
+    size_t topic_length = strlen(topic);
+    uint8_t *buffer = malloc(publish_size(topic_length, len));
+    if (buffer == NULL) {
+        return -1;
+    }
+    uint8_t *packet;
+    int msg_id;
+    size_t length = encode_publish(mqtt, buffer, topic, topic_length, data, len, qos, retain, &msg_id, &packet);
+    int ret = send_bytes(mqtt, packet, length);
+    free(buffer);
+    if (ret != 0) {
+        return -1;
+    }
+    platform_linux_stat_add(PLATFORM_LINUX_MQTT_PUBLISHED, 1);
+    return msg_id;
+}
+
+int platform_mqtt_subscribe(platform_mqtt_t *mqtt, const char *topic, int qos) {
+    if (mqtt == NULL || !mqtt->connected) {
+        return -1;
+    }
+    size_t topic_length = strlen(topic);
+    uint8_t *buffer = malloc(5 + 2 + 2 + topic_length + 1);
+    if (buffer == NULL) {
+        return -1;
+    }
+    uint8_t *body = buffer + 5;
+    int msg_id = new_msg_id(mqtt);
+    body[0] = msg_id >> 8;
+    body[1] = msg_id & 0xFF;
+    uint8_t *p = put_string(body + 2, topic, topic_length);
+    *p++ = qos;
+    int ret = send_packet(mqtt, MQTT_SUBSCRIBE, buffer, p - body);
+    free(buffer);
+    return ret == 0 ? msg_id : -1;
+}
@@ -0,0 +1,436 @@
+/**
+ * \file mqtt_router_bench.c
+ * \brief Routing cost per inbound message of the topic trie (mqtt_router.c) against a linear scan of the filters.
+ *
+ * The routes are fleet-style filters, `site/<s>/device/<d>/<leaf>` with `+` and `#` at every level, plus
+ * a few first-level wildcards and `$SYS` filters. Topics are drawn from the same space, so that some match
+ * several routes and some none. It reports, for each number of routes:
+ *   - the time to route a message through the trie and to match it by scanning every filter
+ *   - the heap used by the routes and the compiled trie
+ * and checks that the trie and the scan match the same routes for every topic, that the MQTT wildcard rules
+ * hold (`a/#` matches `a`, first-level wildcards skip `$` topics), that invalid filters are rejected, that
+ * streaming handlers get every fragment as a slice of the event, that reassembling handlers get the whole
+ * message once (without a copy when it came in one piece), that each filter is subscribed to once, and that
+ * dispatching does not allocate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <limits.h>
+#include <malloc.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "mqtt_router.h"
+
+#define MAX_FILTER_LENGTH   (64)
+#define MAX_REFERENCE       (256)
+
+
+static size_t heap_used(void) {
+    return mallinfo2().uordblks;
+}
+
+/* Deterministic generator, the same routes and topics at every run */
+static uint32_t s_seed = 0x2545F491;
+
+static uint32_t next_random(void) {
+    s_seed ^= s_seed << 13;
+    s_seed ^= s_seed >> 17;
+    s_seed ^= s_seed << 5;
+    return s_seed;
+}
+
+static const char *const LEAVES[] = { "cmd", "config", "fwupdate", "telemetry", "state", "reply" };
+#define LEAF_COUNT  (sizeof(LEAVES) / sizeof(LEAVES[0]))
+
+/* Routes for a fleet of `sites` sites of `devices` devices */
+static void make_filter(char *filter, int sites, int devices) {
+    int site = next_random() % sites;
+    int device = next_random() % devices;
+    const char *leaf = LEAVES[next_random() % LEAF_COUNT];
+    switch (next_random() % 16) {
+    case 0:  snprintf(filter, MAX_FILTER_LENGTH, "site/%d/#", site); break;
+    case 1:  snprintf(filter, MAX_FILTER_LENGTH, "site/+/device/%d/%s", device, leaf); break;
+    case 2:  snprintf(filter, MAX_FILTER_LENGTH, "site/%d/device/+/%s", site, leaf); break;
+    case 3:  snprintf(filter, MAX_FILTER_LENGTH, "site/%d/device/%d/#", site, device); break;
+    case 4:  snprintf(filter, MAX_FILTER_LENGTH, "site/%d/+/%d/+", site, device); break;
+    default: snprintf(filter, MAX_FILTER_LENGTH, "site/%d/device/%d/%s", site, device, leaf); break;
+    }
+}
+
+static const char *const FIXED_FILTERS[] = { "+/status", "$SYS/#", "$SYS/+/load", "site/+/device/+/fwupdate", "+/+/+/+/+" };
+
+static void make_topic(char *topic, int sites, int devices) {
+    switch (next_random() % 32) {
+    case 0:  snprintf(topic, MAX_FILTER_LENGTH, "$SYS/broker/load"); break;
+    case 1:  snprintf(topic, MAX_FILTER_LENGTH, "gateway/status"); break;
+    case 2:  snprintf(topic, MAX_FILTER_LENGTH, "site/%u", next_random() % sites); break;
+    case 3:  snprintf(topic, MAX_FILTER_LENGTH, "site/%u/device//cmd", next_random() % sites); break;
+    default:
+        snprintf(topic, MAX_FILTER_LENGTH, "site/%u/device/%u/%s", next_random() % sites, next_random() % devices,
+                 LEAVES[next_random() % LEAF_COUNT]);
+        break;
+    }
+}
+
+/**
+ * Reference matcher: the MQTT rules, filter by filter
+ */
+
+static bool filter_matches(const char *filter, const char *topic, int topic_len) {
+    const char *end = topic + topic_len;
+    if (topic_len > 0 && topic[0] == '$' && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    for (;;) {
+        const char *filter_slash = strchr(filter, '/');
+        size_t filter_level = (filter_slash != NULL) ? (size_t)(filter_slash - filter) : strlen(filter);
+        if (filter_level == 1 && filter[0] == '#') {
+            return true;
+        }
+        if (topic > end) {
+            // The topic ended: "a/#" matches "a"
+            return false;
+        }
+        const char *topic_slash = memchr(topic, '/', end - topic);
+        size_t topic_level = (topic_slash != NULL) ? (size_t)(topic_slash - topic) : (size_t)(end - topic);
+        if (!(filter_level == 1 && filter[0] == '+') &&
+            (filter_level != topic_level || memcmp(filter, topic, topic_level) != 0)) {
+            return false;
+        }
+        topic += topic_level + 1;
+        if (filter_slash == NULL) {
+            return topic > end;
+        }
+        filter = filter_slash + 1;
+    }
+}
+
+static int linear_match(char (*filters)[MAX_FILTER_LENGTH], int count, const char *topic, int topic_len,
+                        uint32_t *routes, int max) {
+    int found = 0;
+    for (int i = 0; i < count; i++) {
+        if (filter_matches(filters[i], topic, topic_len)) {
+            if (found < max) {
+                routes[found] = (uint32_t)i;
+            }
+            found++;
+        }
+    }
+    return found;
+}
+
+/* The MQTT client is not linked: the subscriptions are counted */
+static int s_subscribed = 0;
+
+int platform_mqtt_subscribe(platform_mqtt_t *mqtt, const char *topic, int qos) {
+    return ++s_subscribed;
+}
+
+/**
+ * Handlers
+ */
+
+static uint64_t s_routed = 0;
+
+static void count_handler(void *arg, const mqtt_router_message_t *message) {
+    s_routed += (uint64_t)message->data_len;
+}
+
+/* Checks the slices a streaming handler gets against the message and the events */
+typedef struct {
+    const char *message;
+    int length;
+    const char *topic;
+    /** The data of the event being dispatched */
+    const char *event_data;
+    int calls;
+    int covered;
+    bool ok;
+} stream_check_t;
+
+static void stream_handler(void *arg, const mqtt_router_message_t *message) {
+    stream_check_t *state = arg;
+    state->calls++;
+    state->ok &= (message->data == state->event_data) && (message->offset == state->covered) &&
+                 (message->total_len == state->length) &&
+                 (message->topic_len == (int)strlen(state->topic)) &&
+                 (memcmp(message->topic, state->topic, message->topic_len) == 0) &&
+                 (memcmp(message->data, state->message + message->offset, message->data_len) == 0);
+    state->covered += message->data_len;
+}
+
+typedef struct {
+    const char *message;
+    int length;
+    const char *data;
+    int calls;
+    bool ok;
+} whole_check_t;
+
+static void whole_handler(void *arg, const mqtt_router_message_t *message) {
+    whole_check_t *state = arg;
+    state->calls++;
+    state->data = message->data;
+    state->ok &= (message->offset == 0) && (message->data_len == state->length) && (message->total_len == state->length) &&
+                 (memcmp(message->data, state->message, state->length) == 0);
+}
+
+/* Dispatch a message as esp_mqtt does, in fragments of `fragment` bytes, the topic only in the first one */
+static void dispatch_fragments(mqtt_router_t *router, stream_check_t *stream, const char *topic, const char *data,
+                               int length, int fragment, int stop_after) {
+    for (int offset = 0, count = 0; offset < length && count < stop_after; offset += fragment, count++) {
+        int chunk = (length - offset < fragment) ? length - offset : fragment;
+        // A copy, as the client buffer is reused for each fragment
+        char *event_data = malloc(chunk);
+        memcpy(event_data, data + offset, chunk);
+        platform_mqtt_event_t event = {
+            .id = PLATFORM_MQTT_EVENT_DATA,
+            .topic = (offset == 0) ? topic : NULL,
+            .topic_len = (offset == 0) ? (int)strlen(topic) : 0,
+            .data = event_data,
+            .data_len = chunk,
+            .total_data_len = length,
+            .current_data_offset = offset,
+        };
+        if (stream != NULL) {
+            stream->event_data = event_data;
+        }
+        mqtt_router_dispatch(router, &event);
+        free(event_data);
+    }
+}
+
+static void check_fragments(int fragment) {
+    mqtt_router_t *router = mqtt_router_create(4096);
+    stream_check_t stream = { .ok = true };
+    whole_check_t whole = { .ok = true };
+    bench_check(router != NULL && mqtt_router_add(router, "ota/+/chunk", stream_handler, &stream, 0) == 0 &&
+                mqtt_router_add(router, "ota/#", whole_handler, &whole, MQTT_ROUTER_REASSEMBLE) == 0 &&
+                mqtt_router_compile(router) == 0, "fragment routes added");
+
+    static char message[6000];
+    for (size_t i = 0; i < sizeof(message); i++) {
+        message[i] = (char)next_random();
+    }
+    const char *topic = "ota/device-0001/chunk";
+
+    // Fragmented, within the reassembly buffer
+    stream = (stream_check_t) { .message = message, .length = 3000, .topic = topic, .ok = true };
+    whole = (whole_check_t) { .message = message, .length = 3000, .ok = true };
+    dispatch_fragments(router, &stream, topic, message, 3000, fragment, INT_MAX);
+    bench_check(stream.ok && stream.covered == 3000 && stream.calls == (3000 + fragment - 1) / fragment,
+                "streaming handler gets every fragment as a slice of its event");
+    bench_check(whole.ok && whole.calls == 1, "reassembling handler gets the whole message once");
+
+    // In one piece: no copy
+    stream = (stream_check_t) { .message = message, .length = 200, .topic = topic, .ok = true };
+    whole = (whole_check_t) { .message = message, .length = 200, .ok = true };
+    char single[200];
+    memcpy(single, message, sizeof(single));
+    platform_mqtt_event_t event = {
+        .id = PLATFORM_MQTT_EVENT_DATA, .topic = topic, .topic_len = (int)strlen(topic),
+        .data = single, .data_len = sizeof(single), .total_data_len = sizeof(single),
+    };
+    stream.event_data = single;
+    mqtt_router_dispatch(router, &event);
+    bench_check(stream.ok && stream.calls == 1 && whole.ok && whole.calls == 1 && whole.data == single,
+                "single-fragment message is not copied");
+
+    // Larger than the reassembly buffer: streamed only
+    mqtt_router_stats_t before, after;
+    mqtt_router_get_stats(router, &before);
+    stream = (stream_check_t) { .message = message, .length = 6000, .topic = topic, .ok = true };
+    whole = (whole_check_t) { .message = message, .length = 6000, .ok = true };
+    dispatch_fragments(router, &stream, topic, message, 6000, fragment, INT_MAX);
+    mqtt_router_get_stats(router, &after);
+    bench_check(stream.ok && stream.covered == 6000 && whole.calls == 0 && after.dropped == before.dropped + 1,
+                "oversize message streamed, not reassembled");
+
+    // Interrupted by the next message
+    stream = (stream_check_t) { .message = message, .length = 3000, .topic = topic, .ok = true };
+    whole = (whole_check_t) { .message = message, .length = 3000, .ok = true };
+    dispatch_fragments(router, &stream, topic, message, 3000, fragment, 2);
+    stream = (stream_check_t) { .message = message, .length = 1000, .topic = topic, .ok = true };
+    whole = (whole_check_t) { .message = message, .length = 1000, .ok = true };
+    dispatch_fragments(router, &stream, topic, message, 1000, fragment, INT_MAX);
+    mqtt_router_get_stats(router, &before);
+    bench_check(whole.ok && whole.calls == 1 && before.dropped == after.dropped + 1 && before.reassembled == 2,
+                "incomplete message dropped, the next one reassembled");
+
+    // Unmatched fragments are ignored
+    dispatch_fragments(router, NULL, "other/topic", message, 3000, fragment, INT_MAX);
+    mqtt_router_get_stats(router, &after);
+    bench_check(after.unmatched == before.unmatched + 1 && after.reassembled == before.reassembled,
+                "unmatched fragmented message ignored");
+    mqtt_router_destroy(router);
+}
+
+static void check_rules(void) {
+    mqtt_router_t *router = mqtt_router_create(0);
+    const char *const invalid[] = { "", "a/#/b", "a+", "a/b#", "+a/b" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        bench_check(mqtt_router_add(router, invalid[i], count_handler, NULL, 0) == -1, "invalid filter rejected");
+    }
+    char deep[3 * MQTT_ROUTER_MAX_LEVELS + 1] = "";
+    for (int i = 0; i <= MQTT_ROUTER_MAX_LEVELS; i++) {
+        strcat(deep, (i == 0) ? "a" : "/a");
+    }
+    bench_check(mqtt_router_add(router, deep, count_handler, NULL, 0) == -1, "filter deeper than the limit rejected");
+
+    const char *const filters[] = { "a/#", "#", "+/b", "$SYS/#", "a/+", "a/b", "a/b" };
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+        mqtt_router_add(router, filters[i], count_handler, NULL, 0);
+    }
+    bench_check(mqtt_router_compile(router) == 0, "rule routes compiled");
+    uint32_t routes[8];
+    bench_check(mqtt_router_match(router, "a", 1, routes, 8) == 2 && routes[0] == 0 && routes[1] == 1, "a/# matches a");
+    bench_check(mqtt_router_match(router, "a/b", 3, routes, 8) == 6 && routes[0] == 0 && routes[5] == 6,
+                "duplicate filters both match, in the order they were added");
+    bench_check(mqtt_router_match(router, "$SYS/b", 6, routes, 8) == 1 && routes[0] == 3, "first-level wildcards skip $ topics");
+    bench_check(mqtt_router_match(router, "a/", 2, routes, 8) == 3 && routes[2] == 4, "+ matches an empty level");
+    bench_check(mqtt_router_match(router, "a/b", 3, routes, 2) == 6, "match count past the routes buffer");
+    bench_check(mqtt_router_subscribe(router, NULL, 0) == 0 && s_subscribed == 6, "one subscription per filter");
+    mqtt_router_destroy(router);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s ROUTES      largest number of routes (5000)\n"
+            "  -n MESSAGES    messages routed per measurement (200000)\n"
+            "  -f BYTES       fragment size of the reassembly checks, below 1000 (256)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int max_routes = 5000;
+    int messages = 200000;
+    int fragment = 256;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:f:h")) != -1) {
+        switch (opt) {
+        case 's': max_routes = atoi(optarg); break;
+        case 'n': messages = atoi(optarg); break;
+        case 'f': fragment = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (max_routes < 100 || messages <= 0 || fragment <= 0 || fragment >= 1000) {
+        usage(argv[0]);
+        return 1;
+    }
+    // The rule checks log the invalid filters and the dropped messages
+    setenv("QL_LOG_LEVEL", "0", 0);
+
+    check_rules();
+    check_fragments(fragment);
+
+    char (*filters)[MAX_FILTER_LENGTH] = malloc((size_t)max_routes * MAX_FILTER_LENGTH);
+    enum { TOPIC_COUNT = 4096 };
+    static char topics[TOPIC_COUNT][MAX_FILTER_LENGTH];
+    static int topic_lens[TOPIC_COUNT];
+    if (filters == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    printf("Routing %d messages, fleet-style filters with + and #\n", messages);
+    printf("  %8s %10s %12s %12s %12s %10s\n", "routes", "heap KiB", "dispatch", "trie match", "linear", "matches");
+
+    // One row per power of ten, the last one at the requested number of routes
+    for (int routes = 100; ; routes = (routes * 10 < max_routes) ? routes * 10 : max_routes) {
+        int sites = 1 + routes / 100;
+        int devices = 100;
+        s_seed = 0x2545F491;
+        int fixed = (int)(sizeof(FIXED_FILTERS) / sizeof(FIXED_FILTERS[0]));
+        for (int i = 0; i < routes; i++) {
+            if (i < fixed) {
+                snprintf(filters[i], MAX_FILTER_LENGTH, "%s", FIXED_FILTERS[i]);
+            }
+            else {
+                make_filter(filters[i], sites, devices);
+            }
+        }
+        for (int i = 0; i < TOPIC_COUNT; i++) {
+            make_topic(topics[i], sites, devices);
+            topic_lens[i] = (int)strlen(topics[i]);
+        }
+
+        size_t heap_before = heap_used();
+        mqtt_router_t *router = mqtt_router_create(1024);
+        bool added = (router != NULL);
+        for (int i = 0; i < routes && added; i++) {
+            added = (mqtt_router_add(router, filters[i], count_handler, NULL, 0) == 0);
+        }
+        bench_check(added && mqtt_router_compile(router) == 0, "fleet routes compiled");
+        size_t router_bytes = heap_used() - heap_before;
+
+        // Same match sets as the scan
+        uint32_t trie_routes[MAX_REFERENCE], linear_routes[MAX_REFERENCE];
+        bool same = true;
+        int64_t total_matches = 0;
+        for (int i = 0; i < TOPIC_COUNT; i++) {
+            int trie = mqtt_router_match(router, topics[i], topic_lens[i], trie_routes, MAX_REFERENCE);
+            int linear = linear_match(filters, routes, topics[i], topic_lens[i], linear_routes, MAX_REFERENCE);
+            same &= (trie == linear) && (trie > MAX_REFERENCE ||
+                                         memcmp(trie_routes, linear_routes, trie * sizeof(uint32_t)) == 0);
+            total_matches += linear;
+        }
+        char what[64];
+        snprintf(what, sizeof(what), "trie matches the linear scan with %d routes", routes);
+        bench_check(same, what);
+
+        // Dispatch, as from the MQTT client: streaming handlers, one fragment per message
+        platform_mqtt_event_t event = { .id = PLATFORM_MQTT_EVENT_DATA, .data = "{\"count\":1}", .data_len = 11,
+                                        .total_data_len = 11 };
+        mqtt_router_stats_t before, after;
+        mqtt_router_get_stats(router, &before);
+        size_t heap_dispatch = heap_used();
+        int64_t start = bench_now_ns();
+        for (int i = 0; i < messages; i++) {
+            event.topic = topics[i % TOPIC_COUNT];
+            event.topic_len = topic_lens[i % TOPIC_COUNT];
+            mqtt_router_dispatch(router, &event);
+        }
+        double dispatch_ns = (double)(bench_now_ns() - start) / messages;
+        bench_check(heap_used() == heap_dispatch, "dispatch does not allocate");
+        mqtt_router_get_stats(router, &after);
+        bench_check(after.messages - before.messages == (uint32_t)messages, "every message counted");
+
+        start = bench_now_ns();
+        int64_t sink = 0;
+        for (int i = 0; i < messages; i++) {
+            sink += mqtt_router_match(router, topics[i % TOPIC_COUNT], topic_lens[i % TOPIC_COUNT], trie_routes,
+                                      MQTT_ROUTER_MAX_MATCHES);
+        }
+        double trie_ns = (double)(bench_now_ns() - start) / messages;
+
+        // The scan is slow: fewer messages
+        int linear_messages = (messages / (routes / 100) > 1000) ? messages / (routes / 100) : 1000;
+        start = bench_now_ns();
+        for (int i = 0; i < linear_messages; i++) {
+            sink += linear_match(filters, routes, topics[i % TOPIC_COUNT], topic_lens[i % TOPIC_COUNT], linear_routes,
+                                 MQTT_ROUTER_MAX_MATCHES);
+        }
+        double linear_ns = (double)(bench_now_ns() - start) / linear_messages;
+        if (sink < 0) {
+            printf("unreachable\n");
+        }
+
+        printf("  %8d %10.1f %10.0fns %10.0fns %10.0fns %10.2f\n", routes, router_bytes / 1024.0, dispatch_ns, trie_ns,
+               linear_ns, (double)total_matches / TOPIC_COUNT);
+        if (routes == max_routes) {
+            bench_check(trie_ns * 5 < linear_ns, "trie at least 5x faster than the scan with the most routes");
+        }
+        mqtt_router_destroy(router);
+        if (routes == max_routes) {
+            break;
+        }
+    }
+    free(filters);
+
+    return bench_result();
+}
@@ -0,0 +1,275 @@
+/**
+ * \file net_linux.c
+ * \brief Blocking TCP connections, optionally over TLS (OpenSSL).
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+#include "net_linux.h"
+#include "platform_linux.h"
+
+/** Number of distinct sets of roots that can be cached */
+#define NET_MAX_TLS_CONTEXTS (4)
+
+typedef struct {
+    char *ca_pem;
+    SSL_CTX *ctx;
+} tls_context_entry_t;
+
+static tls_context_entry_t s_contexts[NET_MAX_TLS_CONTEXTS];
+static pthread_mutex_t s_contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static SSL_CTX *tls_context_new(const char *ca_pem) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    BIO *bio = BIO_new_mem_buf(ca_pem, -1);
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    int loaded = 0;
+    X509 *cert;
+    while (bio != NULL && (cert = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL) {
+        if (X509_STORE_add_cert(store, cert) == 1) {
+            loaded++;
+        }
+        X509_free(cert);
+    }
+    ERR_clear_error();
+    BIO_free(bio);
+    if (loaded == 0) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+SSL_CTX *net_tls_context(const char *ca_pem) {
+    SSL_CTX *ctx = NULL;
+    if (ca_pem == NULL || ca_pem[0] == '\0') {
+        return NULL;
+    }
+    pthread_mutex_lock(&s_contexts_lock);
+    for (int i = 0; i < NET_MAX_TLS_CONTEXTS; i++) {
+        if (s_contexts[i].ca_pem == NULL) {
+            s_contexts[i].ctx = tls_context_new(ca_pem);
+            if (s_contexts[i].ctx != NULL) {
+                s_contexts[i].ca_pem = strdup(ca_pem);
+            }
+            ctx = s_contexts[i].ctx;
+            break;
+        }
+        if (strcmp(s_contexts[i].ca_pem, ca_pem) == 0) {
+            ctx = s_contexts[i].ctx;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_contexts_lock);
+    return ctx;
+}
+
+int net_connect(net_conn_t *conn, const char *host, uint16_t port, SSL_CTX *tls, int timeout_ms) {
+    return net_connect_to(conn, NULL, host, port, tls, NULL, timeout_ms);
+}
+
+int net_connect_to(net_conn_t *conn, const char *address, const char *host, uint16_t port, SSL_CTX *tls,
+                   SSL_SESSION *session, int timeout_ms) {
+    int early_status;
+    return net_connect_early(conn, address, host, port, tls, session, NULL, 0, &early_status, timeout_ms);
+}
+
+/* Write the early data with the ClientHello, SSL_connect then completes the handshake */
+static int write_early_data(SSL *ssl, SSL_SESSION *session, const void *early, size_t early_length) {
+    if (early == NULL || early_length == 0 || session == NULL ||
+        SSL_SESSION_get_max_early_data(session) < early_length) {
+        return 0;
+    }
+    const uint8_t *bytes = early;
+    while (early_length > 0) {
+        size_t written = 0;
+        if (SSL_write_early_data(ssl, bytes, early_length, &written) != 1) {
+            return -1;
+        }
+        bytes += written;
+        early_length -= written;
+    }
+    return 0;
+}
+
+int net_connect_early(net_conn_t *conn, const char *address, const char *host, uint16_t port, SSL_CTX *tls,
+                      SSL_SESSION *session, const void *early, size_t early_length, int *early_status, int timeout_ms) {
+    *early_status = SSL_EARLY_DATA_NOT_SENT;
+    conn->fd = -1;
+    conn->ssl = NULL;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints = {
+        .ai_family = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    // The resolver hook stands for the DNS cache lwIP resolves through on the device
+    char resolved[INET_ADDRSTRLEN];
+    uint32_t hooked;
+    if (address == NULL && platform_linux_resolve_hook(host, &hooked, 1) > 0) {
+        address = inet_ntop(AF_INET, &hooked, resolved, sizeof(resolved));
+    }
+    struct addrinfo *addresses = NULL;
+    if (getaddrinfo(address != NULL ? address : host, service, &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int fd = -1;
+    for (struct addrinfo *candidate = addresses; candidate != NULL && fd < 0; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype | SOCK_CLOEXEC, candidate->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        // SO_SNDTIMEO also bounds connect()
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, candidate->ai_addr, candidate->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return -1;
+    }
+    return net_connect_socket(conn, fd, host, tls, session, early, early_length, early_status, timeout_ms);
+}
+
+int net_connect_socket(net_conn_t *conn, int fd, const char *host, SSL_CTX *tls, SSL_SESSION *session,
+                       const void *early, size_t early_length, int *early_status, int timeout_ms) {
+    *early_status = SSL_EARLY_DATA_NOT_SENT;
+    conn->fd = fd;
+    conn->ssl = NULL;
+
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (tls != NULL) {
+        unsigned char ip[sizeof(struct in6_addr)];
+        bool is_ip = inet_pton(AF_INET, host, ip) == 1 || inet_pton(AF_INET6, host, ip) == 1;
+        conn->ssl = SSL_new(tls);
+        if (conn->ssl == NULL ||
+            SSL_set_fd(conn->ssl, conn->fd) != 1 ||
+            (session != NULL && SSL_set_session(conn->ssl, session) != 1) ||
+            (is_ip ? X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(conn->ssl), host) != 1
+                   : (SSL_set_tlsext_host_name(conn->ssl, host) != 1 || SSL_set1_host(conn->ssl, host) != 1)) ||
+            write_early_data(conn->ssl, session, early, early_length) != 0 ||
+            SSL_connect(conn->ssl) != 1) {
+            ERR_clear_error();
+            net_close(conn);
+            return -1;
+        }
+        *early_status = SSL_get_early_data_status(conn->ssl);
+    }
+    return 0;
+}
+
+int net_write(net_conn_t *conn, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    while (length > 0) {
+        int n;
+        if (conn->ssl != NULL) {
+            n = SSL_write(conn->ssl, bytes, (int)length);
+        }
+        else {
+            n = send(conn->fd, bytes, length, MSG_NOSIGNAL);
+        }
+        if (n <= 0) {
+            if (conn->ssl == NULL && n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int net_read(net_conn_t *conn, void *data, size_t length) {
+    if (conn->ssl != NULL) {
+        int n = SSL_read(conn->ssl, data, (int)length);
+        if (n > 0) {
+            return n;
+        }
+        int error = SSL_get_error(conn->ssl, n);
+        ERR_clear_error();
+        if (error == SSL_ERROR_ZERO_RETURN) {
+            return 0;
+        }
+        if (error == SSL_ERROR_WANT_READ || (error == SSL_ERROR_SYSCALL && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+            return NET_TIMEOUT;
+        }
+        return -1;
+    }
+
+    ssize_t n;
+    do {
+        n = recv(conn->fd, data, length, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? NET_TIMEOUT : -1;
+    }
+    return (int)n;
+}
+
+int net_wait_readable(net_conn_t *conn, int timeout_ms) {
+    if (conn->ssl != NULL && SSL_pending(conn->ssl) > 0) {
+        return 1;
+    }
+    struct pollfd pfd = {
+        .fd = conn->fd,
+        .events = POLLIN,
+    };
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -1 : (ret > 0 ? 1 : 0);
+}
+
+void net_shutdown(net_conn_t *conn) {
+    if (conn->fd >= 0) {
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+}
+
+void net_close(net_conn_t *conn) {
+    if (conn->ssl != NULL) {
+        SSL_free(conn->ssl);
+        conn->ssl = NULL;
+    }
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * \file net_linux.h
+ * \brief Blocking TCP connections, optionally over TLS (OpenSSL), for the Linux backends.
+ */
+#ifndef _NET_LINUX_H_
+#define _NET_LINUX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <openssl/ssl.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** \ref net_read timed out before any byte was received */
+#define NET_TIMEOUT (-2)
+
+typedef struct {
+    int fd;
+    /** NULL for plain TCP */
+    SSL *ssl;
+} net_conn_t;
+
+/**
+ * \brief Get a client TLS context trusting the given roots. Contexts are shared between
+ * the connections using the same roots and are never freed.
+ * \param[in] ca_pem the trusted roots, in PEM format
+ * \return the context, NULL for failure
+ */
+SSL_CTX *net_tls_context(const char *ca_pem);
+
+/**
+ * \brief Open a connection.
+ * \param[out] conn       the connection
+ * \param[in]  host       the host name or address
+ * \param[in]  port       the port
+ * \param[in]  tls        the TLS context from \ref net_tls_context, NULL for plain TCP
+ * \param[in]  timeout_ms the connection and read timeout
+ * \return 0 for success, -1 for failure
+ */
+int net_connect(net_conn_t *conn, const char *host, uint16_t port, SSL_CTX *tls, int timeout_ms);
+
+/**
+ * \brief Open a connection to an address resolved beforehand, optionally resuming a TLS session.
+ * \param[in] address the address to connect to, NULL to resolve \p host
+ * \param[in] host    the host name, the TLS server name
+ * \param[in] session the TLS session to resume, NULL for a full handshake
+ * \see net_connect for the other parameters
+ */
+int net_connect_to(net_conn_t *conn, const char *address, const char *host, uint16_t port, SSL_CTX *tls,
+                   SSL_SESSION *session, int timeout_ms);
+
+/**
+ * \brief Open a connection resuming a TLS 1.3 session, and send \p early as early data in the first flight when the
+ * session allows that much. The caller writes the data again unless the server accepted it.
+ * \param[in]  early        the data to send before the handshake completes, NULL for none
+ * \param[in]  early_length its length
+ * \param[out] early_status SSL_EARLY_DATA_NOT_SENT, SSL_EARLY_DATA_REJECTED or SSL_EARLY_DATA_ACCEPTED
+ * \see net_connect_to for the other parameters
+ */
+int net_connect_early(net_conn_t *conn, const char *address, const char *host, uint16_t port, SSL_CTX *tls,
+                      SSL_SESSION *session, const void *early, size_t early_length, int *early_status, int timeout_ms);
+
+/**
+ * \brief Take over a blocking TCP connection established beforehand, e.g. by broker_race_connect, and start TLS on it
+ * as \ref net_connect_early does.
+ * \param[in] fd the connection, owned by \p conn: closed on failure
+ * \see net_connect_early for the other parameters
+ */
+int net_connect_socket(net_conn_t *conn, int fd, const char *host, SSL_CTX *tls, SSL_SESSION *session,
+                       const void *early, size_t early_length, int *early_status, int timeout_ms);
+
+/**
+ * \brief Write the whole buffer.
+ * \return 0 for success, -1 for failure
+ */
+int net_write(net_conn_t *conn, const void *data, size_t length);
+
+/**
+ * \brief Read up to \p length bytes.
+ * \return the number of bytes read, 0 if the peer closed the connection, NET_TIMEOUT or -1 for failure
+ */
+int net_read(net_conn_t *conn, void *data, size_t length);
+
+/**
+ * \brief Wait until data can be read.
+ * \return 1 when readable, 0 for timeout, -1 for failure
+ */
+int net_wait_readable(net_conn_t *conn, int timeout_ms);
+
+/**
+ * \brief Unblock the threads waiting on the connection, it must still be closed with \ref net_close.
+ */
+void net_shutdown(net_conn_t *conn);
+
+void net_close(net_conn_t *conn);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _NET_LINUX_H_
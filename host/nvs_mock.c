@@ -0,0 +1,536 @@
+/**
+ * \file nvs_mock.c
+ * \brief Host implementation of the ESP-IDF NVS API, see nvs_mock.h.
+ *
+ * Only blobs are implemented, which is what the shared sources store.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "esp_log.h"
+
+#include "nvs_mock.h"
+#include "platform_linux.h"
+
+#define NVS_MOCK_ENTRY_SIZE         32
+#define NVS_MOCK_ENTRIES_PER_PAGE   126
+/** Largest blob: the chunks of ESP-IDF are limited to the pages left once the spare one is kept */
+#define NVS_MOCK_MAX_BLOB_SIZE      ((NVS_MOCK_PAGES - 2) * (NVS_MOCK_ENTRIES_PER_PAGE - 1) * NVS_MOCK_ENTRY_SIZE)
+/** Name of the partition of the threads not bound to a device */
+#define NVS_MOCK_DEFAULT_PARTITION  "nvs"
+
+static const char *TAG = "nvs_mock";
+
+typedef enum {
+    PAGE_FREE,
+    PAGE_ACTIVE,
+    PAGE_FULL,
+} page_state_t;
+
+typedef struct {
+    page_state_t state;
+    uint16_t used;      /*!< entries written since the page was erased */
+    uint16_t erased;    /*!< entries of values overwritten or erased since */
+} page_t;
+
+/** Consecutive entries of a value on a page: a chunk header and its data, or the blob index */
+typedef struct {
+    int page;
+    uint16_t entries;
+} span_t;
+
+typedef struct item {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t *data;
+    size_t length;
+    span_t *spans;
+    int span_count;
+    struct item *next;
+} item_t;
+
+typedef struct partition {
+    char name[64];
+    page_t pages[NVS_MOCK_PAGES];
+    int active;
+    item_t *items;
+    nvs_mock_stats_t stats;
+    bool loading;
+    struct partition *next;
+} partition_t;
+
+typedef struct {
+    partition_t *partition;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    bool writable;
+    bool open;
+} handle_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static partition_t *s_partitions = NULL;
+static handle_t *s_handles = NULL;
+static size_t s_handle_count = 0;
+static char s_dir[256] = "";
+static int s_fail_after = -1;
+
+/**
+ * Flash layout
+ */
+
+static uint32_t item_entries(const item_t *item) {
+    uint32_t entries = 0;
+    for (int i = 0; i < item->span_count; i++) {
+        entries += item->spans[i].entries;
+    }
+    return entries;
+}
+
+static int add_span(item_t *item, int page, uint16_t entries) {
+    span_t *spans = realloc(item->spans, (item->span_count + 1) * sizeof(span_t));
+    if (spans == NULL) {
+        return -1;
+    }
+    item->spans = spans;
+    item->spans[item->span_count++] = (span_t){ .page = page, .entries = entries };
+    return 0;
+}
+
+/* Copy the live entries of the fullest page of erased entries to the spare page, then erase it */
+static int collect_garbage(partition_t *part) {
+    int spare = -1;
+    int victim = -1;
+    for (int p = 0; p < NVS_MOCK_PAGES; p++) {
+        if (part->pages[p].state == PAGE_FREE && spare < 0) {
+            spare = p;
+        }
+        else if (part->pages[p].state == PAGE_FULL && part->pages[p].erased > 0 &&
+                 (victim < 0 || part->pages[p].erased > part->pages[victim].erased)) {
+            victim = p;
+        }
+    }
+    if (spare < 0 || victim < 0) {
+        return -1;
+    }
+    part->pages[spare].state = PAGE_ACTIVE;
+    for (item_t *item = part->items; item != NULL; item = item->next) {
+        for (int i = 0; i < item->span_count; i++) {
+            if (item->spans[i].page == victim) {
+                item->spans[i].page = spare;
+                part->pages[spare].used += item->spans[i].entries;
+                part->stats.bytes_written += item->spans[i].entries * NVS_MOCK_ENTRY_SIZE;
+            }
+        }
+    }
+    part->pages[victim] = (page_t){ .state = PAGE_FREE };
+    part->stats.page_erases++;
+    part->active = spare;
+    return 0;
+}
+
+/* Page with at least `entries` free entries, moving to the next page or collecting garbage when needed */
+static int page_with_room(partition_t *part, uint16_t entries) {
+    while (1) {
+        if (part->active >= 0 && NVS_MOCK_ENTRIES_PER_PAGE - part->pages[part->active].used >= entries) {
+            return part->active;
+        }
+        if (part->active >= 0) {
+            part->pages[part->active].state = PAGE_FULL;
+            part->active = -1;
+        }
+        int free_page = -1;
+        int free_count = 0;
+        for (int p = 0; p < NVS_MOCK_PAGES; p++) {
+            if (part->pages[p].state == PAGE_FREE) {
+                free_page = free_page < 0 ? p : free_page;
+                free_count++;
+            }
+        }
+        // One page stays free for the garbage collection
+        if (free_count > 1) {
+            part->pages[free_page].state = PAGE_ACTIVE;
+            part->active = free_page;
+        }
+        else if (collect_garbage(part) != 0) {
+            return -1;
+        }
+    }
+}
+
+static void release_spans(partition_t *part, item_t *item) {
+    for (int i = 0; i < item->span_count; i++) {
+        part->pages[item->spans[i].page].erased += item->spans[i].entries;
+    }
+}
+
+static item_t *item_find(partition_t *part, const char *ns, const char *key) {
+    for (item_t *item = part->items; item != NULL; item = item->next) {
+        if (strcmp(item->ns, ns) == 0 && strcmp(item->key, key) == 0) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void item_remove(partition_t *part, item_t *item) {
+    release_spans(part, item);
+    for (item_t **link = &part->items; *link != NULL; link = &(*link)->next) {
+        if (*link == item) {
+            *link = item->next;
+            break;
+        }
+    }
+    free(item->data);
+    free(item->spans);
+    free(item);
+}
+
+static void save_partition(partition_t *part);
+
+static esp_err_t item_write(partition_t *part, const char *ns, const char *key, const void *value, size_t length) {
+    item_t *old = item_find(part, ns, key);
+    if (old != NULL && old->length == length) {
+        // The stored value is compared before writing
+        part->stats.bytes_read += item_entries(old) * NVS_MOCK_ENTRY_SIZE;
+        if (memcmp(old->data, value, length) == 0) {
+            return ESP_OK;
+        }
+    }
+    if (!part->loading && s_fail_after >= 0) {
+        if (s_fail_after == 0) {
+            return ESP_FAIL;
+        }
+        s_fail_after--;
+    }
+
+    item_t *item = calloc(1, sizeof(item_t));
+    if (item == NULL || (item->data = malloc(length > 0 ? length : 1)) == NULL) {
+        free(item);
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(item->ns, sizeof(item->ns), "%s", ns);
+    snprintf(item->key, sizeof(item->key), "%s", key);
+    memcpy(item->data, value, length);
+    item->length = length;
+    // Listed first, so that the garbage collection moves the chunks already written
+    item->next = part->items;
+    part->items = item;
+
+    size_t remaining = length;
+    esp_err_t ret = ESP_OK;
+    do {
+        int page = page_with_room(part, remaining > 0 ? 2 : 1);
+        if (page < 0) {
+            ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+            break;
+        }
+        uint16_t room = NVS_MOCK_ENTRIES_PER_PAGE - part->pages[page].used - 1;
+        size_t data_entries = (remaining + NVS_MOCK_ENTRY_SIZE - 1) / NVS_MOCK_ENTRY_SIZE;
+        data_entries = data_entries < room ? data_entries : room;
+        size_t chunk = data_entries * NVS_MOCK_ENTRY_SIZE;
+        if (add_span(item, page, 1 + data_entries) != 0) {
+            ret = ESP_ERR_NO_MEM;
+            break;
+        }
+        part->pages[page].used += 1 + data_entries;
+        part->stats.bytes_written += (1 + data_entries) * NVS_MOCK_ENTRY_SIZE;
+        remaining -= chunk < remaining ? chunk : remaining;
+    } while (remaining > 0);
+    if (ret == ESP_OK) {
+        int page = page_with_room(part, 1);
+        if (page < 0) {
+            ret = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        else if (add_span(item, page, 1) != 0) {
+            ret = ESP_ERR_NO_MEM;
+        }
+        else {
+            part->pages[page].used += 1;
+            part->stats.bytes_written += NVS_MOCK_ENTRY_SIZE;
+        }
+    }
+    if (ret != ESP_OK) {
+        item_remove(part, item);
+        return ret;
+    }
+    if (old != NULL) {
+        item_remove(part, old);
+    }
+    part->stats.writes++;
+    save_partition(part);
+    return ESP_OK;
+}
+
+/**
+ * Partitions
+ */
+
+static void save_partition(partition_t *part) {
+    if (s_dir[0] == '\0' || part->loading) {
+        return;
+    }
+    char path[512];
+    char temp_path[520];
+    snprintf(path, sizeof(path), "%s/%s.nvs", s_dir, part->name);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        ESP_LOGW(TAG, "Cannot save %s", path);
+        return;
+    }
+    bool ok = true;
+    for (item_t *item = part->items; item != NULL && ok; item = item->next) {
+        uint32_t length = item->length;
+        ok = fwrite(item->ns, sizeof(item->ns), 1, file) == 1 && fwrite(item->key, sizeof(item->key), 1, file) == 1 &&
+             fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(item->data, 1, length, file) == length;
+    }
+    if (fclose(file) != 0 || !ok || rename(temp_path, path) != 0) {
+        ESP_LOGW(TAG, "Cannot save %s", path);
+    }
+}
+
+static void load_partition(partition_t *part) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s.nvs", s_dir, part->name);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return;
+    }
+    part->loading = true;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t length;
+    while (fread(ns, sizeof(ns), 1, file) == 1 && fread(key, sizeof(key), 1, file) == 1 &&
+           fread(&length, sizeof(length), 1, file) == 1 && length <= NVS_MOCK_MAX_BLOB_SIZE) {
+        uint8_t *data = malloc(length > 0 ? length : 1);
+        if (data == NULL || fread(data, 1, length, file) != length) {
+            free(data);
+            break;
+        }
+        ns[sizeof(ns) - 1] = '\0';
+        key[sizeof(key) - 1] = '\0';
+        item_write(part, ns, key, data, length);
+        free(data);
+    }
+    fclose(file);
+    part->loading = false;
+    memset(&part->stats, 0, sizeof(part->stats));
+}
+
+static partition_t *partition_find(const char *name, bool create) {
+    for (partition_t *part = s_partitions; part != NULL; part = part->next) {
+        if (strcmp(part->name, name) == 0) {
+            return part;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    partition_t *part = calloc(1, sizeof(partition_t));
+    if (part == NULL) {
+        return NULL;
+    }
+    snprintf(part->name, sizeof(part->name), "%s", name);
+    part->active = -1;
+    part->next = s_partitions;
+    s_partitions = part;
+    if (s_dir[0] != '\0') {
+        load_partition(part);
+    }
+    return part;
+}
+
+static handle_t *handle_get(nvs_handle_t handle) {
+    if (handle == 0 || handle > s_handle_count || !s_handles[handle - 1].open) {
+        return NULL;
+    }
+    return &s_handles[handle - 1];
+}
+
+/**
+ * nvs_mock.h API
+ */
+
+void nvs_mock_get_stats(const char *device_id, nvs_mock_stats_t *stats) {
+    pthread_mutex_lock(&s_lock);
+    partition_t *part = partition_find(device_id != NULL ? device_id : NVS_MOCK_DEFAULT_PARTITION, false);
+    memset(stats, 0, sizeof(nvs_mock_stats_t));
+    if (part != NULL) {
+        *stats = part->stats;
+        for (item_t *item = part->items; item != NULL; item = item->next) {
+            stats->entries_used += item_entries(item);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void nvs_mock_reset(void) {
+    pthread_mutex_lock(&s_lock);
+    while (s_partitions != NULL) {
+        partition_t *part = s_partitions;
+        s_partitions = part->next;
+        while (part->items != NULL) {
+            item_remove(part, part->items);
+        }
+        free(part);
+    }
+    for (size_t i = 0; i < s_handle_count; i++) {
+        s_handles[i].open = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void nvs_mock_set_dir(const char *dir) {
+    pthread_mutex_lock(&s_lock);
+    snprintf(s_dir, sizeof(s_dir), "%s", dir != NULL ? dir : "");
+    pthread_mutex_unlock(&s_lock);
+}
+
+void nvs_mock_fail_after(int writes) {
+    pthread_mutex_lock(&s_lock);
+    s_fail_after = writes;
+    pthread_mutex_unlock(&s_lock);
+}
+
+/**
+ * nvs.h API
+ */
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (namespace_name == NULL || out_handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(namespace_name) == 0 || strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    const char *device_id = platform_linux_device_id();
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    partition_t *part = partition_find(device_id != NULL ? device_id : NVS_MOCK_DEFAULT_PARTITION, true);
+    size_t index = 0;
+    while (index < s_handle_count && s_handles[index].open) {
+        index++;
+    }
+    if (part == NULL) {
+        ret = ESP_ERR_NO_MEM;
+    }
+    else if (index == s_handle_count) {
+        handle_t *handles = realloc(s_handles, (s_handle_count + 16) * sizeof(handle_t));
+        if (handles == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        }
+        else {
+            memset(handles + s_handle_count, 0, 16 * sizeof(handle_t));
+            s_handles = handles;
+            s_handle_count += 16;
+        }
+    }
+    if (ret == ESP_OK) {
+        handle_t *handle = &s_handles[index];
+        handle->partition = part;
+        snprintf(handle->ns, sizeof(handle->ns), "%s", namespace_name);
+        handle->writable = open_mode == NVS_READWRITE;
+        handle->open = true;
+        *out_handle = index + 1;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    if (key == NULL || length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    handle_t *h = handle_get(handle);
+    item_t *item = h != NULL ? item_find(h->partition, h->ns, key) : NULL;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (item == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (out_value != NULL && *length < item->length) {
+        ret = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else if (out_value != NULL) {
+        memcpy(out_value, item->data, item->length);
+        h->partition->stats.reads++;
+        h->partition->stats.bytes_read += item_entries(item) * NVS_MOCK_ENTRY_SIZE;
+    }
+    if (item != NULL) {
+        *length = item->length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (key == NULL || (value == NULL && length > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (length > NVS_MOCK_MAX_BLOB_SIZE) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    esp_err_t ret;
+    pthread_mutex_lock(&s_lock);
+    handle_t *h = handle_get(handle);
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    }
+    else {
+        ret = item_write(h->partition, h->ns, key, value, length);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    if (key == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    handle_t *h = handle_get(handle);
+    item_t *item = h != NULL ? item_find(h->partition, h->ns, key) : NULL;
+    if (h == NULL) {
+        ret = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable) {
+        ret = ESP_ERR_NVS_READ_ONLY;
+    }
+    else if (item == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else {
+        item_remove(h->partition, item);
+        save_partition(h->partition);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    // Values are written to the flash by nvs_set_blob, as on ESP-IDF
+    pthread_mutex_lock(&s_lock);
+    esp_err_t ret = handle_get(handle) != NULL ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_lock);
+    handle_t *h = handle_get(handle);
+    if (h != NULL) {
+        h->open = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,77 @@
+/**
+ * \file nvs_mock.h
+ * \brief Host implementation of the ESP-IDF NVS API (nvs.h), with a model of the flash underneath.
+ *
+ * Each simulated device (see platform_linux_bind_device) has its own partition of NVS_MOCK_PAGES pages,
+ * laid out as ESP-IDF NVS does: 4KB pages of 126 entries of 32 bytes, written in sequence. A blob takes
+ * one header entry per chunk, its data rounded up to entries and one index entry; blobs larger than the free
+ * space of a page are split in chunks over several pages. Overwriting a key appends the new value and
+ * erases the old one, and writing the value already stored writes nothing, as ESP-IDF. When only the
+ * spare page is left, the full page with the most erased entries is garbage collected: its live entries
+ * are copied to the spare page, which costs flash writes, and the page is erased.
+ *
+ * The statistics count the flash bytes read and written by these operations, so that the benches
+ * can compare storage layouts. Optionally, the partitions are saved in a directory, to survive the process.
+ */
+#ifndef _NVS_MOCK_H_
+#define _NVS_MOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Pages of a partition: the 32K "nvs" partition of the partition tables */
+#define NVS_MOCK_PAGES 8
+
+/**
+ * \brief Partition statistics
+ */
+typedef struct {
+    /** Number of values read */
+    uint32_t reads;
+    /** Number of values written, not counting the writes of an unchanged value */
+    uint32_t writes;
+    /** Flash bytes read, including the comparisons of an unchanged value */
+    uint64_t bytes_read;
+    /** Flash bytes written, including the entries copied by the garbage collection */
+    uint64_t bytes_written;
+    /** Number of pages erased by the garbage collection */
+    uint32_t page_erases;
+    /** Entries holding live values */
+    uint32_t entries_used;
+} nvs_mock_stats_t;
+
+/**
+ * \brief Get a snapshot of the statistics of a partition.
+ * \param[in] device_id the device the partition belongs to, NULL for the threads not bound to a device
+ */
+void nvs_mock_get_stats(const char *device_id, nvs_mock_stats_t *stats);
+
+/**
+ * \brief Erase every partition, as a fresh flash.
+ */
+void nvs_mock_reset(void);
+
+/**
+ * \brief Save the partitions in \p dir, one file per device, and load them from there when first opened.
+ * The flash layout is not saved: a loaded partition starts compacted.
+ * \param[in] dir the directory, NULL to keep the partitions in memory only
+ */
+void nvs_mock_set_dir(const char *dir);
+
+/**
+ * \brief Simulate a power loss: the writes after the next \p writes ones fail, until the next call.
+ * \param[in] writes the number of writes that still succeed, -1 for no failure
+ */
+void nvs_mock_fail_after(int writes);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _NVS_MOCK_H_
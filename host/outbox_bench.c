@@ -0,0 +1,512 @@
+/**
+ * \file outbox_bench.c
+ * \brief Sustained QoS 1 publish throughput of the outbox (mqtt_outbox.c) for different in-flight windows.
+ *
+ * The bench runs an MQTT broker on 127.0.0.1 that acknowledges each PUBLISH after a fixed latency, as a broker
+ * one round trip away does, and publishes through the Linux MQTT client (mqtt_linux.c) as fast as the outbox
+ * lets the producer. It reports, for each window:
+ *   - the messages acknowledged per second
+ *   - the peak of messages in flight, as the broker sees them and as the outbox counts them
+ *   - the outbox memory: its buffer, the peak in use and the publishes that had to wait for room
+ * with a QoS 0 burst as the reference. It checks that every message reaches the broker, that the broker never
+ * has more messages unacknowledged than the window, that the outbox stays within its buffer, that a larger
+ * window raises the throughput, that the messages in flight when the broker drops the connection are sent again
+ * after the reconnection, and that a full outbox refuses a publish that cannot wait.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "mqtt_outbox.h"
+#include "platform.h"
+#include "platform_linux.h"
+
+#define TOPIC           "bench/outbox"
+#define PAYLOAD_LENGTH  (64)
+#define MAX_MESSAGES    (100000)
+/** Most PUBACKs the broker holds back at once */
+#define MAX_PENDING_ACKS (1024)
+
+typedef struct {
+    int listen_fd;
+    uint16_t port;
+    uint32_t latency_ms;
+    /** Close the connection after this many publishes, once, 0 never */
+    atomic_int drop_after;
+    atomic_int connections;
+    atomic_int publishes;
+    atomic_int unacked;
+    atomic_int peak_unacked;
+    /** Times each message was received, by sequence number */
+    atomic_uchar seen[MAX_MESSAGES];
+} broker_t;
+
+/* A connection and its PUBACKs waiting for the latency */
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool closed;
+    struct {
+        int64_t due_us;
+        uint16_t msg_id;
+    } acks[MAX_PENDING_ACKS];
+    size_t head;
+    size_t count;
+} connection_t;
+
+static broker_t s_broker;
+
+/**
+ * MQTT broker
+ */
+
+static int read_exact(int fd, uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(fd, data, length);
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/* Send the PUBACKs once their latency elapsed */
+static void *broker_acks(void *arg) {
+    connection_t *conn = arg;
+    pthread_mutex_lock(&conn->lock);
+    while (!conn->closed) {
+        if (conn->count == 0) {
+            pthread_cond_wait(&conn->changed, &conn->lock);
+            continue;
+        }
+        int64_t wait_us = conn->acks[conn->head].due_us - platform_now_us();
+        if (wait_us > 0) {
+            pthread_mutex_unlock(&conn->lock);
+            usleep(wait_us);
+            pthread_mutex_lock(&conn->lock);
+            continue;
+        }
+        uint16_t msg_id = conn->acks[conn->head].msg_id;
+        conn->head = (conn->head + 1) % MAX_PENDING_ACKS;
+        conn->count--;
+        uint8_t reply[4] = { 0x40, 2, msg_id >> 8, msg_id & 0xFF };
+        // Before the write: the client may send the next message as soon as it gets the PUBACK
+        atomic_fetch_sub(&s_broker.unacked, 1);
+        if (write(conn->fd, reply, sizeof(reply)) != sizeof(reply)) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return NULL;
+}
+
+static void *broker_connection(void *arg) {
+    connection_t *conn = calloc(1, sizeof(connection_t));
+    conn->fd = (int)(intptr_t)arg;
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_cond_init(&conn->changed, NULL);
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    atomic_fetch_add(&s_broker.connections, 1);
+    pthread_t ack_thread;
+    pthread_create(&ack_thread, NULL, broker_acks, conn);
+    int received = 0;
+
+    while (1) {
+        uint8_t type;
+        if (read_exact(conn->fd, &type, 1) != 0) {
+            break;
+        }
+        size_t length = 0;
+        for (int shift = 0; shift < 28; shift += 7) {
+            uint8_t byte;
+            if (read_exact(conn->fd, &byte, 1) != 0) {
+                goto done;
+            }
+            length |= (size_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+        }
+        uint8_t *body = malloc(length + 1);
+        if (body == NULL || read_exact(conn->fd, body, length) != 0) {
+            free(body);
+            break;
+        }
+        uint8_t reply[4] = { 0 };
+        switch (type & 0xF0) {
+        case 0x10:  // CONNECT: CONNACK
+            reply[0] = 0x20;
+            reply[1] = 2;
+            pthread_mutex_lock(&conn->lock);
+            write(conn->fd, reply, 4);
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        case 0x30: {  // PUBLISH: sequence number in the payload, PUBACK after the latency for QoS 1
+            size_t topic_length = length >= 2 ? (size_t)((body[0] << 8) | body[1]) : length;
+            int qos = (type >> 1) & 3;
+            size_t offset = 2 + topic_length + (qos > 0 ? 2 : 0);
+            if (offset + 8 > length) {
+                break;
+            }
+            body[length] = '\0';
+            int seq = atoi((const char *)body + offset);
+            if (seq >= 0 && seq < MAX_MESSAGES) {
+                atomic_fetch_add(&s_broker.seen[seq], 1);
+            }
+            atomic_fetch_add(&s_broker.publishes, 1);
+            received++;
+            int drop_after = atomic_load(&s_broker.drop_after);
+            if (drop_after > 0 && received >= drop_after &&
+                atomic_compare_exchange_strong(&s_broker.drop_after, &drop_after, 0)) {
+                // The messages waiting for their PUBACK are lost with the connection
+                free(body);
+                goto done;
+            }
+            if (qos == 1) {
+                int unacked = atomic_fetch_add(&s_broker.unacked, 1) + 1;
+                int peak = atomic_load(&s_broker.peak_unacked);
+                while (unacked > peak && !atomic_compare_exchange_weak(&s_broker.peak_unacked, &peak, unacked)) {
+                }
+                pthread_mutex_lock(&conn->lock);
+                if (conn->count < MAX_PENDING_ACKS) {
+                    size_t tail = (conn->head + conn->count) % MAX_PENDING_ACKS;
+                    conn->acks[tail].due_us = platform_now_us() + s_broker.latency_ms * 1000LL;
+                    conn->acks[tail].msg_id = (uint16_t)((body[2 + topic_length] << 8) | body[2 + topic_length + 1]);
+                    conn->count++;
+                    pthread_cond_signal(&conn->changed);
+                }
+                pthread_mutex_unlock(&conn->lock);
+            }
+            break;
+        }
+        case 0xC0:  // PINGREQ
+            reply[0] = 0xD0;
+            pthread_mutex_lock(&conn->lock);
+            write(conn->fd, reply, 2);
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        case 0xE0:  // DISCONNECT
+            free(body);
+            goto done;
+        default:
+            break;
+        }
+        free(body);
+    }
+done:
+    pthread_mutex_lock(&conn->lock);
+    conn->closed = true;
+    // The PUBACKs not sent are lost
+    atomic_fetch_sub(&s_broker.unacked, (int)conn->count);
+    shutdown(conn->fd, SHUT_RDWR);
+    pthread_cond_signal(&conn->changed);
+    pthread_mutex_unlock(&conn->lock);
+    pthread_join(ack_thread, NULL);
+    close(conn->fd);
+    pthread_mutex_destroy(&conn->lock);
+    pthread_cond_destroy(&conn->changed);
+    free(conn);
+    return NULL;
+}
+
+static void *broker_accept(void *arg) {
+    while (1) {
+        int fd = accept(s_broker.listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, broker_connection, (void *)(intptr_t)fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+static int broker_start(void) {
+    s_broker.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t address_length = sizeof(address);
+    if (bind(s_broker.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(s_broker.listen_fd, 16) != 0 ||
+        getsockname(s_broker.listen_fd, (struct sockaddr *)&address, &address_length) != 0) {
+        return -1;
+    }
+    s_broker.port = ntohs(address.sin_port);
+    pthread_t thread;
+    return pthread_create(&thread, NULL, broker_accept, NULL) == 0 ? 0 : -1;
+}
+
+static void broker_reset(void) {
+    for (int i = 0; i < MAX_MESSAGES; i++) {
+        atomic_store(&s_broker.seen[i], 0);
+    }
+    atomic_store(&s_broker.publishes, 0);
+    atomic_store(&s_broker.peak_unacked, 0);
+}
+
+/* Messages received at least once, among the first `count` */
+static int broker_delivered(int count) {
+    int delivered = 0;
+    for (int i = 0; i < count; i++) {
+        delivered += atomic_load(&s_broker.seen[i]) > 0;
+    }
+    return delivered;
+}
+
+/**
+ * Client
+ */
+
+typedef struct {
+    platform_mqtt_t *mqtt;
+    mqtt_outbox_t *outbox;
+    platform_queue_t *connected;
+} client_t;
+
+static void on_event(void *arg, const platform_mqtt_event_t *event) {
+    client_t *client = arg;
+    if (client->outbox != NULL) {
+        mqtt_outbox_handle_event(client->outbox, event);
+    }
+    if (event->id == PLATFORM_MQTT_EVENT_CONNECTED) {
+        int connected = 1;
+        platform_queue_send(client->connected, &connected);
+    }
+}
+
+/* Connect, through an outbox if `config` is set */
+static int client_start(client_t *client, const mqtt_outbox_config_t *config) {
+    static quarklink_context_t quarklink;
+    memset(&quarklink, 0, sizeof(quarklink));
+    strcpy(quarklink.deviceID, "outbox-bench");
+    strcpy(quarklink.iotHubEndpoint, "127.0.0.1");
+    quarklink.iotHubPort = s_broker.port;
+
+    memset(client, 0, sizeof(client_t));
+    client->connected = platform_queue_create(4, sizeof(int));
+    if (config != NULL && (client->outbox = mqtt_outbox_create(config)) == NULL) {
+        return -1;
+    }
+    platform_mqtt_config_t mqtt_cfg = {
+        .quarklink = &quarklink,
+        .socket = -1,
+        .event_cb = on_event,
+        .event_arg = client,
+    };
+    client->mqtt = platform_mqtt_start(&mqtt_cfg);
+    if (client->mqtt == NULL) {
+        return -1;
+    }
+    if (client->outbox != NULL) {
+        mqtt_outbox_attach(client->outbox, client->mqtt);
+    }
+    int connected;
+    return platform_queue_receive(client->connected, &connected, 5000);
+}
+
+static void client_stop(client_t *client) {
+    platform_mqtt_stop(client->mqtt);
+    mqtt_outbox_destroy(client->outbox);
+    platform_queue_delete(client->connected);
+}
+
+static void make_payload(char *payload, int seq) {
+    memset(payload, 'x', PAYLOAD_LENGTH);
+    char number[16];
+    int length = snprintf(number, sizeof(number), "%08d", seq);
+    memcpy(payload, number, length);
+}
+
+typedef struct {
+    double rate;
+    int delivered;
+    int broker_peak;
+    mqtt_outbox_stats_t stats;
+} result_t;
+
+/* Publish `count` messages through an outbox, as fast as it accepts them, until all are acknowledged */
+static void run_window(uint16_t window, size_t capacity, int count, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    broker_reset();
+    client_t client;
+    mqtt_outbox_config_t config = { .window = window, .capacity = capacity };
+    if (client_start(&client, &config) != 0) {
+        bench_check(false, "client connected");
+        client_stop(&client);
+        return;
+    }
+    char payload[PAYLOAD_LENGTH];
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < count; i++) {
+        make_payload(payload, i);
+        if (mqtt_outbox_publish(client.outbox, TOPIC, payload, PAYLOAD_LENGTH, PLATFORM_WAIT_FOREVER) != 0) {
+            bench_check(false, "publish waits for room");
+            break;
+        }
+    }
+    bench_check(mqtt_outbox_flush(client.outbox, 60000) == 0, "outbox flushed");
+    result->rate = count / ((bench_now_ns() - start) / 1e9);
+    mqtt_outbox_get_stats(client.outbox, &result->stats);
+    result->delivered = broker_delivered(count);
+    result->broker_peak = atomic_load(&s_broker.peak_unacked);
+    client_stop(&client);
+}
+
+/* QoS 0 reference: no acknowledgement, no flow control */
+static double run_qos0(int count, int *delivered) {
+    broker_reset();
+    client_t client;
+    *delivered = 0;
+    if (client_start(&client, NULL) != 0) {
+        bench_check(false, "client connected");
+        client_stop(&client);
+        return 0.0;
+    }
+    char payload[PAYLOAD_LENGTH];
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < count; i++) {
+        make_payload(payload, i);
+        platform_mqtt_publish(client.mqtt, TOPIC, payload, PAYLOAD_LENGTH, 0, 0);
+    }
+    double rate = count / ((bench_now_ns() - start) / 1e9);
+    // Let the broker read what was written
+    for (int waited = 0; waited < 2000 && atomic_load(&s_broker.publishes) < count; waited += 10) {
+        usleep(10000);
+    }
+    *delivered = broker_delivered(count);
+    client_stop(&client);
+    return rate;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n MESSAGES    messages published per window (500)\n"
+            "  -l MS          broker acknowledgement latency (10)\n"
+            "  -m BYTES       outbox buffer size (%d)\n"
+            "  -w WINDOW      largest window, the windows are the powers of 2 up to it (%d)\n", name, 4096,
+            MQTT_OUTBOX_MAX_WINDOW);
+}
+
+int main(int argc, char **argv) {
+    int count = 500;
+    int capacity = 4096;
+    int max_window = MQTT_OUTBOX_MAX_WINDOW;
+    s_broker.latency_ms = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:m:w:h")) != -1) {
+        switch (opt) {
+        case 'n': count = atoi(optarg); break;
+        case 'l': s_broker.latency_ms = (uint32_t)atoi(optarg); break;
+        case 'm': capacity = atoi(optarg); break;
+        case 'w': max_window = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (count < 200 || count > MAX_MESSAGES || capacity < 256 || max_window < 8 || max_window > MQTT_OUTBOX_MAX_WINDOW) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    // The last checks log the refused publishes
+    setenv("QL_LOG_LEVEL", "0", 0);
+    // The MQTT client waits 10 s before reconnecting: make it 100 ms
+    platform_linux_set_time_scale(100);
+    if (broker_start() != 0) {
+        fprintf(stderr, "Failed to start the broker\n");
+        return 1;
+    }
+
+    printf("Publishing %d messages of %d bytes, broker acknowledging after %u ms, outbox of %d bytes\n",
+           count, PAYLOAD_LENGTH, s_broker.latency_ms, capacity);
+    printf("  %-8s %10s %14s %12s %12s %10s\n", "window", "msg/s", "peak in flight", "outbox peak", "blocked", "delivered");
+    int qos0_delivered;
+    double qos0_rate = run_qos0(count, &qos0_delivered);
+    printf("  %-8s %10.0f %14s %12s %12s %5d/%-4d\n", "qos 0", qos0_rate, "-", "-", "-", qos0_delivered, count);
+
+    double rate_1 = 0.0;
+    double rate_8 = 0.0;
+    for (int window = 1; window <= max_window; window *= 2) {
+        result_t result;
+        run_window((uint16_t)window, (size_t)capacity, count, &result);
+        char what[96];
+        printf("  %-8d %10.0f %7d/%-6d %12u %12u %5d/%-4d\n", window, result.rate, result.broker_peak,
+               result.stats.peak_in_flight, result.stats.peak_bytes, result.stats.blocked, result.delivered, count);
+        snprintf(what, sizeof(what), "every message delivered and acknowledged with window %d", window);
+        bench_check(result.delivered == count && result.stats.acked == (uint32_t)count && result.stats.pending == 0, what);
+        snprintf(what, sizeof(what), "broker never has more than %d messages unacknowledged", window);
+        bench_check(result.broker_peak <= window && result.stats.peak_in_flight <= window, what);
+        bench_check(result.stats.peak_bytes <= (uint32_t)capacity, "outbox within its buffer");
+        rate_1 = (window == 1) ? result.rate : rate_1;
+        rate_8 = (window == 8) ? result.rate : rate_8;
+    }
+    bench_check(rate_8 > 4 * rate_1, "window of 8 more than 4x the throughput of 1");
+
+    // Connection dropped by the broker with messages in flight
+    broker_reset();
+    atomic_store(&s_broker.drop_after, count / 4);
+    int connections = atomic_load(&s_broker.connections);
+    client_t client;
+    mqtt_outbox_config_t config = { .window = 8, .capacity = (size_t)capacity };
+    mqtt_outbox_stats_t stats = { 0 };
+    if (client_start(&client, &config) == 0) {
+        char payload[PAYLOAD_LENGTH];
+        for (int i = 0; i < count; i++) {
+            make_payload(payload, i);
+            mqtt_outbox_publish(client.outbox, TOPIC, payload, PAYLOAD_LENGTH, PLATFORM_WAIT_FOREVER);
+        }
+        bench_check(mqtt_outbox_flush(client.outbox, 60000) == 0, "outbox flushed after the reconnection");
+        mqtt_outbox_get_stats(client.outbox, &stats);
+    }
+    client_stop(&client);
+    printf("  connection dropped after %d publishes: %d connections, %u sent again, %d/%d delivered\n", count / 4,
+           atomic_load(&s_broker.connections) - connections, stats.retransmitted, broker_delivered(count), count);
+    bench_check(atomic_load(&s_broker.connections) - connections == 2 && stats.retransmitted > 0 &&
+                broker_delivered(count) == count && stats.acked == (uint32_t)count, "messages in flight sent again after the reconnection");
+
+    // Full outbox: a publish that cannot wait is refused, one larger than the buffer too
+    broker_reset();
+    mqtt_outbox_config_t small = { .window = 1, .capacity = 256 };
+    if (client_start(&client, &small) == 0) {
+        char payload[PAYLOAD_LENGTH];
+        make_payload(payload, 0);
+        int accepted = 0;
+        while (accepted < 10 && mqtt_outbox_publish(client.outbox, TOPIC, payload, PAYLOAD_LENGTH, 0) == 0) {
+            accepted++;
+        }
+        static char large[512];
+        memset(large, 'x', sizeof(large));
+        bench_check(mqtt_outbox_publish(client.outbox, TOPIC, large, sizeof(large), PLATFORM_WAIT_FOREVER) == -1,
+                    "message larger than the buffer refused");
+        bench_check(mqtt_outbox_flush(client.outbox, 10000) == 0, "small outbox flushed");
+        mqtt_outbox_get_stats(client.outbox, &stats);
+        bench_check(accepted == 256 / 96 && stats.rejected == 2 && stats.acked == (uint32_t)accepted,
+                    "full outbox refuses a publish that cannot wait");
+    }
+    client_stop(&client);
+
+    return bench_result();
+}
@@ -0,0 +1,389 @@
+/**
+ * \file platform_linux.c
+ * \brief Linux implementation of platform.h (scheduler, timers and statistics).
+ * The MQTT client is in mqtt_linux.c.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/random.h>
+#include "esp_log.h"
+
+#include "platform.h"
+#include "platform_linux.h"
+
+/** Minimum stack of the host threads: glibc and OpenSSL need much more than the device tasks */
+#define HOST_MIN_STACK_SIZE (256 * 1024)
+
+static _Atomic double s_time_scale = 1.0;
+static atomic_uint s_associate_ms = 0;
+static atomic_uint s_dns_ms = 0;
+static __thread const char *s_device_id = NULL;
+static atomic_uint s_dns_server = 0;
+static atomic_uint s_dns_port = 0;
+static _Atomic(platform_linux_resolver_t) s_resolver = NULL;
+
+static atomic_int_least64_t s_stats[PLATFORM_LINUX_STAT_COUNT];
+static atomic_int_least64_t s_peaks[PLATFORM_LINUX_STAT_COUNT];
+
+esp_log_level_t host_log_level(void) {
+    static atomic_int level = -1;
+    int current = atomic_load_explicit(&level, memory_order_relaxed);
+    if (current < 0) {
+        const char *env = getenv("QL_LOG_LEVEL");
+        current = env != NULL ? atoi(env) : ESP_LOG_WARN;
+        atomic_store_explicit(&level, current, memory_order_relaxed);
+    }
+    return (esp_log_level_t)current;
+}
+
+const char *host_log_device(void) {
+    return s_device_id != NULL ? s_device_id : "-";
+}
+
+void platform_linux_set_time_scale(double scale) {
+    s_time_scale = scale > 0 ? scale : 1.0;
+}
+
+void platform_linux_set_network_latency(uint32_t associate_ms, uint32_t dns_ms) {
+    s_associate_ms = associate_ms;
+    s_dns_ms = dns_ms;
+}
+
+void platform_linux_set_dns_server(uint32_t address, uint16_t port) {
+    s_dns_port = port;
+    s_dns_server = address;
+}
+
+void platform_linux_set_resolver(platform_linux_resolver_t resolver) {
+    s_resolver = resolver;
+}
+
+int platform_linux_resolve_hook(const char *host, uint32_t *addresses, size_t max) {
+    platform_linux_resolver_t resolver = s_resolver;
+    return (resolver != NULL) ? resolver(host, addresses, max) : -1;
+}
+
+void platform_linux_bind_device(const char *device_id) {
+    s_device_id = device_id;
+}
+
+const char *platform_linux_device_id(void) {
+    return s_device_id;
+}
+
+void platform_linux_stat_add(platform_linux_stat_t stat, int64_t delta) {
+    if (stat >= PLATFORM_LINUX_STAT_COUNT) {
+        return;
+    }
+    int64_t value = atomic_fetch_add_explicit(&s_stats[stat], delta, memory_order_relaxed) + delta;
+    int64_t peak = atomic_load_explicit(&s_peaks[stat], memory_order_relaxed);
+    while (value > peak &&
+           !atomic_compare_exchange_weak_explicit(&s_peaks[stat], &peak, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void platform_linux_get_stats(int64_t *values, int64_t *peaks) {
+    for (int i = 0; i < PLATFORM_LINUX_STAT_COUNT; i++) {
+        values[i] = atomic_load(&s_stats[i]);
+        if (peaks != NULL) {
+            // The next interval starts from the current value
+            peaks[i] = atomic_exchange(&s_peaks[i], values[i]);
+        }
+    }
+}
+
+/**
+ * Scheduler and timers
+ */
+
+static int64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Time origin, so that the uptime of the metrics report is the uptime of the process as on the device */
+static int64_t s_start_us;
+
+__attribute__((constructor)) static void platform_linux_init(void) {
+    s_start_us = monotonic_us();
+}
+
+int64_t platform_now_us(void) {
+    return monotonic_us() - s_start_us;
+}
+
+static void sleep_ms(double ms) {
+    struct timespec delay = {
+        .tv_sec = (time_t)(ms / 1000),
+        .tv_nsec = (long)((ms - (time_t)(ms / 1000) * 1000.0) * 1000000),
+    };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+void platform_delay_ms(uint32_t ms) {
+    sleep_ms(ms / s_time_scale);
+}
+
+typedef struct {
+    void (*task)(void *);
+    void *arg;
+} task_start_t;
+
+static void *task_trampoline(void *arg) {
+    task_start_t start = *(task_start_t *)arg;
+    free(arg);
+    start.task(start.arg);
+    return NULL;
+}
+
+int platform_task_create(void (*task)(void *), const char *name, uint32_t stack_size, void *arg, int priority, void **handle) {
+    (void)name;
+    (void)priority;
+    task_start_t *start = malloc(sizeof(task_start_t));
+    if (start == NULL) {
+        return -1;
+    }
+    start->task = task;
+    start->arg = arg;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_size > HOST_MIN_STACK_SIZE ? stack_size : HOST_MIN_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int ret = pthread_create(&thread, &attr, task_trampoline, start);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        free(start);
+        return -1;
+    }
+    if (handle != NULL) {
+        *handle = (void *)(uintptr_t)thread;
+    }
+    return 0;
+}
+
+void platform_task_exit(void) {
+    pthread_exit(NULL);
+}
+
+uint32_t platform_task_stack_free(void *handle) {
+    (void)handle;
+    return 0;
+}
+
+void platform_random(void *buffer, size_t length) {
+    uint8_t *bytes = buffer;
+    while (length > 0) {
+        ssize_t got = getrandom(bytes, length, 0);
+        if (got > 0) {
+            bytes += got;
+            length -= (size_t)got;
+        }
+    }
+}
+
+size_t platform_heap_free(void) {
+    return 0;
+}
+
+size_t platform_heap_largest_block(void) {
+    return 0;
+}
+
+/**
+ * Queues
+ */
+
+struct platform_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    size_t length;
+    size_t item_size;
+    size_t head;
+    size_t count;
+    uint8_t items[];
+};
+
+platform_queue_t *platform_queue_create(size_t length, size_t item_size) {
+    platform_queue_t *queue = calloc(1, sizeof(platform_queue_t) + length * item_size);
+    if (queue == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+int platform_queue_send(platform_queue_t *queue, const void *item) {
+    int ret = -1;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count < queue->length) {
+        size_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+        queue->count++;
+        pthread_cond_signal(&queue->not_empty);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ret;
+}
+
+int platform_queue_receive(platform_queue_t *queue, void *item, uint32_t timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    int ret = 0;
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && ret == 0) {
+        if (timeout_ms == PLATFORM_WAIT_FOREVER) {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        else {
+            ret = pthread_cond_timedwait(&queue->not_empty, &queue->lock, &deadline);
+        }
+    }
+    if (queue->count > 0) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ret == 0 ? 0 : -1;
+}
+
+void platform_queue_delete(platform_queue_t *queue) {
+    if (queue != NULL) {
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->lock);
+        free(queue);
+    }
+}
+
+/**
+ * Mutexes
+ */
+
+struct platform_mutex {
+    pthread_mutex_t lock;
+};
+
+platform_mutex_t *platform_mutex_create(void) {
+    platform_mutex_t *mutex = malloc(sizeof(platform_mutex_t));
+    if (mutex != NULL) {
+        pthread_mutex_init(&mutex->lock, NULL);
+    }
+    return mutex;
+}
+
+void platform_mutex_lock(platform_mutex_t *mutex) {
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void platform_mutex_unlock(platform_mutex_t *mutex) {
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+void platform_mutex_delete(platform_mutex_t *mutex) {
+    if (mutex != NULL) {
+        pthread_mutex_destroy(&mutex->lock);
+        free(mutex);
+    }
+}
+
+/**
+ * Network
+ */
+
+int platform_network_start(void) {
+    // The host network is already up, only its modelled latency is spent
+    sleep_ms(s_associate_ms);
+    return 0;
+}
+
+int platform_dns_server(uint32_t *address, uint16_t *port) {
+    // Only the stand-in set by the benches: the queries of the host resolver are not modelled
+    uint32_t server = s_dns_server;
+    if (server == 0) {
+        return -1;
+    }
+    *address = server;
+    *port = (uint16_t)s_dns_port;
+    return 0;
+}
+
+int platform_dns_resolve(const char *host, uint32_t *address) {
+    return (platform_dns_resolve_all(host, address, 1) > 0) ? 0 : -1;
+}
+
+int platform_dns_resolve_all(const char *host, uint32_t *addresses, size_t max) {
+    int resolved = platform_linux_resolve_hook(host, addresses, max);
+    if (resolved > 0) {
+        return resolved;
+    }
+    platform_linux_stat_add(PLATFORM_LINUX_DNS_LOOKUPS, 1);
+    sleep_ms(s_dns_ms);
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL) {
+        return -1;
+    }
+    size_t count = 0;
+    for (struct addrinfo *entry = result; entry != NULL && count < max; entry = entry->ai_next) {
+        addresses[count++] = ((struct sockaddr_in *)entry->ai_addr)->sin_addr.s_addr;
+    }
+    freeaddrinfo(result);
+    return (int)count;
+}
+
+/* No arena on Linux: the QuarkLink requests are counted by quarklink_linux.c */
+void platform_connection_begin(void) {
+}
+
+void platform_connection_end(void) {
+}
+
+/**
+ * Miscellaneous
+ */
+
+static platform_linux_led_output_t s_led_output = NULL;
+
+void platform_linux_set_led_output(platform_linux_led_output_t output) {
+    s_led_output = output;
+}
+
+void platform_led_write(uint8_t red, uint8_t green, uint8_t blue) {
+    if (s_led_output != NULL) {
+        s_led_output(red, green, blue);
+    }
+}
+
+int32_t platform_sample(void) {
+    // A room temperature with a little noise
+    return 215 + (int32_t)(monotonic_us() % 11) - 5;
+}
+
+void platform_log_stats(void) {
+    // Reported by the load test
+}
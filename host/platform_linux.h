@@ -0,0 +1,106 @@
+/**
+ * \file platform_linux.h
+ * \brief Host-only extensions of platform.h, used by the load test and the Linux backends.
+ */
+#ifndef _PLATFORM_LINUX_H_
+#define _PLATFORM_LINUX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Load test statistics. Totals only grow, gauges also keep their peak value.
+ */
+typedef enum {
+    PLATFORM_LINUX_QUARKLINK_REQUESTS = 0,  /*!< Total: QuarkLink API calls */
+    PLATFORM_LINUX_QUARKLINK_ACTIVE,        /*!< Gauge: QuarkLink API calls in progress */
+    PLATFORM_LINUX_QUARKLINK_HANDSHAKES,    /*!< Total: TLS handshakes with QuarkLink */
+    PLATFORM_LINUX_MQTT_CONNECTS,           /*!< Total: MQTT connection attempts */
+    PLATFORM_LINUX_MQTT_CONNECTING,         /*!< Gauge: MQTT connections between BEFORE_CONNECT and CONNACK */
+    PLATFORM_LINUX_MQTT_CONNECTED,          /*!< Gauge: MQTT clients connected */
+    PLATFORM_LINUX_MQTT_PUBLISHED,          /*!< Total: PUBLISH packets sent */
+    PLATFORM_LINUX_MQTT_RESUMED,            /*!< Total: MQTT connections that resumed a TLS session */
+    PLATFORM_LINUX_MQTT_EARLY_ACCEPTED,     /*!< Total: MQTT connections whose early data the broker accepted */
+    PLATFORM_LINUX_MQTT_EARLY_REJECTED,     /*!< Total: MQTT connections whose early data the broker rejected */
+    PLATFORM_LINUX_DNS_LOOKUPS,             /*!< Total: host names resolved by platform_dns_resolve, not by the resolver hook */
+    PLATFORM_LINUX_STAT_COUNT
+} platform_linux_stat_t;
+
+/**
+ * \brief Divide every \ref platform_delay_ms by \p scale, so that the application intervals
+ * (status checks, publishes) run faster than real time. Latencies are always measured in real time.
+ */
+void platform_linux_set_time_scale(double scale);
+
+/**
+ * \brief Model the latency of the device network: \ref platform_network_start takes \p associate_ms
+ * (Wi-Fi association and DHCP) and \ref platform_dns_resolve takes \p dns_ms more than the host lookup.
+ * Both are 0 by default, as the host network is always up. Not affected by the time scale.
+ */
+void platform_linux_set_network_latency(uint32_t associate_ms, uint32_t dns_ms);
+
+/**
+ * \brief Set the DNS server returned by \ref platform_dns_server, e.g. a local stand-in (dns_stub.h).
+ * \param[in] address the server address, in network byte order, 0 for none (the default)
+ * \param[in] port    the server port
+ */
+void platform_linux_set_dns_server(uint32_t address, uint16_t port);
+
+typedef int (*platform_linux_resolver_t)(const char *host, uint32_t *addresses, size_t max);
+
+/**
+ * \brief Resolve host names through \p resolver first, as lwIP does through the DNS cache on the device
+ * (e.g. dns_cache_resolve): \ref platform_dns_resolve_all and the connections of net_linux.c.
+ * A resolver returning -1 leaves the name to the host resolver.
+ * \param[in] resolver the resolver, NULL for none (the default)
+ */
+void platform_linux_set_resolver(platform_linux_resolver_t resolver);
+
+/**
+ * \brief Resolve a host name with the resolver set by \ref platform_linux_set_resolver.
+ * \return the number of addresses, -1 if there is no resolver or it has no answer
+ */
+int platform_linux_resolve_hook(const char *host, uint32_t *addresses, size_t max);
+
+/**
+ * \brief Bind a simulated device to the calling thread. The device ID is returned by
+ * the QuarkLink client (as the eFuse-derived ID on the device) and prefixes the log lines.
+ * \param[in] device_id the device ID, must outlive the thread
+ */
+void platform_linux_bind_device(const char *device_id);
+
+/**
+ * \brief Device ID bound to the calling thread, NULL if none.
+ */
+const char *platform_linux_device_id(void);
+
+/**
+ * \brief Update a statistic.
+ */
+void platform_linux_stat_add(platform_linux_stat_t stat, int64_t delta);
+
+/**
+ * \brief Get a snapshot of the statistics.
+ * \param[out] values the current values, PLATFORM_LINUX_STAT_COUNT entries
+ * \param[out] peaks  the peak of the gauges since the previous call, PLATFORM_LINUX_STAT_COUNT entries, can be NULL
+ */
+void platform_linux_get_stats(int64_t *values, int64_t *peaks);
+
+typedef void (*platform_linux_led_output_t)(uint8_t red, uint8_t green, uint8_t blue);
+
+/**
+ * \brief Send the \ref platform_led_write frames to \p output, e.g. a LED strip on the RMT mock.
+ * They are dropped by default.
+ */
+void platform_linux_set_led_output(platform_linux_led_output_t output);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _PLATFORM_LINUX_H_
@@ -0,0 +1,329 @@
+/**
+ * \file ql_context_bench.c
+ * \brief Resident size and cost of the packed QuarkLink context (ql_context.c) against quarklink_context_t.
+ *
+ * The context is filled with certificates generated with OpenSSL: an RSA QuarkLink root, an EC device
+ * certificate with its intermediate (a chain) and an RSA IoT Hub root. It reports:
+ *   - the resident size of each representation
+ *   - the time to copy each representation, to pack and to unpack the context
+ *   - the time to get the device certificate through the getter of each representation
+ * and checks that unpacking gives back the packed context, that the getters return the fields of the full
+ * context, that the DER is the one OpenSSL encodes, and that a certificate that cannot be rebuilt from its
+ * DER (CRLF line endings) is kept as text.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <getopt.h>
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+#include "bench.h"
+#include "ql_context.h"
+
+static char s_scope_id[QUARKLINK_MAX_URI_LENGTH] = "0ne00ABCDEF";
+static char s_topic[QUARKLINK_MAX_ENDPOINT_LENGTH] = "fwupdate/device";
+static char s_temp_cert[] = "temporary";
+
+/**
+ * Certificates
+ */
+
+typedef struct {
+    EVP_PKEY *key;
+    X509 *crt;
+} cert_t;
+
+static EVP_PKEY *make_key(bool rsa) {
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(rsa ? EVP_PKEY_RSA : EVP_PKEY_EC, NULL);
+    EVP_PKEY *key = NULL;
+    if (ctx == NULL || EVP_PKEY_keygen_init(ctx) <= 0 ||
+        (rsa ? EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) : EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1)) <= 0 ||
+        EVP_PKEY_keygen(ctx, &key) <= 0) {
+        fprintf(stderr, "Failed to generate a key\n");
+        exit(1);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+/* A certificate for `name`, signed by `issuer` or self-signed */
+static cert_t make_cert(const char *name, bool rsa, const cert_t *issuer, long serial) {
+    cert_t cert = { .key = make_key(rsa), .crt = X509_new() };
+    X509_set_version(cert.crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert.crt), serial);
+    X509_gmtime_adj(X509_getm_notBefore(cert.crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert.crt), 365L * 24 * 3600);
+    X509_set_pubkey(cert.crt, cert.key);
+    X509_NAME *subject = X509_get_subject_name(cert.crt);
+    X509_NAME_add_entry_by_txt(subject, "O", MBSTRING_ASC, (const unsigned char *)"Example", -1, -1, 0);
+    X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char *)name, -1, -1, 0);
+    X509_set_issuer_name(cert.crt, issuer != NULL ? X509_get_subject_name(issuer->crt) : subject);
+    if (X509_sign(cert.crt, issuer != NULL ? issuer->key : cert.key, EVP_sha256()) <= 0) {
+        fprintf(stderr, "Failed to sign %s\n", name);
+        exit(1);
+    }
+    return cert;
+}
+
+static void free_cert(cert_t *cert) {
+    X509_free(cert->crt);
+    EVP_PKEY_free(cert->key);
+}
+
+/* Append the PEM of `cert` to `pem` */
+static void append_pem(char *pem, size_t size, const cert_t *cert) {
+    BIO *bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, cert->crt);
+    char *data;
+    long length = BIO_get_mem_data(bio, &data);
+    size_t used = strlen(pem);
+    if (used + length >= size) {
+        fprintf(stderr, "Certificate too long\n");
+        exit(1);
+    }
+    memcpy(pem + used, data, length);
+    pem[used + length] = '\0';
+    BIO_free(bio);
+}
+
+/* Append the DER of `cert` to `der` */
+static size_t append_der(uint8_t *der, size_t used, const cert_t *cert) {
+    unsigned char *p = der + used;
+    return used + i2d_X509(cert->crt, &p);
+}
+
+/**
+ * Checks
+ */
+
+static bool same_string(const char *a, const char *b) {
+    return (a == NULL && b == NULL) || (a != NULL && b != NULL && strcmp(a, b) == 0);
+}
+
+static bool in_arena(const ql_context_t *context, const char *text) {
+    uintptr_t start = (uintptr_t)context->arena;
+    return (uintptr_t)text >= start && (uintptr_t)text < start + context->arena_size;
+}
+
+static bool same_context(const quarklink_context_t *a, const quarklink_context_t *b) {
+    return strcmp(a->rootCert, b->rootCert) == 0 && a->tempCert == b->tempCert &&
+           strcmp(a->endpoint, b->endpoint) == 0 && a->port == b->port &&
+           strcmp(a->deviceID, b->deviceID) == 0 && strcmp(a->deviceCert, b->deviceCert) == 0 &&
+           strcmp(a->iotHubRootCert, b->iotHubRootCert) == 0 && strcmp(a->iotHubEndpoint, b->iotHubEndpoint) == 0 &&
+           a->iotHubPort == b->iotHubPort && same_string(a->scopeID, b->scopeID) &&
+           same_string(a->fwUpdateTopic, b->fwUpdateTopic);
+}
+
+static bool same_getter(quarklink_return_t ret, const char *value, const char *expected) {
+    return ret == QUARKLINK_SUCCESS && strcmp(value, expected) == 0;
+}
+
+static void check_getters(const ql_context_t *context, const quarklink_context_t *quarklink) {
+    char *buffer = malloc(QUARKLINK_MAX_LONG_CERT_LENGTH);
+    uint16_t port = 0;
+    if (buffer == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    bench_check(same_getter(ql_context_getRootCert(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer, quarklink->rootCert),
+                "root certificate getter");
+    bench_check(same_getter(ql_context_getEndpoint(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer, quarklink->endpoint),
+                "endpoint getter");
+    bench_check(same_getter(ql_context_getDeviceID(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer, quarklink->deviceID),
+                "device ID getter");
+    bench_check(same_getter(ql_context_getDeviceCert(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer, quarklink->deviceCert),
+                "device certificate getter");
+    bench_check(same_getter(ql_context_getIoTHubCert(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer, quarklink->iotHubRootCert),
+                "IoT Hub certificate getter");
+    bench_check(same_getter(ql_context_getIoTHubEndpoint(context, buffer, QUARKLINK_MAX_LONG_CERT_LENGTH), buffer,
+                      quarklink->iotHubEndpoint), "IoT Hub endpoint getter");
+    bench_check(ql_context_getPort(context, &port) == QUARKLINK_SUCCESS && port == quarklink->port, "port getter");
+    bench_check(ql_context_getIoTHubPort(context, &port) == QUARKLINK_SUCCESS && port == quarklink->iotHubPort,
+                "IoT Hub port getter");
+    bench_check(ql_context_getDeviceCert(context, buffer, (int)strlen(quarklink->deviceCert)) == QUARKLINK_INVALID_PARAMETER,
+                "getter with a short buffer");
+    bench_check(ql_context_getDeviceCert(context, NULL, QUARKLINK_MAX_LONG_CERT_LENGTH) == QUARKLINK_INVALID_PARAMETER,
+                "getter without a buffer");
+    free(buffer);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n ROUNDS      number of copies, packs and unpacks timed (10000)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 10000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': rounds = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (rounds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cert_t ql_root = make_cert("QuarkLink Root", true, NULL, 1);
+    cert_t hub_root = make_cert("IoT Hub Root", true, NULL, 2);
+    cert_t intermediate = make_cert("Device CA", false, &ql_root, 3);
+    cert_t device = make_cert("device-0001", false, &intermediate, 4);
+
+    quarklink_context_t *quarklink = calloc(1, sizeof(quarklink_context_t));
+    quarklink_context_t *unpacked = malloc(sizeof(quarklink_context_t));
+    quarklink_context_t *copy = malloc(sizeof(quarklink_context_t));
+    uint8_t *der = malloc(QUARKLINK_MAX_LONG_CERT_LENGTH);
+    if (quarklink == NULL || unpacked == NULL || copy == NULL || der == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    append_pem(quarklink->rootCert, sizeof(quarklink->rootCert), &ql_root);
+    quarklink->tempCert = s_temp_cert;
+    snprintf(quarklink->endpoint, sizeof(quarklink->endpoint), "example.quarklink.io");
+    quarklink->port = 6000;
+    snprintf(quarklink->deviceID, sizeof(quarklink->deviceID), "device-0001");
+    append_pem(quarklink->deviceCert, sizeof(quarklink->deviceCert), &device);
+    append_pem(quarklink->deviceCert, sizeof(quarklink->deviceCert), &intermediate);
+    append_pem(quarklink->iotHubRootCert, sizeof(quarklink->iotHubRootCert), &hub_root);
+    snprintf(quarklink->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint), "broker.example.quarklink.io");
+    quarklink->iotHubPort = 8883;
+    quarklink->scopeID = s_scope_id;
+    quarklink->fwUpdateTopic = s_topic;
+
+    // Round trip
+    ql_context_t context = { 0 };
+    bench_check(ql_context_pack(&context, quarklink) == 0, "context packed");
+    bench_check(ql_context_unpack(&context, unpacked) == 0 && same_context(unpacked, quarklink), "unpacked context is the packed one");
+    // The library frees or reallocates them: they must not point into the arena
+    bench_check(unpacked->scopeID != NULL && unpacked->fwUpdateTopic != NULL &&
+                !in_arena(&context, unpacked->scopeID) && !in_arena(&context, unpacked->fwUpdateTopic),
+                "unpacked strings are copies of their own");
+    bench_check(context.der_mask == ((1u << QL_CONTEXT_ROOT_CERT) | (1u << QL_CONTEXT_DEVICE_CERT) | (1u << QL_CONTEXT_IOT_HUB_ROOT_CERT)),
+                "certificates stored as DER");
+    check_getters(&context, quarklink);
+    bench_check(strcmp(ql_context_string(&context, QL_CONTEXT_DEVICE_ID), quarklink->deviceID) == 0 &&
+                strcmp(ql_context_string(&context, QL_CONTEXT_SCOPE_ID), s_scope_id) == 0, "string accessor");
+
+    size_t der_len = 0;
+    size_t expected_len = append_der(der, append_der(der, 0, &device), &intermediate);
+    const uint8_t *packed_der = ql_context_der(&context, QL_CONTEXT_DEVICE_CERT, &der_len);
+    bench_check(packed_der != NULL && der_len == expected_len && memcmp(packed_der, der, der_len) == 0,
+                "device chain DER is the OpenSSL one");
+
+    // Packing the unpacked context again keeps the arena
+    uint8_t *arena = context.arena;
+    bench_check(ql_context_pack(&context, unpacked) == 0 && context.arena == arena, "unchanged context keeps its arena");
+
+    // Text that cannot be rebuilt from the DER, and NULL pointer fields
+    memcpy(copy, quarklink, sizeof(quarklink_context_t));
+    char *line_end = strchr(copy->iotHubRootCert, '\n');
+    memmove(line_end + 1, line_end, strlen(line_end) + 1);
+    *line_end = '\r';
+    copy->scopeID = NULL;
+    ql_context_t text = { 0 };
+    bench_check(ql_context_pack(&text, copy) == 0 && !(text.der_mask & (1u << QL_CONTEXT_IOT_HUB_ROOT_CERT)),
+                "CRLF certificate kept as text");
+    ql_context_release(unpacked);
+    bench_check(ql_context_unpack(&text, unpacked) == 0 && same_context(unpacked, copy), "CRLF certificate round trip");
+    ql_context_free(&text);
+
+    // An empty context, as before enrolling
+    memset(copy, 0, sizeof(quarklink_context_t));
+    snprintf(copy->deviceID, sizeof(copy->deviceID), "device-0002");
+    ql_context_release(unpacked);
+    bench_check(ql_context_pack(&text, copy) == 0 && ql_context_unpack(&text, unpacked) == 0 && same_context(unpacked, copy),
+                "empty context round trip");
+    char buffer[QUARKLINK_MAX_DEVICE_ID_LENGTH];
+    bench_check(ql_context_getDeviceCert(&text, buffer, sizeof(buffer)) == QUARKLINK_VALUE_NOT_AVAILABLE &&
+                ql_context_getIoTHubPort(&text, &(uint16_t){ 0 }) == QUARKLINK_VALUE_NOT_AVAILABLE, "empty fields not available");
+    ql_context_free(&text);
+
+    // Timings
+    int64_t start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        memcpy(copy, quarklink, sizeof(quarklink_context_t));
+        __asm__ volatile("" : : "r"(copy) : "memory");
+    }
+    double full_copy_ns = (double)(bench_now_ns() - start_ns) / rounds;
+
+    ql_context_t packed_copy = { 0 };
+    start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        ql_context_copy(&packed_copy, &context);
+    }
+    double packed_copy_ns = (double)(bench_now_ns() - start_ns) / rounds;
+    bench_check(packed_copy.arena_size == context.arena_size &&
+                memcmp(packed_copy.arena, context.arena, context.arena_size) == 0, "packed copy");
+    ql_context_free(&packed_copy);
+
+    ql_context_t repacked = { 0 };
+    start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        ql_context_pack(&repacked, quarklink);
+        ql_context_free(&repacked);
+    }
+    double pack_ns = (double)(bench_now_ns() - start_ns) / rounds;
+
+    start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        ql_context_unpack(&context, unpacked);
+        ql_context_release(unpacked);
+    }
+    double unpack_ns = (double)(bench_now_ns() - start_ns) / rounds;
+
+    char *cert = malloc(QUARKLINK_MAX_LONG_CERT_LENGTH);
+    if (cert == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        // What quarklink_getDeviceCert() does with the full context
+        snprintf(cert, QUARKLINK_MAX_LONG_CERT_LENGTH, "%s", quarklink->deviceCert);
+        __asm__ volatile("" : : "r"(cert) : "memory");
+    }
+    double full_get_ns = (double)(bench_now_ns() - start_ns) / rounds;
+    start_ns = bench_now_ns();
+    for (int i = 0; i < rounds; i++) {
+        ql_context_getDeviceCert(&context, cert, QUARKLINK_MAX_LONG_CERT_LENGTH);
+    }
+    double packed_get_ns = (double)(bench_now_ns() - start_ns) / rounds;
+    free(cert);
+
+    size_t full_size = sizeof(quarklink_context_t);
+    size_t packed_size = sizeof(ql_context_t) + context.arena_size;
+    bench_check(packed_size * 2 < full_size, "packed context less than half the full one");
+
+    printf("QuarkLink context with %u + %u + %u bytes of PEM certificates, %d rounds\n",
+           (unsigned)strlen(quarklink->rootCert), (unsigned)strlen(quarklink->deviceCert),
+           (unsigned)strlen(quarklink->iotHubRootCert), rounds);
+    printf("  %-28s %12s %12s\n", "", "full", "packed");
+    printf("  %-28s %12u %12u\n", "resident bytes", (unsigned)full_size, (unsigned)packed_size);
+    printf("  %-28s %10.0fns %10.0fns\n", "copy", full_copy_ns, packed_copy_ns);
+    printf("  %-28s %12s %10.0fns\n", "pack", "-", pack_ns);
+    printf("  %-28s %12s %10.0fns\n", "unpack", "-", unpack_ns);
+    printf("  %-28s %10.0fns %10.0fns\n", "get device certificate", full_get_ns, packed_get_ns);
+
+    ql_context_free(&context);
+    free(quarklink);
+    ql_context_release(unpacked);
+    free(unpacked);
+    free(copy);
+    free(der);
+    free_cert(&device);
+    free_cert(&intermediate);
+    free_cert(&hub_root);
+    free_cert(&ql_root);
+
+    return bench_result();
+}
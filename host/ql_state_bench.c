@@ -0,0 +1,319 @@
+/**
+ * \file ql_state_bench.c
+ * \brief Concurrent readers of the QuarkLink state (ql_state.c) while writers re-enrol.
+ *
+ * Every writer unpacks the current context with ql_state_begin(), holds the client lock for the time of a
+ * QuarkLink call (-c), rewrites the device ID, the endpoints and the scope ID for the next generation and
+ * publishes it with a status derived from the generation. The readers take snapshots in a loop, some of them
+ * kept for a while, and check that every field of a snapshot belongs to its generation, before and after
+ * keeping it, and that the generations they see never go back.
+ *
+ * It runs twice: with snapshots, and with the readers taking the client lock instead, as a single mutex
+ * around the context would have them do. It reports the reads per second and the latency of a read, and
+ * checks that the final generation counts every write, and that only the current snapshot is left.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "ql_state.h"
+
+#define LATENCY_SAMPLES (1 << 16)
+/* One read in KEEP_EVERY keeps its snapshot for KEEP_US */
+#define KEEP_EVERY      (256)
+#define KEEP_US         (50)
+
+
+static void sleep_us(long us) {
+    struct timespec ts = { .tv_sec = 0, .tv_nsec = us * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static const quarklink_return_t s_statuses[] = {
+    QUARKLINK_STATUS_ENROLLED,
+    QUARKLINK_STATUS_FWUPDATE_REQUIRED,
+    QUARKLINK_STATUS_NOT_ENROLLED,
+    QUARKLINK_STATUS_CERTIFICATE_EXPIRED,
+    QUARKLINK_STATUS_REVOKED,
+};
+
+static quarklink_return_t status_of(uint32_t generation) {
+    return s_statuses[generation % (sizeof(s_statuses) / sizeof(s_statuses[0]))];
+}
+
+static void fill(quarklink_context_t *quarklink, uint32_t generation) {
+    char scope_id[32];
+    snprintf(quarklink->deviceID, sizeof(quarklink->deviceID), "device-%u", generation);
+    snprintf(quarklink->endpoint, sizeof(quarklink->endpoint), "g%u.quarklink.io", generation);
+    snprintf(quarklink->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint), "hub-%u.example.net", generation);
+    snprintf(scope_id, sizeof(scope_id), "scope-%u", generation);
+    // As the library does
+    ql_context_set_string(quarklink, QL_CONTEXT_SCOPE_ID, scope_id);
+    quarklink->port = (uint16_t)generation;
+}
+
+/* Every field of the snapshot belongs to its generation */
+static bool consistent(const ql_snapshot_t *snapshot) {
+    char expected[64];
+    uint32_t generation = snapshot->generation;
+    const ql_context_t *context = &snapshot->context;
+    snprintf(expected, sizeof(expected), "device-%u", generation);
+    if (strcmp(ql_context_string(context, QL_CONTEXT_DEVICE_ID), expected) != 0) {
+        return false;
+    }
+    snprintf(expected, sizeof(expected), "g%u.quarklink.io", generation);
+    if (strcmp(ql_context_string(context, QL_CONTEXT_ENDPOINT), expected) != 0) {
+        return false;
+    }
+    snprintf(expected, sizeof(expected), "hub-%u.example.net", generation);
+    if (strcmp(ql_context_string(context, QL_CONTEXT_IOT_HUB_ENDPOINT), expected) != 0) {
+        return false;
+    }
+    snprintf(expected, sizeof(expected), "scope-%u", generation);
+    if (strcmp(ql_context_string(context, QL_CONTEXT_SCOPE_ID), expected) != 0) {
+        return false;
+    }
+    return context->port == (uint16_t)generation && snapshot->status == status_of(generation);
+}
+
+/**
+ * Threads
+ */
+
+typedef struct {
+    ql_state_t state;
+    bool locked;
+    int writes;
+    int call_us;
+    atomic_int writers_left;
+    atomic_uint inconsistent;
+    atomic_uint went_back;
+    atomic_uint failed_writes;
+} shared_t;
+
+typedef struct {
+    shared_t *shared;
+    pthread_t thread;
+    uint64_t reads;
+    uint32_t latency_count;
+    uint32_t *latency_ns;
+} reader_t;
+
+static void *writer_main(void *arg) {
+    shared_t *shared = arg;
+    for (int i = 0; i < shared->writes; i++) {
+        quarklink_context_t *quarklink = ql_state_begin(&shared->state);
+        if (quarklink == NULL) {
+            atomic_fetch_add(&shared->failed_writes, 1);
+            continue;
+        }
+        // Writers are serialised: the next generation is known
+        uint32_t generation = shared->state.client_snapshot->generation + 1;
+        sleep_us(shared->call_us);
+        fill(quarklink, generation);
+        if (ql_state_end(&shared->state, quarklink, status_of(generation)) != 0) {
+            atomic_fetch_add(&shared->failed_writes, 1);
+        }
+    }
+    atomic_fetch_sub(&shared->writers_left, 1);
+    return NULL;
+}
+
+static void *reader_main(void *arg) {
+    reader_t *reader = arg;
+    shared_t *shared = reader->shared;
+    uint32_t last_generation = 0;
+    while (atomic_load(&shared->writers_left) > 0) {
+        bool keep = (reader->reads % KEEP_EVERY) == 0;
+        int64_t start = bench_now_ns();
+        const ql_snapshot_t *snapshot;
+        if (shared->locked) {
+            platform_mutex_lock(shared->state.client_lock);
+            snapshot = shared->state.current;
+        }
+        else {
+            snapshot = ql_state_acquire(&shared->state);
+        }
+        bool ok = consistent(snapshot);
+        if (keep) {
+            // Publishes go on meanwhile: the snapshot must not change
+            sleep_us(KEEP_US);
+            ok = ok && consistent(snapshot);
+        }
+        uint32_t generation = snapshot->generation;
+        if (shared->locked) {
+            platform_mutex_unlock(shared->state.client_lock);
+        }
+        else {
+            ql_state_release(&shared->state, snapshot);
+        }
+        if (!keep && reader->latency_count < LATENCY_SAMPLES) {
+            reader->latency_ns[reader->latency_count++] = (uint32_t)(bench_now_ns() - start);
+        }
+        if (!ok) {
+            atomic_fetch_add(&shared->inconsistent, 1);
+        }
+        if (generation < last_generation) {
+            atomic_fetch_add(&shared->went_back, 1);
+        }
+        last_generation = generation;
+        reader->reads++;
+    }
+    return NULL;
+}
+
+/**
+ * Runs
+ */
+
+typedef struct {
+    double reads_per_s;
+    double p50_ns;
+    double p99_ns;
+    double max_ns;
+    ql_state_stats_t stats;
+} result_t;
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(bool locked, int readers, int writers, int writes, int call_us, result_t *result) {
+    shared_t *shared = calloc(1, sizeof(shared_t));
+    reader_t *reader = calloc(readers, sizeof(reader_t));
+    pthread_t *writer = calloc(writers, sizeof(pthread_t));
+    quarklink_context_t *quarklink = calloc(1, sizeof(quarklink_context_t));
+    uint32_t *latency = malloc((size_t)readers * LATENCY_SAMPLES * sizeof(uint32_t));
+    if (shared == NULL || reader == NULL || writer == NULL || quarklink == NULL || latency == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    shared->locked = locked;
+    shared->writes = writes;
+    shared->call_us = call_us;
+    atomic_init(&shared->writers_left, writers);
+
+    // Generation 1, as loaded at boot
+    ql_context_t context = { 0 };
+    fill(quarklink, 1);
+    bench_check(ql_state_init(&shared->state) == 0, "state initialised");
+    bench_check(ql_state_acquire(&shared->state) == NULL, "nothing to acquire before the first publish");
+    bench_check(ql_state_status(&shared->state) == QUARKLINK_ERROR, "no status before the first publish");
+    bench_check(ql_context_pack(&context, quarklink) == 0 && ql_state_publish(&shared->state, &context, status_of(1)) == 0,
+                "first context published");
+    bench_check(context.arena == NULL, "arena moved to the snapshot");
+    ql_context_release(quarklink);
+    free(quarklink);
+
+    int64_t start = bench_now_ns();
+    for (int i = 0; i < readers; i++) {
+        reader[i].shared = shared;
+        reader[i].latency_ns = latency + (size_t)i * LATENCY_SAMPLES;
+        pthread_create(&reader[i].thread, NULL, reader_main, &reader[i]);
+    }
+    for (int i = 0; i < writers; i++) {
+        pthread_create(&writer[i], NULL, writer_main, shared);
+    }
+    for (int i = 0; i < writers; i++) {
+        pthread_join(writer[i], NULL);
+    }
+    uint64_t reads = 0;
+    size_t samples = 0;
+    for (int i = 0; i < readers; i++) {
+        pthread_join(reader[i].thread, NULL);
+        reads += reader[i].reads;
+        memmove(latency + samples, reader[i].latency_ns, reader[i].latency_count * sizeof(uint32_t));
+        samples += reader[i].latency_count;
+    }
+    double elapsed_s = (bench_now_ns() - start) / 1e9;
+
+    const char *mode = locked ? "locked" : "snapshot";
+    char what[96];
+    snprintf(what, sizeof(what), "%s: every snapshot consistent", mode);
+    bench_check(atomic_load(&shared->inconsistent) == 0, what);
+    snprintf(what, sizeof(what), "%s: generations never go back", mode);
+    bench_check(atomic_load(&shared->went_back) == 0, what);
+    snprintf(what, sizeof(what), "%s: every write published", mode);
+    bench_check(atomic_load(&shared->failed_writes) == 0, what);
+    const ql_snapshot_t *last = ql_state_acquire(&shared->state);
+    snprintf(what, sizeof(what), "%s: final generation counts every write", mode);
+    bench_check(last != NULL && last->generation == (uint32_t)(writers * writes + 1), what);
+    snprintf(what, sizeof(what), "%s: predicates follow the current snapshot", mode);
+    bench_check(last != NULL && ql_state_isDeviceEnrolled(&shared->state) == (last->status == QUARKLINK_STATUS_ENROLLED) &&
+                ql_state_isDeviceFwUpdateAvailable(&shared->state) == (last->status == QUARKLINK_STATUS_FWUPDATE_REQUIRED) &&
+                ql_state_isDeviceNotEnrolled(&shared->state) == (last->status == QUARKLINK_STATUS_NOT_ENROLLED) &&
+                ql_state_isDeviceCertificateExpired(&shared->state) == (last->status == QUARKLINK_STATUS_CERTIFICATE_EXPIRED) &&
+                ql_state_isDeviceRevoked(&shared->state) == (last->status == QUARKLINK_STATUS_REVOKED), what);
+    ql_state_release(&shared->state, last);
+
+    ql_state_get_stats(&shared->state, &result->stats);
+    snprintf(what, sizeof(what), "%s: only the current snapshot left", mode);
+    bench_check(result->stats.live == 1 && result->stats.retired == result->stats.published - 1, what);
+
+    qsort(latency, samples, sizeof(uint32_t), compare_u32);
+    result->reads_per_s = reads / elapsed_s;
+    result->p50_ns = samples > 0 ? latency[samples / 2] : 0;
+    result->p99_ns = samples > 0 ? latency[samples * 99 / 100] : 0;
+    result->max_ns = samples > 0 ? latency[samples - 1] : 0;
+
+    ql_state_free(&shared->state);
+    free(latency);
+    free(writer);
+    free(reader);
+    free(shared);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -r READERS     reader threads (8)\n"
+            "  -w WRITERS     writer threads (2)\n"
+            "  -n WRITES      writes per writer (1000)\n"
+            "  -c MICROS      time a writer holds the client lock, as a QuarkLink call (100)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int readers = 8;
+    int writers = 2;
+    int writes = 1000;
+    int call_us = 100;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:n:c:h")) != -1) {
+        switch (opt) {
+        case 'r': readers = atoi(optarg); break;
+        case 'w': writers = atoi(optarg); break;
+        case 'n': writes = atoi(optarg); break;
+        case 'c': call_us = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (readers <= 0 || writers <= 0 || writes <= 0 || call_us < 0 || call_us >= 1000000) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    result_t snapshot, locked;
+    run(false, readers, writers, writes, call_us, &snapshot);
+    run(true, readers, writers, writes, call_us, &locked);
+
+    bench_check(snapshot.reads_per_s > locked.reads_per_s, "snapshots read faster than the client lock");
+
+    printf("QuarkLink state: %d readers, %d writers x %d writes, %dus per QuarkLink call\n",
+           readers, writers, writes, call_us);
+    printf("  %-10s %14s %10s %10s %12s %10s\n", "", "reads/s", "p50", "p99", "max", "peak live");
+    printf("  %-10s %14.0f %8.0fns %8.0fns %10.0fns %10u\n", "snapshot",
+           snapshot.reads_per_s, snapshot.p50_ns, snapshot.p99_ns, snapshot.max_ns, snapshot.stats.peak_live);
+    printf("  %-10s %14.0f %8.0fns %8.0fns %10.0fns %10s\n", "locked",
+           locked.reads_per_s, locked.p50_ns, locked.p99_ns, locked.max_ns, "-");
+    printf("  snapshots: %u published, %u acquired, %u retired\n",
+           snapshot.stats.published, snapshot.stats.acquired, snapshot.stats.retired);
+
+    return bench_result();
+}
@@ -0,0 +1,585 @@
+/**
+ * \file quarklink_linux.c
+ * \brief Implementation of the quarklink.h API for the simulated devices.
+ *
+ * It talks HTTPS to the QuarkLink stub (tools/quarklink_stub.py) with the stub's own REST paths:
+ *   GET  /devices/<id>/status    -> {"status": "enrolled" | "not_enrolled" | "fwupdate_required" | "certificate_expired" | "revoked"}
+ *   POST /devices/<id>/enrol     -> {"iotHubEndpoint": ..., "iotHubPort": ..., "deviceCert": ..., "iotHubRootCert": ...,
+ *                                   optionally "scopeID": ..., "fwUpdateTopic": ...}
+ *   GET  /devices/<id>/firmware  -> 204 (no update) or 200 with the image
+ * The enrolment contexts are persisted in one file per device instead of NVS.
+ * Each device keeps one HTTP/1.1 keep-alive connection to the stub, closed after an idle timeout: a status
+ * check followed by an enrol or a firmware update costs one TLS handshake instead of two or three.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+
+#include "quarklink.h"
+#include "platform.h"
+#include "platform_linux.h"
+#include "quarklink_linux.h"
+#include "net_linux.h"
+
+static const char *TAG = "quarklink_linux";
+
+const char QUARKLINK_VERSION[] = "host-stub";
+
+#define QUARKLINK_NETWORK_TIMEOUT_MS    (15000)
+#define QUARKLINK_MAX_RESPONSE_LENGTH   (8 * 1024)
+#define STORED_ENROLMENT_MAGIC          (0x514C4531) // "QLE1"
+
+typedef struct {
+    uint32_t magic;
+    char deviceCert[QUARKLINK_MAX_LONG_CERT_LENGTH];
+    char iotHubRootCert[QUARKLINK_MAX_LONG_CERT_LENGTH];
+    char iotHubEndpoint[QUARKLINK_MAX_ENDPOINT_LENGTH];
+    uint16_t iotHubPort;
+} stored_enrolment_t;
+
+static char s_endpoint[QUARKLINK_MAX_ENDPOINT_LENGTH];
+static uint16_t s_port;
+static char s_root_cert[QUARKLINK_MAX_SHORT_CERT_LENGTH];
+static char s_store_dir[256] = ".";
+
+/* Last status of the device bound to the calling thread, for the quarklink_isDevice*() predicates */
+static __thread quarklink_return_t s_last_status = QUARKLINK_ERROR;
+
+/* tempCert is not used by the stub */
+static char s_empty[1] = "";
+
+int quarklink_linux_provision(const char *endpoint, uint16_t port, const char *root_cert_path, const char *store_dir) {
+    FILE *file = fopen(root_cert_path, "r");
+    if (file == NULL) {
+        ESP_LOGE(TAG, "Cannot open %s (%s)", root_cert_path, strerror(errno));
+        return -1;
+    }
+    size_t length = fread(s_root_cert, 1, sizeof(s_root_cert) - 1, file);
+    int truncated = !feof(file);
+    fclose(file);
+    if (length == 0 || truncated) {
+        ESP_LOGE(TAG, "%s must be a PEM certificate shorter than %d bytes", root_cert_path, QUARKLINK_MAX_SHORT_CERT_LENGTH);
+        return -1;
+    }
+    s_root_cert[length] = '\0';
+    snprintf(s_endpoint, sizeof(s_endpoint), "%s", endpoint);
+    s_port = port;
+    snprintf(s_store_dir, sizeof(s_store_dir), "%s", store_dir);
+    mkdir(s_store_dir, 0755);
+    return 0;
+}
+
+/**
+ * HTTPS and JSON helpers
+ */
+
+/* Keep-alive connection of a simulated device to QuarkLink */
+typedef struct {
+    net_conn_t conn;
+    bool open;
+    /** Endpoint the connection goes to, a different one opens a new connection */
+    char host[QUARKLINK_MAX_ENDPOINT_LENGTH];
+    uint16_t port;
+    int64_t last_used_us;
+} keepalive_t;
+
+static int s_keepalive_idle_ms = QUARKLINK_LINUX_KEEPALIVE_IDLE_MS;
+static pthread_key_t s_keepalive_key;
+static pthread_once_t s_keepalive_once = PTHREAD_ONCE_INIT;
+
+static void keepalive_free(void *arg) {
+    keepalive_t *keepalive = arg;
+    if (keepalive->open) {
+        net_close(&keepalive->conn);
+    }
+    free(keepalive);
+}
+
+static void keepalive_init(void) {
+    pthread_key_create(&s_keepalive_key, keepalive_free);
+}
+
+/* Keep-alive connection of the calling device, NULL if keep-alive is disabled */
+static keepalive_t *keepalive_get(void) {
+    if (s_keepalive_idle_ms <= 0) {
+        return NULL;
+    }
+    pthread_once(&s_keepalive_once, keepalive_init);
+    keepalive_t *keepalive = pthread_getspecific(s_keepalive_key);
+    if (keepalive == NULL && (keepalive = calloc(1, sizeof(keepalive_t))) != NULL) {
+        pthread_setspecific(s_keepalive_key, keepalive);
+    }
+    return keepalive;
+}
+
+static void keepalive_close(keepalive_t *keepalive) {
+    if (keepalive != NULL && keepalive->open) {
+        net_close(&keepalive->conn);
+        keepalive->open = false;
+    }
+}
+
+/*
+ * Get a connection to QuarkLink: the keep-alive one if it is open, to the same endpoint and not idle
+ * for longer than the idle timeout, otherwise a new one. `reused` tells which.
+ */
+static net_conn_t *connection_get(const quarklink_context_t *quarklink, SSL_CTX *tls, keepalive_t *keepalive,
+                                  net_conn_t *local, bool *reused) {
+    *reused = false;
+    if (keepalive != NULL && keepalive->open) {
+        bool idle = platform_now_us() - keepalive->last_used_us > (int64_t)s_keepalive_idle_ms * 1000;
+        if (!idle && keepalive->port == quarklink->port && strcmp(keepalive->host, quarklink->endpoint) == 0) {
+            *reused = true;
+            return &keepalive->conn;
+        }
+        keepalive_close(keepalive);
+    }
+    net_conn_t *conn = keepalive != NULL ? &keepalive->conn : local;
+    if (net_connect(conn, quarklink->endpoint, quarklink->port, tls, QUARKLINK_NETWORK_TIMEOUT_MS) != 0) {
+        ESP_LOGW(TAG, "Cannot connect to %s:%u", quarklink->endpoint, quarklink->port);
+        return NULL;
+    }
+    platform_linux_stat_add(PLATFORM_LINUX_QUARKLINK_HANDSHAKES, 1);
+    if (keepalive != NULL) {
+        keepalive->open = true;
+        snprintf(keepalive->host, sizeof(keepalive->host), "%s", quarklink->endpoint);
+        keepalive->port = quarklink->port;
+    }
+    return conn;
+}
+
+/* Copy the part of a body chunk that fits in `body` */
+static void body_append(char *body, size_t body_size, size_t *body_length, const char *data, size_t length) {
+    if (body != NULL && *body_length < body_size - 1) {
+        size_t copy = length < body_size - 1 - *body_length ? length : body_size - 1 - *body_length;
+        memcpy(body + *body_length, data, copy);
+        *body_length += copy;
+    }
+}
+
+/*
+ * Send a request on `conn` and read the response. The body is delimited by its Content-Length, or by the
+ * server closing the connection. Returns the HTTP status, -1 for failure. `keep_open` tells whether the
+ * connection can take another request, `received` whether any byte of the response arrived.
+ */
+static int http_exchange(net_conn_t *conn, const char *host, const char *method, const char *path, bool keepalive,
+                         char *body, size_t body_size, size_t *total_length, bool *keep_open, bool *received) {
+    *keep_open = false;
+    *received = false;
+    char request[512];
+    int request_length = snprintf(request, sizeof(request),
+                                  "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                                  method, path, host, keepalive ? "keep-alive" : "close");
+    if (net_write(conn, request, request_length) != 0) {
+        return -1;
+    }
+
+    // Headers, the bytes read past them are the start of the body
+    char headers[1024];
+    size_t headers_length = 0;
+    char *headers_end = NULL;
+    while (headers_end == NULL) {
+        if (headers_length == sizeof(headers) - 1) {
+            return -1;
+        }
+        int n = net_read(conn, headers + headers_length, sizeof(headers) - 1 - headers_length);
+        if (n <= 0) {
+            return -1;
+        }
+        *received = true;
+        headers_length += n;
+        headers[headers_length] = '\0';
+        headers_end = strstr(headers, "\r\n\r\n");
+    }
+    const char *body_start = headers_end + 4;
+    size_t body_start_length = headers_length - (body_start - headers);
+    headers_end[2] = '\0';
+
+    int status = -1;
+    if (sscanf(headers, "HTTP/1.%*d %d", &status) != 1) {
+        return -1;
+    }
+    long content_length = -1;
+    const char *header = strcasestr(headers, "\r\nContent-Length:");
+    if (header != NULL) {
+        content_length = strtol(header + strlen("\r\nContent-Length:"), NULL, 10);
+    }
+    bool server_closes = strcasestr(headers, "\r\nConnection: close") != NULL;
+
+    size_t body_length = 0;
+    size_t total = body_start_length;
+    body_append(body, body_size, &body_length, body_start, body_start_length);
+    while (content_length < 0 || total < (size_t)content_length) {
+        char chunk[1024];
+        int n = net_read(conn, chunk, sizeof(chunk));
+        if (n <= 0) {
+            if (content_length >= 0) {
+                // Truncated response
+                return -1;
+            }
+            break;
+        }
+        total += n;
+        body_append(body, body_size, &body_length, chunk, n);
+    }
+
+    if (body != NULL) {
+        body[body_length] = '\0';
+    }
+    if (total_length != NULL) {
+        *total_length = total;
+    }
+    *keep_open = keepalive && content_length >= 0 && !server_closes && total == (size_t)content_length;
+    return status;
+}
+
+/*
+ * Send a request to the stub and read the response body into `body` (truncated to body_size - 1).
+ * Returns the HTTP status, -1 for failure. `total_length` receives the full body length.
+ *
+ * The keep-alive connection of the device is reused when it is open. If the server closed it in the
+ * meantime (nothing received), the request is sent again on a new connection.
+ */
+static int https_send(const quarklink_context_t *quarklink, const char *method, const char *path,
+                      char *body, size_t body_size, size_t *total_length) {
+    SSL_CTX *tls = net_tls_context(quarklink->rootCert);
+    if (tls == NULL) {
+        ESP_LOGE(TAG, "Invalid QuarkLink root certificate");
+        return -1;
+    }
+    keepalive_t *keepalive = keepalive_get();
+    int status = -1;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        net_conn_t local;
+        bool reused;
+        net_conn_t *conn = connection_get(quarklink, tls, keepalive, &local, &reused);
+        if (conn == NULL) {
+            return -1;
+        }
+        bool keep_open;
+        bool received;
+        status = http_exchange(conn, quarklink->endpoint, method, path, keepalive != NULL, body, body_size,
+                               total_length, &keep_open, &received);
+        if (keepalive == NULL) {
+            net_close(conn);
+            break;
+        }
+        if (keep_open) {
+            keepalive->last_used_us = platform_now_us();
+        }
+        else {
+            keepalive_close(keepalive);
+        }
+        if (status >= 0 || !reused || received) {
+            break;
+        }
+        ESP_LOGD(TAG, "Keep-alive connection closed by the server, reconnecting");
+    }
+    return status;
+}
+
+/* An API call: counted here, platform_connection_begin() also marks the broker race of the application */
+static int https_request(const quarklink_context_t *quarklink, const char *method, const char *path,
+                         char *body, size_t body_size, size_t *total_length) {
+    platform_linux_stat_add(PLATFORM_LINUX_QUARKLINK_REQUESTS, 1);
+    platform_linux_stat_add(PLATFORM_LINUX_QUARKLINK_ACTIVE, 1);
+    int status = https_send(quarklink, method, path, body, body_size, total_length);
+    platform_linux_stat_add(PLATFORM_LINUX_QUARKLINK_ACTIVE, -1);
+    return status;
+}
+
+/* Minimal lookup of a string value in a flat JSON object */
+static int json_get_string(const char *json, const char *key, char *value, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(json, pattern);
+    if (p == NULL) {
+        return -1;
+    }
+    p = strchr(p + strlen(pattern), ':');
+    if (p == NULL || (p = strchr(p, '"')) == NULL) {
+        return -1;
+    }
+    p++;
+    size_t length = 0;
+    while (*p != '\0' && *p != '"') {
+        char c = *p++;
+        if (c == '\\') {
+            c = *p++;
+            if (c == 'n') {
+                c = '\n';
+            }
+            else if (c == 'r') {
+                c = '\r';
+            }
+            else if (c == '\0') {
+                return -1;
+            }
+        }
+        if (length + 1 >= size) {
+            return -1;
+        }
+        value[length++] = c;
+    }
+    value[length] = '\0';
+    return *p == '"' ? 0 : -1;
+}
+
+static int json_get_int(const char *json, const char *key, long *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char *p = strstr(json, pattern);
+    if (p == NULL || (p = strchr(p + strlen(pattern), ':')) == NULL) {
+        return -1;
+    }
+    char *end;
+    *value = strtol(p + 1, &end, 10);
+    return end == p + 1 ? -1 : 0;
+}
+
+static void store_path(const quarklink_context_t *quarklink, char *path, size_t size) {
+    snprintf(path, size, "%s/%s.enrol", s_store_dir, quarklink->deviceID);
+}
+
+void quarklink_linux_set_keepalive(int idle_ms) {
+    s_keepalive_idle_ms = idle_ms;
+}
+
+void quarklink_linux_disconnect(void) {
+    if (s_keepalive_idle_ms > 0) {
+        keepalive_close(keepalive_get());
+    }
+}
+
+/*
+ * The scope ID and the firmware update topic are heap strings of the context, as in the QuarkLink client: the
+ * previous values are freed or reallocated, which a context pointing them elsewhere does not survive.
+ */
+static quarklink_return_t set_enrolment_strings(quarklink_context_t *quarklink, const char *body) {
+    char value[QUARKLINK_MAX_ENDPOINT_LENGTH];
+    if (json_get_string(body, "scopeID", value, sizeof(value)) != 0) {
+        value[0] = '\0';
+    }
+    char *scope_id = strdup(value);
+    if (scope_id == NULL) {
+        return QUARKLINK_ERROR;
+    }
+    free(quarklink->scopeID);
+    quarklink->scopeID = scope_id;
+
+    if (json_get_string(body, "fwUpdateTopic", value, sizeof(value)) != 0) {
+        value[0] = '\0';
+    }
+    char *topic = realloc(quarklink->fwUpdateTopic, strlen(value) + 1);
+    if (topic == NULL) {
+        return QUARKLINK_ERROR;
+    }
+    strcpy(topic, value);
+    quarklink->fwUpdateTopic = topic;
+    return QUARKLINK_SUCCESS;
+}
+
+/**
+ * quarklink.h API
+ */
+
+quarklink_return_t quarklink_init(quarklink_context_t *quarklink, const char *endpoint, const char *rootCert) {
+    if (quarklink == NULL || endpoint == NULL || rootCert == NULL) {
+        return QUARKLINK_INVALID_PARAMETER;
+    }
+    const char *device_id = platform_linux_device_id();
+    if (device_id == NULL) {
+        return QUARKLINK_NOT_INITIALISED;
+    }
+    memset(quarklink, 0, sizeof(quarklink_context_t));
+    snprintf(quarklink->endpoint, sizeof(quarklink->endpoint), "%s", endpoint);
+    snprintf(quarklink->rootCert, sizeof(quarklink->rootCert), "%s", rootCert);
+    snprintf(quarklink->deviceID, sizeof(quarklink->deviceID), "%s", device_id);
+    quarklink->port = 443;
+    quarklink->tempCert = s_empty;
+    return QUARKLINK_SUCCESS;
+}
+
+quarklink_return_t quarklink_status(quarklink_context_t *quarklink) {
+    static const struct {
+        const char *name;
+        quarklink_return_t status;
+    } statuses[] = {
+        { "enrolled",               QUARKLINK_STATUS_ENROLLED },
+        { "fwupdate_required",      QUARKLINK_STATUS_FWUPDATE_REQUIRED },
+        { "not_enrolled",           QUARKLINK_STATUS_NOT_ENROLLED },
+        { "certificate_expired",    QUARKLINK_STATUS_CERTIFICATE_EXPIRED },
+        { "revoked",                QUARKLINK_STATUS_REVOKED },
+    };
+
+    char path[128];
+    char body[256];
+    snprintf(path, sizeof(path), "/devices/%s/status", quarklink->deviceID);
+    int http_status = https_request(quarklink, "GET", path, body, sizeof(body), NULL);
+    if (http_status < 0) {
+        return QUARKLINK_COMMUNICATION_ERROR;
+    }
+    char status[QUARKLINK_MAX_SHORT_DATA_LENGTH];
+    if (http_status != 200 || json_get_string(body, "status", status, sizeof(status)) != 0) {
+        return QUARKLINK_ERROR;
+    }
+    for (size_t i = 0; i < sizeof(statuses) / sizeof(statuses[0]); i++) {
+        if (strcmp(status, statuses[i].name) == 0) {
+            s_last_status = statuses[i].status;
+            return statuses[i].status;
+        }
+    }
+    return QUARKLINK_ERROR;
+}
+
+quarklink_return_t quarklink_enrol(quarklink_context_t *quarklink) {
+    char path[128];
+    char *body = malloc(QUARKLINK_MAX_RESPONSE_LENGTH);
+    if (body == NULL) {
+        return QUARKLINK_ERROR;
+    }
+    snprintf(path, sizeof(path), "/devices/%s/enrol", quarklink->deviceID);
+    int http_status = https_request(quarklink, "POST", path, body, QUARKLINK_MAX_RESPONSE_LENGTH, NULL);
+
+    quarklink_return_t ret = QUARKLINK_SUCCESS;
+    long port = 0;
+    if (http_status < 0) {
+        ret = QUARKLINK_COMMUNICATION_ERROR;
+    }
+    else if (http_status == 404) {
+        ret = QUARKLINK_DEVICE_DOES_NOT_EXIST;
+    }
+    else if (http_status == 403) {
+        ret = QUARKLINK_DEVICE_REVOKED;
+    }
+    else if (http_status != 200 ||
+             json_get_string(body, "iotHubEndpoint", quarklink->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint)) != 0 ||
+             json_get_int(body, "iotHubPort", &port) != 0 ||
+             json_get_string(body, "deviceCert", quarklink->deviceCert, sizeof(quarklink->deviceCert)) != 0 ||
+             json_get_string(body, "iotHubRootCert", quarklink->iotHubRootCert, sizeof(quarklink->iotHubRootCert)) != 0) {
+        ret = QUARKLINK_ERROR;
+    }
+    else {
+        quarklink->iotHubPort = (uint16_t)port;
+        ret = set_enrolment_strings(quarklink, body);
+    }
+    free(body);
+    return ret;
+}
+
+quarklink_return_t quarklink_firmwareUpdate(quarklink_context_t *quarklink, const char *signingKey) {
+    (void)signingKey;
+    char path[128];
+    size_t image_length = 0;
+    snprintf(path, sizeof(path), "/devices/%s/firmware", quarklink->deviceID);
+    // The image is only downloaded, to load the server like a real update
+    int http_status = https_request(quarklink, "GET", path, NULL, 0, &image_length);
+    if (http_status == 204) {
+        return QUARKLINK_FWUPDATE_NO_UPDATE;
+    }
+    if (http_status == 200 && image_length > 0) {
+        ESP_LOGI(TAG, "Downloaded %zu bytes", image_length);
+        return QUARKLINK_FWUPDATE_UPDATED;
+    }
+    return QUARKLINK_FWUPDATE_ERROR;
+}
+
+quarklink_return_t quarklink_persistContext(const quarklink_context_t *quarklink) {
+    // The provisioning data comes from quarklink_linux_provision(): only the enrolment is stored
+    return quarklink_persistEnrolmentContext(quarklink);
+}
+
+quarklink_return_t quarklink_persistEnrolmentContext(const quarklink_context_t *quarklink) {
+    stored_enrolment_t *stored = calloc(1, sizeof(stored_enrolment_t));
+    if (stored == NULL) {
+        return QUARKLINK_ERROR;
+    }
+    stored->magic = STORED_ENROLMENT_MAGIC;
+    memcpy(stored->deviceCert, quarklink->deviceCert, sizeof(stored->deviceCert));
+    memcpy(stored->iotHubRootCert, quarklink->iotHubRootCert, sizeof(stored->iotHubRootCert));
+    memcpy(stored->iotHubEndpoint, quarklink->iotHubEndpoint, sizeof(stored->iotHubEndpoint));
+    stored->iotHubPort = quarklink->iotHubPort;
+
+    char path[512];
+    char temp_path[520];
+    store_path(quarklink, path, sizeof(path));
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    quarklink_return_t ret = QUARKLINK_NVM_ERROR;
+    FILE *file = fopen(temp_path, "wb");
+    if (file != NULL) {
+        size_t written = fwrite(stored, sizeof(stored_enrolment_t), 1, file);
+        if (fclose(file) == 0 && written == 1 && rename(temp_path, path) == 0) {
+            ret = QUARKLINK_SUCCESS;
+        }
+    }
+    free(stored);
+    return ret;
+}
+
+quarklink_return_t quarklink_loadStoredContext(quarklink_context_t *quarklink) {
+    if (s_endpoint[0] == '\0') {
+        return QUARKLINK_CONTEXT_NOTHING_STORED;
+    }
+    snprintf(quarklink->endpoint, sizeof(quarklink->endpoint), "%s", s_endpoint);
+    quarklink->port = s_port;
+    memcpy(quarklink->rootCert, s_root_cert, sizeof(quarklink->rootCert));
+
+    char path[512];
+    store_path(quarklink, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return QUARKLINK_CONTEXT_NO_ENROLMENT_INFO_STORED;
+    }
+    stored_enrolment_t *stored = malloc(sizeof(stored_enrolment_t));
+    quarklink_return_t ret = QUARKLINK_NVM_ERROR;
+    if (stored != NULL && fread(stored, sizeof(stored_enrolment_t), 1, file) == 1 && stored->magic == STORED_ENROLMENT_MAGIC) {
+        memcpy(quarklink->deviceCert, stored->deviceCert, sizeof(quarklink->deviceCert));
+        memcpy(quarklink->iotHubRootCert, stored->iotHubRootCert, sizeof(quarklink->iotHubRootCert));
+        memcpy(quarklink->iotHubEndpoint, stored->iotHubEndpoint, sizeof(quarklink->iotHubEndpoint));
+        quarklink->iotHubPort = stored->iotHubPort;
+        ret = QUARKLINK_SUCCESS;
+    }
+    free(stored);
+    fclose(file);
+    return ret;
+}
+
+quarklink_return_t quarklink_deleteEnrolmentContext(const quarklink_context_t *quarklink) {
+    char path[512];
+    store_path(quarklink, path, sizeof(path));
+    return (unlink(path) == 0 || errno == ENOENT) ? QUARKLINK_SUCCESS : QUARKLINK_NVM_ERROR;
+}
+
+quarklink_return_t quarklink_deleteContext(const quarklink_context_t *quarklink) {
+    return quarklink_deleteEnrolmentContext(quarklink);
+}
+
+int quarklink_isDeviceEnrolled() {
+    return s_last_status == QUARKLINK_STATUS_ENROLLED;
+}
+
+int quarklink_isDeviceNotEnrolled() {
+    return s_last_status == QUARKLINK_STATUS_NOT_ENROLLED;
+}
+
+int quarklink_isDeviceRevoked() {
+    return s_last_status == QUARKLINK_STATUS_REVOKED;
+}
+
+int quarklink_isDevicePendingRevoke() {
+    return 0;
+}
+
+int quarklink_isDeviceCertificateExpired() {
+    return s_last_status == QUARKLINK_STATUS_CERTIFICATE_EXPIRED;
+}
+
+int quarklink_isDeviceFwUpdateAvailable() {
+    return s_last_status == QUARKLINK_STATUS_FWUPDATE_REQUIRED;
+}
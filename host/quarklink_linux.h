@@ -0,0 +1,45 @@
+/**
+ * \file quarklink_linux.h
+ * \brief Host-only setup of the Linux QuarkLink client (quarklink_linux.c).
+ */
+#ifndef _QUARKLINK_LINUX_H_
+#define _QUARKLINK_LINUX_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Set the provisioning data returned by quarklink_loadStoredContext() to every simulated device,
+ * as if they had all been provisioned against the same QuarkLink instance.
+ * \param[in] endpoint       the QuarkLink (stub) host
+ * \param[in] port           the QuarkLink (stub) port
+ * \param[in] root_cert_path the PEM file of the QuarkLink (stub) root certificate
+ * \param[in] store_dir      the directory where the enrolment contexts are persisted, one file per device
+ * \return 0 for success, -1 if the root certificate could not be read
+ */
+int quarklink_linux_provision(const char *endpoint, uint16_t port, const char *root_cert_path, const char *store_dir);
+
+/** Default idle time after which a device closes its keep-alive connection to QuarkLink */
+#define QUARKLINK_LINUX_KEEPALIVE_IDLE_MS   (30000)
+
+/**
+ * \brief Set the idle timeout of the keep-alive connections, for every device. Each device keeps its connection
+ * to QuarkLink open between API calls, and opens a new one when it was idle for longer than \p idle_ms.
+ * \param[in] idle_ms the idle timeout, 0 to open a connection per API call (`Connection: close`)
+ */
+void quarklink_linux_set_keepalive(int idle_ms);
+
+/**
+ * \brief Close the keep-alive connection of the device bound to the calling thread, as a reboot does.
+ */
+void quarklink_linux_disconnect(void);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _QUARKLINK_LINUX_H_
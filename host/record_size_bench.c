@@ -0,0 +1,230 @@
+/**
+ * \file record_size_bench.c
+ * \brief Largest TLS records of an MQTT connection in each direction, with and without the max_fragment_length
+ *        limit the device requests (MQTT_TLS_MAX_FRAG_LEN, platform_esp32.c).
+ *
+ * A TLS server stands in for the broker on a socket pair. After the handshake it sends a small and a large
+ * PUBLISH-sized payload (a command, a device twin), and the client sends a small and a large one (telemetry,
+ * a batch). Every record header seen by the client is recorded: the largest record received is the input buffer
+ * mbedtls needs, the largest sent the output buffer, once CONFIG_MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH has shrunk
+ * them to the negotiated length.
+ *
+ * The client requests the limit as the mbedtls client of the device does: with TLS 1.2 only. The mbedtls TLS 1.3
+ * client sends no max_fragment_length, and its record_size_limit (RFC 8449) would announce the compile-time
+ * CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN for every connection, the QuarkLink API ones included. It checks that the limit
+ * bounds the records both ways with TLS 1.2, and that TLS 1.2 without it and TLS 1.3 keep full-size records.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include "bench.h"
+
+/** MQTT_TLS_MAX_FRAG_LEN: MBEDTLS_SSL_MAX_FRAG_LEN_2048 */
+#define FRAGMENT_LENGTH     (2048)
+/** Largest expansion of a TLS 1.2 record: header, explicit IV, MAC and padding */
+#define RECORD_OVERHEAD     (5 + 256)
+#define SMALL_PAYLOAD       (120)
+#define LARGE_DOWN_PAYLOAD  (6000)
+#define LARGE_UP_PAYLOAD    (3000)
+
+typedef struct {
+    const char *name;
+    int version;
+    bool limit;
+} config_t;
+
+static const config_t s_configs[] = {
+    { "TLS 1.2",            TLS1_2_VERSION, false },
+    { "TLS 1.2 + limit",    TLS1_2_VERSION, true },
+    { "TLS 1.3",            TLS1_3_VERSION, false },
+    { "TLS 1.3 + limit",    TLS1_3_VERSION, true },
+};
+
+#define CONFIG_COUNT    (sizeof(s_configs) / sizeof(s_configs[0]))
+
+typedef struct {
+    /** Largest records, header included */
+    size_t largest_in;
+    size_t largest_out;
+    uint32_t records_in;
+    uint32_t records_out;
+    /** Negotiated max_fragment_length, 0 for none */
+    size_t negotiated;
+    bool transferred;
+} result_t;
+
+typedef struct {
+    SSL_CTX *ctx;
+    int fd;
+    bool ok;
+} server_t;
+
+static SSL_CTX *server_context(void) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    EVP_PKEY *key = EVP_RSA_gen(2048);
+    X509 *crt = X509_new();
+    if (ctx == NULL || key == NULL || crt == NULL) {
+        return NULL;
+    }
+    X509_set_version(crt, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(crt), 1);
+    X509_gmtime_adj(X509_getm_notBefore(crt), 0);
+    X509_gmtime_adj(X509_getm_notAfter(crt), 24 * 3600);
+    X509_set_pubkey(crt, key);
+    X509_NAME *name = X509_get_subject_name(crt);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)"broker.example-iot.net", -1, -1, 0);
+    X509_set_issuer_name(crt, name);
+    X509_sign(crt, key, EVP_sha256());
+    int ret = SSL_CTX_use_certificate(ctx, crt) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1;
+    X509_free(crt);
+    EVP_PKEY_free(key);
+    if (!ret) {
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static bool read_exactly(SSL *ssl, size_t length) {
+    char buffer[1024];
+    while (length > 0) {
+        int n = SSL_read(ssl, buffer, length < sizeof(buffer) ? (int)length : (int)sizeof(buffer));
+        if (n <= 0) {
+            return false;
+        }
+        length -= n;
+    }
+    return true;
+}
+
+static bool write_payload(SSL *ssl, size_t length) {
+    char *payload = malloc(length);
+    if (payload == NULL) {
+        return false;
+    }
+    memset(payload, 'p', length);
+    bool ok = SSL_write(ssl, payload, (int)length) == (int)length;
+    free(payload);
+    return ok;
+}
+
+static void *server_main(void *arg) {
+    server_t *server = arg;
+    SSL *ssl = SSL_new(server->ctx);
+    server->ok = ssl != NULL && SSL_set_fd(ssl, server->fd) == 1 && SSL_accept(ssl) == 1 &&
+                 write_payload(ssl, SMALL_PAYLOAD) && write_payload(ssl, LARGE_DOWN_PAYLOAD) &&
+                 read_exactly(ssl, SMALL_PAYLOAD + LARGE_UP_PAYLOAD);
+    if (ssl != NULL) {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+    close(server->fd);
+    return NULL;
+}
+
+/* Record headers seen by the client, both ways */
+static void on_message(int write_p, int version, int content_type, const void *buf, size_t len, SSL *ssl, void *arg) {
+    result_t *result = arg;
+    if (content_type != SSL3_RT_HEADER || len < 5) {
+        return;
+    }
+    const unsigned char *header = buf;
+    size_t length = 5 + ((size_t)header[3] << 8 | header[4]);
+    if (write_p) {
+        result->records_out++;
+        result->largest_out = length > result->largest_out ? length : result->largest_out;
+    }
+    else {
+        result->records_in++;
+        result->largest_in = length > result->largest_in ? length : result->largest_in;
+    }
+}
+
+static void run(SSL_CTX *server_ctx, const config_t *config, result_t *result) {
+    memset(result, 0, sizeof(result_t));
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        return;
+    }
+    server_t server = { .ctx = server_ctx, .fd = fds[1] };
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server_main, &server) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_min_proto_version(ctx, config->version);
+    SSL_CTX_set_max_proto_version(ctx, config->version);
+    // The stand-in is self-signed: the records are measured, not the verification
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+    SSL *ssl = SSL_new(ctx);
+    SSL_set_msg_callback(ssl, on_message);
+    SSL_set_msg_callback_arg(ssl, result);
+    SSL_set_fd(ssl, fds[0]);
+    // As the mbedtls client: max_fragment_length with TLS 1.2 only
+    if (config->limit && config->version == TLS1_2_VERSION) {
+        SSL_set_tlsext_max_fragment_length(ssl, TLSEXT_max_fragment_length_2048);
+    }
+    if (SSL_connect(ssl) == 1) {
+        uint8_t mfl = SSL_SESSION_get_max_fragment_length(SSL_get0_session(ssl));
+        result->negotiated = (mfl != TLSEXT_max_fragment_length_DISABLED) ? (size_t)256 << mfl : 0;
+        result->transferred = read_exactly(ssl, SMALL_PAYLOAD + LARGE_DOWN_PAYLOAD) &&
+                              write_payload(ssl, SMALL_PAYLOAD) && write_payload(ssl, LARGE_UP_PAYLOAD);
+        SSL_shutdown(ssl);
+    }
+    ERR_clear_error();
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    close(fds[0]);
+    pthread_join(thread, NULL);
+    result->transferred = result->transferred && server.ok;
+}
+
+int main(int argc, char **argv) {
+    // Either end may close while the other writes its close_notify
+    signal(SIGPIPE, SIG_IGN);
+    SSL_CTX *server_ctx = server_context();
+    if (server_ctx == NULL) {
+        fprintf(stderr, "Failed to create the broker stand-in\n");
+        return 1;
+    }
+    SSL_CTX_set_min_proto_version(server_ctx, TLS1_2_VERSION);
+
+    result_t results[CONFIG_COUNT];
+    for (size_t i = 0; i < CONFIG_COUNT; i++) {
+        run(server_ctx, &s_configs[i], &results[i]);
+    }
+    SSL_CTX_free(server_ctx);
+
+    printf("Largest TLS records, header included: %d + %d bytes received, %d + %d bytes sent\n",
+           SMALL_PAYLOAD, LARGE_DOWN_PAYLOAD, SMALL_PAYLOAD, LARGE_UP_PAYLOAD);
+    printf("  %-18s %12s %14s %10s %14s %10s\n", "", "negotiated", "largest in", "records", "largest out", "records");
+    for (size_t i = 0; i < CONFIG_COUNT; i++) {
+        const result_t *result = &results[i];
+        printf("  %-18s %12zu %14zu %10u %14zu %10u\n", s_configs[i].name, result->negotiated, result->largest_in,
+               result->records_in, result->largest_out, result->records_out);
+        char what[96];
+        snprintf(what, sizeof(what), "%s: payloads transferred", s_configs[i].name);
+        bench_check(result->transferred, what);
+    }
+    const size_t bounded = FRAGMENT_LENGTH + RECORD_OVERHEAD;
+    const result_t *limited = &results[1];
+    bench_check(limited->negotiated == FRAGMENT_LENGTH && limited->largest_in <= bounded && limited->largest_out <= bounded,
+                "TLS 1.2: the limit bounds the records both ways");
+    bench_check(results[0].largest_in > bounded && results[0].largest_out > bounded,
+                "TLS 1.2 without the limit: full-size records");
+    bench_check(results[3].negotiated == 0 && results[3].largest_in > bounded,
+                "TLS 1.3: no limit negotiated, full-size records");
+    return bench_result();
+}
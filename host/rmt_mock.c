@@ -0,0 +1,672 @@
+/**
+ * \file rmt_mock.c
+ * \brief Host implementation of the ESP-IDF RMT TX driver, see rmt_mock.h.
+ *
+ * Only what the LED strip component uses is implemented: TX channels, the bytes, copy and simple
+ * encoders, the transaction queue, the trans done callback and the sync manager. The callback runs
+ * on the channel thread, where it runs in the RMT interrupt on the device.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bench.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "soc/soc_caps.h"
+
+#include "rmt_mock.h"
+
+static const char *TAG = "rmt_mock";
+
+typedef struct {
+    rmt_encoder_handle_t encoder;
+    const void *payload;
+    size_t payload_bytes;
+} rmt_mock_trans_t;
+
+struct rmt_channel_t {
+    rmt_tx_channel_config_t config;
+    rmt_tx_done_callback_t on_trans_done;
+    void *user_data;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool enabled;
+    bool stopping;
+    /* Transactions queued or in flight, popped once their callback has returned */
+    rmt_mock_trans_t *queue;
+    size_t head;
+    size_t tail;
+    /* Simulated channel memory, written by the encoders */
+    rmt_symbol_word_t *mem;
+    size_t mem_used;
+    /* Symbols of the transaction in flight, then of the last one */
+    rmt_symbol_word_t *symbols;
+    size_t symbols_len;
+    size_t symbols_size;
+    rmt_symbol_word_t *last;
+    size_t last_len;
+    size_t last_size;
+    rmt_mock_stats_t stats;
+    /* Sync manager holding the start of the transactions, NULL if none */
+    struct rmt_sync_manager_t *sync;
+    struct rmt_channel_t *next;
+};
+
+/*
+ * The hardware starts the managed channels together once every one of them has a transaction:
+ * the channel threads meet at a barrier before sending.
+ */
+struct rmt_sync_manager_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    rmt_channel_handle_t *channels;
+    size_t count;
+    /* Channels waiting for the others, and the number of starts, which releases them */
+    size_t arrived;
+    uint64_t starts;
+};
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_bytes_encoder_config_t config;
+    size_t byte;
+    int bit;
+} rmt_mock_bytes_encoder_t;
+
+typedef struct {
+    rmt_encoder_t base;
+    size_t offset;
+} rmt_mock_copy_encoder_t;
+
+static pthread_mutex_t s_channels_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rmt_channel_t *s_channels = NULL;
+static atomic_bool s_real_time = true;
+
+/* Move the first `count` symbols of the memory block to the symbols of the transaction, as the hardware sends them out */
+static bool channel_drain(rmt_channel_handle_t chan, size_t count) {
+    if (chan->symbols_len + count > chan->symbols_size) {
+        size_t size = (chan->symbols_size == 0) ? chan->config.mem_block_symbols : chan->symbols_size;
+        while (size < chan->symbols_len + count) {
+            size *= 2;
+        }
+        rmt_symbol_word_t *symbols = realloc(chan->symbols, size * sizeof(rmt_symbol_word_t));
+        if (symbols == NULL) {
+            return false;
+        }
+        chan->symbols = symbols;
+        chan->symbols_size = size;
+    }
+    memcpy(chan->symbols + chan->symbols_len, chan->mem, count * sizeof(rmt_symbol_word_t));
+    chan->symbols_len += count;
+    chan->mem_used -= count;
+    memmove(chan->mem, chan->mem + count, chan->mem_used * sizeof(rmt_symbol_word_t));
+    return true;
+}
+
+/**
+ * \brief Encode a transaction and wait for the time it takes on the wire.
+ * \param[out] refills the number of times the memory block was full
+ * \param[out] encode_ns the time spent in the encoder
+ * \return the wire time in us
+ */
+static uint64_t channel_send(rmt_channel_handle_t chan, const rmt_mock_trans_t *trans, uint32_t *refills,
+                             uint64_t *encode_ns) {
+    chan->symbols_len = 0;
+    chan->mem_used = 0;
+    *refills = 0;
+    *encode_ns = 0;
+    // the memory block is used as two halves: the hardware sends one while the refill interrupt encodes the other
+    size_t half = chan->config.mem_block_symbols / 2;
+    if (half == 0) {
+        half = 1;
+    }
+    while (true) {
+        rmt_encode_state_t state = RMT_ENCODING_RESET;
+        int64_t start = bench_now_ns();
+        size_t encoded = trans->encoder->encode(trans->encoder, chan, trans->payload, trans->payload_bytes, &state);
+        *encode_ns += bench_now_ns() - start;
+        if (state & RMT_ENCODING_COMPLETE) {
+            if (!channel_drain(chan, chan->mem_used)) {
+                ESP_LOGE(TAG, "no mem for the symbols of the transaction");
+            }
+            break;
+        }
+        if (state & RMT_ENCODING_MEM_FULL) {
+            (*refills)++;
+            if (!channel_drain(chan, chan->mem_used < half ? chan->mem_used : half)) {
+                ESP_LOGE(TAG, "no mem for the symbols of the transaction");
+                break;
+            }
+        }
+        else if (encoded == 0) {
+            ESP_LOGE(TAG, "encoder made no progress, transaction dropped");
+            break;
+        }
+    }
+
+    uint64_t ticks = 0;
+    for (size_t i = 0; i < chan->symbols_len; i++) {
+        ticks += chan->symbols[i].duration0 + chan->symbols[i].duration1;
+    }
+    uint64_t wire_ns = ticks * 1000000000 / chan->config.resolution_hz;
+    if (atomic_load(&s_real_time) && wire_ns > 0) {
+        struct timespec ts = { .tv_sec = wire_ns / 1000000000, .tv_nsec = wire_ns % 1000000000 };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        }
+    }
+    return wire_ns / 1000;
+}
+
+/* Wait until every channel of the sync manager has a transaction to send */
+static void sync_wait(struct rmt_sync_manager_t *sync) {
+    pthread_mutex_lock(&sync->lock);
+    uint64_t starts = sync->starts;
+    if (++sync->arrived == sync->count) {
+        sync->arrived = 0;
+        sync->starts++;
+        pthread_cond_broadcast(&sync->cond);
+    }
+    while (sync->starts == starts) {
+        pthread_cond_wait(&sync->cond, &sync->lock);
+    }
+    pthread_mutex_unlock(&sync->lock);
+}
+
+static void *channel_thread(void *arg) {
+    rmt_channel_handle_t chan = arg;
+    pthread_mutex_lock(&chan->lock);
+    while (true) {
+        while (!chan->stopping && (!chan->enabled || chan->head == chan->tail)) {
+            pthread_cond_wait(&chan->cond, &chan->lock);
+        }
+        if (chan->stopping) {
+            break;
+        }
+        rmt_mock_trans_t trans = chan->queue[chan->tail % chan->config.trans_queue_depth];
+        struct rmt_sync_manager_t *sync = chan->sync;
+        pthread_mutex_unlock(&chan->lock);
+
+        if (sync != NULL) {
+            sync_wait(sync);
+        }
+        int64_t start_us = bench_now_ns() / 1000;
+        uint32_t refills;
+        uint64_t encode_ns;
+        uint64_t wire_us = channel_send(chan, &trans, &refills, &encode_ns);
+        rmt_tx_done_event_data_t edata = { .num_symbols = chan->symbols_len };
+        if (chan->on_trans_done) {
+            chan->on_trans_done(chan, &edata, chan->user_data);
+        }
+
+        pthread_mutex_lock(&chan->lock);
+        rmt_symbol_word_t *last = chan->last;
+        size_t last_size = chan->last_size;
+        chan->last = chan->symbols;
+        chan->last_len = chan->symbols_len;
+        chan->last_size = chan->symbols_size;
+        chan->symbols = last;
+        chan->symbols_size = last_size;
+        chan->stats.transactions++;
+        chan->stats.refills += refills;
+        chan->stats.symbols += chan->last_len;
+        chan->stats.encode_ns += encode_ns;
+        chan->stats.wire_us += wire_us;
+        chan->stats.last_start_us = start_us;
+        chan->tail++;
+        pthread_cond_broadcast(&chan->cond);
+    }
+    pthread_mutex_unlock(&chan->lock);
+    return NULL;
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t *config, rmt_channel_handle_t *ret_chan) {
+    ESP_RETURN_ON_FALSE(config && ret_chan, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->resolution_hz > 0 && config->mem_block_symbols > 0 && config->trans_queue_depth > 0,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid channel configuration");
+    rmt_channel_handle_t chan = calloc(1, sizeof(struct rmt_channel_t));
+    ESP_RETURN_ON_FALSE(chan, ESP_ERR_NO_MEM, TAG, "no mem for channel");
+    chan->config = *config;
+    chan->queue = calloc(config->trans_queue_depth, sizeof(rmt_mock_trans_t));
+    chan->mem = calloc(config->mem_block_symbols, sizeof(rmt_symbol_word_t));
+    if (chan->queue == NULL || chan->mem == NULL) {
+        free(chan->queue);
+        free(chan->mem);
+        free(chan);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_init(&chan->lock, NULL);
+    pthread_cond_init(&chan->cond, NULL);
+    if (pthread_create(&chan->thread, NULL, channel_thread, chan) != 0) {
+        free(chan->queue);
+        free(chan->mem);
+        free(chan);
+        return ESP_FAIL;
+    }
+    pthread_mutex_lock(&s_channels_lock);
+    chan->next = s_channels;
+    s_channels = chan;
+    pthread_mutex_unlock(&s_channels_lock);
+    *ret_chan = chan;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel) {
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    pthread_mutex_lock(&channel->lock);
+    bool enabled = channel->enabled;
+    channel->stopping = !enabled;
+    pthread_cond_broadcast(&channel->cond);
+    pthread_mutex_unlock(&channel->lock);
+    ESP_RETURN_ON_FALSE(!enabled, ESP_ERR_INVALID_STATE, TAG, "channel not in init state");
+    pthread_join(channel->thread, NULL);
+
+    pthread_mutex_lock(&s_channels_lock);
+    for (rmt_channel_handle_t *it = &s_channels; *it != NULL; it = &(*it)->next) {
+        if (*it == channel) {
+            *it = channel->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_channels_lock);
+    pthread_cond_destroy(&channel->cond);
+    pthread_mutex_destroy(&channel->lock);
+    free(channel->queue);
+    free(channel->mem);
+    free(channel->symbols);
+    free(channel->last);
+    free(channel);
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&channel->lock);
+    if (channel->enabled) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else {
+        channel->enabled = true;
+        channel->stats.enables++;
+        pthread_cond_broadcast(&channel->cond);
+    }
+    pthread_mutex_unlock(&channel->lock);
+    return ret;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t channel) {
+    ESP_RETURN_ON_FALSE(channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&channel->lock);
+    if (!channel->enabled) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    channel->enabled = false;
+    pthread_mutex_unlock(&channel->lock);
+    return ret;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t tx_channel, const rmt_tx_event_callbacks_t *cbs, void *user_data) {
+    ESP_RETURN_ON_FALSE(tx_channel && cbs, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    pthread_mutex_lock(&tx_channel->lock);
+    bool enabled = tx_channel->enabled;
+    if (!enabled) {
+        tx_channel->on_trans_done = cbs->on_trans_done;
+        tx_channel->user_data = user_data;
+    }
+    pthread_mutex_unlock(&tx_channel->lock);
+    ESP_RETURN_ON_FALSE(!enabled, ESP_ERR_INVALID_STATE, TAG, "channel not in init state");
+    return ESP_OK;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t tx_channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes, const rmt_transmit_config_t *config) {
+    ESP_RETURN_ON_FALSE(tx_channel && encoder && payload && payload_bytes && config, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->loop_count == 0, ESP_ERR_NOT_SUPPORTED, TAG, "loop count not supported");
+    size_t depth = tx_channel->config.trans_queue_depth;
+    pthread_mutex_lock(&tx_channel->lock);
+    while (tx_channel->head - tx_channel->tail >= depth) {
+        if (config->flags.queue_nonblocking) {
+            tx_channel->stats.rejected++;
+            pthread_mutex_unlock(&tx_channel->lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        pthread_cond_wait(&tx_channel->cond, &tx_channel->lock);
+    }
+    tx_channel->queue[tx_channel->head % depth] = (rmt_mock_trans_t) {
+        .encoder = encoder,
+        .payload = payload,
+        .payload_bytes = payload_bytes,
+    };
+    tx_channel->head++;
+    pthread_cond_broadcast(&tx_channel->cond);
+    pthread_mutex_unlock(&tx_channel->lock);
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t tx_channel, int timeout_ms) {
+    ESP_RETURN_ON_FALSE(tx_channel, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeout_ms > 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&tx_channel->lock);
+    while (tx_channel->head != tx_channel->tail) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&tx_channel->cond, &tx_channel->lock);
+        }
+        else if (pthread_cond_timedwait(&tx_channel->cond, &tx_channel->lock, &deadline) == ETIMEDOUT) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&tx_channel->lock);
+    return ret;
+}
+
+esp_err_t rmt_new_sync_manager(const rmt_sync_manager_config_t *config, rmt_sync_manager_handle_t *ret_synchro) {
+    ESP_RETURN_ON_FALSE(config && config->tx_channel_array && config->array_size && ret_synchro, ESP_ERR_INVALID_ARG,
+                        TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->array_size <= SOC_RMT_TX_CANDIDATES_PER_GROUP, ESP_ERR_INVALID_ARG, TAG,
+                        "too many channels");
+    for (size_t i = 0; i < config->array_size; i++) {
+        rmt_channel_handle_t chan = config->tx_channel_array[i];
+        ESP_RETURN_ON_FALSE(chan, ESP_ERR_INVALID_ARG, TAG, "invalid channel");
+        pthread_mutex_lock(&chan->lock);
+        bool ready = chan->enabled && chan->sync == NULL;
+        pthread_mutex_unlock(&chan->lock);
+        ESP_RETURN_ON_FALSE(ready, ESP_ERR_INVALID_STATE, TAG, "channel should be started before creating sync manager");
+    }
+    struct rmt_sync_manager_t *sync = calloc(1, sizeof(struct rmt_sync_manager_t));
+    ESP_RETURN_ON_FALSE(sync, ESP_ERR_NO_MEM, TAG, "no mem for sync manager");
+    sync->channels = calloc(config->array_size, sizeof(rmt_channel_handle_t));
+    if (sync->channels == NULL) {
+        free(sync);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(sync->channels, config->tx_channel_array, config->array_size * sizeof(rmt_channel_handle_t));
+    sync->count = config->array_size;
+    pthread_mutex_init(&sync->lock, NULL);
+    pthread_cond_init(&sync->cond, NULL);
+    for (size_t i = 0; i < sync->count; i++) {
+        pthread_mutex_lock(&sync->channels[i]->lock);
+        sync->channels[i]->sync = sync;
+        pthread_mutex_unlock(&sync->channels[i]->lock);
+    }
+    *ret_synchro = sync;
+    return ESP_OK;
+}
+
+esp_err_t rmt_sync_reset(rmt_sync_manager_handle_t synchro) {
+    ESP_RETURN_ON_FALSE(synchro, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    pthread_mutex_lock(&synchro->lock);
+    bool idle = synchro->arrived == 0;
+    pthread_mutex_unlock(&synchro->lock);
+    ESP_RETURN_ON_FALSE(idle, ESP_ERR_INVALID_STATE, TAG, "channels waiting for a synchronous start");
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_sync_manager(rmt_sync_manager_handle_t synchro) {
+    ESP_RETURN_ON_FALSE(synchro, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    for (size_t i = 0; i < synchro->count; i++) {
+        pthread_mutex_lock(&synchro->channels[i]->lock);
+        synchro->channels[i]->sync = NULL;
+        pthread_mutex_unlock(&synchro->channels[i]->lock);
+    }
+    // release the channels that were waiting for the others
+    pthread_mutex_lock(&synchro->lock);
+    bool waiting = synchro->arrived > 0;
+    synchro->arrived = 0;
+    synchro->starts++;
+    pthread_cond_broadcast(&synchro->cond);
+    pthread_mutex_unlock(&synchro->lock);
+    ESP_RETURN_ON_FALSE(!waiting, ESP_ERR_INVALID_STATE, TAG, "channels were waiting for a synchronous start");
+    pthread_cond_destroy(&synchro->cond);
+    pthread_mutex_destroy(&synchro->lock);
+    free(synchro->channels);
+    free(synchro);
+    return ESP_OK;
+}
+
+static size_t bytes_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state) {
+    rmt_mock_bytes_encoder_t *bytes_encoder = __containerof(encoder, rmt_mock_bytes_encoder_t, base);
+    const uint8_t *data = primary_data;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded = 0;
+    while (bytes_encoder->byte < data_size && channel->mem_used < channel->config.mem_block_symbols) {
+        int shift = bytes_encoder->config.flags.msb_first ? 7 - bytes_encoder->bit : bytes_encoder->bit;
+        bool one = (data[bytes_encoder->byte] >> shift) & 1;
+        channel->mem[channel->mem_used++] = one ? bytes_encoder->config.bit1 : bytes_encoder->config.bit0;
+        encoded++;
+        if (++bytes_encoder->bit == 8) {
+            bytes_encoder->bit = 0;
+            bytes_encoder->byte++;
+        }
+    }
+    if (bytes_encoder->byte == data_size) {
+        bytes_encoder->byte = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (channel->mem_used == channel->config.mem_block_symbols) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encoded;
+}
+
+static esp_err_t bytes_reset(rmt_encoder_t *encoder) {
+    rmt_mock_bytes_encoder_t *bytes_encoder = __containerof(encoder, rmt_mock_bytes_encoder_t, base);
+    bytes_encoder->byte = 0;
+    bytes_encoder->bit = 0;
+    return ESP_OK;
+}
+
+static esp_err_t bytes_del(rmt_encoder_t *encoder) {
+    free(__containerof(encoder, rmt_mock_bytes_encoder_t, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+    ESP_RETURN_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_mock_bytes_encoder_t *encoder = calloc(1, sizeof(rmt_mock_bytes_encoder_t));
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_NO_MEM, TAG, "no mem for bytes encoder");
+    encoder->base.encode = bytes_encode;
+    encoder->base.reset = bytes_reset;
+    encoder->base.del = bytes_del;
+    encoder->config = *config;
+    *ret_encoder = &encoder->base;
+    return ESP_OK;
+}
+
+static size_t copy_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state) {
+    rmt_mock_copy_encoder_t *copy_encoder = __containerof(encoder, rmt_mock_copy_encoder_t, base);
+    const rmt_symbol_word_t *symbols = primary_data;
+    size_t count = data_size / sizeof(rmt_symbol_word_t);
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded = 0;
+    while (copy_encoder->offset < count && channel->mem_used < channel->config.mem_block_symbols) {
+        channel->mem[channel->mem_used++] = symbols[copy_encoder->offset++];
+        encoded++;
+    }
+    if (copy_encoder->offset == count) {
+        copy_encoder->offset = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (channel->mem_used == channel->config.mem_block_symbols) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encoded;
+}
+
+static esp_err_t copy_reset(rmt_encoder_t *encoder) {
+    __containerof(encoder, rmt_mock_copy_encoder_t, base)->offset = 0;
+    return ESP_OK;
+}
+
+static esp_err_t copy_del(rmt_encoder_t *encoder) {
+    free(__containerof(encoder, rmt_mock_copy_encoder_t, base));
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+    ESP_RETURN_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_mock_copy_encoder_t *encoder = calloc(1, sizeof(rmt_mock_copy_encoder_t));
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_NO_MEM, TAG, "no mem for copy encoder");
+    encoder->base.encode = copy_encode;
+    encoder->base.reset = copy_reset;
+    encoder->base.del = copy_del;
+    *ret_encoder = &encoder->base;
+    return ESP_OK;
+}
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_simple_encoder_config_t config;
+    size_t symbols_written;
+    bool done;
+    /* Chunk encoded when the free space was below min_chunk_size, copied as the memory frees up */
+    rmt_symbol_word_t *overflow;
+    size_t overflow_len;
+    size_t overflow_offset;
+} rmt_mock_simple_encoder_t;
+
+static size_t simple_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state) {
+    rmt_mock_simple_encoder_t *simple_encoder = __containerof(encoder, rmt_mock_simple_encoder_t, base);
+    size_t mem_size = channel->config.mem_block_symbols;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded = 0;
+    while (true) {
+        while (simple_encoder->overflow_offset < simple_encoder->overflow_len && channel->mem_used < mem_size) {
+            channel->mem[channel->mem_used++] = simple_encoder->overflow[simple_encoder->overflow_offset++];
+            encoded++;
+        }
+        if (simple_encoder->overflow_offset < simple_encoder->overflow_len) {
+            state |= RMT_ENCODING_MEM_FULL;
+            break;
+        }
+        if (simple_encoder->done) {
+            simple_encoder->done = false;
+            simple_encoder->symbols_written = 0;
+            state |= RMT_ENCODING_COMPLETE;
+            break;
+        }
+        size_t symbols_free = mem_size - channel->mem_used;
+        if (symbols_free == 0) {
+            state |= RMT_ENCODING_MEM_FULL;
+            break;
+        }
+        size_t count;
+        if (symbols_free >= simple_encoder->config.min_chunk_size) {
+            count = simple_encoder->config.callback(primary_data, data_size, simple_encoder->symbols_written, symbols_free,
+                                                    channel->mem + channel->mem_used, &simple_encoder->done,
+                                                    simple_encoder->config.arg);
+            channel->mem_used += count;
+            encoded += count;
+        }
+        else {
+            count = simple_encoder->config.callback(primary_data, data_size, simple_encoder->symbols_written,
+                                                    simple_encoder->config.min_chunk_size, simple_encoder->overflow,
+                                                    &simple_encoder->done, simple_encoder->config.arg);
+            simple_encoder->overflow_len = count;
+            simple_encoder->overflow_offset = 0;
+        }
+        simple_encoder->symbols_written += count;
+        if (count == 0 && !simple_encoder->done) {
+            ESP_LOGE(TAG, "simple encoder callback wrote nothing with %zu symbols free", symbols_free);
+            simple_encoder->done = true;
+        }
+    }
+    if (channel->mem_used == mem_size) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encoded;
+}
+
+static esp_err_t simple_reset(rmt_encoder_t *encoder) {
+    rmt_mock_simple_encoder_t *simple_encoder = __containerof(encoder, rmt_mock_simple_encoder_t, base);
+    simple_encoder->symbols_written = 0;
+    simple_encoder->done = false;
+    simple_encoder->overflow_len = 0;
+    simple_encoder->overflow_offset = 0;
+    return ESP_OK;
+}
+
+static esp_err_t simple_del(rmt_encoder_t *encoder) {
+    rmt_mock_simple_encoder_t *simple_encoder = __containerof(encoder, rmt_mock_simple_encoder_t, base);
+    free(simple_encoder->overflow);
+    free(simple_encoder);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_simple_encoder(const rmt_simple_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder) {
+    ESP_RETURN_ON_FALSE(config && config->callback && ret_encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_mock_simple_encoder_t *encoder = calloc(1, sizeof(rmt_mock_simple_encoder_t));
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_NO_MEM, TAG, "no mem for simple encoder");
+    encoder->config = *config;
+    if (encoder->config.min_chunk_size == 0) {
+        // default of the driver
+        encoder->config.min_chunk_size = 64;
+    }
+    encoder->overflow = calloc(encoder->config.min_chunk_size, sizeof(rmt_symbol_word_t));
+    if (encoder->overflow == NULL) {
+        free(encoder);
+        return ESP_ERR_NO_MEM;
+    }
+    encoder->base.encode = simple_encode;
+    encoder->base.reset = simple_reset;
+    encoder->base.del = simple_del;
+    *ret_encoder = &encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder) {
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder) {
+    ESP_RETURN_ON_FALSE(encoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    return encoder->reset(encoder);
+}
+
+rmt_channel_handle_t rmt_mock_find_channel(gpio_num_t gpio_num) {
+    pthread_mutex_lock(&s_channels_lock);
+    rmt_channel_handle_t chan = s_channels;
+    while (chan != NULL && chan->config.gpio_num != gpio_num) {
+        chan = chan->next;
+    }
+    pthread_mutex_unlock(&s_channels_lock);
+    return chan;
+}
+
+void rmt_mock_set_real_time(bool real_time) {
+    atomic_store(&s_real_time, real_time);
+}
+
+void rmt_mock_get_stats(rmt_channel_handle_t channel, rmt_mock_stats_t *stats) {
+    pthread_mutex_lock(&channel->lock);
+    *stats = channel->stats;
+    pthread_mutex_unlock(&channel->lock);
+}
+
+size_t rmt_mock_get_last_symbols(rmt_channel_handle_t channel, rmt_symbol_word_t *symbols, size_t max_symbols) {
+    pthread_mutex_lock(&channel->lock);
+    size_t count = channel->last_len;
+    if (symbols != NULL) {
+        memcpy(symbols, channel->last, (count < max_symbols ? count : max_symbols) * sizeof(rmt_symbol_word_t));
+    }
+    pthread_mutex_unlock(&channel->lock);
+    return count;
+}
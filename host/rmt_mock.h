@@ -0,0 +1,75 @@
+/**
+ * \file rmt_mock.h
+ * \brief Host implementation of the ESP-IDF RMT TX driver, for the LED strip benches.
+ *
+ * Every channel has a thread that takes the transactions from a queue of trans_queue_depth,
+ * runs the encoder into a simulated memory block of mem_block_symbols, sleeps for the time the
+ * symbols take on the wire and calls on_trans_done.
+ * As on the device, the block is used as two halves once it is full: every time the encoder
+ * fills it, the hardware sends one half and the refill interrupt encodes into it again.
+ * The channels of a sync manager start each transaction together, once all of them have one.
+ * The symbols of the last transaction are kept so that the benches can decode the frame.
+ */
+#ifndef _RMT_MOCK_H_
+#define _RMT_MOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_tx.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Channel statistics
+ */
+typedef struct {
+    /** Number of rmt_enable calls */
+    uint32_t enables;
+    /** Number of transactions sent */
+    uint32_t transactions;
+    /** Number of transactions refused because the queue was full */
+    uint32_t rejected;
+    /** Number of refill interrupts: times the memory block was full before the end of a transaction */
+    uint32_t refills;
+    /** Number of symbols sent */
+    uint64_t symbols;
+    /** Time spent in the encoders, in ns */
+    uint64_t encode_ns;
+    /** Time the symbols took on the wire, in us */
+    uint64_t wire_us;
+    /** Time the last transaction started on the wire, on CLOCK_MONOTONIC in us */
+    int64_t last_start_us;
+} rmt_mock_stats_t;
+
+/**
+ * \brief Find the channel driving a GPIO.
+ * \return the channel, NULL if there is none
+ */
+rmt_channel_handle_t rmt_mock_find_channel(gpio_num_t gpio_num);
+
+/**
+ * \brief Sleep for the wire time of every transaction (the default), or complete them as soon as they are encoded.
+ */
+void rmt_mock_set_real_time(bool real_time);
+
+/**
+ * \brief Get a snapshot of the channel statistics.
+ */
+void rmt_mock_get_stats(rmt_channel_handle_t channel, rmt_mock_stats_t *stats);
+
+/**
+ * \brief Copy the symbols of the last transaction.
+ * \param[out] symbols the symbols, can be NULL to get the count
+ * \param[in] max_symbols the size of \p symbols
+ * \return the number of symbols of the last transaction
+ */
+size_t rmt_mock_get_last_symbols(rmt_channel_handle_t channel, rmt_symbol_word_t *symbols, size_t max_symbols);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _RMT_MOCK_H_
@@ -0,0 +1,169 @@
+/**
+ * \file spi_mock.c
+ * \brief Host implementation of the ESP-IDF SPI master driver, see spi_mock.h.
+ *
+ * Only what the LED strip component uses is implemented: bus and device setup, and the
+ * transmit of MOSI bytes.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "soc/soc_caps.h"
+
+#include "spi_mock.h"
+
+#define SPI_MOCK_APB_CLOCK_HZ 80000000
+/** max_transfer_sz of the driver with DMA when the bus configuration leaves it to 0 */
+#define SPI_MOCK_DMA_DEFAULT_TRANSFER_SIZE 4092
+
+static const char *TAG = "spi_mock";
+
+struct spi_device_t {
+    spi_host_device_t host_id;
+    int clock_hz;
+};
+
+typedef struct {
+    bool initialized;
+    size_t max_transfer_sz;
+    struct spi_device_t *device;
+    uint8_t *last;
+    size_t last_len;
+    spi_mock_stats_t stats;
+} spi_mock_bus_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static spi_mock_bus_t s_buses[SPI_HOST_MAX];
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan) {
+    ESP_RETURN_ON_FALSE(host_id > SPI1_HOST && host_id < SPI_HOST_MAX && bus_config, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid argument");
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    spi_mock_bus_t *bus = &s_buses[host_id];
+    if (bus->initialized) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else {
+        bus->initialized = true;
+        if (dma_chan == SPI_DMA_DISABLED) {
+            bus->max_transfer_sz = SOC_SPI_MAXIMUM_BUFFER_SIZE;
+        }
+        else {
+            bus->max_transfer_sz = bus_config->max_transfer_sz > 0 ? bus_config->max_transfer_sz
+                                   : SPI_MOCK_DMA_DEFAULT_TRANSFER_SIZE;
+        }
+        memset(&bus->stats, 0, sizeof(bus->stats));
+    }
+    pthread_mutex_unlock(&s_lock);
+    ESP_RETURN_ON_FALSE(ret == ESP_OK, ret, TAG, "SPI bus already initialized");
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id) {
+    ESP_RETURN_ON_FALSE(host_id > SPI1_HOST && host_id < SPI_HOST_MAX, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    spi_mock_bus_t *bus = &s_buses[host_id];
+    if (!bus->initialized || bus->device != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else {
+        bus->initialized = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+    ESP_RETURN_ON_FALSE(ret == ESP_OK, ret, TAG, "SPI bus not initialized or still in use");
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host_id, const spi_device_interface_config_t *dev_config, spi_device_handle_t *handle) {
+    ESP_RETURN_ON_FALSE(host_id > SPI1_HOST && host_id < SPI_HOST_MAX && dev_config && handle, ESP_ERR_INVALID_ARG, TAG,
+                        "invalid argument");
+    ESP_RETURN_ON_FALSE(dev_config->clock_speed_hz > 0 && dev_config->clock_speed_hz <= SPI_MOCK_APB_CLOCK_HZ,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid clock");
+    struct spi_device_t *device = calloc(1, sizeof(struct spi_device_t));
+    ESP_RETURN_ON_FALSE(device, ESP_ERR_NO_MEM, TAG, "no mem for SPI device");
+    device->host_id = host_id;
+    // the closest clock that is not faster than the requested one
+    int divider = (SPI_MOCK_APB_CLOCK_HZ + dev_config->clock_speed_hz - 1) / dev_config->clock_speed_hz;
+    device->clock_hz = SPI_MOCK_APB_CLOCK_HZ / divider;
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    spi_mock_bus_t *bus = &s_buses[host_id];
+    if (!bus->initialized || bus->device != NULL) {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else {
+        bus->device = device;
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (ret != ESP_OK) {
+        free(device);
+        ESP_LOGE(TAG, "SPI bus not initialized or already used");
+        return ret;
+    }
+    *handle = device;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    pthread_mutex_lock(&s_lock);
+    s_buses[handle->host_id].device = NULL;
+    pthread_mutex_unlock(&s_lock);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_actual_freq(spi_device_handle_t handle, int *freq_khz) {
+    ESP_RETURN_ON_FALSE(handle && freq_khz, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    *freq_khz = handle->clock_hz / 1000;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans_desc) {
+    ESP_RETURN_ON_FALSE(handle && trans_desc && trans_desc->tx_buffer && trans_desc->length % 8 == 0,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    size_t size = trans_desc->length / 8;
+    esp_err_t ret = ESP_OK;
+    pthread_mutex_lock(&s_lock);
+    spi_mock_bus_t *bus = &s_buses[handle->host_id];
+    if (size > bus->max_transfer_sz) {
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    else {
+        uint8_t *last = realloc(bus->last, size > 0 ? size : 1);
+        if (last == NULL) {
+            ret = ESP_ERR_NO_MEM;
+        }
+        else {
+            memcpy(last, trans_desc->tx_buffer, size);
+            bus->last = last;
+            bus->last_len = size;
+            bus->stats.transactions++;
+            bus->stats.bytes += size;
+            bus->stats.wire_us += (uint64_t)size * 8 * 1000000 / handle->clock_hz;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    ESP_RETURN_ON_FALSE(ret == ESP_OK, ret, TAG, "transaction of %zu bytes refused", size);
+    return ESP_OK;
+}
+
+void spi_mock_get_stats(spi_host_device_t host_id, spi_mock_stats_t *stats) {
+    pthread_mutex_lock(&s_lock);
+    *stats = s_buses[host_id].stats;
+    pthread_mutex_unlock(&s_lock);
+}
+
+size_t spi_mock_get_last_bytes(spi_host_device_t host_id, uint8_t *bytes, size_t max_bytes) {
+    pthread_mutex_lock(&s_lock);
+    size_t count = s_buses[host_id].last_len;
+    if (bytes != NULL) {
+        memcpy(bytes, s_buses[host_id].last, count < max_bytes ? count : max_bytes);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return count;
+}
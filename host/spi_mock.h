@@ -0,0 +1,49 @@
+/**
+ * \file spi_mock.h
+ * \brief Host implementation of the ESP-IDF SPI master driver, for the LED strip benches.
+ *
+ * One device per bus. A transaction completes as soon as it is accepted: its bytes are kept so
+ * that the benches can decode the waveform on MOSI, and its wire time is only accounted.
+ * The device clock is the APB clock (80MHz) divided by an integer, the closest below the requested one.
+ */
+#ifndef _SPI_MOCK_H_
+#define _SPI_MOCK_H_
+
+#include <stdint.h>
+#include "driver/spi_master.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Bus statistics
+ */
+typedef struct {
+    /** Number of transactions sent */
+    uint32_t transactions;
+    /** Number of bytes sent */
+    uint64_t bytes;
+    /** Time the bytes take on the wire, in us */
+    uint64_t wire_us;
+} spi_mock_stats_t;
+
+/**
+ * \brief Get a snapshot of the bus statistics.
+ */
+void spi_mock_get_stats(spi_host_device_t host_id, spi_mock_stats_t *stats);
+
+/**
+ * \brief Copy the bytes of the last transaction on the bus.
+ * \param[out] bytes the bytes, can be NULL to get the count
+ * \param[in] max_bytes the size of \p bytes
+ * \return the number of bytes of the last transaction
+ */
+size_t spi_mock_get_last_bytes(spi_host_device_t host_id, uint8_t *bytes, size_t max_bytes);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _SPI_MOCK_H_
@@ -0,0 +1,297 @@
+/**
+ * \file tls_pool_bench.c
+ * \brief Soak of the TLS pool (tls_pool.c): thousands of TLS connections of MQTT clients created and destroyed,
+ *        and of QuarkLink API calls, each replaying the mbedtls allocations of a connection.
+ *
+ * Every MQTT client has a thread of its own, as the esp_mqtt task: it binds an arena when it connects and
+ * unbinds it when it disconnects, as platform_esp32.c does on MQTT_EVENT_BEFORE_CONNECT and
+ * MQTT_EVENT_DISCONNECTED. Every other client is destroyed while connected: its thread ends with the arena
+ * bound, the main thread frees its blocks and releases the arena with tls_pool_arena_release(), as
+ * platform_mqtt_stop() does. Meanwhile the main thread makes a QuarkLink API call between
+ * tls_pool_arena_begin() and tls_pool_arena_end().
+ *
+ * The connection replays the allocations of a TLS 1.3 client handshake with X25519MLKEM768 in mbedtls 3.6, in
+ * their order: the context and record buffers of CONFIG_MBEDTLS_SSL_IN/OUT_CONTENT_LEN, the handshake parameters,
+ * the ML-KEM-768 keypair held from the ClientHello to the ServerHello, the transforms, the device certificate,
+ * the server chain kept with the session (CONFIG_MBEDTLS_SSL_KEEP_PEER_CERTIFICATE), the nested ECDSA
+ * temporaries of the chain and CertificateVerify checks, then the small blocks of record processing. The sizes
+ * are estimates from the mbedtls structures, not a device trace: the arena peak printed here is what
+ * TLS_POOL_ARENA_SIZE is sized from, until the peak logged by platform_log_stats() on a device replaces it.
+ * The bench reports the arena peak and the allocations served by the heap, and checks that:
+ *   - every connection gets an arena and none of its allocations reaches the heap, which is what keeps the
+ *     heap of the device from fragmenting
+ *   - every connection releases its arena in one go, and once all are closed no block is left and no arena is bound
+ *   - without tls_pool_arena_release(), destroyed clients leave arenas bound to tasks that no longer exist
+ *   - a block allocated between tls_pool_arena_suspend() and tls_pool_arena_resume(), as the cached root
+ *     certificate, comes from the heap and does not keep the arena from being released
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "tls_pool.h"
+#include "freertos/task.h"
+
+/** Record buffers, CONFIG_MBEDTLS_SSL_IN/OUT_CONTENT_LEN plus the record overhead of mbedtls */
+#define IN_BUFFER_SIZE      (16384 + 333)
+#define OUT_BUFFER_SIZE     (3072 + 333)
+#define CONTEXT_BLOCKS      (16)
+/** mbedtls_ssl_handshake_params with the TLS 1.3 and PSA hash states, until the handshake is done */
+#define HANDSHAKE_SIZE      (2600)
+/** struct X25519MLKEM768_ctx of the ML-KEM patch: encapsulation and decapsulation keys */
+#define ML_KEM_CTX_SIZE     (1184 + 2400)
+/** Handshake and application transforms */
+#define TRANSFORM_SIZE      (700)
+/** Device certificate parsed by esp-tls: mbedtls_x509_crt and its DER */
+#define OWN_CERT_SIZE       (600 + 550)
+/** Server chain: leaf and intermediate, each a mbedtls_x509_crt, its DER and name blocks */
+#define CERTIFICATES        (2)
+#define NAME_BLOCKS         (10)
+/** ECDSA verification: bignum and point temporaries, nested */
+#define VERIFY_BLOCKS       (24)
+#define RECORDS             (50)
+#define MAX_BLOCKS          (CONTEXT_BLOCKS + 7 + CERTIFICATES * (2 + NAME_BLOCKS))
+/** IoT Hub root certificate cached by cert_cache.c */
+#define ROOT_CERT_SIZE      (600 + 900)
+
+typedef struct {
+    void *blocks[MAX_BLOCKS];
+    int count;
+} connection_t;
+
+typedef struct {
+    unsigned seed;
+    int connections;
+    /** Destroyed while connected: the blocks of the last connection are left to the main thread */
+    bool destroyed;
+    TaskHandle_t task;
+    connection_t last;
+    int unbound;
+} client_t;
+
+typedef struct {
+    int connections;
+    int clients;
+    int quarklink_calls;
+    /** Connections that did not get an arena */
+    int unbound;
+    uint32_t fallbacks;
+    uint32_t resets;
+    size_t peak;
+    size_t in_use;
+    uint32_t bound;
+    double connection_us;
+} result_t;
+
+static size_t random_size(unsigned *seed, size_t min, size_t max) {
+    return min + (size_t)rand_r(seed) % (max - min + 1);
+}
+
+static void *alloc(connection_t *connection, size_t size) {
+    void *block = esp_mbedtls_mem_calloc(1, size);
+    if (block != NULL) {
+        connection->blocks[connection->count++] = block;
+    }
+    return block;
+}
+
+/* Nested temporaries, freed in reverse order */
+static void temporaries(unsigned *seed, int count, size_t min, size_t max) {
+    void *blocks[VERIFY_BLOCKS];
+    for (int i = 0; i < count; i++) {
+        blocks[i] = esp_mbedtls_mem_calloc(1, random_size(seed, min, max));
+    }
+    for (int i = count - 1; i >= 0; i--) {
+        esp_mbedtls_mem_free(blocks[i]);
+    }
+}
+
+/* The allocations of a connection up to its close: what it holds is left in `connection` */
+static void connection_open(connection_t *connection, unsigned *seed) {
+    connection->count = 0;
+    // SSL context, configuration and the small structures kept for the connection
+    for (int i = 0; i < CONTEXT_BLOCKS; i++) {
+        alloc(connection, random_size(seed, 16, 256));
+    }
+    alloc(connection, IN_BUFFER_SIZE);
+    alloc(connection, OUT_BUFFER_SIZE);
+    alloc(connection, OWN_CERT_SIZE);
+    void *handshake = esp_mbedtls_mem_calloc(1, HANDSHAKE_SIZE);
+
+    // ClientHello: ML-KEM keypair and X25519 key, held until the ServerHello
+    void *ml_kem = esp_mbedtls_mem_calloc(1, ML_KEM_CTX_SIZE);
+    temporaries(seed, 4, 32, 128);
+
+    // ServerHello: decapsulation, then the key schedule and the handshake transform
+    esp_mbedtls_mem_free(ml_kem);
+    temporaries(seed, 4, 64, 512);
+    alloc(connection, TRANSFORM_SIZE);
+
+    // Certificate: the server chain is kept with the session, each certificate verified
+    for (int i = 0; i < CERTIFICATES; i++) {
+        alloc(connection, random_size(seed, 1400, 2000));
+        for (int j = 0; j < NAME_BLOCKS; j++) {
+            alloc(connection, random_size(seed, 24, 96));
+        }
+        temporaries(seed, VERIFY_BLOCKS, 40, 200);
+    }
+
+    // CertificateVerify, then the application transform once Finished is sent
+    temporaries(seed, VERIFY_BLOCKS, 40, 200);
+    alloc(connection, TRANSFORM_SIZE);
+    esp_mbedtls_mem_free(handshake);
+
+    // Record processing
+    for (int i = 0; i < RECORDS; i++) {
+        esp_mbedtls_mem_free(esp_mbedtls_mem_calloc(1, random_size(seed, 16, 512)));
+    }
+}
+
+/* Close the connection: its blocks are freed in any order */
+static void connection_close(connection_t *connection, unsigned *seed) {
+    for (int i = connection->count - 1; i > 0; i--) {
+        int j = rand_r(seed) % (i + 1);
+        void *block = connection->blocks[i];
+        connection->blocks[i] = connection->blocks[j];
+        connection->blocks[j] = block;
+    }
+    for (int i = 0; i < connection->count; i++) {
+        esp_mbedtls_mem_free(connection->blocks[i]);
+    }
+    connection->count = 0;
+}
+
+/* The esp_mqtt task of a client */
+static void *client_main(void *arg) {
+    client_t *client = arg;
+    client->task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < client->connections; i++) {
+        client->unbound += tls_pool_arena_begin() != 0;
+        connection_open(&client->last, &client->seed);
+        if (client->destroyed && i == client->connections - 1) {
+            // The client is destroyed while connected: the task ends with the arena bound
+            return NULL;
+        }
+        connection_close(&client->last, &client->seed);
+        tls_pool_arena_end();
+    }
+    return NULL;
+}
+
+static void run(int connections, bool release, result_t *result) {
+    tls_pool_stats_t before;
+    tls_pool_get_stats(&before);
+    memset(result, 0, sizeof(result_t));
+    unsigned seed = 1;
+    int64_t start_ns = bench_now_ns();
+    while (result->connections < connections) {
+        client_t client = {
+            .seed = (unsigned)result->clients + 1,
+            .connections = 1 + rand_r(&seed) % 4,
+            .destroyed = (result->clients % 2) == 1,
+        };
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, client_main, &client) != 0) {
+            fprintf(stderr, "Cannot create the client thread\n");
+            exit(1);
+        }
+        // A QuarkLink API call while the client runs
+        connection_t quarklink = { 0 };
+        result->unbound += tls_pool_arena_begin() != 0;
+        connection_open(&quarklink, &seed);
+        connection_close(&quarklink, &seed);
+        tls_pool_arena_end();
+        result->quarklink_calls++;
+
+        pthread_join(thread, NULL);
+        // platform_mqtt_stop(): destroying the client closes its connection, then its task is gone
+        connection_close(&client.last, &seed);
+        if (release) {
+            tls_pool_arena_release(client.task);
+        }
+        result->unbound += client.unbound;
+        result->connections += client.connections + 1;
+        result->clients++;
+    }
+    result->connection_us = (bench_now_ns() - start_ns) / 1000.0 / result->connections;
+
+    tls_pool_stats_t after;
+    tls_pool_get_stats(&after);
+    result->fallbacks = after.fallbacks - before.fallbacks;
+    result->resets = after.resets - before.resets;
+    result->peak = after.peak;
+    result->in_use = after.in_use;
+    result->bound = after.bound;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n CONNECTIONS number of TLS connections of the soak (5000)\n", name);
+}
+
+int main(int argc, char **argv) {
+    int connections = 5000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+        case 'n': connections = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (connections <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (tls_pool_init() != 0) {
+        fprintf(stderr, "Cannot reserve the arenas\n");
+        return 1;
+    }
+
+    result_t soak;
+    run(connections, true, &soak);
+    bench_check(soak.unbound == 0, "every connection gets an arena");
+    bench_check(soak.fallbacks == 0, "no allocation of a connection served by the heap");
+    bench_check(soak.resets == (uint32_t)soak.connections, "every connection releases its arena in one go");
+    bench_check(soak.in_use == 0 && soak.bound == 0, "no block left and no arena bound after the soak");
+
+    // The root certificate is parsed once for every connection: suspended, it comes from the heap
+    tls_pool_stats_t before;
+    tls_pool_get_stats(&before);
+    unsigned seed = 1;
+    connection_t connection = { 0 };
+    tls_pool_arena_begin();
+    tls_pool_arena_suspend();
+    void *root = esp_mbedtls_mem_calloc(1, ROOT_CERT_SIZE);
+    tls_pool_arena_resume();
+    connection_open(&connection, &seed);
+    connection_close(&connection, &seed);
+    tls_pool_arena_end();
+    tls_pool_stats_t after;
+    tls_pool_get_stats(&after);
+    bench_check(root != NULL && after.in_use == 0 && after.resets == before.resets + 1,
+                "root certificate parsed while suspended: from the heap, the arena is still released");
+    esp_mbedtls_mem_free(root);
+
+    // Destroyed clients whose arena is not released: the arenas stay bound to tasks that are gone
+    result_t leaked;
+    run(8, false, &leaked);
+    bench_check(leaked.bound > 0, "arenas left bound without tls_pool_arena_release");
+
+    printf("TLS pool soak: %d arenas of %d bytes, connections of MQTT clients and QuarkLink API calls\n",
+           TLS_POOL_ARENAS, TLS_POOL_ARENA_SIZE);
+    printf("  %-32s %12s %12s\n", "", "released", "not released");
+    printf("  %-32s %12d %12d\n", "connections", soak.connections, leaked.connections);
+    printf("  %-32s %12d %12d\n", "MQTT clients created/destroyed", soak.clients, leaked.clients);
+    printf("  %-32s %12d %12d\n", "connections without an arena", soak.unbound, leaked.unbound);
+    printf("  %-32s %12u %12u\n", "allocations from the heap", soak.fallbacks, leaked.fallbacks);
+    printf("  %-32s %12u %12u\n", "arena resets", soak.resets, leaked.resets);
+    printf("  %-32s %12u %12u\n", "arenas bound at the end", soak.bound, leaked.bound);
+    printf("  %-32s %12zu %12s\n", "arena peak bytes", soak.peak, "-");
+    printf("  %-32s %10.1fus %12s\n", "time per connection", soak.connection_us, "-");
+    return bench_result();
+}
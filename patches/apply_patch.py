@@ -1,5 +1,5 @@
 from os.path import join, isfile
-from os import getlogin
+from os import getlogin, remove
 
 # Import the current working construction environment to the `env` variable.
 # alias of `env = DefaultEnvironment()`
@@ -9,10 +9,11 @@ FRAMEWORK_DIR = env.PioPlatform().get_package_dir("framework-espidf")
 PATCHES = {
     'ds_idf': "ds_idf.patch",
     'ds_mbedtls': "ds_mbedtls.patch",
-    'mlkem_mbedtls': "mlkem_mbedtls.patch"
+    'mlkem_mbedtls': "mlkem_mbedtls.patch",
+    'certcomp_mbedtls': "certcomp_mbedtls.patch"
 }
 
-def apply_patch(patch_file, submodule_dir = ""):
+def find_patch_command():
     # Find patch command depending on OS
     if env['HOST_OS'].startswith("win"):
         # OS is Windows, use patch from git
@@ -36,32 +37,99 @@ def apply_patch(patch_file, submodule_dir = ""):
         GIT_PATCH_CMD = "patch"
 
     print("Found patch command at %s" % GIT_PATCH_CMD)
-        
+    return GIT_PATCH_CMD
+
+GIT_PATCH_CMD = find_patch_command()
+
+def read_file(path):
+    with open(path, newline="") as fp:
+        return fp.read()
+
+def write_file(path, text):
+    with open(path, "w", newline="") as fp:
+        fp.write(text)
+
+def run_patch(patch_path, root_dir, options = ""):
+    return env.Execute("\"%s\" -p1 %s -i \"%s\" -d \"%s\"" % (GIT_PATCH_CMD, options, patch_path, root_dir))
+
+# The flag file of a patch holds the text that was applied, so that a changed patch is
+# detected and the old text can be reversed before the new one is applied.
+def applied_text(patch_file, submodule_dir):
+    patchflag_path = join(FRAMEWORK_DIR, submodule_dir, f".{patch_file}-done")
+    if not isfile(patchflag_path):
+        return None
+    return read_file(patchflag_path)
+
+def revert_patch(patch_file, submodule_dir, text):
+    root_dir = join(FRAMEWORK_DIR, submodule_dir)
+    patchflag_path = join(root_dir, f".{patch_file}-done")
+    print(f"Reverting the previous {patch_file} from {root_dir}")
+    if text == "":
+        # Empty flag written by an older apply_patch.py: only the current patch can be tried
+        old_patch = join(env["PROJECT_DIR"], "patches", patch_file)
+    else:
+        old_patch = patchflag_path + ".old"
+        write_file(old_patch, text)
+    # Dry run first, so that a patch that does not reverse leaves the package as it was
+    rc = run_patch(old_patch, root_dir, "-R --dry-run -s")
+    if rc == 0:
+        rc = run_patch(old_patch, root_dir, "-R")
+    if text != "":
+        remove(old_patch)
+    if rc != 0:
+        raise SystemExit(f"Failed to revert {patch_file} from {root_dir}, "
+                         "reinstall the framework-espidf package and build again")
+    remove(patchflag_path)
+
+def apply_patch(patch_file, submodule_dir = ""):
     print("Project dir: %s" % env["PROJECT_DIR"])
     print(f"Patch file: {patch_file}")
     full_patch = join(env["PROJECT_DIR"], "patches", patch_file)
     if not isfile(full_patch):
         raise SystemExit(f"Patch file {full_patch} not found")
 
-    # patch file only if we didn't do it before
     root_dir = join(FRAMEWORK_DIR,submodule_dir)
     patchflag_path = join(root_dir, f".{patch_file}-done")
-    if not isfile(patchflag_path):
-        print(f"Applying patch for {full_patch} to {root_dir}")
-        rc = env.Execute("\"%s\" -p1 -i %s -d %s" % (GIT_PATCH_CMD, full_patch, root_dir))
-        if rc != 0:
-            raise SystemExit("Failed to apply patch")
+    print(f"Applying patch for {full_patch} to {root_dir}")
+    rc = run_patch(full_patch, root_dir)
+    if rc != 0:
+        raise SystemExit("Failed to apply patch")
+    write_file(patchflag_path, read_file(full_patch))
 
-        def _touch(path):
-            with open(path, "w") as fp:
-                fp.write("")
+def sdkconfig_enabled(option):
+    # The sdkconfig of the environment, as written by the build or menuconfig
+    sdkconfig_path = join(env["PROJECT_DIR"], "sdkconfig.%s" % env["PIOENV"])
+    if not isfile(sdkconfig_path):
+        return False
+    return f"{option}=y" in read_file(sdkconfig_path).splitlines()
 
-        env.Execute(lambda *args, **kwargs: _touch(patchflag_path))
+def apply_patches(patches):
+    # The first patch whose applied text differs from the wanted one, and every patch
+    # after it, are reverted from the top down and applied again in order, as later
+    # patches may touch the same files. A patch that is not wanted is only reverted.
+    applied = [applied_text(patch_file, submodule_dir) for patch_file, submodule_dir, wanted in patches]
+    first_changed = len(patches)
+    for i, (patch_file, submodule_dir, wanted) in enumerate(patches):
+        current = read_file(join(env["PROJECT_DIR"], "patches", patch_file)) if wanted else None
+        if applied[i] != current:
+            first_changed = i
+            break
+    for i in reversed(range(first_changed, len(patches))):
+        if applied[i] is not None:
+            revert_patch(patches[i][0], patches[i][1], applied[i])
+    for i, (patch_file, submodule_dir, wanted) in enumerate(patches):
+        if not wanted:
+            print(f"Patch {patch_file} is not enabled")
+        elif i < first_changed:
+            print(f"Patch {patch_file} has already been applied")
+        else:
+            apply_patch(patch_file, submodule_dir)
 
-    else:
-        print("Patch has already been applied")
-    
-# Apply all patches, always
-apply_patch(PATCHES['ds_idf'])
-apply_patch(PATCHES['ds_mbedtls'], "components/mbedtls/mbedtls")
-apply_patch(PATCHES['mlkem_mbedtls'], "components/mbedtls/mbedtls")
\ No newline at end of file
+# Apply the patches, certificate compression only if enabled in the sdkconfig
+apply_patches([
+    (PATCHES['ds_idf'], "", True),
+    (PATCHES['ds_mbedtls'], "components/mbedtls/mbedtls", True),
+    (PATCHES['mlkem_mbedtls'], "components/mbedtls/mbedtls", True),
+    (PATCHES['certcomp_mbedtls'], "components/mbedtls/mbedtls",
+     sdkconfig_enabled("CONFIG_QUARKLINK_CERT_COMPRESSION")),
+])
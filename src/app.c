@@ -0,0 +1,855 @@
+/**
+ * \file app.c
+ * \brief The getting started application logic.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+
+#include "app.h"
+#include "metrics.h"
+#include "led_anim.h"
+
+static const char *TAG = "quarklink-getting-started";
+
+/* Intervals */
+// How often to check for status, in s
+static const int STATUS_CHECK_INTERVAL = 20;
+// mqtt publish interval in s
+static const int MQTT_PUBLISH_INTERVAL = 5;
+// How often to publish the runtime metrics, in s
+static const int METRICS_FLUSH_INTERVAL = 60;
+// Wait before retrying a failed status check, doubled at each failure, in ms
+static const uint32_t STATUS_RETRY_MIN_DELAY = 1000;
+static const uint32_t STATUS_RETRY_MAX_DELAY = 60000;
+// Duty-cycle mode: how long to wait for the MQTT connection and for the acknowledgement of the batch, in ms
+static const uint32_t DUTY_CYCLE_CONNECT_TIMEOUT = 15000;
+static const uint32_t DUTY_CYCLE_ACK_TIMEOUT = 5000;
+
+/* MQTT event forwarded to the duty-cycle publish */
+typedef struct {
+    platform_mqtt_event_id_t id;
+    int msg_id;
+} app_event_t;
+
+/*
+ * @brief Event handler registered to receive MQTT events
+ *
+ *  This function is called by the MQTT client task.
+ *
+ * @param arg the device the client belongs to.
+ * @param event the event.
+ */
+static void mqtt_event_handler(void *arg, const platform_mqtt_event_t *event) {
+    app_device_t *device = arg;
+    if (device->events != NULL &&
+        (event->id == PLATFORM_MQTT_EVENT_CONNECTED || event->id == PLATFORM_MQTT_EVENT_PUBLISHED ||
+         event->id == PLATFORM_MQTT_EVENT_ERROR)) {
+        app_event_t app_event = { .id = event->id, .msg_id = event->msg_id };
+        platform_queue_send(device->events, &app_event);
+    }
+    if (device->outbox != NULL) {
+        mqtt_outbox_handle_event(device->outbox, event);
+    }
+    switch (event->id) {
+    case PLATFORM_MQTT_EVENT_CONNECTED:
+        ESP_LOGD(TAG, "MQTT_EVENT_CONNECTED");
+        metrics_count(METRICS_C_MQTT_CONNECTED);
+        device->mqtt_connected = true;
+        if (device->mqtt_connect_start != 0) {
+            metrics_record_since(METRICS_H_HANDSHAKE, device->mqtt_connect_start);
+            device->mqtt_connect_start = 0;
+        }
+        if (device->events != NULL) {
+            // Duty-cycle mode: disconnected right after the publish
+            break;
+        }
+        if (mqtt_router_subscribe(device->router, device->mqtt, 0) != 0) {
+            ESP_LOGW(TAG, "Failed to subscribe to the inbound topics");
+        }
+        break;
+    case PLATFORM_MQTT_EVENT_DISCONNECTED:
+        ESP_LOGD(TAG, "MQTT_EVENT_DISCONNECTED");
+        metrics_count(METRICS_C_MQTT_DISCONNECTED);
+        device->mqtt_connected = false;
+        break;
+    case PLATFORM_MQTT_EVENT_SUBSCRIBED:
+        ESP_LOGD(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+        break;
+    case PLATFORM_MQTT_EVENT_UNSUBSCRIBED:
+        ESP_LOGD(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
+        break;
+    case PLATFORM_MQTT_EVENT_PUBLISHED:
+        ESP_LOGD(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        metrics_publish_acked(event->msg_id);
+        break;
+    case PLATFORM_MQTT_EVENT_DATA:
+        ESP_LOGD(TAG, "MQTT_EVENT_DATA");
+        if (device->router != NULL) {
+            mqtt_router_dispatch(device->router, event);
+        }
+        break;
+    case PLATFORM_MQTT_EVENT_BEFORE_CONNECT:
+        ESP_LOGD(TAG, "MQTT_EVENT_BEFORE_CONNECT");
+        device->mqtt_connect_start = metrics_now_us();
+        break;
+    case PLATFORM_MQTT_EVENT_ERROR:
+        ESP_LOGD(TAG, "MQTT_EVENT_ERROR (0x%x)", event->error_code);
+        metrics_count(METRICS_C_MQTT_ERROR);
+        if (!device->mqtt_connected && device->broker_address != 0 && device->events == NULL) {
+            // The client would retry the same address: the application loop races the others
+            device->failover_requested = true;
+        }
+        break;
+    default:
+        ESP_LOGD(TAG, "Other event id:%d", event->id);
+        break;
+    }
+}
+
+/*
+ * @brief Inbound message handlers, called by the MQTT client task through the router
+ */
+static void on_echo(void *arg, const mqtt_router_message_t *message) {
+    (void)arg;
+    ESP_LOGD(TAG, "TOPIC=%.*s", message->topic_len, message->topic);
+    ESP_LOGD(TAG, "DATA[%d..%d/%d]=%.*s", message->offset, message->offset + message->data_len, message->total_len,
+             message->data_len, message->data);
+}
+
+static void on_firmware_update(void *arg, const mqtt_router_message_t *message) {
+    app_device_t *device = arg;
+    if (message->offset == 0) {
+        ESP_LOGI(TAG, "Firmware update notification on %.*s", message->topic_len, message->topic);
+        device->status_requested = true;
+    }
+}
+
+/* Create the router of the inbound messages, with a route per subscription */
+static mqtt_router_t *router_init(app_device_t *device, const quarklink_context_t *quarklink) {
+    mqtt_router_t *router = mqtt_router_create(MAX_INBOUND_LENGTH);
+    if (router == NULL) {
+        return NULL;
+    }
+    int ret = mqtt_router_add(router, "topic/#", on_echo, device, 0);
+    if (ret == 0 && quarklink->fwUpdateTopic != NULL && strcmp(quarklink->fwUpdateTopic, "") != 0) {
+        ret = mqtt_router_add(router, quarklink->fwUpdateTopic, on_firmware_update, device, 0);
+    }
+    if (ret != 0 || mqtt_router_compile(router) != 0) {
+        mqtt_router_destroy(router);
+        return NULL;
+    }
+    return router;
+}
+
+bool isAzure(const ql_context_t *context) {
+    return ((strstr(ql_context_string(context, QL_CONTEXT_IOT_HUB_ENDPOINT), "azure") != 0) &&
+            (strlen(ql_context_string(context, QL_CONTEXT_SCOPE_ID)) == 0));
+}
+
+bool isAzureCentral(const ql_context_t *context) {
+    return ((strstr(ql_context_string(context, QL_CONTEXT_IOT_HUB_ENDPOINT), "azure") != 0) &&
+            (strlen(ql_context_string(context, QL_CONTEXT_SCOPE_ID)) != 0));
+}
+
+/* Forget the broker kept across deep sleep: its address, and its TLS session where the backend keeps one */
+static void retained_forget_broker(app_retained_t *retained) {
+    retained->broker_address = 0;
+    #if (PLATFORM_MQTT_TLS_SESSION)
+    retained->session.length = 0;
+    #endif
+}
+
+static int format_batch(const app_retained_t *retained, char *buffer, size_t size) {
+    int len = snprintf(buffer, size, "{\"count\":%" PRIu32 ",\"period\":%d,\"temperature\":[",
+                       retained->first_sample, DUTY_CYCLE_PERIOD_S);
+    for (int i = 0; i < retained->sample_count && len > 0 && (size_t)len < size; i++) {
+        // Tenths of degree, null for a failed reading
+        int32_t sample = retained->samples[i];
+        if (sample == INT32_MIN) {
+            len += snprintf(buffer + len, size - len, "%snull", i > 0 ? "," : "");
+        }
+        else {
+            int32_t magnitude = sample < 0 ? -sample : sample;
+            len += snprintf(buffer + len, size - len, "%s%s%" PRId32 ".%" PRId32, i > 0 ? "," : "",
+                            sample < 0 ? "-" : "", magnitude / 10, magnitude % 10);
+        }
+    }
+    if (len > 0 && (size_t)len < size) {
+        len += snprintf(buffer + len, size - len, "]}");
+    }
+    return (len > 0 && (size_t)len < size) ? len : -1;
+}
+
+/**
+ * \brief Choose the broker address: race the addresses of the IoT Hub endpoint and of the fallback endpoints.
+ * \param[out] connection the connection established by the race, for the MQTT client to take over; -1 for none
+ * \return the address that connected first, 0 to leave the resolution to the MQTT client
+ */
+static uint32_t broker_select(app_device_t *device, const quarklink_context_t *quarklink, int *connection) {
+    char fallbacks[] = MQTT_FALLBACK_ENDPOINTS;
+    const char *hosts[1 + MAX_FALLBACK_ENDPOINTS] = { quarklink->iotHubEndpoint };
+    size_t count = 1;
+    char *save = NULL;
+    for (char *host = strtok_r(fallbacks, ",", &save); host != NULL && count < 1 + MAX_FALLBACK_ENDPOINTS;
+         host = strtok_r(NULL, ",", &save)) {
+        hosts[count++] = host;
+    }
+    uint32_t address = 0;
+    *connection = -1;
+    if (broker_race_resolve(&device->brokers, hosts, count, quarklink->iotHubPort) <= 0 ||
+        broker_race_connect(&device->brokers, &address, connection) != 0) {
+        ESP_LOGW(TAG, "No broker address connected, the MQTT client resolves %s", quarklink->iotHubEndpoint);
+        return 0;
+    }
+    return address;
+}
+
+/**
+ * \brief Start the MQTT client, see \ref mqtt_init.
+ */
+static int mqtt_start(app_device_t *device, const quarklink_context_t *quarklink) {
+    platform_mqtt_config_t mqtt_cfg = {
+        .quarklink = quarklink,
+        .socket = -1,
+        .event_cb = mqtt_event_handler,
+        .event_arg = device,
+    };
+
+    const ql_snapshot_t *snapshot = ql_state_acquire(&device->state);
+    bool azure = (snapshot != NULL) && (isAzure(&snapshot->context) || isAzureCentral(&snapshot->context));
+    ql_state_release(&device->state, snapshot);
+
+    char userName[256] = "";
+    if (azure) {
+        sprintf(userName, "%s/%s/?api-version=2018-06-30", quarklink->iotHubEndpoint, quarklink->deviceID);
+        mqtt_cfg.username = userName;
+        mqtt_cfg.keepalive = 10;
+        sprintf(device->mqtt_topic, "devices/%s/messages/events/", quarklink->deviceID);
+    }
+
+    app_retained_t *retained = device->retained;
+    char batch[MAX_BATCH_LENGTH];
+    platform_mqtt_message_t batch_message = { 0 };
+    if (retained != NULL) {
+        // The batch is handed to the client with the CONNECT
+        if (strcmp(device->mqtt_topic, "") == 0) {
+            sprintf(device->mqtt_topic, "topic/%s", quarklink->deviceID);
+        }
+        batch_message.topic = device->mqtt_topic;
+        batch_message.data = batch;
+        batch_message.len = format_batch(retained, batch, sizeof(batch));
+        batch_message.qos = 1;
+        if (batch_message.len <= 0) {
+            ESP_LOGE(TAG, "Failed to format the batch");
+            return -1;
+        }
+        mqtt_cfg.connect_messages = &batch_message;
+        mqtt_cfg.connect_message_count = 1;
+        #if (DUTY_CYCLE_EARLY_DATA)
+        // As early data when the session allows it: a QoS 1 message, which a replay can only duplicate
+        mqtt_cfg.early_data = true;
+        #endif
+
+        // Duty-cycle mode: reuse the broker address kept across deep sleep, and the TLS session on Linux. Nothing can fail
+        // from here on, so the connection of a new race is always handed over to the client.
+        if (retained->broker_address == 0 || retained->clock_s - retained->broker_resolved_s >= DUTY_CYCLE_DNS_MAX_AGE_S) {
+            retained->broker_address = broker_select(device, quarklink, &mqtt_cfg.socket);
+            if (retained->broker_address != 0) {
+                retained->broker_resolved_s = retained->clock_s;
+            }
+        }
+        mqtt_cfg.address = retained->broker_address;
+        #if (PLATFORM_MQTT_TLS_SESSION)
+        mqtt_cfg.session = &retained->session;
+        #endif
+    }
+
+    else {
+        // Duty-cycle mode does not subscribe
+        device->router = router_init(device, quarklink);
+        if (device->router == NULL) {
+            ESP_LOGE(TAG, "Failed to create the inbound message router");
+            return -1;
+        }
+        if (device->publish_window > 0) {
+            mqtt_outbox_config_t outbox_cfg = {
+                .window = device->publish_window,
+                .capacity = PUBLISH_OUTBOX_SIZE,
+            };
+            device->outbox = mqtt_outbox_create(&outbox_cfg);
+            if (device->outbox == NULL) {
+                ESP_LOGE(TAG, "Failed to create the outbox");
+                mqtt_router_destroy(device->router);
+                device->router = NULL;
+                return -1;
+            }
+        }
+
+        // Last, so that the connection of the race is always handed over to the client
+        device->broker_address = broker_select(device, quarklink, &mqtt_cfg.socket);
+        mqtt_cfg.address = device->broker_address;
+    }
+
+    device->mqtt = platform_mqtt_start(&mqtt_cfg);
+    if (device->mqtt == NULL) {
+        mqtt_router_destroy(device->router);
+        device->router = NULL;
+        mqtt_outbox_destroy(device->outbox);
+        device->outbox = NULL;
+        device->is_running = false;
+        return -1;
+    }
+    if (device->outbox != NULL) {
+        mqtt_outbox_attach(device->outbox, device->mqtt);
+    }
+    device->mqtt_connected = false;
+    device->failover_requested = false;
+    device->is_running = true;
+    return 0;
+}
+
+/**
+ * \brief Initialise the MQTT client using to the QuarkLink details provided.
+ *
+ * \param[in,out] device the device, its QuarkLink context must be enrolled
+ * \param[in] quarklink the unpacked QuarkLink context, the client does not refer to it once started
+ * \return int 0 for success
+ */
+static int mqtt_init(app_device_t *device, const quarklink_context_t *quarklink) {
+    if (device->is_running) {
+        return 0;
+    }
+    // A connection of the application task like the QuarkLink calls: the broker race and the certificate
+    // conversions of the client start are served by an arena
+    platform_connection_begin();
+    int ret = mqtt_start(device, quarklink);
+    platform_connection_end();
+    return ret;
+}
+
+static void mqtt_reset(app_device_t *device) {
+    strcpy(device->mqtt_topic, "");
+    strcpy(device->metrics_topic, "");
+    if (device->is_running) {
+        platform_mqtt_stop(device->mqtt);
+        device->mqtt = NULL;
+        device->is_running = false;
+        mqtt_router_destroy(device->router);
+        device->router = NULL;
+        mqtt_outbox_destroy(device->outbox);
+        device->outbox = NULL;
+    }
+}
+
+int app_device_load(app_device_t *device) {
+    // Only needed while loading: the device keeps the packed context
+    quarklink_context_t *quarklink = malloc(sizeof(quarklink_context_t));
+    if (quarklink == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the QuarkLink context");
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Loading stored QuarkLink context");
+    // Need to initialise a local quarklink_context_t in order to retrieve the stored one. Doesn't matter what values it is given.
+    quarklink_return_t ql_ret = quarklink_init(quarklink, "placeholder.endpoint", "");
+    ql_ret = quarklink_loadStoredContext(quarklink);
+    if (ql_ret != QUARKLINK_SUCCESS && ql_ret != QUARKLINK_CONTEXT_NO_ENROLMENT_INFO_STORED) {
+        // Any return other than QUARKLINK_SUCCESS or QUARKLINK_CONTEXT_NO_ENROLMENT_INFO_STORED is to be considered an error
+        ESP_LOGE(TAG, "Failed to load stored QuarkLink context (%d)", ql_ret);
+        ql_context_release(quarklink);
+        free(quarklink);
+        // should not happen, restart and retry
+        return -1;
+    }
+
+    // The answers of the previous boot are served at once and revalidated in the background
+    dns_cache_load();
+
+    // The enrolment fields are persisted field by field in the enrolment store
+    bool legacy_enrolment = (ql_ret == QUARKLINK_SUCCESS) && (strcmp(quarklink->iotHubEndpoint, "") != 0);
+    quarklink_context_t *legacy = NULL;
+    if (legacy_enrolment && (legacy = malloc(sizeof(quarklink_context_t))) != NULL) {
+        // The copy takes the strings, the store replaces those of the context
+        memcpy(legacy, quarklink, sizeof(quarklink_context_t));
+        quarklink->scopeID = NULL;
+        quarklink->fwUpdateTopic = NULL;
+    }
+    int stored = enrol_store_load(&device->enrol_store, quarklink);
+    if (stored == 1 && legacy != NULL) {
+        // Enrolment persisted by the QuarkLink client before the store: move it there
+        ql_context_release(quarklink);
+        memcpy(quarklink, legacy, sizeof(quarklink_context_t));
+        free(legacy);
+        legacy = NULL;
+        if (enrol_store_persist(&device->enrol_store, quarklink) == 0) {
+            quarklink_deleteEnrolmentContext(quarklink);
+        }
+    }
+    else if (stored == 1) {
+        // Should get here the first time after provisioning as the device hasn't enrolled yet
+        ESP_LOGI(TAG, "No QuarkLink enrolment info stored");
+    }
+    else if (stored != 0) {
+        // The device enrols again
+        ESP_LOGW(TAG, "Failed to load the stored enrolment");
+    }
+    ql_context_release(legacy);
+    free(legacy);
+
+    // Print instance without the "iot" subdomain
+    const char *instance_end = strchr(quarklink->endpoint, '.');
+    if (instance_end != NULL && strchr(instance_end + 1, '.') != NULL) {
+        ESP_LOGI(TAG, "Successfully loaded QuarkLink details for: %.*s%s",
+           (int)(instance_end - quarklink->endpoint),       // instance basename
+           quarklink->endpoint,
+           strchr(instance_end + 1, '.'));                  // ".quarklink.io"
+    }
+    else {
+        ESP_LOGI(TAG, "Successfully loaded QuarkLink details for: %s", quarklink->endpoint);
+    }
+    ESP_LOGI(TAG, "Device ID: %s", quarklink->deviceID);
+
+    ql_context_t context = { 0 };
+    int ret = ql_context_pack(&context, quarklink);
+    ql_context_release(quarklink);
+    free(quarklink);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to pack the QuarkLink context");
+        return -1;
+    }
+    ESP_LOGD(TAG, "QuarkLink context packed in %u bytes", (unsigned)context.arena_size);
+    // The status is not known until the first check
+    if (ql_state_init(&device->state) != 0 || ql_state_publish(&device->state, &context, QUARKLINK_ERROR) != 0) {
+        ESP_LOGE(TAG, "Failed to publish the QuarkLink context");
+        ql_context_free(&context);
+        return -1;
+    }
+    return 0;
+}
+
+/* What to do after a status check */
+typedef enum {
+    STATUS_CHECK_DONE,
+    STATUS_CHECK_RETRY,
+    STATUS_CHECK_RESTART,
+} status_check_t;
+
+/**
+ * \brief Check the QuarkLink status, then enrol, update the firmware or start the MQTT client as needed.
+ *
+ * \param[in,out] device the device
+ * \param[in,out] quarklink the unpacked QuarkLink context, updated by the QuarkLink calls
+ * \param[out] ql_status the QuarkLink status
+ */
+static status_check_t status_check(app_device_t *device, quarklink_context_t *quarklink, quarklink_return_t *ql_status) {
+    quarklink_return_t ql_ret;
+
+    /* get status */
+    ESP_LOGI(TAG, "Get status");
+    int64_t status_start = metrics_now_us();
+    platform_connection_begin();
+    *ql_status = quarklink_status(quarklink);
+    platform_connection_end();
+    metrics_record_since(METRICS_H_STATUS_RTT, status_start);
+    switch (*ql_status) {
+        case QUARKLINK_STATUS_ENROLLED:
+            ESP_LOGI(TAG, "Enrolled");
+            if (strcmp(quarklink->iotHubEndpoint, "") == 0) {
+                ESP_LOGI(TAG, "No enrolment info saved. Re-enrolling");
+                *ql_status = QUARKLINK_STATUS_NOT_ENROLLED;
+            }
+            break;
+        case QUARKLINK_STATUS_FWUPDATE_REQUIRED:
+            ESP_LOGI(TAG, "Firmware Update required");
+            break;
+        case QUARKLINK_STATUS_NOT_ENROLLED:
+            ESP_LOGI(TAG, "Not enrolled");
+            break;
+        case QUARKLINK_STATUS_CERTIFICATE_EXPIRED:
+            ESP_LOGI(TAG, "Certificate expired");
+            break;
+        case QUARKLINK_STATUS_REVOKED:
+            ESP_LOGI(TAG, "Device revoked");
+            break;
+        default:
+            ESP_LOGE(TAG, "Error during status request");
+            metrics_count(METRICS_C_STATUS_ERROR);
+            return STATUS_CHECK_RETRY;
+    }
+    #if (LED_COLOUR)
+    led_anim_show_status(*ql_status);
+    #endif
+
+    if (*ql_status == QUARKLINK_STATUS_NOT_ENROLLED ||
+        *ql_status == QUARKLINK_STATUS_CERTIFICATE_EXPIRED ||
+        *ql_status == QUARKLINK_STATUS_REVOKED) {
+        /* Reset mqtt */
+        mqtt_reset(device);
+        /* enroll */
+        ESP_LOGI(TAG, "Enrol to %s", quarklink->endpoint);
+        platform_connection_begin();
+        ql_ret = quarklink_enrol(quarklink);
+        platform_connection_end();
+        switch (ql_ret) {
+            case QUARKLINK_SUCCESS:
+                ESP_LOGI(TAG, "Successfully enrolled!");
+                if (enrol_store_persist(&device->enrol_store, quarklink) != 0) {
+                    ESP_LOGW(TAG, "Failed to store the Enrolment context");
+                }
+                // Readers, mqtt_init() first, see the new enrolment without waiting for the end of the check
+                ql_state_update(&device->state, quarklink, QUARKLINK_STATUS_ENROLLED);
+                if (device->retained != NULL) {
+                    // The broker may have changed
+                    retained_forget_broker(device->retained);
+                }
+                #if (LED_COLOUR)
+                led_anim_show_status(QUARKLINK_STATUS_ENROLLED);
+                #endif
+                /* Update Status to avoid delaying MQTT Client init */
+                *ql_status = QUARKLINK_STATUS_ENROLLED;
+                break;
+            case QUARKLINK_DEVICE_DOES_NOT_EXIST:
+                ESP_LOGW(TAG, "Device does not exist");
+                break;
+            case QUARKLINK_DEVICE_REVOKED:
+                #if (LED_COLOUR)
+                led_anim_show_status(QUARKLINK_STATUS_REVOKED);
+                #endif
+                ESP_LOGW(TAG, "Device revoked");
+                break;
+            case QUARKLINK_CACERTS_ERROR:
+            default:
+                ESP_LOGE(TAG, "Error during enrol");
+                break;
+        }
+    }
+
+    if (*ql_status == QUARKLINK_STATUS_FWUPDATE_REQUIRED) {
+        /* firmware update */
+        ESP_LOGI(TAG, "Get firmware update");
+        platform_connection_begin();
+        ql_ret = quarklink_firmwareUpdate(quarklink, NULL);
+        platform_connection_end();
+        switch (ql_ret) {
+            case QUARKLINK_FWUPDATE_UPDATED:
+                ESP_LOGI(TAG, "Firmware updated. Rebooting...");
+                mqtt_reset(device);
+                return STATUS_CHECK_RESTART;
+            case QUARKLINK_FWUPDATE_NO_UPDATE:
+                ESP_LOGI(TAG, "No firmware update");
+                break;
+            case QUARKLINK_FWUPDATE_WRONG_SIGNATURE:
+                ESP_LOGI(TAG, "Wrong firmware signature");
+                break;
+            case QUARKLINK_FWUPDATE_MISSING_SIGNATURE:
+                ESP_LOGI(TAG, "Missing required firmware signature");
+                break;
+            case QUARKLINK_FWUPDATE_ERROR:
+            default:
+                ESP_LOGE(TAG, "Error while updating firmware");
+                break;
+        }
+    }
+
+    if (*ql_status == QUARKLINK_STATUS_ENROLLED) {
+        /* Start the MQTT client */
+        if (mqtt_init(device, quarklink) != 0) {
+            ESP_LOGE(TAG, "Failed to initialise the MQTT Client");
+            return STATUS_CHECK_RETRY;
+        }
+    }
+    return STATUS_CHECK_DONE;
+}
+
+static void broker_failover(app_device_t *device) {
+    if (!device->is_running || device->mqtt_connected) {
+        return;
+    }
+    broker_race_report(&device->brokers, device->broker_address, false);
+    if (device->brokers.count < 2) {
+        // Nothing else to race: the client keeps retrying
+        return;
+    }
+    quarklink_context_t *quarklink = ql_state_begin(&device->state);
+    if (quarklink == NULL) {
+        return;
+    }
+    ESP_LOGW(TAG, "MQTT connection failed, racing the other broker addresses");
+    mqtt_reset(device);
+    if (mqtt_init(device, quarklink) != 0) {
+        ESP_LOGE(TAG, "Failed to initialise the MQTT Client");
+    }
+    ql_state_cancel(&device->state, quarklink);
+}
+
+/* Wait before the next status check, one second at a time so that a stop request is not held up */
+static void status_retry_wait(app_device_t *device, uint32_t delay_ms) {
+    for (uint32_t waited = 0; waited < delay_ms && !device->stop; waited += 1000) {
+        platform_delay_ms((delay_ms - waited < 1000) ? delay_ms - waited : 1000);
+    }
+}
+
+app_exit_t app_device_run(app_device_t *device) {
+    quarklink_return_t ql_status = QUARKLINK_ERROR;
+
+    char message[MAX_MESSAGE_LENGTH] = "";
+    uint32_t round = 0;
+    uint32_t retry_delay = 0;
+
+    while (!device->stop) {
+
+        // If it's time for a status check
+        if (round % STATUS_CHECK_INTERVAL == 0 || device->status_requested) {
+            device->status_requested = false;
+            // The QuarkLink API takes the full context: unpack it for the duration of the check
+            quarklink_context_t *quarklink = ql_state_begin(&device->state);
+            if (quarklink == NULL) {
+                ESP_LOGE(TAG, "Failed to unpack the QuarkLink context");
+                platform_delay_ms(1000);
+                continue;
+            }
+            status_check_t check = status_check(device, quarklink, &ql_status);
+            // Enrolling updates the context, the status is published with it
+            ql_state_end(&device->state, quarklink, ql_status);
+            if (check == STATUS_CHECK_RESTART) {
+                return APP_EXIT_RESTART;
+            }
+            if (check == STATUS_CHECK_RETRY) {
+                // Back off: QuarkLink or the broker may be down, or the device has no route to them
+                retry_delay = (retry_delay == 0) ? STATUS_RETRY_MIN_DELAY : retry_delay * 2;
+                retry_delay = (retry_delay < STATUS_RETRY_MAX_DELAY) ? retry_delay : STATUS_RETRY_MAX_DELAY;
+                ESP_LOGW(TAG, "Retrying the status check in %" PRIu32 " ms", retry_delay);
+                status_retry_wait(device, retry_delay);
+                continue;
+            }
+            retry_delay = 0;
+        }
+
+        // The MQTT client failed to connect to the raced address: restart it on the next one
+        if (device->failover_requested) {
+            device->failover_requested = false;
+            broker_failover(device);
+        }
+
+        // If it's time to publish
+        if ((round % MQTT_PUBLISH_INTERVAL == 0) && ql_state_isDeviceEnrolled(&device->state)) {
+            if (strcmp(device->mqtt_topic, "") == 0) {
+                const ql_snapshot_t *snapshot = ql_state_acquire(&device->state);
+                sprintf(device->mqtt_topic, "topic/%s", ql_context_string(&snapshot->context, QL_CONTEXT_DEVICE_ID));
+                ql_state_release(&device->state, snapshot);
+            }
+            sprintf(message, "{\"count\":%d}", device->count);
+            if (device->outbox != NULL) {
+                // QoS 1: queued, never waits for room in the outbox
+                if (mqtt_outbox_publish(device->outbox, device->mqtt_topic, message, 0, 0) != 0) {
+                    ESP_LOGE(TAG, "Outbox full, dropped data=%d", device->count);
+                    metrics_count(METRICS_C_PUBLISH_FAILED);
+                }
+                else {
+                    metrics_count(METRICS_C_PUBLISH_OK);
+                    ESP_LOGI(TAG, "Queued data=%d to %s", device->count, device->mqtt_topic);
+                    #if (LED_COLOUR)
+                    led_anim_flash(LED_ANIM_RGB_OFF, 100);
+                    #endif
+                }
+            }
+            else {
+                int msg_id = platform_mqtt_publish(device->mqtt, device->mqtt_topic, message, 0, 0, 0);
+                if (msg_id < 0) {
+                    ESP_LOGE(TAG, "Failed to publish to %s (ret %d)", device->mqtt_topic, msg_id);
+                    metrics_count(METRICS_C_PUBLISH_FAILED);
+                }
+                else {
+                    metrics_count(METRICS_C_PUBLISH_OK);
+                    metrics_publish_started(msg_id);
+                    ESP_LOGI(TAG, "Published data=%d to %s", device->count, device->mqtt_topic);
+                    #if (LED_COLOUR)
+                    led_anim_flash(LED_ANIM_RGB_OFF, 100);
+                    #endif
+                }
+            }
+            device->count++;
+            metrics_sample_system();
+        }
+
+        // If it's time to flush the metrics
+        if ((round % METRICS_FLUSH_INTERVAL == 0) && (round != 0) && ql_state_isDeviceEnrolled(&device->state) &&
+            !device->keep_metrics) {
+            char metrics[MAX_METRICS_LENGTH];
+            if (strcmp(device->metrics_topic, "") == 0) {
+                const ql_snapshot_t *snapshot = ql_state_acquire(&device->state);
+                if (isAzure(&snapshot->context) || isAzureCentral(&snapshot->context)) {
+                    // Azure only accepts telemetry on the device events topic
+                    strcpy(device->metrics_topic, device->mqtt_topic);
+                }
+                else {
+                    sprintf(device->metrics_topic, "metrics/%s", ql_context_string(&snapshot->context, QL_CONTEXT_DEVICE_ID));
+                }
+                ql_state_release(&device->state, snapshot);
+            }
+            int metrics_len = metrics_flush(metrics, sizeof(metrics));
+            if (metrics_len > 0 && platform_mqtt_publish(device->mqtt, device->metrics_topic, metrics, metrics_len, 0, 0) < 0) {
+                ESP_LOGW(TAG, "Failed to publish metrics to %s", device->metrics_topic);
+            }
+            platform_log_stats();
+        }
+
+        if (device->outbox != NULL) {
+            // Release the acknowledged messages, send the next ones and resend after a reconnection
+            mqtt_outbox_poll(device->outbox, 0);
+        }
+        platform_delay_ms(1000);
+        round++;
+    }
+
+    mqtt_reset(device);
+    return APP_EXIT_STOPPED;
+}
+
+/**
+ * Duty-cycle mode
+ */
+
+bool app_duty_cycle_sample(app_retained_t *retained) {
+    if (retained->magic != APP_RETAINED_MAGIC) {
+        // Power-on: check the status at the first radio wake
+        memset(retained, 0, sizeof(app_retained_t));
+        retained->magic = APP_RETAINED_MAGIC;
+        retained->since_status = DUTY_CYCLE_STATUS_INTERVAL;
+    }
+    else {
+        retained->clock_s += DUTY_CYCLE_PERIOD_S;
+    }
+
+    if (retained->sample_count == DUTY_CYCLE_SAMPLES) {
+        // The previous batches could not be published
+        memmove(retained->samples, retained->samples + 1, (DUTY_CYCLE_SAMPLES - 1) * sizeof(retained->samples[0]));
+        retained->sample_count--;
+        retained->first_sample++;
+        retained->dropped++;
+    }
+    retained->samples[retained->sample_count++] = platform_sample();
+    ESP_LOGD(TAG, "Sample %u/%d", retained->sample_count, DUTY_CYCLE_SAMPLES);
+    return retained->sample_count == DUTY_CYCLE_SAMPLES;
+}
+
+int app_device_restore(app_device_t *device, const app_retained_t *retained) {
+    if (retained->magic != APP_RETAINED_MAGIC) {
+        return -1;
+    }
+    #if (DNS_CACHE)
+    // The DNS answers are kept even without the context, which is then loaded from flash
+    dns_cache_restore(&retained->dns, retained->clock_s);
+    #endif
+    if (retained->context_length == 0) {
+        return -1;
+    }
+    quarklink_context_t *quarklink = malloc(sizeof(quarklink_context_t));
+    if (quarklink == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the QuarkLink context");
+        return -1;
+    }
+    // The client is initialised as at every boot, only loading the stored context is skipped
+    quarklink_init(quarklink, "placeholder.endpoint", "");
+    ql_context_t context = { 0 };
+    int ret = ql_context_restore(&context, retained->context, retained->context_length);
+    if (ret == 0) {
+        context.temp_cert = quarklink->tempCert;
+        ESP_LOGD(TAG, "QuarkLink context restored (%u bytes)", retained->context_length);
+        if (ql_state_init(&device->state) != 0 || ql_state_publish(&device->state, &context, QUARKLINK_ERROR) != 0) {
+            ql_context_free(&context);
+            ret = -1;
+        }
+    }
+    ql_context_release(quarklink);
+    free(quarklink);
+    return ret;
+}
+
+/* Wait for an MQTT event, an error ends the wait. msg_id -1 matches any message ID */
+static int wait_event(app_device_t *device, platform_mqtt_event_id_t id, int msg_id, uint32_t timeout_ms) {
+    int64_t deadline = platform_now_us() + timeout_ms * 1000LL;
+    app_event_t event;
+    for (;;) {
+        int64_t left_us = deadline - platform_now_us();
+        if (left_us <= 0 || platform_queue_receive(device->events, &event, (uint32_t)(left_us / 1000)) != 0) {
+            return -1;
+        }
+        if (event.id == PLATFORM_MQTT_EVENT_ERROR) {
+            return -1;
+        }
+        if (event.id == id && (msg_id < 0 || event.msg_id == msg_id)) {
+            return 0;
+        }
+    }
+}
+
+static int publish_batch(app_device_t *device, app_retained_t *retained) {
+    if (wait_event(device, PLATFORM_MQTT_EVENT_CONNECTED, -1, DUTY_CYCLE_CONNECT_TIMEOUT) != 0) {
+        ESP_LOGW(TAG, "MQTT connection failed");
+        return -1;
+    }
+    // The batch, sent with the CONNECT, is the only QoS 1 message of the connection
+    if (wait_event(device, PLATFORM_MQTT_EVENT_PUBLISHED, -1, DUTY_CYCLE_ACK_TIMEOUT) != 0) {
+        ESP_LOGW(TAG, "Batch not acknowledged");
+        metrics_count(METRICS_C_PUBLISH_FAILED);
+        return -1;
+    }
+    metrics_count(METRICS_C_PUBLISH_OK);
+    ESP_LOGI(TAG, "Published samples %" PRIu32 "-%" PRIu32 " to %s", retained->first_sample,
+             retained->first_sample + retained->sample_count - 1, device->mqtt_topic);
+    retained->first_sample += retained->sample_count;
+    retained->sample_count = 0;
+    retained->batches++;
+    return 0;
+}
+
+app_exit_t app_duty_cycle_publish(app_device_t *device, app_retained_t *retained) {
+    device->retained = retained;
+    device->events = platform_queue_create(4, sizeof(app_event_t));
+    quarklink_context_t *quarklink = (device->events != NULL) ? ql_state_begin(&device->state) : NULL;
+    if (quarklink == NULL) {
+        ESP_LOGE(TAG, "Failed to prepare the publish");
+        platform_queue_delete(device->events);
+        device->events = NULL;
+        return APP_EXIT_SLEEP;
+    }
+
+    status_check_t check = STATUS_CHECK_DONE;
+    if (retained->since_status >= DUTY_CYCLE_STATUS_INTERVAL) {
+        quarklink_return_t ql_status = QUARKLINK_ERROR;
+        check = status_check(device, quarklink, &ql_status);
+        ql_state_end(&device->state, quarklink, ql_status);
+        if (check == STATUS_CHECK_DONE && ql_status == QUARKLINK_STATUS_ENROLLED) {
+            retained->since_status = 0;
+        }
+    }
+    else {
+        if (mqtt_init(device, quarklink) != 0) {
+            ESP_LOGE(TAG, "Failed to initialise the MQTT Client");
+        }
+        // Nothing to publish: the context is unchanged and the status was not checked
+        ql_state_cancel(&device->state, quarklink);
+    }
+    retained->since_status++;
+
+    if (check != STATUS_CHECK_RESTART && device->is_running && publish_batch(device, retained) != 0) {
+        // The kept address or session may be stale: start afresh at the next radio wake
+        retained_forget_broker(retained);
+    }
+    mqtt_reset(device);
+    platform_queue_delete(device->events);
+    device->events = NULL;
+
+    const ql_snapshot_t *snapshot = ql_state_acquire(&device->state);
+    int saved = (snapshot != NULL) ? ql_context_save(&snapshot->context, retained->context, sizeof(retained->context)) : -1;
+    ql_state_release(&device->state, snapshot);
+    retained->context_length = (saved > 0) ? (uint16_t)saved : 0;
+    #if (DNS_CACHE)
+    dns_cache_save(&retained->dns);
+    #endif
+    return (check == STATUS_CHECK_RESTART) ? APP_EXIT_RESTART : APP_EXIT_SLEEP;
+}
@@ -0,0 +1,232 @@
+/**
+ * \file app.h
+ * \brief The getting started application logic: QuarkLink status, enrol, firmware update and telemetry.
+ *
+ * The logic only depends on platform.h and quarklink.h, so the same code runs on the device and,
+ * as many simulated devices, on Linux.
+ */
+#ifndef _APP_H_
+#define _APP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quarklink.h"
+#include "platform.h"
+#include "enrol_store.h"
+#include "ql_state.h"
+#include "mqtt_router.h"
+#include "mqtt_outbox.h"
+#include "broker_race.h"
+#include "dns_cache.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef LED_COLOUR
+#define LED_COLOUR  0
+#endif
+
+#define RED     1
+#define GREEN   2
+#define BLUE    3
+
+/* MQTT config */
+#define MAX_TOPIC_LENGTH    (QUARKLINK_MAX_DEVICE_ID_LENGTH + 30)
+#define MAX_MESSAGE_LENGTH  30
+#define MAX_METRICS_LENGTH  1024
+/* Largest fragmented inbound message reassembled for the handlers that need it whole */
+#define MAX_INBOUND_LENGTH  1024
+
+/* Reliable telemetry: publish with QoS 1 through an outbox with this many messages in flight, see mqtt_outbox.h.
+ * 0 to publish with QoS 0. */
+#ifndef PUBLISH_WINDOW
+#define PUBLISH_WINDOW      0
+#endif
+/* Memory of the outbox, in bytes: the publishes wait once it is full */
+#ifndef PUBLISH_OUTBOX_SIZE
+#define PUBLISH_OUTBOX_SIZE 4096
+#endif
+
+/* Other broker host names raced with the enrolled IoT Hub endpoint, comma-separated, e.g. the names of other regions.
+ * The broker certificate is still checked against the enrolled endpoint: they must serve it. */
+#ifndef MQTT_FALLBACK_ENDPOINTS
+#define MQTT_FALLBACK_ENDPOINTS     ""
+#endif
+#define MAX_FALLBACK_ENDPOINTS      3
+
+/* Duty-cycle mode: 1 to sample from deep sleep instead of running the application loop, see app_duty_cycle_sample() */
+#ifndef DUTY_CYCLE
+#define DUTY_CYCLE  0
+#endif
+/* Samples published together: the radio wakes up every DUTY_CYCLE_SAMPLES samples */
+#ifndef DUTY_CYCLE_SAMPLES
+#define DUTY_CYCLE_SAMPLES          10
+#endif
+/* Time between samples, in s */
+#ifndef DUTY_CYCLE_PERIOD_S
+#define DUTY_CYCLE_PERIOD_S         60
+#endif
+/* The QuarkLink status is checked every DUTY_CYCLE_STATUS_INTERVAL radio wakes */
+#ifndef DUTY_CYCLE_STATUS_INTERVAL
+#define DUTY_CYCLE_STATUS_INTERVAL  6
+#endif
+/* Linux only: 1 to send the batch and the MQTT CONNECT as TLS 1.3 early data when the kept session allows it, 0 to
+ * wait for the handshake. The batch always leaves with the CONNECT, without waiting for the CONNACK. Early data rides
+ * on the kept session, so it is always 0 where the backend keeps none: esp-tls exposes neither */
+#if !(PLATFORM_MQTT_TLS_SESSION)
+#undef DUTY_CYCLE_EARLY_DATA
+#define DUTY_CYCLE_EARLY_DATA       0
+#elif !defined(DUTY_CYCLE_EARLY_DATA)
+#define DUTY_CYCLE_EARLY_DATA       1
+#endif
+/* How long the resolved broker address is used, in s */
+#define DUTY_CYCLE_DNS_MAX_AGE_S    3600
+/* Room for the packed QuarkLink context in RTC memory, larger contexts are loaded from flash at every radio wake */
+#define APP_RETAINED_CONTEXT_SIZE   3072
+#define MAX_BATCH_LENGTH            (64 + DUTY_CYCLE_SAMPLES * 12)
+
+/**
+ * \brief Duty-cycle state kept across deep sleep (in RTC memory on the device)
+ */
+typedef struct {
+    /** APP_RETAINED_MAGIC once initialised: the memory is only cleared at power-on */
+    uint32_t magic;
+    /** Time since power-on, advanced by DUTY_CYCLE_PERIOD_S at every wake, in s */
+    uint32_t clock_s;
+    /** Sequence number of samples[0], the first sample since power-on is 0 */
+    uint32_t first_sample;
+    /** Samples not published yet, the oldest first */
+    int32_t samples[DUTY_CYCLE_SAMPLES];
+    uint16_t sample_count;
+    /** Samples dropped because the batch could not be published */
+    uint16_t dropped;
+    /** Batches published */
+    uint32_t batches;
+    /** Radio wakes since the last successful status check */
+    uint16_t since_status;
+    /** Length of the packed QuarkLink context saved by ql_context_save(), 0 if none */
+    uint16_t context_length;
+    uint8_t context[APP_RETAINED_CONTEXT_SIZE];
+    /** IoT Hub address, resolved at broker_resolved_s, 0 if none */
+    uint32_t broker_address;
+    uint32_t broker_resolved_s;
+    #if (PLATFORM_MQTT_TLS_SESSION)
+    /** TLS session of the last MQTT connection, Linux only: esp_mqtt does not export it, see platform.h */
+    platform_tls_session_t session;
+    #endif
+    #if (DNS_CACHE)
+    /** The DNS cache, with the expiry of its answers on clock_s */
+    dns_cache_table_t dns;
+    #endif
+} app_retained_t;
+
+/* The size is part of the magic: a firmware with another layout starts afresh */
+#define APP_RETAINED_MAGIC  (0x514C4443u ^ (uint32_t)sizeof(app_retained_t))
+
+/**
+ * \brief State of one device running the application
+ */
+typedef struct app_device {
+    /** The QuarkLink context and status, packed: read through snapshots, unpacked around the QuarkLink API calls */
+    ql_state_t state;
+    /** The persisted enrolment fields of the context */
+    enrol_store_t enrol_store;
+    /** The MQTT client, NULL until enrolled */
+    platform_mqtt_t *mqtt;
+    /** Track if the MQTT client is running */
+    bool is_running;
+    /** Routes the inbound messages to their handlers, created with the MQTT client */
+    mqtt_router_t *router;
+    /** Messages in flight of the telemetry, 0 to publish it with QoS 0 (see PUBLISH_WINDOW) */
+    uint16_t publish_window;
+    /** The outbox of the telemetry when publish_window is set, created with the MQTT client */
+    mqtt_outbox_t *outbox;
+    /** Set by the firmware update notification: check the status without waiting for the interval */
+    volatile bool status_requested;
+    /** The addresses of the broker and their health */
+    broker_race_t brokers;
+    /** Address the MQTT client connects to, 0 if it resolves the endpoint itself */
+    uint32_t broker_address;
+    /** Track if the MQTT client is connected */
+    volatile bool mqtt_connected;
+    /** Set when the MQTT client failed to connect to broker_address: race the other addresses again */
+    volatile bool failover_requested;
+    char mqtt_topic[MAX_TOPIC_LENGTH];
+    char metrics_topic[MAX_TOPIC_LENGTH];
+    /** Telemetry counter */
+    int count;
+    /** Timestamp of the last MQTT connection attempt, used to measure the handshake time */
+    int64_t mqtt_connect_start;
+    /** Do not flush the runtime metrics, the caller collects them (e.g. the load test) */
+    bool keep_metrics;
+    /** Duty-cycle mode: the state kept across deep sleep, NULL in the always-on mode */
+    app_retained_t *retained;
+    /** Duty-cycle mode: the MQTT events the publish waits for */
+    platform_queue_t *events;
+    /** Set to make \ref app_device_run return */
+    volatile bool stop;
+} app_device_t;
+
+/**
+ * \brief Why \ref app_device_run returned
+ */
+typedef enum {
+    APP_EXIT_STOPPED,   /*!< `stop` was set */
+    APP_EXIT_RESTART,   /*!< the device needs to restart, e.g. after a firmware update */
+    APP_EXIT_SLEEP,     /*!< duty-cycle mode: the batch was handled, go back to deep sleep */
+} app_exit_t;
+
+/**
+ * \brief Load the QuarkLink context stored on the device.
+ * \param[in,out] device the device, its context is initialised
+ * \return 0 for success (even when there is no enrolment information yet), -1 if the device needs to restart
+ */
+int app_device_load(app_device_t *device);
+
+/**
+ * \brief Run the application loop: check the QuarkLink status, enrol, update the firmware and publish telemetry.
+ * \param[in,out] device the device, loaded with \ref app_device_load
+ * \return the reason the loop ended
+ */
+app_exit_t app_device_run(app_device_t *device);
+
+/**
+ * \brief Duty-cycle mode: take a sample, at every wake from deep sleep. Initialises \p retained at power-on.
+ * When the batch is full and could not be published, the oldest sample is dropped.
+ * \param[in,out] retained the state kept across deep sleep
+ * \return true when DUTY_CYCLE_SAMPLES samples are waiting: bring the network up and call \ref app_duty_cycle_publish
+ */
+bool app_duty_cycle_sample(app_retained_t *retained);
+
+/**
+ * \brief Duty-cycle mode: restore the QuarkLink context kept across deep sleep, instead of loading it from flash
+ * with \ref app_device_load. The QuarkLink client is still initialised.
+ * \param[in,out] device   the device, zero-initialised
+ * \param[in]     retained the state kept across deep sleep
+ * \return 0 for success, -1 if no context was kept
+ */
+int app_device_restore(app_device_t *device, const app_retained_t *retained);
+
+/**
+ * \brief Duty-cycle mode: publish the waiting samples in one message and wait for its acknowledgement.
+ * The QuarkLink status is checked every DUTY_CYCLE_STATUS_INTERVAL calls. The broker address is reused from
+ * \p retained, then the context and the address are kept there for the next call. The Linux backend also keeps
+ * the TLS session there (PLATFORM_MQTT_TLS_SESSION); the device makes a full handshake at every radio wake.
+ * The samples are kept when the batch could not be published.
+ * \param[in,out] device   the device, loaded or restored, with the network up
+ * \param[in,out] retained the state kept across deep sleep
+ * \return APP_EXIT_SLEEP, or APP_EXIT_RESTART after a firmware update
+ */
+app_exit_t app_duty_cycle_publish(app_device_t *device, app_retained_t *retained);
+
+bool isAzure(const ql_context_t *context);
+bool isAzureCentral(const ql_context_t *context);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _APP_H_
@@ -0,0 +1,250 @@
+/**
+ * \file broker_race.c
+ * \brief Choice of the broker address by racing connections, see broker_race.h.
+ *
+ * Plain BSD sockets: lwIP on the device, the host stack on Linux.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "esp_log.h"
+
+#include "broker_race.h"
+#include "platform.h"
+
+static const char *TAG = "broker_race";
+
+static void record_failure(broker_race_address_t *entry, int64_t now_us) {
+    if (entry->failures < UINT16_MAX) {
+        entry->failures++;
+    }
+    int64_t penalty_s = (entry->failures > 9) ? BROKER_RACE_MAX_PENALTY_S : (1 << (entry->failures - 1));
+    if (penalty_s > BROKER_RACE_MAX_PENALTY_S) {
+        penalty_s = BROKER_RACE_MAX_PENALTY_S;
+    }
+    entry->penalty_until_us = now_us + penalty_s * 1000000;
+}
+
+static void record_success(broker_race_address_t *entry, uint32_t connect_us) {
+    // Smoothed as TCP smooths the round-trip time
+    entry->connect_us = (entry->connect_us == 0) ? connect_us : (7 * entry->connect_us + connect_us) / 8;
+    entry->failures = 0;
+    entry->penalty_until_us = 0;
+}
+
+static broker_race_address_t *find(broker_race_t *race, uint32_t address) {
+    for (size_t i = 0; i < race->count; i++) {
+        if (race->addresses[i].address == address) {
+            return &race->addresses[i];
+        }
+    }
+    return NULL;
+}
+
+int broker_race_resolve(broker_race_t *race, const char *const *hosts, size_t count, uint16_t port) {
+    broker_race_address_t resolved[BROKER_RACE_MAX_ADDRESSES];
+    size_t resolved_count = 0;
+    for (size_t i = 0; i < count && resolved_count < BROKER_RACE_MAX_ADDRESSES; i++) {
+        uint32_t addresses[BROKER_RACE_MAX_ADDRESSES];
+        int found = platform_dns_resolve_all(hosts[i], addresses, BROKER_RACE_MAX_ADDRESSES - resolved_count);
+        for (int j = 0; j < found; j++) {
+            bool duplicate = false;
+            for (size_t k = 0; k < resolved_count && !duplicate; k++) {
+                duplicate = (resolved[k].address == addresses[j]);
+            }
+            if (duplicate) {
+                continue;
+            }
+            const broker_race_address_t *known = find(race, addresses[j]);
+            if (known != NULL && port == race->port) {
+                resolved[resolved_count] = *known;
+            }
+            else {
+                memset(&resolved[resolved_count], 0, sizeof(broker_race_address_t));
+                resolved[resolved_count].address = addresses[j];
+            }
+            resolved_count++;
+        }
+    }
+    if (resolved_count == 0) {
+        return -1;
+    }
+    memcpy(race->addresses, resolved, resolved_count * sizeof(broker_race_address_t));
+    race->count = resolved_count;
+    race->port = port;
+    return (int)resolved_count;
+}
+
+/* Order of the attempts: the addresses without a penalty first, the fastest first, then the resolver order */
+static void rank(const broker_race_t *race, int64_t now_us, size_t *order) {
+    for (size_t i = 0; i < race->count; i++) {
+        order[i] = i;
+    }
+    // Insertion sort, stable: there are only a few addresses
+    for (size_t i = 1; i < race->count; i++) {
+        size_t current = order[i];
+        const broker_race_address_t *entry = &race->addresses[current];
+        bool penalised = entry->penalty_until_us > now_us;
+        uint32_t connect_us = (entry->connect_us != 0) ? entry->connect_us : UINT32_MAX;
+        size_t j = i;
+        while (j > 0) {
+            const broker_race_address_t *before = &race->addresses[order[j - 1]];
+            bool before_penalised = before->penalty_until_us > now_us;
+            uint32_t before_us = (before->connect_us != 0) ? before->connect_us : UINT32_MAX;
+            if (before_penalised < penalised || (before_penalised == penalised && before_us <= connect_us)) {
+                break;
+            }
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = current;
+    }
+}
+
+/* Start a non-blocking connection: the socket, or -1 if it failed right away */
+static int start_attempt(uint32_t address, uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int flags = fcntl(fd, F_GETFL, 0);
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = address,
+    };
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        (connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0 && errno != EINPROGRESS)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int broker_race_connect(broker_race_t *race, uint32_t *address, int *connection) {
+    uint32_t stagger_us = ((race->stagger_ms != 0) ? race->stagger_ms : BROKER_RACE_STAGGER_MS) * 1000;
+    uint32_t timeout_ms = (race->timeout_ms != 0) ? race->timeout_ms : BROKER_RACE_TIMEOUT_MS;
+    size_t order[BROKER_RACE_MAX_ADDRESSES];
+    int fds[BROKER_RACE_MAX_ADDRESSES];
+    int64_t started_us[BROKER_RACE_MAX_ADDRESSES];
+
+    int64_t start_us = platform_now_us();
+    int64_t deadline_us = start_us + timeout_ms * 1000LL;
+    int64_t next_start_us = start_us;
+    rank(race, start_us, order);
+    race->stats.races++;
+
+    size_t started = 0;
+    size_t pending = 0;
+    int winner = -1;
+    while (winner < 0) {
+        int64_t now_us = platform_now_us();
+        if (started < race->count && (now_us >= next_start_us || pending == 0)) {
+            size_t index = order[started];
+            fds[started] = start_attempt(race->addresses[index].address, race->port);
+            started_us[started] = now_us;
+            race->stats.attempts++;
+            if (fds[started] < 0) {
+                record_failure(&race->addresses[index], now_us);
+            }
+            else {
+                pending++;
+            }
+            started++;
+            next_start_us = now_us + stagger_us;
+            continue;
+        }
+        if (pending == 0 || now_us >= deadline_us) {
+            break;
+        }
+
+        // Wait for an attempt to complete, or for the time to start the next one
+        int64_t wake_us = (started < race->count && next_start_us < deadline_us) ? next_start_us : deadline_us;
+        fd_set writable;
+        FD_ZERO(&writable);
+        int max_fd = -1;
+        for (size_t i = 0; i < started; i++) {
+            if (fds[i] >= 0) {
+                FD_SET(fds[i], &writable);
+                max_fd = (fds[i] > max_fd) ? fds[i] : max_fd;
+            }
+        }
+        struct timeval timeout = {
+            .tv_sec = (wake_us - now_us) / 1000000,
+            .tv_usec = (wake_us - now_us) % 1000000,
+        };
+        if (select(max_fd + 1, NULL, &writable, NULL, &timeout) <= 0) {
+            continue;
+        }
+        now_us = platform_now_us();
+        for (size_t i = 0; i < started && winner < 0; i++) {
+            if (fds[i] < 0 || !FD_ISSET(fds[i], &writable)) {
+                continue;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+                winner = (int)i;
+                record_success(&race->addresses[order[i]], (uint32_t)(now_us - started_us[i]));
+            }
+            else {
+                // Start the next attempt without waiting for the stagger
+                record_failure(&race->addresses[order[i]], now_us);
+                close(fds[i]);
+                fds[i] = -1;
+                pending--;
+                next_start_us = now_us;
+            }
+        }
+    }
+
+    // The attempts still pending lost, or timed out when none won
+    int64_t now_us = platform_now_us();
+    for (size_t i = 0; i < started; i++) {
+        if (fds[i] >= 0 && (int)i != winner) {
+            if (winner < 0) {
+                record_failure(&race->addresses[order[i]], now_us);
+            }
+            close(fds[i]);
+        }
+    }
+    if (winner < 0) {
+        race->stats.failures++;
+        ESP_LOGW(TAG, "No broker address connected (%u tried)", (unsigned)started);
+        return -1;
+    }
+    if (winner > 0) {
+        race->stats.failovers++;
+        ESP_LOGI(TAG, "Broker address %d of %u connected first", winner + 1, (unsigned)race->count);
+    }
+    *address = race->addresses[order[winner]].address;
+    // The winning connection is handed over as it is, blocking again for the TLS handshake
+    int flags = fcntl(fds[winner], F_GETFL, 0);
+    if (connection == NULL || flags < 0 || fcntl(fds[winner], F_SETFL, flags & ~O_NONBLOCK) < 0) {
+        close(fds[winner]);
+        fds[winner] = -1;
+    }
+    if (connection != NULL) {
+        *connection = fds[winner];
+    }
+    return 0;
+}
+
+void broker_race_report(broker_race_t *race, uint32_t address, bool connected) {
+    broker_race_address_t *entry = find(race, address);
+    if (entry == NULL) {
+        return;
+    }
+    if (connected) {
+        entry->failures = 0;
+        entry->penalty_until_us = 0;
+    }
+    else {
+        record_failure(entry, platform_now_us());
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * \file broker_race.h
+ * \brief Choice of the broker address: staggered connection attempts to every address of the broker endpoints,
+ * the first one to connect wins (Happy Eyeballs, RFC 8305, for IPv4 only).
+ *
+ * \ref broker_race_resolve collects the addresses of the endpoints. \ref broker_race_connect starts a TCP
+ * connection to the best ranked address, then to the next one every `stagger_ms` while none has connected, or
+ * as soon as one fails. The first connection established wins, the others are abandoned. A slow or dead address
+ * then costs `stagger_ms` instead of the TCP timeout.
+ *
+ * The health of each address is remembered across races: the time its connections take, smoothed, and its
+ * consecutive failures. An address that failed is ranked last for a time that doubles with every failure,
+ * up to BROKER_RACE_MAX_PENALTY_S. The others are ranked by connection time, the addresses never connected to
+ * in the order of the resolver.
+ *
+ * The race only connects over TCP. The winning connection is handed over to the MQTT client, which starts the
+ * TLS handshake on it rather than connecting to the address again. The broker name stays the TLS server name.
+ */
+#ifndef _BROKER_RACE_H_
+#define _BROKER_RACE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Most addresses kept, across all the endpoints */
+#define BROKER_RACE_MAX_ADDRESSES   (8)
+/** Connection attempt delay of RFC 8305 */
+#define BROKER_RACE_STAGGER_MS      (250)
+/** Time given to a whole race */
+#define BROKER_RACE_TIMEOUT_MS      (10000)
+/** Longest time an address that failed is ranked last */
+#define BROKER_RACE_MAX_PENALTY_S   (300)
+
+/**
+ * \brief Health of an address
+ */
+typedef struct {
+    /** The address, in network byte order */
+    uint32_t address;
+    /** Smoothed connection time in microseconds, 0 until connected once */
+    uint32_t connect_us;
+    /** Consecutive failures */
+    uint16_t failures;
+    /** Ranked last until then (platform_now_us()) */
+    int64_t penalty_until_us;
+} broker_race_address_t;
+
+/**
+ * \brief Race statistics
+ */
+typedef struct {
+    uint32_t races;
+    /** Connections started */
+    uint32_t attempts;
+    /** Races won by another address than the best ranked one */
+    uint32_t failovers;
+    /** Races no address won */
+    uint32_t failures;
+} broker_race_stats_t;
+
+/**
+ * \brief Addresses of the broker of one device
+ */
+typedef struct {
+    broker_race_address_t addresses[BROKER_RACE_MAX_ADDRESSES];
+    size_t count;
+    uint16_t port;
+    /** Delay between two attempts, 0 for BROKER_RACE_STAGGER_MS */
+    uint32_t stagger_ms;
+    /** Time given to a race, 0 for BROKER_RACE_TIMEOUT_MS */
+    uint32_t timeout_ms;
+    broker_race_stats_t stats;
+} broker_race_t;
+
+/**
+ * \brief Resolve the broker endpoints. The health of the addresses known before is kept, the addresses
+ * the endpoints no longer resolve to are forgotten.
+ * \param[in,out] race  the addresses, zero-initialised before the first call
+ * \param[in]     hosts the endpoints, the enrolled one first
+ * \param[in]     count the number of endpoints
+ * \param[in]     port  the broker port
+ * \return the number of addresses, -1 if no endpoint could be resolved (the addresses are then kept)
+ */
+int broker_race_resolve(broker_race_t *race, const char *const *hosts, size_t count, uint16_t port);
+
+/**
+ * \brief Race connections to the addresses and update their health.
+ * \param[in,out] race       the addresses
+ * \param[out]    address    the address that connected first, in network byte order
+ * \param[out]    connection the connection to \p address, blocking, owned by the caller; -1 if it could not be
+ *                           kept. NULL to close it.
+ * \return 0 for success, -1 if no address connected within the timeout
+ */
+int broker_race_connect(broker_race_t *race, uint32_t *address, int *connection);
+
+/**
+ * \brief Report the outcome of a later connection to an address, e.g. a TLS handshake that failed.
+ * Unknown addresses are ignored.
+ */
+void broker_race_report(broker_race_t *race, uint32_t address, bool connected);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _BROKER_RACE_H_
@@ -0,0 +1,160 @@
+/**
+ * \file cert_cache.c
+ * \brief Parse-once cache of the enrolment certificates.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "mbedtls/pem.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "cert_cache.h"
+#include "tls_pool.h"
+
+static const char *TAG = "cert_cache";
+
+#define PEM_BEGIN_CRT   "-----BEGIN CERTIFICATE-----"
+#define PEM_END_CRT     "-----END CERTIFICATE-----"
+#define HASH_LENGTH     (32)
+
+typedef struct {
+    /** SHA-256 of the PEM the cached data was obtained from */
+    unsigned char pem_hash[HASH_LENGTH];
+    bool valid;
+} cert_cache_source_t;
+
+static cert_cache_source_t s_device_source;
+static unsigned char *s_device_der = NULL;
+static size_t s_device_der_len = 0;
+
+static cert_cache_source_t s_root_source;
+static mbedtls_x509_crt s_root_crt;
+
+static cert_cache_stats_t s_stats;
+
+static void pem_hash(const char *pem, unsigned char hash[HASH_LENGTH]) {
+    mbedtls_sha256((const unsigned char *)pem, strlen(pem), hash, 0);
+}
+
+static bool source_matches(const cert_cache_source_t *source, const unsigned char hash[HASH_LENGTH]) {
+    return source->valid && memcmp(source->pem_hash, hash, HASH_LENGTH) == 0;
+}
+
+/* Convert a PEM holding a single certificate to DER. Chains are left as PEM. */
+static int device_cert_to_der(const char *pem) {
+    mbedtls_pem_context ctx;
+    size_t used = 0;
+    int ret = -1;
+
+    free(s_device_der);
+    s_device_der = NULL;
+    s_device_der_len = 0;
+
+    if (strstr(pem, PEM_BEGIN_CRT) == NULL) {
+        return -1;
+    }
+    if (strstr(strstr(pem, PEM_BEGIN_CRT) + 1, PEM_BEGIN_CRT) != NULL) {
+        // A DER buffer can only hold one certificate, esp-tls will parse the PEM chain
+        ESP_LOGD(TAG, "Device certificate is a chain, keeping PEM");
+        return 0;
+    }
+
+    mbedtls_pem_init(&ctx);
+    if (mbedtls_pem_read_buffer(&ctx, PEM_BEGIN_CRT, PEM_END_CRT, (const unsigned char *)pem, NULL, 0, &used) == 0) {
+        size_t der_len = 0;
+        const unsigned char *der = mbedtls_pem_get_buffer(&ctx, &der_len);
+        s_device_der = malloc(der_len);
+        if (s_device_der != NULL) {
+            memcpy(s_device_der, der, der_len);
+            s_device_der_len = der_len;
+            ret = 0;
+        }
+    }
+    mbedtls_pem_free(&ctx);
+    return ret;
+}
+
+void cert_cache_clear(void) {
+    free(s_device_der);
+    s_device_der = NULL;
+    s_device_der_len = 0;
+    s_device_source.valid = false;
+
+    if (s_root_source.valid) {
+        mbedtls_x509_crt_free(&s_root_crt);
+    }
+    s_root_source.valid = false;
+}
+
+int cert_cache_update(const quarklink_context_t *quarklink) {
+    unsigned char hash[HASH_LENGTH];
+
+    if (quarklink == NULL) {
+        return -1;
+    }
+
+    pem_hash(quarklink->deviceCert, hash);
+    if (!source_matches(&s_device_source, hash)) {
+        s_device_source.valid = false;
+        if (device_cert_to_der(quarklink->deviceCert) != 0) {
+            ESP_LOGE(TAG, "Failed to convert the device certificate");
+            cert_cache_clear();
+            return -1;
+        }
+        memcpy(s_device_source.pem_hash, hash, HASH_LENGTH);
+        s_device_source.valid = true;
+        s_stats.conversions++;
+    }
+
+    pem_hash(quarklink->iotHubRootCert, hash);
+    if (!source_matches(&s_root_source, hash)) {
+        if (s_root_source.valid) {
+            mbedtls_x509_crt_free(&s_root_crt);
+            s_root_source.valid = false;
+        }
+        mbedtls_x509_crt_init(&s_root_crt);
+        /* Kept across connections: from the heap, an arena holding it would never be released */
+        tls_pool_arena_suspend();
+        int ret = mbedtls_x509_crt_parse(&s_root_crt, (const unsigned char *)quarklink->iotHubRootCert,
+                                         strlen(quarklink->iotHubRootCert) + 1);
+        tls_pool_arena_resume();
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Failed to parse the IoT Hub root certificate (-0x%x)", -ret);
+            mbedtls_x509_crt_free(&s_root_crt);
+            cert_cache_clear();
+            return -1;
+        }
+        memcpy(s_root_source.pem_hash, hash, HASH_LENGTH);
+        s_root_source.valid = true;
+        s_stats.conversions++;
+    }
+    return 0;
+}
+
+const unsigned char *cert_cache_device_cert(size_t *length) {
+    if (length != NULL) {
+        *length = s_device_der_len;
+    }
+    return s_device_der;
+}
+
+bool cert_cache_has_root(void) {
+    return s_root_source.valid;
+}
+
+esp_err_t cert_cache_attach(void *conf) {
+    if (conf == NULL || !s_root_source.valid) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    mbedtls_ssl_conf_ca_chain((mbedtls_ssl_config *)conf, &s_root_crt, NULL);
+    s_stats.attaches++;
+    return ESP_OK;
+}
+
+void cert_cache_get_stats(cert_cache_stats_t *stats) {
+    if (stats != NULL) {
+        *stats = s_stats;
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * \file cert_cache.h
+ * \brief Parse-once cache of the enrolment certificates shared by all MQTT connections.
+ *
+ * The PEM certificates obtained from QuarkLink are converted once after enrolment:
+ * the device certificate to DER, so that esp-tls does not need to base64-decode it at every
+ * connection, and the IoT Hub root certificate to a parsed mbedtls_x509_crt that is attached
+ * to every TLS configuration instead of being parsed from scratch.
+ *
+ * The broker chain is still verified in full at every handshake: mbedtls verifies it before calling any verify
+ * callback, so pinning the broker certificate would not save any work.
+ */
+#ifndef _CERT_CACHE_H_
+#define _CERT_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#include "quarklink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Cache statistics
+ */
+typedef struct {
+    /** Number of times the PEM certificates were converted */
+    uint32_t conversions;
+    /** Number of TLS configurations that reused the cached root */
+    uint32_t attaches;
+} cert_cache_stats_t;
+
+/**
+ * \brief Update the cache from the enrolment context. Conversion only happens if the
+ * certificates changed since the previous call.
+ * \param[in] quarklink the enrolled QuarkLink context
+ * \return 0 for success, -1 if a certificate could not be converted (the cache is then cleared)
+ */
+int cert_cache_update(const quarklink_context_t *quarklink);
+
+/**
+ * \brief Release the cached certificates.
+ */
+void cert_cache_clear(void);
+
+/**
+ * \brief Get the device certificate to use in the connection configuration.
+ * \param[out] length the certificate length: non-zero for DER, zero for a NULL-terminated PEM
+ * \return the cached DER certificate, or NULL if none is cached
+ */
+const unsigned char *cert_cache_device_cert(size_t *length);
+
+/**
+ * \brief Check whether the parsed IoT Hub root is available.
+ */
+bool cert_cache_has_root(void);
+
+/**
+ * \brief Attach the cached IoT Hub root to a TLS configuration.
+ * Meant to be used as `crt_bundle_attach` in the esp-tls based client configurations.
+ * \param[in,out] conf the mbedtls_ssl_config being set up
+ * \return ESP_OK, or ESP_ERR_INVALID_STATE if no root is cached
+ */
+esp_err_t cert_cache_attach(void *conf);
+
+/**
+ * \brief Get a copy of the cache statistics.
+ */
+void cert_cache_get_stats(cert_cache_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _CERT_CACHE_H_
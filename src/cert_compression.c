@@ -0,0 +1,51 @@
+/**
+ * \file cert_compression.c
+ * \brief zlib decoder for compressed certificates, on the miniz inflater of the ROM.
+ */
+#include <stdlib.h>
+#include "esp_log.h"
+#include "rom/miniz.h"
+#include "mbedtls/ssl_cert_compression.h"
+
+#include "cert_compression.h"
+
+static const char *TAG = "cert_compression";
+
+static const uint16_t s_algs[] = { MBEDTLS_SSL_CERT_COMPRESSION_ZLIB };
+
+int cert_compression_init(void) {
+    if (mbedtls_ssl_set_cert_decompression(s_algs, sizeof(s_algs) / sizeof(s_algs[0]),
+                                           cert_compression_decompress, NULL) != 0) {
+        ESP_LOGE(TAG, "Failed to register the certificate decoder");
+        return -1;
+    }
+    return 0;
+}
+
+int cert_compression_decompress(void *ctx, uint16_t alg, const unsigned char *in, size_t in_len,
+                                unsigned char *out, size_t out_len) {
+    if (alg != MBEDTLS_SSL_CERT_COMPRESSION_ZLIB) {
+        return -1;
+    }
+    /* About 11 KB, only needed for the time of the message */
+    tinfl_decompressor *inflater = malloc(sizeof(tinfl_decompressor));
+    if (inflater == NULL) {
+        ESP_LOGE(TAG, "Out of memory for the inflater");
+        return -1;
+    }
+    tinfl_init(inflater);
+    size_t in_size = in_len;
+    size_t out_size = out_len;
+    /* The whole message is in one buffer and the output is sized by the server: anything
+     * but a stream that ends exactly at out_len is an error */
+    tinfl_status status = tinfl_decompress(inflater, in, &in_size, out, out, &out_size,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER |
+                                           TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+    free(inflater);
+    if (status != TINFL_STATUS_DONE || in_size != in_len || out_size != out_len) {
+        ESP_LOGW(TAG, "Invalid compressed certificate (status %d, %u of %u bytes)",
+                 status, (unsigned)out_size, (unsigned)out_len);
+        return -1;
+    }
+    return 0;
+}
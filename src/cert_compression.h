@@ -0,0 +1,41 @@
+/**
+ * \file cert_compression.h
+ * \brief Decoder for the compressed server certificates of TLS 1.3 (RFC 8879).
+ *
+ * The patched mbedtls advertises compress_certificate once a decoder is registered, and QuarkLink
+ * or the MQTT broker may then send their chain as a CompressedCertificate. Only zlib is offered:
+ * the decoder is the miniz inflater of the ROM, so it adds no code, and its state is allocated for
+ * the time of one message. The device's own Certificate is sent uncompressed.
+ */
+#ifndef _CERT_COMPRESSION_H_
+#define _CERT_COMPRESSION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief Register the decoder with mbedtls. Call once, before the first TLS connection.
+ * \return 0 for success, -1 if mbedtls refused it
+ */
+int cert_compression_init(void);
+
+/**
+ * \brief Decompress a certificate message, the decoder registered by \ref cert_compression_init.
+ * \param[in] alg     the algorithm, MBEDTLS_SSL_CERT_COMPRESSION_ZLIB
+ * \param[out] out    the buffer of the decompressed message
+ * \param[in] out_len the length announced by the server
+ * \return 0 if exactly \p out_len bytes were decompressed, -1 otherwise
+ */
+int cert_compression_decompress(void *ctx, uint16_t alg, const unsigned char *in, size_t in_len,
+                                unsigned char *out, size_t out_len);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _CERT_COMPRESSION_H_
@@ -0,0 +1,678 @@
+/**
+ * \file dns_cache.c
+ * \brief Persistent DNS cache with stale-while-revalidate, see dns_cache.h.
+ *
+ * The queries use plain BSD sockets: lwIP on the device, the host stack on Linux.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "dns_cache.h"
+#include "platform.h"
+#include "metrics.h"
+
+#if (DNS_CACHE)
+
+static const char *TAG = "dns_cache";
+
+#define DNS_CACHE_NAMESPACE     "dns_cache"
+#define DNS_CACHE_KEY           "table"
+/** Below the application task: a revalidation never delays a connection */
+#define REVALIDATE_TASK_PRIORITY    4
+
+/* DNS messages, RFC 1035 */
+#define DNS_HEADER_SIZE     12
+#define DNS_MAX_MESSAGE     512
+#define DNS_MAX_LABEL       63
+#define DNS_TYPE_A          1
+#define DNS_TYPE_CNAME      5
+#define DNS_CLASS_IN        1
+#define DNS_FLAG_QR         0x8000
+#define DNS_FLAG_RD         0x0100
+#define DNS_RCODE_MASK      0x000F
+/** parse_reply(): a datagram that does not answer the query */
+#define NOT_AN_ANSWER       (-2)
+
+static struct {
+    /** NULL when the cache is not running */
+    platform_mutex_t *lock;
+    dns_cache_table_t table;
+    /** Entries waiting for the revalidation task */
+    bool pending[DNS_CACHE_ENTRIES];
+    /** Name missed by dns_cache_lookup(), queried by the revalidation task, empty for none */
+    char fill[DNS_CACHE_MAX_NAME];
+    /** The revalidation task is running */
+    bool revalidating;
+    /** The cache clock was clock_s at clock_us (platform_now_us()) */
+    uint32_t clock_s;
+    int64_t clock_us;
+    dns_cache_stats_t stats;
+} s_cache;
+
+typedef enum {
+    ANSWER_FRESH,
+    ANSWER_STALE,
+    ANSWER_EXPIRED,
+} answer_age_t;
+
+static uint32_t clock_now_s(void) {
+    return s_cache.clock_s + (uint32_t)((platform_now_us() - s_cache.clock_us) / 1000000);
+}
+
+static answer_age_t answer_age(const dns_cache_entry_t *entry, uint32_t now_s) {
+    if (entry->expires_s == 0) {
+        // Loaded from NVS
+        return ANSWER_STALE;
+    }
+    if (now_s < entry->expires_s) {
+        return ANSWER_FRESH;
+    }
+    return (now_s - entry->expires_s <= DNS_CACHE_MAX_STALE_S) ? ANSWER_STALE : ANSWER_EXPIRED;
+}
+
+static int find(const char *host) {
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        if (s_cache.table.entries[i].name[0] != '\0' && strcasecmp(s_cache.table.entries[i].name, host) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int copy_addresses(const dns_cache_entry_t *entry, uint32_t *addresses, size_t max) {
+    size_t count = (entry->count < max) ? entry->count : max;
+    memcpy(addresses, entry->addresses, count * sizeof(uint32_t));
+    return (int)count;
+}
+
+static uint16_t get16(const uint8_t *bytes) {
+    return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+static uint32_t get32(const uint8_t *bytes) {
+    return ((uint32_t)get16(bytes) << 16) | get16(bytes + 2);
+}
+
+static void put16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+}
+
+/* A recursive query of the A records of host: its length, -1 if the name cannot be encoded */
+static int build_query(const char *host, uint16_t id, uint8_t *message, size_t size) {
+    memset(message, 0, DNS_HEADER_SIZE);
+    put16(message, id);
+    put16(message + 2, DNS_FLAG_RD);
+    put16(message + 4, 1);
+    size_t pos = DNS_HEADER_SIZE;
+    const char *label = host;
+    while (*label != '\0') {
+        const char *dot = strchr(label, '.');
+        size_t length = (dot != NULL) ? (size_t)(dot - label) : strlen(label);
+        if (length == 0 || length > DNS_MAX_LABEL || pos + 1 + length + 5 > size) {
+            return -1;
+        }
+        message[pos++] = (uint8_t)length;
+        memcpy(message + pos, label, length);
+        pos += length;
+        label += length + (dot != NULL ? 1 : 0);
+    }
+    message[pos++] = 0;
+    put16(message + pos, DNS_TYPE_A);
+    put16(message + pos + 2, DNS_CLASS_IN);
+    return (int)(pos + 4);
+}
+
+/* Position after the name at pos, -1 if it overflows the message */
+static int skip_name(const uint8_t *message, size_t length, size_t pos) {
+    while (pos < length) {
+        uint8_t label = message[pos];
+        if (label == 0) {
+            return (int)(pos + 1);
+        }
+        if ((label & 0xC0) == 0xC0) {
+            // Compression pointer: the name ends here
+            return (pos + 2 <= length) ? (int)(pos + 2) : -1;
+        }
+        if ((label & 0xC0) != 0) {
+            return -1;
+        }
+        pos += 1 + label;
+    }
+    return -1;
+}
+
+/**
+ * \brief Read the addresses of a reply to \p query, and the smallest TTL of its CNAME and A records.
+ * \return the number of addresses, -1 if the server has none, NOT_AN_ANSWER if the datagram is not a reply
+ */
+static int parse_reply(const uint8_t *reply, size_t length, const uint8_t *query, size_t query_length,
+                       uint32_t *addresses, size_t max, uint32_t *ttl_s) {
+    if (length < query_length || get16(reply) != get16(query) || (get16(reply + 2) & DNS_FLAG_QR) == 0 ||
+        get16(reply + 4) != 1) {
+        return NOT_AN_ANSWER;
+    }
+    // The question asked, the server may change the case of the name
+    for (size_t i = DNS_HEADER_SIZE; i < query_length; i++) {
+        if (tolower(reply[i]) != tolower(query[i])) {
+            return NOT_AN_ANSWER;
+        }
+    }
+    if ((get16(reply + 2) & DNS_RCODE_MASK) != 0) {
+        return -1;
+    }
+
+    uint16_t answers = get16(reply + 6);
+    size_t pos = query_length;
+    size_t count = 0;
+    uint32_t ttl = UINT32_MAX;
+    // A truncated reply keeps the records read before the end
+    for (uint16_t i = 0; i < answers; i++) {
+        int next = skip_name(reply, length, pos);
+        if (next < 0 || (size_t)next + 10 > length) {
+            break;
+        }
+        pos = (size_t)next;
+        uint16_t type = get16(reply + pos);
+        uint16_t class = get16(reply + pos + 2);
+        uint32_t record_ttl = get32(reply + pos + 4);
+        uint16_t data_length = get16(reply + pos + 8);
+        pos += 10;
+        if (pos + data_length > length) {
+            break;
+        }
+        if (class == DNS_CLASS_IN && (type == DNS_TYPE_CNAME || (type == DNS_TYPE_A && data_length == 4))) {
+            ttl = (record_ttl < ttl) ? record_ttl : ttl;
+            if (type == DNS_TYPE_A && count < max) {
+                memcpy(&addresses[count++], reply + pos, 4);
+            }
+        }
+        pos += data_length;
+    }
+    if (count == 0) {
+        return -1;
+    }
+    *ttl_s = ttl;
+    return (int)count;
+}
+
+/* Query the server for host: the number of addresses, -1 without an answer */
+static int query(const char *host, uint32_t *addresses, size_t max, uint32_t *ttl_s) {
+    uint32_t server;
+    uint16_t port;
+    if (platform_dns_server(&server, &port) != 0) {
+        return -1;
+    }
+    uint8_t message[DNS_MAX_MESSAGE];
+    uint16_t id;
+    platform_random(&id, sizeof(id));
+    int length = build_query(host, id, message, sizeof(message));
+    if (length < 0) {
+        return -1;
+    }
+
+    // Connected: only the datagrams of the server are received
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in to = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = server,
+    };
+    if (fd < 0 || connect(fd, (struct sockaddr *)&to, sizeof(to)) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    int found = NOT_AN_ANSWER;
+    for (int attempt = 0; attempt < 2 && found == NOT_AN_ANSWER; attempt++) {
+        if (send(fd, message, (size_t)length, 0) != length) {
+            found = -1;
+            break;
+        }
+        int64_t deadline_us = platform_now_us() + DNS_CACHE_QUERY_TIMEOUT_MS * 1000LL;
+        while (found == NOT_AN_ANSWER) {
+            int64_t left_us = deadline_us - platform_now_us();
+            if (left_us <= 0) {
+                break;
+            }
+            fd_set readable;
+            FD_ZERO(&readable);
+            FD_SET(fd, &readable);
+            struct timeval timeout = {
+                .tv_sec = left_us / 1000000,
+                .tv_usec = left_us % 1000000,
+            };
+            int ready = select(fd + 1, &readable, NULL, NULL, &timeout);
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                break;
+            }
+            uint8_t reply[DNS_MAX_MESSAGE];
+            ssize_t received = recv(fd, reply, sizeof(reply), 0);
+            if (received < 0) {
+                // e.g. no server on the port
+                found = -1;
+                break;
+            }
+            found = parse_reply(reply, (size_t)received, message, (size_t)length, addresses, max, ttl_s);
+        }
+    }
+    close(fd);
+    return (found > 0) ? found : -1;
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Whether two answers hold the same addresses, in any order: resolvers rotate them from one answer to the next */
+static bool same_addresses(const uint32_t *a, const uint32_t *b, int count) {
+    uint32_t sorted_a[DNS_CACHE_MAX_ADDRESSES];
+    uint32_t sorted_b[DNS_CACHE_MAX_ADDRESSES];
+    memcpy(sorted_a, a, count * sizeof(uint32_t));
+    memcpy(sorted_b, b, count * sizeof(uint32_t));
+    qsort(sorted_a, count, sizeof(uint32_t), compare_addresses);
+    qsort(sorted_b, count, sizeof(uint32_t), compare_addresses);
+    return memcmp(sorted_a, sorted_b, count * sizeof(uint32_t)) == 0;
+}
+
+/* Keep an answer in the entry of the name, or in the least recently used one: true if the addresses changed */
+static bool store(const char *host, const uint32_t *addresses, int count, uint32_t ttl_s, uint32_t query_ms) {
+    uint32_t now_s = clock_now_s();
+    int index = find(host);
+    bool changed = (index < 0);
+    if (index < 0) {
+        index = 0;
+        for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+            const dns_cache_entry_t *entry = &s_cache.table.entries[i];
+            if (entry->name[0] == '\0') {
+                index = i;
+                break;
+            }
+            if (entry->used_s < s_cache.table.entries[index].used_s) {
+                index = i;
+            }
+        }
+        memset(&s_cache.table.entries[index], 0, sizeof(dns_cache_entry_t));
+        strcpy(s_cache.table.entries[index].name, host);
+        s_cache.table.entries[index].used_s = now_s;
+        s_cache.pending[index] = false;
+    }
+    dns_cache_entry_t *entry = &s_cache.table.entries[index];
+    changed = changed || entry->count != count || !same_addresses(entry->addresses, addresses, count);
+    memcpy(entry->addresses, addresses, count * sizeof(uint32_t));
+    entry->count = (uint8_t)count;
+    entry->ttl_s = (ttl_s < DNS_CACHE_MIN_TTL_S) ? DNS_CACHE_MIN_TTL_S : (ttl_s > DNS_CACHE_MAX_TTL_S) ? DNS_CACHE_MAX_TTL_S : ttl_s;
+    entry->expires_s = now_s + entry->ttl_s;
+    entry->query_ms = (query_ms < UINT16_MAX) ? (uint16_t)query_ms : UINT16_MAX;
+    return changed;
+}
+
+/* Write the entries to NVS, without their times: they mean nothing after a reboot */
+static void persist(void) {
+    dns_cache_table_t table;
+    platform_mutex_lock(s_cache.lock);
+    table = s_cache.table;
+    platform_mutex_unlock(s_cache.lock);
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        table.entries[i].expires_s = 0;
+        table.entries[i].used_s = 0;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(DNS_CACHE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(handle, DNS_CACHE_KEY, &table, sizeof(table));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to persist the cache (0x%x)", err);
+        return;
+    }
+    platform_mutex_lock(s_cache.lock);
+    s_cache.stats.persisted++;
+    platform_mutex_unlock(s_cache.lock);
+}
+
+/* Query the server and keep the answer */
+static int ask_server(const char *host, uint32_t *addresses, size_t max, bool revalidation) {
+    uint32_t answer[DNS_CACHE_MAX_ADDRESSES];
+    uint32_t ttl_s = 0;
+    int64_t start_us = platform_now_us();
+    int count = query(host, answer, DNS_CACHE_MAX_ADDRESSES, &ttl_s);
+    int64_t query_us = platform_now_us() - start_us;
+
+    bool changed = false;
+    platform_mutex_lock(s_cache.lock);
+    if (revalidation) {
+        s_cache.stats.revalidations++;
+    }
+    if (count > 0) {
+        s_cache.stats.queries++;
+        changed = store(host, answer, count, ttl_s, (uint32_t)(query_us / 1000));
+    }
+    else {
+        s_cache.stats.query_failures++;
+    }
+    platform_mutex_unlock(s_cache.lock);
+
+    if (count <= 0) {
+        ESP_LOGD(TAG, "No answer for %s", host);
+        return -1;
+    }
+    metrics_record(METRICS_H_DNS_QUERY, (uint32_t)query_us);
+    if (changed) {
+        ESP_LOGD(TAG, "%s: %d addresses, TTL %us", host, count, (unsigned)ttl_s);
+        persist();
+    }
+    if (addresses == NULL) {
+        return count;
+    }
+    count = (count < (int)max) ? count : (int)max;
+    memcpy(addresses, answer, count * sizeof(uint32_t));
+    return count;
+}
+
+static void revalidate_task(void *arg) {
+    for (;;) {
+        char host[DNS_CACHE_MAX_NAME];
+        platform_mutex_lock(s_cache.lock);
+        int index = -1;
+        for (int i = 0; i < DNS_CACHE_ENTRIES && index < 0; i++) {
+            index = s_cache.pending[i] ? i : -1;
+        }
+        if (index >= 0) {
+            s_cache.pending[index] = false;
+            strcpy(host, s_cache.table.entries[index].name);
+        }
+        else if (s_cache.fill[0] != '\0') {
+            strcpy(host, s_cache.fill);
+            s_cache.fill[0] = '\0';
+        }
+        else {
+            s_cache.revalidating = false;
+            platform_mutex_unlock(s_cache.lock);
+            break;
+        }
+        platform_mutex_unlock(s_cache.lock);
+
+        // A failure keeps the stale answer, revalidated again at the next lookup
+        ask_server(host, NULL, 0, true);
+    }
+    platform_task_exit();
+}
+
+/* Start the revalidation task, claimed with s_cache.revalidating */
+static void start_revalidation(void) {
+    if (platform_task_create(revalidate_task, "dns_revalidate", DNS_CACHE_TASK_STACK_SIZE, NULL,
+                             REVALIDATE_TASK_PRIORITY, NULL) != 0) {
+        // Tried again at the next stale lookup
+        platform_mutex_lock(s_cache.lock);
+        s_cache.revalidating = false;
+        platform_mutex_unlock(s_cache.lock);
+    }
+}
+
+int dns_cache_init(void) {
+    if (s_cache.lock != NULL) {
+        return 0;
+    }
+    memset(&s_cache, 0, sizeof(s_cache));
+    s_cache.clock_us = platform_now_us();
+    s_cache.lock = platform_mutex_create();
+    return (s_cache.lock != NULL) ? 0 : -1;
+}
+
+void dns_cache_free(void) {
+    if (s_cache.lock == NULL) {
+        return;
+    }
+    platform_mutex_lock(s_cache.lock);
+    memset(s_cache.pending, 0, sizeof(s_cache.pending));
+    s_cache.fill[0] = '\0';
+    bool revalidating = s_cache.revalidating;
+    platform_mutex_unlock(s_cache.lock);
+    // The task ends after its query
+    while (revalidating) {
+        platform_delay_ms(10);
+        platform_mutex_lock(s_cache.lock);
+        revalidating = s_cache.revalidating;
+        platform_mutex_unlock(s_cache.lock);
+    }
+    platform_mutex_delete(s_cache.lock);
+    memset(&s_cache, 0, sizeof(s_cache));
+}
+
+int dns_cache_load(void) {
+    if (s_cache.lock == NULL) {
+        return -1;
+    }
+    platform_mutex_lock(s_cache.lock);
+    bool empty = true;
+    for (int i = 0; i < DNS_CACHE_ENTRIES && empty; i++) {
+        empty = (s_cache.table.entries[i].name[0] == '\0');
+    }
+    platform_mutex_unlock(s_cache.lock);
+    if (!empty) {
+        return 0;
+    }
+
+    dns_cache_table_t table;
+    size_t length = sizeof(table);
+    nvs_handle_t handle;
+    if (nvs_open(DNS_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return -1;
+    }
+    esp_err_t err = nvs_get_blob(handle, DNS_CACHE_KEY, &table, &length);
+    nvs_close(handle);
+    // Another layout is dropped
+    if (err != ESP_OK || length != sizeof(table)) {
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < DNS_CACHE_ENTRIES; i++) {
+        dns_cache_entry_t *entry = &table.entries[i];
+        entry->name[DNS_CACHE_MAX_NAME - 1] = '\0';
+        entry->count = (entry->count < DNS_CACHE_MAX_ADDRESSES) ? entry->count : DNS_CACHE_MAX_ADDRESSES;
+        entry->expires_s = 0;
+        entry->used_s = 0;
+        count += (entry->name[0] != '\0');
+    }
+    platform_mutex_lock(s_cache.lock);
+    s_cache.table = table;
+    platform_mutex_unlock(s_cache.lock);
+    ESP_LOGD(TAG, "%d names loaded", count);
+    return (count > 0) ? 0 : -1;
+}
+
+void dns_cache_save(dns_cache_table_t *table) {
+    if (s_cache.lock == NULL) {
+        memset(table, 0, sizeof(dns_cache_table_t));
+        return;
+    }
+    platform_mutex_lock(s_cache.lock);
+    *table = s_cache.table;
+    platform_mutex_unlock(s_cache.lock);
+}
+
+void dns_cache_restore(const dns_cache_table_t *table, uint32_t clock_s) {
+    if (s_cache.lock == NULL) {
+        return;
+    }
+    bool empty = true;
+    for (int i = 0; i < DNS_CACHE_ENTRIES && empty; i++) {
+        empty = (table->entries[i].name[0] == '\0');
+    }
+    platform_mutex_lock(s_cache.lock);
+    s_cache.clock_s = clock_s;
+    s_cache.clock_us = platform_now_us();
+    if (!empty) {
+        s_cache.table = *table;
+        memset(s_cache.pending, 0, sizeof(s_cache.pending));
+    }
+    platform_mutex_unlock(s_cache.lock);
+}
+
+static bool cacheable(const char *host, size_t max) {
+    struct in_addr numeric;
+    return s_cache.lock != NULL && max > 0 && strlen(host) < DNS_CACHE_MAX_NAME && inet_pton(AF_INET, host, &numeric) != 1;
+}
+
+/* Answer from the cache within the TTL or the stale period, revalidated in the background once expired.
+ * Returns 0 when the answer must wait for the server. */
+static int answer_cached(const char *host, uint32_t *addresses, size_t max) {
+    platform_mutex_lock(s_cache.lock);
+    uint32_t now_s = clock_now_s();
+    int index = find(host);
+    answer_age_t age = (index >= 0) ? answer_age(&s_cache.table.entries[index], now_s) : ANSWER_EXPIRED;
+    if (age == ANSWER_EXPIRED) {
+        platform_mutex_unlock(s_cache.lock);
+        return 0;
+    }
+    dns_cache_entry_t *entry = &s_cache.table.entries[index];
+    int count = copy_addresses(entry, addresses, max);
+    entry->used_s = now_s;
+    s_cache.stats.saved_us += entry->query_ms * 1000ULL;
+    bool start = false;
+    if (age == ANSWER_FRESH) {
+        s_cache.stats.fresh++;
+    }
+    else {
+        s_cache.stats.stale++;
+        s_cache.pending[index] = true;
+        start = !s_cache.revalidating;
+        s_cache.revalidating = true;
+    }
+    platform_mutex_unlock(s_cache.lock);
+
+    metrics_count(age == ANSWER_FRESH ? METRICS_C_DNS_FRESH : METRICS_C_DNS_STALE);
+    if (start) {
+        start_revalidation();
+    }
+    return count;
+}
+
+int dns_cache_resolve(const char *host, uint32_t *addresses, size_t max) {
+    if (!cacheable(host, max)) {
+        return -1;
+    }
+    int count = answer_cached(host, addresses, max);
+    if (count > 0) {
+        return count;
+    }
+    platform_mutex_lock(s_cache.lock);
+    s_cache.stats.misses++;
+    platform_mutex_unlock(s_cache.lock);
+    metrics_count(METRICS_C_DNS_MISS);
+
+    count = ask_server(host, addresses, max, false);
+    if (count < 0) {
+        // Past its stale period, an answer is still better than none
+        platform_mutex_lock(s_cache.lock);
+        int index = find(host);
+        if (index >= 0) {
+            count = copy_addresses(&s_cache.table.entries[index], addresses, max);
+        }
+        platform_mutex_unlock(s_cache.lock);
+    }
+    return count;
+}
+
+int dns_cache_lookup(const char *host, uint32_t *addresses, size_t max) {
+    if (!cacheable(host, max)) {
+        return -1;
+    }
+    int count = answer_cached(host, addresses, max);
+    if (count > 0) {
+        return count;
+    }
+    // Left to the platform resolver, and queried in the background for the next lookups
+    platform_mutex_lock(s_cache.lock);
+    s_cache.stats.deferred++;
+    int index = find(host);
+    bool queued = true;
+    if (index >= 0) {
+        s_cache.pending[index] = true;
+    }
+    else if (s_cache.fill[0] == '\0' || strcmp(s_cache.fill, host) == 0) {
+        strcpy(s_cache.fill, host);
+    }
+    else {
+        // Another name waits: this one is queried at its next lookup
+        queued = false;
+    }
+    bool start = queued && !s_cache.revalidating;
+    s_cache.revalidating = s_cache.revalidating || queued;
+    platform_mutex_unlock(s_cache.lock);
+    if (start) {
+        start_revalidation();
+    }
+    return -1;
+}
+
+void dns_cache_get_stats(dns_cache_stats_t *stats) {
+    if (s_cache.lock == NULL) {
+        memset(stats, 0, sizeof(dns_cache_stats_t));
+        return;
+    }
+    platform_mutex_lock(s_cache.lock);
+    *stats = s_cache.stats;
+    platform_mutex_unlock(s_cache.lock);
+}
+
+#else
+
+/* CONFIG_QUARKLINK_DNS_CACHE is off: every name is left to the platform resolver */
+
+int dns_cache_init(void) {
+    return -1;
+}
+
+void dns_cache_free(void) {
+}
+
+int dns_cache_load(void) {
+    return -1;
+}
+
+void dns_cache_save(dns_cache_table_t *table) {
+    memset(table, 0, sizeof(dns_cache_table_t));
+}
+
+void dns_cache_restore(const dns_cache_table_t *table, uint32_t clock_s) {
+}
+
+int dns_cache_resolve(const char *host, uint32_t *addresses, size_t max) {
+    return -1;
+}
+
+int dns_cache_lookup(const char *host, uint32_t *addresses, size_t max) {
+    return -1;
+}
+
+void dns_cache_get_stats(dns_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(dns_cache_stats_t));
+}
+
+#endif /* DNS_CACHE */
@@ -0,0 +1,173 @@
+/**
+ * \file dns_cache.h
+ * \brief Cache of the IPv4 addresses of the QuarkLink and IoT Hub endpoints, kept across reboots and deep sleep.
+ *
+ * The cache queries the DNS server of the network itself (A records over UDP) to learn the TTL of the answers,
+ * the smallest TTL of a CNAME chain. An answer is fresh for its TTL, clamped to [DNS_CACHE_MIN_TTL_S,
+ * DNS_CACHE_MAX_TTL_S]. Once expired it is still returned right away, for DNS_CACHE_MAX_STALE_S more, while a
+ * background task queries the server again (stale-while-revalidate, as the serve-stale of RFC 8767): the
+ * connection starts without waiting for the resolver. An answer also outlives its stale period when the server
+ * does not answer. Names missing from the cache wait for the server.
+ *
+ * The entries are persisted in NVS whenever their set of addresses changes (not their order, which round-robin
+ * resolvers rotate), so they survive a power cycle. Their age is then unknown: they are served stale and
+ * revalidated at their first lookup. In duty-cycle mode the entries are also kept in RTC memory with their expiry,
+ * see \ref dns_cache_save and \ref dns_cache_restore.
+ *
+ * On the device lwIP resolves through the cache (the netconn external resolve hook, see platform_esp32.c), so the
+ * QuarkLink client library and esp_mqtt use it as well. The hook runs inside lwIP's getaddrinfo() in any task,
+ * so it never queries the server nor writes NVS itself: it only takes answers already cached (\ref dns_cache_lookup)
+ * and leaves the other names to lwIP while the cache queries them in the background. Numeric addresses and names the server cannot resolve are left to the
+ * platform resolver.
+ */
+#ifndef _DNS_CACHE_H_
+#define _DNS_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Whether the cache is built: CONFIG_QUARKLINK_DNS_CACHE on the device, always in the host benches. Without it
+ * every function is a stub and every name is left to the platform resolver */
+#ifndef DNS_CACHE
+#if defined(CONFIG_QUARKLINK_DNS_CACHE) || !defined(ESP_PLATFORM)
+#define DNS_CACHE                   (1)
+#else
+#define DNS_CACHE                   (0)
+#endif
+#endif
+
+/** Names kept: the QuarkLink endpoint, the IoT Hub endpoint and the fallback broker endpoints */
+#define DNS_CACHE_ENTRIES           (5)
+/** Longer names are not cached */
+#define DNS_CACHE_MAX_NAME          (80)
+#define DNS_CACHE_MAX_ADDRESSES     (4)
+#define DNS_CACHE_MIN_TTL_S         (30)
+#define DNS_CACHE_MAX_TTL_S         (86400)
+/** Time an expired answer is still served while it is revalidated, one day as suggested by RFC 8767 */
+#define DNS_CACHE_MAX_STALE_S       (86400)
+/** Time given to the server to answer a query, sent twice */
+#ifndef DNS_CACHE_QUERY_TIMEOUT_MS
+#define DNS_CACHE_QUERY_TIMEOUT_MS  (1500)
+#endif
+/** Stack of the revalidation task */
+#define DNS_CACHE_TASK_STACK_SIZE   (4096)
+
+/**
+ * \brief A cached answer
+ */
+typedef struct {
+    /** The name, empty for a free entry */
+    char name[DNS_CACHE_MAX_NAME];
+    /** The addresses, in network byte order */
+    uint32_t addresses[DNS_CACHE_MAX_ADDRESSES];
+    uint8_t count;
+    /** Time the last query took, in ms: what a lookup answered from the cache saves */
+    uint16_t query_ms;
+    /** TTL of the answer, clamped */
+    uint32_t ttl_s;
+    /** End of the TTL on the cache clock, 0 if unknown */
+    uint32_t expires_s;
+    /** Last lookup on the cache clock, the least recently used entry is replaced first */
+    uint32_t used_s;
+} dns_cache_entry_t;
+
+/**
+ * \brief The entries, as persisted in NVS and kept in RTC memory
+ */
+typedef struct {
+    dns_cache_entry_t entries[DNS_CACHE_ENTRIES];
+} dns_cache_table_t;
+
+/**
+ * \brief Cache statistics, since \ref dns_cache_init
+ */
+typedef struct {
+    /** Lookups answered within the TTL */
+    uint32_t fresh;
+    /** Lookups answered past the TTL, or at an unknown age */
+    uint32_t stale;
+    /** Lookups that waited for the server */
+    uint32_t misses;
+    /** Lookups of \ref dns_cache_lookup left to the platform resolver */
+    uint32_t deferred;
+    /** Queries answered by the server */
+    uint32_t queries;
+    /** Queries without a usable answer */
+    uint32_t query_failures;
+    /** Queries made by the revalidation task */
+    uint32_t revalidations;
+    /** Tables written to NVS */
+    uint32_t persisted;
+    /** Server time the lookups answered from the cache saved, in microseconds */
+    uint64_t saved_us;
+} dns_cache_stats_t;
+
+/**
+ * \brief Start the cache, empty, with its clock at 0. Lookups before are left to the platform resolver.
+ * \return 0 for success, -1 for failure
+ */
+int dns_cache_init(void);
+
+/**
+ * \brief Stop the cache: wait for the revalidation task and forget the entries. NVS is left as is.
+ */
+void dns_cache_free(void);
+
+/**
+ * \brief Load the entries persisted in NVS, at an unknown age, unless the cache already has entries.
+ * \return 0 for success, -1 if there are none
+ */
+int dns_cache_load(void);
+
+/**
+ * \brief Copy the entries, e.g. to RTC memory before deep sleep.
+ */
+void dns_cache_save(dns_cache_table_t *table);
+
+/**
+ * \brief Set the cache clock and take the entries of \p table, if it has any.
+ * \param[in] table   the entries saved by \ref dns_cache_save
+ * \param[in] clock_s the time now on the clock of the saved entries, in s
+ */
+void dns_cache_restore(const dns_cache_table_t *table, uint32_t clock_s);
+
+/**
+ * \brief Resolve a host name: from the cache, revalidated in the background once expired, or from the server.
+ * \param[in]  host      the host name
+ * \param[out] addresses the addresses, in network byte order
+ * \param[in]  max       the size of \p addresses
+ * \return the number of addresses, -1 if the cache is not running, for a numeric address
+ *         or when the server gave no answer
+ */
+int dns_cache_resolve(const char *host, uint32_t *addresses, size_t max);
+
+/**
+ * \brief Resolve a host name from the cache only, never waiting for the server nor writing NVS, e.g. from the lwIP
+ * resolve hook. An expired answer is revalidated in the background and a missing name is queried in the background,
+ * both for the next lookups.
+ * \param[in]  host      the host name
+ * \param[out] addresses the addresses, in network byte order
+ * \param[in]  max       the size of \p addresses
+ * \return the number of addresses, -1 if the cache is not running, for a numeric address
+ *         or when the cache has no answer yet
+ */
+int dns_cache_lookup(const char *host, uint32_t *addresses, size_t max);
+
+/**
+ * \brief Get the statistics.
+ */
+void dns_cache_get_stats(dns_cache_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _DNS_CACHE_H_
@@ -0,0 +1,249 @@
+/**
+ * \file enrol_store.c
+ * \brief Per-field, diff-based persistence of the enrolment context.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "mbedtls/sha256.h"
+
+#include "enrol_store.h"
+
+static const char *TAG = "enrol_store";
+
+#define INDEX_KEY       "index"
+#define INDEX_MAGIC     (0x514C4932) // "QLI2"
+
+/** Layout of the index blob */
+typedef struct {
+    uint32_t magic;
+    enrol_store_entry_t entries[ENROL_STORE_FIELD_COUNT];
+} stored_index_t;
+
+/* Key prefixes of the fields, the version parity is appended */
+static const char *const s_keys[ENROL_STORE_FIELD_COUNT] = {
+    [ENROL_STORE_DEVICE_CERT]       = "dev_cert",
+    [ENROL_STORE_IOT_HUB_ROOT_CERT] = "hub_root",
+    [ENROL_STORE_IOT_HUB_ENDPOINT]  = "hub_host",
+    [ENROL_STORE_IOT_HUB_PORT]      = "hub_port",
+    [ENROL_STORE_SCOPE_ID]          = "scope_id",
+    [ENROL_STORE_FW_UPDATE_TOPIC]   = "fw_topic",
+};
+
+static void field_key(enrol_store_field_t field, uint32_t version, char key[NVS_KEY_NAME_MAX_SIZE]) {
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s%u", s_keys[field], (unsigned)(version & 1));
+}
+
+/* Value of a field in the context. Strings are stored without their NULL terminator. */
+static const void *field_value(const quarklink_context_t *quarklink, enrol_store_field_t field, size_t *length) {
+    const char *string = NULL;
+    switch (field) {
+    case ENROL_STORE_DEVICE_CERT:
+        string = quarklink->deviceCert;
+        break;
+    case ENROL_STORE_IOT_HUB_ROOT_CERT:
+        string = quarklink->iotHubRootCert;
+        break;
+    case ENROL_STORE_IOT_HUB_ENDPOINT:
+        string = quarklink->iotHubEndpoint;
+        break;
+    case ENROL_STORE_IOT_HUB_PORT:
+        *length = sizeof(quarklink->iotHubPort);
+        return &quarklink->iotHubPort;
+    case ENROL_STORE_SCOPE_ID:
+        string = quarklink->scopeID;
+        break;
+    case ENROL_STORE_FW_UPDATE_TOPIC:
+    default:
+        string = quarklink->fwUpdateTopic;
+        break;
+    }
+    string = string != NULL ? string : "";
+    *length = strlen(string);
+    return string;
+}
+
+/* Where a field is loaded: `size` is the room for the value, a string also has room for its terminator */
+static void *field_buffer(enrol_store_t *store, quarklink_context_t *quarklink, enrol_store_field_t field,
+                          size_t *size, bool *is_string) {
+    *is_string = true;
+    switch (field) {
+    case ENROL_STORE_DEVICE_CERT:
+        *size = sizeof(quarklink->deviceCert) - 1;
+        return quarklink->deviceCert;
+    case ENROL_STORE_IOT_HUB_ROOT_CERT:
+        *size = sizeof(quarklink->iotHubRootCert) - 1;
+        return quarklink->iotHubRootCert;
+    case ENROL_STORE_IOT_HUB_ENDPOINT:
+        *size = sizeof(quarklink->iotHubEndpoint) - 1;
+        return quarklink->iotHubEndpoint;
+    case ENROL_STORE_IOT_HUB_PORT:
+        *is_string = false;
+        *size = sizeof(quarklink->iotHubPort);
+        return &quarklink->iotHubPort;
+    case ENROL_STORE_SCOPE_ID:
+        *size = sizeof(store->scope_id) - 1;
+        return store->scope_id;
+    case ENROL_STORE_FW_UPDATE_TOPIC:
+    default:
+        *size = sizeof(store->fw_update_topic) - 1;
+        return store->fw_update_topic;
+    }
+}
+
+static void clear_fields(enrol_store_t *store, quarklink_context_t *quarklink) {
+    quarklink->deviceCert[0] = '\0';
+    quarklink->iotHubRootCert[0] = '\0';
+    quarklink->iotHubEndpoint[0] = '\0';
+    quarklink->iotHubPort = 0;
+    store->scope_id[0] = '\0';
+    store->fw_update_topic[0] = '\0';
+    ql_context_set_string(quarklink, QL_CONTEXT_SCOPE_ID, NULL);
+    ql_context_set_string(quarklink, QL_CONTEXT_FW_UPDATE_TOPIC, NULL);
+}
+
+/* Read the index, 1 if there is none */
+static int read_index(nvs_handle_t handle, stored_index_t *index) {
+    size_t length = sizeof(stored_index_t);
+    esp_err_t err = nvs_get_blob(handle, INDEX_KEY, index, &length);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return 1;
+    }
+    if (err != ESP_OK || length != sizeof(stored_index_t) || index->magic != INDEX_MAGIC) {
+        ESP_LOGE(TAG, "Invalid enrolment index (0x%x)", err);
+        return -1;
+    }
+    return 0;
+}
+
+static int load_field(nvs_handle_t handle, enrol_store_t *store, quarklink_context_t *quarklink,
+                      enrol_store_field_t field, const enrol_store_entry_t *entry) {
+    size_t size;
+    bool is_string;
+    uint8_t *buffer = field_buffer(store, quarklink, field, &size, &is_string);
+    size_t length = 0;
+    if (entry->version != 0) {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        field_key(field, entry->version, key);
+        length = size;
+        esp_err_t err = nvs_get_blob(handle, key, buffer, &length);
+        if (err != ESP_OK || length != entry->length) {
+            ESP_LOGE(TAG, "Failed to load %s (0x%x)", key, err);
+            return -1;
+        }
+        store->stats.bytes_read += length;
+    }
+    if (is_string) {
+        buffer[length] = '\0';
+    }
+    else if (length == 0) {
+        memset(buffer, 0, size);
+    }
+    return 0;
+}
+
+int enrol_store_load(enrol_store_t *store, quarklink_context_t *quarklink) {
+    if (store == NULL || quarklink == NULL) {
+        return -1;
+    }
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ENROL_STORE_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        clear_fields(store, quarklink);
+        return 1;
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open the enrolment store (0x%x)", err);
+        clear_fields(store, quarklink);
+        return -1;
+    }
+    stored_index_t index;
+    int ret = read_index(handle, &index);
+    if (ret == 0) {
+        store->stats.bytes_read += sizeof(index);
+        for (int field = 0; field < ENROL_STORE_FIELD_COUNT && ret == 0; field++) {
+            ret = load_field(handle, store, quarklink, field, &index.entries[field]);
+        }
+    }
+    nvs_close(handle);
+
+    // The QuarkLink client frees or reallocates these: the context gets copies of its own
+    if (ret == 0 && (ql_context_set_string(quarklink, QL_CONTEXT_SCOPE_ID, store->scope_id) != 0 ||
+                     ql_context_set_string(quarklink, QL_CONTEXT_FW_UPDATE_TOPIC, store->fw_update_topic) != 0)) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        memcpy(store->index, index.entries, sizeof(store->index));
+        store->index_valid = true;
+    }
+    else {
+        clear_fields(store, quarklink);
+    }
+    return ret;
+}
+
+int enrol_store_persist(enrol_store_t *store, const quarklink_context_t *quarklink) {
+    if (store == NULL || quarklink == NULL) {
+        return -1;
+    }
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ENROL_STORE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open the enrolment store (0x%x)", err);
+        return -1;
+    }
+
+    // The versions continue from the stored index, so that the fields it refers to are not overwritten
+    stored_index_t index = { .magic = INDEX_MAGIC };
+    if (store->index_valid) {
+        memcpy(index.entries, store->index, sizeof(index.entries));
+    }
+    else if (read_index(handle, &index) != 0) {
+        memset(&index, 0, sizeof(index));
+        index.magic = INDEX_MAGIC;
+    }
+
+    int changed = 0;
+    for (int field = 0; field < ENROL_STORE_FIELD_COUNT && err == ESP_OK; field++) {
+        size_t length;
+        const void *value = field_value(quarklink, field, &length);
+        uint8_t hash[ENROL_STORE_HASH_LENGTH];
+        mbedtls_sha256(value, length, hash, 0);
+
+        enrol_store_entry_t *entry = &index.entries[field];
+        if (entry->version != 0 && entry->length == length && memcmp(entry->hash, hash, sizeof(hash)) == 0) {
+            store->stats.fields_unchanged++;
+            continue;
+        }
+        entry->version++;
+        entry->length = (uint16_t)length;
+        memcpy(entry->hash, hash, sizeof(hash));
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        field_key(field, entry->version, key);
+        err = nvs_set_blob(handle, key, value, length);
+        if (err == ESP_OK) {
+            store->stats.fields_written++;
+            store->stats.bytes_written += length;
+            changed++;
+        }
+    }
+    // The index switches to the new fields at once
+    if (err == ESP_OK && changed > 0) {
+        err = nvs_set_blob(handle, INDEX_KEY, &index, sizeof(index));
+        if (err == ESP_OK) {
+            store->stats.bytes_written += sizeof(index);
+            err = nvs_commit(handle);
+        }
+    }
+    nvs_close(handle);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store the enrolment (0x%x)", err);
+        return -1;
+    }
+    memcpy(store->index, index.entries, sizeof(store->index));
+    store->index_valid = true;
+    ESP_LOGD(TAG, "Enrolment stored: %d fields written, %d unchanged", changed, ENROL_STORE_FIELD_COUNT - changed);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * \file enrol_store.h
+ * \brief Per-field, diff-based persistence of the enrolment context in NVS.
+ *
+ * Every enrolment field (device certificate, IoT Hub root certificate, endpoint and port, scope ID and
+ * firmware update topic) is a blob of its own, and an index blob holds the version, length and SHA-256
+ * of each of them. Persisting hashes the fields and only writes the ones that changed, then the index;
+ * an enrolment that returns the same certificates writes nothing. Loading reads the index and each field
+ * at its actual length, and trusts the index instead of hashing the certificates again.
+ *
+ * A field alternates between two keys from one version to the next, and the index is written last: an
+ * interrupted persist leaves the previous enrolment loadable.
+ *
+ * The fields are stored in the "nvs" partition, which the QuarkLink client initialises (encrypted with
+ * CONFIG_NVS_ENCRYPTION): \ref enrol_store_load is called after quarklink_loadStoredContext().
+ */
+#ifndef _ENROL_STORE_H_
+#define _ENROL_STORE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quarklink.h"
+#include "ql_context.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** NVS namespace of the enrolment fields */
+#define ENROL_STORE_NAMESPACE       "ql_enrol"
+#define ENROL_STORE_HASH_LENGTH     (32)
+/** Room for the scope ID and the firmware update topic, loaded in the store before being copied to the context */
+#define ENROL_STORE_MAX_SCOPE_ID_LENGTH (QUARKLINK_MAX_URI_LENGTH)
+#define ENROL_STORE_MAX_TOPIC_LENGTH    (QUARKLINK_MAX_ENDPOINT_LENGTH)
+
+typedef enum {
+    ENROL_STORE_DEVICE_CERT = 0,
+    ENROL_STORE_IOT_HUB_ROOT_CERT,
+    ENROL_STORE_IOT_HUB_ENDPOINT,
+    ENROL_STORE_IOT_HUB_PORT,
+    ENROL_STORE_SCOPE_ID,
+    ENROL_STORE_FW_UPDATE_TOPIC,
+    ENROL_STORE_FIELD_COUNT
+} enrol_store_field_t;
+
+/**
+ * \brief Index entry of a stored field
+ */
+typedef struct {
+    /** Incremented every time the field changes, 0 if never stored */
+    uint32_t version;
+    /** Length of the stored value */
+    uint16_t length;
+    uint8_t hash[ENROL_STORE_HASH_LENGTH];
+} enrol_store_entry_t;
+
+/**
+ * \brief Store statistics
+ */
+typedef struct {
+    /** Fields written by \ref enrol_store_persist */
+    uint32_t fields_written;
+    /** Fields \ref enrol_store_persist did not write, as they had not changed */
+    uint32_t fields_unchanged;
+    /** Bytes of the fields and the index written */
+    uint32_t bytes_written;
+    /** Bytes of the fields and the index read by \ref enrol_store_load */
+    uint32_t bytes_read;
+} enrol_store_stats_t;
+
+/**
+ * \brief State of the store of one device
+ */
+typedef struct {
+    /** The stored index, valid once loaded or persisted */
+    enrol_store_entry_t index[ENROL_STORE_FIELD_COUNT];
+    bool index_valid;
+    /** The loaded scope ID and firmware update topic, the context has copies of its own */
+    char scope_id[ENROL_STORE_MAX_SCOPE_ID_LENGTH];
+    char fw_update_topic[ENROL_STORE_MAX_TOPIC_LENGTH];
+    enrol_store_stats_t stats;
+} enrol_store_t;
+
+/**
+ * \brief Load the stored enrolment fields into the context.
+ * \param[in,out] store     the store, zero-initialised before the first call
+ * \param[in,out] quarklink the context, its scopeID and fwUpdateTopic are replaced with heap copies
+ *                          (see \ref ql_context_set_string)
+ * \return 0 for success, 1 if no enrolment is stored, -1 for failure (the enrolment fields are then cleared)
+ */
+int enrol_store_load(enrol_store_t *store, quarklink_context_t *quarklink);
+
+/**
+ * \brief Store the enrolment fields of the context that changed since they were last loaded or persisted.
+ * \param[in,out] store     the store
+ * \param[in]     quarklink the enrolled context
+ * \return 0 for success, -1 for failure (the previous enrolment is kept)
+ */
+int enrol_store_persist(enrol_store_t *store, const quarklink_context_t *quarklink);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _ENROL_STORE_H_
@@ -0,0 +1,281 @@
+/**
+ * \file led_anim.c
+ * \brief Status LED animations, rendered by a dedicated task.
+ */
+#include "esp_log.h"
+
+#include "led_anim.h"
+#include "app.h"
+#include "platform.h"
+
+/* On the device the animation task is only built with a status LED colour: every call is under #if (LED_COLOUR) */
+#if (LED_COLOUR) || !defined(ESP_PLATFORM)
+
+static const char *TAG = "led_anim";
+
+typedef enum {
+    LED_ANIM_CMD_PLAY,
+    LED_ANIM_CMD_FLASH,
+} led_anim_cmd_id_t;
+
+typedef struct {
+    led_anim_cmd_id_t id;
+    /** The animation to play, or the flash colour and duration */
+    led_anim_t anim;
+} led_anim_cmd_t;
+
+/**
+ * \brief What the task shows: an animation, possibly hidden by a flash
+ */
+typedef struct {
+    led_anim_t background;
+    int64_t background_start_us;
+    bool flashing;
+    led_anim_rgb_t flash_colour;
+    int64_t flash_end_us;
+} led_anim_state_t;
+
+static platform_queue_t *s_queue = NULL;
+static led_anim_stats_t s_stats;
+
+static uint8_t mix(uint8_t from, uint8_t to, uint32_t num, uint32_t den) {
+    return (uint8_t)(from + ((int32_t)to - from) * (int64_t)num / den);
+}
+
+static led_anim_rgb_t mix_rgb(led_anim_rgb_t from, led_anim_rgb_t to, uint32_t num, uint32_t den) {
+    led_anim_rgb_t rgb = {
+        .red = mix(from.red, to.red, num, den),
+        .green = mix(from.green, to.green, num, den),
+        .blue = mix(from.blue, to.blue, num, den),
+    };
+    return rgb;
+}
+
+static bool rgb_equal(led_anim_rgb_t a, led_anim_rgb_t b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static bool anim_equal(const led_anim_t *a, const led_anim_t *b) {
+    return a->pattern == b->pattern && rgb_equal(a->colour, b->colour) && rgb_equal(a->colour_to, b->colour_to) &&
+           a->period_ms == b->period_ms;
+}
+
+led_anim_rgb_t led_anim_render(const led_anim_t *anim, uint32_t elapsed_ms) {
+    uint32_t period = anim->period_ms;
+    switch (anim->pattern) {
+    case LED_ANIM_SOLID:
+        return anim->colour;
+    case LED_ANIM_BLINK:
+        if (period == 0 || elapsed_ms % period < period / 2) {
+            return anim->colour;
+        }
+        return LED_ANIM_RGB_OFF;
+    case LED_ANIM_PULSE: {
+        if (period == 0) {
+            return anim->colour;
+        }
+        uint32_t phase = elapsed_ms % period;
+        uint32_t level = (phase < period / 2) ? 2 * phase : 2 * (period - phase);
+        return mix_rgb(LED_ANIM_RGB_OFF, anim->colour, level, period);
+    }
+    case LED_ANIM_FADE:
+        if (elapsed_ms >= period) {
+            return anim->colour_to;
+        }
+        return mix_rgb(anim->colour, anim->colour_to, elapsed_ms, period);
+    case LED_ANIM_OFF:
+    default:
+        return LED_ANIM_RGB_OFF;
+    }
+}
+
+/* The colour of the frame due at `time_us` */
+static led_anim_rgb_t render_frame(led_anim_state_t *state, int64_t time_us) {
+    if (state->flashing && time_us < state->flash_end_us) {
+        return state->flash_colour;
+    }
+    state->flashing = false;
+    return led_anim_render(&state->background, (uint32_t)((time_us - state->background_start_us) / 1000));
+}
+
+/* Whether every frame after the one due at `time_us` is the same */
+static bool is_still(const led_anim_state_t *state, int64_t time_us) {
+    if (state->flashing) {
+        return false;
+    }
+    switch (state->background.pattern) {
+    case LED_ANIM_OFF:
+    case LED_ANIM_SOLID:
+        return true;
+    case LED_ANIM_FADE:
+        return time_us - state->background_start_us >= (int64_t)state->background.period_ms * 1000;
+    default:
+        return state->background.period_ms == 0;
+    }
+}
+
+/* Apply a command, the frame due at `time_us` is the first one it affects */
+static void apply(led_anim_state_t *state, const led_anim_cmd_t *cmd, int64_t time_us) {
+    switch (cmd->id) {
+    case LED_ANIM_CMD_PLAY:
+        // the status is shown again after every status check, keep the animation phase
+        if (!anim_equal(&state->background, &cmd->anim)) {
+            state->background = cmd->anim;
+            state->background_start_us = time_us;
+        }
+        break;
+    case LED_ANIM_CMD_FLASH:
+        state->flashing = true;
+        state->flash_colour = cmd->anim.colour;
+        state->flash_end_us = time_us + (int64_t)cmd->anim.period_ms * 1000;
+        break;
+    }
+    s_stats.commands++;
+}
+
+/*
+ * The frame due at `deadline` is rendered into the back buffer as soon as the previous one is presented,
+ * so that presenting it is only a write, then the task waits for the deadline on the command queue.
+ */
+static void led_anim_task(void *pvParameter) {
+    const int64_t period_us = LED_ANIM_FRAME_PERIOD_MS * 1000;
+    led_anim_state_t state = { .background = { .pattern = LED_ANIM_OFF } };
+    led_anim_rgb_t frames[2] = { LED_ANIM_RGB_OFF, LED_ANIM_RGB_OFF };
+    int back = 1;
+    bool shown = false;
+    int64_t deadline = platform_now_us();
+    frames[back] = render_frame(&state, deadline);
+
+    while (true) {
+        led_anim_cmd_t cmd;
+        int64_t now = platform_now_us();
+        bool idle = shown && rgb_equal(frames[back], frames[1 - back]) && is_still(&state, deadline);
+        uint32_t timeout_ms = 0;
+        if (idle) {
+            timeout_ms = PLATFORM_WAIT_FOREVER;
+        }
+        else if (now < deadline) {
+            timeout_ms = (uint32_t)((deadline - now + 999) / 1000);
+        }
+        if (timeout_ms > 0 && platform_queue_receive(s_queue, &cmd, timeout_ms) == 0) {
+            if (idle) {
+                // the frame schedule restarts with the command
+                deadline = platform_now_us();
+            }
+            apply(&state, &cmd, deadline);
+            frames[back] = render_frame(&state, deadline);
+            continue;
+        }
+
+        now = platform_now_us();
+        if (now < deadline) {
+            continue;
+        }
+        int64_t lateness = now - deadline;
+        if (lateness > s_stats.max_lateness_us) {
+            s_stats.max_lateness_us = (uint32_t)lateness;
+        }
+        if (!shown || !rgb_equal(frames[back], frames[1 - back])) {
+            platform_led_write(frames[back].red, frames[back].green, frames[back].blue);
+            s_stats.writes++;
+            shown = true;
+        }
+        s_stats.frames++;
+        back = 1 - back;
+
+        deadline += period_us;
+        if (lateness > period_us) {
+            s_stats.late_frames++;
+            deadline = now + period_us;
+        }
+        frames[back] = render_frame(&state, deadline);
+    }
+}
+
+static int post(const led_anim_cmd_t *cmd) {
+    if (s_queue == NULL || platform_queue_send(s_queue, cmd) != 0) {
+        s_stats.dropped++;
+        return -1;
+    }
+    return 0;
+}
+
+int led_anim_start(void **handle) {
+    if (s_queue != NULL) {
+        return 0;
+    }
+    s_queue = platform_queue_create(LED_ANIM_QUEUE_LENGTH, sizeof(led_anim_cmd_t));
+    if (s_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create the command queue");
+        return -1;
+    }
+    if (platform_task_create(led_anim_task, "led_anim", LED_ANIM_STACK_SIZE, NULL, LED_ANIM_PRIORITY, handle) != 0) {
+        ESP_LOGE(TAG, "Failed to start the animation task");
+        return -1;
+    }
+    return 0;
+}
+
+int led_anim_play(const led_anim_t *anim) {
+    led_anim_cmd_t cmd = {
+        .id = LED_ANIM_CMD_PLAY,
+        .anim = *anim,
+    };
+    return post(&cmd);
+}
+
+int led_anim_flash(led_anim_rgb_t colour, uint32_t duration_ms) {
+    led_anim_cmd_t cmd = {
+        .id = LED_ANIM_CMD_FLASH,
+        .anim = { .colour = colour, .period_ms = duration_ms },
+    };
+    return post(&cmd);
+}
+
+int led_anim_show_status(quarklink_return_t status) {
+    led_anim_t anim = { .pattern = LED_ANIM_SOLID };
+    switch (status) {
+    case QUARKLINK_STATUS_ENROLLED:
+        anim.colour = led_anim_colour(LED_COLOUR);
+        break;
+    case QUARKLINK_STATUS_NOT_ENROLLED:
+    case QUARKLINK_STATUS_CERTIFICATE_EXPIRED:
+        anim.pattern = LED_ANIM_BLINK;
+        anim.colour = led_anim_colour(LED_COLOUR);
+        anim.period_ms = 1000;
+        break;
+    case QUARKLINK_STATUS_FWUPDATE_REQUIRED:
+        anim.pattern = LED_ANIM_PULSE;
+        anim.colour = led_anim_colour(BLUE);
+        anim.period_ms = 2000;
+        break;
+    case QUARKLINK_STATUS_REVOKED:
+        anim.pattern = LED_ANIM_BLINK;
+        anim.colour = led_anim_colour(RED);
+        anim.period_ms = 400;
+        break;
+    default:
+        return 0;
+    }
+    return led_anim_play(&anim);
+}
+
+led_anim_rgb_t led_anim_colour(int colour) {
+    led_anim_rgb_t rgb = LED_ANIM_RGB_OFF;
+    if (colour == RED) {
+        rgb.red = LED_ANIM_LEVEL;
+    }
+    else if (colour == GREEN) {
+        rgb.green = LED_ANIM_LEVEL;
+    }
+    else if (colour == BLUE) {
+        rgb.blue = LED_ANIM_LEVEL;
+    }
+    return rgb;
+}
+
+void led_anim_get_stats(led_anim_stats_t *stats) {
+    *stats = s_stats;
+}
+
+#endif /* LED_COLOUR */
@@ -0,0 +1,134 @@
+/**
+ * \file led_anim.h
+ * \brief Status LED animations, rendered by a dedicated task.
+ *
+ * The callers post commands to a small queue and never wait for the LED: the task applies them,
+ * renders the next frame ahead of its deadline into a back buffer and presents it at a fixed frame
+ * rate through \ref platform_led_write. A frame identical to the one shown is not written again, and
+ * while nothing moves (solid colour, no flash) the task sleeps on the queue instead of ticking.
+ *
+ * The device build only includes the animations when LED_COLOUR is set (see app.h); the host benches always do.
+ */
+#ifndef _LED_ANIM_H_
+#define _LED_ANIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "quarklink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Time between two frames, a multiple of the FreeRTOS tick */
+#ifndef LED_ANIM_FRAME_PERIOD_MS
+#define LED_ANIM_FRAME_PERIOD_MS    20
+#endif
+
+/** Number of commands that can be pending, further ones are dropped */
+#define LED_ANIM_QUEUE_LENGTH       8
+#define LED_ANIM_STACK_SIZE         3072
+/** Above the application task, so that frames are on time while it runs TLS handshakes */
+#define LED_ANIM_PRIORITY           6
+
+/** Level of the named colours of app.h, out of 255 */
+#define LED_ANIM_LEVEL              10
+
+typedef struct {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} led_anim_rgb_t;
+
+#define LED_ANIM_RGB_OFF ((led_anim_rgb_t){ 0, 0, 0 })
+
+typedef enum {
+    LED_ANIM_OFF,
+    LED_ANIM_SOLID,     /*!< `colour` */
+    LED_ANIM_BLINK,     /*!< `colour` for half of `period_ms`, off for the other half */
+    LED_ANIM_PULSE,     /*!< from off to `colour` and back to off in `period_ms` */
+    LED_ANIM_FADE,      /*!< from `colour` to `colour_to` in `period_ms`, then `colour_to` */
+} led_anim_pattern_t;
+
+/**
+ * \brief An animation, see \ref led_anim_render
+ */
+typedef struct {
+    led_anim_pattern_t pattern;
+    led_anim_rgb_t colour;
+    led_anim_rgb_t colour_to;
+    uint32_t period_ms;
+} led_anim_t;
+
+/**
+ * \brief Animation task statistics
+ */
+typedef struct {
+    /** Number of frames presented */
+    uint32_t frames;
+    /** Number of frames written to the LED, the others were identical to the frame shown */
+    uint32_t writes;
+    /** Number of frames presented more than one frame period late, the schedule then restarts */
+    uint32_t late_frames;
+    /** Largest delay between a frame deadline and its presentation, in us */
+    uint32_t max_lateness_us;
+    /** Number of commands applied */
+    uint32_t commands;
+    /** Number of commands dropped because the queue was full */
+    uint32_t dropped;
+} led_anim_stats_t;
+
+/**
+ * \brief Start the animation task, the LED is off until the first command.
+ * \param[out] handle the task, can be NULL
+ * \return 0 for success, -1 for failure
+ */
+int led_anim_start(void **handle);
+
+/**
+ * \brief Play an animation until the next one. Never blocks.
+ * \return 0 for success, -1 if the command was dropped
+ */
+int led_anim_play(const led_anim_t *anim);
+
+/**
+ * \brief Show a colour for a while over the current animation, which keeps running underneath. Never blocks.
+ * \return 0 for success, -1 if the command was dropped
+ */
+int led_anim_flash(led_anim_rgb_t colour, uint32_t duration_ms);
+
+/**
+ * \brief Play the animation of a QuarkLink status:
+ *   - enrolled: solid LED_COLOUR
+ *   - not enrolled, certificate expired: LED_COLOUR blinking while the device enrols
+ *   - firmware update required: blue pulse
+ *   - revoked: red blinking fast
+ * Other values are ignored. Never blocks.
+ * \return 0 for success, -1 if the command was dropped
+ */
+int led_anim_show_status(quarklink_return_t status);
+
+/**
+ * \brief The RGB value of a named colour of app.h (RED, GREEN, BLUE), off for other values.
+ */
+led_anim_rgb_t led_anim_colour(int colour);
+
+/**
+ * \brief Render an animation.
+ * \param[in] elapsed_ms time since the animation started
+ * \return the colour of the LED
+ */
+led_anim_rgb_t led_anim_render(const led_anim_t *anim, uint32_t elapsed_ms);
+
+/**
+ * \brief Get a snapshot of the animation task statistics.
+ */
+void led_anim_get_stats(led_anim_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _LED_ANIM_H_
@@ -0,0 +1,243 @@
+/**
+ * \file metrics.c
+ * \brief Lock-free, allocation-free runtime metrics.
+ */
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "metrics.h"
+#include "platform.h"
+
+typedef struct {
+    atomic_uint_least32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    atomic_uint_least32_t count;
+    atomic_uint_least32_t min;
+    atomic_uint_least32_t max;
+} metrics_histogram_data_t;
+
+typedef struct {
+    /** Short name used in the flushed report */
+    const char *name;
+    /** log2 of the lower bound of the first bucket */
+    uint8_t base;
+} metrics_histogram_info_t;
+
+static const metrics_histogram_info_t histogram_info[METRICS_H_COUNT] = {
+    [METRICS_H_PUBLISH_LATENCY]     = { "pub",  10 }, // from ~1ms
+    [METRICS_H_STATUS_RTT]          = { "st",   14 }, // from ~16ms
+    [METRICS_H_HANDSHAKE]           = { "hs",   14 }, // from ~16ms
+    [METRICS_H_DS_SIGN]             = { "ds",   10 }, // from ~1ms
+    [METRICS_H_FREE_HEAP]           = { "heap", 10 }, // from 1KB
+    [METRICS_H_LARGEST_FREE_BLOCK]  = { "blk",  8 },  // from 256B
+    [METRICS_H_DNS_QUERY]           = { "dns",  10 }, // from ~1ms
+};
+
+static const char *counter_names[METRICS_C_COUNT] = {
+    [METRICS_C_PUBLISH_OK]          = "pok",
+    [METRICS_C_PUBLISH_FAILED]      = "perr",
+    [METRICS_C_MQTT_CONNECTED]      = "con",
+    [METRICS_C_MQTT_DISCONNECTED]   = "dis",
+    [METRICS_C_MQTT_ERROR]          = "merr",
+    [METRICS_C_WIFI_DISCONNECTED]   = "wdis",
+    [METRICS_C_STATUS_ERROR]        = "serr",
+    [METRICS_C_DNS_FRESH]           = "dnsf",
+    [METRICS_C_DNS_STALE]           = "dnss",
+    [METRICS_C_DNS_MISS]            = "dnsm",
+};
+
+typedef struct {
+    /** 0 when free, -1 while being claimed/released, msg_id otherwise */
+    atomic_int msg_id;
+    int64_t start_us;
+} metrics_pending_publish_t;
+
+typedef struct {
+    atomic_uintptr_t task;
+    const char *name;
+    atomic_uint_least32_t min_free;
+} metrics_watched_task_t;
+
+static metrics_histogram_data_t histograms[METRICS_H_COUNT];
+static atomic_uint_least32_t counters[METRICS_C_COUNT];
+static metrics_pending_publish_t pending_publish[METRICS_MAX_PENDING_PUBLISH];
+static metrics_watched_task_t watched_tasks[METRICS_MAX_WATCHED_TASKS];
+
+int64_t metrics_now_us(void) {
+    return platform_now_us();
+}
+
+static unsigned histogram_bucket(uint8_t base, uint32_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    int msb = 31 - __builtin_clz(value);
+    if (msb <= base) {
+        return 0;
+    }
+    if (msb - base >= METRICS_HISTOGRAM_BUCKETS) {
+        return METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    return msb - base;
+}
+
+void metrics_record(metrics_histogram_t histogram, uint32_t value) {
+    if (histogram >= METRICS_H_COUNT) {
+        return;
+    }
+    metrics_histogram_data_t *h = &histograms[histogram];
+    atomic_fetch_add_explicit(&h->buckets[histogram_bucket(histogram_info[histogram].base, value)], 1, memory_order_relaxed);
+
+    // count == 0 means min/max are stale from before the last flush
+    uint32_t previous_count = atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    uint32_t current = atomic_load_explicit(&h->min, memory_order_relaxed);
+    while ((previous_count == 0 || value < current) &&
+           !atomic_compare_exchange_weak_explicit(&h->min, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+        previous_count = 1;
+    }
+    current = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void metrics_record_since(metrics_histogram_t histogram, int64_t start_us) {
+    int64_t elapsed = metrics_now_us() - start_us;
+    if (elapsed < 0) {
+        elapsed = 0;
+    }
+    metrics_record(histogram, elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t)elapsed);
+}
+
+void metrics_count(metrics_counter_t counter) {
+    if (counter < METRICS_C_COUNT) {
+        atomic_fetch_add_explicit(&counters[counter], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_publish_started(int msg_id) {
+    if (msg_id <= 0) {
+        // QoS 0 publishes have no msg_id and never get acknowledged
+        return;
+    }
+    for (int i = 0; i < METRICS_MAX_PENDING_PUBLISH; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&pending_publish[i].msg_id, &expected, -1)) {
+            pending_publish[i].start_us = metrics_now_us();
+            atomic_store_explicit(&pending_publish[i].msg_id, msg_id, memory_order_release);
+            return;
+        }
+    }
+    // Table full: the sample is dropped
+}
+
+void metrics_publish_acked(int msg_id) {
+    if (msg_id <= 0) {
+        return;
+    }
+    for (int i = 0; i < METRICS_MAX_PENDING_PUBLISH; i++) {
+        int expected = msg_id;
+        if (atomic_compare_exchange_strong(&pending_publish[i].msg_id, &expected, -1)) {
+            metrics_record_since(METRICS_H_PUBLISH_LATENCY, pending_publish[i].start_us);
+            atomic_store_explicit(&pending_publish[i].msg_id, 0, memory_order_release);
+            return;
+        }
+    }
+}
+
+int metrics_watch_task(void *task, const char *name) {
+    if (task == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < METRICS_MAX_WATCHED_TASKS; i++) {
+        uintptr_t expected = 0;
+        if (atomic_compare_exchange_strong(&watched_tasks[i].task, &expected, (uintptr_t)task)) {
+            watched_tasks[i].name = name;
+            atomic_store(&watched_tasks[i].min_free, UINT32_MAX);
+            return 0;
+        }
+        if (expected == (uintptr_t)task) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void metrics_sample_system(void) {
+    size_t free_heap = platform_heap_free();
+    if (free_heap != 0) {
+        metrics_record(METRICS_H_FREE_HEAP, free_heap);
+        metrics_record(METRICS_H_LARGEST_FREE_BLOCK, platform_heap_largest_block());
+    }
+
+    for (int i = 0; i < METRICS_MAX_WATCHED_TASKS; i++) {
+        void *task = (void *)atomic_load(&watched_tasks[i].task);
+        if (task == NULL) {
+            continue;
+        }
+        uint32_t free_bytes = platform_task_stack_free(task);
+        if (free_bytes < atomic_load(&watched_tasks[i].min_free)) {
+            atomic_store(&watched_tasks[i].min_free, free_bytes);
+        }
+    }
+}
+
+/* Append to the flush buffer, keeping track of the remaining space */
+#define FLUSH_APPEND(...) do { \
+        int n = snprintf(buffer + len, length - len, __VA_ARGS__); \
+        if (n < 0 || (size_t)n >= length - len) { return -1; } \
+        len += n; \
+    } while (0)
+
+int metrics_flush(char *buffer, size_t length) {
+    size_t len = 0;
+    if (buffer == NULL || length == 0) {
+        return -1;
+    }
+
+    FLUSH_APPEND("{\"up\":%lu,\"h\":{", (unsigned long)(metrics_now_us() / 1000000));
+    bool first = true;
+    for (int i = 0; i < METRICS_H_COUNT; i++) {
+        metrics_histogram_data_t *h = &histograms[i];
+        uint32_t count = atomic_exchange(&h->count, 0);
+        uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+        int last = -1;
+        for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            buckets[b] = atomic_exchange(&h->buckets[b], 0);
+            if (buckets[b] != 0) {
+                last = b;
+            }
+        }
+        uint32_t min = atomic_load(&h->min);
+        uint32_t max = atomic_exchange(&h->max, 0);
+        if (count == 0) {
+            continue;
+        }
+        // [count, min, max, base, buckets...], trailing empty buckets omitted
+        FLUSH_APPEND("%s\"%s\":[%lu,%lu,%lu,%u", first ? "" : ",", histogram_info[i].name,
+                     (unsigned long)count, (unsigned long)min, (unsigned long)max, histogram_info[i].base);
+        for (int b = 0; b <= last; b++) {
+            FLUSH_APPEND(",%lu", (unsigned long)buckets[b]);
+        }
+        FLUSH_APPEND("]");
+        first = false;
+    }
+
+    FLUSH_APPEND("},\"c\":{");
+    for (int i = 0; i < METRICS_C_COUNT; i++) {
+        FLUSH_APPEND("%s\"%s\":%lu", i == 0 ? "" : ",", counter_names[i], (unsigned long)atomic_load(&counters[i]));
+    }
+
+    FLUSH_APPEND("},\"stk\":{");
+    first = true;
+    for (int i = 0; i < METRICS_MAX_WATCHED_TASKS; i++) {
+        if (atomic_load(&watched_tasks[i].task) == 0) {
+            continue;
+        }
+        FLUSH_APPEND("%s\"%s\":%lu", first ? "" : ",", watched_tasks[i].name,
+                     (unsigned long)atomic_load(&watched_tasks[i].min_free));
+        first = false;
+    }
+    FLUSH_APPEND("}}");
+    return (int)len;
+}
@@ -0,0 +1,119 @@
+/**
+ * \file metrics.h
+ * \brief Steady-state runtime metrics: fixed-bucket histograms, counters and
+ * stack watermarks, periodically flushed to a metrics topic.
+ *
+ * Recording functions are lock-free and never allocate, so they can be called from
+ * the MQTT and Wi-Fi event handlers as well as from the application task.
+ */
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Number of buckets of every histogram. Bucket i holds values in [2^(base+i), 2^(base+i+1)) */
+#define METRICS_HISTOGRAM_BUCKETS   (16)
+/** Maximum number of tasks whose stack high-water mark is tracked */
+#define METRICS_MAX_WATCHED_TASKS   (6)
+/** Maximum number of publishes waiting for MQTT_EVENT_PUBLISHED at the same time */
+#define METRICS_MAX_PENDING_PUBLISH (8)
+
+/**
+ * \brief Histograms. Latencies are recorded in microseconds, memory in bytes.
+ */
+typedef enum {
+    METRICS_H_PUBLISH_LATENCY = 0,  /*!< esp_mqtt_client_publish to MQTT_EVENT_PUBLISHED */
+    METRICS_H_STATUS_RTT,           /*!< quarklink_status round trip */
+    METRICS_H_HANDSHAKE,            /*!< MQTT_EVENT_BEFORE_CONNECT to MQTT_EVENT_CONNECTED */
+    METRICS_H_DS_SIGN,              /*!< Digital Signature peripheral signing time */
+    METRICS_H_FREE_HEAP,            /*!< Free 8-bit heap */
+    METRICS_H_LARGEST_FREE_BLOCK,   /*!< Largest free 8-bit heap block */
+    METRICS_H_DNS_QUERY,            /*!< DNS query of the cache, see dns_cache.h */
+    METRICS_H_COUNT
+} metrics_histogram_t;
+
+/**
+ * \brief Monotonic event counters.
+ */
+typedef enum {
+    METRICS_C_PUBLISH_OK = 0,
+    METRICS_C_PUBLISH_FAILED,
+    METRICS_C_MQTT_CONNECTED,
+    METRICS_C_MQTT_DISCONNECTED,
+    METRICS_C_MQTT_ERROR,
+    METRICS_C_WIFI_DISCONNECTED,
+    METRICS_C_STATUS_ERROR,
+    METRICS_C_DNS_FRESH,
+    METRICS_C_DNS_STALE,
+    METRICS_C_DNS_MISS,
+    METRICS_C_COUNT
+} metrics_counter_t;
+
+/**
+ * \brief Get a monotonic timestamp, in microseconds, suitable for the latency histograms.
+ */
+int64_t metrics_now_us(void);
+
+/**
+ * \brief Record a value into a histogram.
+ * \param[in] histogram the histogram to update
+ * \param[in] value     the sample, in the histogram unit
+ */
+void metrics_record(metrics_histogram_t histogram, uint32_t value);
+
+/**
+ * \brief Record the time elapsed since \p start_us (from \ref metrics_now_us) into a histogram.
+ */
+void metrics_record_since(metrics_histogram_t histogram, int64_t start_us);
+
+/**
+ * \brief Increment a counter by one.
+ */
+void metrics_count(metrics_counter_t counter);
+
+/**
+ * \brief Remember when a publish with the given message id was issued.
+ * The latency is recorded when \ref metrics_publish_acked is called with the same id.
+ * \note Only QoS > 0 publishes generate MQTT_EVENT_PUBLISHED.
+ */
+void metrics_publish_started(int msg_id);
+
+/**
+ * \brief Record the publish latency for the given message id, if it is being tracked.
+ */
+void metrics_publish_acked(int msg_id);
+
+/**
+ * \brief Add a task to the list of tasks whose stack high-water mark is reported.
+ * \param[in] task the task handle (see \ref platform_task_create), NULL is ignored
+ * \param[in] name short name used in the flushed report
+ * \return 0 for success, -1 if the list is full
+ */
+int metrics_watch_task(void *task, const char *name);
+
+/**
+ * \brief Sample the heap and the stack high-water marks of the watched tasks.
+ * Called periodically from the application task.
+ */
+void metrics_sample_system(void);
+
+/**
+ * \brief Serialise the metrics collected since the previous flush in a compact JSON form
+ * and reset the histograms. Counters and watermarks are cumulative.
+ * \param[out] buffer the output buffer
+ * \param[in]  length the size of the buffer
+ * \return the length of the string written, or -1 if the buffer is too small
+ */
+int metrics_flush(char *buffer, size_t length);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _METRICS_H_
@@ -0,0 +1,365 @@
+/**
+ * \file mqtt_outbox.c
+ * \brief Reliable publishing through a bounded outbox, see mqtt_outbox.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "esp_log.h"
+
+#include "mqtt_outbox.h"
+
+static const char *TAG = "mqtt_outbox";
+
+#define ENTRY_ALIGN     (8)
+#define NO_WRAP         (SIZE_MAX)
+/** Event queue slots besides one PUBACK per message in flight, for the connection events */
+#define EVENT_SLACK     (8)
+
+typedef enum {
+    ENTRY_QUEUED = 0,
+    ENTRY_IN_FLIGHT,
+    ENTRY_ACKED,
+} entry_state_t;
+
+/* A message in the buffer: the header, the NULL-terminated topic, then the data */
+typedef struct {
+    uint32_t size;
+    int32_t msg_id;
+    uint32_t data_len;
+    uint16_t topic_len;
+    uint8_t state;
+    uint8_t reserved;
+} entry_t;
+
+_Static_assert(sizeof(entry_t) + 1 == MQTT_OUTBOX_OVERHEAD, "MQTT_OUTBOX_OVERHEAD is the header and the topic terminator");
+_Static_assert(sizeof(entry_t) % ENTRY_ALIGN == 0, "entry header must keep the next entry aligned");
+
+/* Event forwarded by the MQTT client task */
+typedef struct {
+    platform_mqtt_event_id_t id;
+    int msg_id;
+} outbox_event_t;
+
+struct mqtt_outbox {
+    uint16_t window;
+    platform_mqtt_t *mqtt;
+    bool connected;
+    platform_queue_t *events;
+    atomic_uint lost_events;
+
+    /* Ring buffer: the entries go from tail to head, wrapping to the start at wrap_at when it is set */
+    uint8_t *buffer;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t wrap_at;
+    /** Next entry to send, valid while unsent > 0 */
+    size_t next;
+    uint16_t count;
+    uint16_t unsent;
+
+    mqtt_outbox_stats_t stats;
+};
+
+static entry_t *entry_at(const mqtt_outbox_t *outbox, size_t offset) {
+    return (entry_t *)(outbox->buffer + offset);
+}
+
+static size_t entry_after(const mqtt_outbox_t *outbox, size_t offset) {
+    offset += entry_at(outbox, offset)->size;
+    return (offset == outbox->wrap_at) ? 0 : offset;
+}
+
+mqtt_outbox_t *mqtt_outbox_create(const mqtt_outbox_config_t *config) {
+    if (config->window == 0 || config->window > MQTT_OUTBOX_MAX_WINDOW || config->capacity < ENTRY_ALIGN * 4) {
+        ESP_LOGE(TAG, "Invalid configuration: window %u, %u bytes", config->window, (unsigned)config->capacity);
+        return NULL;
+    }
+    mqtt_outbox_t *outbox = calloc(1, sizeof(mqtt_outbox_t));
+    if (outbox == NULL) {
+        return NULL;
+    }
+    outbox->window = config->window;
+    outbox->capacity = config->capacity - config->capacity % ENTRY_ALIGN;
+    outbox->wrap_at = NO_WRAP;
+    outbox->buffer = malloc(outbox->capacity);
+    outbox->events = platform_queue_create(config->window + EVENT_SLACK, sizeof(outbox_event_t));
+    atomic_init(&outbox->lost_events, 0);
+    if (outbox->buffer == NULL || outbox->events == NULL) {
+        mqtt_outbox_destroy(outbox);
+        return NULL;
+    }
+    return outbox;
+}
+
+void mqtt_outbox_destroy(mqtt_outbox_t *outbox) {
+    if (outbox == NULL) {
+        return;
+    }
+    if (outbox->count > 0) {
+        ESP_LOGW(TAG, "Dropping %u messages not acknowledged", outbox->count);
+    }
+    platform_queue_delete(outbox->events);
+    free(outbox->buffer);
+    free(outbox);
+}
+
+void mqtt_outbox_attach(mqtt_outbox_t *outbox, platform_mqtt_t *mqtt) {
+    outbox->mqtt = mqtt;
+}
+
+void mqtt_outbox_handle_event(mqtt_outbox_t *outbox, const platform_mqtt_event_t *event) {
+    if (event->id != PLATFORM_MQTT_EVENT_CONNECTED && event->id != PLATFORM_MQTT_EVENT_DISCONNECTED &&
+        event->id != PLATFORM_MQTT_EVENT_PUBLISHED) {
+        return;
+    }
+    outbox_event_t outbox_event = { .id = event->id, .msg_id = event->msg_id };
+    if (platform_queue_send(outbox->events, &outbox_event) != 0) {
+        atomic_fetch_add(&outbox->lost_events, 1);
+    }
+}
+
+/* Send the queued messages while the window allows */
+static void send_queued(mqtt_outbox_t *outbox) {
+    while (outbox->connected && outbox->mqtt != NULL && outbox->unsent > 0 && outbox->stats.in_flight < outbox->window) {
+        entry_t *entry = entry_at(outbox, outbox->next);
+        if (entry->state == ENTRY_QUEUED) {
+            const char *topic = (const char *)(entry + 1);
+            int msg_id = platform_mqtt_publish(outbox->mqtt, topic, topic + entry->topic_len + 1, (int)entry->data_len, 1, 0);
+            if (msg_id <= 0) {
+                // Disconnected in the meantime: sent again after the reconnection
+                ESP_LOGD(TAG, "Failed to publish to %s", topic);
+                break;
+            }
+            entry->msg_id = msg_id;
+            entry->state = ENTRY_IN_FLIGHT;
+            outbox->unsent--;
+            outbox->stats.sent++;
+            outbox->stats.in_flight++;
+            if (outbox->stats.in_flight > outbox->stats.peak_in_flight) {
+                outbox->stats.peak_in_flight = outbox->stats.in_flight;
+            }
+        }
+        outbox->next = entry_after(outbox, outbox->next);
+    }
+}
+
+/* Release the acknowledged messages at the tail */
+static void release_acked(mqtt_outbox_t *outbox) {
+    while (outbox->count > 0 && entry_at(outbox, outbox->tail)->state == ENTRY_ACKED) {
+        entry_t *entry = entry_at(outbox, outbox->tail);
+        outbox->stats.used_bytes -= entry->size;
+        outbox->count--;
+        size_t after = outbox->tail + entry->size;
+        if (after == outbox->wrap_at) {
+            after = 0;
+            outbox->wrap_at = NO_WRAP;
+        }
+        outbox->tail = after;
+    }
+    if (outbox->count == 0) {
+        outbox->head = outbox->tail = 0;
+        outbox->wrap_at = NO_WRAP;
+    }
+}
+
+static void handle_ack(mqtt_outbox_t *outbox, int msg_id) {
+    size_t offset = outbox->tail;
+    for (uint16_t i = 0; i < outbox->count; i++) {
+        entry_t *entry = entry_at(outbox, offset);
+        if (entry->state == ENTRY_IN_FLIGHT && entry->msg_id == msg_id) {
+            entry->state = ENTRY_ACKED;
+            outbox->stats.in_flight--;
+            outbox->stats.acked++;
+            release_acked(outbox);
+            return;
+        }
+        offset = entry_after(outbox, offset);
+    }
+    // Acknowledgement of a message already sent again, or of a publish made without the outbox
+    ESP_LOGD(TAG, "PUBACK for unknown msg_id=%d", msg_id);
+}
+
+/* After a reconnection, the messages in flight are sent again first */
+static void handle_connected(mqtt_outbox_t *outbox) {
+    outbox->connected = true;
+    if (outbox->stats.in_flight == 0) {
+        return;
+    }
+    size_t offset = outbox->tail;
+    outbox->unsent = 0;
+    for (uint16_t i = 0; i < outbox->count; i++) {
+        entry_t *entry = entry_at(outbox, offset);
+        if (entry->state == ENTRY_IN_FLIGHT) {
+            entry->state = ENTRY_QUEUED;
+            outbox->stats.retransmitted++;
+        }
+        if (entry->state == ENTRY_QUEUED) {
+            outbox->unsent++;
+        }
+        offset = entry_after(outbox, offset);
+    }
+    ESP_LOGD(TAG, "Sending %u messages again", outbox->stats.in_flight);
+    outbox->stats.in_flight = 0;
+    outbox->next = outbox->tail;
+}
+
+static void process_event(mqtt_outbox_t *outbox, const outbox_event_t *event) {
+    switch (event->id) {
+    case PLATFORM_MQTT_EVENT_CONNECTED:
+        handle_connected(outbox);
+        break;
+    case PLATFORM_MQTT_EVENT_DISCONNECTED:
+        outbox->connected = false;
+        break;
+    case PLATFORM_MQTT_EVENT_PUBLISHED:
+        handle_ack(outbox, event->msg_id);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Process the events waiting in the queue, then those arriving until the deadline */
+static void process_events(mqtt_outbox_t *outbox, int64_t deadline_us) {
+    outbox_event_t event;
+    for (;;) {
+        int64_t remaining_us = deadline_us - platform_now_us();
+        uint32_t timeout_ms = (remaining_us > 0) ? (uint32_t)((remaining_us + 999) / 1000) : 0;
+        if (platform_queue_receive(outbox->events, &event, timeout_ms) != 0) {
+            break;
+        }
+        process_event(outbox, &event);
+        // Drain what is already there before sending
+        while (platform_queue_receive(outbox->events, &event, 0) == 0) {
+            process_event(outbox, &event);
+        }
+        send_queued(outbox);
+        if (platform_now_us() >= deadline_us) {
+            break;
+        }
+    }
+    send_queued(outbox);
+}
+
+static int64_t deadline_after(uint32_t timeout_ms) {
+    return (timeout_ms == PLATFORM_WAIT_FOREVER) ? INT64_MAX : platform_now_us() + (int64_t)timeout_ms * 1000;
+}
+
+/* Find room for an entry of `size` bytes, -1 if there is none */
+static int64_t reserve(mqtt_outbox_t *outbox, size_t size) {
+    if (outbox->count == 0) {
+        return (size <= outbox->capacity) ? 0 : -1;
+    }
+    if (outbox->wrap_at == NO_WRAP) {
+        // The entries go from tail to head
+        if (outbox->capacity - outbox->head >= size) {
+            return (int64_t)outbox->head;
+        }
+        if (outbox->tail >= size) {
+            outbox->wrap_at = outbox->head;
+            return 0;
+        }
+        return -1;
+    }
+    // The entries go from tail to wrap_at, then from the start to head
+    return (outbox->tail - outbox->head >= size) ? (int64_t)outbox->head : -1;
+}
+
+int mqtt_outbox_publish(mqtt_outbox_t *outbox, const char *topic, const char *data, int len, uint32_t timeout_ms) {
+    if (len == 0) {
+        len = (int)strlen(data);
+    }
+    size_t topic_len = strlen(topic);
+    size_t size = sizeof(entry_t) + topic_len + 1 + (size_t)(len > 0 ? len : 0);
+    size = (size + ENTRY_ALIGN - 1) / ENTRY_ALIGN * ENTRY_ALIGN;
+    if (len < 0 || topic_len > UINT16_MAX || size > outbox->capacity) {
+        ESP_LOGE(TAG, "Message to %s does not fit the outbox (%u bytes)", topic, (unsigned)size);
+        outbox->stats.rejected++;
+        return -1;
+    }
+
+    // Process the acknowledgements first, they may make room
+    process_events(outbox, 0);
+    int64_t offset = reserve(outbox, size);
+    if (offset < 0 && timeout_ms > 0) {
+        outbox->stats.blocked++;
+        int64_t deadline_us = deadline_after(timeout_ms);
+        outbox_event_t event;
+        while (offset < 0) {
+            int64_t remaining_us = deadline_us - platform_now_us();
+            if (remaining_us <= 0) {
+                break;
+            }
+            uint32_t wait_ms = (deadline_us == INT64_MAX) ? PLATFORM_WAIT_FOREVER : (uint32_t)((remaining_us + 999) / 1000);
+            if (platform_queue_receive(outbox->events, &event, wait_ms) != 0) {
+                break;
+            }
+            process_event(outbox, &event);
+            send_queued(outbox);
+            offset = reserve(outbox, size);
+        }
+    }
+    if (offset < 0) {
+        ESP_LOGD(TAG, "Outbox full, %u messages pending", outbox->count);
+        outbox->stats.rejected++;
+        return -1;
+    }
+
+    entry_t *entry = entry_at(outbox, (size_t)offset);
+    *entry = (entry_t) {
+        .size = (uint32_t)size,
+        .data_len = (uint32_t)len,
+        .topic_len = (uint16_t)topic_len,
+        .state = ENTRY_QUEUED,
+    };
+    char *text = (char *)(entry + 1);
+    memcpy(text, topic, topic_len + 1);
+    memcpy(text + topic_len + 1, data, len);
+    outbox->head = (size_t)offset + size;
+    if (outbox->count == 0) {
+        outbox->tail = (size_t)offset;
+    }
+    if (outbox->unsent == 0) {
+        outbox->next = (size_t)offset;
+    }
+    outbox->count++;
+    outbox->unsent++;
+    outbox->stats.queued++;
+    outbox->stats.used_bytes += size;
+    if (outbox->stats.used_bytes > outbox->stats.peak_bytes) {
+        outbox->stats.peak_bytes = outbox->stats.used_bytes;
+    }
+    send_queued(outbox);
+    return 0;
+}
+
+void mqtt_outbox_poll(mqtt_outbox_t *outbox, uint32_t timeout_ms) {
+    process_events(outbox, deadline_after(timeout_ms));
+}
+
+int mqtt_outbox_flush(mqtt_outbox_t *outbox, uint32_t timeout_ms) {
+    int64_t deadline_us = deadline_after(timeout_ms);
+    process_events(outbox, 0);
+    outbox_event_t event;
+    while (outbox->count > 0) {
+        int64_t remaining_us = deadline_us - platform_now_us();
+        if (remaining_us <= 0) {
+            return -1;
+        }
+        uint32_t wait_ms = (deadline_us == INT64_MAX) ? PLATFORM_WAIT_FOREVER : (uint32_t)((remaining_us + 999) / 1000);
+        if (platform_queue_receive(outbox->events, &event, wait_ms) != 0) {
+            return -1;
+        }
+        process_event(outbox, &event);
+        send_queued(outbox);
+    }
+    return 0;
+}
+
+void mqtt_outbox_get_stats(const mqtt_outbox_t *outbox, mqtt_outbox_stats_t *stats) {
+    *stats = outbox->stats;
+    stats->pending = outbox->count;
+    stats->lost_events = atomic_load(&outbox->lost_events);
+}
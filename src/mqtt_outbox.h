@@ -0,0 +1,125 @@
+/**
+ * \file mqtt_outbox.h
+ * \brief Reliable publishing: QoS 1 messages queued in a bounded outbox, with a window of messages in flight.
+ *
+ * \ref mqtt_outbox_publish copies the message into a ring buffer of `capacity` bytes, allocated once. Messages are
+ * sent in order while fewer than `window` are waiting for their PUBACK, and released from the buffer once
+ * acknowledged. When the buffer is full the producer waits for acknowledgements: this is the backpressure,
+ * bursts neither drop messages nor grow the heap. After a reconnection, the messages that were in flight are
+ * sent again, before the queued ones.
+ *
+ * The outbox belongs to one producer task: every function but \ref mqtt_outbox_handle_event is called from it.
+ * The MQTT event handler only forwards the CONNECTED, DISCONNECTED and PUBLISHED events to a queue, which the
+ * producer processes when it publishes, polls or flushes. Nothing blocks the MQTT client task, and the client
+ * is never called with an outbox lock held.
+ *
+ * esp_mqtt also keeps the QoS 1 messages it sent until their PUBACK and may send them again itself: the broker
+ * can get duplicates, which QoS 1 allows.
+ */
+#ifndef _MQTT_OUTBOX_H_
+#define _MQTT_OUTBOX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Most messages in flight */
+#define MQTT_OUTBOX_MAX_WINDOW  (64)
+
+typedef struct {
+    /** Most messages sent and not acknowledged yet, 1 to MQTT_OUTBOX_MAX_WINDOW */
+    uint16_t window;
+    /** Size of the buffer of the queued and in-flight messages, in bytes. Each message takes its topic, its data
+     * and MQTT_OUTBOX_OVERHEAD bytes, rounded up to 8 bytes. */
+    size_t capacity;
+} mqtt_outbox_config_t;
+
+/** Bytes of the outbox buffer taken by a message besides its topic and data */
+#define MQTT_OUTBOX_OVERHEAD    (17)
+
+/**
+ * \brief Outbox statistics
+ */
+typedef struct {
+    /** Messages accepted by \ref mqtt_outbox_publish */
+    uint32_t queued;
+    /** PUBLISH packets sent, retransmissions included */
+    uint32_t sent;
+    /** Messages acknowledged and released */
+    uint32_t acked;
+    /** Messages sent again after a reconnection */
+    uint32_t retransmitted;
+    /** Publishes that had to wait for room in the buffer */
+    uint32_t blocked;
+    /** Publishes refused: larger than the buffer, or no room before the timeout */
+    uint32_t rejected;
+    /** Events lost because the event queue was full */
+    uint32_t lost_events;
+    /** Messages in the buffer, and in flight */
+    uint16_t pending;
+    uint16_t in_flight;
+    uint16_t peak_in_flight;
+    /** Bytes of the buffer in use */
+    uint32_t used_bytes;
+    uint32_t peak_bytes;
+} mqtt_outbox_stats_t;
+
+typedef struct mqtt_outbox mqtt_outbox_t;
+
+/**
+ * \brief Create an outbox. It allocates its buffer and its event queue.
+ * \return the outbox, NULL if the configuration is invalid or for an allocation failure
+ */
+mqtt_outbox_t *mqtt_outbox_create(const mqtt_outbox_config_t *config);
+
+/**
+ * \brief Destroy an outbox, dropping the messages not acknowledged. The client must be stopped.
+ */
+void mqtt_outbox_destroy(mqtt_outbox_t *outbox);
+
+/**
+ * \brief Set the client the messages are sent with. Events may be forwarded before.
+ */
+void mqtt_outbox_attach(mqtt_outbox_t *outbox, platform_mqtt_t *mqtt);
+
+/**
+ * \brief Forward an MQTT event to the outbox. Called from the event handler of the client, never blocks.
+ */
+void mqtt_outbox_handle_event(mqtt_outbox_t *outbox, const platform_mqtt_event_t *event);
+
+/**
+ * \brief Queue a QoS 1 message, and send it if the window allows.
+ * \param[in] len        the data length, 0 to use strlen(data)
+ * \param[in] timeout_ms how long to wait for room in the buffer, 0 not to wait, or PLATFORM_WAIT_FOREVER
+ * \return 0 for success, -1 if the message is larger than the buffer or there was no room in time
+ */
+int mqtt_outbox_publish(mqtt_outbox_t *outbox, const char *topic, const char *data, int len, uint32_t timeout_ms);
+
+/**
+ * \brief Process the forwarded events for \p timeout_ms: release the acknowledged messages, send the queued ones
+ * as the window allows, resend those in flight after a reconnection.
+ */
+void mqtt_outbox_poll(mqtt_outbox_t *outbox, uint32_t timeout_ms);
+
+/**
+ * \brief Process the events until every message is acknowledged.
+ * \return 0 for success, -1 if messages are still pending after \p timeout_ms
+ */
+int mqtt_outbox_flush(mqtt_outbox_t *outbox, uint32_t timeout_ms);
+
+/**
+ * \brief Get a snapshot of the statistics.
+ */
+void mqtt_outbox_get_stats(const mqtt_outbox_t *outbox, mqtt_outbox_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _MQTT_OUTBOX_H_
@@ -0,0 +1,557 @@
+/**
+ * \file mqtt_router.c
+ * \brief Inbound MQTT message router, see mqtt_router.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "mqtt_router.h"
+
+static const char *TAG = "mqtt_router";
+
+#define NO_NODE     (UINT32_MAX)
+#define ROOT        (0)
+
+typedef struct {
+    char *filter;
+    mqtt_router_handler_t handler;
+    void *arg;
+    uint32_t flags;
+} route_t;
+
+/* Literal child of a compiled node: the label points into the filter of a route */
+typedef struct {
+    const char *label;
+    uint32_t label_len;
+    uint32_t node;
+} edge_t;
+
+/* Compiled node: its literal children are edges[first_edge..], sorted by (length, bytes), its routes are
+ * node_routes[first_route..], those ending at the node then those with a '#' at the node */
+typedef struct {
+    uint32_t first_edge;
+    uint32_t edge_count;
+    uint32_t plus;
+    uint32_t first_route;
+    uint16_t end_count;
+    uint16_t hash_count;
+} node_t;
+
+/* Node while compiling: children and routes as linked lists, in the order they were added */
+typedef struct {
+    const char *label;
+    uint32_t label_len;
+    uint32_t first_child;
+    uint32_t last_child;
+    uint32_t next_sibling;
+    uint32_t plus;
+    uint32_t end_head, end_tail;
+    uint32_t hash_head, hash_tail;
+    uint32_t child_count;
+} build_node_t;
+
+/* The message whose fragments are being received */
+typedef struct {
+    bool active;
+    char topic[MQTT_ROUTER_MAX_TOPIC_LENGTH];
+    int topic_len;
+    int total_len;
+    /** Offset of the next fragment */
+    int next_offset;
+    /** Set while the fragments are copied to the reassembly buffer */
+    bool reassembling;
+    int match_count;
+    uint32_t matches[MQTT_ROUTER_MAX_MATCHES];
+} inflight_t;
+
+struct mqtt_router {
+    route_t *routes;
+    uint32_t route_count;
+    uint32_t route_capacity;
+
+    /* Compiled trie */
+    node_t *nodes;
+    edge_t *edges;
+    uint32_t *node_routes;
+    bool compiled;
+
+    size_t max_message;
+    char *buffer;
+    inflight_t inflight;
+    mqtt_router_stats_t stats;
+};
+
+mqtt_router_t *mqtt_router_create(size_t max_message) {
+    mqtt_router_t *router = calloc(1, sizeof(mqtt_router_t));
+    if (router == NULL) {
+        return NULL;
+    }
+    router->max_message = max_message;
+    return router;
+}
+
+static void free_compiled(mqtt_router_t *router) {
+    free(router->nodes);
+    free(router->edges);
+    free(router->node_routes);
+    router->nodes = NULL;
+    router->edges = NULL;
+    router->node_routes = NULL;
+}
+
+void mqtt_router_destroy(mqtt_router_t *router) {
+    if (router == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        free(router->routes[i].filter);
+    }
+    free(router->routes);
+    free_compiled(router);
+    free(router->buffer);
+    free(router);
+}
+
+/* Check the MQTT rules: '+' and '#' are whole levels, '#' is the last one */
+static bool filter_is_valid(const char *filter) {
+    size_t len = strlen(filter);
+    if (len == 0 || len > UINT16_MAX) {
+        return false;
+    }
+    int levels = 1;
+    for (size_t i = 0; i < len; i++) {
+        bool level_start = (i == 0 || filter[i - 1] == '/');
+        bool level_end = (i + 1 == len || filter[i + 1] == '/');
+        if (filter[i] == '/') {
+            levels++;
+        }
+        else if (filter[i] == '+' && !(level_start && level_end)) {
+            return false;
+        }
+        else if (filter[i] == '#' && !(level_start && i + 1 == len)) {
+            return false;
+        }
+    }
+    return levels <= MQTT_ROUTER_MAX_LEVELS;
+}
+
+int mqtt_router_add(mqtt_router_t *router, const char *filter, mqtt_router_handler_t handler, void *arg, uint32_t flags) {
+    if (handler == NULL || !filter_is_valid(filter)) {
+        ESP_LOGE(TAG, "Invalid route %s", filter);
+        return -1;
+    }
+    if (router->route_count == router->route_capacity) {
+        uint32_t capacity = (router->route_capacity == 0) ? 8 : router->route_capacity * 2;
+        route_t *routes = realloc(router->routes, capacity * sizeof(route_t));
+        if (routes == NULL) {
+            return -1;
+        }
+        router->routes = routes;
+        router->route_capacity = capacity;
+    }
+    char *copy = strdup(filter);
+    if (copy == NULL) {
+        return -1;
+    }
+    router->routes[router->route_count++] = (route_t) {
+        .filter = copy,
+        .handler = handler,
+        .arg = arg,
+        .flags = flags,
+    };
+    router->compiled = false;
+    return 0;
+}
+
+static int compare_label(const char *a, uint32_t a_len, const char *b, uint32_t b_len) {
+    if (a_len != b_len) {
+        return (a_len < b_len) ? -1 : 1;
+    }
+    return memcmp(a, b, a_len);
+}
+
+static int compare_edges(const void *a, const void *b) {
+    const edge_t *edge_a = a;
+    const edge_t *edge_b = b;
+    return compare_label(edge_a->label, edge_a->label_len, edge_b->label, edge_b->label_len);
+}
+
+static void append_route(uint32_t *head, uint32_t *tail, uint32_t *next, uint32_t route) {
+    next[route] = NO_NODE;
+    if (*head == NO_NODE) {
+        *head = route;
+    }
+    else {
+        next[*tail] = route;
+    }
+    *tail = route;
+}
+
+int mqtt_router_compile(mqtt_router_t *router) {
+    // A filter of n levels adds at most n nodes
+    uint32_t max_nodes = 1;
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        for (const char *c = router->routes[i].filter; *c != '\0'; c++) {
+            max_nodes += (*c == '/');
+        }
+        max_nodes++;
+    }
+
+    build_node_t *build = malloc(max_nodes * sizeof(build_node_t));
+    uint32_t *route_next = malloc((router->route_count + 1) * sizeof(uint32_t));
+    node_t *nodes = NULL;
+    edge_t *edges = NULL;
+    uint32_t *node_routes = NULL;
+    if (build == NULL || route_next == NULL) {
+        goto fail;
+    }
+
+    const build_node_t empty = {
+        .first_child = NO_NODE, .last_child = NO_NODE, .next_sibling = NO_NODE, .plus = NO_NODE,
+        .end_head = NO_NODE, .end_tail = NO_NODE, .hash_head = NO_NODE, .hash_tail = NO_NODE,
+    };
+    uint32_t node_count = 1;
+    uint32_t edge_count = 0;
+    build[ROOT] = empty;
+
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        const char *level = router->routes[i].filter;
+        uint32_t node = ROOT;
+        for (;;) {
+            const char *slash = strchr(level, '/');
+            uint32_t level_len = (slash != NULL) ? (uint32_t)(slash - level) : (uint32_t)strlen(level);
+            if (level_len == 1 && level[0] == '#') {
+                append_route(&build[node].hash_head, &build[node].hash_tail, route_next, i);
+                break;
+            }
+            uint32_t child = NO_NODE;
+            if (level_len == 1 && level[0] == '+') {
+                child = build[node].plus;
+                if (child == NO_NODE) {
+                    child = build[node].plus = node_count++;
+                    build[child] = empty;
+                }
+            }
+            else {
+                // Linear search: only when compiling
+                for (child = build[node].first_child; child != NO_NODE; child = build[child].next_sibling) {
+                    if (compare_label(build[child].label, build[child].label_len, level, level_len) == 0) {
+                        break;
+                    }
+                }
+                if (child == NO_NODE) {
+                    child = node_count++;
+                    build[child] = empty;
+                    build[child].label = level;
+                    build[child].label_len = level_len;
+                    if (build[node].first_child == NO_NODE) {
+                        build[node].first_child = child;
+                    }
+                    else {
+                        build[build[node].last_child].next_sibling = child;
+                    }
+                    build[node].last_child = child;
+                    build[node].child_count++;
+                    edge_count++;
+                }
+            }
+            node = child;
+            if (slash == NULL) {
+                append_route(&build[node].end_head, &build[node].end_tail, route_next, i);
+                break;
+            }
+            level = slash + 1;
+        }
+    }
+
+    nodes = malloc(node_count * sizeof(node_t));
+    edges = malloc((edge_count + 1) * sizeof(edge_t));
+    node_routes = malloc((router->route_count + 1) * sizeof(uint32_t));
+    if (nodes == NULL || edges == NULL || node_routes == NULL) {
+        goto fail;
+    }
+
+    uint32_t edge = 0;
+    uint32_t route = 0;
+    for (uint32_t n = 0; n < node_count; n++) {
+        nodes[n] = (node_t) {
+            .first_edge = edge,
+            .edge_count = build[n].child_count,
+            .plus = build[n].plus,
+            .first_route = route,
+        };
+        for (uint32_t child = build[n].first_child; child != NO_NODE; child = build[child].next_sibling) {
+            edges[edge++] = (edge_t) { .label = build[child].label, .label_len = build[child].label_len, .node = child };
+        }
+        qsort(edges + nodes[n].first_edge, nodes[n].edge_count, sizeof(edge_t), compare_edges);
+        for (uint32_t r = build[n].end_head; r != NO_NODE; r = route_next[r]) {
+            node_routes[route++] = r;
+            nodes[n].end_count++;
+        }
+        for (uint32_t r = build[n].hash_head; r != NO_NODE; r = route_next[r]) {
+            node_routes[route++] = r;
+            nodes[n].hash_count++;
+        }
+    }
+    free(build);
+    free(route_next);
+
+    free_compiled(router);
+    router->nodes = nodes;
+    router->edges = edges;
+    router->node_routes = node_routes;
+    router->compiled = true;
+    // Route indices kept from the previous layout may be stale
+    router->inflight.active = false;
+    ESP_LOGD(TAG, "Compiled %u routes in %u nodes", (unsigned)router->route_count, (unsigned)node_count);
+    return 0;
+
+fail:
+    ESP_LOGE(TAG, "Failed to compile %u routes", (unsigned)router->route_count);
+    free(build);
+    free(route_next);
+    free(nodes);
+    free(edges);
+    free(node_routes);
+    return -1;
+}
+
+static uint32_t find_child(const mqtt_router_t *router, const node_t *node, const char *level, uint32_t level_len) {
+    const edge_t *edges = router->edges + node->first_edge;
+    uint32_t low = 0;
+    uint32_t high = node->edge_count;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        int cmp = compare_label(edges[mid].label, edges[mid].label_len, level, level_len);
+        if (cmp == 0) {
+            return edges[mid].node;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return NO_NODE;
+}
+
+static void add_matches(const mqtt_router_t *router, uint32_t first, uint32_t count, uint32_t *routes, int max, int *found) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (*found < max) {
+            routes[*found] = router->node_routes[first + i];
+        }
+        (*found)++;
+    }
+}
+
+int mqtt_router_match(const mqtt_router_t *router, const char *topic, int topic_len, uint32_t *routes, int max) {
+    if (!router->compiled || topic_len < 0) {
+        return 0;
+    }
+    // Wildcards at the first level do not match the topics starting with '$'
+    bool system_topic = (topic_len > 0 && topic[0] == '$');
+
+    // Depth-first walk: a node and the offset of the next topic level, past the end once every level is matched.
+    // Every node on the stack is one level deeper than the node popped before it pushed it, at most two per level.
+    struct {
+        uint32_t node;
+        int offset;
+    } stack[2 * MQTT_ROUTER_MAX_LEVELS + 2];
+    int depth = 0;
+    int found = 0;
+    stack[depth].node = ROOT;
+    stack[depth].offset = 0;
+    depth++;
+
+    while (depth > 0) {
+        depth--;
+        const node_t *node = &router->nodes[stack[depth].node];
+        int offset = stack[depth].offset;
+        bool first_level = (stack[depth].node == ROOT);
+
+        // '#' also matches the parent level: "a/#" matches "a"
+        if (!(first_level && system_topic)) {
+            add_matches(router, node->first_route + node->end_count, node->hash_count, routes, max, &found);
+        }
+        if (offset > topic_len) {
+            add_matches(router, node->first_route, node->end_count, routes, max, &found);
+            continue;
+        }
+
+        const char *level = topic + offset;
+        const char *slash = memchr(level, '/', topic_len - offset);
+        uint32_t level_len = (slash != NULL) ? (uint32_t)(slash - level) : (uint32_t)(topic_len - offset);
+        int next = offset + (int)level_len + 1;
+
+        if (node->plus != NO_NODE && !(first_level && system_topic)) {
+            stack[depth].node = node->plus;
+            stack[depth].offset = next;
+            depth++;
+        }
+        uint32_t child = find_child(router, node, level, level_len);
+        if (child != NO_NODE) {
+            stack[depth].node = child;
+            stack[depth].offset = next;
+            depth++;
+        }
+    }
+
+    // Call the handlers in the order the routes were added
+    int stored = (found < max) ? found : max;
+    for (int i = 1; i < stored; i++) {
+        uint32_t value = routes[i];
+        int j = i;
+        for (; j > 0 && routes[j - 1] > value; j--) {
+            routes[j] = routes[j - 1];
+        }
+        routes[j] = value;
+    }
+    return found;
+}
+
+int mqtt_router_subscribe(const mqtt_router_t *router, platform_mqtt_t *mqtt, int qos) {
+    int ret = 0;
+    for (uint32_t i = 0; i < router->route_count; i++) {
+        bool duplicate = false;
+        for (uint32_t j = 0; j < i && !duplicate; j++) {
+            duplicate = (strcmp(router->routes[i].filter, router->routes[j].filter) == 0);
+        }
+        if (duplicate) {
+            continue;
+        }
+        int msg_id = platform_mqtt_subscribe(mqtt, router->routes[i].filter, qos);
+        ESP_LOGD(TAG, "Subscribe to %s, msg_id=%d", router->routes[i].filter, msg_id);
+        if (msg_id < 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/* Call the matching handlers: the streaming ones, or the reassembling ones with the whole message */
+static void call_handlers(const mqtt_router_t *router, const inflight_t *inflight, bool reassembling,
+                          const mqtt_router_message_t *message) {
+    for (int i = 0; i < inflight->match_count; i++) {
+        const route_t *route = &router->routes[inflight->matches[i]];
+        if (((route->flags & MQTT_ROUTER_REASSEMBLE) != 0) == reassembling) {
+            route->handler(route->arg, message);
+        }
+    }
+}
+
+void mqtt_router_dispatch(mqtt_router_t *router, const platform_mqtt_event_t *event) {
+    inflight_t *inflight = &router->inflight;
+    router->stats.fragments++;
+
+    if (event->current_data_offset == 0) {
+        router->stats.messages++;
+        if (inflight->active && inflight->reassembling) {
+            // The previous message did not complete
+            router->stats.dropped++;
+        }
+        inflight->active = false;
+        inflight->reassembling = false;
+
+        int found = mqtt_router_match(router, event->topic, event->topic_len, inflight->matches, MQTT_ROUTER_MAX_MATCHES);
+        if (found > MQTT_ROUTER_MAX_MATCHES) {
+            ESP_LOGW(TAG, "%.*s matches %d routes, only %d are called", event->topic_len, event->topic, found,
+                     MQTT_ROUTER_MAX_MATCHES);
+            router->stats.overflows++;
+            found = MQTT_ROUTER_MAX_MATCHES;
+        }
+        inflight->match_count = found;
+        if (found == 0) {
+            ESP_LOGD(TAG, "No route for %.*s", event->topic_len, event->topic);
+            router->stats.unmatched++;
+            return;
+        }
+
+        mqtt_router_message_t message = {
+            .topic = event->topic,
+            .topic_len = event->topic_len,
+            .data = event->data,
+            .data_len = event->data_len,
+            .offset = 0,
+            .total_len = event->total_data_len,
+        };
+        call_handlers(router, inflight, false, &message);
+        if (event->data_len >= event->total_data_len) {
+            // Single fragment: no copy for the reassembling handlers either
+            call_handlers(router, inflight, true, &message);
+            return;
+        }
+
+        bool reassemble = false;
+        for (int i = 0; i < found; i++) {
+            reassemble |= (router->routes[inflight->matches[i]].flags & MQTT_ROUTER_REASSEMBLE) != 0;
+        }
+        if (reassemble && (size_t)event->total_data_len > router->max_message) {
+            ESP_LOGW(TAG, "%.*s: %d bytes do not fit the reassembly buffer", event->topic_len, event->topic,
+                     event->total_data_len);
+            router->stats.dropped++;
+            reassemble = false;
+        }
+        if (reassemble && router->buffer == NULL && (router->buffer = malloc(router->max_message)) == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate the reassembly buffer");
+            router->stats.dropped++;
+            reassemble = false;
+        }
+        if (reassemble) {
+            memcpy(router->buffer, event->data, event->data_len);
+        }
+
+        inflight->active = true;
+        inflight->reassembling = reassemble;
+        inflight->topic_len = (event->topic_len < MQTT_ROUTER_MAX_TOPIC_LENGTH) ? event->topic_len : MQTT_ROUTER_MAX_TOPIC_LENGTH;
+        memcpy(inflight->topic, event->topic, inflight->topic_len);
+        inflight->total_len = event->total_data_len;
+        inflight->next_offset = event->data_len;
+        return;
+    }
+
+    if (!inflight->active) {
+        // Unmatched message, or its first fragment was missed
+        return;
+    }
+    if (event->current_data_offset != inflight->next_offset || event->total_data_len != inflight->total_len ||
+        event->data_len > inflight->total_len - inflight->next_offset) {
+        ESP_LOGW(TAG, "Unexpected fragment at %d of %d bytes", event->current_data_offset, event->total_data_len);
+        if (inflight->reassembling) {
+            router->stats.dropped++;
+        }
+        inflight->active = false;
+        return;
+    }
+
+    mqtt_router_message_t message = {
+        .topic = inflight->topic,
+        .topic_len = inflight->topic_len,
+        .data = event->data,
+        .data_len = event->data_len,
+        .offset = event->current_data_offset,
+        .total_len = inflight->total_len,
+    };
+    call_handlers(router, inflight, false, &message);
+    inflight->next_offset += event->data_len;
+    bool last = (inflight->next_offset >= inflight->total_len);
+
+    if (inflight->reassembling) {
+        memcpy(router->buffer + event->current_data_offset, event->data, event->data_len);
+        if (last) {
+            message.data = router->buffer;
+            message.data_len = inflight->total_len;
+            message.offset = 0;
+            router->stats.reassembled++;
+            call_handlers(router, inflight, true, &message);
+        }
+    }
+    if (last) {
+        inflight->active = false;
+    }
+}
+
+void mqtt_router_get_stats(const mqtt_router_t *router, mqtt_router_stats_t *stats) {
+    *stats = router->stats;
+}
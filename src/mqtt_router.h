@@ -0,0 +1,134 @@
+/**
+ * \file mqtt_router.h
+ * \brief Inbound MQTT message router: topic filters with `+` and `#` wildcards, compiled into a trie.
+ *
+ * Routes are added with \ref mqtt_router_add, then \ref mqtt_router_compile lays the trie out in flat arrays:
+ * one node per filter level, the literal children of a node sorted for a binary search, the `+` child and
+ * the routes ending or with a `#` at the node. Routing a topic walks its levels once, following both the literal
+ * and the `+` child, so its cost depends on the topic depth and the matching filters, not on the number of routes.
+ *
+ * esp_mqtt delivers a message larger than its buffer as several DATA events, the topic only in the first one.
+ * Handlers get the payload as a borrowed slice of the event, with its offset in the message: a streaming handler
+ * sees every fragment. A handler added with MQTT_ROUTER_REASSEMBLE is called once with the whole message: directly
+ * from the event when it came in one piece, otherwise from the reassembly buffer of the router, filled as fragments
+ * arrive. The fragments of a message come in order from the MQTT client task, so one buffer, allocated at the first
+ * fragmented message and then reused, is enough. Messages larger than it are not delivered to those handlers.
+ *
+ * Routes are added and compiled before the MQTT client starts; \ref mqtt_router_dispatch is only called from
+ * the MQTT client task.
+ */
+#ifndef _MQTT_ROUTER_H_
+#define _MQTT_ROUTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Most routes matched by one message, the others are not called */
+#define MQTT_ROUTER_MAX_MATCHES     (16)
+/** Longest topic kept for the fragments after the first one, longer topics are truncated */
+#define MQTT_ROUTER_MAX_TOPIC_LENGTH (128)
+/** Most levels in a topic filter */
+#define MQTT_ROUTER_MAX_LEVELS      (32)
+
+/** Route flag: call the handler once with the whole message */
+#define MQTT_ROUTER_REASSEMBLE      (1u << 0)
+
+/**
+ * \brief A message, or a fragment of it for a streaming handler. Only valid during the call.
+ */
+typedef struct {
+    /** The topic, not NULL-terminated */
+    const char *topic;
+    int topic_len;
+    /** The payload slice: `data_len` bytes at `offset` of a `total_len` message */
+    const char *data;
+    int data_len;
+    int offset;
+    int total_len;
+} mqtt_router_message_t;
+
+typedef void (*mqtt_router_handler_t)(void *arg, const mqtt_router_message_t *message);
+
+/**
+ * \brief Router statistics
+ */
+typedef struct {
+    /** Messages received (first fragments) */
+    uint32_t messages;
+    /** DATA events, one per fragment */
+    uint32_t fragments;
+    /** Messages no route matched */
+    uint32_t unmatched;
+    /** Messages reassembled in the reassembly buffer */
+    uint32_t reassembled;
+    /** Messages not delivered to the reassembling routes: too large, no memory or fragments missing */
+    uint32_t dropped;
+    /** Messages that matched more than MQTT_ROUTER_MAX_MATCHES routes */
+    uint32_t overflows;
+} mqtt_router_stats_t;
+
+typedef struct mqtt_router mqtt_router_t;
+
+/**
+ * \brief Create a router.
+ * \param[in] max_message size of the reassembly buffer, the largest fragmented message a reassembling handler gets
+ * \return the router, NULL for failure
+ */
+mqtt_router_t *mqtt_router_create(size_t max_message);
+
+/**
+ * \brief Destroy a router and its reassembly buffer.
+ */
+void mqtt_router_destroy(mqtt_router_t *router);
+
+/**
+ * \brief Add a route. The trie must be compiled again before dispatching.
+ * \param[in] filter  the topic filter, copied
+ * \param[in] handler the handler
+ * \param[in] arg     passed to the handler
+ * \param[in] flags   MQTT_ROUTER_REASSEMBLE or 0
+ * \return 0 for success, -1 if the filter is invalid or for an allocation failure
+ */
+int mqtt_router_add(mqtt_router_t *router, const char *filter, mqtt_router_handler_t handler, void *arg, uint32_t flags);
+
+/**
+ * \brief Lay the trie out for dispatching.
+ * \return 0 for success, -1 for an allocation failure (the previous layout is kept)
+ */
+int mqtt_router_compile(mqtt_router_t *router);
+
+/**
+ * \brief Find the routes matching a topic, as \ref mqtt_router_dispatch does.
+ * \param[out] routes the indices of the matching routes (0 for the first route added), sorted
+ * \param[in]  max    the size of \p routes
+ * \return the number of matching routes, which may be larger than \p max
+ */
+int mqtt_router_match(const mqtt_router_t *router, const char *topic, int topic_len, uint32_t *routes, int max);
+
+/**
+ * \brief Subscribe to the filters of the routes, once each.
+ * \return 0 for success, -1 if a subscription could not be sent
+ */
+int mqtt_router_subscribe(const mqtt_router_t *router, platform_mqtt_t *mqtt, int qos);
+
+/**
+ * \brief Route a DATA event to the matching handlers.
+ */
+void mqtt_router_dispatch(mqtt_router_t *router, const platform_mqtt_event_t *event);
+
+/**
+ * \brief Get a snapshot of the statistics.
+ */
+void mqtt_router_get_stats(const mqtt_router_t *router, mqtt_router_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _MQTT_ROUTER_H_
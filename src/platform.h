@@ -0,0 +1,315 @@
+/**
+ * \file platform.h
+ * \brief Thin platform abstraction used by the application logic in app.c.
+ *
+ * Two backends implement it: platform_esp32.c (FreeRTOS, esp_wifi, esp_mqtt, QuarkLink client library, LED strip)
+ * and host/platform_linux.c (pthreads and a plain MQTT client) for running many simulated devices in one process.
+ * The QuarkLink API itself is the one declared in quarklink.h, provided by the client library on the device
+ * and by host/quarklink_linux.c on Linux.
+ */
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "quarklink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Scheduler and timers
+ */
+
+/** \brief Monotonic time in microseconds */
+int64_t platform_now_us(void);
+
+/** \brief Block the calling task for the given time */
+void platform_delay_ms(uint32_t ms);
+
+/**
+ * \brief Create a task.
+ * \param[in]  task       the task function
+ * \param[in]  name       the task name
+ * \param[in]  stack_size the stack size, in bytes
+ * \param[in]  arg        the argument passed to the task function
+ * \param[in]  priority   the task priority (ignored on Linux)
+ * \param[out] handle     the created task, can be NULL
+ * \return 0 for success, -1 for failure
+ */
+int platform_task_create(void (*task)(void *), const char *name, uint32_t stack_size, void *arg, int priority, void **handle);
+
+/**
+ * \brief End the calling task, created with \ref platform_task_create. A FreeRTOS task may not return.
+ */
+void platform_task_exit(void);
+
+/**
+ * \brief Get the minimum amount of stack, in bytes, that remained free for the task since it started.
+ * \return the high-water mark, 0 if not available
+ */
+uint32_t platform_task_stack_free(void *handle);
+
+/** \brief Fill \p buffer with cryptographically secure random bytes */
+void platform_random(void *buffer, size_t length);
+
+/** \brief Free heap, in bytes, 0 if not available */
+size_t platform_heap_free(void);
+
+/** \brief Largest free heap block, in bytes, 0 if not available */
+size_t platform_heap_largest_block(void);
+
+/**
+ * Queues
+ */
+
+typedef struct platform_queue platform_queue_t;
+
+/** Timeout of \ref platform_queue_receive that waits until an item arrives */
+#define PLATFORM_WAIT_FOREVER UINT32_MAX
+
+/**
+ * \brief Create a queue of fixed size items.
+ * \param[in] length    the maximum number of items
+ * \param[in] item_size the size of an item, in bytes
+ * \return the queue, NULL for failure
+ */
+platform_queue_t *platform_queue_create(size_t length, size_t item_size);
+
+/**
+ * \brief Copy an item to the back of the queue. Never blocks.
+ * \return 0 for success, -1 if the queue is full
+ */
+int platform_queue_send(platform_queue_t *queue, const void *item);
+
+/**
+ * \brief Take the item at the front of the queue.
+ * \param[out] item       the item, \p item_size bytes
+ * \param[in]  timeout_ms how long to wait for an item, rounded up to the scheduler tick,
+ *                        or PLATFORM_WAIT_FOREVER. Not affected by the host time scale.
+ * \return 0 for success, -1 if the timeout expired
+ */
+int platform_queue_receive(platform_queue_t *queue, void *item, uint32_t timeout_ms);
+
+/**
+ * \brief Delete a queue, NULL is ignored. No task may be waiting on it.
+ */
+void platform_queue_delete(platform_queue_t *queue);
+
+/**
+ * Mutexes
+ */
+
+typedef struct platform_mutex platform_mutex_t;
+
+/**
+ * \brief Create a mutex. It is not recursive.
+ * \return the mutex, NULL for failure
+ */
+platform_mutex_t *platform_mutex_create(void);
+
+void platform_mutex_lock(platform_mutex_t *mutex);
+void platform_mutex_unlock(platform_mutex_t *mutex);
+
+/**
+ * \brief Delete a mutex, NULL is ignored. It must not be locked.
+ */
+void platform_mutex_delete(platform_mutex_t *mutex);
+
+/**
+ * Network
+ */
+
+/**
+ * \brief Bring the network up. Blocks until connected.
+ * \return 0 for success, -1 if the network could not be brought up
+ */
+int platform_network_start(void);
+
+/**
+ * \brief Get the DNS server of the network, to query it directly (see dns_cache.h).
+ * \param[out] address the server address, in network byte order
+ * \param[out] port    the server port
+ * \return 0 for success, -1 if there is none
+ */
+int platform_dns_server(uint32_t *address, uint16_t *port);
+
+/**
+ * \brief Resolve a host name to an IPv4 address, e.g. to keep the answer across deep sleep.
+ * \param[in]  host    the host name
+ * \param[out] address the address, in network byte order
+ * \return 0 for success, -1 if the name could not be resolved
+ */
+int platform_dns_resolve(const char *host, uint32_t *address);
+
+/**
+ * \brief Resolve a host name to all its IPv4 addresses, in the order of the resolver.
+ * The DNS cache answers first once initialised, see dns_cache.h.
+ * \param[in]  host      the host name
+ * \param[out] addresses the addresses, in network byte order
+ * \param[in]  max       the size of \p addresses
+ * \return the number of addresses, -1 if the name could not be resolved
+ */
+int platform_dns_resolve_all(const char *host, uint32_t *addresses, size_t max);
+
+/**
+ * \brief Mark the start and the end of a connection made by the application task: a call to QuarkLink, or
+ * the broker race and the start of the MQTT client, so the backend can account for the connection resources
+ * (e.g. TLS memory arena).
+ */
+void platform_connection_begin(void);
+void platform_connection_end(void);
+
+/**
+ * MQTT client
+ */
+
+typedef struct platform_mqtt platform_mqtt_t;
+
+typedef enum {
+    PLATFORM_MQTT_EVENT_BEFORE_CONNECT,
+    PLATFORM_MQTT_EVENT_CONNECTED,
+    PLATFORM_MQTT_EVENT_DISCONNECTED,
+    PLATFORM_MQTT_EVENT_SUBSCRIBED,
+    PLATFORM_MQTT_EVENT_UNSUBSCRIBED,
+    PLATFORM_MQTT_EVENT_PUBLISHED,
+    PLATFORM_MQTT_EVENT_DATA,
+    PLATFORM_MQTT_EVENT_ERROR,
+} platform_mqtt_event_id_t;
+
+/**
+ * \brief MQTT event. Data events may be fragments of a larger message:
+ * `data` holds `data_len` bytes starting at `current_data_offset` of a `total_data_len` message.
+ * The topic is only set on the first fragment.
+ */
+typedef struct {
+    platform_mqtt_event_id_t id;
+    int msg_id;
+    const char *topic;
+    int topic_len;
+    const char *data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    /** Backend specific error code, for PLATFORM_MQTT_EVENT_ERROR */
+    int error_code;
+} platform_mqtt_event_t;
+
+typedef void (*platform_mqtt_event_cb_t)(void *arg, const platform_mqtt_event_t *event);
+
+/** Largest TLS session that can be kept between MQTT connections */
+#define PLATFORM_TLS_SESSION_SIZE   (2048)
+
+/** 1 if the MQTT backend fills and resumes platform_mqtt_config_t.session. esp_mqtt does not expose the TLS session
+ * of its connection, so the ESP-IDF build (ESP_PLATFORM) keeps none */
+#ifndef PLATFORM_MQTT_TLS_SESSION
+#ifdef ESP_PLATFORM
+#define PLATFORM_MQTT_TLS_SESSION   0
+#else
+#define PLATFORM_MQTT_TLS_SESSION   1
+#endif
+#endif
+
+/**
+ * \brief A serialised TLS session, to resume it on the next connection to the same broker
+ */
+typedef struct {
+    /** Length of the session, 0 for none */
+    uint16_t length;
+    uint8_t data[PLATFORM_TLS_SESSION_SIZE];
+} platform_tls_session_t;
+
+/**
+ * \brief A message published right after the CONNECT, see platform_mqtt_config_t
+ */
+typedef struct {
+    const char *topic;
+    const char *data;
+    /** The data length, 0 to use strlen(data) */
+    int len;
+    /** 0 or 1 */
+    int qos;
+} platform_mqtt_message_t;
+
+typedef struct {
+    /** The enrolled context: broker endpoint, port, client ID and credentials. Only used during the call. */
+    const quarklink_context_t *quarklink;
+    /** Optional username */
+    const char *username;
+    /** Keep-alive in seconds, 0 for the default */
+    int keepalive;
+    /** IoT Hub address resolved beforehand (network byte order), 0 to resolve the endpoint.
+     * The endpoint remains the TLS server name. */
+    uint32_t address;
+    /** TCP connection to `address` established beforehand, e.g. by broker_race_connect, -1 for none. The client
+     * owns it and starts the TLS handshake of its first connection on it; it connects again after a disconnection. */
+    int socket;
+    /** TLS session to resume, replaced by the session of every new connection. NULL not to resume,
+     * otherwise must outlive the client. The esp_mqtt backend leaves it empty: see platform_esp32.c */
+    platform_tls_session_t *session;
+    /** Messages published on the first connection right after the CONNECT, without waiting for the CONNACK,
+     * copied by \ref platform_mqtt_start. Their PUBLISHED events are the only way to learn their message IDs. */
+    const platform_mqtt_message_t *connect_messages;
+    size_t connect_message_count;
+    /** Send the CONNECT and the connect messages as TLS 1.3 early data (0-RTT) when the resumed session allows it,
+     * and send them again after the handshake if the broker rejects it. Early data can be replayed by an attacker
+     * until the broker drops the ticket: only use it for messages a duplicate does not harm. The esp_mqtt backend
+     * never sends early data: see platform_esp32.c */
+    bool early_data;
+    /** Event callback, called from the MQTT client task */
+    platform_mqtt_event_cb_t event_cb;
+    void *event_arg;
+} platform_mqtt_config_t;
+
+/**
+ * \brief Create and start an MQTT client. Connection happens in the background.
+ * \return the client, NULL for failure
+ */
+platform_mqtt_t *platform_mqtt_start(const platform_mqtt_config_t *config);
+
+/**
+ * \brief Stop and destroy an MQTT client.
+ */
+void platform_mqtt_stop(platform_mqtt_t *mqtt);
+
+/**
+ * \brief Publish a message.
+ * \param[in] len the data length, 0 to use strlen(data)
+ * \return the message ID (0 for QoS 0), -1 for failure
+ */
+int platform_mqtt_publish(platform_mqtt_t *mqtt, const char *topic, const char *data, int len, int qos, int retain);
+
+/**
+ * \brief Subscribe to a topic filter.
+ * \return the message ID, -1 for failure
+ */
+int platform_mqtt_subscribe(platform_mqtt_t *mqtt, const char *topic, int qos);
+
+/**
+ * Miscellaneous
+ */
+
+/**
+ * \brief Read the sensor sampled by the duty-cycle mode: the chip temperature.
+ * \return the temperature in tenths of degree Celsius, INT32_MIN if it could not be read
+ */
+int32_t platform_sample(void);
+
+/**
+ * \brief Show a colour on the status LED. Must not block: the frame is queued to the LED driver.
+ * Only called by the LED animation task, see led_anim.h.
+ */
+void platform_led_write(uint8_t red, uint8_t green, uint8_t blue);
+
+/** \brief Log the backend statistics, e.g. the TLS pool usage. Called when the runtime metrics are flushed */
+void platform_log_stats(void);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _PLATFORM_H_
@@ -0,0 +1,849 @@
+/**
+ * \file platform_esp32.c
+ * \brief ESP-IDF implementation of platform.h: FreeRTOS, esp_wifi, esp_mqtt and the LED strip.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_wifi.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include "lwip/api.h"
+#include "lwip/dns.h"
+#include "driver/temperature_sensor.h"
+#include "mqtt_client.h"
+#include "esp_tls.h"
+#include "esp_transport.h"
+#include "mbedtls/ssl.h"
+#include "led_strip.h"
+#include "sdkconfig.h"
+
+#include "quarklink.h"
+#include "quarklink_extras.h"
+#include "rsa_sign_alt.h"
+
+#include "app.h"
+#include "platform.h"
+#include "metrics.h"
+#include "cert_cache.h"
+#include "tls_pool.h"
+#include "dns_cache.h"
+#if CONFIG_QUARKLINK_CERT_COMPRESSION
+#include "mbedtls/ssl_cert_compression.h"
+#endif
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+#define LED_STRIP_BLINK_GPIO  48 // GPIO assignment esp32-s3
+#elif CONFIG_IDF_TARGET_ESP32S2
+#define LED_STRIP_BLINK_GPIO  18 // GPIO assignment esp32-s2
+#else
+#define LED_STRIP_BLINK_GPIO  8 // GPIO assignment esp32-c3
+#endif
+#define LED_STRIP_LED_NUMBERS 1 // LED numbers in the strip
+#define LED_STRIP_RMT_RES_HZ  (10 * 1000 * 1000) // 10MHz resolution, 1 tick = 0.1us (led strip needs a high resolution)
+
+/* FreeRTOS event group to signal when we are connected */
+static EventGroupHandle_t s_wifi_event_group;
+
+/* The event group allows multiple bits for each event, but we only care about two events:
+ * - we are connected to the AP with an IP
+ * - we failed to connect after the maximum amount of retries */
+#define WIFI_CONNECTED_BIT BIT0
+#define WIFI_FAIL_BIT      BIT1
+
+static int s_retry_num = 0;
+
+static const char *TAG = "platform";
+
+/* Largest TLS record the broker may send on the MQTT connection, requested with the
+ * max_fragment_length extension. The record buffers are shrunk to the negotiated size after the handshake.
+ * TLS 1.2 only: the mbedtls TLS 1.3 client sends no max_fragment_length, and its record_size_limit would announce
+ * CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN for every connection, the QuarkLink API ones included. With TLS 1.3 enabled,
+ * as in all the sdkconfigs but esp32-s3-ds-release, a broker that negotiates TLS 1.3 keeps full-size records, so
+ * the sdkconfigs keep IN_CONTENT_LEN at 16384 and only shrink OUT_CONTENT_LEN, which bounds what the device sends. */
+#ifndef MQTT_TLS_MAX_FRAG_LEN
+#define MQTT_TLS_MAX_FRAG_LEN   MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#endif
+
+struct platform_mqtt {
+    esp_mqtt_client_handle_t client;
+    platform_mqtt_event_cb_t event_cb;
+    void *event_arg;
+    /** Copies of the PEM certificates not served by the cert cache, the client refers to them */
+    char *root_cert;
+    char *device_cert;
+    /** Server name checked against the broker certificate, when connecting to a resolved address */
+    char *common_name;
+    /** The esp_mqtt task, once it has connected: its TLS pool arena is released with the client */
+    void *task;
+};
+
+/**
+ * \brief TLS transport of an MQTT client given the connection of the broker race: esp_transport_ssl always opens
+ * a new socket, this one starts the handshake of the first connection on the connection handed over, and connects
+ * to the address again after a disconnection. Destroyed with the client.
+ */
+typedef struct {
+    esp_tls_cfg_t cfg;
+    esp_tls_t *tls;
+    /** The connection handed over, -1 once the first connection has taken it */
+    int socket;
+} mqtt_transport_t;
+
+/**
+ * Scheduler and timers
+ */
+
+int64_t platform_now_us(void) {
+    return esp_timer_get_time();
+}
+
+void platform_delay_ms(uint32_t ms) {
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+int platform_task_create(void (*task)(void *), const char *name, uint32_t stack_size, void *arg, int priority, void **handle) {
+    TaskHandle_t task_handle = NULL;
+    if (xTaskCreate(task, name, stack_size, arg, priority, &task_handle) != pdPASS) {
+        return -1;
+    }
+    if (handle != NULL) {
+        *handle = task_handle;
+    }
+    return 0;
+}
+
+void platform_task_exit(void) {
+    vTaskDelete(NULL);
+}
+
+uint32_t platform_task_stack_free(void *handle) {
+    // Stack sizes are expressed in bytes on ESP-IDF
+    return uxTaskGetStackHighWaterMark((TaskHandle_t)handle);
+}
+
+void platform_random(void *buffer, size_t length) {
+    esp_fill_random(buffer, length);
+}
+
+size_t platform_heap_free(void) {
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+size_t platform_heap_largest_block(void) {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+/**
+ * Queues
+ */
+
+platform_queue_t *platform_queue_create(size_t length, size_t item_size) {
+    return (platform_queue_t *)xQueueCreate(length, item_size);
+}
+
+int platform_queue_send(platform_queue_t *queue, const void *item) {
+    return (xQueueSend((QueueHandle_t)queue, item, 0) == pdTRUE) ? 0 : -1;
+}
+
+int platform_queue_receive(platform_queue_t *queue, void *item, uint32_t timeout_ms) {
+    TickType_t ticks = portMAX_DELAY;
+    if (timeout_ms != PLATFORM_WAIT_FOREVER) {
+        ticks = (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    }
+    return (xQueueReceive((QueueHandle_t)queue, item, ticks) == pdTRUE) ? 0 : -1;
+}
+
+void platform_queue_delete(platform_queue_t *queue) {
+    if (queue != NULL) {
+        vQueueDelete((QueueHandle_t)queue);
+    }
+}
+
+/**
+ * Mutexes
+ */
+
+platform_mutex_t *platform_mutex_create(void) {
+    return (platform_mutex_t *)xSemaphoreCreateMutex();
+}
+
+void platform_mutex_lock(platform_mutex_t *mutex) {
+    xSemaphoreTake((SemaphoreHandle_t)mutex, portMAX_DELAY);
+}
+
+void platform_mutex_unlock(platform_mutex_t *mutex) {
+    xSemaphoreGive((SemaphoreHandle_t)mutex);
+}
+
+void platform_mutex_delete(platform_mutex_t *mutex) {
+    if (mutex != NULL) {
+        vSemaphoreDelete((SemaphoreHandle_t)mutex);
+    }
+}
+
+/**
+ * Network
+ */
+
+static void event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    }
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        ESP_LOGI(TAG, "Connection to the AP failed");
+        metrics_count(METRICS_C_WIFI_DISCONNECTED);
+        if (s_retry_num < 10) {
+            esp_wifi_connect();
+            s_retry_num++;
+            ESP_LOGI(TAG, "Retry to connect to the AP (%d/%d)", s_retry_num, 10);
+        }
+        else {
+            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        }
+    }
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        // ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        // ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        s_retry_num = 0;
+        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+    }
+}
+
+int platform_network_start(void) {
+    int ret = 0;
+    s_wifi_event_group = xEventGroupCreate();
+
+    ESP_ERROR_CHECK(esp_netif_init());
+
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &event_handler,
+                                                        NULL,
+                                                        &instance_any_id));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        &instance_got_ip));
+
+    wifi_config_t wifi_config;
+    /* Load existing configuration and prompt user */
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+
+    ESP_ERROR_CHECK(esp_wifi_start() );
+    ESP_LOGD(TAG, "platform_network_start finished.");
+
+    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
+     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
+    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
+            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+            pdFALSE,
+            pdFALSE,
+            portMAX_DELAY);
+
+    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
+     * happened. */
+    if (bits & WIFI_CONNECTED_BIT) {
+        ESP_LOGI(TAG, "connected to ap SSID: %s", wifi_config.sta.ssid);
+    }
+    else if (bits & WIFI_FAIL_BIT) {
+        ESP_LOGI(TAG, "Failed to connect to SSID: %s", wifi_config.sta.ssid);
+        ESP_LOGI(TAG, "Reached maximum retry limit for connection to the AP");
+        ret = -1;
+    }
+    else {
+        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+    }
+
+    /* The event will not be processed after unregister */
+    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
+    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
+    vEventGroupDelete(s_wifi_event_group);
+    return ret;
+}
+
+int platform_dns_server(uint32_t *address, uint16_t *port) {
+    const ip_addr_t *server = dns_getserver(0);
+    if (server == NULL || !IP_IS_V4(server) || ip4_addr_isany(ip_2_ip4(server))) {
+        return -1;
+    }
+    *address = ip4_addr_get_u32(ip_2_ip4(server));
+    *port = 53;
+    return 0;
+}
+
+#if CONFIG_LWIP_HOOK_NETCONN_EXT_RESOLVE_CUSTOM
+/*
+ * @brief Resolve through the DNS cache, called by lwIP before its own resolver
+ *
+ *  Every getaddrinfo() goes through it, those of the QuarkLink client library, esp-tls and esp_mqtt included.
+ *  Only answers already cached: a miss is queried in the background. Returns 0 to leave the name to lwIP.
+ */
+int lwip_hook_netconn_external_resolve(const char *name, ip_addr_t *addr, u8_t addrtype, err_t *err) {
+    uint32_t address;
+    if (addrtype == NETCONN_DNS_IPV6 || dns_cache_lookup(name, &address, 1) <= 0) {
+        return 0;
+    }
+    ip_addr_set_ip4_u32(addr, address);
+    *err = ERR_OK;
+    return 1;
+}
+#endif
+
+int platform_dns_resolve(const char *host, uint32_t *address) {
+    return (platform_dns_resolve_all(host, address, 1) > 0) ? 0 : -1;
+}
+
+int platform_dns_resolve_all(const char *host, uint32_t *addresses, size_t max) {
+    // getaddrinfo() would only return the first address of the cache
+    int cached = dns_cache_resolve(host, addresses, max);
+    if (cached > 0) {
+        return cached;
+    }
+    const struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *result = NULL;
+    if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL) {
+        ESP_LOGW(TAG, "Failed to resolve %s", host);
+        return -1;
+    }
+    size_t count = 0;
+    for (struct addrinfo *entry = result; entry != NULL && count < max; entry = entry->ai_next) {
+        addresses[count++] = ((struct sockaddr_in *)entry->ai_addr)->sin_addr.s_addr;
+    }
+    freeaddrinfo(result);
+    return (int)count;
+}
+
+void platform_connection_begin(void) {
+    tls_pool_arena_begin();
+}
+
+void platform_connection_end(void) {
+    tls_pool_arena_end();
+}
+
+/**
+ * MQTT client
+ */
+
+/*
+ * @brief Set up the TLS configuration of the MQTT connection
+ *
+ *  Attaches the cached IoT Hub root and requests a smaller record size, as MQTT payloads are tiny. Only a TLS 1.2
+ *  handshake negotiates it: see MQTT_TLS_MAX_FRAG_LEN.
+ */
+static esp_err_t mqtt_tls_attach(void *conf) {
+    esp_err_t ret = cert_cache_attach(conf);
+    if (ret == ESP_OK) {
+        mbedtls_ssl_conf_max_frag_len((mbedtls_ssl_config *)conf, MQTT_TLS_MAX_FRAG_LEN);
+    }
+    return ret;
+}
+
+/* The receive and send timeouts esp-tls sets when it opens the socket itself, see esp_tls_set_socket_options */
+static int mqtt_transport_socket_timeouts(int fd, int timeout_ms) {
+    if (timeout_ms <= 0) {
+        return 0;
+    }
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+        ESP_LOGE(TAG, "Failed to set the timeouts of the broker socket (errno %d)", errno);
+        return -1;
+    }
+    return 0;
+}
+
+static int mqtt_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    transport->tls = esp_tls_init();
+    if (transport->tls == NULL) {
+        return -1;
+    }
+    if (transport->socket >= 0 && mqtt_transport_socket_timeouts(transport->socket, timeout_ms) != 0) {
+        // Without timeouts a silent broker would block the handshake forever: let esp-tls connect again
+        close(transport->socket);
+        transport->socket = -1;
+    }
+    if (transport->socket >= 0) {
+        // Already connected: esp-tls goes straight to the handshake, without the socket options of its tcp_connect
+        esp_tls_set_conn_sockfd(transport->tls, transport->socket);
+        esp_tls_set_conn_state(transport->tls, ESP_TLS_CONNECTING);
+        transport->socket = -1;
+    }
+    transport->cfg.timeout_ms = timeout_ms;
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &transport->cfg, transport->tls) <= 0) {
+        esp_tls_conn_destroy(transport->tls);
+        transport->tls = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* 1 when the connection is ready, 0 on timeout, -1 for an error */
+static int mqtt_transport_poll(esp_transport_handle_t t, int timeout_ms, bool write) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    int fd = -1;
+    if (transport->tls == NULL || esp_tls_get_conn_sockfd(transport->tls, &fd) != ESP_OK || fd < 0) {
+        return -1;
+    }
+    if (!write && esp_tls_get_bytes_avail(transport->tls) > 0) {
+        return 1;
+    }
+    fd_set ready;
+    fd_set errors;
+    FD_ZERO(&ready);
+    FD_ZERO(&errors);
+    FD_SET(fd, &ready);
+    FD_SET(fd, &errors);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int ret = select(fd + 1, write ? NULL : &ready, write ? &ready : NULL, &errors, (timeout_ms < 0) ? NULL : &timeout);
+    if (ret > 0 && FD_ISSET(fd, &errors)) {
+        return -1;
+    }
+    return ret;
+}
+
+static int mqtt_transport_poll_read(esp_transport_handle_t t, int timeout_ms) {
+    return mqtt_transport_poll(t, timeout_ms, false);
+}
+
+static int mqtt_transport_poll_write(esp_transport_handle_t t, int timeout_ms) {
+    return mqtt_transport_poll(t, timeout_ms, true);
+}
+
+static int mqtt_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    int poll = mqtt_transport_poll_read(t, timeout_ms);
+    if (poll <= 0) {
+        return (poll == 0) ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    ssize_t ret = esp_tls_conn_read(transport->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    return (ret < 0) ? ERR_TCP_TRANSPORT_CONNECTION_FAILED : (int)ret;
+}
+
+static int mqtt_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    int poll = mqtt_transport_poll_write(t, timeout_ms);
+    if (poll <= 0) {
+        return poll;
+    }
+    ssize_t ret = esp_tls_conn_write(transport->tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return (ret < 0) ? -1 : (int)ret;
+}
+
+static int mqtt_transport_close(esp_transport_handle_t t) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    if (transport->tls != NULL) {
+        esp_tls_conn_destroy(transport->tls);
+        transport->tls = NULL;
+    }
+    return 0;
+}
+
+static int mqtt_transport_destroy(esp_transport_handle_t t) {
+    mqtt_transport_t *transport = esp_transport_get_context_data(t);
+    mqtt_transport_close(t);
+    if (transport->socket >= 0) {
+        close(transport->socket);
+    }
+    free(transport);
+    return 0;
+}
+
+/**
+ * \brief Create the transport taking over \p socket, with the TLS settings esp_mqtt would give its own.
+ * \return the transport, NULL for failure (\p socket is then left to the caller)
+ */
+static esp_transport_handle_t mqtt_transport_create(const esp_mqtt_client_config_t *mqtt_cfg, int socket) {
+    mqtt_transport_t *transport = calloc(1, sizeof(mqtt_transport_t));
+    esp_transport_handle_t t = esp_transport_init();
+    if (transport == NULL || t == NULL) {
+        free(transport);
+        esp_transport_destroy(t);
+        return NULL;
+    }
+    // A PEM string is passed with its terminator, a DER buffer with its length
+    const char *root = mqtt_cfg->broker.verification.certificate;
+    if (root != NULL) {
+        transport->cfg.cacert_buf = (const unsigned char *)root;
+        transport->cfg.cacert_bytes = strlen(root) + 1;
+    }
+    transport->cfg.crt_bundle_attach = mqtt_cfg->broker.verification.crt_bundle_attach;
+    transport->cfg.common_name = mqtt_cfg->broker.verification.common_name;
+    const char *device_cert = mqtt_cfg->credentials.authentication.certificate;
+    size_t device_cert_len = mqtt_cfg->credentials.authentication.certificate_len;
+    transport->cfg.clientcert_buf = (const unsigned char *)device_cert;
+    transport->cfg.clientcert_bytes = (device_cert_len != 0) ? device_cert_len : strlen(device_cert) + 1;
+    transport->cfg.ds_data = mqtt_cfg->credentials.authentication.ds_data;
+    transport->socket = socket;
+    esp_transport_set_context_data(t, transport);
+    esp_transport_set_func(t, mqtt_transport_connect, mqtt_transport_read, mqtt_transport_write, mqtt_transport_close,
+                           mqtt_transport_poll_read, mqtt_transport_poll_write, mqtt_transport_destroy);
+    return t;
+}
+
+/*
+ * @brief Event handler registered to receive MQTT events
+ *
+ *  Translates the esp_mqtt events for the application.
+ *
+ * @param handler_args the platform_mqtt_t the event belongs to.
+ * @param base Event base for the handler(always MQTT Base in this example).
+ * @param event_id The id for the received event.
+ * @param event_data The data for the event, esp_mqtt_event_handle_t.
+ */
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
+    ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%" PRIi32, base, event_id);
+    platform_mqtt_t *mqtt = handler_args;
+    esp_mqtt_event_handle_t event = event_data;
+    platform_mqtt_event_t app_event = {
+        .msg_id = event->msg_id,
+        .topic = event->topic,
+        .topic_len = event->topic_len,
+        .data = event->data,
+        .data_len = event->data_len,
+        .total_data_len = event->total_data_len,
+        .current_data_offset = event->current_data_offset,
+    };
+
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        app_event.id = PLATFORM_MQTT_EVENT_CONNECTED;
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        app_event.id = PLATFORM_MQTT_EVENT_DISCONNECTED;
+        /* The transport is closed: the arena goes back to the pool until the next connection */
+        tls_pool_arena_end();
+        break;
+    case MQTT_EVENT_SUBSCRIBED:
+        app_event.id = PLATFORM_MQTT_EVENT_SUBSCRIBED;
+        break;
+    case MQTT_EVENT_UNSUBSCRIBED:
+        app_event.id = PLATFORM_MQTT_EVENT_UNSUBSCRIBED;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        app_event.id = PLATFORM_MQTT_EVENT_PUBLISHED;
+        break;
+    case MQTT_EVENT_DATA:
+        app_event.id = PLATFORM_MQTT_EVENT_DATA;
+        break;
+    case MQTT_EVENT_BEFORE_CONNECT:
+        app_event.id = PLATFORM_MQTT_EVENT_BEFORE_CONNECT;
+        /* The MQTT task only uses mbedtls for its connection: bind it to an arena until it disconnects */
+        mqtt->task = xTaskGetCurrentTaskHandle();
+        tls_pool_arena_begin();
+        break;
+    case MQTT_EVENT_ERROR:
+        app_event.id = PLATFORM_MQTT_EVENT_ERROR;
+        app_event.error_code = event->error_handle->error_type;
+        if (event->error_handle->error_type == MQTT_ERROR_TYPE_TCP_TRANSPORT) {
+            ESP_LOGD(TAG, "Last error code reported from esp-tls: 0x%x", event->error_handle->esp_tls_last_esp_err);
+            ESP_LOGD(TAG, "Last tls stack error number: 0x%x", event->error_handle->esp_tls_stack_err);
+            ESP_LOGD(TAG, "Last captured errno : %d (%s)",  event->error_handle->esp_transport_sock_errno,
+                     strerror(event->error_handle->esp_transport_sock_errno));
+        }
+        else if (event->error_handle->error_type == MQTT_ERROR_TYPE_CONNECTION_REFUSED) {
+            ESP_LOGD(TAG, "Connection refused error: 0x%x", event->error_handle->connect_return_code);
+        }
+        else {
+            ESP_LOGD(TAG, "Unknown error type: 0x%x", event->error_handle->error_type);
+        }
+        break;
+    default:
+        ESP_LOGD(TAG, "Other event id:%d", event->event_id);
+        return;
+    }
+
+    if (mqtt->event_cb != NULL) {
+        mqtt->event_cb(mqtt->event_arg, &app_event);
+    }
+}
+
+static void mqtt_free(platform_mqtt_t *mqtt) {
+    free(mqtt->root_cert);
+    free(mqtt->device_cert);
+    free(mqtt->common_name);
+    free(mqtt);
+}
+
+platform_mqtt_t *platform_mqtt_start(const platform_mqtt_config_t *config) {
+    const quarklink_context_t *quarklink = config->quarklink;
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker = {
+            .address.hostname = quarklink->iotHubEndpoint,
+            .address.port = quarklink->iotHubPort,
+            .address.transport = MQTT_TRANSPORT_OVER_SSL,
+            .verification.certificate = quarklink->iotHubRootCert
+        },
+        .credentials = {
+            .client_id = quarklink->deviceID,
+            .username = config->username,
+            .authentication = {
+                .certificate = quarklink->deviceCert,
+            }
+        },
+        .session.keepalive = config->keepalive,
+    };
+
+    /* Use the certificates converted once after enrolment, fall back to the PEM strings otherwise */
+    if (cert_cache_update(quarklink) == 0) {
+        size_t device_cert_len = 0;
+        const unsigned char *device_cert = cert_cache_device_cert(&device_cert_len);
+        if (device_cert != NULL) {
+            mqtt_cfg.credentials.authentication.certificate = (const char *)device_cert;
+            mqtt_cfg.credentials.authentication.certificate_len = device_cert_len;
+        }
+        if (cert_cache_has_root()) {
+            mqtt_cfg.broker.verification.certificate = NULL;
+            mqtt_cfg.broker.verification.crt_bundle_attach = mqtt_tls_attach;
+        }
+    }
+    else {
+        ESP_LOGW(TAG, "Failed to cache the enrolment certificates");
+    }
+
+    /* Using Digital Signature module */
+    static esp_ds_data_ctx_t ds_data;
+    quarklink_esp32_getDSData(&ds_data);
+    mqtt_cfg.credentials.authentication.ds_data = &ds_data;
+
+    platform_mqtt_t *mqtt = calloc(1, sizeof(platform_mqtt_t));
+    if (mqtt == NULL) {
+        if (config->socket >= 0) {
+            close(config->socket);
+        }
+        return NULL;
+    }
+    mqtt->event_cb = config->event_cb;
+    mqtt->event_arg = config->event_arg;
+
+    /* The context is only unpacked for this call: copy the PEM strings the client would refer to */
+    bool copied = true;
+    if (mqtt_cfg.broker.verification.certificate != NULL) {
+        mqtt->root_cert = strdup(quarklink->iotHubRootCert);
+        mqtt_cfg.broker.verification.certificate = mqtt->root_cert;
+        copied = copied && (mqtt->root_cert != NULL);
+    }
+    if (mqtt_cfg.credentials.authentication.certificate == quarklink->deviceCert) {
+        mqtt->device_cert = strdup(quarklink->deviceCert);
+        mqtt_cfg.credentials.authentication.certificate = mqtt->device_cert;
+        copied = copied && (mqtt->device_cert != NULL);
+    }
+    /* Connect to the address resolved beforehand: the endpoint is still the server name (SNI) and checked
+     * against the broker certificate. esp_mqtt does not expose the TLS session of its connection, so
+     * config->session is left empty (PLATFORM_MQTT_TLS_SESSION is 0) and every connection is a full handshake. */
+    char address[INET_ADDRSTRLEN];
+    if (config->address != 0) {
+        struct in_addr in = { .s_addr = config->address };
+        inet_ntoa_r(in, address, sizeof(address));
+        mqtt->common_name = strdup(quarklink->iotHubEndpoint);
+        mqtt_cfg.broker.address.hostname = address;
+        mqtt_cfg.broker.verification.common_name = mqtt->common_name;
+        copied = copied && (mqtt->common_name != NULL);
+    }
+    if (!copied) {
+        if (config->socket >= 0) {
+            close(config->socket);
+        }
+        mqtt_free(mqtt);
+        return NULL;
+    }
+    /* Start the TLS handshake on the connection of the broker race rather than connecting again. The transport
+     * belongs to the client from esp_mqtt_client_init() on, which destroys it even if it fails. */
+    if (config->socket >= 0) {
+        mqtt_cfg.network.transport = mqtt_transport_create(&mqtt_cfg, config->socket);
+        if (mqtt_cfg.network.transport == NULL) {
+            ESP_LOGW(TAG, "Failed to take over the broker connection, connecting again");
+            close(config->socket);
+        }
+    }
+
+    mqtt->client = esp_mqtt_client_init(&mqtt_cfg);
+    if (mqtt->client == NULL) {
+        mqtt_free(mqtt);
+        return NULL;
+    }
+    esp_mqtt_client_register_event(mqtt->client, ESP_EVENT_ANY_ID, mqtt_event_handler, mqtt);
+    /* The connect messages are stored in the client outbox, which sends them as soon as the CONNACK arrives. esp-tls
+     * exposes neither the TLS session nor mbedtls early data, so the device never sets config->early_data
+     * (DUTY_CYCLE_EARLY_DATA is 0, see app.h): the CONNECT always waits for the handshake. */
+    for (size_t i = 0; i < config->connect_message_count; i++) {
+        const platform_mqtt_message_t *message = &config->connect_messages[i];
+        if (esp_mqtt_client_enqueue(mqtt->client, message->topic, message->data, message->len, message->qos, 0, true) < 0) {
+            ESP_LOGW(TAG, "Failed to queue a message to %s", message->topic);
+        }
+    }
+    if (esp_mqtt_client_start(mqtt->client) != ESP_OK) {
+        esp_mqtt_client_destroy(mqtt->client);
+        mqtt_free(mqtt);
+        return NULL;
+    }
+    metrics_watch_task(xTaskGetHandle("mqtt_task"), "mqtt");
+    return mqtt;
+}
+
+void platform_mqtt_stop(platform_mqtt_t *mqtt) {
+    if (mqtt == NULL) {
+        return;
+    }
+    esp_mqtt_client_stop(mqtt->client);
+    esp_mqtt_client_destroy(mqtt->client);
+    // The task is deleted with the client, connected or not: its handle must not keep the arena
+    tls_pool_arena_release(mqtt->task);
+    mqtt_free(mqtt);
+}
+
+int platform_mqtt_publish(platform_mqtt_t *mqtt, const char *topic, const char *data, int len, int qos, int retain) {
+    if (mqtt == NULL) {
+        return -1;
+    }
+    return esp_mqtt_client_publish(mqtt->client, topic, data, len, qos, retain);
+}
+
+int platform_mqtt_subscribe(platform_mqtt_t *mqtt, const char *topic, int qos) {
+    if (mqtt == NULL) {
+        return -1;
+    }
+    return esp_mqtt_client_subscribe(mqtt->client, topic, qos);
+}
+
+/**
+ * Miscellaneous
+ */
+
+#if (LED_COLOUR)
+// LED Strip object handle
+static led_strip_handle_t led_strip;
+
+static void set_led(void) {
+
+    // LED strip general initialization, according to your led board design
+    led_strip_config_t strip_config = {
+        .strip_gpio_num = LED_STRIP_BLINK_GPIO,   // The GPIO that connected to the LED strip's data line
+        .max_leds = LED_STRIP_LED_NUMBERS,        // The number of LEDs in the strip,
+        .led_pixel_format = LED_PIXEL_FORMAT_GRB, // Pixel format of your LED strip
+        .led_model = LED_MODEL_WS2812,            // LED strip model
+        .flags.invert_out = false,                // whether to invert the output signal
+    };
+
+    // LED strip backend configuration: RMT
+    led_strip_rmt_config_t rmt_config = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,        // different clock source can lead to different power consumption
+        .resolution_hz = LED_STRIP_RMT_RES_HZ, // RMT counter clock frequency
+        .flags.with_dma = false,               // DMA feature is available on ESP target like ESP32-S3
+    };
+    led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip);
+}
+
+/* Queue the frame without waiting for the RMT, unchanged pixels are not sent again */
+static void led_refresh(void) {
+    if (led_strip_refresh_async(led_strip, NULL, NULL) == ESP_ERR_INVALID_STATE) {
+        // every frame slot is in flight
+        led_strip_refresh(led_strip);
+    }
+}
+#endif
+
+void platform_led_write(uint8_t red, uint8_t green, uint8_t blue) {
+#if (LED_COLOUR)
+    if (led_strip == NULL) {
+        set_led(); // esp32-c3 and esp32-s3 RGB LED
+    }
+    led_strip_set_pixel(led_strip, 0, red, green, blue);
+    led_refresh();
+#endif
+}
+
+int32_t platform_sample(void) {
+    // Installed for each reading: the duty-cycle mode takes one per wake
+    temperature_sensor_config_t config = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    temperature_sensor_handle_t sensor = NULL;
+    float celsius = 0;
+    if (temperature_sensor_install(&config, &sensor) != ESP_OK) {
+        return INT32_MIN;
+    }
+    esp_err_t ret = temperature_sensor_enable(sensor);
+    if (ret == ESP_OK) {
+        ret = temperature_sensor_get_celsius(sensor, &celsius);
+        temperature_sensor_disable(sensor);
+    }
+    temperature_sensor_uninstall(sensor);
+    return ret == ESP_OK ? (int32_t)(celsius * 10) : INT32_MIN;
+}
+
+void platform_log_stats(void) {
+    tls_pool_stats_t pool_stats;
+    tls_pool_get_stats(&pool_stats);
+    #if CONFIG_QUARKLINK_TLS_POOL
+    ESP_LOGI(TAG, "TLS pool: in use %u, peak %u of %d, bound %lu, resets %lu, fallbacks %lu, heap fragmentation %lu%%",
+             pool_stats.in_use, pool_stats.peak, TLS_POOL_ARENA_SIZE, pool_stats.bound, pool_stats.resets,
+             pool_stats.fallbacks, pool_stats.heap_fragmentation);
+    #else
+    ESP_LOGI(TAG, "Heap fragmentation %lu%%", pool_stats.heap_fragmentation);
+    #endif
+    #if CONFIG_QUARKLINK_CERT_COMPRESSION
+    mbedtls_ssl_cert_compression_stats_t compression_stats;
+    mbedtls_ssl_cert_compression_get_stats(&compression_stats);
+    ESP_LOGI(TAG, "Certificate compression: messages %lu, %lu bytes for %lu, failures %lu",
+             compression_stats.messages, compression_stats.compressed_bytes,
+             compression_stats.uncompressed_bytes, compression_stats.failures);
+    #endif
+}
+
+#if CONFIG_ESP_TLS_USE_DS_PERIPHERAL
+/*
+ * DS signing time. esp_ds_rsa_sign is reached through esp-tls, so the call is
+ * intercepted at link time with -Wl,--wrap=esp_ds_rsa_sign (see platformio.ini).
+ */
+int __real_esp_ds_rsa_sign(void *ctx, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng,
+                           mbedtls_md_type_t md_alg, unsigned int hashlen, const unsigned char *hash, unsigned char *sig);
+
+int __wrap_esp_ds_rsa_sign(void *ctx, int (*f_rng)(void *, unsigned char *, size_t), void *p_rng,
+                           mbedtls_md_type_t md_alg, unsigned int hashlen, const unsigned char *hash, unsigned char *sig) {
+    int64_t start = metrics_now_us();
+    int ret = __real_esp_ds_rsa_sign(ctx, f_rng, p_rng, md_alg, hashlen, hash, sig);
+    metrics_record_since(METRICS_H_DS_SIGN, start);
+    return ret;
+}
+#endif
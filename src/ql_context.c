@@ -0,0 +1,578 @@
+/**
+ * \file ql_context.c
+ * \brief Compact, variable-length representation of the QuarkLink context.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "ql_context.h"
+
+static const char *TAG = "ql_context";
+
+#define PEM_BEGIN_CRT   "-----BEGIN CERTIFICATE-----\n"
+#define PEM_END_CRT     "-----END CERTIFICATE-----\n"
+#define PEM_LINE_LENGTH (64)
+
+#define FIELD_BIT(field)    ((uint16_t)(1u << (field)))
+
+static const char s_base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static bool is_certificate(ql_context_field_t field) {
+    return field == QL_CONTEXT_ROOT_CERT || field == QL_CONTEXT_DEVICE_CERT || field == QL_CONTEXT_IOT_HUB_ROOT_CERT;
+}
+
+/* Text of a field in the full context, "" for a NULL pointer field */
+static const char *field_text(const quarklink_context_t *quarklink, ql_context_field_t field, bool *is_null) {
+    const char *text = NULL;
+    *is_null = false;
+    switch (field) {
+    case QL_CONTEXT_ROOT_CERT:
+        return quarklink->rootCert;
+    case QL_CONTEXT_ENDPOINT:
+        return quarklink->endpoint;
+    case QL_CONTEXT_DEVICE_ID:
+        return quarklink->deviceID;
+    case QL_CONTEXT_DEVICE_CERT:
+        return quarklink->deviceCert;
+    case QL_CONTEXT_IOT_HUB_ROOT_CERT:
+        return quarklink->iotHubRootCert;
+    case QL_CONTEXT_IOT_HUB_ENDPOINT:
+        return quarklink->iotHubEndpoint;
+    case QL_CONTEXT_SCOPE_ID:
+        text = quarklink->scopeID;
+        break;
+    case QL_CONTEXT_FW_UPDATE_TOPIC:
+    default:
+        text = quarklink->fwUpdateTopic;
+        break;
+    }
+    *is_null = (text == NULL);
+    return text != NULL ? text : "";
+}
+
+/* Where a fixed-size field is unpacked, NULL for the pointer fields */
+static char *field_buffer(quarklink_context_t *quarklink, ql_context_field_t field, size_t *size) {
+    switch (field) {
+    case QL_CONTEXT_ROOT_CERT:
+        *size = sizeof(quarklink->rootCert);
+        return quarklink->rootCert;
+    case QL_CONTEXT_ENDPOINT:
+        *size = sizeof(quarklink->endpoint);
+        return quarklink->endpoint;
+    case QL_CONTEXT_DEVICE_ID:
+        *size = sizeof(quarklink->deviceID);
+        return quarklink->deviceID;
+    case QL_CONTEXT_DEVICE_CERT:
+        *size = sizeof(quarklink->deviceCert);
+        return quarklink->deviceCert;
+    case QL_CONTEXT_IOT_HUB_ROOT_CERT:
+        *size = sizeof(quarklink->iotHubRootCert);
+        return quarklink->iotHubRootCert;
+    case QL_CONTEXT_IOT_HUB_ENDPOINT:
+        *size = sizeof(quarklink->iotHubEndpoint);
+        return quarklink->iotHubEndpoint;
+    default:
+        *size = 0;
+        return NULL;
+    }
+}
+
+/**
+ * PEM <-> DER
+ */
+
+static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+/* Decode base64, skipping the line endings. Returns the decoded length or -1. */
+static int base64_decode(const char *text, size_t text_len, uint8_t *out) {
+    uint32_t bits = 0;
+    int bit_count = 0;
+    int pad = 0;
+    size_t out_len = 0;
+    for (size_t i = 0; i < text_len; i++) {
+        char c = text[i];
+        if (c == '\n' || c == '\r') {
+            continue;
+        }
+        if (c == '=') {
+            pad++;
+            continue;
+        }
+        int value = base64_value(c);
+        if (value < 0 || pad > 0) {
+            return -1;
+        }
+        bits = (bits << 6) | (uint32_t)value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            out[out_len++] = (uint8_t)(bits >> bit_count);
+        }
+    }
+    return pad > 2 ? -1 : (int)out_len;
+}
+
+/* Length of the base64 of `len` bytes, with a line ending every PEM_LINE_LENGTH characters */
+static size_t base64_pem_length(size_t len) {
+    size_t chars = 4 * ((len + 2) / 3);
+    return chars + (chars + PEM_LINE_LENGTH - 1) / PEM_LINE_LENGTH;
+}
+
+static size_t base64_pem_encode(const uint8_t *data, size_t len, char *out) {
+    size_t out_len = 0;
+    size_t line = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t triple = (uint32_t)data[i] << 16;
+        if (i + 1 < len) {
+            triple |= (uint32_t)data[i + 1] << 8;
+        }
+        if (i + 2 < len) {
+            triple |= data[i + 2];
+        }
+        out[out_len++] = s_base64[(triple >> 18) & 0x3F];
+        out[out_len++] = s_base64[(triple >> 12) & 0x3F];
+        out[out_len++] = (i + 1 < len) ? s_base64[(triple >> 6) & 0x3F] : '=';
+        out[out_len++] = (i + 2 < len) ? s_base64[triple & 0x3F] : '=';
+        line += 4;
+        if (line == PEM_LINE_LENGTH) {
+            out[out_len++] = '\n';
+            line = 0;
+        }
+    }
+    if (line != 0) {
+        out[out_len++] = '\n';
+    }
+    return out_len;
+}
+
+/* Length of the DER SEQUENCE at the start of `der`, 0 if it is not one */
+static size_t der_sequence_length(const uint8_t *der, size_t len) {
+    if (len < 2 || der[0] != 0x30) {
+        return 0;
+    }
+    size_t content = der[1];
+    size_t header = 2;
+    if (content & 0x80) {
+        size_t count = content & 0x7F;
+        if (count == 0 || count > 3 || len < 2 + count) {
+            return 0;
+        }
+        content = 0;
+        for (size_t i = 0; i < count; i++) {
+            content = (content << 8) | der[2 + i];
+        }
+        header += count;
+    }
+    return (header + content <= len) ? header + content : 0;
+}
+
+/* Length of the PEM text of a DER chain, 0 if it is not one */
+static size_t der_pem_length(const uint8_t *der, size_t len) {
+    size_t pem_len = 0;
+    while (len > 0) {
+        size_t crt_len = der_sequence_length(der, len);
+        if (crt_len == 0) {
+            return 0;
+        }
+        pem_len += strlen(PEM_BEGIN_CRT) + base64_pem_length(crt_len) + strlen(PEM_END_CRT);
+        der += crt_len;
+        len -= crt_len;
+    }
+    return pem_len;
+}
+
+/* Write the PEM text of a DER chain, of the length given by der_pem_length() */
+static void der_to_pem(const uint8_t *der, size_t len, char *pem) {
+    while (len > 0) {
+        size_t crt_len = der_sequence_length(der, len);
+        memcpy(pem, PEM_BEGIN_CRT, strlen(PEM_BEGIN_CRT));
+        pem += strlen(PEM_BEGIN_CRT);
+        pem += base64_pem_encode(der, crt_len, pem);
+        memcpy(pem, PEM_END_CRT, strlen(PEM_END_CRT));
+        pem += strlen(PEM_END_CRT);
+        der += crt_len;
+        len -= crt_len;
+    }
+}
+
+/*
+ * Convert PEM text to the concatenated DER of its certificates. Returns the DER length, or -1 if the
+ * text cannot be rebuilt from the DER exactly.
+ */
+static int pem_to_der(const char *pem, size_t pem_len, uint8_t *der) {
+    const char *pos = pem;
+    const char *end = pem + pem_len;
+    size_t der_len = 0;
+    if (pem_len == 0) {
+        return -1;
+    }
+    while (pos < end) {
+        if ((size_t)(end - pos) < strlen(PEM_BEGIN_CRT) || memcmp(pos, PEM_BEGIN_CRT, strlen(PEM_BEGIN_CRT)) != 0) {
+            return -1;
+        }
+        pos += strlen(PEM_BEGIN_CRT);
+        const char *crt_end = strstr(pos, PEM_END_CRT);
+        if (crt_end == NULL || crt_end >= end) {
+            return -1;
+        }
+        int crt_len = base64_decode(pos, crt_end - pos, der + der_len);
+        if (crt_len <= 0 || der_sequence_length(der + der_len, crt_len) != (size_t)crt_len) {
+            return -1;
+        }
+        der_len += crt_len;
+        pos = crt_end + strlen(PEM_END_CRT);
+    }
+    // Only keep the DER if it gives back the same text
+    if (der_pem_length(der, der_len) != pem_len) {
+        return -1;
+    }
+    char *check = malloc(pem_len);
+    if (check == NULL) {
+        return -1;
+    }
+    der_to_pem(der, der_len, check);
+    bool same = memcmp(check, pem, pem_len) == 0;
+    free(check);
+    return same ? (int)der_len : -1;
+}
+
+/**
+ * Packing
+ */
+
+int ql_context_pack(ql_context_t *context, const quarklink_context_t *quarklink) {
+    if (context == NULL || quarklink == NULL) {
+        return -1;
+    }
+    // DER is shorter than its PEM: the text lengths bound the arena, shrunk once filled
+    size_t lengths[QL_CONTEXT_FIELD_COUNT];
+    size_t bound = 0;
+    for (int field = 0; field < QL_CONTEXT_FIELD_COUNT; field++) {
+        bool is_null;
+        lengths[field] = strlen(field_text(quarklink, field, &is_null));
+        bound += lengths[field] + 1;
+    }
+    uint8_t *arena = malloc(bound);
+    if (arena == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes", (unsigned)bound);
+        return -1;
+    }
+
+    ql_context_t packed = {
+        .port = quarklink->port,
+        .iot_hub_port = quarklink->iotHubPort,
+        .temp_cert = quarklink->tempCert,
+    };
+    size_t used = 0;
+    for (int field = 0; field < QL_CONTEXT_FIELD_COUNT; field++) {
+        bool is_null;
+        const char *text = field_text(quarklink, field, &is_null);
+        size_t length = lengths[field];
+        if (is_null) {
+            packed.null_mask |= FIELD_BIT(field);
+        }
+        packed.spans[field].offset = (uint16_t)used;
+        if (is_certificate(field) && length > 0) {
+            int der_len = pem_to_der(text, length, arena + used);
+            if (der_len > 0) {
+                packed.der_mask |= FIELD_BIT(field);
+                packed.spans[field].length = (uint16_t)der_len;
+                used += der_len;
+                continue;
+            }
+            ESP_LOGD(TAG, "Field %d kept as text", field);
+        }
+        memcpy(arena + used, text, length + 1);
+        packed.spans[field].length = (uint16_t)length;
+        used += length + 1;
+    }
+
+    packed.arena_size = used;
+    // An unchanged context keeps its arena, packing after every QuarkLink call does not churn the heap
+    if (context->arena != NULL && context->arena_size == used && memcmp(context->arena, arena, used) == 0) {
+        free(arena);
+        packed.arena = context->arena;
+        *context = packed;
+        return 0;
+    }
+    uint8_t *shrunk = realloc(arena, used);
+    packed.arena = (shrunk != NULL) ? shrunk : arena;
+
+    free(context->arena);
+    *context = packed;
+    return 0;
+}
+
+int ql_context_unpack(const ql_context_t *context, quarklink_context_t *quarklink) {
+    if (context == NULL || quarklink == NULL || context->arena == NULL) {
+        return -1;
+    }
+    memset(quarklink, 0, sizeof(quarklink_context_t));
+    quarklink->port = context->port;
+    quarklink->iotHubPort = context->iot_hub_port;
+    quarklink->tempCert = context->temp_cert;
+    for (int field = 0; field < QL_CONTEXT_FIELD_COUNT; field++) {
+        const ql_context_span_t *span = &context->spans[field];
+        uint8_t *value = context->arena + span->offset;
+        size_t size;
+        char *buffer = field_buffer(quarklink, field, &size);
+        int ret = 0;
+        if (buffer == NULL) {
+            // The library frees or reallocates these: they get copies of their own
+            ret = ql_context_set_string(quarklink, field,
+                                        (context->null_mask & FIELD_BIT(field)) ? NULL : (const char *)value);
+        }
+        else if (context->der_mask & FIELD_BIT(field)) {
+            size_t pem_len = der_pem_length(value, span->length);
+            if (pem_len == 0 || pem_len >= size) {
+                ret = -1;
+            }
+            else {
+                der_to_pem(value, span->length, buffer);
+                buffer[pem_len] = '\0';
+            }
+        }
+        else if (span->length >= size) {
+            ret = -1;
+        }
+        else {
+            memcpy(buffer, value, span->length + 1);
+        }
+        if (ret != 0) {
+            ql_context_release(quarklink);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+quarklink_context_t *ql_context_expand(const ql_context_t *context) {
+    quarklink_context_t *quarklink = malloc(sizeof(quarklink_context_t));
+    if (quarklink != NULL && ql_context_unpack(context, quarklink) != 0) {
+        free(quarklink);
+        quarklink = NULL;
+    }
+    return quarklink;
+}
+
+int ql_context_set_string(quarklink_context_t *quarklink, ql_context_field_t field, const char *value) {
+    if (quarklink == NULL || (field != QL_CONTEXT_SCOPE_ID && field != QL_CONTEXT_FW_UPDATE_TOPIC)) {
+        return -1;
+    }
+    char *copy = NULL;
+    if (value != NULL && (copy = strdup(value)) == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate field %d", field);
+        return -1;
+    }
+    char **string = (field == QL_CONTEXT_SCOPE_ID) ? &quarklink->scopeID : &quarklink->fwUpdateTopic;
+    free(*string);
+    *string = copy;
+    return 0;
+}
+
+void ql_context_release(quarklink_context_t *quarklink) {
+    if (quarklink != NULL) {
+        free(quarklink->scopeID);
+        free(quarklink->fwUpdateTopic);
+        quarklink->scopeID = NULL;
+        quarklink->fwUpdateTopic = NULL;
+    }
+}
+
+int ql_context_copy(ql_context_t *dest, const ql_context_t *src) {
+    if (dest == NULL || src == NULL || src->arena == NULL) {
+        return -1;
+    }
+    uint8_t *arena = malloc(src->arena_size);
+    if (arena == NULL) {
+        return -1;
+    }
+    memcpy(arena, src->arena, src->arena_size);
+    free(dest->arena);
+    *dest = *src;
+    dest->arena = arena;
+    return 0;
+}
+
+/* Header of a saved context, followed by the arena */
+typedef struct {
+    uint16_t arena_size;
+    uint16_t der_mask;
+    uint16_t null_mask;
+    uint16_t port;
+    uint16_t iot_hub_port;
+    ql_context_span_t spans[QL_CONTEXT_FIELD_COUNT];
+} saved_context_t;
+
+int ql_context_save(const ql_context_t *context, uint8_t *buffer, size_t size) {
+    if (context == NULL || buffer == NULL || context->arena == NULL ||
+        sizeof(saved_context_t) + context->arena_size > size) {
+        return -1;
+    }
+    saved_context_t header = {
+        .arena_size = (uint16_t)context->arena_size,
+        .der_mask = context->der_mask,
+        .null_mask = context->null_mask,
+        .port = context->port,
+        .iot_hub_port = context->iot_hub_port,
+    };
+    memcpy(header.spans, context->spans, sizeof(header.spans));
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), context->arena, context->arena_size);
+    return (int)(sizeof(header) + context->arena_size);
+}
+
+int ql_context_restore(ql_context_t *context, const uint8_t *buffer, size_t length) {
+    saved_context_t header;
+    if (context == NULL || buffer == NULL || length < sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, buffer, sizeof(header));
+    if (header.arena_size == 0 || sizeof(header) + header.arena_size != length) {
+        return -1;
+    }
+    for (int field = 0; field < QL_CONTEXT_FIELD_COUNT; field++) {
+        // Strings are followed by their terminator
+        size_t end = header.spans[field].offset + header.spans[field].length +
+                     ((header.der_mask & FIELD_BIT(field)) ? 0 : 1);
+        if (end > header.arena_size) {
+            return -1;
+        }
+    }
+    uint8_t *arena = malloc(header.arena_size);
+    if (arena == NULL) {
+        return -1;
+    }
+    memcpy(arena, buffer + sizeof(header), header.arena_size);
+    free(context->arena);
+    *context = (ql_context_t) {
+        .arena = arena,
+        .arena_size = header.arena_size,
+        .der_mask = header.der_mask,
+        .null_mask = header.null_mask,
+        .port = header.port,
+        .iot_hub_port = header.iot_hub_port,
+    };
+    memcpy(context->spans, header.spans, sizeof(context->spans));
+    return 0;
+}
+
+void ql_context_free(ql_context_t *context) {
+    if (context != NULL) {
+        free(context->arena);
+        memset(context, 0, sizeof(ql_context_t));
+    }
+}
+
+/**
+ * Accessors
+ */
+
+const char *ql_context_string(const ql_context_t *context, ql_context_field_t field) {
+    if (context == NULL || context->arena == NULL || field >= QL_CONTEXT_FIELD_COUNT ||
+        (context->der_mask & FIELD_BIT(field))) {
+        return "";
+    }
+    return (const char *)context->arena + context->spans[field].offset;
+}
+
+const uint8_t *ql_context_der(const ql_context_t *context, ql_context_field_t field, size_t *length) {
+    if (context == NULL || context->arena == NULL || field >= QL_CONTEXT_FIELD_COUNT ||
+        !(context->der_mask & FIELD_BIT(field))) {
+        return NULL;
+    }
+    if (length != NULL) {
+        *length = context->spans[field].length;
+    }
+    return context->arena + context->spans[field].offset;
+}
+
+quarklink_return_t ql_context_get(const ql_context_t *context, ql_context_field_t field, char *buffer, int length) {
+    if (context == NULL || buffer == NULL || length <= 0 || field >= QL_CONTEXT_FIELD_COUNT) {
+        return QUARKLINK_INVALID_PARAMETER;
+    }
+    if (context->arena == NULL || context->spans[field].length == 0) {
+        return QUARKLINK_VALUE_NOT_AVAILABLE;
+    }
+    const ql_context_span_t *span = &context->spans[field];
+    const uint8_t *value = context->arena + span->offset;
+    if (context->der_mask & FIELD_BIT(field)) {
+        size_t pem_len = der_pem_length(value, span->length);
+        if (pem_len == 0 || pem_len >= (size_t)length) {
+            return QUARKLINK_INVALID_PARAMETER;
+        }
+        der_to_pem(value, span->length, buffer);
+        buffer[pem_len] = '\0';
+    }
+    else {
+        if (span->length >= (size_t)length) {
+            return QUARKLINK_INVALID_PARAMETER;
+        }
+        memcpy(buffer, value, span->length + 1);
+    }
+    return QUARKLINK_SUCCESS;
+}
+
+quarklink_return_t ql_context_getDeviceID(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_DEVICE_ID, buffer, length);
+}
+
+quarklink_return_t ql_context_getDeviceCert(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_DEVICE_CERT, buffer, length);
+}
+
+quarklink_return_t ql_context_getRootCert(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_ROOT_CERT, buffer, length);
+}
+
+quarklink_return_t ql_context_getEndpoint(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_ENDPOINT, buffer, length);
+}
+
+quarklink_return_t ql_context_getIoTHubCert(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_IOT_HUB_ROOT_CERT, buffer, length);
+}
+
+quarklink_return_t ql_context_getIoTHubEndpoint(const ql_context_t *context, char *buffer, int length) {
+    return ql_context_get(context, QL_CONTEXT_IOT_HUB_ENDPOINT, buffer, length);
+}
+
+quarklink_return_t ql_context_getPort(const ql_context_t *context, uint16_t *port) {
+    if (context == NULL || port == NULL) {
+        return QUARKLINK_INVALID_PARAMETER;
+    }
+    if (context->port == 0) {
+        return QUARKLINK_VALUE_NOT_AVAILABLE;
+    }
+    *port = context->port;
+    return QUARKLINK_SUCCESS;
+}
+
+quarklink_return_t ql_context_getIoTHubPort(const ql_context_t *context, uint16_t *port) {
+    if (context == NULL || port == NULL) {
+        return QUARKLINK_INVALID_PARAMETER;
+    }
+    if (context->iot_hub_port == 0) {
+        return QUARKLINK_VALUE_NOT_AVAILABLE;
+    }
+    *port = context->iot_hub_port;
+    return QUARKLINK_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/**
+ * \file ql_context.h
+ * \brief Compact, variable-length representation of the QuarkLink context.
+ *
+ * quarklink_context_t is a fixed ~6.4 KB structure whose certificate buffers are mostly empty and hold
+ * PEM text. \ref ql_context_t keeps the same fields in one heap arena sized to the actual content:
+ * the certificates as DER (concatenated for a chain), the strings with their terminator, each field
+ * referenced by an offset and a length.
+ *
+ * A certificate is only kept as DER if encoding it back gives the exact same PEM text (64 characters
+ * per line, LF line endings), otherwise its text is kept as is: \ref ql_context_unpack always gives back
+ * the context that was packed.
+ *
+ * The QuarkLink client library only takes a quarklink_context_t: it is unpacked in a temporary buffer
+ * around every call, and packed again after the calls that update it (e.g. quarklink_enrol()). This
+ * relies on the library not keeping pointers to the context between calls.
+ *
+ * The scope ID and the firmware update topic are pointers in quarklink_context_t, NULL or heap strings
+ * owned by the context: the library frees or reallocates them when it updates them. An unpacked context
+ * holds copies of its own, released with \ref ql_context_release before the context is freed.
+ */
+#ifndef _QL_CONTEXT_H_
+#define _QL_CONTEXT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "quarklink.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef enum {
+    QL_CONTEXT_ROOT_CERT = 0,
+    QL_CONTEXT_ENDPOINT,
+    QL_CONTEXT_DEVICE_ID,
+    QL_CONTEXT_DEVICE_CERT,
+    QL_CONTEXT_IOT_HUB_ROOT_CERT,
+    QL_CONTEXT_IOT_HUB_ENDPOINT,
+    QL_CONTEXT_SCOPE_ID,
+    QL_CONTEXT_FW_UPDATE_TOPIC,
+    QL_CONTEXT_FIELD_COUNT
+} ql_context_field_t;
+
+/**
+ * \brief Location of a field in the arena
+ */
+typedef struct {
+    uint16_t offset;
+    /** Length of the value: DER bytes, or string length without the terminator */
+    uint16_t length;
+} ql_context_span_t;
+
+/**
+ * \brief A packed QuarkLink context
+ */
+typedef struct {
+    /** The fields, NULL until packed */
+    uint8_t *arena;
+    size_t arena_size;
+    ql_context_span_t spans[QL_CONTEXT_FIELD_COUNT];
+    /** Certificate fields stored as DER, one bit per \ref ql_context_field_t */
+    uint16_t der_mask;
+    /** Pointer fields (scope ID, firmware update topic) that were NULL */
+    uint16_t null_mask;
+    uint16_t port;
+    uint16_t iot_hub_port;
+    /** Owned by the QuarkLink client, kept as is */
+    char *temp_cert;
+} ql_context_t;
+
+/**
+ * \brief Pack a QuarkLink context. The previous arena is only released once the new one is built,
+ * so \p quarklink may have been unpacked from \p context.
+ * \param[in,out] context   the packed context, zero-initialised before the first call
+ * \param[in]     quarklink the context to pack
+ * \return 0 for success, -1 for failure (\p context is then left unchanged)
+ */
+int ql_context_pack(ql_context_t *context, const quarklink_context_t *quarklink);
+
+/**
+ * \brief Unpack into a full QuarkLink context, to pass it to the QuarkLink API.
+ * scopeID and fwUpdateTopic are heap copies, to release with \ref ql_context_release.
+ * \param[in]  context   the packed context
+ * \param[out] quarklink the context to fill, its previous strings are not released
+ * \return 0 for success, -1 if \p context was never packed or a string cannot be allocated
+ */
+int ql_context_unpack(const ql_context_t *context, quarklink_context_t *quarklink);
+
+/**
+ * \brief Unpack into a newly allocated QuarkLink context.
+ * \return the context, to release with \ref ql_context_release then free(), or NULL for failure
+ */
+quarklink_context_t *ql_context_expand(const ql_context_t *context);
+
+/**
+ * \brief Replace a pointer field (scope ID, firmware update topic) of a full context with a heap copy,
+ * as the QuarkLink client does. The previous value is freed.
+ * \param[in] value the new value, NULL for none
+ * \return 0 for success, -1 if \p field is not a pointer field or the copy cannot be allocated
+ * (the field is then left unchanged)
+ */
+int ql_context_set_string(quarklink_context_t *quarklink, ql_context_field_t field, const char *value);
+
+/**
+ * \brief Free the scope ID and the firmware update topic of a full context, before the context itself.
+ * NULL is ignored.
+ */
+void ql_context_release(quarklink_context_t *quarklink);
+
+/**
+ * \brief Copy a packed context: only the arena is duplicated.
+ * \return 0 for success, -1 for failure
+ */
+int ql_context_copy(ql_context_t *dest, const ql_context_t *src);
+
+/**
+ * \brief Save a packed context in a flat buffer, e.g. memory kept across deep sleep. temp_cert is
+ * not saved: it belongs to the QuarkLink client of the current boot.
+ * \param[out] buffer the buffer
+ * \param[in]  size   the size of the buffer
+ * \return the number of bytes written, -1 if the context was never packed or does not fit
+ */
+int ql_context_save(const ql_context_t *context, uint8_t *buffer, size_t size);
+
+/**
+ * \brief Restore a context saved with \ref ql_context_save in a new arena.
+ * \param[in,out] context the packed context, zero-initialised or packed before
+ * \param[in]     buffer  the saved context
+ * \param[in]     length  the length returned by \ref ql_context_save
+ * \return 0 for success, -1 if the saved context is invalid or the arena cannot be allocated
+ * (\p context is then left unchanged)
+ */
+int ql_context_restore(ql_context_t *context, const uint8_t *buffer, size_t length);
+
+/**
+ * \brief Release the arena of a packed context.
+ */
+void ql_context_free(ql_context_t *context);
+
+/**
+ * \brief Get a string field (endpoint, device ID, IoT Hub endpoint, scope ID, firmware update topic).
+ * \return the NULL-terminated string, "" if the field is empty or not a string
+ */
+const char *ql_context_string(const ql_context_t *context, ql_context_field_t field);
+
+/**
+ * \brief Get the DER of a certificate field.
+ * \param[out] length the length of the DER, the concatenated certificates for a chain
+ * \return the DER, or NULL if the field is empty or kept as PEM text
+ */
+const uint8_t *ql_context_der(const ql_context_t *context, ql_context_field_t field, size_t *length);
+
+/**
+ * \brief Copy a field in the format quarklink_context_t holds it (PEM text for the certificates).
+ * Same semantics as the quarklink_get*() functions of the QuarkLink client.
+ * \param[out] buffer the buffer to copy the NULL-terminated value to
+ * \param[in]  length the size of the buffer
+ * \retval QUARKLINK_SUCCESS
+ * \retval QUARKLINK_INVALID_PARAMETER if a parameter is NULL or the buffer is too small
+ * \retval QUARKLINK_VALUE_NOT_AVAILABLE if the field is empty
+ */
+quarklink_return_t ql_context_get(const ql_context_t *context, ql_context_field_t field, char *buffer, int length);
+
+/** \brief Packed counterpart of quarklink_getDeviceID() */
+quarklink_return_t ql_context_getDeviceID(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getDeviceCert() */
+quarklink_return_t ql_context_getDeviceCert(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getRootCert() */
+quarklink_return_t ql_context_getRootCert(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getEndpoint() */
+quarklink_return_t ql_context_getEndpoint(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getPort() */
+quarklink_return_t ql_context_getPort(const ql_context_t *context, uint16_t *port);
+/** \brief Packed counterpart of quarklink_getIoTHubCert() */
+quarklink_return_t ql_context_getIoTHubCert(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getIoTHubEndpoint() */
+quarklink_return_t ql_context_getIoTHubEndpoint(const ql_context_t *context, char *buffer, int length);
+/** \brief Packed counterpart of quarklink_getIoTHubPort() */
+quarklink_return_t ql_context_getIoTHubPort(const ql_context_t *context, uint16_t *port);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _QL_CONTEXT_H_
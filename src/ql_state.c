@@ -0,0 +1,168 @@
+/**
+ * \file ql_state.c
+ * \brief Thread-safe QuarkLink state of a device, see ql_state.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+
+#include "ql_state.h"
+
+static const char *TAG = "ql_state";
+
+/* Called with the lock held */
+static void snapshot_put(ql_state_t *state, ql_snapshot_t *snapshot) {
+    if (--snapshot->refs == 0) {
+        ql_context_free(&snapshot->context);
+        free(snapshot);
+        state->stats.retired++;
+        state->stats.live--;
+    }
+}
+
+int ql_state_init(ql_state_t *state) {
+    if (state->lock != NULL) {
+        return 0;
+    }
+    state->lock = platform_mutex_create();
+    state->client_lock = platform_mutex_create();
+    if (state->lock == NULL || state->client_lock == NULL) {
+        ESP_LOGE(TAG, "Failed to create the locks");
+        ql_state_free(state);
+        return -1;
+    }
+    return 0;
+}
+
+void ql_state_free(ql_state_t *state) {
+    if (state->current != NULL) {
+        snapshot_put(state, state->current);
+        state->current = NULL;
+    }
+    platform_mutex_delete(state->lock);
+    platform_mutex_delete(state->client_lock);
+    memset(state, 0, sizeof(ql_state_t));
+}
+
+int ql_state_publish(ql_state_t *state, ql_context_t *context, quarklink_return_t status) {
+    // Built outside of the lock, readers only wait for the swap
+    ql_snapshot_t *snapshot = malloc(sizeof(ql_snapshot_t));
+    if (snapshot == NULL) {
+        return -1;
+    }
+    snapshot->context = *context;
+    snapshot->status = status;
+    snapshot->refs = 1;
+    memset(context, 0, sizeof(ql_context_t));
+
+    platform_mutex_lock(state->lock);
+    ql_snapshot_t *previous = state->current;
+    snapshot->generation = (previous != NULL) ? previous->generation + 1 : 1;
+    state->current = snapshot;
+    state->stats.published++;
+    if (++state->stats.live > state->stats.peak_live) {
+        state->stats.peak_live = state->stats.live;
+    }
+    if (previous != NULL) {
+        snapshot_put(state, previous);
+    }
+    platform_mutex_unlock(state->lock);
+    return 0;
+}
+
+const ql_snapshot_t *ql_state_acquire(ql_state_t *state) {
+    platform_mutex_lock(state->lock);
+    ql_snapshot_t *snapshot = state->current;
+    if (snapshot != NULL) {
+        snapshot->refs++;
+        state->stats.acquired++;
+    }
+    platform_mutex_unlock(state->lock);
+    return snapshot;
+}
+
+void ql_state_release(ql_state_t *state, const ql_snapshot_t *snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    platform_mutex_lock(state->lock);
+    snapshot_put(state, (ql_snapshot_t *)snapshot);
+    platform_mutex_unlock(state->lock);
+}
+
+quarklink_context_t *ql_state_begin(ql_state_t *state) {
+    platform_mutex_lock(state->client_lock);
+    // The snapshot the calls start from is held until ql_state_end()
+    state->client_snapshot = ql_state_acquire(state);
+    quarklink_context_t *quarklink = NULL;
+    if (state->client_snapshot != NULL) {
+        quarklink = ql_context_expand(&state->client_snapshot->context);
+    }
+    if (quarklink == NULL) {
+        ql_state_release(state, state->client_snapshot);
+        state->client_snapshot = NULL;
+        platform_mutex_unlock(state->client_lock);
+    }
+    return quarklink;
+}
+
+int ql_state_update(ql_state_t *state, const quarklink_context_t *quarklink, quarklink_return_t status) {
+    ql_context_t context = { 0 };
+    if (ql_context_pack(&context, quarklink) != 0) {
+        ESP_LOGW(TAG, "Failed to pack the QuarkLink context");
+        return -1;
+    }
+    if (ql_state_publish(state, &context, status) != 0) {
+        ESP_LOGW(TAG, "Failed to publish the QuarkLink context");
+        ql_context_free(&context);
+        return -1;
+    }
+    return 0;
+}
+
+int ql_state_end(ql_state_t *state, quarklink_context_t *quarklink, quarklink_return_t status) {
+    int ret = ql_state_update(state, quarklink, status);
+    ql_state_cancel(state, quarklink);
+    return ret;
+}
+
+void ql_state_cancel(ql_state_t *state, quarklink_context_t *quarklink) {
+    ql_context_release(quarklink);
+    free(quarklink);
+    ql_state_release(state, state->client_snapshot);
+    state->client_snapshot = NULL;
+    platform_mutex_unlock(state->client_lock);
+}
+
+quarklink_return_t ql_state_status(ql_state_t *state) {
+    const ql_snapshot_t *snapshot = ql_state_acquire(state);
+    quarklink_return_t status = (snapshot != NULL) ? snapshot->status : QUARKLINK_ERROR;
+    ql_state_release(state, snapshot);
+    return status;
+}
+
+bool ql_state_isDeviceEnrolled(ql_state_t *state) {
+    return ql_state_status(state) == QUARKLINK_STATUS_ENROLLED;
+}
+
+bool ql_state_isDeviceNotEnrolled(ql_state_t *state) {
+    return ql_state_status(state) == QUARKLINK_STATUS_NOT_ENROLLED;
+}
+
+bool ql_state_isDeviceRevoked(ql_state_t *state) {
+    return ql_state_status(state) == QUARKLINK_STATUS_REVOKED;
+}
+
+bool ql_state_isDeviceCertificateExpired(ql_state_t *state) {
+    return ql_state_status(state) == QUARKLINK_STATUS_CERTIFICATE_EXPIRED;
+}
+
+bool ql_state_isDeviceFwUpdateAvailable(ql_state_t *state) {
+    return ql_state_status(state) == QUARKLINK_STATUS_FWUPDATE_REQUIRED;
+}
+
+void ql_state_get_stats(ql_state_t *state, ql_state_stats_t *stats) {
+    platform_mutex_lock(state->lock);
+    *stats = state->stats;
+    platform_mutex_unlock(state->lock);
+}
@@ -0,0 +1,151 @@
+/**
+ * \file ql_state.h
+ * \brief Thread-safe QuarkLink state of a device: immutable, reference-counted snapshots of the packed
+ * context and of the status it was last checked with.
+ *
+ * Readers take the current snapshot with \ref ql_state_acquire and give it back with \ref ql_state_release;
+ * the snapshot does not change in between, whatever the writers do. A writer never modifies a snapshot:
+ * \ref ql_state_publish swaps in a new one and the previous one is released once its last reader is done
+ * with it. The lock is only held to swap the pointer and count the references, never across a QuarkLink call.
+ *
+ * The QuarkLink client library is not thread-safe and updates the context it is given (e.g. quarklink_enrol()):
+ * writers go through \ref ql_state_begin and \ref ql_state_end, which serialise them on a client lock and
+ * unpack the current snapshot for the calls. Its quarklink_isDevice*() predicates report the status of the
+ * last call of any thread: the ql_state_isDevice*() predicates report the status published with the snapshot.
+ */
+#ifndef _QL_STATE_H_
+#define _QL_STATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "platform.h"
+#include "ql_context.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * \brief A published state, read-only
+ */
+typedef struct {
+    ql_context_t context;
+    /** Status of the last check, QUARKLINK_ERROR until the first one */
+    quarklink_return_t status;
+    /** Incremented by every publish, 1 for the first snapshot */
+    uint32_t generation;
+    /** Readers, plus one while it is the current snapshot */
+    uint32_t refs;
+} ql_snapshot_t;
+
+/**
+ * \brief State statistics
+ */
+typedef struct {
+    uint32_t published;
+    uint32_t acquired;
+    /** Snapshots released after their last reader */
+    uint32_t retired;
+    /** Snapshots allocated: the current one and the older ones still read */
+    uint32_t live;
+    uint32_t peak_live;
+} ql_state_stats_t;
+
+typedef struct {
+    platform_mutex_t *lock;
+    /** Held by the writer calling the QuarkLink client */
+    platform_mutex_t *client_lock;
+    /** Snapshot unpacked by \ref ql_state_begin, held by the writer */
+    const ql_snapshot_t *client_snapshot;
+    ql_snapshot_t *current;
+    ql_state_stats_t stats;
+} ql_state_t;
+
+/**
+ * \brief Create the locks, nothing is published yet. Does nothing if already initialised.
+ * \param[in,out] state the state, zero-initialised before the first call
+ * \return 0 for success, -1 for failure
+ */
+int ql_state_init(ql_state_t *state);
+
+/**
+ * \brief Release the current snapshot and the locks. No reader or writer may be left.
+ */
+void ql_state_free(ql_state_t *state);
+
+/**
+ * \brief Publish a new snapshot. The arena of \p context is moved to it, \p context is cleared.
+ * \param[in,out] state   the state
+ * \param[in,out] context the packed context
+ * \param[in]     status  the status it was checked with
+ * \return 0 for success, -1 for failure (\p context is then left unchanged)
+ */
+int ql_state_publish(ql_state_t *state, ql_context_t *context, quarklink_return_t status);
+
+/**
+ * \brief Take a reference to the current snapshot.
+ * \return the snapshot, to give back with \ref ql_state_release, or NULL if nothing was published
+ */
+const ql_snapshot_t *ql_state_acquire(ql_state_t *state);
+
+/**
+ * \brief Give back a snapshot taken with \ref ql_state_acquire. NULL is ignored.
+ */
+void ql_state_release(ql_state_t *state, const ql_snapshot_t *snapshot);
+
+/**
+ * \brief Start calling the QuarkLink client: take the client lock and unpack the current snapshot.
+ * \return the context to pass to the QuarkLink API, or NULL for failure (the lock is then not held)
+ */
+quarklink_context_t *ql_state_begin(ql_state_t *state);
+
+/**
+ * \brief Publish the context updated by the QuarkLink calls, the client lock is kept.
+ * \param[in] quarklink the context returned by \ref ql_state_begin
+ * \param[in] status    the status of the check
+ * \return 0 for success, -1 if the context could not be packed (the previous snapshot stays current)
+ */
+int ql_state_update(ql_state_t *state, const quarklink_context_t *quarklink, quarklink_return_t status);
+
+/**
+ * \brief Publish the context updated by the QuarkLink calls, release the client lock and free \p quarklink
+ * with the strings the library left in it.
+ * \return the result of \ref ql_state_update
+ */
+int ql_state_end(ql_state_t *state, quarklink_context_t *quarklink, quarklink_return_t status);
+
+/**
+ * \brief Release the client lock and free \p quarklink without publishing, when the QuarkLink calls did not
+ * update the context.
+ */
+void ql_state_cancel(ql_state_t *state, quarklink_context_t *quarklink);
+
+/**
+ * \brief Status of the current snapshot.
+ * \return the status, QUARKLINK_ERROR if nothing was published or checked yet
+ */
+quarklink_return_t ql_state_status(ql_state_t *state);
+
+/** \brief Per-context counterpart of quarklink_isDeviceEnrolled() */
+bool ql_state_isDeviceEnrolled(ql_state_t *state);
+/** \brief Per-context counterpart of quarklink_isDeviceNotEnrolled() */
+bool ql_state_isDeviceNotEnrolled(ql_state_t *state);
+/** \brief Per-context counterpart of quarklink_isDeviceRevoked() */
+bool ql_state_isDeviceRevoked(ql_state_t *state);
+/** \brief Per-context counterpart of quarklink_isDeviceCertificateExpired() */
+bool ql_state_isDeviceCertificateExpired(ql_state_t *state);
+/** \brief Per-context counterpart of quarklink_isDeviceFwUpdateAvailable() */
+bool ql_state_isDeviceFwUpdateAvailable(ql_state_t *state);
+
+/**
+ * \brief Copy the statistics.
+ */
+void ql_state_get_stats(ql_state_t *state, ql_state_stats_t *stats);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _QL_STATE_H_
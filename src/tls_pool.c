@@ -0,0 +1,366 @@
+/**
+ * \file tls_pool.c
+ * \brief Pooled allocator for mbedtls: per-connection arenas with size-class free lists.
+ */
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "tls_pool.h"
+
+static const char *TAG = "tls_pool";
+
+#define BLOCK_MAGIC         (0x7A5C)
+#define BLOCK_ALIGN         (8)
+/** Smallest size class, header included */
+#define SMALL_CLASS_MIN     (16)
+/** Number of size classes: 16, 32, 64, 128, 256, 512 */
+#define SMALL_CLASSES       (6)
+#define SMALL_CLASS_MAX     (SMALL_CLASS_MIN << (SMALL_CLASSES - 1))
+
+#define HEAP_CAPS           (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+
+/* 100 * (1 - largest free block / free heap) */
+static void heap_fragmentation(tls_pool_stats_t *stats) {
+    size_t free_heap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    stats->heap_fragmentation = free_heap ? 100 - (uint32_t)((uint64_t)largest * 100 / free_heap) : 0;
+}
+
+#if (TLS_POOL)
+
+typedef struct {
+    /** Size of the block, header included */
+    uint32_t size;
+    uint16_t arena;
+    uint16_t magic;
+} block_header_t;
+
+_Static_assert(sizeof(block_header_t) == BLOCK_ALIGN, "block header must keep the payload aligned");
+
+typedef struct free_block {
+    block_header_t header;
+    struct free_block *next;
+} free_block_t;
+
+typedef struct {
+    uint8_t *base;
+    /** Bump pointer offset */
+    size_t offset;
+    /** Number of blocks allocated */
+    uint32_t live;
+    /** Bytes allocated, headers included */
+    size_t in_use;
+    size_t peak;
+    TaskHandle_t owner;
+    /** The owner allocates from the heap, see tls_pool_arena_suspend() */
+    bool suspended;
+    free_block_t *free_lists[SMALL_CLASSES];
+} tls_pool_arena_t;
+
+static tls_pool_arena_t s_arenas[TLS_POOL_ARENAS];
+static uint32_t s_resets = 0;
+static uint32_t s_fallbacks = 0;
+static uint32_t s_draining = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+int tls_pool_init(void) {
+    int ret = 0;
+    for (int i = 0; i < TLS_POOL_ARENAS; i++) {
+        if (s_arenas[i].base != NULL) {
+            continue;
+        }
+        s_arenas[i].base = heap_caps_aligned_alloc(BLOCK_ALIGN, TLS_POOL_ARENA_SIZE, HEAP_CAPS);
+        if (s_arenas[i].base == NULL) {
+            ESP_LOGW(TAG, "Failed to reserve arena %d", i);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int small_class(size_t size) {
+    int index = 0;
+    size_t class_size = SMALL_CLASS_MIN;
+    while (class_size < size) {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
+}
+
+/* Must be called with the lock held */
+static tls_pool_arena_t *arena_of_task(TaskHandle_t task) {
+    for (int i = 0; i < TLS_POOL_ARENAS; i++) {
+        if (s_arenas[i].owner == task && s_arenas[i].base != NULL) {
+            return &s_arenas[i];
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with the lock held */
+static tls_pool_arena_t *arena_of_current_task(void) {
+    return arena_of_task(xTaskGetCurrentTaskHandle());
+}
+
+/* Must be called with the lock held */
+static void arena_unbind(tls_pool_arena_t *arena) {
+    arena->owner = NULL;
+    arena->suspended = false;
+    if (arena->live != 0) {
+        s_draining++;
+    }
+}
+
+/* Must be called with the lock held */
+static void arena_release(tls_pool_arena_t *arena) {
+    arena->offset = 0;
+    arena->in_use = 0;
+    memset(arena->free_lists, 0, sizeof(arena->free_lists));
+    s_resets++;
+}
+
+/* Must be called with the lock held */
+static block_header_t *arena_alloc(tls_pool_arena_t *arena, size_t size) {
+    block_header_t *block = NULL;
+    int index = -1;
+
+    if (size <= SMALL_CLASS_MAX) {
+        index = small_class(size);
+        size = SMALL_CLASS_MIN << index;
+        if (arena->free_lists[index] != NULL) {
+            free_block_t *free_block = arena->free_lists[index];
+            arena->free_lists[index] = free_block->next;
+            block = &free_block->header;
+        }
+    }
+    else {
+        size = (size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1);
+    }
+
+    if (block == NULL) {
+        if (TLS_POOL_ARENA_SIZE - arena->offset < size) {
+            return NULL;
+        }
+        block = (block_header_t *)(arena->base + arena->offset);
+        arena->offset += size;
+        if (arena->offset > arena->peak) {
+            arena->peak = arena->offset;
+        }
+    }
+
+    block->size = size;
+    block->arena = arena - s_arenas;
+    block->magic = BLOCK_MAGIC;
+    arena->live++;
+    arena->in_use += size;
+    return block;
+}
+
+/* Must be called with the lock held */
+static void arena_free(tls_pool_arena_t *arena, block_header_t *block) {
+    size_t size = block->size;
+    block->magic = 0;
+    arena->live--;
+    arena->in_use -= size;
+
+    if (arena->live == 0) {
+        arena_release(arena);
+    }
+    else if ((uint8_t *)block + size == arena->base + arena->offset) {
+        // Last block of the bump region, typical of nested handshake temporaries
+        arena->offset -= size;
+    }
+    else if (size <= SMALL_CLASS_MAX) {
+        int index = small_class(size);
+        free_block_t *free_block = (free_block_t *)block;
+        free_block->next = arena->free_lists[index];
+        arena->free_lists[index] = free_block;
+    }
+    // Large blocks in the middle of the arena are reclaimed when the arena is released
+}
+
+void *esp_mbedtls_mem_calloc(size_t n, size_t size) {
+    if (n != 0 && size > (SIZE_MAX - sizeof(block_header_t)) / n) {
+        return NULL;
+    }
+    size_t length = n * size;
+    block_header_t *block = NULL;
+    bool pooled = false;
+
+    if (length != 0) {
+        taskENTER_CRITICAL(&s_lock);
+        tls_pool_arena_t *arena = arena_of_current_task();
+        if (arena != NULL && !arena->suspended) {
+            pooled = true;
+            block = arena_alloc(arena, length + sizeof(block_header_t));
+            if (block == NULL) {
+                s_fallbacks++;
+            }
+        }
+        taskEXIT_CRITICAL(&s_lock);
+    }
+
+    if (block == NULL) {
+        if (pooled) {
+            ESP_LOGD(TAG, "Arena full, %u bytes from heap", (unsigned)length);
+        }
+        return heap_caps_calloc(n, size, HEAP_CAPS);
+    }
+    void *ptr = block + 1;
+    memset(ptr, 0, length);
+    return ptr;
+}
+
+void esp_mbedtls_mem_free(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    for (int i = 0; i < TLS_POOL_ARENAS; i++) {
+        tls_pool_arena_t *arena = &s_arenas[i];
+        if ((uint8_t *)ptr > arena->base && (uint8_t *)ptr < arena->base + TLS_POOL_ARENA_SIZE) {
+            block_header_t *block = (block_header_t *)ptr - 1;
+            assert(block->magic == BLOCK_MAGIC && block->arena == i);
+            taskENTER_CRITICAL(&s_lock);
+            arena_free(arena, block);
+            taskEXIT_CRITICAL(&s_lock);
+            return;
+        }
+    }
+    heap_caps_free(ptr);
+}
+
+int tls_pool_arena_begin(void) {
+    int ret = -1;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    taskENTER_CRITICAL(&s_lock);
+    if (arena_of_current_task() != NULL) {
+        ret = 0;
+    }
+    else {
+        tls_pool_arena_t *candidate = NULL;
+        for (int i = 0; i < TLS_POOL_ARENAS; i++) {
+            if (s_arenas[i].base == NULL || s_arenas[i].owner != NULL) {
+                continue;
+            }
+            // Prefer an empty arena over one still draining
+            if (candidate == NULL || (candidate->live != 0 && s_arenas[i].live == 0)) {
+                candidate = &s_arenas[i];
+            }
+        }
+        if (candidate != NULL) {
+            candidate->owner = task;
+            ret = 0;
+        }
+    }
+    taskEXIT_CRITICAL(&s_lock);
+    return ret;
+}
+
+void tls_pool_arena_end(void) {
+    taskENTER_CRITICAL(&s_lock);
+    tls_pool_arena_t *arena = arena_of_current_task();
+    if (arena != NULL) {
+        arena_unbind(arena);
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static void arena_set_suspended(bool suspended) {
+    taskENTER_CRITICAL(&s_lock);
+    tls_pool_arena_t *arena = arena_of_current_task();
+    if (arena != NULL) {
+        arena->suspended = suspended;
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void tls_pool_arena_suspend(void) {
+    arena_set_suspended(true);
+}
+
+void tls_pool_arena_resume(void) {
+    arena_set_suspended(false);
+}
+
+void tls_pool_arena_release(void *task) {
+    if (task == NULL) {
+        return;
+    }
+    taskENTER_CRITICAL(&s_lock);
+    tls_pool_arena_t *arena = arena_of_task((TaskHandle_t)task);
+    if (arena != NULL) {
+        arena_unbind(arena);
+    }
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+void tls_pool_get_stats(tls_pool_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    taskENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < TLS_POOL_ARENAS; i++) {
+        stats->in_use += s_arenas[i].in_use;
+        if (s_arenas[i].peak > stats->peak) {
+            stats->peak = s_arenas[i].peak;
+        }
+        if (s_arenas[i].owner != NULL) {
+            stats->bound++;
+        }
+    }
+    stats->resets = s_resets;
+    stats->fallbacks = s_fallbacks;
+    stats->draining = s_draining;
+    taskEXIT_CRITICAL(&s_lock);
+    heap_fragmentation(stats);
+}
+
+#else
+
+/* CONFIG_QUARKLINK_TLS_POOL is off: no arena, the mbedtls hooks only forward to the heap */
+
+int tls_pool_init(void) {
+    ESP_LOGD(TAG, "No arena reserved");
+    return 0;
+}
+
+void *esp_mbedtls_mem_calloc(size_t n, size_t size) {
+    return heap_caps_calloc(n, size, HEAP_CAPS);
+}
+
+void esp_mbedtls_mem_free(void *ptr) {
+    heap_caps_free(ptr);
+}
+
+int tls_pool_arena_begin(void) {
+    return -1;
+}
+
+void tls_pool_arena_end(void) {
+}
+
+void tls_pool_arena_suspend(void) {
+}
+
+void tls_pool_arena_resume(void) {
+}
+
+void tls_pool_arena_release(void *task) {
+}
+
+void tls_pool_get_stats(tls_pool_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    heap_fragmentation(stats);
+}
+
+#endif /* TLS_POOL */
@@ -0,0 +1,130 @@
+/**
+ * \file tls_pool.h
+ * \brief Pooled allocator for mbedtls, plugged in with CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC.
+ *
+ * A few connection arenas are reserved at boot, before the heap gets fragmented.
+ * A task binds an arena before opening a TLS connection, then every mbedtls allocation
+ * made by that task (handshake state, ML-KEM context, shared secrets, record buffers...)
+ * is served from the arena: small blocks are recycled through size-class free lists,
+ * larger ones are bump-allocated. When the last block of an arena is freed, the whole
+ * arena is released in one shot, so reconnects never fragment the general heap.
+ * Allocations that do not fit, or that are made outside of an arena, use the internal heap.
+ *
+ * The arenas take TLS_POOL_ARENAS * TLS_POOL_ARENA_SIZE bytes of internal RAM for the lifetime of the
+ * application: CONFIG_QUARKLINK_TLS_POOL turns them off (the default on the ESP32-C3), the hooks then
+ * only forward to the heap.
+ */
+#ifndef _TLS_POOL_H_
+#define _TLS_POOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Whether the arenas are reserved: CONFIG_QUARKLINK_TLS_POOL on the device, always in the host benches */
+#ifndef TLS_POOL
+#if defined(CONFIG_QUARKLINK_TLS_POOL) || !defined(ESP_PLATFORM)
+#define TLS_POOL            (1)
+#else
+#define TLS_POOL            (0)
+#endif
+#endif
+
+/** Number of connection arenas, i.e. of TLS connections that can be pooled at the same time */
+#ifndef TLS_POOL_ARENAS
+#ifdef CONFIG_QUARKLINK_TLS_POOL_ARENAS
+#define TLS_POOL_ARENAS     CONFIG_QUARKLINK_TLS_POOL_ARENAS
+#else
+#define TLS_POOL_ARENAS     (2)
+#endif
+#endif
+
+/** Size of each connection arena, in bytes: the 39920-byte peak of a connection in quarklink-tls-pool-bench,
+ * plus a margin for its estimated sizes */
+#ifndef TLS_POOL_ARENA_SIZE
+#ifdef CONFIG_QUARKLINK_TLS_POOL_ARENA_SIZE
+#define TLS_POOL_ARENA_SIZE CONFIG_QUARKLINK_TLS_POOL_ARENA_SIZE
+#else
+#define TLS_POOL_ARENA_SIZE (48 * 1024)
+#endif
+#endif
+
+/**
+ * \brief Allocator statistics
+ */
+typedef struct {
+    /** Bytes currently allocated from the arenas */
+    size_t in_use;
+    /** Highest number of bytes ever used by a single arena (including size-class slack) */
+    size_t peak;
+    /** Number of times an arena was released in one shot */
+    uint32_t resets;
+    /** Number of allocations served by the heap because the arena was full */
+    uint32_t fallbacks;
+    /** Number of arenas that were released by their task while blocks were still allocated */
+    uint32_t draining;
+    /** Number of arenas currently bound to a task */
+    uint32_t bound;
+    /** Heap fragmentation in percent: 100 * (1 - largest free block / free heap) */
+    uint32_t heap_fragmentation;
+} tls_pool_stats_t;
+
+/**
+ * \brief Reserve the connection arenas. Call early in app_main.
+ * \return 0 for success, -1 if the arenas could not be reserved (the heap is used instead)
+ */
+int tls_pool_init(void);
+
+/**
+ * \brief Bind a free arena to the calling task. Does nothing if the task already has one.
+ * \return 0 for success, -1 if no arena is available (the heap is used instead)
+ */
+int tls_pool_arena_begin(void);
+
+/**
+ * \brief Unbind the arena of the calling task. The arena is released as soon as all its
+ * blocks have been freed.
+ */
+void tls_pool_arena_end(void);
+
+/**
+ * \brief Serve the allocations of the calling task from the heap until \ref tls_pool_arena_resume, e.g. to
+ * parse a certificate kept across connections, which would otherwise keep the arena from being released.
+ */
+void tls_pool_arena_suspend(void);
+
+/**
+ * \brief Serve the allocations of the calling task from its arena again.
+ */
+void tls_pool_arena_resume(void);
+
+/**
+ * \brief Unbind the arena of another task, which will not call \ref tls_pool_arena_end itself: e.g. the
+ * MQTT task of a client being destroyed. Call it once the task is gone, before its handle can be reused.
+ * \param[in] task the task handle, NULL is ignored
+ */
+void tls_pool_arena_release(void *task);
+
+/**
+ * \brief Get a snapshot of the allocator statistics.
+ */
+void tls_pool_get_stats(tls_pool_stats_t *stats);
+
+/**
+ * \brief mbedtls allocation hooks, see CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC.
+ */
+void *esp_mbedtls_mem_calloc(size_t n, size_t size);
+void esp_mbedtls_mem_free(void *ptr);
+
+#ifdef __cplusplus
+} /* end of extern "C" */
+#endif
+
+#endif // _TLS_POOL_H_
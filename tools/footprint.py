@@ -0,0 +1,407 @@
+#!/usr/bin/env python3
+"""
+Footprint and stack usage of every PlatformIO environment, checked against the limits of platformio.ini.
+
+For each environment it:
+  - builds the firmware with PlatformIO in .pio/footprint, with QL_FOOTPRINT=1 so that every component
+    (mbedtls and its patches, esp-tls, esp_mqtt, the application) is compiled with -fcallgraph-info=su
+  - sums the flash code, flash data, IRAM and DRAM of every component (static library) from the link map
+  - reports the headroom of the image in the factory and OTA partitions of the environment's partition table
+  - walks the call graph written by GCC (one .ci file per object, with the stack frame of each function)
+    from the roots of custom_footprint_stacks, and reports the worst-case stack and path of each
+
+A path through a function pointer or into a library built without the flag (the QuarkLink client) stops
+there: the graph counts these calls as unresolved and the worst case is then a lower bound. Recursion and
+frames of dynamic size (alloca, variable-length arrays) are reported as well.
+
+The limits are options of the [env] section of platformio.ini, an environment may override them:
+  custom_footprint_min_headroom   bytes left in the smallest app partition
+  custom_footprint_stack_margin   bytes left on every stack budget, for interrupts and unresolved calls
+  custom_footprint_stacks         one "function=budget" per line, the budget in bytes
+  custom_footprint_max_growth     most bytes a memory type or a stack may grow over the --baseline report
+  custom_footprint_enforce        yes to exit with an error when a limit is exceeded, no to only report it
+
+While the limits are estimates (custom_footprint_enforce = no) an exceeded limit is printed as a warning and the
+tool succeeds; --enforce makes it fail anyway.
+
+--suggest prints the limits the measured environments would just meet, in the syntax of platformio.ini:
+the smallest headroom less the allowed growth, and each worst-case stack plus the margin and the growth. A stack
+suggested over its current budget does not fit the task it runs in: the stack size has to grow first.
+
+Example:
+  python3 tools/footprint.py --json footprint.json
+  python3 tools/footprint.py -e esp32-c3-ds-release --baseline footprint.json
+  python3 tools/footprint.py --no-build --suggest
+"""
+import argparse
+import configparser
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+
+MEMORY_TYPES = ("flash_code", "flash_data", "iram", "dram")
+
+# Output sections of the ESP-IDF linker scripts, by memory type. The rest (RTC memory, PSRAM, debug) is not counted.
+SECTION_TYPES = [
+    (re.compile(r"^\.flash\.text$"), "flash_code"),
+    (re.compile(r"^\.flash\.(rodata|appdesc)$"), "flash_data"),
+    (re.compile(r"^\.iram0\."), "iram"),
+    (re.compile(r"^\.(dram0\.|noinit$)"), "dram"),
+]
+
+OUTPUT_SECTION = re.compile(r"^(\.[\w.]+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+))?\s*$")
+INPUT_SECTION = re.compile(r"^ (\.[\w.$]+|COMMON)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?\s*$")
+INPUT_CONTINUATION = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+ARCHIVE_MEMBER = re.compile(r"^(.*?)\(([^()]+)\)$")
+
+CI_NODE = re.compile(r'^node: \{ title: "([^"]+)" label: "([^"]*)"')
+CI_EDGE = re.compile(r'^edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+CI_STACK = re.compile(r"\\n(\d+) bytes \(([\w,]+)\)")
+INDIRECT_CALL = "__indirect_call"
+
+
+def parse_size(text):
+    text = text.strip()
+    if text.upper().endswith("K"):
+        return int(text[:-1], 0) * 1024
+    if text.upper().endswith("M"):
+        return int(text[:-1], 0) * 1024 * 1024
+    return int(text, 0)
+
+
+def load_config(path, envs):
+    """Options of each environment, with the ones of [env] inherited"""
+    config = configparser.ConfigParser(interpolation=None, inline_comment_prefixes=(";", "#"))
+    config.read(path)
+    base = dict(config["env"]) if config.has_section("env") else {}
+    available = [section[len("env:"):] for section in config.sections() if section.startswith("env:")]
+    for env in envs:
+        if env not in available:
+            sys.exit(f"{env} is not an environment of {path}")
+    result = {}
+    for env in envs or available:
+        options = dict(base)
+        options.update(config[f"env:{env}"])
+        stacks = []
+        for line in options.get("custom_footprint_stacks", "").split("\n"):
+            if line.strip():
+                name, budget = line.split("=")
+                stacks.append((name.strip(), parse_size(budget)))
+        result[env] = {
+            "partitions": options.get("board_build.partitions"),
+            "min_headroom": parse_size(options.get("custom_footprint_min_headroom", "0")),
+            "stack_margin": parse_size(options.get("custom_footprint_stack_margin", "0")),
+            "max_growth": parse_size(options.get("custom_footprint_max_growth", "0")),
+            "enforce": options.get("custom_footprint_enforce", "yes").strip().lower() in ("yes", "true", "1"),
+            "stacks": stacks,
+        }
+    return result
+
+
+def build(project_dir, build_dir, env):
+    environ = dict(os.environ, PLATFORMIO_BUILD_DIR=build_dir, QL_FOOTPRINT="1")
+    result = subprocess.run(["pio", "run", "-e", env], cwd=project_dir, env=environ)
+    if result.returncode != 0:
+        sys.exit(f"{env}: build failed")
+
+
+def component_of(path):
+    """lib<component>.a for the objects of a static library, the object name otherwise"""
+    match = ARCHIVE_MEMBER.match(path)
+    name = os.path.basename(match.group(1) if match else path)
+    if name.startswith("lib") and name.endswith(".a"):
+        return name[3:-2]
+    return name
+
+
+def memory_type(section):
+    for pattern, kind in SECTION_TYPES:
+        if pattern.match(section):
+            return kind
+    return None
+
+
+def parse_map(path):
+    """Bytes of each memory type per component, from the input sections of the link map"""
+    components = {}
+    with open(path, errors="replace") as f:
+        lines = f.read().split("\n")
+    try:
+        start = lines.index("Linker script and memory map")
+    except ValueError:
+        sys.exit(f"{path}: no memory map")
+    kind = None
+    pending = False
+    for line in lines[start + 1:]:
+        match = OUTPUT_SECTION.match(line)
+        if match:
+            kind = memory_type(match.group(1))
+            pending = False
+            continue
+        if kind is None:
+            continue
+        match = INPUT_SECTION.match(line)
+        if match:
+            if match.group(2) is None:
+                # Long section names put the address, the size and the file on the next line
+                pending = True
+                continue
+            size, source = int(match.group(3), 16), match.group(4)
+        elif pending and INPUT_CONTINUATION.match(line):
+            match = INPUT_CONTINUATION.match(line)
+            size, source = int(match.group(2), 16), match.group(3)
+        else:
+            pending = False
+            continue
+        pending = False
+        if size > 0:
+            sizes = components.setdefault(component_of(source.strip()), dict.fromkeys(MEMORY_TYPES, 0))
+            sizes[kind] += size
+    return components
+
+
+def parse_partitions(path):
+    """Size of every app partition"""
+    apps = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split("#")[0].strip()
+            fields = [field.strip() for field in line.split(",")]
+            if len(fields) >= 5 and fields[1] == "app":
+                apps[fields[0]] = parse_size(fields[4])
+    return apps
+
+
+class CallGraph:
+    def __init__(self):
+        # title -> (frame bytes, qualifier, location), only for the functions compiled with the flag
+        self.frames = {}
+        self.calls = {}
+
+    def load(self, path):
+        with open(path, errors="replace") as f:
+            for line in f:
+                match = CI_NODE.match(line)
+                if match:
+                    stack = CI_STACK.search(match.group(2))
+                    if stack:
+                        location = match.group(2).split("\\n")[1] if "\\n" in match.group(2) else ""
+                        self.frames[match.group(1)] = (int(stack.group(1)), stack.group(2), location)
+                    continue
+                match = CI_EDGE.match(line)
+                if match:
+                    self.calls.setdefault(match.group(1), set()).add(match.group(2))
+
+    def resolve(self, name):
+        """Titles of the functions called `name`: static functions are titled file:name"""
+        if name in self.frames:
+            return [name]
+        return [title for title in self.frames if title.endswith(":" + name)]
+
+    def worst(self, root):
+        """Worst-case stack from `root`: (bytes, path, unresolved calls, recursive functions, dynamic frames)"""
+        memo = {}
+        unresolved = set()
+        recursive = set()
+        dynamic = set()
+        active = set()
+
+        def visit(title):
+            if title in memo:
+                return memo[title]
+            if title not in self.frames:
+                unresolved.add(title)
+                return 0, []
+            if title in active:
+                recursive.add(title)
+                return 0, []
+            frame, qualifier, _ = self.frames[title]
+            if qualifier != "static":
+                dynamic.add(title)
+            active.add(title)
+            best = (0, [])
+            for callee in sorted(self.calls.get(title, ())):
+                cost = visit(callee)
+                if cost[0] > best[0]:
+                    best = cost
+            active.discard(title)
+            memo[title] = (frame + best[0], [title] + best[1])
+            return memo[title]
+
+        stack, path = visit(root)
+        return stack, path, unresolved, recursive, dynamic
+
+
+def analyse(build_dir, env, options):
+    env_dir = os.path.join(build_dir, env)
+    maps = glob.glob(os.path.join(env_dir, "*.map"))
+    if not maps:
+        sys.exit(f"{env}: no link map in {env_dir}")
+    report = {"components": parse_map(max(maps, key=os.path.getmtime)), "partitions": {}, "stacks": {}}
+    image = os.path.join(env_dir, "firmware.bin")
+    report["image"] = os.path.getsize(image)
+    if options["partitions"]:
+        for name, size in parse_partitions(options["partitions"]).items():
+            report["partitions"][name] = size - report["image"]
+
+    graph = CallGraph()
+    for path in glob.glob(os.path.join(env_dir, "**", "*.ci"), recursive=True):
+        graph.load(path)
+    for root, budget in options["stacks"]:
+        titles = graph.resolve(root)
+        if not titles:
+            report["stacks"][root] = None
+            continue
+        stack, path, unresolved, recursive, dynamic = max((graph.worst(title) for title in titles), key=lambda w: w[0])
+        report["stacks"][root] = {
+            "bytes": stack,
+            "budget": budget,
+            "path": [(title, graph.frames[title][0]) for title in path],
+            "unresolved": len(unresolved),
+            "indirect": INDIRECT_CALL in unresolved,
+            "recursive": sorted(recursive),
+            "dynamic": sorted(dynamic),
+        }
+    return report
+
+
+def totals(report):
+    return {kind: sum(sizes[kind] for sizes in report["components"].values()) for kind in MEMORY_TYPES}
+
+
+def check(env, report, options, baseline):
+    failures = []
+    if report["partitions"]:
+        name, headroom = min(report["partitions"].items(), key=lambda item: item[1])
+        if headroom < options["min_headroom"]:
+            failures.append(f"{env}: {headroom} bytes left in {name}, below {options['min_headroom']}")
+    for root, stack in report["stacks"].items():
+        if stack is None:
+            failures.append(f"{env}: {root} not found in the call graph")
+        elif stack["bytes"] + options["stack_margin"] > stack["budget"]:
+            failures.append(f"{env}: {root} needs {stack['bytes']} bytes of its {stack['budget']} "
+                            f"with a margin of {options['stack_margin']}")
+    if baseline is not None and env in baseline and options["max_growth"] > 0:
+        before = totals(baseline[env])
+        for kind, size in totals(report).items():
+            if size - before[kind] > options["max_growth"]:
+                failures.append(f"{env}: {kind} grew by {size - before[kind]} bytes")
+        for root, stack in report["stacks"].items():
+            previous = baseline[env]["stacks"].get(root)
+            if stack is not None and previous is not None and stack["bytes"] - previous["bytes"] > options["max_growth"]:
+                failures.append(f"{env}: {root} stack grew by {stack['bytes'] - previous['bytes']} bytes")
+    return failures
+
+
+def print_report(env, report, top):
+    print(f"{env}: image {report['image']} bytes")
+    for name, headroom in sorted(report["partitions"].items()):
+        print(f"  {name:<12} {headroom:>10} bytes left")
+    print(f"  {'component':<36} {'flash code':>10} {'flash data':>10} {'iram':>8} {'dram':>8}")
+    components = sorted(report["components"].items(), key=lambda item: -sum(item[1].values()))
+    for name, sizes in components[:top]:
+        print(f"  {name[:36]:<36} {sizes['flash_code']:>10} {sizes['flash_data']:>10} {sizes['iram']:>8} {sizes['dram']:>8}")
+    if len(components) > top:
+        print(f"  ({len(components) - top} more)")
+    total = totals(report)
+    print(f"  {'total':<36} {total['flash_code']:>10} {total['flash_data']:>10} {total['iram']:>8} {total['dram']:>8}")
+    print(f"  {'stack from':<36} {'worst':>10} {'budget':>10} {'unresolved':>10}")
+    for root, stack in report["stacks"].items():
+        if stack is None:
+            print(f"  {root[:36]:<36} {'-':>10} {'-':>10} {'not found':>10}")
+            continue
+        bound = ">=" if stack["unresolved"] or stack["recursive"] or stack["dynamic"] else ""
+        print(f"  {root[:36]:<36} {bound + str(stack['bytes']):>10} {stack['budget']:>10} {stack['unresolved']:>10}")
+        print("    " + " > ".join(f"{title} ({frame})" for title, frame in stack["path"]))
+        if stack["recursive"]:
+            print("    recursive: " + ", ".join(stack["recursive"]))
+        if stack["dynamic"]:
+            print("    dynamic frames: " + ", ".join(stack["dynamic"]))
+
+
+def round_down(value, step):
+    return value // step * step
+
+
+def round_up(value, step):
+    return -(-value // step) * step
+
+
+def print_suggestion(reports, config):
+    """Limits of platformio.ini that every measured environment meets with the allowed growth to spare"""
+    options = next(iter(config.values()))
+    growth = options["max_growth"]
+    headrooms = [min(report["partitions"].values()) for report in reports.values() if report["partitions"]]
+    print("; Limits from the measured environments: " + ", ".join(sorted(reports)))
+    if headrooms:
+        print(f"custom_footprint_min_headroom = {max(round_down(min(headrooms) - growth, 1024), 0) // 1024}K")
+    print(f"custom_footprint_stack_margin = {options['stack_margin']}")
+    print(f"custom_footprint_max_growth = {growth}")
+    print("custom_footprint_stacks =")
+    for root, budget in options["stacks"]:
+        worst = [report["stacks"][root]["bytes"] for report in reports.values() if report["stacks"].get(root)]
+        if worst:
+            # A budget is at most the stack the task or caller really has
+            suggested = round_up(max(worst) + options["stack_margin"] + growth, 256)
+            note = f" ; over the current {budget}" if suggested > budget else ""
+            print(f"    {root}={suggested}{note}")
+        else:
+            print(f"    ; {root} not found in the call graph")
+
+
+def main():
+    # The call graph of mbedtls is deep
+    sys.setrecursionlimit(20000)
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-e", "--environment", action="append", default=[], help="environment, all by default")
+    parser.add_argument("-d", "--project-dir", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+    parser.add_argument("--no-build", action="store_true", help="analyse the last build in .pio/footprint")
+    parser.add_argument("--json", help="write the report to this file, to use as a baseline")
+    parser.add_argument("--baseline", help="report of a previous run to check the growth against")
+    parser.add_argument("--top", type=int, default=15, help="components listed per environment (15)")
+    parser.add_argument("--suggest", action="store_true", help="print the limits the environments would meet")
+    parser.add_argument("--enforce", action="store_true", help="fail on an exceeded limit, even one only reported")
+    args = parser.parse_args()
+
+    project_dir = os.path.abspath(args.project_dir)
+    build_dir = os.path.join(project_dir, ".pio", "footprint")
+    config = load_config(os.path.join(project_dir, "platformio.ini"), args.environment)
+    baseline = None
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    reports = {}
+    failures = []
+    warnings = []
+    for env, options in config.items():
+        if not args.no_build:
+            build(project_dir, build_dir, env)
+        if options["partitions"]:
+            options["partitions"] = os.path.join(project_dir, options["partitions"])
+        reports[env] = analyse(build_dir, env, options)
+        print_report(env, reports[env], args.top)
+        if options["enforce"] or args.enforce:
+            failures += check(env, reports[env], options, baseline)
+        else:
+            warnings += check(env, reports[env], options, baseline)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(reports, f, indent=1)
+    if args.suggest:
+        print_suggestion(reports, config)
+    for warning in warnings:
+        print(f"over an estimated limit, not enforced: {warning}")
+    for failure in failures:
+        print(f"FAILED: {failure}", file=sys.stderr)
+    if failures:
+        sys.exit(1)
+    print("all enforced limits met" if warnings else "all limits met")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Check that the ESP-IDF and mbedtls patches apply to a framework-espidf package, in the
+order patches/apply_patch.py applies them: `patch -p1 --dry-run`, the command of the build,
+on a copy of the files they touch, each patch checked on top of the previous ones. The
+package is left untouched. certcomp_mbedtls.patch is checked even though the build only
+applies it with CONFIG_QUARKLINK_CERT_COMPRESSION.
+
+Run it against the package pinned in platformio.ini (espressif32 @6.9.0, ESP-IDF 5.3.1)
+before a build has patched it, e.g. after `pio pkg install`.
+
+Example:
+  python3 tools/patch_check.py ~/.platformio/packages/framework-espidf
+"""
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+PATCH_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "patches")
+MBEDTLS_DIR = "components/mbedtls/mbedtls"
+# The patches and the directories they apply to, in the order of apply_patch.py
+PATCHES = [
+    ("ds_idf.patch", ""),
+    ("ds_mbedtls.patch", MBEDTLS_DIR),
+    ("mlkem_mbedtls.patch", MBEDTLS_DIR),
+    ("certcomp_mbedtls.patch", MBEDTLS_DIR),
+]
+
+
+def touched_files(patch):
+    files = []
+    with open(patch) as f:
+        for line in f:
+            if line.startswith("--- a/"):
+                files.append(line[len("--- a/"):].rstrip("\n").split("\t")[0])
+    return files
+
+
+def framework_version(framework):
+    try:
+        with open(os.path.join(framework, "package.json")) as f:
+            return json.load(f).get("version", "unknown")
+    except (OSError, ValueError):
+        return "unknown"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("framework", nargs="?",
+                        default=os.path.expanduser("~/.platformio/packages/framework-espidf"),
+                        help="the framework-espidf package (default: %(default)s)")
+    args = parser.parse_args()
+    if not os.path.isdir(os.path.join(args.framework, MBEDTLS_DIR)):
+        raise SystemExit(f"{args.framework}: no {MBEDTLS_DIR}, not a framework-espidf package")
+    for name, subdir in PATCHES:
+        if os.path.isfile(os.path.join(args.framework, subdir, f".{name}-done")):
+            raise SystemExit(f"{args.framework}: already patched with {name}")
+    print(f"framework-espidf {framework_version(args.framework)}")
+
+    failures = 0
+    with tempfile.TemporaryDirectory() as work:
+        for name, subdir in PATCHES:
+            patch = os.path.join(PATCH_DIR, name)
+            root = os.path.join(work, subdir)
+            os.makedirs(root, exist_ok=True)
+            # Copy the files the patch modifies, unless an earlier patch already did
+            for path in touched_files(patch):
+                source = os.path.join(args.framework, subdir, path)
+                target = os.path.join(root, path)
+                if not os.path.exists(target) and os.path.isfile(source):
+                    os.makedirs(os.path.dirname(target), exist_ok=True)
+                    shutil.copyfile(source, target)
+            command = ["patch", "-p1", "-N", "-i", os.path.abspath(patch), "-d", root]
+            check = subprocess.run(command + ["--dry-run"], capture_output=True, text=True)
+            if check.returncode != 0:
+                failures += 1
+                print(f"{name}: FAILED")
+                print((check.stdout + check.stderr).rstrip())
+                continue
+            # Apply it, so that the next patches are checked on top
+            subprocess.run(command + ["-s"], check=True)
+            print(f"{name}: applies")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
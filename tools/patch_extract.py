@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+"""
+Write the files created by a patch (the "new file" entries) to a directory, without
+needing the tree the patch applies to. The host build uses it to compile the ML-KEM
+sources of patches/mlkem_mbedtls.patch.
+
+Example:
+  python3 tools/patch_extract.py patches/mlkem_mbedtls.patch build/mlkem library/kem.c library/kem.h
+"""
+import argparse
+import os
+import re
+import sys
+
+HUNK = re.compile(r"^@@ -0,0 \+1(?:,(\d+))? @@")
+
+
+def new_files(patch):
+    files = {}
+    with open(patch) as f:
+        lines = f.read().split("\n")
+    i = 0
+    while i < len(lines):
+        if lines[i].startswith("+++ b/") and lines[i - 1] == "--- /dev/null":
+            name = lines[i][len("+++ b/"):]
+            match = HUNK.match(lines[i + 1])
+            if match is None:
+                raise SystemExit(f"{patch}:{i + 2}: unexpected hunk for {name}")
+            count = int(match.group(1) or 1)
+            body = lines[i + 2:i + 2 + count]
+            if any(not line.startswith("+") for line in body):
+                raise SystemExit(f"{patch}: truncated hunk for {name}")
+            files[name] = "".join(line[1:] + "\n" for line in body)
+            i += 2 + count
+        else:
+            i += 1
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("patch")
+    parser.add_argument("output", help="directory the files are written to, without their path")
+    parser.add_argument("files", nargs="+", help="files to extract, as named in the patch")
+    args = parser.parse_args()
+
+    files = new_files(args.patch)
+    os.makedirs(args.output, exist_ok=True)
+    for name in args.files:
+        if name not in files:
+            sys.exit(f"{name} is not created by {args.patch}")
+        path = os.path.join(args.output, os.path.basename(name))
+        # Leave unchanged files alone so that they are not rebuilt
+        if os.path.exists(path):
+            with open(path) as f:
+                if f.read() == files[name]:
+                    continue
+        with open(path, "w") as f:
+            f.write(files[name])
+
+
+if __name__ == "__main__":
+    main()
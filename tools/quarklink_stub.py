@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+QuarkLink stub server for the Linux load test (host/loadtest.c).
+
+It serves the REST paths used by host/quarklink_linux.c over HTTPS:
+  GET  /devices/<id>/status    -> {"status": "enrolled" | "not_enrolled" | "fwupdate_required" | "revoked"}
+  POST /devices/<id>/enrol     -> {"iotHubEndpoint", "iotHubPort", "deviceCert", "iotHubRootCert"}
+  GET  /devices/<id>/firmware  -> 204, or 200 with a dummy image when an update is pending
+Every device is accepted; the state is kept in memory. Connections are kept alive between requests
+(HTTP/1.1) unless the client sends "Connection: close", and closed after --keepalive-timeout of idle time.
+
+Example:
+  openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes -days 30 \\
+      -subj /CN=127.0.0.1 -addext subjectAltName=IP:127.0.0.1 -keyout stub-key.pem -out stub-cert.pem
+  python3 tools/quarklink_stub.py --cert stub-cert.pem --key stub-key.pem --mqtt-port 1883
+"""
+import argparse
+import json
+import random
+import ssl
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DUMMY_DEVICE_CERT = "-----BEGIN CERTIFICATE-----\nc3R1Yg==\n-----END CERTIFICATE-----\n"
+
+
+class Stub:
+    def __init__(self, args):
+        self.args = args
+        self.lock = threading.Lock()
+        self.enrolled = set()
+        self.fwupdate = set()
+        self.requests = {"status": 0, "enrol": 0, "firmware": 0, "connections": 0}
+        self.mqtt_root = ""
+        if args.mqtt_ca:
+            with open(args.mqtt_ca) as f:
+                self.mqtt_root = f.read()
+
+    def count(self, kind):
+        with self.lock:
+            self.requests[kind] += 1
+
+    def status(self, device_id):
+        with self.lock:
+            if device_id not in self.enrolled:
+                return "not_enrolled"
+            if device_id in self.fwupdate:
+                return "fwupdate_required"
+            if random.random() < self.args.fwupdate_rate:
+                self.fwupdate.add(device_id)
+                return "fwupdate_required"
+            return "enrolled"
+
+    def enrol(self, device_id):
+        with self.lock:
+            self.enrolled.add(device_id)
+        return {
+            "iotHubEndpoint": self.args.mqtt_host,
+            "iotHubPort": self.args.mqtt_port,
+            "deviceCert": DUMMY_DEVICE_CERT,
+            "iotHubRootCert": self.mqtt_root,
+        }
+
+    def firmware(self, device_id):
+        with self.lock:
+            if device_id in self.fwupdate:
+                self.fwupdate.discard(device_id)
+                return True
+        return False
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        self.timeout = self.server.stub.args.keepalive_timeout
+        super().setup()
+        self.server.stub.count("connections")
+
+    def log_message(self, format, *args):
+        pass
+
+    def reply(self, code, body=b"", content_type="application/json"):
+        self.send_response(code)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        # close_connection is set by the "Connection" header of the request
+        self.send_header("Connection", "close" if self.close_connection else "keep-alive")
+        self.end_headers()
+        self.wfile.write(body)
+
+    def route(self, method):
+        stub = self.server.stub
+        parts = self.path.strip("/").split("/")
+        if len(parts) != 3 or parts[0] != "devices":
+            self.reply(404)
+            return
+        device_id, action = parts[1], parts[2]
+        if stub.args.latency_ms:
+            time.sleep(stub.args.latency_ms / 1000)
+
+        if method == "GET" and action == "status":
+            stub.count("status")
+            self.reply(200, json.dumps({"status": stub.status(device_id)}).encode())
+        elif method == "POST" and action == "enrol":
+            stub.count("enrol")
+            self.reply(200, json.dumps(stub.enrol(device_id)).encode())
+        elif method == "GET" and action == "firmware":
+            stub.count("firmware")
+            if stub.firmware(device_id):
+                self.reply(200, bytes(stub.args.image_size), "application/octet-stream")
+            else:
+                self.reply(204)
+        else:
+            self.reply(404)
+
+    def do_GET(self):
+        self.route("GET")
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        if length:
+            self.rfile.read(length)
+        self.route("POST")
+
+
+class StubServer(ThreadingHTTPServer):
+    daemon_threads = True
+    request_queue_size = 1024
+
+
+def report(stub, interval):
+    previous = dict(stub.requests)
+    while True:
+        time.sleep(interval)
+        with stub.lock:
+            current = dict(stub.requests)
+            enrolled = len(stub.enrolled)
+        rates = ", ".join(f"{k} {(current[k] - previous[k]) / interval:.1f}/s" for k in current)
+        print(f"enrolled {enrolled}, {rates}", flush=True)
+        previous = current
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--cert", required=True, help="server certificate (PEM)")
+    parser.add_argument("--key", required=True, help="server key (PEM)")
+    parser.add_argument("--mqtt-host", default="127.0.0.1", help="broker returned to the devices")
+    parser.add_argument("--mqtt-port", type=int, default=1883)
+    parser.add_argument("--mqtt-ca", help="broker root certificate, the devices use plain TCP when omitted")
+    parser.add_argument("--fwupdate-rate", type=float, default=0.0,
+                        help="probability that a status request reports a firmware update")
+    parser.add_argument("--image-size", type=int, default=64 * 1024, help="size of the dummy firmware image")
+    parser.add_argument("--latency-ms", type=float, default=0, help="processing time added to every request")
+    parser.add_argument("--keepalive-timeout", type=float, default=60,
+                        help="idle time after which a kept-alive connection is closed, in s")
+    parser.add_argument("--report", type=float, default=10, help="request rate report interval, in s")
+    args = parser.parse_args()
+
+    server = StubServer((args.host, args.port), Handler)
+    server.stub = Stub(args)
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(args.cert, args.key)
+    # The TLS handshake happens in the request thread, not in the accept loop
+    server.socket = context.wrap_socket(server.socket, server_side=True, do_handshake_on_connect=False)
+
+    threading.Thread(target=report, args=(server.stub, args.report), daemon=True).start()
+    print(f"QuarkLink stub on https://{args.host}:{args.port}, broker {args.mqtt_host}:{args.mqtt_port}", flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()